@@ -0,0 +1,21 @@
+/**
+ * One size of lib/fix_fft for the benchmarks
+ *
+ * fix_fft is built at one size per app (FFT_LOG2_N). CMakeLists.txt
+ * compiles this once for each size, with FFT_LOG2_N set, so its
+ * functions come out with the size on their names (fft_complex_10,
+ * fft_real_10, ...) and every size can be timed in the one program.
+ *
+ */
+#define BENCH_FFT_CAT2(name, bits) name##_##bits
+#define BENCH_FFT_CAT(name, bits) BENCH_FFT_CAT2(name, bits)
+
+#define fft_complex BENCH_FFT_CAT(fft_complex, FFT_LOG2_N)
+#define fft_real BENCH_FFT_CAT(fft_real, FFT_LOG2_N)
+#define fft_hann BENCH_FFT_CAT(fft_hann, FFT_LOG2_N)
+#define fft_mag BENCH_FFT_CAT(fft_mag, FFT_LOG2_N)
+#define fft_real_mag BENCH_FFT_CAT(fft_real_mag, FFT_LOG2_N)
+#define fft_db BENCH_FFT_CAT(fft_db, FFT_LOG2_N)
+#define fft_db_array BENCH_FFT_CAT(fft_db_array, FFT_LOG2_N)
+
+#include "fix_fft.c"
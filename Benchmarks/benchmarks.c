@@ -0,0 +1,349 @@
+/**
+ * On-target benchmarks
+ *
+ * A fixed battery of the kernels the demos depend on, timed in CPU
+ * cycles with SysTick, so a change to any of them can be measured (and
+ * a slowdown caught) on the board:
+ *  - VGA primitives: drawPixel, drawHLine, fillRect and drawChar
+ *  - lib/fix_fft: fft_complex() and fft_real() at 256 to 4096 points
+ *  - The CAN driver's checksum (table lookup, against the bitwise loop it
+ *    replaced), bitStuff() and unBitStuff()
+ *  - multfix15/divfix15 against float multiply and divide
+ *  - A protothread context switch: a yield, through the scheduler and
+ *    another thread that yields straight back
+ * The battery runs twice: first with the VGA driver not started, then
+ * after initVGA(), with its DMA streaming the framebuffer to the PIO, so
+ * the second run shows what sharing the bus with scanout costs.
+ *
+ * OUTPUT (serial, 115200 baud)
+ *  - Lines starting with # are comments. The first gives the system
+ *    clock: "# sysclk_hz,125000000"
+ *  - One line per benchmark:
+ *      bench,<name>,<vga off|on>,<ops per call>,<cycles per op>,<best>
+ *    where cycles per op is the mean over every call (interrupts and
+ *    all) and best is the fastest call's
+ *  - "# done" once both runs have finished
+ *
+ * HARDWARE CONNECTIONS
+ *  - The VGA connections of lib/vga_graphics (for the second run; the
+ *    numbers come out the same without a monitor)
+ *
+ * RESOURCES USED
+ *  - Those of lib/vga_graphics, once the second run starts
+ *  - The SysTick of core 0, for timing
+ *  - 32 kBytes of RAM for the FFT buffers
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+
+#include "hotpath.h"
+#include "fixed_point.h"
+#include "vga_graphics.h"
+#include "can_driver.h"
+#include "pt_cornell_rp2040_v1.h"
+
+// Calls of each benchmark (fewer for the FFTs, by size), and yields
+// timed for the context switch
+#ifndef BENCH_CALLS
+#define BENCH_CALLS 200
+#endif
+#ifndef BENCH_PT_ROUNDS
+#define BENCH_PT_ROUNDS 1000
+#endif
+
+// The operations one call does, for those that do many
+#define BENCH_BATCH 64
+
+// "off" or "on", for the report
+static const char * vga_state = "off" ;
+
+// Cycles taken by the timing itself (an empty call), taken off each call
+static uint32_t bench_overhead = 0 ;
+
+// Results of one benchmark
+typedef struct {
+    uint64_t total ;
+    uint32_t best ;
+} bench_result ;
+
+// Cycles for each of calls calls of run(i), with setup() (if any) before
+// each one, untimed. In RAM, so only what's timed runs from flash.
+static void HOT_KERNEL(timeBench)(void (*setup)(void), void (*run)(int), int calls, bench_result * r) {
+    r->total = 0 ;
+    r->best = 0xFFFFFFFF ;
+    for (int i=0; i<calls; i++) {
+        if (setup) setup() ;
+        // SysTick counts down, and wraps at 24 bits
+        uint32_t start = systick_hw->cvr ;
+        run(i) ;
+        uint32_t cycles = (start - systick_hw->cvr) & 0xFFFFFF ;
+        cycles = (cycles > bench_overhead) ? cycles - bench_overhead : 0 ;
+        r->total += cycles ;
+        if (cycles < r->best) r->best = cycles ;
+    }
+}
+
+static void report(const char * name, int ops, int calls, const bench_result * r) {
+    printf("bench,%s,%s,%d,%.1f,%.1f\n", name, vga_state, ops,
+           (double)r->total / calls / ops, (double)r->best / ops) ;
+}
+
+static void bench(const char * name, void (*setup)(void), void (*run)(int), int calls, int ops) {
+    bench_result r ;
+    timeBench(setup, run, calls, &r) ;
+    report(name, ops, calls, &r) ;
+}
+
+static void HOT_KERNEL(runNothing)(int i) {
+}
+
+////////////////////////////////// VGA ///////////////////////////////////
+
+static void HOT_KERNEL(runDrawPixel)(int i) {
+    short y = (i * 7) % 480 ;
+    for (int k=0; k<BENCH_BATCH; k++) drawPixel((k * 11 + i) % 640, y, k & 7) ;
+}
+
+static void HOT_KERNEL(runDrawHLine)(int i) {
+    drawHLine(i % 500, (i * 13) % 480, 100, i & 7) ;
+}
+
+static void HOT_KERNEL(runFillRect)(int i) {
+    fillRect((i * 17) % 540, (i * 13) % 380, 100, 100, i & 7) ;
+}
+
+static void HOT_KERNEL(runDrawChar)(int i) {
+    drawChar((i * 6) % 630, (i * 8) % 470, 'A' + (i % 26), i & 7, BLACK, 1) ;
+}
+
+////////////////////////////////// FFT ///////////////////////////////////
+
+// Each size of fix_fft, compiled with its size on its names (bench_fft.c)
+#define BENCH_FFT_DECLARE(bits)                                     \
+    void fft_complex_##bits(fix15 fr[], fix15 fi[]) ;               \
+    void fft_real_##bits(fix15 x[]) ;
+BENCH_FFT_DECLARE(8)
+BENCH_FFT_DECLARE(9)
+BENCH_FFT_DECLARE(10)
+BENCH_FFT_DECLARE(11)
+BENCH_FFT_DECLARE(12)
+
+static const struct {
+    int points ;
+    void (*complex)(fix15 fr[], fix15 fi[]) ;
+    void (*real)(fix15 x[]) ;
+} ffts[] = {
+    {256, fft_complex_8, fft_real_8},
+    {512, fft_complex_9, fft_real_9},
+    {1024, fft_complex_10, fft_real_10},
+    {2048, fft_complex_11, fft_real_11},
+    {4096, fft_complex_12, fft_real_12},
+} ;
+
+static fix15 fft_re[4096], fft_im[4096] ;
+static int fft_size ;
+
+// A fresh signal before each transform (a ramp with some noise, full of
+// nonzero bins), since the FFT works in place
+static void fftFill(void) {
+    for (int i=0; i<ffts[fft_size].points; i++) {
+        fft_re[i] = ((i * 37) & 0x3FFF) - 0x2000 + (rand() & 0xFF) ;
+        fft_im[i] = 0 ;
+    }
+}
+
+static void HOT_KERNEL(runFFTComplex)(int i) {
+    ffts[fft_size].complex(fft_re, fft_im) ;
+}
+
+static void HOT_KERNEL(runFFTReal)(int i) {
+    ffts[fft_size].real(fft_re) ;
+}
+
+////////////////////////////////// CAN ///////////////////////////////////
+
+// The checksum as the CAN driver did it before its table, a bit at a time
+static unsigned short HOT_KERNEL(crcBitwise)(char crcData, unsigned short crcReg) {
+    for (int i = 0; i < 8; i++) {
+        if (((crcReg & 0x8000) >> 8) ^ (crcData & 0x80)) crcReg = (crcReg << 1) ^ CRC16_POLY ;
+        else crcReg = (crcReg << 1) ;
+        crcData <<= 1 ;
+    }
+    return crcReg ;
+}
+
+static unsigned char crc_bytes[BENCH_BATCH] ;
+static volatile unsigned short crc_result ;
+
+static void HOT_KERNEL(runCRCTable)(int i) {
+    unsigned short crc = CRC_INIT ;
+    for (int k=0; k<BENCH_BATCH; k++) crc = culCalcCRC(crc_bytes[k], crc) ;
+    crc_result = crc ;
+}
+
+static void HOT_KERNEL(runCRCBitwise)(int i) {
+    unsigned short crc = CRC_INIT ;
+    for (int k=0; k<BENCH_BATCH; k++) crc = crcBitwise(crc_bytes[k], crc) ;
+    crc_result = crc ;
+}
+
+// A whole packet, with a full payload, stuffed and unstuffed
+static unsigned short bench_payload[MAX_PAYLOAD_SIZE>>1] ;
+static unsigned short bench_stuffed[MAX_STUFFED_PACKET_LEN>>1] ;
+static unsigned char bench_unstuffed[MAX_PACKET_LEN] ;
+
+static void HOT_KERNEL(runBitStuff)(int i) {
+    bitStuff(tx_packet_unstuffed, bench_stuffed) ;
+}
+
+static void HOT_KERNEL(runUnBitStuff)(int i) {
+    unBitStuff((unsigned char *)bench_stuffed, bench_unstuffed, MAX_PACKET_LEN) ;
+}
+
+////////////////////////////// Arithmetic ////////////////////////////////
+
+static fix15 fix_a[BENCH_BATCH], fix_b[BENCH_BATCH], fix_out[BENCH_BATCH] ;
+static float float_a[BENCH_BATCH], float_b[BENCH_BATCH], float_out[BENCH_BATCH] ;
+
+static void HOT_KERNEL(runMultfix15)(int i) {
+    for (int k=0; k<BENCH_BATCH; k++) fix_out[k] = multfix15(fix_a[k], fix_b[k]) ;
+}
+
+static void HOT_KERNEL(runMultFloat)(int i) {
+    for (int k=0; k<BENCH_BATCH; k++) float_out[k] = float_a[k] * float_b[k] ;
+}
+
+static void HOT_KERNEL(runDivfix15)(int i) {
+    for (int k=0; k<BENCH_BATCH; k++) fix_out[k] = divfix15(fix_a[k], fix_b[k]) ;
+}
+
+static void HOT_KERNEL(runDivFloat)(int i) {
+    for (int k=0; k<BENCH_BATCH; k++) float_out[k] = float_a[k] / float_b[k] ;
+}
+
+/////////////////////////////// The battery //////////////////////////////
+
+static void benchInit(void) {
+    // SysTick free running at the system clock
+    systick_hw->rvr = 0xFFFFFF ;
+    systick_hw->csr = 0x5 ;
+
+    for (int k=0; k<BENCH_BATCH; k++) {
+        crc_bytes[k] = rand() ;
+        fix_a[k] = (rand() & 0xFFFFF) - 0x80000 ;
+        fix_b[k] = (rand() & 0x3FFFF) + 0x1000 ;
+        float_a[k] = fix2float15(fix_a[k]) ;
+        float_b[k] = fix2float15(fix_b[k]) ;
+    }
+
+    // The packet: the driver's checksum and EOF, stuffed once for
+    // unBitStuff to take apart
+    buildCRCTable() ;
+    for (int k=0; k<(MAX_PAYLOAD_SIZE>>1); k++) bench_payload[k] = rand() ;
+    assemblePacket(MY_ARBITRATION_VALUE, 0, bench_payload, MAX_PAYLOAD_SIZE, bench_stuffed) ;
+
+    // The best of a few empty calls is the timing's own cost
+    bench_result r ;
+    timeBench(NULL, runNothing, 16, &r) ;
+    bench_overhead = r.best ;
+}
+
+static void runBattery(void) {
+    bench("drawPixel", NULL, runDrawPixel, BENCH_CALLS, BENCH_BATCH) ;
+    bench("drawHLine_100", NULL, runDrawHLine, BENCH_CALLS, 1) ;
+    bench("fillRect_100x100", NULL, runFillRect, BENCH_CALLS / 4, 1) ;
+    bench("drawChar", NULL, runDrawChar, BENCH_CALLS, 1) ;
+
+    for (fft_size=0; fft_size<(int)(sizeof(ffts) / sizeof(ffts[0])); fft_size++) {
+        char name[24] ;
+        // Fewer of the longer ones, so each size transforms as many points
+        int calls = 4096 * 4 / ffts[fft_size].points ;
+        snprintf(name, sizeof(name), "fft_complex_%d", ffts[fft_size].points) ;
+        bench(name, fftFill, runFFTComplex, calls, 1) ;
+        snprintf(name, sizeof(name), "fft_real_%d", ffts[fft_size].points) ;
+        bench(name, fftFill, runFFTReal, calls, 1) ;
+    }
+
+    bench("crc_table", NULL, runCRCTable, BENCH_CALLS, BENCH_BATCH) ;
+    bench("crc_bitwise", NULL, runCRCBitwise, BENCH_CALLS, BENCH_BATCH) ;
+    bench("bitStuff", NULL, runBitStuff, BENCH_CALLS, 1) ;
+    bench("unBitStuff", NULL, runUnBitStuff, BENCH_CALLS, 1) ;
+
+    bench("multfix15", NULL, runMultfix15, BENCH_CALLS, BENCH_BATCH) ;
+    bench("mult_float", NULL, runMultFloat, BENCH_CALLS, BENCH_BATCH) ;
+    bench("divfix15", NULL, runDivfix15, BENCH_CALLS, BENCH_BATCH) ;
+    bench("div_float", NULL, runDivFloat, BENCH_CALLS, BENCH_BATCH) ;
+}
+
+////////////////////////////// Protothreads //////////////////////////////
+
+// The other thread the scheduler switches to, which yields straight back
+static PT_THREAD (protothread_partner(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    while(1) {
+        PT_YIELD(pt) ;
+    }
+    PT_END(pt);
+}
+
+// Runs the battery, then times its own yields: each round is two
+// switches, out through the scheduler to the partner and back
+static PT_THREAD (protothread_bench(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    static int pass, round ;
+    static uint32_t start ;
+    static bench_result r ;
+
+    // A moment to open a terminal
+    PT_YIELD_usec(2000000) ;
+    printf("# sysclk_hz,%u\n", (unsigned int)clock_get_hz(clk_sys)) ;
+    printf("# bench,name,vga,ops,cycles_per_op,best_cycles_per_op\n") ;
+
+    for (pass=0; pass<2; pass++) {
+        if (pass == 1) {
+            initVGA() ;
+            vga_state = "on" ;
+            // Let scanout get going
+            PT_YIELD_usec(100000) ;
+        }
+        runBattery() ;
+
+        r.total = 0 ;
+        r.best = 0xFFFFFFFF ;
+        for (round=0; round<BENCH_PT_ROUNDS; round++) {
+            start = systick_hw->cvr ;
+            PT_YIELD(pt) ;
+            uint32_t cycles = (start - systick_hw->cvr) & 0xFFFFFF ;
+            r.total += cycles ;
+            if (cycles < r.best) r.best = cycles ;
+        }
+        report("pt_switch", 2, BENCH_PT_ROUNDS, &r) ;
+    }
+    printf("# done\n") ;
+
+    while(1) {
+        PT_YIELD_usec(1000000) ;
+    }
+    PT_END(pt);
+}
+
+int main() {
+    // Initialize stdio
+    stdio_init_all();
+    printf("# Benchmarks\n") ;
+
+    benchInit() ;
+
+    pt_add_thread(protothread_bench) ;
+    pt_add_thread(protothread_partner) ;
+    pt_schedule_start ;
+}
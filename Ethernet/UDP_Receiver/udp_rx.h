@@ -0,0 +1,299 @@
+/**
+ * V. Hunter Adams (vha3@cornell.edu)
+ * 
+ * Non-blocking UDP receiver for RP2040
+ * 
+ * Hardware connections
+ * - RX+/RX- -----> comparator (or a biased, AC-coupled input) -----> GPIO
+ *   (the GPIO must idle low, and read high when RX+ is above RX-)
+ * 
+ * Resources utilized
+ * - Two PIO state machines on PIO block 1, and the IRQ flag of the end
+ *   of frame one, and PIO1_IRQ_0 (claimed from lib/hw_claim)
+ * - One DMA channel (claimed from lib/hw_claim), and the DMA sniffer
+ * 
+ * One state machine decodes the Manchester bit stream. It hunts for the
+ * start frame delimiter, then pushes the frame a byte at a time, and a
+ * DMA channel copies the bytes into the buffer being filled, from a ring
+ * of UDP_RX_BUFFERS. The DMA sniffer computes the Ethernet CRC of
+ * everything received (over a good frame and its own CRC, that's always
+ * the same residue). Another state machine raises an interrupt when the
+ * line goes idle at the end of the frame. The handler restarts the decoder
+ * and points the DMA channel at the next buffer (so it's ready before the
+ * next preamble), then checks the CRC and keeps the frame only if it's an
+ * IPv4 UDP packet for our Ethernet address, IP address and UDP port.
+ * Every kept packet calls the user's handler, if there is one, from the
+ * interrupt, and waits in the ring for GetReceived(). The handler and
+ * everything it calls run from RAM, as should the user's handler
+ * (HOT_ISR, in hotpath.h).
+ * 
+ * The transmitter (udp_tx.h) uses the DMA sniffer too, and every DMA
+ * channel but the shared control block channel, so this doesn't run
+ * alongside it as it stands.
+ */
+
+#include "pico/unique_id.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hotpath.h"
+#include "hw_claim.h"
+#include "udp_receive.pio.h"
+#include "udp_rx_parameters.h"
+
+
+///////////////////////////////////////////////////////////////////////////////
+////////////////////////// Probably do not need to modify /////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// Largest Ethernet frame, with its CRC, and the buffer for one (a little
+// longer, to tell a frame that's too long)
+#define ETH_MAX_FRAME   1518
+#define UDP_RX_FRAME_LEN (ETH_MAX_FRAME + 2)
+
+// Smallest Ethernet frame, with its CRC
+#define ETH_MIN_FRAME   64
+
+// Length of Ethernet checksum
+#define CRC_LEN 4
+
+// The Ethernet CRC over a good frame and its CRC
+#define ETH_CRC_RESIDUE 0x2144DF1C
+
+// A received packet
+typedef struct {
+    unsigned char frame[UDP_RX_FRAME_LEN] ; // Ethernet frame, with the CRC
+    int frame_len ;                         // bytes received
+    unsigned char * payload ;               // UDP payload (in the frame)
+    int len ;                               // UDP payload length
+    unsigned char * src_ip ;                // sender's IP address (in the frame)
+    unsigned short src_port ;               // sender's UDP port
+} udp_rx_buffer ;
+
+// Called from the interrupt for each packet received
+typedef void (*udp_rx_handler_t)(udp_rx_buffer * packet) ;
+
+// Counts of frames received
+typedef struct {
+    unsigned int received ;                 // kept, for us
+    unsigned int crc_errors ;               // bad CRC (or too short or long)
+    unsigned int filtered ;                 // good, but not for us
+    unsigned int overruns ;                 // for us, but the ring was full
+} udp_rx_stats ;
+
+// The ring of buffers. ring[rx_tail % UDP_RX_BUFFERS] is being filled, and
+// those from rx_head up to it hold received packets.
+udp_rx_buffer udp_rx_ring[UDP_RX_BUFFERS] ;
+volatile unsigned int rx_head = 0, rx_tail = 0 ;
+volatile udp_rx_stats rx_stats ;
+
+udp_rx_handler_t udp_rx_handler = NULL ;
+
+// Unique board ID for MAC address generation
+pico_unique_board_id_t rx_board_identification ;
+
+
+///////////////////////////////////////////////////////////////////////////////
+///////////////////////// Functions for checking packets //////////////////////
+///////////////////////////////////////////////////////////////////////////////
+void GenerateReceiveMAC() {
+    // Get the unique flash memory ID, we'll use this for our MAC address
+    pico_get_unique_board_id(&rx_board_identification) ;
+    // Populate ethernet address with first bytes of unique ID (as the transmitter does)
+    for (int i=0; i<5; i++) {
+        rx_ethernet_address[i] = rx_board_identification.id[i] ;
+    }
+}
+
+// Reads big-endian 16-bit header fields
+#define RX_GET16(p) ((unsigned short)(((p)[0]<<8) | (p)[1]))
+
+// Whether n bytes match (memcmp is in flash)
+static HOT_INLINE int SameBytes(const unsigned char * a, const unsigned char * b, int n) {
+    for (int i=0; i<n; i++) {
+        if (a[i] != b[i]) return 0 ;
+    }
+    return 1 ;
+}
+
+// Checks that a good frame is a UDP packet for us, and finds its payload
+int HOT_ISR(AcceptPacket)(udp_rx_buffer * packet) {
+    unsigned char * frame = packet->frame ;
+    int len = packet->frame_len - CRC_LEN ;
+    static unsigned char broadcast[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff} ;    // in RAM, not flash
+
+    // Ethernet: for our address (or broadcast), carrying IP
+    if (!SameBytes(&frame[0], rx_ethernet_address, 6) && !SameBytes(&frame[0], broadcast, 6)) return 0 ;
+    if ((frame[12] != 0x08) || (frame[13] != 0x00)) return 0 ;
+
+    // IP: v4, not fragmented, UDP, for our address (or broadcast)
+    int ip_head_len = (frame[14] & 0x0F) * 4 ;
+    if (((frame[14] >> 4) != 4) || (ip_head_len < 20)) return 0 ;
+    if ((RX_GET16(&frame[20]) & 0x3FFF) != 0) return 0 ;
+    if (frame[23] != 0x11) return 0 ;
+    if (!SameBytes(&frame[30], rx_ip_address, 4) && !SameBytes(&frame[30], broadcast, 4)) return 0 ;
+
+    // UDP: for our port, and all of it in the frame
+    unsigned char * udp = &frame[14 + ip_head_len] ;
+    if ((udp[2] != rx_udp_port[0]) || (udp[3] != rx_udp_port[1])) return 0 ;
+    int udp_len = RX_GET16(&udp[4]) ;
+    if ((udp_len < 8) || (udp + udp_len > frame + len)) return 0 ;
+
+    packet->payload = &udp[8] ;
+    packet->len = udp_len - 8 ;
+    packet->src_ip = &frame[26] ;
+    packet->src_port = RX_GET16(&udp[0]) ;
+    return 1 ;
+}
+
+
+////////////////////////// PIO params ////////////////////////////
+// We'll use PIO1
+PIO rx_pio = pio1 ;
+int sm_rx = -1 ;
+int sm_eof = -1 ;
+uint offset_rx ;
+
+
+/////////////////// DMA-utilized variables //////////////////////
+int rx_chan = -1 ;
+
+
+///////////////////////////////////////////////////////////////////////////////
+/////////////////////////////////// Our API ///////////////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// Returns the oldest received packet, or NULL if there isn't one. It stays
+// in the ring until it's released with ReleaseReceived().
+udp_rx_buffer * HOT_ISR(GetReceived)() {
+    if (rx_head == rx_tail) return NULL ;
+    return &udp_rx_ring[rx_head % UDP_RX_BUFFERS] ;
+}
+
+// Releases the oldest received packet (from GetReceived()) for reuse
+void HOT_ISR(ReleaseReceived)() {
+    if (rx_head != rx_tail) rx_head++ ;
+}
+
+// Points the DMA channel at the buffer to fill, and resets the sniffer
+static void HOT_ISR(StartReceive)() {
+    dma_hw->sniff_data = 0xffffffff ;
+    dma_channel_set_trans_count(rx_chan, UDP_RX_FRAME_LEN, false) ;
+    dma_channel_set_write_addr(rx_chan, udp_rx_ring[rx_tail % UDP_RX_BUFFERS].frame, true) ;
+}
+
+// Runs at the end of each frame (and after each link pulse)
+void HOT_ISR(UDPReceiveDone)() {
+    // How much arrived, and whether its CRC is good. The last byte was
+    // pushed 2 bit times ago, so the DMA channel has it.
+    udp_rx_buffer * packet = &udp_rx_ring[rx_tail % UDP_RX_BUFFERS] ;
+    packet->frame_len = UDP_RX_FRAME_LEN - dma_hw->ch[rx_chan].transfer_count ;
+    int good = (dma_hw->sniff_data == ETH_CRC_RESIDUE) ;
+    dma_channel_abort(rx_chan) ;
+
+    // Restart the decoder, hunting for the next preamble
+    pio_sm_set_enabled(rx_pio, sm_rx, false) ;
+    pio_sm_clear_fifos(rx_pio, sm_rx) ;
+    pio_sm_restart(rx_pio, sm_rx) ;
+    pio_sm_exec(rx_pio, sm_rx, pio_encode_jmp(offset_rx + manchester_rx_offset_start)) ;
+    pio_sm_set_enabled(rx_pio, sm_rx, true) ;
+
+    // Keep it if it's for us, and there's room for another in the ring
+    int keep = 0 ;
+    if (packet->frame_len == 0) {
+        // A link pulse, or noise
+    }
+    else if (!good || (packet->frame_len < ETH_MIN_FRAME) || (packet->frame_len > ETH_MAX_FRAME)) {
+        rx_stats.crc_errors++ ;
+    }
+    else if (!AcceptPacket(packet)) {
+        rx_stats.filtered++ ;
+    }
+    else if ((rx_tail + 1 - rx_head) >= UDP_RX_BUFFERS) {
+        rx_stats.overruns++ ;
+    }
+    else {
+        rx_stats.received++ ;
+        keep = 1 ;
+        rx_tail++ ;
+    }
+
+    // Fill the next buffer (or this one again)
+    StartReceive() ;
+
+    // Let the end of frame machine go on
+    pio_interrupt_clear(rx_pio, sm_eof) ;
+
+    if (keep && (udp_rx_handler != NULL)) udp_rx_handler(packet) ;
+}
+
+// Copies the counts of frames received
+void GetReceiveStats(udp_rx_stats * stats) {
+    stats->received = rx_stats.received ;
+    stats->crc_errors = rx_stats.crc_errors ;
+    stats->filtered = rx_stats.filtered ;
+    stats->overruns = rx_stats.overruns ;
+}
+
+
+void initUDPReceive(unsigned int rx_pin, udp_rx_handler_t handler) {
+    ///////////////////////////////////////////////////////////////////
+    ////////////////////////// PIO SETUP //////////////////////////////
+    ///////////////////////////////////////////////////////////////////
+    // State machines (on PIO1)
+    sm_rx  = hw_claim_sm(rx_pio, "udp rx") ;
+    sm_eof = hw_claim_sm(rx_pio, "udp rx") ;
+    // Its "irq wait 0 rel" is flag sm_eof
+    hw_claim_pio_irq(rx_pio, sm_eof, "udp rx") ;
+
+    // Load programs into instruction memory
+    offset_rx = hw_add_program(rx_pio, &manchester_rx_program, "udp rx") ;
+    uint offset_eof = hw_add_program(rx_pio, &eth_rx_eof_program, "udp rx") ;
+
+    // Initialize PIO programs (24 cycles per bit at 240 MHz, no clock divider)
+    manchester_rx_program_init(rx_pio, sm_rx, offset_rx, rx_pin, 1.f) ;
+    eth_rx_eof_program_init(rx_pio, sm_eof, offset_eof, rx_pin, 1.f) ;
+
+
+    ///////////////////////////////////////////////////////////////////
+    ////////////////////////// DMA RX SETUP ///////////////////////////
+    ///////////////////////////////////////////////////////////////////
+    rx_chan = hw_claim_dma("udp rx") ;
+
+    // Bytes from the decoder into the buffer being filled (add sniffer here!).
+    // The decoder shifts right, so each byte is in the top of its FIFO word.
+    dma_channel_config c0 = dma_channel_get_default_config(rx_chan);        // default configs
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_8);                 // 8-bit txfers
+    channel_config_set_read_increment(&c0, false);                          // no read incrementing
+    channel_config_set_write_increment(&c0, true);                          // yes write incrementing
+    channel_config_set_dreq(&c0, pio_get_dreq(rx_pio, sm_rx, false)) ;      // decoder RX FIFO pacing
+
+    dma_channel_configure(
+        rx_chan,                                // Channel to be configured
+        &c0,                                    // The configuration we just created
+        udp_rx_ring[0].frame,                   // write address (set for each frame)
+        ((io_rw_8 *)&rx_pio->rxf[sm_rx]) + 3,   // The initial read address (top byte of decoder RX FIFO)
+        UDP_RX_FRAME_LEN,                       // Number of transfers; in this case each is 1 byte.
+        false                                   // Don't start immediately.
+    );
+
+    // Configure the sniffer, as for transmit
+    dma_sniffer_enable(rx_chan, 1, true);
+    hw_set_bits(&dma_hw->sniff_ctrl, (DMA_SNIFF_CTRL_OUT_INV_BITS | DMA_SNIFF_CTRL_OUT_REV_BITS));
+
+
+    ///////////////////////////////////////////////////////////////////
+    ////////////////////////// Sys startup ////////////////////////////
+    ///////////////////////////////////////////////////////////////////
+    // Our Ethernet address
+    GenerateReceiveMAC() ;
+
+    // Setup interrupts (end of frame)
+    udp_rx_handler = handler ;
+    pio_interrupt_clear(rx_pio, sm_eof) ;
+    pio_set_irq0_source_enabled(rx_pio, PIO_INTR_SM0_LSB + sm_eof, true) ;
+    irq_set_exclusive_handler(PIO1_IRQ_0, UDPReceiveDone) ;
+    irq_set_enabled(PIO1_IRQ_0, true) ;
+
+    // Start filling the first buffer, then the state machines
+    StartReceive() ;
+    pio_enable_sm_mask_in_sync(rx_pio, ((1u << sm_rx) | (1u << sm_eof)));
+}
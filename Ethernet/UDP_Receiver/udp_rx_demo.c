@@ -0,0 +1,92 @@
+/**
+ * V. Hunter Adams (vha3@cornell.edu)
+ * 
+ * Non-blocking UDP receiver for RP2040
+ * 
+ * Hardware connections (unless you specify otherwise
+ * in the first argument to initUDPReceive())
+ * - RX+/RX- -----> comparator -----> GPIO 4
+ * 
+ * Resources utilized
+ * - Two PIO state machines on PIO block 1
+ * - One DMA channel, and the DMA sniffer
+ * - UART 0 (GPIO's 0 and 1)
+ * 
+ * To use:
+ * - Modify parameters in udp_rx_parameters.h
+ *   for your particular network
+ * - When you start the program, it will print its Ethernet address,
+ *   then every UDP payload it receives on its port
+ * 
+ * To test:
+ *  - Here is some Python code that you can use to test.
+ *    Just modify to your specific IP address and port number
+ *    (these should match those you specify in the
+ *    udp_rx_parameters.h file). There's no ARP, so first give
+ *    the host a static entry for the Pico's Ethernet address
+ *    (e.g. "arp -s 169.254.123.101 <address printed at startup>")
+ * 
+ *       import socket, time
+ *       sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+ *       n = 0
+ *       while True:
+ *           sock.sendto(b"Hello Pico %d" % n, ('169.254.123.101', 1024))
+ *           n += 1
+ *           time.sleep(0.1)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "pico/stdlib.h"
+#include "udp_rx.h"
+
+
+// An interrupt handler, runs after each packet is received
+void HOT_ISR(packet_received)(udp_rx_buffer * packet) {
+    // Toggle the LED
+    gpio_put(25, !gpio_get(25)) ;
+}
+
+
+int main() {
+    // Overclock to 240MHz (24 PIO cycles per bit, no clock divider)
+    // You MUST do this in order for the UDP receiver to work!
+    set_sys_clock_khz(240000, true) ;
+
+    // Initialize stdio
+    stdio_init_all();
+
+    // We'll blink the LED in the ISR
+    gpio_init(25) ;
+    gpio_set_dir(25, GPIO_OUT) ;
+    gpio_put(25, 0) ;
+
+    // Initialize the UDP receive machine
+    // First argument is GPIO number for RX.
+    // Second argument is the name of the handler called for each packet received.
+    initUDPReceive(4, packet_received) ;
+
+    // Print out our Ethernet address
+    printf("Ethernet address: ") ;
+    for (int i=0; i<6; i++) {
+        printf("%02x%s", rx_ethernet_address[i], (i < 5) ? ":" : "\n") ;
+    }
+
+    udp_rx_stats stats ;
+
+    while(1) {
+
+        // Print each packet that arrives, then release its buffer
+        udp_rx_buffer * packet = GetReceived() ;
+        if (packet == NULL) continue ;
+
+        GetReceiveStats(&stats) ;
+        printf("%d.%d.%d.%d:%d (%d bytes, %u bad, %u not for us): %.*s\n",
+               packet->src_ip[0], packet->src_ip[1], packet->src_ip[2], packet->src_ip[3],
+               packet->src_port, packet->len, stats.crc_errors, stats.filtered,
+               packet->len, packet->payload) ;
+
+        ReleaseReceived() ;
+    }
+}
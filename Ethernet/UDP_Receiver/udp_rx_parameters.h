@@ -0,0 +1,18 @@
+///////////////////////////////////////////////////////////////////////////////
+//////////////////////////// USER-MODIFIED PARAMETERS /////////////////////////
+///////////////////////////////////////////////////////////////////////////////
+// The number of receive buffers in the ring. One is always being filled, so
+// up to UDP_RX_BUFFERS - 1 received packets can wait for the application.
+#define UDP_RX_BUFFERS          (4)
+
+// Our Ethernet address (MAC). Frames are accepted for this address, or for
+// broadcast. It's auto-generated from Pico's unique flash ID, the same way
+// as the transmitter's source address. If you want to specify this, comment
+// out GenerateReceiveMAC() from initUDPReceive().
+unsigned char rx_ethernet_address[6] = {} ;
+
+// Our IP address. Packets are accepted for this address, or for broadcast.
+unsigned char rx_ip_address[4]  = {169, 254, 123, 101};
+
+// The UDP port we listen on (set to a default of 1024)
+unsigned char rx_udp_port[2] = {0x04, 0x00} ; // 1024
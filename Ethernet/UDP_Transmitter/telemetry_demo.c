@@ -0,0 +1,136 @@
+/**
+ * V. Hunter Adams (vha3@cornell.edu)
+ * 
+ * UDP telemetry streaming for RP2040
+ * 
+ * Samples the ADC into ping-pong halves, and streams each half and the
+ * FFT of it as binary telemetry frames (udp_telemetry.h) through the UDP
+ * transmitter, instead of printing them over the UART.
+ * 
+ * Hardware connections (unless you specify otherwise
+ * in the first argument to initUDP())
+ * - GPIO 3 -----> TX+
+ * - GPIO 2 -----> TX-
+ * - GPIO 26 ----> Audio input [0-3.3V]
+ * 
+ * Resources utilized
+ * - Every DMA channel, for the transmitter (so the ADC is sampled from
+ *   a timer interrupt)
+ * - 3 PIO state machines on PIO block 0
+ * - PWM slice 7
+ * - ADC channel 0
+ * - UART 0 (GPIO's 0 and 1)
+ * 
+ * To use:
+ * - Modify parameters in udp_tx_parameters.h for your particular network
+ * - Set the rates below. Every ADC block is sent (Fs/NUM_SAMPLES frames a
+ *   second), and spectra at SPECTRUM_RATE.
+ * 
+ * To test:
+ *  - Here is some Python code that you can use to test.
+ * 
+ *       import socket, struct
+ *       sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+ *       sock.bind(('169.254.4.174', 1024))
+ *       while True:
+ *           data = sock.recv(1500)
+ *           seq, ts, kind, size, count, offset, total = struct.unpack_from("<IIBBHHH", data)
+ *           print(seq, ts, kind, count, offset, total)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "udp_tx.h"
+#include "udp_telemetry.h"
+#include "fixed_point.h"
+#include "fix_fft.h"
+
+// ADC channel and pin, and sample rate
+#define ADC_CHAN 0
+#define ADC_PIN 26
+#define Fs 10000.0
+
+// Samples per block (one FFT each)
+#define NUM_SAMPLES FFT_N
+
+// Spectra sent a second
+#define SPECTRUM_RATE 10.0
+
+// Samples to fixed point (16.15, fixed_point.h)
+#define sample2fix15(a) ((fix15)(a) << 11)  // 12-bit samples, centered
+
+// Ping-pong capture: the timer fills one half while main sends the other
+uint16_t samples[2][NUM_SAMPLES] ;
+volatile int sample_count = 0 ;
+volatile int sample_half = 0 ;
+volatile int block_ready = -1 ;
+volatile uint32_t block_time[2] ;
+
+// The FFT, and the magnitudes from it
+fix15 fft_data[NUM_SAMPLES] ;
+
+// Takes one sample, every 1/Fs
+bool HOT_ISR(sample_callback)(struct repeating_timer *t) {
+    if (sample_count == 0) block_time[sample_half] = time_us_32() ;
+    samples[sample_half][sample_count++] = adc_read() ;
+    if (sample_count == NUM_SAMPLES) {
+        // This half is done: hand it to main, and fill the other
+        block_ready = sample_half ;
+        sample_half ^= 1 ;
+        sample_count = 0 ;
+    }
+    return true ;
+}
+
+// Runs after each packet is sent
+void HOT_ISR(pio0_interrupt_handler)() {
+    // Clear the interrupt
+    pio_interrupt_clear(pio0, 1) ;
+}
+
+
+int main() {
+    // Overclock to 240MHz (makes clock dividers for PIO nice round numbers)
+    // You MUST do this in order for the UDP transmitter to work!
+    set_sys_clock_khz(240000, true) ;
+
+    // Initialize stdio
+    stdio_init_all();
+
+    // Initialize the UDP transmit machine
+    initUDP(2, pio0_interrupt_handler) ;
+
+    // Every ADC block, and spectra at SPECTRUM_RATE
+    TelemetrySetRate(TELEMETRY_ADC, 0) ;
+    TelemetrySetRate(TELEMETRY_SPECTRUM, SPECTRUM_RATE) ;
+
+    // ADC, sampled from a timer
+    adc_gpio_init(ADC_PIN) ;
+    adc_init() ;
+    adc_select_input(ADC_CHAN) ;
+    struct repeating_timer timer ;
+    add_repeating_timer_us(-(int64_t)(1000000.0 / Fs), sample_callback, NULL, &timer) ;
+
+    while(1) {
+
+        // Wait for a block
+        while (block_ready < 0) {
+        }
+        int half = block_ready ;
+        block_ready = -1 ;
+
+        // Send the samples
+        TelemetryBlock(TELEMETRY_ADC, samples[half], NUM_SAMPLES, sizeof(uint16_t), block_time[half]) ;
+
+        // Window, FFT and magnitudes, and send those (at SPECTRUM_RATE)
+        for (int i=0; i<NUM_SAMPLES; i++) {
+            fft_data[i] = multfix15(sample2fix15((int)samples[half][i] - 2048), fft_hann[i]) ;
+        }
+        fft_real(fft_data) ;
+        fft_real_mag(fft_data, fft_data) ;
+        TelemetryBlock(TELEMETRY_SPECTRUM, fft_data, NUM_SAMPLES/2, sizeof(fix15), block_time[half]) ;
+    }
+}
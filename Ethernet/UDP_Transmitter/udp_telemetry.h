@@ -0,0 +1,169 @@
+/**
+ * V. Hunter Adams (vha3@cornell.edu)
+ * 
+ * Binary telemetry over the UDP transmitter (include after udp_tx.h)
+ * 
+ * Each UDP payload is one telemetry frame: a 16-byte header, then the
+ * data. All of it is little-endian, as the RP2040 stores it.
+ * 
+ *   offset  size  field
+ *   0       4     sequence   frames sent by this board so far (a gap is a drop)
+ *   4       4     timestamp  time_us_32() of the data's first element
+ *   8       1     type       TELEMETRY_ADC, TELEMETRY_SPECTRUM, TELEMETRY_IMU, ...
+ *   9       1     size       bytes per element
+ *   10      2     count      elements in this frame
+ *   12      2     offset     this frame's first element, within its block
+ *   14      2     total      elements in the whole block
+ * 
+ * Two kinds of producer:
+ * - Blocks (an ADC capture half, an FFT spectrum) go out whole with
+ *   TelemetryBlock(), split across frames if they don't fit in one.
+ * - Samples (an MPU6050 reading) are batched with TelemetrySample(): each
+ *   one is appended to its type's open frame, which is sent when it's
+ *   full or when its interval has passed.
+ * 
+ * TelemetrySetRate() limits each type to a number of frames a second.
+ * Blocks offered sooner than that after the last one are skipped, and
+ * samples are sent in batches at that rate.
+ * 
+ * For example, from the IMU demo's loop:
+ *   fix16 imu[6] ;
+ *   mpu6050_read_raw(&imu[0], &imu[3]) ;
+ *   TelemetrySample(TELEMETRY_IMU, imu, sizeof(imu), time_us_32()) ;
+ * 
+ * And on the host:
+ *   seq, ts, kind, size, count, offset, total = struct.unpack_from("<IIBBHHH", data)
+ */
+
+#include "pico/time.h"
+
+
+// Frame types (the application can use any others below TELEMETRY_TYPES)
+#define TELEMETRY_ADC       1   // raw ADC samples, 16 bits each
+#define TELEMETRY_SPECTRUM  2   // FFT magnitudes, 16.15 (32 bits each)
+#define TELEMETRY_IMU       3   // MPU6050 samples, 16.16 fix16 accel[3] then gyro[3]
+#define TELEMETRY_TYPES     8
+
+// Telemetry frame header, at the start of each UDP payload
+typedef struct __attribute__((packed)) {
+    uint32_t sequence ;
+    uint32_t timestamp ;
+    uint8_t type ;
+    uint8_t size ;
+    uint16_t count ;
+    uint16_t offset ;
+    uint16_t total ;
+} telemetry_header ;
+
+// Room for data after the header, in one frame
+#define TELEMETRY_MAX_DATA (UDP_MAX_PAYLOAD - sizeof(telemetry_header))
+
+// Each type's rate, when it was last sent, and its open batch of samples
+typedef struct {
+    uint32_t interval_us ;      // 0 for no limit
+    uint32_t last_us ;          // when a frame of this type last went
+    udp_packet * batch ;        // open frame of samples, or NULL
+    uint32_t batch_us ;         // when the open frame was started
+} telemetry_stream ;
+
+telemetry_stream telemetry_streams[TELEMETRY_TYPES] ;
+uint32_t telemetry_sequence = 0 ;
+
+// Frames that didn't go (no free packet), and blocks skipped for the rate
+unsigned int telemetry_dropped = 0 ;
+unsigned int telemetry_skipped = 0 ;
+
+
+// Limits a type to 'rate' frames a second (0 for no limit)
+void TelemetrySetRate(int type, float rate) {
+    if ((type < 0) || (type >= TELEMETRY_TYPES)) return ;
+    telemetry_streams[type].interval_us = (rate > 0) ? (uint32_t)(1000000.0f / rate) : 0 ;
+}
+
+// Fills in a frame's header, and sends it with 'bytes' of data after it
+static int SendTelemetry(udp_packet * packet, int type, int size, int count, int offset,
+                         int total, uint32_t timestamp) {
+    telemetry_header * header = (telemetry_header *)UDP_PAYLOAD(packet) ;
+    header->sequence = telemetry_sequence++ ;
+    header->timestamp = timestamp ;
+    header->type = type ;
+    header->size = size ;
+    header->count = count ;
+    header->offset = offset ;
+    header->total = total ;
+    telemetry_streams[type].last_us = time_us_32() ;
+    return SendPacket(packet, sizeof(telemetry_header) + count * size) ;
+}
+
+// Sends a block of 'count' elements of 'size' bytes each, captured at
+// 'timestamp' (split across frames if it doesn't fit in one). The data is
+// copied, so it can change as soon as this returns. Returns 0 if the
+// block was skipped for the type's rate, or a frame was dropped.
+int TelemetryBlock(int type, const void * data, int count, int size, uint32_t timestamp) {
+    if ((type < 0) || (type >= TELEMETRY_TYPES) || (size <= 0)) return 0 ;
+    telemetry_stream * stream = &telemetry_streams[type] ;
+    if (stream->interval_us && ((time_us_32() - stream->last_us) < stream->interval_us)) {
+        telemetry_skipped++ ;
+        return 0 ;
+    }
+
+    // Whole elements per frame
+    int per_frame = TELEMETRY_MAX_DATA / size ;
+    const unsigned char * bytes = (const unsigned char *)data ;
+    for (int offset=0; offset<count; offset+=per_frame) {
+        int n = ((count - offset) < per_frame) ? (count - offset) : per_frame ;
+        udp_packet * packet = GetPacket() ;
+        if (packet == NULL) {
+            telemetry_dropped++ ;
+            return 0 ;
+        }
+        memcpy(UDP_PAYLOAD(packet) + sizeof(telemetry_header), bytes + offset * size, n * size) ;
+        SendTelemetry(packet, type, size, n, offset, count, timestamp) ;
+    }
+    return 1 ;
+}
+
+// Sends a type's open batch of samples now, if it has one
+void TelemetryFlush(int type) {
+    if ((type < 0) || (type >= TELEMETRY_TYPES)) return ;
+    telemetry_stream * stream = &telemetry_streams[type] ;
+    udp_packet * packet = stream->batch ;
+    if (packet == NULL) return ;
+    stream->batch = NULL ;
+    telemetry_header * header = (telemetry_header *)UDP_PAYLOAD(packet) ;
+    SendTelemetry(packet, type, header->size, header->count, 0, header->count, header->timestamp) ;
+}
+
+// Adds one sample of 'size' bytes, taken at 'timestamp', to its type's
+// batch. The batch goes when it's full or its interval has passed (every
+// sample in a batch must be the same size). Returns 0 if it was dropped.
+int TelemetrySample(int type, const void * sample, int size, uint32_t timestamp) {
+    if ((type < 0) || (type >= TELEMETRY_TYPES) || (size <= 0)) return 0 ;
+    telemetry_stream * stream = &telemetry_streams[type] ;
+
+    // Start a batch, with this sample's timestamp
+    if (stream->batch == NULL) {
+        stream->batch = GetPacket() ;
+        if (stream->batch == NULL) {
+            telemetry_dropped++ ;
+            return 0 ;
+        }
+        telemetry_header * header = (telemetry_header *)UDP_PAYLOAD(stream->batch) ;
+        header->timestamp = timestamp ;
+        header->size = size ;
+        header->count = 0 ;
+        stream->batch_us = time_us_32() ;
+    }
+
+    // Add the sample
+    telemetry_header * header = (telemetry_header *)UDP_PAYLOAD(stream->batch) ;
+    memcpy(UDP_PAYLOAD(stream->batch) + sizeof(telemetry_header) + header->count * size, sample, size) ;
+    header->count++ ;
+
+    // Send it if there's no room for another, or it's been open long enough
+    if (((header->count + 1) * size > TELEMETRY_MAX_DATA) ||
+        (stream->interval_us && ((time_us_32() - stream->batch_us) >= stream->interval_us))) {
+        TelemetryFlush(type) ;
+    }
+    return 1 ;
+}
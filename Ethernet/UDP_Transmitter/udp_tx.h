@@ -7,16 +7,38 @@
  * - GPIO 3 -----> TX+
  * - GPIO 2 -----> TX-
  * 
- * Resources utilized
- * - All DMA channels
- * - PIO state machines 0, 1, and 2 on PIO block 0
+ * Resources utilized (claimed from lib/hw_claim in initUDP)
+ * - 11 DMA channels, and lib/hw_claim's shared control block channel,
+ *   a packet at a time
+ * - 3 PIO state machines on PIO block 0, whose programs use its IRQ
+ *   flags 1 (to the CPU) and 4 (between them), and PIO0_IRQ_0
  * - PWM slice 7
+ * 
+ * Packets come from a pool of UDP_POOL_SIZE buffers, each with its own
+ * copy of a header template. A payload can be any length up to
+ * UDP_MAX_PAYLOAD. When a packet is sent, its length fields and IP
+ * identifier are set and the IP checksum is adjusted for them
+ * incrementally (RFC 1624), so the rest of the header isn't touched.
+ * 
+ * Nothing is copied to send. A control block channel loads the packet
+ * channel with the headers, then the payload (from the packet, or straight
+ * from the user's buffer with SendPayload()), then any padding, and the
+ * sniffer computes the Ethernet CRC across all of them. The control block
+ * channel is lib/hw_claim's shared one: each packet asks for a turn with
+ * it, and hands it on when the packet has gone.
+ * 
+ * Sent packets join a transmit queue. The end of each transaction (after
+ * the interpacket gap, timed by the TP_IDL machine) starts the next one
+ * from the interrupt, so they go back to back. NLPs only come after 16ms
+ * with nothing sent, as the PWM counter is reset by every packet.
  */
 
 #include "pico/unique_id.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
 #include "hardware/pwm.h"
+#include "hotpath.h"
+#include "hw_claim.h"
 #include "udp_transmit.pio.h"
 #include "udp_tx_parameters.h"
 
@@ -24,11 +46,15 @@
 ///////////////////////////////////////////////////////////////////////////////
 ////////////////////////// Probably do not need to modify /////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// Payload + Eth CRC (4) + UDP CRC (2) + UPD len (2)
-#define DEF_UDP_LEN (DEF_UDP_PAYLOAD_SIZE + 8)
+// Ports (4) + UDP CRC (2) + UPD len (2) + IP header (20) + Eth (14)
+#define HEADER_LEN  (8 + 20 + 14)
 
-// Payload + Eth CRC (4) + UDP CRC (2) + UPD len (2) + IP header (20) + Eth (14)
-#define PACKET_LEN  (DEF_UDP_PAYLOAD_SIZE + 8 + 20 + 14)
+// Headers + the largest payload
+#define PACKET_MAX_LEN (HEADER_LEN + UDP_MAX_PAYLOAD)
+
+// Ethernet frames (without the CRC) are at least 60 bytes, so payloads
+// shorter than this are padded with zeros
+#define UDP_MIN_PAYLOAD (60 - HEADER_LEN)
 
 // Length of preamble
 #define PREAMBLE_LEN 8
@@ -52,13 +78,14 @@ unsigned char ip_v_and_head_len = (((IP_VERSION<<4) & 0xF0) | (IP_HEAD_LEN & 0x0
 // IP type of service (outine precedence, normal delay)
 static const uint8_t ip_type_of_service = 0 ;
 
-// Total length of packet (20 bytes for header, plus UDP length)
-static const unsigned char ip_total_len[2] = {  ((DEF_UDP_LEN + 20)>>8) & 0xFF,
-                                                ((DEF_UDP_LEN + 20)) & 0xFF} ;
+// Total length of packet (20 bytes for header, plus UDP length) is set
+// for each packet when it's sent
 
 // The IP identifier. Could be different for each packet. If the IP packet is fragmented,
-// each will use the same identification number. For testing, this is of a fixed value.
+// each will use the same identification number. This is the first packet's,
+// and each packet after it gets the next one.
 unsigned char ip_identifier[2] = {0xB3, 0xFE} ;
+unsigned short ip_next_id ;
 
 // IP flags and fragment offset (we aren't fragmenging packets)
 static const unsigned char ip_flags_and_fragment[2] = {0x00, 0x00} ;
@@ -69,8 +96,7 @@ static const uint8_t ip_time_to_live = 0x80 ;
 // IP prototocol (set to UDP)
 static const uint8_t ip_protocol = 0x11 ;
 
-// UDP payload length
-unsigned char udp_payload_len[2] = {((DEF_UDP_LEN >> 8) & 0xFF), (DEF_UDP_LEN & 0xFF)} ;
+// UDP length (8 bytes for header, plus payload) is also set for each packet
 
 // UDP payload checksum (must be set to zero if not used)
 unsigned char udp_checksum[2] = {0x00, 0x00};//{0x2D, 0xE8} ;
@@ -79,9 +105,50 @@ unsigned char udp_checksum[2] = {0x00, 0x00};//{0x2D, 0xE8} ;
 // Byte aligned for read pointer wrapping on the DMA channel
 unsigned char crc_dest[4] __attribute__ ((aligned (8))) = {0} ;
 
-// The packet which we populate and transmit
-unsigned char assembled_packet[PACKET_LEN] = {} ;
-unsigned char * assembled_packet_pointer = &assembled_packet[0] ;
+// A DMA control block for the packet channel: its read address, write
+// address, transfer count and control register, in register order
+typedef struct {
+    const void * read_addr ;
+    volatile void * write_addr ;
+    uint32_t count ;
+    uint32_t ctrl ;
+} udp_dma_block ;
+
+// A packet buffer: the headers, then room for the largest payload, and
+// the control blocks that send the headers, the payload (from here or
+// from the user's buffer) and any padding
+typedef struct {
+    unsigned char frame[PACKET_MAX_LEN] ;   // Ethernet frame, less the CRC
+    udp_dma_block blocks[3] ;               // headers, payload, padding
+    volatile unsigned char in_use ;         // taken from the pool
+} udp_packet ;
+
+// The payload of a packet
+#define UDP_PAYLOAD(packet) (&(packet)->frame[HEADER_LEN])
+
+// The pool of packets. Each carries its own copy of the header template.
+udp_packet udp_pool[UDP_POOL_SIZE] ;
+
+// The packet being sent, if any, whether one is being sent or waiting
+// for its turn with the control block channel, and the user's completion
+// handler
+udp_packet * volatile udp_sending = NULL ;
+volatile unsigned char udp_busy = 0 ;
+irq_handler_t udp_done_handler = NULL ;
+
+// The transmit queue: a ring of packets waiting to be sent, in order. Every
+// packet in it is from the pool, so it can't hold more than the pool.
+udp_packet * udp_tx_queue[UDP_POOL_SIZE] ;
+volatile unsigned int udp_tx_head = 0, udp_tx_tail = 0 ;
+
+// Zeros to pad short frames with
+static const unsigned char udp_padding[UDP_MIN_PAYLOAD] = {0} ;
+
+// Packet channel control values for a block with more to follow (chains
+// back to the control block channel), and for the last (chains on to the
+// CRC), and the serializer's TX FIFO (all set in initUDP())
+uint32_t udp_ctrl_more, udp_ctrl_last ;
+volatile void * udp_tx_fifo ;
 
 
 // Unique board ID for MAC address generation
@@ -167,98 +234,103 @@ void GenerateUniqueMAC() {
 }
 
 // Generates the ethernet header
-void BuildEthernetHeader() {
+void BuildEthernetHeader(unsigned char * frame) {
     // Copy over ethernet destination
-    memcpy(&assembled_packet[0],  &ethernet_destination[0], 6) ;
+    memcpy(&frame[0],  &ethernet_destination[0], 6) ;
     // Copy over ethernet source (unique to RP2040)
-    memcpy(&assembled_packet[6],  &ethernet_source[0], 6) ;
+    memcpy(&frame[6],  &ethernet_source[0], 6) ;
     // Copy over ethernet type
-    memcpy(&assembled_packet[12], &ethernet_type[0], 2) ;
+    memcpy(&frame[12], &ethernet_type[0], 2) ;
 }
 
-// Generates the IP header
-void BuildIPHeader() {
-    // Some local variables for computing the IP checksum
-    unsigned short ip_crc_array[9] = {} ;
-    unsigned int ip_chk_sum1 = 0;
-    unsigned int ip_chk_sum2 = 0;
-    unsigned int ip_chk_sum3 = 0;
-    unsigned short final_checksum = 0 ;
-    unsigned char ip_checksum_array[2] = {} ;
+// The headers, built once and copied into each packet in the pool. The
+// IP total length is zero here, and the checksum to match.
+unsigned char udp_header_template[HEADER_LEN] = {} ;
 
+// Computes the IP header checksum (the checksum field itself is skipped)
+unsigned short IPChecksum(unsigned char * frame) {
+    unsigned int sum = 0 ;
+    for (int i=14; i<34; i+=2) {
+        if (i != 24) sum += ((frame[i]<<8) & 0xFF00) | (frame[i+1] & 0x00FF) ;
+    }
+    sum = (sum & 0x0000FFFF) + (sum >> 16) ;
+    sum = (sum & 0x0000FFFF) + (sum >> 16) ;
+    return ~sum ;
+}
+
+// Generates the IP header (the length and checksum are set when sent)
+void BuildIPHeader(unsigned char * frame) {
     // Copy over IP version and head len, and type of service
-    memcpy(&assembled_packet[14], &ip_v_and_head_len, 1) ;
-    memcpy(&assembled_packet[15], &ip_type_of_service, 1) ;
-    ip_crc_array[0] = ((assembled_packet[14]<<8) & 0xFF00) | (assembled_packet[15] & 0x00FF) ;
+    memcpy(&frame[14], &ip_v_and_head_len, 1) ;
+    memcpy(&frame[15], &ip_type_of_service, 1) ;
 
-    // Copy over IP total length
-    memcpy(&assembled_packet[16], &ip_total_len, 2) ;
-    memcpy(&ip_crc_array[1], &assembled_packet[16], 2) ;
-    ip_crc_array[1] = ((assembled_packet[16]<<8) & 0xFF00) | (assembled_packet[17] & 0x00FF) ;
+    // IP total length and checksum, zero for now
+    memset(&frame[16], 0, 2) ;
+    memset(&frame[24], 0, 2) ;
 
     // Copy over IP identifier
-    memcpy(&assembled_packet[18], &ip_identifier, 2) ;
-    ip_crc_array[2] = ((assembled_packet[18]<<8) & 0xFF00) | (assembled_packet[19] & 0x00FF) ;
+    memcpy(&frame[18], &ip_identifier, 2) ;
 
     // Copy over IP flags and fragmentation settings
-    memcpy(&assembled_packet[20], &ip_flags_and_fragment, 2) ;
-    ip_crc_array[3] = ((assembled_packet[20]<<8) & 0xFF00) | (assembled_packet[21] & 0x00FF) ;
+    memcpy(&frame[20], &ip_flags_and_fragment, 2) ;
 
     // Copy over IP time to live and protocol
-    memcpy(&assembled_packet[22], &ip_time_to_live, 1) ;
-    memcpy(&assembled_packet[23], &ip_protocol, 1) ;
-    ip_crc_array[4] = ((assembled_packet[22]<<8) & 0xFF00) | (assembled_packet[23] & 0x00FF) ;
-
-    // Next is checksum. Skip for now! We still need to compute it.
-
-    // Copy over IP source address
-    memcpy(&assembled_packet[26], &ip_source, 4) ;
-    ip_crc_array[5] = ((assembled_packet[26]<<8) & 0xFF00) | (assembled_packet[27] & 0x00FF) ;
-    ip_crc_array[6] = ((assembled_packet[28]<<8) & 0xFF00) | (assembled_packet[29] & 0x00FF) ;
+    memcpy(&frame[22], &ip_time_to_live, 1) ;
+    memcpy(&frame[23], &ip_protocol, 1) ;
 
-    // Copy over IP destination address
-    memcpy(&assembled_packet[30], &ip_dest, 4) ;
-    ip_crc_array[7] = ((assembled_packet[30]<<8) & 0xFF00) | (assembled_packet[31] & 0x00FF) ;
-    ip_crc_array[8] = ((assembled_packet[32]<<8) & 0xFF00) | (assembled_packet[33] & 0x00FF) ;
-
-    // Compute the checksum
-    for (int i=0; i<9; i++) {
-        ip_chk_sum1 += ip_crc_array[i] ;
-    }
-    ip_chk_sum2 = (ip_chk_sum1 & 0x0000FFFF) + (ip_chk_sum1 >> 16);
-    ip_chk_sum3 = (ip_chk_sum2 & 0x0000FFFF) + (ip_chk_sum2 >> 16);
-    final_checksum = ~ip_chk_sum3 ;
-
-    // Populate a local checksum array
-    ip_checksum_array[0] = (final_checksum>>8) & 0xFF ;
-    ip_checksum_array[1] = (final_checksum & 0xFF) ;
+    // Copy over IP source and destination addresses
+    memcpy(&frame[26], &ip_source, 4) ;
+    memcpy(&frame[30], &ip_dest, 4) ;
+}
 
-    // Copy local array over to the packet
-    memcpy(&assembled_packet[24], &ip_checksum_array[0], 2) ;
+// Generates the UDP header (the length is set when sent)
+void BuildUDPHeader(unsigned char * frame) {
+    memcpy(&frame[34], &udp_src_port, 2) ;
+    memcpy(&frame[36], &udp_dst_port, 2) ;
+    memset(&frame[38], 0, 2) ;
+    memcpy(&frame[40], &udp_checksum, 2) ;
 }
 
-// Generates the UDP header
-void BuildUDPHeader() {
-    memcpy(&assembled_packet[34], &udp_src_port, 2) ;
-    memcpy(&assembled_packet[36], &udp_dst_port, 2) ;
-    memcpy(&assembled_packet[38], &udp_payload_len, 2) ;
-    memcpy(&assembled_packet[40], &udp_checksum, 2) ;
+// Updates checksum hc for a 16-bit field changing from m to m_new,
+// without summing the rest of the header again (RFC 1624, eqn. 3:
+// HC' = ~(~HC + ~m + m'))
+unsigned short AdjustChecksum(unsigned short hc, unsigned short m, unsigned short m_new) {
+    unsigned int sum = (~hc & 0xFFFF) + (~m & 0xFFFF) + m_new ;
+    sum = (sum & 0x0000FFFF) + (sum >> 16) ;
+    sum = (sum & 0x0000FFFF) + (sum >> 16) ;
+    return ~sum ;
 }
 
-// Memcopy's over the UDP payload
-void SetUDPData() {
-    memcpy(&assembled_packet[42], &udp_payload[0], DEF_UDP_PAYLOAD_SIZE) ;
-    // for (int i=0; i<DEF_UDP_PAYLOAD_SIZE; i++) {
-        // assembled_packet[42+i] = udp_payload[i] ;
-    // }
+// Reads and writes big-endian 16-bit header fields
+#define GET16(p)    ((unsigned short)(((p)[0]<<8) | (p)[1]))
+#define SET16(p, v) ((p)[0] = ((v)>>8) & 0xFF, (p)[1] = (v) & 0xFF)
+
+// Sets the IP and UDP length fields for a payload of len bytes and the
+// IP identifier, and adjusts the IP checksum for the two IP fields that
+// changed since the packet was last sent
+void SetPacketHeader(unsigned char * frame, int len, unsigned short id) {
+    unsigned short ip_len = len + 8 + 20 ;
+    unsigned short checksum = GET16(&frame[24]) ;
+    checksum = AdjustChecksum(checksum, GET16(&frame[16]), ip_len) ;
+    checksum = AdjustChecksum(checksum, GET16(&frame[18]), id) ;
+    SET16(&frame[16], ip_len) ;
+    SET16(&frame[18], id) ;
+    SET16(&frame[24], checksum) ;
+    SET16(&frame[38], len + 8) ;
 }
 
+// Builds the header template, and copies it into every packet in the pool
 void AssemblePacket() {
     GenerateUniqueMAC() ;
-    BuildEthernetHeader() ;
-    BuildIPHeader() ;
-    BuildUDPHeader() ;
-    SetUDPData() ;
+    BuildEthernetHeader(udp_header_template) ;
+    BuildIPHeader(udp_header_template) ;
+    BuildUDPHeader(udp_header_template) ;
+    SET16(&udp_header_template[24], IPChecksum(udp_header_template)) ;
+    ip_next_id = GET16(ip_identifier) ;
+    for (int i=0; i<UDP_POOL_SIZE; i++) {
+        memcpy(udp_pool[i].frame, udp_header_template, HEADER_LEN) ;
+        udp_pool[i].in_use = 0 ;
+    }
 }
 
 
@@ -274,19 +346,12 @@ PIO pio = pio0;
 
 
 /////////////////// DMA-utilized variables //////////////////////
-// Name the DMA channels
-int chan_0 = 0 ;
-int chan_1 = 1 ;
-int chan_2 = 2 ;
-int chan_3 = 3 ;
-int chan_4 = 4 ;
-int chan_5 = 5 ;
-int chan_6 = 6 ;
-int chan_7 = 7 ;
-int chan_8 = 8 ;
-int chan_9 = 9 ;
-int chan_10 = 10 ;
-int chan_11 = 11 ;
+// Name the DMA channels (claimed in initUDP). chan_5, the control block
+// channel, is the shared one (hw_ctrl_channel()).
+int chan_0, chan_1, chan_2, chan_3, chan_4, chan_5 ;
+int chan_6, chan_7, chan_8, chan_9, chan_10, chan_11 ;
+// Our turn with the control block channel
+hw_ctrl_user udp_ctrl_user ;
 // Change these if you want to use other PWM channels
 // These values are DMA's to PWM control registers
 unsigned int pwm_kill           = 0x00000000 ;
@@ -307,7 +372,116 @@ unsigned int dummy_dest = 0 ;
 /////////////////////////////////// Our API ///////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
 #define START_NLP dma_start_channel_mask((1u << chan_0))
-#define SEND_PACKET SetUDPData() ; dma_start_channel_mask((1u << chan_2))
+
+// Takes a packet from the pool, or returns NULL if they're all in use.
+// Fill in its payload (UDP_PAYLOAD(packet)) and send it with SendPacket().
+udp_packet * GetPacket() {
+    for (int i=0; i<UDP_POOL_SIZE; i++) {
+        if (!udp_pool[i].in_use) {
+            udp_pool[i].in_use = 1 ;
+            return &udp_pool[i] ;
+        }
+    }
+    return NULL ;
+}
+
+// Returns a packet to the pool without sending it
+void FreePacket(udp_packet * packet) {
+    packet->in_use = 0 ;
+}
+
+// Fills in a packet channel control block
+static inline void SetBlock(udp_dma_block * block, const void * data, int len, uint32_t ctrl) {
+    block->read_addr = data ;
+    block->write_addr = udp_tx_fifo ;
+    block->count = len ;
+    block->ctrl = ctrl ;
+}
+
+// Starts the packet at the head of the queue, when it's our turn with the
+// control block channel
+static void HOT_ISR(UDPCtrlStart)(hw_ctrl_user * user) {
+    udp_packet * packet = udp_tx_queue[udp_tx_head % UDP_POOL_SIZE] ;
+    udp_tx_head++ ;
+
+    // Point the control block channel at channel 7 and the blocks, and start
+    // the transaction
+    udp_sending = packet ;
+    hw_ctrl_load(&dma_hw->ch[chan_7].read_addr, &packet->blocks[0]) ;
+    dma_start_channel_mask((1u << chan_2)) ;
+}
+
+// Asks for a turn for the packet at the head of the queue, if there is one
+// (with interrupts off, or from the completion interrupt)
+static void HOT_ISR(StartNextPacket)() {
+    if (udp_tx_head == udp_tx_tail) {
+        udp_busy = 0 ;
+        return ;
+    }
+    udp_busy = 1 ;
+    hw_ctrl_request(&udp_ctrl_user) ;
+}
+
+// Queues a packet with its headers, and a payload of len bytes read
+// straight from 'payload' (non-blocking, nothing is copied). Packets are
+// sent back to back, in order. Each goes back to the pool when it's been
+// sent, and its payload mustn't change until then.
+int SendPacketFrom(udp_packet * packet, const void * payload, int len) {
+    if (len > UDP_MAX_PAYLOAD) len = UDP_MAX_PAYLOAD ;
+    if (len < 0) len = 0 ;
+    SetPacketHeader(packet->frame, len, ip_next_id++) ;
+
+    // Headers, then the payload, then padding out to the minimum frame.
+    // The last block chains on to the CRC.
+    int pad = (len < UDP_MIN_PAYLOAD) ? UDP_MIN_PAYLOAD - len : 0 ;
+    int n = 0 ;
+    SetBlock(&packet->blocks[n++], packet->frame, HEADER_LEN, udp_ctrl_more) ;
+    if (len > 0) SetBlock(&packet->blocks[n++], payload, len, udp_ctrl_more) ;
+    if (pad > 0) SetBlock(&packet->blocks[n++], udp_padding, pad, udp_ctrl_more) ;
+    packet->blocks[n-1].ctrl = udp_ctrl_last ;
+
+    // Add it to the queue, and start it if nothing is being sent
+    uint32_t irq_status = save_and_disable_interrupts() ;
+    udp_tx_queue[udp_tx_tail % UDP_POOL_SIZE] = packet ;
+    udp_tx_tail++ ;
+    if (!udp_busy) StartNextPacket() ;
+    restore_interrupts(irq_status) ;
+    return 1 ;
+}
+
+// Sends a packet from the pool with a payload of len bytes, from its own
+// buffer (UDP_PAYLOAD(packet))
+int SendPacket(udp_packet * packet, int len) {
+    return SendPacketFrom(packet, UDP_PAYLOAD(packet), len) ;
+}
+
+// Queues len bytes straight from 'payload', with the headers of a packet
+// from the pool. Returns 0 if there's no free packet. The payload mustn't
+// change until it's been sent.
+int SendPayload(const void * payload, int len) {
+    udp_packet * packet = GetPacket() ;
+    if (packet == NULL) return 0 ;
+    return SendPacketFrom(packet, payload, len) ;
+}
+
+// Sends the udp_payload array (don't change it until it's been sent)
+#define SEND_PACKET SendPayload(udp_payload, DEF_UDP_PAYLOAD_SIZE)
+
+// Runs at the end of each transaction (after the interpacket gap): returns
+// the packet to the pool, hands the control block channel on, and asks for
+// it again for the next packet, then calls the user's handler (which
+// clears the interrupt). It runs from RAM, as should the user's handler
+// (HOT_ISR, in hotpath.h).
+void HOT_ISR(UDPSendDone)() {
+    if (udp_sending != NULL) {
+        udp_sending->in_use = 0 ;
+        udp_sending = NULL ;
+    }
+    hw_ctrl_release(&udp_ctrl_user) ;
+    StartNextPacket() ;
+    if (udp_done_handler != NULL) udp_done_handler() ;
+    else pio_interrupt_clear(pio0, 1) ;
+}
 
 
 
@@ -315,15 +489,33 @@ void initUDP(unsigned int txminus_pin, irq_handler_t handler) {
     ///////////////////////////////////////////////////////////////////
     ////////////////////////// PIO SETUP //////////////////////////////
     ///////////////////////////////////////////////////////////////////
-    // State machines (on PIO0)
-    uint sm_tx  = 0 ;
-    uint sm_nlp = 1 ;
-    uint sm_idl = 2 ;
+    // State machines (on PIO0, for its IRQ flags and interrupt)
+    uint sm_tx  = hw_claim_sm(pio, "udp tx") ;
+    uint sm_nlp = hw_claim_sm(pio, "udp tx") ;
+    uint sm_idl = hw_claim_sm(pio, "udp tx") ;
+    hw_claim_pio_irq(pio, 1, "udp tx") ;
+    hw_claim_pio_irq(pio, 4, "udp tx") ;
 
     // Load programs into instruction memory
-    uint offset_tx  = pio_add_program(pio, &manchester_tx_program);
-    uint offset_nlp = pio_add_program(pio, &nlp_program);
-    uint offset_idl = pio_add_program(pio, &tp_idl_program) ;
+    uint offset_tx  = hw_add_program(pio, &manchester_tx_program, "udp tx");
+    uint offset_nlp = hw_add_program(pio, &nlp_program, "udp tx");
+    uint offset_idl = hw_add_program(pio, &tp_idl_program, "udp tx") ;
+
+    // DMA channels, and our turn with the shared control block channel
+    chan_0 = hw_claim_dma("udp tx") ;
+    chan_1 = hw_claim_dma("udp tx") ;
+    chan_2 = hw_claim_dma("udp tx") ;
+    chan_3 = hw_claim_dma("udp tx") ;
+    chan_4 = hw_claim_dma("udp tx") ;
+    chan_5 = hw_ctrl_channel() ;
+    chan_6 = hw_claim_dma("udp tx") ;
+    chan_7 = hw_claim_dma("udp tx") ;
+    chan_8 = hw_claim_dma("udp tx") ;
+    chan_9 = hw_claim_dma("udp tx") ;
+    chan_10 = hw_claim_dma("udp tx") ;
+    chan_11 = hw_claim_dma("udp tx") ;
+    udp_ctrl_user.start = UDPCtrlStart ;
+    udp_ctrl_user.owner = "udp tx" ;
 
     // Initialize PIO programs with appropriate clock divider values
     manchester_tx_program_init(pio, sm_tx, offset_tx, txminus_pin, 3.f);
@@ -421,7 +613,7 @@ void initUDP(unsigned int txminus_pin, irq_handler_t handler) {
     channel_config_set_transfer_data_size(&c4, DMA_SIZE_32);        // 32-bit txfers
     channel_config_set_read_increment(&c4, false);                  // no read incrementing
     channel_config_set_write_increment(&c4, false);                 // no write incrementing
-    channel_config_set_chain_to(&c4, chan_5);                       // chain to channel 5
+    channel_config_set_chain_to(&c4, chan_6);                       // chain to channel 6
 
     dma_channel_configure(
         chan_4,                // Channel to be configured
@@ -432,30 +624,14 @@ void initUDP(unsigned int txminus_pin, irq_handler_t handler) {
         false                  // Don't start immediately.
     );
 
-    // Reset packet read pointer
-    dma_channel_config c5 = dma_channel_get_default_config(chan_5);  // default configs
-    channel_config_set_transfer_data_size(&c5, DMA_SIZE_32);         // 32-bit txfers
-    channel_config_set_read_increment(&c5, false);                   // no read incrementing
-    channel_config_set_write_increment(&c5, false);                  // no write incrementing
-    channel_config_set_chain_to(&c5, chan_6);                        // chain to channel 6
-
-    dma_channel_configure(
-        chan_5,                                 // Channel to be configured
-        &c5,                                    // The configuration we just created
-        &dma_hw->ch[chan_7].read_addr,          // write address (dma 7 read address)
-        &assembled_packet_pointer,              // The initial read address (pointer to address)
-        1,                                      // Number of transfers; in this case each is 4 byte.
-        false                                   // Don't start immediately.
-    );
-
     // Do preamble transaction (8 bytes long, ring wrap to avoid a read pointer reset)
     dma_channel_config c6 = dma_channel_get_default_config(chan_6); // default configs
     channel_config_set_transfer_data_size(&c6, DMA_SIZE_8);         // 8-bit txfers
     channel_config_set_read_increment(&c6, true);                   // yes read incrementing
     channel_config_set_write_increment(&c6, false);                 // no write incrementing
     channel_config_set_ring(&c6, false, 3) ;                        // ring wrap read address!
-    channel_config_set_dreq(&c6, DREQ_PIO0_TX0) ;                   // DREQ_PIO0_TX0 pacing (FIFO)
-    channel_config_set_chain_to(&c6, chan_7);                       // chain to channel 7
+    channel_config_set_dreq(&c6, pio_get_dreq(pio, sm_tx, true)) ;  // serializer TX FIFO pacing
+    channel_config_set_chain_to(&c6, chan_5);                       // chain to channel 5
 
     dma_channel_configure(
         chan_6,                 // Channel to be configured
@@ -466,23 +642,37 @@ void initUDP(unsigned int txminus_pin, irq_handler_t handler) {
         false                   // Don't start immediately.
     );
 
+    // Channel 5, the shared control block channel, loads the packet's control
+    // blocks into channel 7, one at a time (4 words to channel 7's registers,
+    // the last of which triggers it). hw_claim sets it up; each packet points
+    // it at channel 7 and the packet's blocks when it's our turn
+    // (UDPCtrlStart), and it carries on from one block to the next.
+
     // Do packet transaction - add sniffer here!
     // Finicky setup. See link below.
     // Don't do bswaps because 8 bit txfers. Otherwise might need them.
     // https://github.com/raspberrypi/pico-feedback/issues/247
+    // Each control block sets up and triggers this channel for one part of the
+    // frame (headers, payload, padding), so the sniffer sees all of them. All but
+    // the last chain back to channel 5 for the next block.
     dma_channel_config c7 = dma_channel_get_default_config(chan_7); // default configs
     channel_config_set_transfer_data_size(&c7, DMA_SIZE_8);         // 8-bit txfers
     channel_config_set_read_increment(&c7, true);                   // yes read incrementing
     channel_config_set_write_increment(&c7, false);                 // no write incrementing
-    channel_config_set_dreq(&c7, DREQ_PIO0_TX0) ;                   // DREQ_PIO0_TX0 pacing (FIFO)
-    channel_config_set_chain_to(&c7, chan_8);                       // chain to channel 8
+    channel_config_set_dreq(&c7, pio_get_dreq(pio, sm_tx, true)) ;  // serializer TX FIFO pacing
+    channel_config_set_sniff_enable(&c7, true) ;                    // sniffed (control blocks rewrite this)
+    channel_config_set_chain_to(&c7, chan_5);                       // chain to channel 5 (more blocks)
+    udp_ctrl_more = channel_config_get_ctrl_value(&c7) ;
+    channel_config_set_chain_to(&c7, chan_8);                       // or to channel 8 (last block)
+    udp_ctrl_last = channel_config_get_ctrl_value(&c7) ;
+    udp_tx_fifo = &pio->txf[sm_tx] ;
 
     dma_channel_configure(
         chan_7,                 // Channel to be configured
         &c7,                    // The configuration we just created
         &pio->txf[sm_tx],       // write address (TX FIFO for packet serializer PIO)
-        &assembled_packet[0],   // The initial read address (pointer to packet array)
-        PACKET_LEN,             // Number of transfers; in this case each is 1 byte.
+        &udp_pool[0].frame[0],  // The initial read address (set by each control block)
+        HEADER_LEN,             // Number of transfers; set by each control block
         false                   // Don't start immediately.
     );
 
@@ -513,7 +703,7 @@ void initUDP(unsigned int txminus_pin, irq_handler_t handler) {
     channel_config_set_read_increment(&c9, true);                   // yes read incrementing
     channel_config_set_write_increment(&c9, false);                 // no write incrementing
     channel_config_set_ring(&c9, false, 2) ;                        // ring wrap read addrsses!
-    channel_config_set_dreq(&c9, DREQ_PIO0_TX0) ;                   // DREQ_PIO0_TX0 pacing (FIFO)
+    channel_config_set_dreq(&c9, pio_get_dreq(pio, sm_tx, true)) ;  // serializer TX FIFO pacing
     channel_config_set_chain_to(&c9, chan_10);                      // chain to channel 10
 
     dma_channel_configure(
@@ -530,7 +720,7 @@ void initUDP(unsigned int txminus_pin, irq_handler_t handler) {
     channel_config_set_transfer_data_size(&c10, DMA_SIZE_32);           // 32-bit txfers
     channel_config_set_read_increment(&c10, false);                     // no read incrementing
     channel_config_set_write_increment(&c10, false);                    // no write incrementing
-    channel_config_set_dreq(&c10, DREQ_PIO0_TX2) ;                      // DREQ_PIO0_TX2 pacing
+    channel_config_set_dreq(&c10, pio_get_dreq(pio, sm_idl, true)) ;    // TP_IDL TX FIFO pacing
     channel_config_set_chain_to(&c10, chan_11);                         // chain to channel 11
 
     dma_channel_configure(
@@ -568,13 +758,14 @@ void initUDP(unsigned int txminus_pin, irq_handler_t handler) {
     // Setup interrupts
     pio_interrupt_clear(pio0, 1) ;
     pio_set_irq0_source_enabled(pio0, PIO_INTR_SM1_LSB, true) ;
-    irq_set_exclusive_handler(PIO0_IRQ_0, handler) ;
+    udp_done_handler = handler ;
+    irq_set_exclusive_handler(PIO0_IRQ_0, UDPSendDone) ;
     irq_set_enabled(PIO0_IRQ_0, true) ;
 
     // Start the NLP DMA channel - begins generating NLP at 16ms intervals
     START_NLP ;
 
-    // Use that network data to assemble the packet
+    // Use that network data to build the packet headers
     AssemblePacket() ;
 }
 
@@ -9,16 +9,21 @@
  * - GPIO 2 -----> TX-
  * 
  * Resources utilized
- * - All DMA channels
- * - PIO state machines 0, 1, and 2 on PIO block 0
+ * - Every DMA channel (claimed by the transmitter)
+ * - 3 PIO state machines on PIO block 0
  * - PWM slice 7
  * - UART 0 (GPIO's 0 and 1)
  * 
  * To use:
  * - Modify parameters in udp_tx_parameters.h
  *   for your particular network
- * - When you start the program, it will print the contents of the UDP
+ * - When you start the program, it will print the headers of the UDP
  *   packet and then prompt for any user input
+ * - Each packet comes from a small pool (GetPacket()), and can carry any
+ *   payload up to UDP_MAX_PAYLOAD bytes (SendPacket(packet, length)).
+ *   This demo sends a counter as text, so the length changes as it grows.
+ * - Sent packets are queued and go out back to back, so this demo sends
+ *   as fast as the link allows
  * 
  * To test:
  *  - Here is some Python code that you can use to test.
@@ -41,17 +46,18 @@
 #include "udp_tx.h"
 
 
-// Flag to signal transaction complete from ISR to main
-volatile int done = 0 ;
+// Packets sent so far (counted in the ISR)
+volatile unsigned int sent = 0 ;
 
-// An interrupt handler, runs after packet is sent
-void pio0_interrupt_handler() {
+// An interrupt handler, runs after each packet is sent (the next one in
+// the queue has already started)
+void HOT_ISR(pio0_interrupt_handler)() {
     // Clear the interrupt
     pio_interrupt_clear(pio0, 1) ;
     // Toggle the LED
     gpio_put(25, !gpio_get(25)) ;
-    // Signal completion
-    done = 1 ;
+    // Count it
+    sent += 1 ;
 }
 
 
@@ -71,10 +77,10 @@ int main() {
     // Second argument is the name of the ISR which will be called on transmit completion.
     initUDP(2, pio0_interrupt_handler) ;
 
-    // Print out the contents of the packet
-    printf("Packet contents: \n");
-    for (int i=0; i<60; i++) {
-        printf("%02x\n", assembled_packet[i]) ;
+    // Print out the packet headers
+    printf("Packet headers: \n");
+    for (int i=0; i<HEADER_LEN; i++) {
+        printf("%02x\n", udp_pool[0].frame[i]) ;
     }
 
     // Takes a moment for the link to form, prompt for user to start the program
@@ -88,21 +94,21 @@ int main() {
     gpio_put(25, 0) ;
 
 
-    while(1) {
+    unsigned int count = 0 ;
 
-        // Send a packet (non-blocking!)
-        SEND_PACKET ;
+    while(1) {
 
-        // Modify the data for the next packet, while the previous
-        // one is still being sent!
-        udp_payload[17] = udp_payload[17] + 1 ;
+        // Take a packet from the pool. There's none free while they're
+        // all queued, until the ISR returns the one being sent.
+        udp_packet * packet = GetPacket() ;
+        if (packet == NULL) continue ;
 
-        // Wait for packet transaction to finish, if it hasn't already
-        // (done is set in the ISR triggered by end of transmission)
-        while(done!=1) {
-        }
+        // Fill in its payload (any length up to UDP_MAX_PAYLOAD)
+        int len = sprintf((char *)UDP_PAYLOAD(packet), "Hello from Pico: %u", count) ;
 
-        // Reset the done flag
-        done = 0 ;
+        // Queue it (non-blocking!). It goes out straight after the packets
+        // ahead of it, while we fill the next one.
+        SendPacket(packet, len) ;
+        count += 1 ;
     }
 }
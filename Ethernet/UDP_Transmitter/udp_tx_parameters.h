@@ -1,12 +1,21 @@
 ///////////////////////////////////////////////////////////////////////////////
 //////////////////////////// USER-MODIFIED PARAMETERS /////////////////////////
 ///////////////////////////////////////////////////////////////////////////////
-// The size of the UDP payload (measured in bytes, set at compile time).
-// This is what establishes the length of the udp_payload character array.
+// The largest UDP payload any packet will carry (measured in bytes). Each
+// packet in the pool has room for this much. 1472 fills an Ethernet frame.
+#define UDP_MAX_PAYLOAD         (1472)
+
+// Number of packet buffers in the pool (each is UDP_MAX_PAYLOAD + 42 bytes)
+#define UDP_POOL_SIZE           (4)
+
+// The size of the udp_payload array that SEND_PACKET sends (measured in bytes).
+// Packets from the pool can be any length up to UDP_MAX_PAYLOAD.
 #define DEF_UDP_PAYLOAD_SIZE    (18)
 
 // UDP payload (modified at runtime! this is just an initialization)
-// This is the character array that you modify in your application code.
+// This is the character array that SEND_PACKET sends. It isn't copied: the
+// packet's DMA reads it straight from here, so don't change or reuse it until
+// the packet has been sent.
 char udp_payload[DEF_UDP_PAYLOAD_SIZE] = "Hello from Pico: 0" ;
 
 // Ethernet destination address (MAC)
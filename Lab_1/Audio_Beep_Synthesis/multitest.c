@@ -2,21 +2,21 @@
  *  V. Hunter Adams (vha3@cornell.edu)
  
     This is an experiment with the multicore capabilities on the
-    RP2040. The program instantiates a timer interrupt on each core.
-    Each of these timer interrupts writes to a separate channel
-    of the SPI DAC and does DDS of two sine waves of two different
-    frequencies. These sine waves are amplitude-modulated to "beeps."
-
-    No spinlock is required to mediate the SPI writes because of the
-    SPI buffer on the RP2040. Spinlocks are used in the main program
+    RP2040. The program does DDS of two sine waves of two different
+    frequencies, one on each channel of the SPI DAC. These sine waves
+    are amplitude-modulated to "beeps."
+
+    The samples are rendered a block at a time on core 1, and DMA
+    streams them to the DAC at 40 kHz (see lib/dds_audio), so there
+    is one interrupt per block instead of one per sample. Spinlocks
+    are used in the main program
     running on each core to lock the other out from an incrementing
     global variable. These are "under the hood" of the PT_SEM_SAFE_x
     macros. Two threads ping-pong using these semaphores.
 
     Note that globals are visible from both cores. Note also that GPIO
     pin mappings performed on core 0 can be utilized from core 1.
-    Creation of an alarm pool is required to force a timer interrupt to
-    take place on core 1 rather than core 0.
+    The block interrupt runs on the core that starts the audio.
 
  */
 
@@ -28,70 +28,42 @@
 #include "pico/multicore.h"
 #include "hardware/sync.h"
 #include "hardware/spi.h"
+// Include the block-rendered DAC output and the DDS voice bank
+#include "dds_audio.h"
+#include "dds_voices.h"
 // Include protothreads
 #include "pt_cornell_rp2040_v1.h"
 
 // Macros for fixed-point arithmetic (faster than floating point)
-typedef signed int fix15 ;
-#define multfix15(a,b) ((fix15)((((signed long long)(a))*((signed long long)(b)))>>15))
-#define float2fix15(a) ((fix15)((a)*32768.0)) 
-#define fix2float15(a) ((float)(a)/32768.0)
-#define absfix15(a) abs(a) 
-#define int2fix15(a) ((fix15)(a << 15))
-#define fix2int15(a) ((int)(a >> 15))
-#define char2fix15(a) (fix15)(((fix15)(a)) << 15)
-#define divfix(a,b) (fix15)( (((signed long long)(a)) << 15) / (b))
+#include "fixed_point.h"
 
 //Direct Digital Synthesis (DDS) parameters
-#define two32 4294967296.0  // 2^32 (a constant)
 #define Fs 40000            // sample rate
 
-// the DDS units - core 1
-// Phase accumulator and phase increment. Increment sets output frequency.
-volatile unsigned int phase_accum_main_1;                  
-volatile unsigned int phase_incr_main_1 = (800.0*two32)/Fs ;
-// the DDS units - core 2
-// Phase accumulator and phase increment. Increment sets output frequency.
-volatile unsigned int phase_accum_main_0;
-volatile unsigned int phase_incr_main_0 = (400.0*two32)/Fs ;
-
-// DDS sine table (populated in main())
-#define sine_table_size 256
-fix15 sin_table[sine_table_size] ;
-
-// Values output to DAC
-int DAC_output_0 ;
-int DAC_output_1 ;
+// The two beeps are voices of a DDS voice bank: voice 1 (800 Hz) on DAC
+// channel A, and voice 0 (400 Hz) on channel B. Add more voices to the bank
+// for more tones at once.
+dds_voice_bank beeps ;
 
-// Amplitude modulation parameters and variables
+// Amplitude modulation parameters
 fix15 max_amplitude = int2fix15(1) ;    // maximum amplitude
-fix15 attack_inc ;                      // rate at which sound ramps up
-fix15 decay_inc ;                       // rate at which sound ramps down
-fix15 current_amplitude_0 = 0 ;         // current amplitude (modified in ISR)
-fix15 current_amplitude_1 = 0 ;         // current amplitude (modified in ISR)
 
-// Timing parameters for beeps (units of interrupts)
+// Timing parameters for beeps (units of samples)
 #define ATTACK_TIME             200
 #define DECAY_TIME              200
 #define SUSTAIN_TIME            10000
 #define BEEP_DURATION           10400
 #define BEEP_REPEAT_INTERVAL    40000
+#define BEEP_CYCLE              (BEEP_DURATION + BEEP_REPEAT_INTERVAL)
+// Voice 0 starts beeping this long after voice 1 (half a second)
+#define BEEP_OFFSET             20000
 
-// State machine variables
-volatile unsigned int STATE_0 = 0 ;
-volatile unsigned int count_0 = 0 ;
-volatile unsigned int STATE_1 = 0 ;
-volatile unsigned int count_1 = 0 ;
+// Where each beep is in its cycle (in samples)
+unsigned int beep_count[2] = {BEEP_CYCLE - BEEP_OFFSET, 0} ;
 
-// SPI data
-uint16_t DAC_data_1 ; // output value
-uint16_t DAC_data_0 ; // output value
-
-// DAC parameters (see the DAC datasheet)
-// A-channel, 1x, active
-#define DAC_config_chan_A 0b0011000000000000
-// B-channel, 1x, active
-#define DAC_config_chan_B 0b1011000000000000
+// Both beeps' envelope: ATTACK_TIME up, DECAY_TIME back down (the ADSR
+// release), full level in between
+dds_adsr beep_envelope ;
 
 //SPI configurations (note these represent GPIO number, NOT pin number)
 #define PIN_MISO 4
@@ -113,104 +85,28 @@ volatile int global_counter = 0 ;
 struct pt_sem core_1_go, core_0_go ;
 
 
-// This timer ISR is called on core 1
-bool repeating_timer_callback_core_1(struct repeating_timer *t) {
-
-    if (STATE_1 == 0) {
-        // DDS phase and sine table lookup
-        phase_accum_main_1 += phase_incr_main_1  ;
-        DAC_output_1 = fix2int15(multfix15(current_amplitude_1,
-            sin_table[phase_accum_main_1>>24])) + 2048 ;
-
-        // Ramp up amplitude
-        if (count_1 < ATTACK_TIME) {
-            current_amplitude_1 = (current_amplitude_1 + attack_inc) ;
+// Starts and ends each beep at the right block, then renders the block.
+// Called from the DMA interrupt once per block (on core 1, which started
+// the audio).
+void HOT_ISR(render_beeps)(uint16_t * block, int frames) {
+    for (int v=0; v<2; v++) {
+        unsigned int prev = beep_count[v] ;
+        unsigned int now = prev + frames ;
+        // Start the attack at the start of the cycle, and the release so
+        // that it's done at the end of the beep
+        unsigned int off = BEEP_DURATION - beep_envelope.release ;
+        if (prev == 0) {
+            dds_voice_note_on(&beeps, v, max_amplitude) ;
         }
-        // Ramp down amplitude
-        else if (count_1 > BEEP_DURATION - DECAY_TIME) {
-            current_amplitude_1 = (current_amplitude_1 - decay_inc) ;
-        }
-
-        // Mask with DAC control bits
-        DAC_data_1 = (DAC_config_chan_A | (DAC_output_1 & 0xffff))  ;
-
-        // SPI write (no spinlock b/c of SPI buffer)
-        spi_write16_blocking(SPI_PORT, &DAC_data_1, 1) ;
-
-        // Increment the counter
-        count_1 += 1 ;
-
-        // State transition?
-        if (count_1 == BEEP_DURATION) {
-            STATE_1 = 1 ;
-            count_1 = 0 ;
-        }
-    }
-
-    // State transition?
-    else {
-        count_1 += 1 ;
-        if (count_1 == BEEP_REPEAT_INTERVAL) {
-            current_amplitude_1 = 0 ;
-            STATE_1 = 0 ;
-            count_1 = 0 ;
+        if ((prev < off) && (now >= off)) {
+            dds_voice_note_off(&beeps, v) ;
         }
+        beep_count[v] = (now >= BEEP_CYCLE) ? 0 : now ;
     }
+    dds_voices_render(&beeps, block, frames, 2) ;
 
     // retrieve core number of execution
-    corenum_1 = get_core_num() ;
-
-    return true;
-}
-
-// This timer ISR is called on core 0
-bool repeating_timer_callback_core_0(struct repeating_timer *t) {
-
-    if (STATE_0 == 0) {
-        // DDS phase and sine table lookup
-        phase_accum_main_0 += phase_incr_main_0  ;
-        DAC_output_0 = fix2int15(multfix15(current_amplitude_0,
-            sin_table[phase_accum_main_0>>24])) + 2048 ;
-
-        // Ramp up amplitude
-        if (count_0 < ATTACK_TIME) {
-            current_amplitude_0 = (current_amplitude_0 + attack_inc) ;
-        }
-        // Ramp down amplitude
-        else if (count_0 > BEEP_DURATION - DECAY_TIME) {
-            current_amplitude_0 = (current_amplitude_0 - decay_inc) ;
-        }
-
-        // Mask with DAC control bits
-        DAC_data_0 = (DAC_config_chan_B | (DAC_output_0 & 0xffff))  ;
-
-        // SPI write (no spinlock b/c of SPI buffer)
-        spi_write16_blocking(SPI_PORT, &DAC_data_0, 1) ;
-
-        // Increment the counter
-        count_0 += 1 ;
-
-        // State transition?
-        if (count_0 == BEEP_DURATION) {
-            STATE_0 = 1 ;
-            count_0 = 0 ;
-        }
-    }
-
-    // State transition?
-    else {
-        count_0 += 1 ;
-        if (count_0 == BEEP_REPEAT_INTERVAL) {
-            current_amplitude_0 = 0 ;
-            STATE_0 = 0 ;
-            count_0 = 0 ;
-        }
-    }
-
-    // retrieve core number of execution
-    corenum_0 = get_core_num() ;
-
-    return true;
+    corenum_0 = corenum_1 = get_core_num() ;
 }
 
 // This thread runs on core 1
@@ -265,17 +161,12 @@ static PT_THREAD (protothread_core_0(struct pt *pt))
 // This is the core 1 entry point. Essentially main() for core 1
 void core1_entry() {
 
-    // create an alarm pool on core 1
-    alarm_pool_t *core1pool ;
-    core1pool = alarm_pool_create(2, 16) ;
-
-    // Create a repeating timer that calls repeating_timer_callback.
-    struct repeating_timer timer_core_1;
-
-    // Negative delay so means we will call repeating_timer_callback, and call it
-    // again 25us (40kHz) later regardless of how long the callback took to execute
-    alarm_pool_add_repeating_timer_us(core1pool, -25, 
-        repeating_timer_callback_core_1, NULL, &timer_core_1);
+    // Start the audio. Blocks of samples are rendered from an interrupt
+    // on this core, two DAC words (A and B) per 25us (40kHz) sample.
+    dds_audio_init(SPI_PORT, Fs, 2, render_beeps) ;
+    // LDAC is pulsed after each A/B pair, so both channels change together
+    dds_audio_ldac(PIN_CS, LDAC) ;
+    dds_audio_start() ;
 
     // Add thread to core 1
     pt_add_thread(protothread_core_1) ;
@@ -303,46 +194,28 @@ int main() {
     gpio_set_function(PIN_MOSI, GPIO_FUNC_SPI);
     gpio_set_function(PIN_CS, GPIO_FUNC_SPI) ;
 
-    // Map LDAC pin to GPIO port, hold it low (could alternatively tie to GND)
-    gpio_init(LDAC) ;
-    gpio_set_dir(LDAC, GPIO_OUT) ;
-    gpio_put(LDAC, 0) ;
-
     // Map LED to GPIO port, make it low
     gpio_init(LED) ;
     gpio_set_dir(LED, GPIO_OUT) ;
     gpio_put(LED, 0) ;
 
-    // set up increments for calculating bow envelope
-    attack_inc = divfix(max_amplitude, int2fix15(ATTACK_TIME)) ;
-    decay_inc =  divfix(max_amplitude, int2fix15(DECAY_TIME)) ;
-
-    // Build the sine lookup table
-    // scaled to produce values between 0 and 4096 (for 12-bit DAC)
-    int ii;
-    for (ii = 0; ii < sine_table_size; ii++){
-         sin_table[ii] = float2fix15(2047*sin((float)ii*6.283/(float)sine_table_size));
-    }
+    // Set up the beep voices
+    dds_voices_init(&beeps, Fs) ;
+    dds_adsr_set(&beep_envelope, Fs, ATTACK_TIME * 1000.0 / Fs, 0.0, 1.0, DECAY_TIME * 1000.0 / Fs) ;
+    dds_voice_set_envelope(&beeps, 0, &beep_envelope) ;
+    dds_voice_set_envelope(&beeps, 1, &beep_envelope) ;
+    dds_voice_set_freq(&beeps, 0, 400.0) ;
+    dds_voice_set_channel(&beeps, 0, 1) ;
+    dds_voice_set_freq(&beeps, 1, 800.0) ;
+    dds_voice_set_channel(&beeps, 1, 0) ;
 
     // Initialize the intercore semaphores
     PT_SEM_SAFE_INIT(&core_0_go, 1) ;
     PT_SEM_SAFE_INIT(&core_1_go, 0) ;
 
-    // Launch core 1
+    // Launch core 1 (which starts the audio)
     multicore_launch_core1(core1_entry);
 
-    // Desynchronize the beeps
-    sleep_ms(500) ;
-
-    // Create a repeating timer that calls 
-    // repeating_timer_callback (defaults core 0)
-    struct repeating_timer timer_core_0;
-
-    // Negative delay so means we will call repeating_timer_callback, and call it
-    // again 25us (40kHz) later regardless of how long the callback took to execute
-    add_repeating_timer_us(-25, 
-        repeating_timer_callback_core_0, NULL, &timer_core_0);
-
     // Add core 0 threads
     pt_add_thread(protothread_core_0) ;
 
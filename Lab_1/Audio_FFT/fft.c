@@ -4,7 +4,9 @@
  * This demonstration calculates an FFT of audio input, and
  * then displays that FFT on a 640x480 VGA display.
  * 
- * Core 0 computes and displays the FFT. Core 1 blinks the LED.
+ * In PIPELINE_MODE (the default, see below) core 1 computes the FFT
+ * and blinks the LED, and core 0 displays it. Without it, core 0
+ * computes and displays the FFT and core 1 blinks the LED.
  *
  * HARDWARE CONNECTIONS
  *  - GPIO 16 ---> VGA Hsync
@@ -14,11 +16,13 @@
  *  - GPIO 20 ---> 330 ohm resistor ---> VGA Blue
  *  - RP2040 GND ---> VGA GND
  *  - GPIO 26 ---> Audio input [0-3.3V]
+ *  - GPIO 27, 28 ---> More audio inputs, with ADC_CHANNELS 2 or 3
  *
  * RESOURCES USED
- *  - PIO state machines 0, 1, and 2 on PIO instance 0
- *  - DMA channels 0, 1, 2, and 3
- *  - ADC channel 0
+ *  - 3 PIO state machines and 2 DMA channels for VGA, and 2 DMA
+ *    channels for the FFT, claimed from lib/hw_claim
+ *  - DMA_IRQ_0 (end of each capture block)
+ *  - ADC channel 0 (and 1, 2 with ADC_CHANNELS)
  *  - 153.6 kBytes of RAM (for pixel color data)
  *
  */
@@ -36,173 +40,324 @@
 // Include hardware libraries
 #include "hardware/pio.h"
 #include "hardware/dma.h"
+#include "hw_claim.h"
 #include "hardware/adc.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
 // Include protothreads
 #include "pt_cornell_rp2040_v1.h"
+// Include the fixed-point FFT
+#include "fix_fft.h"
+// Include the Goertzel filter bank (for TONE_DETECT)
+#include "goertzel.h"
 
 // Define the LED pin
 #define LED     25
 
+// Window, FFT and magnitudes on core 1, drawing on core 0, with finished
+// spectra passed between them. Comment out to do it all on core 0.
+#define PIPELINE_MODE
+
+// FFT frames per NUM_SAMPLES new samples: 1 (no overlap), 2 (50% overlap)
+// or 4 (75% overlap)
+#define OVERLAP 2
+// Spectrum averaging: AVG_NONE, AVG_EXPONENTIAL (each frame weighted
+// 1/2^AVG_SHIFT) or AVG_FRAMES (mean of each AVG_COUNT frames)
+#define AVG_NONE        0
+#define AVG_EXPONENTIAL 1
+#define AVG_FRAMES      2
+#define AVERAGING AVG_EXPONENTIAL
+#define AVG_SHIFT 3
+#define AVG_COUNT 8
+// Hold the peak of each bin (drawn in red), falling by 1/2^PEAK_DECAY_SHIFT
+// of itself per frame. Comment out to turn off.
+#define PEAK_HOLD
+#define PEAK_DECAY_SHIFT 6
+// Draw the bars in dB, DB_RANGE dB from DB_TOP at the top of the plot
+// down to the bottom. A full-scale sine is about +30 dB. Comment out for
+// a linear plot.
+#define DISPLAY_DB
+#define DB_TOP   30
+#define DB_RANGE 80
+// Instead of bars, draw a spectrogram: each spectrum is one new row of
+// color-coded levels at the bottom of the plot, and the rows above scroll
+// up by moving the VGA scanout addresses (the driver's VGA_SCROLL, set in
+// CMakeLists.txt), so only that one row is drawn. With several inputs,
+// each gets a column of the plot.
+//#define DISPLAY_WATERFALL
+// Also decode DTMF tones on the first input with a Goertzel bank over its
+// 8 frequencies (TONE_BLOCK samples per measurement), alongside the FFT.
+// A key needs a row and a column tone above TONE_LEVEL (in 8-bit sample
+// units). Comment out to turn off.
+#define TONE_DETECT
+#define TONE_BLOCK 256
+#define TONE_LEVEL 8
+
+#if defined(DISPLAY_WATERFALL) && !defined(VGA_SCROLL)
+#error "DISPLAY_WATERFALL needs the VGA driver built with VGA_SCROLL"
+#endif
+
 // === the fixed point macros (16.15) ========================================
-typedef signed int fix15 ;
-#define multfix15(a,b) ((fix15)((((signed long long)(a))*((signed long long)(b)))>>15))
-#define float2fix15(a) ((fix15)((a)*32768.0)) // 2^15
-#define fix2float15(a) ((float)(a)/32768.0)
-#define absfix15(a) abs(a) 
-#define int2fix15(a) ((fix15)(a << 15))
-#define fix2int15(a) ((int)(a >> 15))
-#define char2fix15(a) (fix15)(((fix15)(a)) << 15)
+#include "fixed_point.h"
 
 /////////////////////////// ADC configuration ////////////////////////////////
-// ADC Channel and pin
+// ADC Channel and pin (of the first input)
 #define ADC_CHAN 0
 #define ADC_PIN 26
-// Number of samples per FFT
-#define NUM_SAMPLES 1024
-// Number of samples per FFT, minus 1
-#define NUM_SAMPLES_M_1 1023
-// Length of short (16 bits) minus log2 number of samples (10)
-#define SHIFT_AMOUNT 6
+// Number of inputs, from ADC_CHAN up, captured round-robin into one
+// stream (1 to 3). Each one is sampled at Fs and gets its own FFT.
+#define ADC_CHANNELS 1
+// Keep all 12 bits of each sample (16-bit transfers) instead of 8
+//#define ADC_12BIT
+#if (ADC_CHANNELS < 1) || (ADC_CHAN + ADC_CHANNELS > 4)
+#error "ADC_CHANNELS inputs from ADC_CHAN must be among ADC inputs 0...3"
+#endif
+#ifdef ADC_12BIT
+typedef uint16_t sample_t ;
+#define sample2fix15(a) ((fix15)(a) << 11)  // same scale as 8-bit samples
+#else
+typedef uint8_t sample_t ;
+#define sample2fix15(a) int2fix15((int)(a))
+#endif
+// Number of samples per FFT (1024 unless FFT_LOG2_N is set)
+#define NUM_SAMPLES FFT_N
 // Log2 number of samples
-#define LOG2_NUM_SAMPLES 10
+#define LOG2_NUM_SAMPLES FFT_LOG2_N
 // Sample rate (Hz)
 #define Fs 10000.0
 // ADC clock rate (unmutable!)
 #define ADCCLK 48000000.0
 
-// DMA channels for sampling ADC (VGA driver uses 0 and 1)
-int sample_chan = 2 ;
-int control_chan = 3 ;
+// DMA channels for sampling ADC (claimed from lib/hw_claim in main)
+int sample_chan ;
+int control_chan ;
 
 // Max and min macros
 #define max(a,b) ((a>b)?a:b)
 #define min(a,b) ((a<b)?a:b)
 
-// 0.4 in fixed point (used for alpha max plus beta min)
-fix15 zero_point_4 = float2fix15(0.4) ;
-
-// Here's where we'll have the DMA channel put ADC samples
-uint8_t sample_array[NUM_SAMPLES] ;
+// Here's where we'll have the DMA channel put ADC samples: a ring of
+// 2*OVERLAP blocks of HOP_SAMPLES from each input, interleaved. Each FFT
+// frame is the newest NUM_SAMPLES samples (FRAME_BLOCKS blocks) of an
+// input while the next block fills.
+#define HOP_SAMPLES (NUM_SAMPLES/OVERLAP)
+#define FRAME_BLOCKS OVERLAP
+#define RING_BLOCKS (2*OVERLAP)
+#define BLOCK_TRANSFERS (HOP_SAMPLES*ADC_CHANNELS)
+#define RING_SAMPLES (2*NUM_SAMPLES*ADC_CHANNELS)
+#if (OVERLAP == 1)
+#define RING_BITS 3     // log2 of the bytes of sample_address_pointers
+#elif (OVERLAP == 2)
+#define RING_BITS 4
+#elif (OVERLAP == 4)
+#define RING_BITS 5
+#else
+#error "OVERLAP must be 1, 2 or 4"
+#endif
+sample_t sample_array[RING_SAMPLES] __attribute__((aligned(4))) ;
 // And here's where we'll copy those samples for FFT calculation
+// (fft_real() needs no imaginary array)
 fix15 fr[NUM_SAMPLES] ;
-fix15 fi[NUM_SAMPLES] ;
-
-// Sine table for the FFT calculation
-fix15 Sinewave[NUM_SAMPLES]; 
-// Hann window table for FFT calculation
-fix15 window[NUM_SAMPLES]; 
-
-// Pointer to address of start of sample buffer
-uint8_t * sample_address_pointer = &sample_array[0] ;
-
-// Peforms an in-place FFT. For more information about how this
-// algorithm works, please see https://vanhunteradams.com/FFT/FFT.html
-void FFTfix(fix15 fr[], fix15 fi[]) {
-    
-    unsigned short m;   // one of the indices being swapped
-    unsigned short mr ; // the other index being swapped (r for reversed)
-    fix15 tr, ti ; // for temporary storage while swapping, and during iteration
-    
-    int i, j ; // indices being combined in Danielson-Lanczos part of the algorithm
-    int L ;    // length of the FFT's being combined
-    int k ;    // used for looking up trig values from sine table
-    
-    int istep ; // length of the FFT which results from combining two FFT's
-    
-    fix15 wr, wi ; // trigonometric values from lookup table
-    fix15 qr, qi ; // temporary variables used during DL part of the algorithm
-    
-    //////////////////////////////////////////////////////////////////////////
-    ////////////////////////// BIT REVERSAL //////////////////////////////////
-    //////////////////////////////////////////////////////////////////////////
-    // Bit reversal code below based on that found here: 
-    // https://graphics.stanford.edu/~seander/bithacks.html#BitReverseObvious
-    for (m=1; m<NUM_SAMPLES_M_1; m++) {
-        // swap odd and even bits
-        mr = ((m >> 1) & 0x5555) | ((m & 0x5555) << 1);
-        // swap consecutive pairs
-        mr = ((mr >> 2) & 0x3333) | ((mr & 0x3333) << 2);
-        // swap nibbles ... 
-        mr = ((mr >> 4) & 0x0F0F) | ((mr & 0x0F0F) << 4);
-        // swap bytes
-        mr = ((mr >> 8) & 0x00FF) | ((mr & 0x00FF) << 8);
-        // shift down mr
-        mr >>= SHIFT_AMOUNT ;
-        // don't swap that which has already been swapped
-        if (mr<=m) continue ;
-        // swap the bit-reveresed indices
-        tr = fr[m] ;
-        fr[m] = fr[mr] ;
-        fr[mr] = tr ;
-        ti = fi[m] ;
-        fi[m] = fi[mr] ;
-        fi[mr] = ti ;
+
+// Addresses of the blocks, in the order the control channel loads them
+// into the sample channel at the end of each block (filled in main)
+sample_t * sample_address_pointers[RING_BLOCKS] __attribute__((aligned(4*RING_BLOCKS))) ;
+
+// Number of blocks the sample channel has finished (counted in the DMA
+// IRQ) and that the FFT thread has taken
+volatile unsigned int blocks_captured = 0 ;
+unsigned int blocks_processed = 0 ;
+// Blocks that were overwritten before the FFT thread got to them
+unsigned int blocks_dropped = 0 ;
+
+// Sample channel finished a block. The control channel has already
+// pointed it at the next one and restarted it.
+void capture_irq_handler() {
+    if (dma_hw->ints0 & (1u << sample_chan)) {
+        dma_hw->ints0 = 1u << sample_chan ;
+        blocks_captured++ ;
     }
-    //////////////////////////////////////////////////////////////////////////
-    ////////////////////////// Danielson-Lanczos //////////////////////////////
-    //////////////////////////////////////////////////////////////////////////
-    // Adapted from code by:
-    // Tom Roberts 11/8/89 and Malcolm Slaney 12/15/94 malcolm@interval.com
-    // Length of the FFT's being combined (starts at 1)
-    L = 1 ;
-    // Log2 of number of samples, minus 1
-    k = LOG2_NUM_SAMPLES - 1 ;
-    // While the length of the FFT's being combined is less than the number 
-    // of gathered samples . . .
-    while (L < NUM_SAMPLES) {
-        // Determine the length of the FFT which will result from combining two FFT's
-        istep = L<<1 ;
-        // For each element in the FFT's that are being combined . . .
-        for (m=0; m<L; ++m) { 
-            // Lookup the trig values for that element
-            j = m << k ;                         // index of the sine table
-            wr =  Sinewave[j + NUM_SAMPLES/4] ; // cos(2pi m/N)
-            wi = -Sinewave[j] ;                 // sin(2pi m/N)
-            wr >>= 1 ;                          // divide by two
-            wi >>= 1 ;                          // divide by two
-            // i gets the index of one of the FFT elements being combined
-            for (i=m; i<NUM_SAMPLES; i+=istep) {
-                // j gets the index of the FFT element being combined with i
-                j = i + L ;
-                // compute the trig terms (bottom half of the above matrix)
-                tr = multfix15(wr, fr[j]) - multfix15(wi, fi[j]) ;
-                ti = multfix15(wr, fi[j]) + multfix15(wi, fr[j]) ;
-                // divide ith index elements by two (top half of above matrix)
-                qr = fr[i]>>1 ;
-                qi = fi[i]>>1 ;
-                // compute the new values at each index
-                fr[j] = qr - tr ;
-                fi[j] = qi - ti ;
-                fr[i] = qr + tr ;
-                fi[i] = qi + ti ;
-            }    
-        }
-        --k ;
-        L = istep ;
+}
+
+// A finished spectrum, handed from the FFT thread to the renderer
+typedef struct {
+    // (averaged) magnitudes of bins 0 ... N/2-1 of each input, or dB
+    fix15 mag[ADC_CHANNELS][NUM_SAMPLES>>1] ;
+#ifdef PEAK_HOLD
+    fix15 peak[ADC_CHANNELS][NUM_SAMPLES>>1] ;  // held peaks, or dB
+#endif
+    float max_freqency[ADC_CHANNELS] ;          // interpolated frequency of the max bin
+#ifdef TONE_DETECT
+    char tone_key ;                             // DTMF key heard, or ' '
+#endif
+} spectrum_t ;
+
+#ifdef TONE_DETECT
+// DTMF row tones, then column tones
+const float dtmf_freqs[8] = {697, 770, 852, 941, 1209, 1336, 1477, 1633} ;
+const char dtmf_keys[4][4] = {
+    {'1', '2', '3', 'A'},
+    {'4', '5', '6', 'B'},
+    {'7', '8', '9', 'C'},
+    {'*', '0', '#', 'D'}
+} ;
+goertzel_bank tones ;
+// Key from the latest measurement
+char tone_key = ' ' ;
+
+// Run the bank over a new block of samples from the first input (from
+// block in the ring), and decode the loudest row and column
+void detect_tones(unsigned int block) {
+    const sample_t * samples = &sample_array[block * BLOCK_TRANSFERS] ;
+#ifdef ADC_12BIT
+    fix15 threshold = int2fix15(TONE_LEVEL * 16) ;
+    if (!goertzel_samples_u16(&tones, samples, HOP_SAMPLES, ADC_CHANNELS)) return ;
+#else
+    fix15 threshold = int2fix15(TONE_LEVEL) ;
+    if (!goertzel_samples_u8(&tones, samples, HOP_SAMPLES, ADC_CHANNELS)) return ;
+#endif
+    int i, row = 0, col = 4 ;
+    for (i=1; i<4; i++) {
+        if (goertzel_level(&tones, i) > goertzel_level(&tones, row)) row = i ;
+        if (goertzel_level(&tones, i+4) > goertzel_level(&tones, col)) col = i+4 ;
+    }
+    if (goertzel_level(&tones, row) > threshold && goertzel_level(&tones, col) > threshold) {
+        tone_key = dtmf_keys[row][col-4] ;
+    }
+    else {
+        tone_key = ' ' ;
     }
 }
+#endif
+
+// Running state of the averaging and peak hold, kept by the FFT thread
+// (with AVG_NONE, mag_avg is just the latest frame)
+fix15 mag_avg[ADC_CHANNELS][NUM_SAMPLES>>1] ;
+#if (AVERAGING == AVG_FRAMES)
+fix15 mag_sum[ADC_CHANNELS][NUM_SAMPLES>>1] ;
+int frames_summed = 0 ;
+#endif
+#ifdef PEAK_HOLD
+fix15 mag_peak[ADC_CHANNELS][NUM_SAMPLES>>1] ;
+#endif
+
+#ifdef PIPELINE_MODE
+// Single-producer (core 1), single-consumer (core 0) ring of spectra.
+// Core 1 only writes spectra_head and core 0 only writes spectra_tail.
+#define SPECTRUM_SLOTS 2
+spectrum_t spectra[SPECTRUM_SLOTS] ;
+volatile unsigned int spectra_head = 0 ;
+volatile unsigned int spectra_tail = 0 ;
+// Spectra thrown away because the renderer still had both slots
+unsigned int spectra_dropped = 0 ;
+#else
+spectrum_t spectrum ;
+#endif
+
+// Window the frame of each input that starts at sample start (of each
+// input) of the ring, FFT it, and fold its magnitudes into the averages
+// and peaks. Returns 1 when there's a new average to show (every frame
+// except with AVG_FRAMES).
+char analyze_frame(unsigned int start) {
+    int i, c ;
+    unsigned int j ;
+
+    for (c=0; c<ADC_CHANNELS; c++) {
+        // Copy/window this input's elements into a fixed-point array,
+        // taking every ADC_CHANNELS'th sample around the ring
+        j = start * ADC_CHANNELS + c ;
+        for (i=0; i<NUM_SAMPLES; i++) {
+            fr[i] = multfix15(sample2fix15(sample_array[j]), fft_hann[i]) ;
+            j += ADC_CHANNELS ;
+            if (j >= RING_SAMPLES) j -= RING_SAMPLES ;
+        }
 
-// Runs on core 0
-static PT_THREAD (protothread_fft(struct pt *pt))
-{
-    // Indicate beginning of thread
-    PT_BEGIN(pt) ;
-    printf("Starting capture\n") ;
-    // Start the ADC channel
-    dma_start_channel_mask((1u << sample_chan)) ;
-    // Start the ADC
-    adc_run(true) ;
+        // Compute the FFT (of real samples)
+        fft_real(fr) ;
+
+        // Find the magnitudes, reusing fr to hold them
+        fft_real_mag(fr, fr) ;
+
+        for (i = 0; i < (NUM_SAMPLES>>1); i++) {  
+#if (AVERAGING == AVG_EXPONENTIAL)
+            mag_avg[c][i] += (fr[i] - mag_avg[c][i]) >> AVG_SHIFT ;
+#elif (AVERAGING == AVG_FRAMES)
+            mag_sum[c][i] += fr[i] ;
+#else
+            mag_avg[c][i] = fr[i] ;
+#endif
+#ifdef PEAK_HOLD
+            mag_peak[c][i] -= mag_peak[c][i] >> PEAK_DECAY_SHIFT ;
+            if (fr[i] > mag_peak[c][i]) mag_peak[c][i] = fr[i] ;
+#endif
+        }
+    }
 
-    // Declare some static variables
-    static int height ;             // for scaling display
-    static float max_freqency ;     // holds max frequency
-    static int i ;                  // incrementing loop variable
+#if (AVERAGING == AVG_FRAMES)
+    // Every AVG_COUNT frames, the sums become the new mean
+    if (++frames_summed < AVG_COUNT) return 0 ;
+    for (c=0; c<ADC_CHANNELS; c++) {
+        for (i = 0; i < (NUM_SAMPLES>>1); i++) {
+            mag_avg[c][i] = mag_sum[c][i] / AVG_COUNT ;
+            mag_sum[c][i] = 0 ;
+        }
+    }
+    frames_summed = 0 ;
+#endif
+    return 1 ;
+}
 
-    static fix15 max_fr ;           // temporary variable for max freq calculation
-    static int max_fr_dex ;         // index of max frequency
+// Fill in a spectrum to draw from the averages, with each input's max bin
+// refined by fitting a parabola through it and its neighbors
+void fill_spectrum(spectrum_t * out) {
+    int i, c ;
+
+    for (c=0; c<ADC_CHANNELS; c++) {
+        fix15 max_fr = 0 ;          // temporary variable for max freq calculation
+        int max_fr_dex = 0 ;        // index of max frequency
+        const fix15 * mag = mag_avg[c] ;
+
+#ifdef DISPLAY_DB
+        fft_db_array(mag, out->mag[c], NUM_SAMPLES>>1) ;
+#ifdef PEAK_HOLD
+        fft_db_array(mag_peak[c], out->peak[c], NUM_SAMPLES>>1) ;
+#endif
+#endif
+
+        for (i = 0; i < (NUM_SAMPLES>>1); i++) {
+#ifndef DISPLAY_DB
+            out->mag[c][i] = mag[i] ;
+#ifdef PEAK_HOLD
+            out->peak[c][i] = mag_peak[c][i] ;
+#endif
+#endif
+            // Keep track of maximum
+            if (mag[i] > max_fr && i>4) {
+                max_fr = mag[i] ;
+                max_fr_dex = i ;
+            }
+        }
+
+        // The peak of the parabola through bins k-1, k, k+1 (y0, y1, y2)
+        // is delta = (y0 - y2) / 2(y0 - 2y1 + y2) bins from k
+        float delta = 0 ;
+        if (max_fr_dex > 0 && max_fr_dex < (NUM_SAMPLES>>1) - 1) {
+            int y0 = mag[max_fr_dex - 1] ;
+            int y1 = mag[max_fr_dex] ;
+            int y2 = mag[max_fr_dex + 1] ;
+            int denom = y0 - 2*y1 + y2 ;
+            if (denom != 0) delta = 0.5f * (float)(y0 - y2) / (float)denom ;
+        }
+        // Compute max frequency in Hz
+        out->max_freqency[c] = (max_fr_dex + delta) * (Fs/NUM_SAMPLES) ;
+    }
+#ifdef TONE_DETECT
+    out->tone_key = tone_key ;
+#endif
+}
 
-    // Write some text to VGA
+// Write the static text to VGA
+void draw_labels() {
     setTextColor(WHITE) ;
     setCursor(65, 0) ;
     setTextSize(1) ;
@@ -216,67 +371,199 @@ static PT_THREAD (protothread_fft(struct pt *pt))
     setCursor(250, 0) ;
     setTextSize(2) ;
     writeString("Max freqency:") ;
+#ifdef TONE_DETECT
+    setCursor(430, 0) ;
+    writeString("DTMF:") ;
+#endif
+}
 
-    // Will be used to write dynamic text to screen
-    static char freqtext[40];
-
+// Each input gets a plot PLOT_HEIGHT high, stacked from the top, in its
+// own color
+#define PLOT_HEIGHT (429/ADC_CHANNELS)
+const char plot_colors[3] = {WHITE, GREEN, CYAN} ;
+
+// Height in pixels (0 to PLOT_HEIGHT) of a bar for a magnitude (or dB)
+int bar_height(fix15 v) {
+#ifdef DISPLAY_DB
+    int height = ((v - DB_TOP*32768 + DB_RANGE*32768) >> 8) * PLOT_HEIGHT / (DB_RANGE << 7) ;
+#else
+    int height = fix2int15(multfix15(v, int2fix15(36))) / ADC_CHANNELS ;
+#endif
+    return max(0, min(height, PLOT_HEIGHT)) ;
+}
 
-    while(1) {
-        // Wait for NUM_SAMPLES samples to be gathered
-        // Measure wait time with timer. THIS IS BLOCKING
-        dma_channel_wait_for_finish_blocking(sample_chan);
+#ifdef DISPLAY_WATERFALL
+// The waterfall is screen lines WATERFALL_TOP to the bottom. Each input
+// gets a column WATERFALL_WIDTH pixels wide, one pixel for every
+// ADC_CHANNELS bins (the largest of them).
+#define WATERFALL_TOP 50
+#define WATERFALL_WIDTH (((NUM_SAMPLES>>1) - 5) / ADC_CHANNELS)
+// The 8 colors from dark to bright
+const char heat_colors[8] = {BLACK, BLUE, RED, MAGENTA, GREEN, CYAN, YELLOW, WHITE} ;
+
+// Color for a magnitude (or dB), on the same scale as the bars
+char heat_color(fix15 v) {
+#ifdef DISPLAY_DB
+    int level = ((v - DB_TOP*32768 + DB_RANGE*32768) >> 8) * 8 / (DB_RANGE << 7) ;
+#else
+    int level = fix2int15(multfix15(v, int2fix15(36))) * 8 / 429 ;
+#endif
+    return heat_colors[max(0, min(level, 7))] ;
+}
 
-        // Copy/window elements into a fixed-point array
-        for (i=0; i<NUM_SAMPLES; i++) {
-            fr[i] = multfix15(int2fix15((int)sample_array[i]), window[i]) ;
-            fi[i] = (fix15) 0 ;
+// Draw the newest spectrum into the row that the last vga_scroll(1)
+// brought to the bottom of the waterfall
+void draw_waterfall_row(const spectrum_t * s) {
+    short y = vga_scroll_line(479) ;
+    int c, x, k ;
+    for (c=0; c<ADC_CHANNELS; c++) {
+        for (x=0; x<WATERFALL_WIDTH; x++) {
+            fix15 v = s->mag[c][5 + x*ADC_CHANNELS] ;
+            for (k=1; k<ADC_CHANNELS; k++) {
+                v = max(v, s->mag[c][5 + x*ADC_CHANNELS + k]) ;
+            }
+            drawPixel(64 + c*WATERFALL_WIDTH + x, y, heat_color(v)) ;
         }
+    }
+}
+#endif
 
-        // Zero max frequency and max frequency index
-        max_fr = 0 ;
-        max_fr_dex = 0 ;
+// Draw the max frequencies and the spectrum bars
+void draw_spectrum(const spectrum_t * s) {
+    int i, c, height, bottom ;
+    // Will be used to write dynamic text to screen
+    char freqtext[40];
 
-        // Restart the sample channel, now that we have our copy of the samples
-        dma_channel_start(control_chan) ;
+    // Display on VGA
+    fillRect(250, 20, 130*ADC_CHANNELS, 30, BLACK); // red box
+    setTextSize(2) ;
+    for (c=0; c<ADC_CHANNELS; c++) {
+        sprintf(freqtext, "%.1f", s->max_freqency[c]) ;
+        setTextColor(plot_colors[c]) ;
+        setCursor(250 + 130*c, 20) ;
+        writeString(freqtext) ;
+    }
+#ifdef TONE_DETECT
+    setTextColor2(YELLOW, BLACK) ;
+    setCursor(496, 0) ;
+    tft_write(s->tone_key) ;
+#endif
+
+#ifdef DISPLAY_WATERFALL
+    draw_waterfall_row(s) ;
+    return ;
+#endif
+    // Update the FFT display
+    for (c=0; c<ADC_CHANNELS; c++) {
+        bottom = 50 + (c+1)*PLOT_HEIGHT ;
+        for (i=5; i<(NUM_SAMPLES>>1); i++) {
+            drawVLine(59+i, bottom-PLOT_HEIGHT, PLOT_HEIGHT, BLACK);
+            height = bar_height(s->mag[c][i]) ;
+            drawVLine(59+i, bottom-height, height, plot_colors[c]);
+#ifdef PEAK_HOLD
+            height = bar_height(s->peak[c][i]) ;
+            drawPixel(59+i, bottom-height, RED);
+#endif
+        }
+    }
+}
+
+// Computes spectra on core 1 (PIPELINE_MODE) or core 0
+static PT_THREAD (protothread_fft(struct pt *pt))
+{
+    // Indicate beginning of thread
+    PT_BEGIN(pt) ;
+#ifdef TONE_DETECT
+    // Set up the DTMF detector
+    goertzel_init(&tones, Fs, TONE_BLOCK) ;
+    for (int t=0; t<8; t++) goertzel_add(&tones, dtmf_freqs[t]) ;
+#endif
+    printf("Starting capture\n") ;
+    // Start the ADC channel
+    dma_start_channel_mask((1u << sample_chan)) ;
+    // Start the ADC
+    adc_run(true) ;
 
-        // Compute the FFT
-        FFTfix(fr, fi) ;
+    static unsigned int start ;     // first sample (of each input) of the frame in the ring
 
-        // Find the magnitudes (alpha max plus beta min)
-        for (int i = 0; i < (NUM_SAMPLES>>1); i++) {  
-            // get the approx magnitude
-            fr[i] = abs(fr[i]); 
-            fi[i] = abs(fi[i]);
-            // reuse fr to hold magnitude
-            fr[i] = max(fr[i], fi[i]) + 
-                    multfix15(min(fr[i], fi[i]), zero_point_4); 
+#ifndef PIPELINE_MODE
+    draw_labels() ;
+#endif
 
-            // Keep track of maximum
-            if (fr[i] > max_fr && i>4) {
-                max_fr = fr[i] ;
-                max_fr_dex = i ;
-            }
+    while(1) {
+        // Wait for the next block of HOP_SAMPLES samples to be gathered
+        // (capture carries on into the one after meanwhile), and for
+        // enough blocks for the first frame
+        PT_YIELD_UNTIL(pt, blocks_captured != blocks_processed &&
+                           blocks_captured >= FRAME_BLOCKS) ;
+        // If we fell more than a block behind, skip to the newest one
+        if (blocks_captured - blocks_processed > 1) {
+            blocks_dropped += blocks_captured - blocks_processed - 1 ;
+            blocks_processed = blocks_captured - 1 ;
         }
-        // Compute max frequency in Hz
-        max_freqency = max_fr_dex * (Fs/NUM_SAMPLES) ;
+        blocks_processed++ ;
+#ifdef TONE_DETECT
+        detect_tones((blocks_processed - 1) % RING_BLOCKS) ;
+#endif
+        // The frame is the newest FRAME_BLOCKS blocks, which fill the
+        // ring in order
+        start = (blocks_processed - FRAME_BLOCKS) * HOP_SAMPLES ;
+
+        // Nothing to show yet while averaging frames
+        if (!analyze_frame(start)) continue ;
+
+#ifdef PIPELINE_MODE
+        // Never wait on the renderer: if both slots are full, don't show
+        // this one
+        if (spectra_head - spectra_tail >= SPECTRUM_SLOTS) {
+            spectra_dropped++ ;
+            continue ;
+        }
+        fill_spectrum(&spectra[spectra_head % SPECTRUM_SLOTS]) ;
+        // Publish the slot only once it's written
+        __dmb() ;
+        spectra_head++ ;
+#else
+        fill_spectrum(&spectrum) ;
+#ifdef DISPLAY_WATERFALL
+        // Scroll, and wait for it to take effect so that the row to be
+        // overwritten is off the top of the screen
+        vga_scroll(1) ;
+        PT_YIELD_UNTIL(pt, !vga_scroll_pending()) ;
+#endif
+        draw_spectrum(&spectrum) ;
+#endif
+    }
+    PT_END(pt) ;
+}
 
-        // Display on VGA
-        fillRect(250, 20, 176, 30, BLACK); // red box
-        sprintf(freqtext, "%d", (int)max_freqency) ;
-        setCursor(250, 20) ;
-        setTextSize(2) ;
-        writeString(freqtext) ;
+#ifdef PIPELINE_MODE
+// Draws the spectra from core 1, on core 0
+static PT_THREAD (protothread_render(struct pt *pt))
+{
+    // Indicate beginning of thread
+    PT_BEGIN(pt) ;
 
-        // Update the FFT display
-        for (int i=5; i<(NUM_SAMPLES>>1); i++) {
-            drawVLine(59+i, 50, 429, BLACK);
-            height = fix2int15(multfix15(fr[i], int2fix15(36))) ;
-            drawVLine(59+i, 479-height, height, WHITE);
-        }
+    draw_labels() ;
 
+    while(1) {
+        // Wait for a finished spectrum
+        PT_YIELD_UNTIL(pt, spectra_tail != spectra_head) ;
+        __dmb() ;
+#ifdef DISPLAY_WATERFALL
+        // Scroll, and wait for it to take effect so that the row to be
+        // overwritten is off the top of the screen
+        vga_scroll(1) ;
+        PT_YIELD_UNTIL(pt, !vga_scroll_pending()) ;
+#endif
+        draw_spectrum(&spectra[spectra_tail % SPECTRUM_SLOTS]) ;
+        // Give the slot back to core 1
+        __dmb() ;
+        spectra_tail++ ;
     }
     PT_END(pt) ;
 }
+#endif
 
 static PT_THREAD (protothread_blink(struct pt *pt))
 {
@@ -293,6 +580,9 @@ static PT_THREAD (protothread_blink(struct pt *pt))
 // Core 1 entry point (main() for core 1)
 void core1_entry() {
     // Add and schedule threads
+#ifdef PIPELINE_MODE
+    pt_add_thread(protothread_fft) ;
+#endif
     pt_add_thread(protothread_blink) ;
     pt_schedule_start ;
 }
@@ -304,6 +594,10 @@ int main() {
 
     // Initialize the VGA screen
     initVGA() ;
+#ifdef DISPLAY_WATERFALL
+    // Everything below the text scrolls
+    vga_set_scroll_region(WATERFALL_TOP, 480) ;
+#endif
 
     // Map LED to GPIO port, make it low
     gpio_init(LED) ;
@@ -314,7 +608,10 @@ int main() {
     // ============================== ADC CONFIGURATION ==========================
     //////////////////////////////////////////////////////////////////////////////
     // Init GPIO for analogue use: hi-Z, no pulls, disable digital input buffer.
-    adc_gpio_init(ADC_PIN);
+    int ii;
+    for (ii = 0; ii < ADC_CHANNELS; ii++) {
+        adc_gpio_init(ADC_PIN + ii);
+    }
 
     // Initialize the ADC harware
     // (resets it, enables the clock, spins until the hardware is ready)
@@ -322,6 +619,10 @@ int main() {
 
     // Select analog mux input (0...3 are GPIO 26, 27, 28, 29; 4 is temp sensor)
     adc_select_input(ADC_CHAN) ;
+#if (ADC_CHANNELS > 1)
+    // and visit the others in turn after it, round-robin
+    adc_set_round_robin(((1u << ADC_CHANNELS) - 1) << ADC_CHAN) ;
+#endif
 
     // Setup the FIFO
     adc_fifo_setup(
@@ -329,7 +630,11 @@ int main() {
         true,    // Enable DMA data request (DREQ)
         1,       // DREQ (and IRQ) asserted when at least 1 sample present
         false,   // We won't see the ERR bit because of 8 bit reads; disable.
+#ifdef ADC_12BIT
+        false    // Keep all 12 bits (16-bit DMA transfers)
+#else
         true     // Shift each sample to 8 bits when pushing to FIFO
+#endif
     );
 
     // Divisor of 0 -> full speed. Free-running capture with the divider is
@@ -338,62 +643,79 @@ int main() {
     // cycles, so in general you want a divider of 0 (hold down the button
     // continuously) or > 95 (take samples less frequently than 96 cycle
     // intervals). This is all timed by the 48 MHz ADC clock. This is setup
-    // to grab a sample at 10kHz (48Mhz/10kHz - 1)
-    adc_set_clkdiv(ADCCLK/Fs);
-
-
-    // Populate the sine table and Hann window table
-    int ii;
-    for (ii = 0; ii < NUM_SAMPLES; ii++) {
-        Sinewave[ii] = float2fix15(sin(6.283 * ((float) ii) / (float)NUM_SAMPLES));
-        window[ii] = float2fix15(0.5 * (1.0 - cos(6.283 * ((float) ii) / ((float)NUM_SAMPLES))));
-    }
+    // to grab a sample at 10kHz (48Mhz/10kHz - 1), from each input
+    adc_set_clkdiv(ADCCLK/(Fs*ADC_CHANNELS));
 
     /////////////////////////////////////////////////////////////////////////////////
     // ============================== ADC DMA CONFIGURATION =========================
     /////////////////////////////////////////////////////////////////////////////////
 
+    // Claim the channels (wherever the VGA driver's and others' aren't)
+    sample_chan = hw_claim_dma("fft") ;
+    control_chan = hw_claim_dma("fft") ;
+
     // Channel configurations
     dma_channel_config c2 = dma_channel_get_default_config(sample_chan);
     dma_channel_config c3 = dma_channel_get_default_config(control_chan);
 
 
     // ADC SAMPLE CHANNEL
-    // Reading from constant address, writing to incrementing byte addresses
+    // Reading from constant address, writing to incrementing addresses
+#ifdef ADC_12BIT
+    channel_config_set_transfer_data_size(&c2, DMA_SIZE_16);
+#else
     channel_config_set_transfer_data_size(&c2, DMA_SIZE_8);
+#endif
     channel_config_set_read_increment(&c2, false);
     channel_config_set_write_increment(&c2, true);
     // Pace transfers based on availability of ADC samples
     channel_config_set_dreq(&c2, DREQ_ADC);
+    // At the end of each block, have the control channel point us at the next
+    channel_config_set_chain_to(&c2, control_chan);
     // Configure the channel
     dma_channel_configure(sample_chan,
         &c2,            // channel config
         sample_array,   // dst
         &adc_hw->fifo,  // src
-        NUM_SAMPLES,    // transfer count
+        BLOCK_TRANSFERS,// transfer count
         false            // don't start immediately
     );
 
     // CONTROL CHANNEL
     channel_config_set_transfer_data_size(&c3, DMA_SIZE_32);      // 32-bit txfers
-    channel_config_set_read_increment(&c3, false);                // no read incrementing
+    channel_config_set_read_increment(&c3, true);                 // step through the addresses
+    channel_config_set_ring(&c3, false, RING_BITS);               // and wrap around them
     channel_config_set_write_increment(&c3, false);               // no write incrementing
     channel_config_set_chain_to(&c3, sample_chan);                // chain to sample chan
 
+    // Block 0 is first, then the control channel loads 1, 2, ... 0
+    for (ii = 0; ii < RING_BLOCKS; ii++) {
+        sample_address_pointers[ii] = &sample_array[((ii + 1) % RING_BLOCKS) * BLOCK_TRANSFERS] ;
+    }
+
     dma_channel_configure(
         control_chan,                         // Channel to be configured
         &c3,                                // The configuration we just created
         &dma_hw->ch[sample_chan].write_addr,  // Write address (channel 0 read address)
-        &sample_address_pointer,                   // Read address (POINTER TO AN ADDRESS)
+        sample_address_pointers,            // Read address (POINTERS TO ADDRESSES)
         1,                                  // Number of transfers, in this case each is 4 byte
         false                               // Don't start immediately.
     );
 
+    // Count each finished block in the DMA IRQ
+    dma_channel_set_irq0_enabled(sample_chan, true);
+    irq_add_shared_handler(DMA_IRQ_0, capture_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+
     // Launch core 1
     multicore_launch_core1(core1_entry);
 
     // Add and schedule core 0 threads
+#ifdef PIPELINE_MODE
+    pt_add_thread(protothread_render) ;
+#else
     pt_add_thread(protothread_fft) ;
+#endif
     pt_schedule_start ;
 
 }
@@ -2,21 +2,21 @@
  *  V. Hunter Adams (vha3@cornell.edu)
  
     This is an experiment with the multicore capabilities on the
-    RP2040. The program instantiates a timer interrupt on each core.
-    Each of these timer interrupts writes to a separate channel
-    of the SPI DAC and does DDS of two sine waves of two different
-    frequencies. These sine waves are amplitude-modulated to "beeps."
-
-    No spinlock is required to mediate the SPI writes because of the
-    SPI buffer on the RP2040. Spinlocks are used in the main program
+    RP2040. The program does DDS of two sine waves, one on each
+    channel of the SPI DAC. These sine waves are amplitude-modulated
+    to "beeps."
+
+    The samples are rendered a block at a time on core 1, and DMA
+    streams them to the DAC at 40 kHz (see lib/dds_audio), so there
+    is one interrupt per block instead of one per sample. Spinlocks
+    are used in the main program
     running on each core to lock the other out from an incrementing
     global variable. These are "under the hood" of the PT_SEM_SAFE_x
     macros. Two threads ping-pong using these semaphores.
 
     Note that globals are visible from both cores. Note also that GPIO
     pin mappings performed on core 0 can be utilized from core 1.
-    Creation of an alarm pool is required to force a timer interrupt to
-    take place on core 1 rather than core 0.
+    The block interrupt runs on the core that starts the audio.
 
  */
 
@@ -35,80 +35,58 @@
 // Include hardware libraries
 #include "hardware/pio.h"
 #include "hardware/dma.h"
+#include "hw_claim.h"
 #include "hardware/adc.h"
 #include "hardware/irq.h"
 #include "hardware/sync.h"
 #include "hardware/spi.h"
 // Include protothreads
+// Serial through DMA (see pt_serial_dma_init), so the prompt, the echo
+// and the telemetry printfs don't hold up the threads
+#define PT_SERIAL_DMA 1
 #include "pt_cornell_rp2040_v1.h"
+// Include the fixed-point FFT
+#include "fix_fft.h"
+// Include the block-rendered DAC output and the DDS voice bank
+#include "dds_audio.h"
+#include "dds_voices.h"
 
 // Macros for fixed-point arithmetic (faster than floating point)
-typedef signed int fix15 ;
-#define multfix15(a,b) ((fix15)((((signed long long)(a))*((signed long long)(b)))>>15))
-#define float2fix15(a) ((fix15)((a)*32768.0)) 
-#define fix2float15(a) ((float)(a)/32768.0)
-#define absfix15(a) abs(a) 
-#define int2fix15(a) ((fix15)(a << 15))
-#define fix2int15(a) ((int)(a >> 15))
-#define char2fix15(a) (fix15)(((fix15)(a)) << 15)
-#define divfix(a,b) (fix15)( (((signed long long)(a)) << 15) / (b))
+#include "fixed_point.h"
 
 /*------------------------defines, functions and global allocations for DDS------------------------------------*/
 
 //Direct Digital Synthesis (DDS) parameters
-#define two32 4294967296.0  // 2^32 (a constant)
 #define Fs_DDS 40000            // sample rate
 
-// the DDS units - core 1
-// Phase accumulator and phase increment. Increment sets output frequency.
-volatile unsigned int phase_accum_main_1;                  
-volatile unsigned int phase_incr_main_1 = (2300.0*two32)/Fs_DDS ;
-// the DDS units - core 2
-// Phase accumulator and phase increment. Increment sets output frequency.
-volatile unsigned int phase_accum_main_0;
-volatile unsigned int phase_incr_main_0 = (2300.0*two32)/Fs_DDS ;
-
-// DDS sine table (populated in main())
-#define sine_table_size 256
-fix15 sin_table[sine_table_size] ;
-
-// Values output to DAC
-int DAC_output_0 ;
-int DAC_output_1 ;
+// The two beeps are voices of a DDS voice bank: voice 0 (left) on DAC
+// channel B and voice 1 (right) on channel A, both at 2300 Hz
+#define VOICE_L 0
+#define VOICE_R 1
+dds_voice_bank beeps ;
 
-// Amplitude modulation parameters and variables
+// Amplitude modulation parameters
 fix15 max_amplitude = int2fix15(1) ;    // maximum amplitude
-fix15 attack_inc ;                      // rate at which sound ramps up
-fix15 decay_inc ;                       // rate at which sound ramps down
-fix15 current_amplitude_0 = 0 ;         // current amplitude (modified in ISR)
-fix15 current_amplitude_1 = 0 ;         // current amplitude (modified in ISR)
 fix15 scale_out = float2fix15(0.5) ;    // output scale factor (volume control)
 
-// Timing parameters for beeps (units of interrupts)
+// Timing parameters for beeps (units of samples)
 #define ATTACK_TIME             3000
 #define DECAY_TIME              3000
 #define SUSTAIN_TIME            (10000 - (ATTACK_TIME + DECAY_TIME))
 #define BEEP_DURATION           (ATTACK_TIME + SUSTAIN_TIME + DECAY_TIME)
 #define BEEP_REPEAT_INTERVAL    40000   // numeber of times per second the DACs are updated
 #define CHIRP_CYCLE_TIME        (BEEP_DURATION + BEEP_REPEAT_INTERVAL)
+// The left beep starts this long after the right one (half a second)
+#define BEEP_OFFSET             20000
 
-// State machine variables
-volatile unsigned int STATE_L = 0 ;
-volatile unsigned int count_L = 0 ;
-#define chirp_L !(bool)STATE_L ;
-volatile unsigned int STATE_R = 0 ;
-volatile unsigned int count_R = 0 ;
-#define chirp_r !(bool)STATE_R ;
+// Where each beep is in its cycle (in samples)
+unsigned int beep_count[2] = {CHIRP_CYCLE_TIME - BEEP_OFFSET, 0} ;
 
-// SPI data
-uint16_t DAC_data_L ; // output value
-uint16_t DAC_data_R ; // output value
-
-// DAC parameters (see the DAC datasheet)
-// A-channel, 1x, active
-#define DAC_config_chan_A 0b0011000000000000
-// B-channel, 1x, active
-#define DAC_config_chan_B 0b1011000000000000
+// The beeps' ADSR envelope, which can be changed over serial. There are
+// two: a new one is set up in the one not playing, then swapped in, so
+// the audio interrupt never sees one half-written.
+dds_adsr beep_envelopes[2] ;
+volatile int beep_envelope = 0 ;
 
 // Define the LED pin
 #define LED     25
@@ -129,112 +107,40 @@ volatile int corenum_1 ;
 
 // Global counter for spinlock experimenting
 volatile int global_counter = 0 ;
-// post-fft max frequency (set in protothread_fft, used in protothread_blink)
-volatile float fr_max = 0.0 ;
-// number of ffts per second
-volatile int FFT_count = 0 ;
+// post-fft max frequency and number of ffts since the last ping (set in
+// protothread_fft and read in protothread_core_0, both on core 0)
+float fr_max = 0.0 ;
+int FFT_count = 0 ;
+// each fft's max frequency, handed to core 1 for protothread_core_1
+PT_RING_DEFINE(fft_peaks, int, 32) ;
+// time spent processing ffts (not waiting for samples), for protothread_stats
+volatile uint32_t FFT_busy_us = 0 ;
 
 // Semaphore
 struct pt_sem core_1_go, core_0_go ;
 
-// This timer ISR is called on core 0
-bool repeating_timer_callback_core_0(struct repeating_timer *t) {
-
-    if (STATE_L == 0) {
-        // DDS phase and sine table lookup
-        phase_accum_main_0 += phase_incr_main_0  ;
-        DAC_output_0 = fix2int15(multfix15(multfix15(current_amplitude_0, scale_out),
-            sin_table[phase_accum_main_0>>24])) + 2048 ;
-
-        // Ramp up amplitude
-        if (count_L < ATTACK_TIME) {
-            current_amplitude_0 = (current_amplitude_0 + attack_inc) ;
-        }
-        // Ramp down amplitude
-        else if (count_L > BEEP_DURATION - DECAY_TIME) {
-            current_amplitude_0 = (current_amplitude_0 - decay_inc) ;
-        }
-
-        // Mask with DAC control bits
-        DAC_data_L = (DAC_config_chan_B | (DAC_output_0 & 0xffff))  ;
-
-        // SPI write (no spinlock b/c of SPI buffer)
-        spi_write16_blocking(SPI_PORT, &DAC_data_L, 1) ;
-
-        // Increment the counter
-        count_L += 1 ;
-
-        // State transition?
-        if (count_L == BEEP_DURATION) {
-            STATE_L = 1 ;
-            count_L = 0 ;
-        }
-    }
-
-    // State transition?
-    else {
-        count_L += 1 ;
-        if (count_L == BEEP_REPEAT_INTERVAL) {
-            current_amplitude_0 = 0 ;
-            STATE_L = 0 ;
-            count_L = 0 ;
-        }
-    }
-
-    // retrieve core number of execution
-    corenum_0 = get_core_num() ;
-
-    return true;
-}
-
-// This timer ISR is called on core 1
-bool repeating_timer_callback_core_1(struct repeating_timer *t) {
-
-    if (STATE_R == 0) {
-        // DDS phase and sine table lookup
-        phase_accum_main_1 += phase_incr_main_1  ;
-        DAC_output_1 = fix2int15(multfix15(multfix15(current_amplitude_1, scale_out),
-            sin_table[phase_accum_main_1>>24])) + 2048 ;
-
-        // Ramp up amplitude
-        if (count_R < ATTACK_TIME) {
-            current_amplitude_1 = (current_amplitude_1 + attack_inc) ;
+// Starts and ends each beep at the right block, then renders the block.
+// Called from the DMA interrupt once per block (on core 1, which started
+// the audio).
+void HOT_ISR(render_beeps)(uint16_t * block, int frames) {
+    for (int v=0; v<2; v++) {
+        unsigned int prev = beep_count[v] ;
+        unsigned int now = prev + frames ;
+        // Start the attack at the start of the cycle, and the release so
+        // that it's done at the end of the beep
+        unsigned int off = BEEP_DURATION - beeps.envelope[v]->release ;
+        if (prev == 0) {
+            dds_voice_note_on(&beeps, v, max_amplitude) ;
         }
-        // Ramp down amplitude
-        else if (count_R > BEEP_DURATION - DECAY_TIME) {
-            current_amplitude_1 = (current_amplitude_1 - decay_inc) ;
-        }
-
-        // Mask with DAC control bits
-        DAC_data_R = (DAC_config_chan_A | (DAC_output_1 & 0xffff))  ;
-
-        // SPI write (no spinlock b/c of SPI buffer)
-        spi_write16_blocking(SPI_PORT, &DAC_data_R, 1) ;
-
-        // Increment the counter
-        count_R += 1 ;
-
-        // State transition?
-        if (count_R == BEEP_DURATION) {
-            STATE_R = 1 ;
-            count_R = 0 ;
-        }
-    }
-
-    // State transition?
-    else {
-        count_R += 1 ;
-        if (count_R == BEEP_REPEAT_INTERVAL) {
-            current_amplitude_1 = 0 ;
-            STATE_R = 0 ;
-            count_R = 0 ;
+        if ((prev < off) && (now >= off)) {
+            dds_voice_note_off(&beeps, v) ;
         }
+        beep_count[v] = (now >= CHIRP_CYCLE_TIME) ? 0 : now ;
     }
+    dds_voices_render(&beeps, block, frames, 2) ;
 
     // retrieve core number of execution
-    corenum_1 = get_core_num() ;
-
-    return true;
+    corenum_0 = corenum_1 = get_core_num() ;
 }
 
 // This thread can run on either core
@@ -268,8 +174,12 @@ static PT_THREAD (protothread_core_1(struct pt *pt))
         //}
         //printf("\n\n") ;
         global_counter++ ;
-        printf("Pong: Core 1: %d, ISR core: %d, Max F: % 5d, FFT count: %3d\n", global_counter, corenum_1, (int)fr_max, FFT_count) ;
-        FFT_count = 0;
+        // take the peaks found since the last pong (the ring holds 32,
+        // so the count tops out there) and show the newest
+        static int peak, peaks ;
+        peaks = 0 ;
+        while (pt_ring_get(&fft_peaks, &peak)) peaks++ ;
+        printf("Pong: Core 1: %d, ISR core: %d, Max F: % 5d, FFT count: %3d\n", global_counter, corenum_1, peak, peaks) ;
         PT_YIELD_usec(1000000) ;
         // signal other core
         PT_SEM_SAFE_SIGNAL(pt, &core_0_go) ;
@@ -306,23 +216,77 @@ static PT_THREAD (protothread_core_0(struct pt *pt))
     PT_END(pt) ;
 }
 
-// This is the core 1 entry point. Essentially main() for core 1
-void core1_entry_DDS() {
+// Prints how long the audio renders take against their deadline, and how
+// busy each core is, every two seconds (idle is time asleep in the
+// tickless scheduler):
+//   audio core 1: 9120/9340/11876 cyc of 400000 (2%), 0 late | core 0 fft 35% | idle 52% 96%
+static PT_THREAD (protothread_stats(struct pt *pt))
+{
+    PT_BEGIN(pt) ;
+    static dds_audio_stats stats ;
+    static uint32_t last_us, last_fft_us, last_idle[2] ;
+    dds_audio_get_stats(&stats, 1) ;
+    last_us = time_us_32() ;
+    while(1) {
+        PT_YIELD_usec(2000000) ;
+        dds_audio_get_stats(&stats, 1) ;
+        uint32_t now = time_us_32() ;
+        uint32_t elapsed = now - last_us ;
+        uint32_t fft_us = FFT_busy_us ;
+        uint32_t idle[2] = {pt_idle_us[0], pt_idle_us[1]} ;
+        unsigned int mean = stats.blocks ? (unsigned int)(stats.total_cycles / stats.blocks) : 0 ;
+        printf("audio core %d: %u/%u/%u cyc of %u (%u%%), %u late | core 0 fft %u%% | idle %u%% %u%%\n",
+               stats.core, (unsigned int)stats.min_cycles, mean, (unsigned int)stats.max_cycles,
+               (unsigned int)stats.budget_cycles,
+               stats.budget_cycles ? (unsigned int)(100 * (uint64_t)mean / stats.budget_cycles) : 0,
+               stats.missed,
+               (unsigned int)(100 * (uint64_t)(fft_us - last_fft_us) / elapsed),
+               (unsigned int)(100 * (uint64_t)(idle[0] - last_idle[0]) / elapsed),
+               (unsigned int)(100 * (uint64_t)(idle[1] - last_idle[1]) / elapsed)) ;
+        last_us = now ;
+        last_fft_us = fft_us ;
+        last_idle[0] = idle[0] ;
+        last_idle[1] = idle[1] ;
+    }
+    PT_END(pt) ;
+}
 
-    // create an alarm pool on core 1
-    alarm_pool_t *core1pool ;
-    core1pool = alarm_pool_create(2, 16) ;
+// User input thread: sets the beep envelope
+static PT_THREAD (protothread_serial(struct pt *pt))
+{
+    PT_BEGIN(pt) ;
+    static float attack, decay, sustain, release ;
+    static float max_ms = BEEP_DURATION * 1000.0 / Fs_DDS ;
+    while(1) {
+        sprintf(pt_serial_out_buffer, "attack decay sustain release (ms ms 0-1 ms): ") ;
+        serial_write ;
+        // spawn a thread to do the non-blocking serial read
+        serial_read ;
+        if (sscanf(pt_serial_in_buffer, "%f %f %f %f", &attack, &decay, &sustain, &release) != 4) continue ;
+        if ((attack < 0) || (decay < 0) || (release < 0)) continue ;
+        // All but the sustain has to fit in a beep
+        if (attack + decay + release > max_ms) continue ;
+        int next = !beep_envelope ;
+        dds_adsr_set(&beep_envelopes[next], Fs_DDS, attack, decay, sustain, release) ;
+        dds_voice_set_envelope(&beeps, VOICE_L, &beep_envelopes[next]) ;
+        dds_voice_set_envelope(&beeps, VOICE_R, &beep_envelopes[next]) ;
+        beep_envelope = next ;
+    }
+    PT_END(pt) ;
+}
 
-    // Create a repeating timer that calls repeating_timer_callback.
-    struct repeating_timer timer_core_1;
+// This is the core 1 entry point. Essentially main() for core 1
+void core1_entry_DDS() {
 
-    // Negative delay so means we will call repeating_timer_callback, and call it
-    // again 25us (40kHz) later regardless of how long the callback took to execute
-    alarm_pool_add_repeating_timer_us(core1pool, -25, 
-        repeating_timer_callback_core_1, NULL, &timer_core_1);
+    // Start the audio. Blocks of samples are rendered from an interrupt
+    // on this core, two DAC words (A and B) per 25us (40kHz) sample.
+    dds_audio_init(SPI_PORT, Fs_DDS, 2, render_beeps) ;
+    // LDAC is pulsed after each A/B pair, so both channels change together
+    dds_audio_ldac(PIN_CS, LDAC) ;
+    dds_audio_start() ;
 
     // Add thread to core 1
-    pt_add_thread(protothread_core_1) ;
+    pt_add_thread_rate(protothread_core_1, PT_PRIORITY_NORMAL, 0) ;
     pt_add_thread(protothread_blink) ;
 
     // Start scheduler on core 1
@@ -335,22 +299,18 @@ void core1_entry_DDS() {
 // ADC Channel and pin
 #define ADC_CHAN 0
 #define ADC_PIN 26
-// Number of samples per FFT
-#define NUM_SAMPLES 1024
-// Number of samples per FFT, minus 1
-#define NUM_SAMPLES_M_1 1023
-// Length of short (16 bits) minus log2 number of samples (10)
-#define SHIFT_AMOUNT 6
+// Number of samples per FFT (1024 unless FFT_LOG2_N is set)
+#define NUM_SAMPLES FFT_N
 // Log2 number of samples
-#define LOG2_NUM_SAMPLES 10
+#define LOG2_NUM_SAMPLES FFT_LOG2_N
 // Sample rate (Hz)
 #define Fs_FFT 10000.0
 // ADC clock rate (unmutable!)
 #define ADCCLK 48000000.0
 
-// DMA channels for sampling ADC (VGA driver uses 0 and 1)
-int sample_chan = 2 ;
-int control_chan = 3 ;
+// DMA channels for sampling ADC (claimed from lib/hw_claim in main)
+int sample_chan ;
+int control_chan ;
 
 // Max and min macros
 #define max(a,b) ((a>b)?a:b)
@@ -362,104 +322,12 @@ fix15 zero_point_4 = float2fix15(0.4) ;
 // Here's where we'll have the DMA channel put ADC samples
 uint8_t sample_array[NUM_SAMPLES] ;
 // And here's where we'll copy those samples for FFT calculation
+// (fft_real() needs no imaginary array)
 fix15 fr[NUM_SAMPLES] ;
-fix15 fi[NUM_SAMPLES] ;
-
-// Sine table for the FFT calculation
-fix15 Sinewave[NUM_SAMPLES]; 
-// Hann window table for FFT calculation
-fix15 window[NUM_SAMPLES]; 
 
 // Pointer to address of start of sample buffer
 uint8_t * sample_address_pointer = &sample_array[0] ;
 
-// Peforms an in-place FFT. For more information about how this
-// algorithm works, please see https://vanhunteradams.com/FFT/FFT.html
-void FFTfix(fix15 fr[], fix15 fi[]) {
-    
-    unsigned short m;   // one of the indices being swapped
-    unsigned short mr ; // the other index being swapped (r for reversed)
-    fix15 tr, ti ; // for temporary storage while swapping, and during iteration
-    
-    int i, j ; // indices being combined in Danielson-Lanczos part of the algorithm
-    int L ;    // length of the FFT's being combined
-    int k ;    // used for looking up trig values from sine table
-    
-    int istep ; // length of the FFT which results from combining two FFT's
-    
-    fix15 wr, wi ; // trigonometric values from lookup table
-    fix15 qr, qi ; // temporary variables used during DL part of the algorithm
-    
-    //////////////////////////////////////////////////////////////////////////
-    ////////////////////////// BIT REVERSAL //////////////////////////////////
-    //////////////////////////////////////////////////////////////////////////
-    // Bit reversal code below based on that found here: 
-    // https://graphics.stanford.edu/~seander/bithacks.html#BitReverseObvious
-    for (m=1; m<NUM_SAMPLES_M_1; m++) {
-        // swap odd and even bits
-        mr = ((m >> 1) & 0x5555) | ((m & 0x5555) << 1);
-        // swap consecutive pairs
-        mr = ((mr >> 2) & 0x3333) | ((mr & 0x3333) << 2);
-        // swap nibbles ... 
-        mr = ((mr >> 4) & 0x0F0F) | ((mr & 0x0F0F) << 4);
-        // swap bytes
-        mr = ((mr >> 8) & 0x00FF) | ((mr & 0x00FF) << 8);
-        // shift down mr
-        mr >>= SHIFT_AMOUNT ;
-        // don't swap that which has already been swapped
-        if (mr<=m) continue ;
-        // swap the bit-reveresed indices
-        tr = fr[m] ;
-        fr[m] = fr[mr] ;
-        fr[mr] = tr ;
-        ti = fi[m] ;
-        fi[m] = fi[mr] ;
-        fi[mr] = ti ;
-    }
-    //////////////////////////////////////////////////////////////////////////
-    ////////////////////////// Danielson-Lanczos //////////////////////////////
-    //////////////////////////////////////////////////////////////////////////
-    // Adapted from code by:
-    // Tom Roberts 11/8/89 and Malcolm Slaney 12/15/94 malcolm@interval.com
-    // Length of the FFT's being combined (starts at 1)
-    L = 1 ;
-    // Log2 of number of samples, minus 1
-    k = LOG2_NUM_SAMPLES - 1 ;
-    // While the length of the FFT's being combined is less than the number 
-    // of gathered samples . . .
-    while (L < NUM_SAMPLES) {
-        // Determine the length of the FFT which will result from combining two FFT's
-        istep = L<<1 ;
-        // For each element in the FFT's that are being combined . . .
-        for (m=0; m<L; ++m) { 
-            // Lookup the trig values for that element
-            j = m << k ;                         // index of the sine table
-            wr =  Sinewave[j + NUM_SAMPLES/4] ; // cos(2pi m/N)
-            wi = -Sinewave[j] ;                 // sin(2pi m/N)
-            wr >>= 1 ;                          // divide by two
-            wi >>= 1 ;                          // divide by two
-            // i gets the index of one of the FFT elements being combined
-            for (i=m; i<NUM_SAMPLES; i+=istep) {
-                // j gets the index of the FFT element being combined with i
-                j = i + L ;
-                // compute the trig terms (bottom half of the above matrix)
-                tr = multfix15(wr, fr[j]) - multfix15(wi, fi[j]) ;
-                ti = multfix15(wr, fi[j]) + multfix15(wi, fr[j]) ;
-                // divide ith index elements by two (top half of above matrix)
-                qr = fr[i]>>1 ;
-                qi = fi[i]>>1 ;
-                // compute the new values at each index
-                fr[j] = qr - tr ;
-                fi[j] = qi - ti ;
-                fr[i] = qr + tr ;
-                fi[i] = qi + ti ;
-            }    
-        }
-        --k ;
-        L = istep ;
-    }
-}
-
 // Runs on core 0
 static PT_THREAD (protothread_fft(struct pt *pt))
 {
@@ -501,11 +369,12 @@ static PT_THREAD (protothread_fft(struct pt *pt))
         // Wait for NUM_SAMPLES samples to be gathered
         // Measure wait time with timer. THIS IS BLOCKING
         dma_channel_wait_for_finish_blocking(sample_chan);
+        static uint32_t fft_start ;
+        fft_start = time_us_32() ;
 
         // Copy/window elements into a fixed-point array
         for (i=0; i<NUM_SAMPLES; i++) {
-            fr[i] = multfix15(int2fix15((int)sample_array[i]), window[i]) ;
-            fi[i] = (fix15) 0 ;
+            fr[i] = multfix15(int2fix15((int)sample_array[i]), fft_hann[i]) ;
         }
 
         // Zero max frequency and max frequency index
@@ -515,18 +384,18 @@ static PT_THREAD (protothread_fft(struct pt *pt))
         // Restart the sample channel, now that we have our copy of the samples
         dma_channel_start(control_chan) ;
 
-        // Compute the FFT
-        FFTfix(fr, fi) ;
+        // Compute the FFT (of real samples)
+        fft_real(fr) ;
         FFT_count++ ;
 
         // Find the magnitudes (alpha max plus beta min)
         for (int i = 0; i < (NUM_SAMPLES>>1); i++) {  
-            // get the approx magnitude
-            fr[i] = abs(fr[i]); 
-            fi[i] = abs(fi[i]);
-            // reuse fr to hold magnitude
-            fr[i] = max(fr[i], fi[i]) + 
-                    multfix15(min(fr[i], fi[i]), zero_point_4); 
+            // get the approx magnitude (bin i is fr[2i] + j fr[2i+1])
+            fix15 re = abs(fr[2*i]) ;
+            fix15 im = abs(fr[2*i+1]) ;
+            // reuse fr to hold magnitude (bins below i were already read)
+            fr[i] = max(re, im) + 
+                    multfix15(min(re, im), zero_point_4); 
 
             // Keep track of maximum
             if (fr[i] > max_fr && i>4) {
@@ -537,6 +406,9 @@ static PT_THREAD (protothread_fft(struct pt *pt))
         // Compute max frequency in Hz
         max_frequency = max_fr_dex * (Fs_FFT / NUM_SAMPLES) ;
         fr_max = max_frequency;
+        // pass it on to core 1, unless it's behind
+        int peak = (int)max_frequency ;
+        pt_ring_put(&fft_peaks, &peak) ;
 
         // Display on VGA
         fillRect(250, 20, 176, 30, BLACK); // red box
@@ -551,6 +423,7 @@ static PT_THREAD (protothread_fft(struct pt *pt))
             height = fix2int15(multfix15(fr[i], int2fix15(36))) ;
             drawVLine(59 + i, 479 - height, height, WHITE);
         }
+        FFT_busy_us += time_us_32() - fft_start ;
         PT_YIELD_usec(10);
     }
     PT_END(pt) ;
@@ -562,6 +435,7 @@ static PT_THREAD (protothread_fft(struct pt *pt))
 int main() {
     // Initialize stdio/uart (printf won't work unless you do this!)
     stdio_init_all();
+    pt_serial_dma_init() ;
     printf("Hello, Combo!\n");
 
 /*------------------------set-up for DDS------------------------------------*/
@@ -577,21 +451,16 @@ int main() {
     gpio_set_function(PIN_MOSI, GPIO_FUNC_SPI);
     gpio_set_function(PIN_CS, GPIO_FUNC_SPI) ;
 
-    // Map LDAC pin to GPIO port, hold it low (could alternatively tie to GND)
-    gpio_init(LDAC) ;
-    gpio_set_dir(LDAC, GPIO_OUT) ;
-    gpio_put(LDAC, 0) ;
-
-    // set up increments for calculating bow envelope
-    attack_inc = divfix(max_amplitude, int2fix15(ATTACK_TIME)) ;
-    decay_inc =  divfix(max_amplitude, int2fix15(DECAY_TIME)) ;
-
-    // Build the sine lookup table
-    // scaled to produce values between 0 and 4096 (for 12-bit DAC)
-    int ii;
-    for (ii = 0; ii < sine_table_size; ii++){
-         sin_table[ii] = float2fix15(2047*sin((float)ii*6.283/(float)sine_table_size));
-    }
+    // Set up the beep voices
+    dds_voices_init(&beeps, Fs_DDS) ;
+    beeps.gain = scale_out ;
+    dds_adsr_set(&beep_envelopes[0], Fs_DDS, ATTACK_TIME * 1000.0 / Fs_DDS, 0.0, 1.0, DECAY_TIME * 1000.0 / Fs_DDS) ;
+    dds_voice_set_envelope(&beeps, VOICE_L, &beep_envelopes[0]) ;
+    dds_voice_set_envelope(&beeps, VOICE_R, &beep_envelopes[0]) ;
+    dds_voice_set_freq(&beeps, VOICE_L, 2300.0) ;
+    dds_voice_set_channel(&beeps, VOICE_L, 1) ;
+    dds_voice_set_freq(&beeps, VOICE_R, 2300.0) ;
+    dds_voice_set_channel(&beeps, VOICE_R, 0) ;
 
     // Initialize the intercore semaphores
     PT_SEM_SAFE_INIT(&core_0_go, 1) ;
@@ -615,8 +484,9 @@ int main() {
  *  - GPIO 26 ---> Audio input [0-3.3V]
  *
  * RESOURCES USED
- *  - PIO state machines 0, 1, and 2 on PIO instance 0
- *  - DMA channels 0, 1, 2, and 3
+ *  - 3 PIO state machines and 2 DMA channels for VGA, 2 DMA channels
+ *    for the FFT, and for the audio 2 more, a DMA timer and DMA_IRQ_0,
+ *    all claimed from lib/hw_claim
  *  - ADC channel 0
  *  - 153.6 kBytes of RAM (for pixel color data)
  *
@@ -661,18 +531,14 @@ int main() {
     // to grab a sample at 10kHz (48Mhz/10kHz - 1)
     adc_set_clkdiv(ADCCLK/Fs_FFT);
 
-
-    // Populate the sine table and Hann window table
-    //int ii;
-    for (ii = 0; ii < NUM_SAMPLES; ii++) {
-        Sinewave[ii] = float2fix15(sin(6.283 * ((float) ii) / (float)NUM_SAMPLES));
-        window[ii] = float2fix15(0.5 * (1.0 - cos(6.283 * ((float) ii) / ((float)NUM_SAMPLES))));
-    }
-
     /////////////////////////////////////////////////////////////////////////////////
     // ============================== ADC DMA CONFIGURATION =========================
     /////////////////////////////////////////////////////////////////////////////////
 
+    // Claim the channels (wherever the VGA driver's and others' aren't)
+    sample_chan = hw_claim_dma("fft") ;
+    control_chan = hw_claim_dma("fft") ;
+
     // Channel configurations
     dma_channel_config c2 = dma_channel_get_default_config(sample_chan);
     dma_channel_config c3 = dma_channel_get_default_config(control_chan);
@@ -711,25 +577,22 @@ int main() {
 
 /*------------------------ Launch for combined processes ------------------------------------*/
 
-    // Launch core 1
-    multicore_launch_core1(core1_entry_DDS);
-
-    // Desynchronize the beeps
-    sleep_ms(500) ;
+    // Both cores schedule by priority, so the FFT runs whenever it's due
+    // and the serial and stats threads only when nothing else is. The
+    // ping-pong threads are parked on their semaphores until the other
+    // core signals, and a core with nothing due sleeps.
+    pt_sched_method = SCHED_RATE ;
+    pt_sched_tickless = 1 ;
 
-    // Create a repeating timer that calls 
-    // repeating_timer_callback (defaults core 0)
-    struct repeating_timer timer_core_0;
-
-    // Negative delay so means we will call repeating_timer_callback, and call it
-    // again 25us (40kHz) later regardless of how long the callback took to execute
-    add_repeating_timer_us(-25, 
-        repeating_timer_callback_core_0, NULL, &timer_core_0);
+    // Launch core 1 (which starts the audio)
+    multicore_launch_core1(core1_entry_DDS);
 
     // Add core 0 threads
-    pt_add_thread(protothread_core_0) ;
+    pt_add_thread_rate(protothread_core_0, PT_PRIORITY_NORMAL, 0) ;
     //pt_add_thread(protothread_blink) ;
-    pt_add_thread(protothread_fft) ;
+    pt_add_thread_rate(protothread_fft, PT_PRIORITY_HIGH, 0) ;
+    pt_add_thread_rate(protothread_serial, PT_PRIORITY_LOW, 0) ;
+    pt_add_thread_rate(protothread_stats, PT_PRIORITY_LOW, 0) ;
 
     // Start scheduling core 0 threads
     pt_schedule_start ;
@@ -18,6 +18,7 @@
 #include <math.h>
 #include "pico/stdlib.h"
 #include "hardware/spi.h"
+#include "hotpath.h"
 
 //DDS parameters
 #define two32 4294967296.0 // 2^32 
@@ -46,13 +47,15 @@ uint16_t DAC_data ; // output value
 #define sine_table_size 256
 volatile int sin_table[sine_table_size] ;
 
-// Timer ISR
-bool repeating_timer_callback(struct repeating_timer *t) {
+// Timer ISR. It runs from RAM, and writes the SPI data register itself
+// (the FIFO is empty again long before the next sample) rather than
+// calling spi_write16_blocking(), which is in flash.
+bool HOT_ISR(repeating_timer_callback)(struct repeating_timer *t) {
 	// DDS phase and sine table lookup
 	phase_accum_main += phase_incr_main  ;
     DAC_data = (DAC_config_chan_A | ((sin_table[phase_accum_main>>24] + 2048) & 0xffff))  ;
 
-    spi_write16_blocking(SPI_PORT, &DAC_data, 1) ;
+    spi_get_hw(SPI_PORT)->dr = DAC_data ;
 
     return true;
 }
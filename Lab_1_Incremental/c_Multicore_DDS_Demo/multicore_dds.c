@@ -2,13 +2,14 @@
  * V. Hunter Adams (vha3@cornell.edu)
 
     This is an experiment with the multicore capabilities on the
-    RP2040. The program instantiates a timer interrupt on each core.
-    Each of these timer interrupts writes to a separate channel
-    of the SPI DAC and does DDS of two sine waves of two different
-    frequencies. These sine waves are amplitude-modulated to "beeps."
-
-    No spinlock is required to mediate the SPI writes because of the
-    SPI buffer on the RP2040. Spinlocks are used in the main program
+    RP2040. The program does DDS of two sine waves of two different
+    frequencies, one on each channel of the SPI DAC. These sine waves
+    are amplitude-modulated to "beeps."
+
+    The samples are rendered a block at a time on core 1, and DMA
+    streams them to the DAC at 40 kHz (see lib/dds_audio), so there
+    is one interrupt per block instead of one per sample. Spinlocks
+    are used in the main program
     running on each core to lock the other out from an incrementing
     global variable. Experimentation shows that a short delay is
     required between unlocking and locking the spinlock for the second
@@ -16,8 +17,7 @@
 
     Note that globals are visible from both cores. Note also that GPIO
     pin mappings performed on core 0 can be utilized from core 1.
-    Creation of an alarm pool is required to force a timer interrupt to
-    take place on core 1 rather than core 0.
+    The block interrupt runs on the core that starts the audio.
 
  */
 
@@ -27,17 +27,10 @@
 #include "pico/multicore.h"
 #include "hardware/sync.h"
 #include "hardware/spi.h"
+#include "dds_audio.h"
 
 // === the fixed point macros ========================================
-typedef signed int fix15 ;
-#define multfix15(a,b) ((fix15)((((signed long long)(a))*((signed long long)(b)))>>15))
-#define float2fix15(a) ((fix15)((a)*32768.0)) 
-#define fix2float15(a) ((float)(a)/32768.0)
-#define absfix15(a) abs(a) 
-#define int2fix15(a) ((fix15)(a << 15))
-#define fix2int15(a) ((int)(a >> 15))
-#define char2fix15(a) (fix15)(((fix15)(a)) << 15)
-#define divfix(a,b) (fix15)( (((signed long long)(a)) << 15) / (b))
+#include "fixed_point.h"
 
 //DDS parameters
 #define two32 4294967296.0 // 2^32 
@@ -68,10 +61,8 @@ fix15 current_amplitude_1 = 0 ;
 #define SUSTAIN_TIME            10000
 #define BEEP_DURATION           (ATTACK_TIME + SUSTAIN_TIME + DECAY_TIME)
 #define BEEP_REPEAT_INTERVAL    40000
-
-//SPI data
-uint16_t DAC_data_1 ; // output value
-uint16_t DAC_data_0 ; // output value
+// The core 0 beep starts this long after the core 1 one (half a second)
+#define BEEP_OFFSET             20000
 
 //DAC parameters
 // A-channel, 1x, active
@@ -79,6 +70,10 @@ uint16_t DAC_data_0 ; // output value
 // B-channel, 1x, active
 #define DAC_config_chan_B 0b1011000000000000
 
+//SPI data (sent every sample, so start at mid-scale)
+uint16_t DAC_data_1 = DAC_config_chan_A | 2048 ; // output value
+uint16_t DAC_data_0 = DAC_config_chan_B | 2048 ; // output value
+
 //SPI configurations
 #define PIN_MISO 4
 #define PIN_CS   5
@@ -99,13 +94,13 @@ int spinlock_num_count ;
 spin_lock_t *spinlock_count ;
 
 // State machine variables
-volatile unsigned int STATE_0 = 0 ;
-volatile unsigned int count_0 = 0 ;
+volatile unsigned int STATE_0 = 1 ;
+volatile unsigned int count_0 = BEEP_REPEAT_INTERVAL - BEEP_OFFSET ;
 volatile unsigned int STATE_1 = 0 ;
 volatile unsigned int count_1 = 0 ;
 
-// This one is called on core 1
-bool repeating_timer_callback_core_1(struct repeating_timer *t) {
+// Next sample of the channel A beep, as a DAC word
+static inline uint16_t beep_sample_1() {
 
     if (STATE_1 == 0) {
         // DDS phase and sine table lookup
@@ -125,9 +120,6 @@ bool repeating_timer_callback_core_1(struct repeating_timer *t) {
         // Mask with DAC control bits
         DAC_data_1 = (DAC_config_chan_A | (DAC_output_1 & 0xffff))  ;
 
-        // SPI write (no spinlock b/c of SPI buffer)
-        spi_write16_blocking(SPI_PORT, &DAC_data_1, 1) ;
-
         // Increment the counter
         count_1 += 1 ;
 
@@ -148,14 +140,12 @@ bool repeating_timer_callback_core_1(struct repeating_timer *t) {
         }
     }
 
-    // retrieve core number of execution
-    corenum_1 = get_core_num() ;
-
-    return true;
+    // (Between beeps the DAC keeps getting the last value)
+    return DAC_data_1 ;
 }
 
-// This one is called on core 0
-bool repeating_timer_callback_core_0(struct repeating_timer *t) {
+// Next sample of the channel B beep, as a DAC word
+static inline uint16_t beep_sample_0() {
 
     if (STATE_0 == 0) {
         // DDS phase and sine table lookup
@@ -174,9 +164,6 @@ bool repeating_timer_callback_core_0(struct repeating_timer *t) {
 
         DAC_data_0 = (DAC_config_chan_B | (DAC_output_0 & 0xffff))  ;
 
-        // SPI write (no spinlock b/c of SPI buffer)
-        spi_write16_blocking(SPI_PORT, &DAC_data_0, 1) ;
-
         // Increment the counter
         count_0 += 1 ;
 
@@ -197,25 +184,29 @@ bool repeating_timer_callback_core_0(struct repeating_timer *t) {
         }
     }
 
-    // retrieve core number of execution
-    corenum_0 = get_core_num() ;
-
-    return true;
+    return DAC_data_0 ;
 }
 
-void core1_entry() {
+// Renders a block of both beeps, A then B in each frame. Called from
+// the DMA interrupt once per block (on core 1, which started the audio).
+void HOT_ISR(render_beeps)(uint16_t * block, int frames) {
+    for (int i=0; i<frames; i++) {
+        block[2*i]     = beep_sample_1() ;
+        block[2*i + 1] = beep_sample_0() ;
+    }
 
-    // create an alarm pool on core 1
-    alarm_pool_t *core1pool ;
-    core1pool = alarm_pool_create(2, 16) ;
+    // retrieve core number of execution
+    corenum_0 = corenum_1 = get_core_num() ;
+}
 
-    // Create a repeating timer that calls repeating_timer_callback.
-    struct repeating_timer timer_core_1;
+void core1_entry() {
 
-    // Negative delay so means we will call repeating_timer_callback, and call it
-    // again 25us (40kHz) later regardless of how long the callback took to execute
-    alarm_pool_add_repeating_timer_us(core1pool, -25, 
-        repeating_timer_callback_core_1, NULL, &timer_core_1);
+    // Start the audio. Blocks of samples are rendered from an interrupt
+    // on this core, two DAC words (A and B) per 25us (40kHz) sample.
+    dds_audio_init(SPI_PORT, Fs, 2, render_beeps) ;
+    // LDAC is pulsed after each A/B pair, so both channels change together
+    dds_audio_ldac(PIN_CS, LDAC) ;
+    dds_audio_start() ;
 
     while (1) {
 
@@ -254,11 +245,6 @@ int main() {
     gpio_set_function(PIN_MOSI, GPIO_FUNC_SPI);
     gpio_set_function(PIN_CS, GPIO_FUNC_SPI) ;
 
-    // Map LDAC pin to GPIO port, hold it low
-    gpio_init(LDAC) ;
-    gpio_set_dir(LDAC, GPIO_OUT) ;
-    gpio_put(LDAC, 0) ;
-
     // set up increments for calculating bow envelope
     attack_inc = divfix(max_amplitude, int2fix15(ATTACK_TIME)) ;//max_amplitude/(float)ATTACK_TIME ;
     decay_inc =  divfix(max_amplitude, int2fix15(DECAY_TIME)) ;//max_amplitude/(float)DECAY_TIME ;
@@ -274,22 +260,9 @@ int main() {
     spinlock_num_count = spin_lock_claim_unused(true) ;
     spinlock_count = spin_lock_init(spinlock_num_count) ;
 
-    // Launch core 1
+    // Launch core 1 (which starts the audio)
     multicore_launch_core1(core1_entry);
 
-    // Desyncrhonize the beeps
-    sleep_ms(500) ;
-
-    // Create a repeating timer that calls 
-    // repeating_timer_callback (defaults core 0)
-    struct repeating_timer timer_core_0;
-
-    // Negative delay so means we will call repeating_timer_callback, and call it
-    // again 25us (40kHz) later regardless of how long the callback took to execute
-    add_repeating_timer_us(-25, 
-        repeating_timer_callback_core_0, NULL, &timer_core_0);
-
-
     while(1) {
 
         // Lock spinlock (without disabling interrupts)
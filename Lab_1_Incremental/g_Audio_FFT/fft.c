@@ -16,8 +16,8 @@
  *  - GPIO 26 ---> Audio input [0-3.3V]
  *
  * RESOURCES USED
- *  - PIO state machines 0, 1, and 2 on PIO instance 0
- *  - DMA channels 0, 1, 2, and 3
+ *  - 3 PIO state machines and 2 DMA channels for VGA, and 2 DMA
+ *    channels for the FFT, claimed from lib/hw_claim
  *  - ADC channel 0
  *  - 153.6 kBytes of RAM (for pixel color data)
  *
@@ -36,23 +36,19 @@
 // Include hardware libraries
 #include "hardware/pio.h"
 #include "hardware/dma.h"
+#include "hw_claim.h"
 #include "hardware/adc.h"
 #include "hardware/irq.h"
 // Include protothreads
 #include "pt_cornell_rp2040_v1.h"
+// RAM placement for the FFT
+#include "hotpath.h"
 
 // Define the LED pin
 #define LED     25
 
 // === the fixed point macros (16.15) ========================================
-typedef signed int fix15 ;
-#define multfix15(a,b) ((fix15)((((signed long long)(a))*((signed long long)(b)))>>15))
-#define float2fix15(a) ((fix15)((a)*32768.0)) // 2^15
-#define fix2float15(a) ((float)(a)/32768.0)
-#define absfix15(a) abs(a) 
-#define int2fix15(a) ((fix15)(a << 15))
-#define fix2int15(a) ((int)(a >> 15))
-#define char2fix15(a) (fix15)(((fix15)(a)) << 15)
+#include "fixed_point.h"
 
 /////////////////////////// ADC configuration ////////////////////////////////
 // ADC Channel and pin
@@ -71,9 +67,9 @@ typedef signed int fix15 ;
 // ADC clock rate (unmutable!)
 #define ADCCLK 48000000.0
 
-// DMA channels for sampling ADC (VGA driver uses 0 and 1)
-int sample_chan = 2 ;
-int control_chan = 3 ;
+// DMA channels for sampling ADC (claimed from lib/hw_claim in main)
+int sample_chan ;
+int control_chan ;
 
 // Max and min macros
 #define max(a,b) ((a>b)?a:b)
@@ -98,7 +94,8 @@ uint8_t * sample_address_pointer = &sample_array[0] ;
 
 // Peforms an in-place FFT. For more information about how this
 // algorithm works, please see https://vanhunteradams.com/FFT/FFT.html
-void FFTfix(fix15 fr[], fix15 fi[]) {
+// It runs from RAM, so VGA DMA doesn't slow it with XIP cache misses.
+void HOT_KERNEL(FFTfix)(fix15 fr[], fix15 fi[]) {
     
     unsigned short m;   // one of the indices being swapped
     unsigned short mr ; // the other index being swapped (r for reversed)
@@ -353,6 +350,10 @@ int main() {
     // ============================== ADC DMA CONFIGURATION =========================
     /////////////////////////////////////////////////////////////////////////////////
 
+    // Claim the channels (wherever the VGA driver's and others' aren't)
+    sample_chan = hw_claim_dma("fft") ;
+    control_chan = hw_claim_dma("fft") ;
+
     // Channel configurations
     dma_channel_config c2 = dma_channel_get_default_config(sample_chan);
     dma_channel_config c3 = dma_channel_get_default_config(control_chan);
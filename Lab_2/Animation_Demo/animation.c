@@ -2,8 +2,11 @@
 /**
  * Hunter Adams (vha3@cornell.edu)
  * 
- * This demonstration animates two balls bouncing about the screen.
- * Through a serial interface, the user can change the ball color.
+ * This demonstration animates a flock of boids (300 to start with, up to
+ * BOID_MAX) flying about the screen, steered on both cores (boids.c).
+ * Through a serial interface, the user can change the boid color, or the
+ * number of boids. How many boids still make 30 fps is printed every 30
+ * frames (as the worst frame time and the frames that overran).
  *
  * HARDWARE CONNECTIONS
  *  - GPIO 16 ---> VGA Hsync
@@ -14,8 +17,8 @@
  *  - RP2040 GND ---> VGA GND
  *
  * RESOURCES USED
- *  - PIO state machines 0, 1, and 2 on PIO instance 0
- *  - DMA channels 0, 1
+ *  - 3 PIO state machines on PIO instance 0, and 2 DMA channels, for
+ *    VGA (claimed from lib/hw_claim)
  *  - 153.6 kBytes of RAM (for pixel color data)
  *
  */
@@ -36,56 +39,37 @@
 #include "hardware/dma.h"
 #include "hardware/clocks.h"
 #include "hardware/pll.h"
-// Include protothreads
+// Include protothreads (PT_PROFILE 1 prints how long each thread takes
+// every two seconds, to see which one is blowing the frame time)
+#define PT_PROFILE 0
 #include "pt_cornell_rp2040_v1.h"
 
-// === the fixed point macros ========================================
-typedef signed int fix15 ;
-#define multfix15(a,b) ((fix15)((((signed long long)(a))*((signed long long)(b)))>>15))
-#define float2fix15(a) ((fix15)((a)*32768.0)) // 2^15
-#define fix2float15(a) ((float)(a)/32768.0)
-#define absfix15(a) abs(a) 
-#define int2fix15(a) ((fix15)(a << 15))
-#define fix2int15(a) ((int)(a >> 15))
-#define char2fix15(a) (fix15)(((fix15)(a)) << 15)
-#define divfix(a,b) (fix15)(div_s64s64( (((signed long long)(a)) << 15), ((signed long long)(b))))
-
-// Wall detection
-#define hitBottom(b) (b>int2fix15(380))
-#define hitTop(b) (b<int2fix15(100))
-#define hitLeft(a) (a<int2fix15(100))
-#define hitRight(a) (a>int2fix15(540))
-
-// uS per frame
-#define FRAME_RATE 33000
-
-// the color of the boid
-char color = WHITE ;
+// The flocking engine (and the fixed point macros)
+#include "boids.h"
 
-// Boid on core 0
-fix15 boid0_x ;
-fix15 boid0_y ;
-fix15 boid0_vx ;
-fix15 boid0_vy ;
+// Refreshes (at 60 Hz) per frame of animation: 2 for 30 fps
+#define FRAME_REFRESHES 2
+#define FRAME_US (FRAME_REFRESHES * 16683)
 
-// Boid on core 1
-fix15 boid1_x ;
-fix15 boid1_y ;
-fix15 boid1_vx ;
-fix15 boid1_vy ;
+// Boids at the start (up to BOID_MAX), and how many each steering job
+// takes
+#ifndef BOIDS
+#define BOIDS 300
+#endif
+#define BOID_JOB 32
 
-// Create a boid
-void spawnBoid(fix15* x, fix15* y, fix15* vx, fix15* vy, int direction)
-{
-  // Start in center of screen
-  *x = int2fix15(320) ;
-  *y = int2fix15(240) ;
-  // Choose left or right
-  if (direction) *vx = int2fix15(3) ;
-  else *vx = int2fix15(-3) ;
-  // Moving down
-  *vy = int2fix15(1) ;
-}
+// the color of the boids
+char color = WHITE ;
+
+// The flock. Each boid is a 2x2 sprite (see vga_graphics.h), which
+// puts back what it covered when it moves.
+boid_flock flock ;
+int boid_sprites[BOID_MAX] ;
+unsigned char boid_image[4] ;
+char boid_color ;
+
+// Boid count wanted (set from the serial thread, taken up between frames)
+volatile int boids_wanted = BOIDS ;
 
 // Draw the boundaries
 void drawArena() {
@@ -95,30 +79,10 @@ void drawArena() {
   drawHLine(100, 380, 440, WHITE) ;
 }
 
-// Detect wallstrikes, update velocity and position
-void wallsAndEdges(fix15* x, fix15* y, fix15* vx, fix15* vy)
-{
-  // Reverse direction if we've hit a wall
-  if (hitTop(*y)) {
-    *vy = (-*vy) ;
-    *y  = (*y + int2fix15(5)) ;
-  }
-  if (hitBottom(*y)) {
-    *vy = (-*vy) ;
-    *y  = (*y - int2fix15(5)) ;
-  } 
-  if (hitRight(*x)) {
-    *vx = (-*vx) ;
-    *x  = (*x - int2fix15(5)) ;
-  }
-  if (hitLeft(*x)) {
-    *vx = (-*vx) ;
-    *x  = (*x + int2fix15(5)) ;
-  } 
-
-  // Update position using velocity
-  *x = *x + *vx ;
-  *y = *y + *vy ;
+// Steer one batch of boids (a job, run by whichever core gets to it)
+void steerJob(void *arg) {
+  int first = (intptr_t)arg ;
+  boidsSteer(&flock, first, first + BOID_JOB) ;
 }
 
 // ==================================================
@@ -137,81 +101,94 @@ static PT_THREAD (protothread_serial(struct pt *pt))
     serial_write ;
       while(1) {
         // print prompt
-        sprintf(pt_serial_out_buffer, "input a number in the range 1-7: ");
+        sprintf(pt_serial_out_buffer, "input a color 1-7, or a number of boids 8-%d: ", BOID_MAX);
         // non-blocking write
         serial_write ;
         // spawn a thread to do the non-blocking serial read
         serial_read ;
         // convert input string to number
         sscanf(pt_serial_in_buffer,"%d", &user_input) ;
-        // update boid color
+        // update boid color, or the size of the flock
         if ((user_input > 0) && (user_input < 8)) {
           color = (char)user_input ;
         }
+        else if ((user_input >= 8) && (user_input <= BOID_MAX)) {
+          boids_wanted = user_input ;
+        }
       } // END WHILE(1)
   PT_END(pt);
 } // timer thread
 
-// Animation on core 0
+// Animation on core 0. Each frame, the flock is binned into its grid,
+// then steered in jobs of BOID_JOB boids that both cores take from the
+// scheduler's job queues, and then moved and drawn.
 static PT_THREAD (protothread_anim(struct pt *pt))
 {
     // Mark beginning of thread
     PT_BEGIN(pt);
 
     // Variables for maintaining frame rate
+    static unsigned int frame ;
     static int begin_time ;
-    static int spare_time ;
-
-    // Spawn a boid
-    spawnBoid(&boid0_x, &boid0_y, &boid0_vx, &boid0_vy, 0);
-
+    static int steer_time ;
+    static int frame_time ;
+    static int first, i ;
+
+    // Frame statistics, printed every 30 frames
+    static int frames = 0, overruns = 0, worst_frame = 0 ;
+
+    // Spawn the flock, with a sprite for every boid it might have
+    boidsInit(&flock, boids_wanted) ;
+    for (i=0; i<BOID_MAX; i++) {
+      boid_sprites[i] = vga_sprite_add(2, 2, boid_image, -1) ;
+      vga_sprite_show(boid_sprites[i], i < flock.count) ;
+    }
+    // draw the boundaries, once: the sprites leave them be
+    drawArena() ;
+
+    frame = vga_frame() ;
     while(1) {
-      // Measure time at start of thread
-      begin_time = time_us_32() ;      
-      // erase boid
-      drawRect(fix2int15(boid0_x), fix2int15(boid0_y), 2, 2, BLACK);
-      // update boid's position and velocity
-      wallsAndEdges(&boid0_x, &boid0_y, &boid0_vx, &boid0_vy) ;
-      // draw the boid at its new position
-      drawRect(fix2int15(boid0_x), fix2int15(boid0_y), 2, 2, color); 
-      // draw the boundaries
-      drawArena() ;
-      // delay in accordance with frame rate
-      spare_time = FRAME_RATE - (time_us_32() - begin_time) ;
-      // yield for necessary amount of time
-      PT_YIELD_usec(spare_time) ;
-     // NEVER exit while
-    } // END WHILE(1)
-  PT_END(pt);
-} // animation thread
-
-
-// Animation on core 1
-static PT_THREAD (protothread_anim1(struct pt *pt))
-{
-    // Mark beginning of thread
-    PT_BEGIN(pt);
-
-    // Variables for maintaining frame rate
-    static int begin_time ;
-    static int spare_time ;
-
-    // Spawn a boid
-    spawnBoid(&boid1_x, &boid1_y, &boid1_vx, &boid1_vy, 1);
-
-    while(1) {
-      // Measure time at start of thread
-      begin_time = time_us_32() ;      
-      // erase boid
-      drawRect(fix2int15(boid1_x), fix2int15(boid1_y), 2, 2, BLACK);
-      // update boid's position and velocity
-      wallsAndEdges(&boid1_x, &boid1_y, &boid1_vx, &boid1_vy) ;
-      // draw the boid at its new position
-      drawRect(fix2int15(boid1_x), fix2int15(boid1_y), 2, 2, color); 
-      // delay in accordance with frame rate
-      spare_time = FRAME_RATE - (time_us_32() - begin_time) ;
-      // yield for necessary amount of time
-      PT_YIELD_usec(spare_time) ;
+      // Wait for vertical blanking, and put the boids on the screen at their
+      // new positions while it lasts
+      if (vga_frame_overrun(frame, FRAME_REFRESHES)) overruns++ ;
+      PT_YIELD_UNTIL_VBLANK(frame, FRAME_REFRESHES) ;
+      vga_sprites_update() ;
+      // Measure time at start of frame
+      begin_time = time_us_32() ;
+      if (boids_wanted != flock.count) {
+        boidsSetCount(&flock, boids_wanted) ;
+        for (i=0; i<BOID_MAX; i++) {
+          vga_sprite_show(boid_sprites[i], i < flock.count) ;
+        }
+      }
+      if (color != boid_color) {
+        boid_color = color ;
+        memset(boid_image, boid_color, sizeof(boid_image)) ;
+        for (i=0; i<BOID_MAX; i++) {
+          vga_sprite_set_image(boid_sprites[i], boid_image) ;
+        }
+      }
+      // steer the flock on both cores
+      boidsBin(&flock) ;
+      for (first=0; first<flock.count; first+=BOID_JOB) {
+        pt_job_submit(steerJob, (void *)(intptr_t)first) ;
+      }
+      PT_YIELD_JOBS_DONE ;
+      steer_time = time_us_32() - begin_time ;
+      // update their positions and velocities
+      boidsMove(&flock) ;
+      // move the boids' sprites (they're all put on the screen at once,
+      // at the next vertical blanking)
+      for (i=0; i<flock.count; i++) {
+        vga_sprite_move(boid_sprites[i], fix2int15(flock.x[i]), fix2int15(flock.y[i])) ;
+      }
+      frame_time = time_us_32() - begin_time ;
+      if (frame_time > worst_frame) worst_frame = frame_time ;
+      if (++frames == 30) {
+        printf("%d boids: steer %d us, worst frame %d us of %d, %d overruns\n",
+               flock.count, steer_time, worst_frame, FRAME_US, overruns) ;
+        frames = overruns = worst_frame = 0 ;
+      }
      // NEVER exit while
     } // END WHILE(1)
   PT_END(pt);
@@ -221,9 +198,7 @@ static PT_THREAD (protothread_anim1(struct pt *pt))
 // === core 1 main -- started in main below
 // ========================================
 void core1_main(){
-  // Add animation thread
-  pt_add_thread(protothread_anim1);
-  // Start the scheduler
+  // No threads of its own: the scheduler takes steering jobs from core 0
   pt_schedule_start ;
 
 }
@@ -246,6 +221,9 @@ int main(){
   // add threads
   pt_add_thread(protothread_serial);
   pt_add_thread(protothread_anim);
+#if PT_PROFILE
+  pt_add_thread(protothread_pt_stats);
+#endif
 
   // start scheduler
   pt_schedule_start ;
@@ -0,0 +1,179 @@
+/**
+ * Boids flocking engine (see boids.h)
+ *
+ */
+#include "boids.h"
+
+// Rule weights and limits (per frame)
+#define TURN_FACTOR      float2fix15(0.2)
+#define CENTERING_FACTOR float2fix15(0.0005)
+#define AVOID_FACTOR     float2fix15(0.05)
+#define MATCHING_FACTOR  float2fix15(0.05)
+#define MAX_SPEED        int2fix15(6)
+#define MIN_SPEED        int2fix15(3)
+
+// Ranges in fix15, and squared at 1/128 pixel (distances are compared as
+// (d >> 8)^2, which stays well inside 32 bits for anything within range)
+#define VISUAL_FIX    int2fix15(BOID_VISUAL)
+#define VISUAL_SQ     ((BOID_VISUAL * 128) * (BOID_VISUAL * 128))
+#define PROTECTED_SQ  ((BOID_PROTECTED * 128) * (BOID_PROTECTED * 128))
+
+// Grid cell of a position
+static inline int cellColumn(fix15 x) {
+    int cx = fix2int15(x) / BOID_VISUAL ;
+    return (cx < 0) ? 0 : (cx >= BOID_GRID_W) ? BOID_GRID_W - 1 : cx ;
+}
+static inline int cellRow(fix15 y) {
+    int cy = fix2int15(y) / BOID_VISUAL ;
+    return (cy < 0) ? 0 : (cy >= BOID_GRID_H) ? BOID_GRID_H - 1 : cy ;
+}
+
+// A boid somewhere inside the margins, at 3 pixels a frame or so
+static void spawnBoid(boid_flock * flock, int i) {
+    flock->x[i] = int2fix15(BOID_LEFT + (rand() % (BOID_RIGHT - BOID_LEFT))) ;
+    flock->y[i] = int2fix15(BOID_TOP + (rand() % (BOID_BOTTOM - BOID_TOP))) ;
+    flock->vx[i] = (rand() % int2fix15(6)) - int2fix15(3) ;
+    flock->vy[i] = (rand() % int2fix15(6)) - int2fix15(3) ;
+    flock->new_vx[i] = flock->vx[i] ;
+    flock->new_vy[i] = flock->vy[i] ;
+}
+
+void boidsInit(boid_flock * flock, int count) {
+    flock->count = 0 ;
+    boidsSetCount(flock, count) ;
+}
+
+void boidsSetCount(boid_flock * flock, int count) {
+    if (count < 0) count = 0 ;
+    if (count > BOID_MAX) count = BOID_MAX ;
+    while (flock->count < count) {
+        spawnBoid(flock, flock->count++) ;
+    }
+    flock->count = count ;
+}
+
+void boidsBin(boid_flock * flock) {
+    int i, c ;
+    unsigned short * start = flock->cell_start ;
+
+    // Count the boids in each cell, so that cell c's run of the list
+    // starts after those of all the cells before it...
+    for (c=0; c<=BOID_GRID_W * BOID_GRID_H; c++) start[c] = 0 ;
+    for (i=0; i<flock->count; i++) {
+        start[cellRow(flock->y[i]) * BOID_GRID_W + cellColumn(flock->x[i]) + 1]++ ;
+    }
+    for (c=1; c<=BOID_GRID_W * BOID_GRID_H; c++) start[c] += start[c-1] ;
+
+    // ...then drop each boid into the next slot of its run (which leaves
+    // start[c] at the end of run c, the start of run c + 1)
+    for (i=0; i<flock->count; i++) {
+        c = cellRow(flock->y[i]) * BOID_GRID_W + cellColumn(flock->x[i]) ;
+        flock->cell_boids[start[c]++] = i ;
+    }
+    for (c=BOID_GRID_W * BOID_GRID_H; c>0; c--) start[c] = start[c-1] ;
+    start[0] = 0 ;
+}
+
+void boidsSteer(boid_flock * flock, int first, int last) {
+    int i, k, gy ;
+    if (last > flock->count) last = flock->count ;
+    for (i=first; i<last; i++) {
+        fix15 x = flock->x[i] ;
+        fix15 y = flock->y[i] ;
+        fix15 vx = flock->vx[i] ;
+        fix15 vy = flock->vy[i] ;
+
+        // Offsets from the boids too close, and the summed offsets and
+        // velocities of the rest of those in sight
+        fix15 close_dx = 0, close_dy = 0 ;
+        fix15 dx_sum = 0, dy_sum = 0 ;
+        fix15 vx_sum = 0, vy_sum = 0 ;
+        int neighbors = 0 ;
+
+        int cx = cellColumn(x) ;
+        int cy = cellRow(y) ;
+        int gx0 = (cx > 0) ? cx - 1 : 0 ;
+        int gx1 = (cx < BOID_GRID_W - 1) ? cx + 1 : cx ;
+        int gy0 = (cy > 0) ? cy - 1 : 0 ;
+        int gy1 = (cy < BOID_GRID_H - 1) ? cy + 1 : cy ;
+        for (gy=gy0; gy<=gy1; gy++) {
+            // The cells of a row of the grid are one run of the list
+            int k0 = flock->cell_start[gy * BOID_GRID_W + gx0] ;
+            int k1 = flock->cell_start[gy * BOID_GRID_W + gx1 + 1] ;
+            for (k=k0; k<k1; k++) {
+                int j = flock->cell_boids[k] ;
+                fix15 dx = x - flock->x[j] ;
+                fix15 dy = y - flock->y[j] ;
+                if ((j == i) || (abs(dx) >= VISUAL_FIX) || (abs(dy) >= VISUAL_FIX)) continue ;
+                int ex = dx >> 8 ;
+                int ey = dy >> 8 ;
+                int d_sq = (ex * ex) + (ey * ey) ;
+                if (d_sq < PROTECTED_SQ) {
+                    close_dx += dx ;
+                    close_dy += dy ;
+                }
+                else if (d_sq < VISUAL_SQ) {
+                    dx_sum -= dx ;
+                    dy_sum -= dy ;
+                    vx_sum += flock->vx[j] ;
+                    vy_sum += flock->vy[j] ;
+                    neighbors++ ;
+                }
+            }
+        }
+
+        // Cohesion (toward the neighbors' center) and alignment (toward
+        // their mean velocity)
+        if (neighbors > 0) {
+            vx += multfix15(dx_sum / neighbors, CENTERING_FACTOR) +
+                  multfix15((vx_sum / neighbors) - vx, MATCHING_FACTOR) ;
+            vy += multfix15(dy_sum / neighbors, CENTERING_FACTOR) +
+                  multfix15((vy_sum / neighbors) - vy, MATCHING_FACTOR) ;
+        }
+
+        // Separation
+        vx += multfix15(close_dx, AVOID_FACTOR) ;
+        vy += multfix15(close_dy, AVOID_FACTOR) ;
+
+        // Turn back in at the margins
+        if (x < int2fix15(BOID_LEFT)) vx += TURN_FACTOR ;
+        if (x > int2fix15(BOID_RIGHT)) vx -= TURN_FACTOR ;
+        if (y < int2fix15(BOID_TOP)) vy += TURN_FACTOR ;
+        if (y > int2fix15(BOID_BOTTOM)) vy -= TURN_FACTOR ;
+
+        // Speed limits. The speed is estimated as max + 3/8 min of |vx|
+        // and |vy| (alpha max plus beta min, within about 7%), which
+        // needs no square root.
+        fix15 ax = abs(vx) ;
+        fix15 ay = abs(vy) ;
+        fix15 speed = (ax > ay) ? ax + ((ay * 3) >> 3) : ay + ((ax * 3) >> 3) ;
+        fix15 limit = (speed > MAX_SPEED) ? MAX_SPEED : (speed < MIN_SPEED) ? MIN_SPEED : 0 ;
+        if (limit && (speed >> 8)) {
+            fix15 scale = divfix(limit, speed) ;     // one divide for both
+            vx = multfix15(vx, scale) ;
+            vy = multfix15(vy, scale) ;
+        }
+        else if (limit) {
+            vx = MIN_SPEED ;
+        }
+
+        flock->new_vx[i] = vx ;
+        flock->new_vy[i] = vy ;
+    }
+}
+
+void boidsMove(boid_flock * flock) {
+    int i ;
+    for (i=0; i<flock->count; i++) {
+        flock->vx[i] = flock->new_vx[i] ;
+        flock->vy[i] = flock->new_vy[i] ;
+        flock->x[i] += flock->vx[i] ;
+        flock->y[i] += flock->vy[i] ;
+
+        // Never off the screen, whatever the margins
+        if (flock->x[i] < 0) flock->x[i] = 0 ;
+        if (flock->x[i] > int2fix15(637)) flock->x[i] = int2fix15(637) ;
+        if (flock->y[i] < 0) flock->y[i] = 0 ;
+        if (flock->y[i] > int2fix15(477)) flock->y[i] = int2fix15(477) ;
+    }
+}
@@ -0,0 +1,65 @@
+/**
+ * Boids flocking engine
+ *
+ * The flock is kept as a struct of arrays (all the x positions, then all
+ * the y...), in fix15, and each step is a batch of loops over them:
+ *  - boidsBin() sorts the boids into a grid of cells as wide as the
+ *    visual range (a counting sort), so each boid's neighbors are in the
+ *    3x3 cells around its own, rather than anywhere in the flock
+ *  - boidsSteer(flock, first, last) works out new velocities for boids
+ *    first to last - 1 (separation, alignment, cohesion, the margins and
+ *    the speed limits), from the positions and velocities of the others.
+ *    It only writes those boids' new velocities, so the flock can be cut
+ *    into pieces and steered on both cores at once.
+ *  - boidsMove() takes up the new velocities and moves every boid
+ *
+ * The rules are the usual ones (as in the ECE 4760 boids lab): boids
+ * closer than the protected range push apart, and those within the
+ * visual range pull together and match velocities. Distances are
+ * compared at 1/128 pixel in 32-bit integers.
+ *
+ */
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "fixed_point.h"
+
+// Most boids in a flock (build-time)
+#ifndef BOID_MAX
+#define BOID_MAX 512
+#endif
+
+// The margins: boids outside them turn back in
+#define BOID_LEFT   100
+#define BOID_RIGHT  540
+#define BOID_TOP    100
+#define BOID_BOTTOM 380
+
+// Neighbor ranges (pixels) and the neighbor grid, one visual range per
+// cell, over the screen
+#define BOID_VISUAL    40
+#define BOID_PROTECTED 8
+#define BOID_GRID_W ((640 + BOID_VISUAL - 1) / BOID_VISUAL)
+#define BOID_GRID_H ((480 + BOID_VISUAL - 1) / BOID_VISUAL)
+
+typedef struct {
+    int count ;
+    fix15 x[BOID_MAX] ;
+    fix15 y[BOID_MAX] ;
+    fix15 vx[BOID_MAX] ;
+    fix15 vy[BOID_MAX] ;
+    fix15 new_vx[BOID_MAX] ;                    // from boidsSteer()
+    fix15 new_vy[BOID_MAX] ;
+    // Neighbor grid: the boids in cell c are cell_boids[cell_start[c]]
+    // to cell_boids[cell_start[c+1] - 1]
+    unsigned short cell_start[BOID_GRID_W * BOID_GRID_H + 1] ;
+    unsigned short cell_boids[BOID_MAX] ;
+} boid_flock ;
+
+// Start with count boids, at random inside the margins
+void boidsInit(boid_flock * flock, int count) ;
+// Add or drop boids (new ones start at random)
+void boidsSetCount(boid_flock * flock, int count) ;
+void boidsBin(boid_flock * flock) ;
+void boidsSteer(boid_flock * flock, int first, int last) ;
+void boidsMove(boid_flock * flock) ;
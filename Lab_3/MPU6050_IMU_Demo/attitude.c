@@ -0,0 +1,159 @@
+/**
+ * Fixed-point attitude estimation (see attitude.h)
+ *
+ */
+#include "mpu6050.h"
+#include "attitude.h"
+
+// q24 arithmetic, for the Madgwick filter
+#define Q24_ONE (1 << 24)
+#define multq24(a,b) fix_mul_shift((a), (b), 24)
+
+// 180/pi, and pi/180 in q24
+#define DEG_PER_RAD  oneeightyoverpi
+#define RAD_PER_DEG_Q24 292818
+
+// Largest b with b*b <= v
+static uint32_t isqrt64(uint64_t v) {
+    uint64_t root = 0 ;
+    uint64_t bit = 1ull << 62 ;
+    while (bit > v) bit >>= 2 ;
+    while (bit) {
+        if (v >= root + bit) {
+            v -= root + bit ;
+            root = (root >> 1) + bit ;
+        }
+        else {
+            root >>= 1 ;
+        }
+        bit >>= 2 ;
+    }
+    return (uint32_t)root ;
+}
+
+fix16 fixSqrt(fix16 x) {
+    if (x <= 0) return 0 ;
+    return isqrt64(((uint64_t)x) << 16) ;
+}
+
+// atan(z) for 0 <= z <= 1, in degrees: 45 z + 15.6 z (1 - z) (the
+// first-order fit of Rajan et al., within 0.22 degree)
+static inline fix16 atanUnit(fix16 z) {
+    return (45 * z) + multfix16(multfix16(float2fix16(15.64f), z), int2fix16(1) - z) ;
+}
+
+fix16 fixAtan2(fix16 y, fix16 x) {
+    fix16 ax = (x < 0) ? -x : x ;
+    fix16 ay = (y < 0) ? -y : y ;
+    fix16 angle ;
+    if ((ax == 0) && (ay == 0)) return 0 ;
+    // Fold into the first octant, where the ratio is at most 1
+    if (ay <= ax) {
+        angle = atanUnit(divfix16(ay, ax)) ;
+    }
+    else {
+        angle = int2fix16(90) - atanUnit(divfix16(ax, ay)) ;
+    }
+    if (x < 0) angle = int2fix16(180) - angle ;
+    return (y < 0) ? -angle : angle ;
+}
+
+// Tilt the accelerometer sees (gravity is the only acceleration it can
+// tell apart from a turn)
+static void accelAngles(const fix16 accel[3], fix16 * roll, fix16 * pitch) {
+    int64_t yz = ((int64_t)accel[1] * accel[1]) + ((int64_t)accel[2] * accel[2]) ;
+    *roll = fixAtan2(accel[1], accel[2]) ;
+    *pitch = fixAtan2(-accel[0], (fix16)isqrt64((uint64_t)yz)) ;
+}
+
+void attitudeCompInit(attitude_comp * f, const fix16 accel[3]) {
+    accelAngles(accel, &f->roll, &f->pitch) ;
+}
+
+void attitudeCompUpdate(attitude_comp * f, const fix16 accel[3], const fix16 gyro[3]) {
+    fix16 accel_roll, accel_pitch ;
+    accelAngles(accel, &accel_roll, &accel_pitch) ;
+    // The gyro's degrees per second, times the sample period (a division
+    // by the rate is exact, where multiplying by a fix16 0.001 isn't)
+    fix16 roll = f->roll + (gyro[0] / ATTITUDE_RATE) ;
+    fix16 pitch = f->pitch + (gyro[1] / ATTITUDE_RATE) ;
+    f->roll = roll + multfix16(accel_roll - roll, ATTITUDE_ACCEL_WEIGHT) ;
+    f->pitch = pitch + multfix16(accel_pitch - pitch, ATTITUDE_ACCEL_WEIGHT) ;
+}
+
+void attitudeMadgwickInit(attitude_madgwick * f, fix16 beta) {
+    f->q[0] = Q24_ONE ;
+    f->q[1] = f->q[2] = f->q[3] = 0 ;
+    f->beta = beta << 8 ;
+}
+
+// Scale a q24 vector to unit length (one 64-bit division, for the
+// reciprocal). Returns 0 for a zero vector. The reciprocal stays 64-bit:
+// a small vector (the gradient, as the filter settles) has a norm under
+// 2^17, whose reciprocal doesn't fit a q24 int32. No |v[i]| is more than
+// the norm, so v[i] * recip is within 2^48.
+static int normalize(int32_t * v, int n) {
+    uint64_t sum = 0 ;
+    int i ;
+    for (i=0; i<n; i++) sum += (uint64_t)((int64_t)v[i] * v[i]) ;
+    uint32_t norm = isqrt64(sum) ;                  // q24
+    if (norm == 0) return 0 ;
+    int64_t recip = (int64_t)((1ull << 48) / norm) ; // q24
+    for (i=0; i<n; i++) v[i] = (int32_t)(((int64_t)v[i] * recip) >> 24) ;
+    return 1 ;
+}
+
+void attitudeMadgwickUpdate(attitude_madgwick * f, const fix16 accel[3], const fix16 gyro[3]) {
+    int32_t q0 = f->q[0], q1 = f->q[1], q2 = f->q[2], q3 = f->q[3] ;
+    int32_t a[3], s[4], qdot[4] ;
+    int i ;
+
+    // Rates in radians per second (q24), straight from fix16 degrees per
+    // second: a rate over 128 deg/s doesn't fit a q24 in degrees
+    int32_t gx = fix_mul_shift(gyro[0], RAD_PER_DEG_Q24, 16) ;
+    int32_t gy = fix_mul_shift(gyro[1], RAD_PER_DEG_Q24, 16) ;
+    int32_t gz = fix_mul_shift(gyro[2], RAD_PER_DEG_Q24, 16) ;
+
+    // Rate of change of the quaternion from the gyro: q * (0, g) / 2
+    qdot[0] = (-multq24(q1, gx) - multq24(q2, gy) - multq24(q3, gz)) >> 1 ;
+    qdot[1] = ( multq24(q0, gx) + multq24(q2, gz) - multq24(q3, gy)) >> 1 ;
+    qdot[2] = ( multq24(q0, gy) - multq24(q1, gz) + multq24(q3, gx)) >> 1 ;
+    qdot[3] = ( multq24(q0, gz) + multq24(q1, gy) - multq24(q2, gx)) >> 1 ;
+
+    // Step against the gradient of the error between gravity as the
+    // quaternion would have it and as the accelerometer sees it
+    a[0] = accel[0] << 8 ;
+    a[1] = accel[1] << 8 ;
+    a[2] = accel[2] << 8 ;
+    if (normalize(a, 3)) {
+        int32_t q0q0 = multq24(q0, q0), q1q1 = multq24(q1, q1) ;
+        int32_t q2q2 = multq24(q2, q2), q3q3 = multq24(q3, q3) ;
+        s[0] = 4*multq24(q0, q2q2) + 2*multq24(q2, a[0]) + 4*multq24(q0, q1q1) - 2*multq24(q1, a[1]) ;
+        s[1] = 4*multq24(q1, q3q3) - 2*multq24(q3, a[0]) + 4*multq24(q0q0, q1) - 2*multq24(q0, a[1])
+               - 4*q1 + 8*multq24(q1, q1q1) + 8*multq24(q1, q2q2) + 4*multq24(q1, a[2]) ;
+        s[2] = 4*multq24(q0q0, q2) + 2*multq24(q0, a[0]) + 4*multq24(q2, q3q3) - 2*multq24(q3, a[1])
+               - 4*q2 + 8*multq24(q2, q1q1) + 8*multq24(q2, q2q2) + 4*multq24(q2, a[2]) ;
+        s[3] = 4*multq24(q1q1, q3) - 2*multq24(q1, a[0]) + 4*multq24(q2q2, q3) - 2*multq24(q2, a[1]) ;
+        if (normalize(s, 4)) {
+            for (i=0; i<4; i++) qdot[i] -= multq24(f->beta, s[i]) ;
+        }
+    }
+
+    // Integrate over the sample period, and keep it a unit quaternion
+    for (i=0; i<4; i++) f->q[i] += qdot[i] / ATTITUDE_RATE ;
+    normalize(f->q, 4) ;
+}
+
+void attitudeMadgwickEuler(const attitude_madgwick * f, fix16 * roll, fix16 * pitch, fix16 * yaw) {
+    int32_t q0 = f->q[0], q1 = f->q[1], q2 = f->q[2], q3 = f->q[3] ;
+    // The fix16 atan2 takes any scale, so q24 goes straight in
+    *roll = fixAtan2(2*(multq24(q0, q1) + multq24(q2, q3)),
+                     Q24_ONE - 2*(multq24(q1, q1) + multq24(q2, q2))) ;
+    int32_t sin_pitch = 2*(multq24(q0, q2) - multq24(q3, q1)) ;
+    if (sin_pitch > Q24_ONE) sin_pitch = Q24_ONE ;
+    if (sin_pitch < -Q24_ONE) sin_pitch = -Q24_ONE ;
+    // asin(s) = atan2(s, sqrt(1 - s^2))
+    *pitch = fixAtan2(sin_pitch, isqrt64((uint64_t)((int64_t)Q24_ONE * Q24_ONE - (int64_t)sin_pitch * sin_pitch))) ;
+    *yaw = fixAtan2(2*(multq24(q0, q3) + multq24(q1, q2)),
+                    Q24_ONE - 2*(multq24(q2, q2) + multq24(q3, q3))) ;
+}
@@ -0,0 +1,54 @@
+/**
+ * Fixed-point attitude estimation from the MPU6050 (see mpu6050.h)
+ *
+ * Two filters, both in integer arithmetic (no soft float), meant to run
+ * on every sample, in the interrupt that takes samples in:
+ *  - A complementary filter: roll and pitch from the gyro, integrated,
+ *    pulled slowly toward the tilt the accelerometer sees
+ *  - Madgwick's filter (the IMU version, no magnetometer): a quaternion,
+ *    turned by the gyro and corrected by a gradient step toward gravity.
+ *    No gimbal lock, and a yaw (which drifts, with no compass).
+ * Angles come out in degrees, in fix16 (16.16, fixed_point.h).
+ *
+ * Axes: roll about x, pitch about y, sensor flat with z up.
+ *
+ * Include mpu6050.h (for fix16) first.
+ *
+ */
+#include <stdint.h>
+
+// Sample rate (Hz) of the updates (mpu6050_reset() sets 1 kHz)
+#ifndef ATTITUDE_RATE
+#define ATTITUDE_RATE 1000
+#endif
+
+// Complementary filter: weight given the accelerometer's angle each
+// sample (and 1 - that to the gyro's)
+#ifndef ATTITUDE_ACCEL_WEIGHT
+#define ATTITUDE_ACCEL_WEIGHT zeropt001
+#endif
+
+typedef struct {
+    fix16 roll, pitch ;                 // degrees
+} attitude_comp ;
+
+// Madgwick filter. The quaternion is kept in a 24-bit fraction (q24),
+// finer than fix16, since each sample turns it only a little.
+typedef struct {
+    int32_t q[4] ;                      // w, x, y, z, in q24
+    int32_t beta ;                      // gradient step gain, in q24
+} attitude_madgwick ;
+
+// Start level with the accelerometer reading
+void attitudeCompInit(attitude_comp * f, const fix16 accel[3]) ;
+void attitudeCompUpdate(attitude_comp * f, const fix16 accel[3], const fix16 gyro[3]) ;
+
+// beta (e.g. float2fix16(0.1)) trades gyro drift against accelerometer
+// noise: larger follows gravity faster
+void attitudeMadgwickInit(attitude_madgwick * f, fix16 beta) ;
+void attitudeMadgwickUpdate(attitude_madgwick * f, const fix16 accel[3], const fix16 gyro[3]) ;
+void attitudeMadgwickEuler(const attitude_madgwick * f, fix16 * roll, fix16 * pitch, fix16 * yaw) ;
+
+// atan2(y, x) in degrees (within about 0.25 degree), and a square root
+fix16 fixAtan2(fix16 y, fix16 x) ;
+fix16 fixSqrt(fix16 x) ;
@@ -5,7 +5,19 @@
  * It gathers raw accelerometer/gyro measurements, scales
  * them, and plots them to the VGA display. The top plot
  * shows gyro measurements, bottom plot shows accelerometer
- * measurements.
+ * measurements. Both are strip charts (vga_chart): each
+ * column spans the smallest to the largest of the samples
+ * it stands for, so no spike is lost. The roll angle (from a fixed-point
+ * complementary filter, or with ATTITUDE_MADGWICK=1 a
+ * Madgwick filter, see attitude.h) is plotted in yellow
+ * over the gyro, in degrees. No floating point is used
+ * from sample to screen.
+ *
+ * A fixed-point PID loop (lib/pid) drives the motor PWM
+ * on GPIO 5 from the roll angle, at the PWM wrap rate
+ * (1 kHz). Its gains start at zero (motor off); set them
+ * over serial with the p, i, d and s (setpoint, degrees)
+ * commands, and see them (and the loop's terms) with g.
  * 
  * HARDWARE CONNECTIONS
  *  - GPIO 16 ---> VGA Hsync
@@ -16,6 +28,8 @@
  *  - RP2040 GND ---> VGA GND
  *  - GPIO 8 ---> MPU6050 SDA
  *  - GPIO 9 ---> MPU6050 SCL
+ *  - GPIO 10 <--- MPU6050 INT
+ *  - GPIO 5 ---> PWM output (motor driver)
  *  - 3.3v ---> MPU6050 VCC
  *  - RP2040 GND ---> MPU6050 GND
  */
@@ -39,44 +53,91 @@
 // Include custom libraries
 #include "vga_graphics.h"
 #include "mpu6050.h"
+#include "attitude.h"
+#include "pid.h"
 #include "pt_cornell_rp2040_v1.h"
 
+// Use the Madgwick filter rather than the complementary filter
+#ifndef ATTITUDE_MADGWICK
+#define ATTITUDE_MADGWICK 0
+#endif
+
 // Arrays in which raw measurements will be stored
-fix15 acceleration[3], gyro[3];
+fix16 acceleration[3], gyro[3];
+mpu6050_sample sample ;
+
+// Attitude estimate, updated with every sample (degrees)
+attitude_comp comp_filter ;
+attitude_madgwick madgwick_filter ;
+fix16 roll, pitch ;
 
 // character array
 char screentext[40];
 
-// draw speed
+// draw speed (samples per plotted column)
 int threshold = 10 ;
 
+// Strip charts: gyro (and roll) on top, accel below, fed every sample
+vga_chart gyro_chart, accel_chart ;
+
 // Some macros for max/min/abs
 #define min(a,b) ((a<b) ? a:b)
 #define max(a,b) ((a<b) ? b:a)
 #define abs(a) ((a>0) ? a:-a)
 
-// semaphore
+// semaphore (signalled from the PWM interrupt on core 0, waited on by
+// the VGA thread on core 1, so the core-safe kind)
 static struct pt_sem vga_semaphore ;
 
 // Some paramters for PWM
 #define WRAPVAL 5000
 #define CLKDIV  25.0
+#define PWM_RATE 1000   // wraps per second (125 MHz / CLKDIV / WRAPVAL)
 uint slice_num ;
 
+// Motor control loop: roll angle in, PWM duty cycle out
+pid_controller motor_pid ;
+volatile fix16 roll_setpoint = 0 ;
+volatile int motor_duty = 0 ;
+
 // Interrupt service routine
 void on_pwm_wrap() {
 
     // Clear the interrupt flag that brought us here
     pwm_clear_irq(pwm_gpio_to_slice_num(5));
 
-    // Read the IMU
+    // Take the latest IMU measurements (read by DMA as the sensor makes
+    // them, 1000 a second)
     // NOTE! This is in 15.16 fixed point. Accel in g's, gyro in deg/s
-    // If you want these values in floating point, call fix2float15() on
+    // If you want these values in floating point, call fix2float16() on
     // the raw measurements.
-    mpu6050_read_raw(acceleration, gyro);
+    while (mpu6050_pop_sample(&sample)) {
+        for (int i = 0; i < 3; i++) {
+            acceleration[i] = sample.accel[i] ;
+            gyro[i] = sample.gyro[i] ;
+        }
+        // The filters run at the sample rate, whatever the PWM rate
+#if ATTITUDE_MADGWICK
+        fix16 yaw ;
+        attitudeMadgwickUpdate(&madgwick_filter, acceleration, gyro) ;
+        attitudeMadgwickEuler(&madgwick_filter, &roll, &pitch, &yaw) ;
+#else
+        attitudeCompUpdate(&comp_filter, acceleration, gyro) ;
+        roll = comp_filter.roll ;
+        pitch = comp_filter.pitch ;
+#endif
+        // Every sample goes to the charts (drawn later, by the VGA thread)
+        int gyro_values[4] = {gyro[0], gyro[1], gyro[2], roll} ;
+        vga_chart_add(&gyro_chart, gyro_values) ;
+        vga_chart_add(&accel_chart, acceleration) ;
+    }
+
+    // Run the control loop, and set the duty cycle for the next period
+    motor_duty = pid2int(pid_update(&motor_pid, roll_setpoint, roll)) ;
+    pwm_set_chan_level(slice_num, PWM_CHAN_B, motor_duty) ;
 
     // Signal VGA to draw
-    PT_SEM_SIGNAL(pt, &vga_semaphore);
+    PT_SEM_SAFE_SIGNAL(pt, &vga_semaphore);
 }
 
 // Thread that draws to VGA display
@@ -85,18 +146,6 @@ static PT_THREAD (protothread_vga(struct pt *pt))
     // Indicate start of thread
     PT_BEGIN(pt) ;
 
-    // We will start drawing at column 81
-    static int xcoord = 81 ;
-    
-    // Rescale the measurements for display
-    static float OldRange = 500. ; // (+/- 250)
-    static float NewRange = 150. ; // (looks nice on VGA)
-    static float OldMin = -250. ;
-    static float OldMax = 250. ;
-
-    // Control rate of drawing
-    static int throttle ;
-
     // Draw the static aspects of the display
     setTextSize(1) ;
     setTextColor(WHITE);
@@ -134,47 +183,24 @@ static PT_THREAD (protothread_vga(struct pt *pt))
 
     while (true) {
         // Wait on semaphore
-        PT_SEM_WAIT(pt, &vga_semaphore);
-        // Increment drawspeed controller
-        throttle += 1 ;
-        // If the controller has exceeded a threshold, draw
-        if (throttle >= threshold) { 
-            // Zero drawspeed controller
-            throttle = 0 ;
-
-            // Erase a column
-            drawVLine(xcoord, 0, 480, BLACK) ;
-
-            // Draw bottom plot (multiply by 120 to scale from +/-2 to +/-250)
-            drawPixel(xcoord, 430 - (int)(NewRange*((float)((fix2float15(acceleration[0])*120.0)-OldMin)/OldRange)), WHITE) ;
-            drawPixel(xcoord, 430 - (int)(NewRange*((float)((fix2float15(acceleration[1])*120.0)-OldMin)/OldRange)), RED) ;
-            drawPixel(xcoord, 430 - (int)(NewRange*((float)((fix2float15(acceleration[2])*120.0)-OldMin)/OldRange)), GREEN) ;
-
-            // Draw top plot
-            drawPixel(xcoord, 230 - (int)(NewRange*((float)((fix2float15(gyro[0]))-OldMin)/OldRange)), WHITE) ;
-            drawPixel(xcoord, 230 - (int)(NewRange*((float)((fix2float15(gyro[1]))-OldMin)/OldRange)), RED) ;
-            drawPixel(xcoord, 230 - (int)(NewRange*((float)((fix2float15(gyro[2]))-OldMin)/OldRange)), GREEN) ;
-
-            // Update horizontal cursor
-            if (xcoord < 609) {
-                xcoord += 1 ;
-            }
-            else {
-                xcoord = 81 ;
-            }
-        }
+        PT_SEM_SAFE_WAIT(pt, &vga_semaphore);
+        // Draw the columns the samples since have filled
+        vga_chart_draw(&gyro_chart) ;
+        vga_chart_draw(&accel_chart) ;
     }
     // Indicate end of thread
     PT_END(pt);
 }
 
-// User input thread. User can change draw speed
+// User input thread. User can change draw speed, and tune the motor loop
 static PT_THREAD (protothread_serial(struct pt *pt))
 {
     PT_BEGIN(pt) ;
     static char classifier ;
     static int test_in ;
     static float float_in ;
+    // motor loop gains, as last set
+    static float kp = 0, ki = 0, kd = 0 ;
     while(1) {
         sprintf(pt_serial_out_buffer, "input a command: ");
         serial_write ;
@@ -184,7 +210,32 @@ static PT_THREAD (protothread_serial(struct pt *pt))
         sscanf(pt_serial_in_buffer,"%c", &classifier) ;
 
         // num_independents = test_in ;
-        if (classifier=='t') {
+        if ((classifier=='p') || (classifier=='i') || (classifier=='d')) {
+            sprintf(pt_serial_out_buffer, "k%c: ", classifier);
+            serial_write ;
+            serial_read ;
+            // convert input string to number
+            sscanf(pt_serial_in_buffer,"%f", &float_in) ;
+            if (classifier=='p') kp = float_in ;
+            else if (classifier=='i') ki = float_in ;
+            else kd = float_in ;
+            pid_set_gains(&motor_pid, kp, ki, kd) ;
+        }
+        else if (classifier=='s') {
+            sprintf(pt_serial_out_buffer, "setpoint (degrees): ");
+            serial_write ;
+            serial_read ;
+            // convert input string to number
+            sscanf(pt_serial_in_buffer,"%f", &float_in) ;
+            roll_setpoint = float2fix16(float_in) ;
+        }
+        else if (classifier=='g') {
+            sprintf(pt_serial_out_buffer, "kp %g ki %g kd %g setpoint %g: roll %g, duty %d (p %d i %d d %d)\n\r",
+                    kp, ki, kd, fix2float16(roll_setpoint), fix2float16(roll), motor_duty,
+                    pid2int(motor_pid.p_out), pid2int(motor_pid.i_out), pid2int(motor_pid.d_out));
+            serial_write ;
+        }
+        else if (classifier=='t') {
             sprintf(pt_serial_out_buffer, "timestep: ");
             serial_write ;
             serial_read ;
@@ -192,6 +243,8 @@ static PT_THREAD (protothread_serial(struct pt *pt))
             sscanf(pt_serial_in_buffer,"%d", &test_in) ;
             if (test_in > 0) {
                 threshold = test_in ;
+                vga_chart_set_decimation(&gyro_chart, threshold) ;
+                vga_chart_set_decimation(&accel_chart, threshold) ;
             }
         }
     }
@@ -223,6 +276,33 @@ int main() {
     // MPU6050 initialization
     mpu6050_reset();
     mpu6050_read_raw(acceleration, gyro);
+    attitudeCompInit(&comp_filter, acceleration) ;
+    attitudeMadgwickInit(&madgwick_filter, float2fix16(0.1)) ;
+    // From here on, samples are read by DMA on the data-ready interrupt
+    mpu6050_start_sampling() ;
+
+    // Motor loop, at the PWM rate, off until gains are set. The
+    // derivative of the roll is smoothed over 4 samples.
+    pid_init(&motor_pid, PWM_RATE) ;
+    pid_set_limits(&motor_pid, 0, WRAPVAL) ;
+    pid_set_derivative_filter(&motor_pid, 2) ;
+
+    // Charts, in columns 81 to 609: +/-250 deg/s (and degrees of
+    // roll) over lines 80 to 230, +/-2 g over 280 to 430
+    vga_chart_init(&gyro_chart, 81, 80, 529, 151, int2fix16(-250), int2fix16(250), BLACK) ;
+    vga_chart_add_trace(&gyro_chart, WHITE) ;
+    vga_chart_add_trace(&gyro_chart, RED) ;
+    vga_chart_add_trace(&gyro_chart, GREEN) ;
+    vga_chart_add_trace(&gyro_chart, YELLOW) ;
+    vga_chart_init(&accel_chart, 81, 280, 529, 151, int2fix16(-2), int2fix16(2), BLACK) ;
+    vga_chart_add_trace(&accel_chart, WHITE) ;
+    vga_chart_add_trace(&accel_chart, RED) ;
+    vga_chart_add_trace(&accel_chart, GREEN) ;
+    vga_chart_set_decimation(&gyro_chart, threshold) ;
+    vga_chart_set_decimation(&accel_chart, threshold) ;
+
+    // Before the interrupt can signal it
+    PT_SEM_SAFE_INIT(&vga_semaphore, 0) ;
 
     ////////////////////////////////////////////////////////////////////////
     ///////////////////////// PWM CONFIGURATION ////////////////////////////
@@ -256,6 +336,11 @@ int main() {
     ////////////////////////////////////////////////////////////////////////
     ///////////////////////////// ROCK AND ROLL ////////////////////////////
     ////////////////////////////////////////////////////////////////////////
+    // The VGA thread is parked on its semaphore between samples, so core
+    // 1 sleeps until the interrupt signals it
+    pt_sched_method = SCHED_RATE ;
+    pt_sched_tickless = 1 ;
+
     // start core 1 
     multicore_reset_core1();
     multicore_launch_core1(core1_entry);
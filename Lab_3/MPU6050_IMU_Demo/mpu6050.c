@@ -4,7 +4,12 @@
  *
  */
 
+#include "pico/stdlib.h"
 #include "hardware/i2c.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/gpio.h"
+#include "hw_claim.h"
 #include "mpu6050.h"
 
 void mpu6050_reset() {
@@ -35,7 +40,7 @@ void mpu6050_reset() {
     i2c_write_blocking(I2C_CHAN, ADDRESS, int_config, 2, false);
 }
 
-void mpu6050_read_raw(fix15 accel[3], fix15 gyro[3]) {
+void mpu6050_read_raw(fix16 accel[3], fix16 gyro[3]) {
     // For this particular device, we send the device the register we want to read
     // first, then subsequently read from the device. The register is auto incrementing
     // so we don't need to keep sending the register we want, just the first.
@@ -63,7 +68,151 @@ void mpu6050_read_raw(fix15 accel[3], fix15 gyro[3]) {
     for (int i = 0; i < 3; i++) {
         temp_gyro = (buffer[i<<1] << 8 | buffer[(i<<1) + 1]);
         gyro[i] = temp_gyro ;
-        gyro[i] = multfix15(gyro[i], 500<<16) ; // deg/sec
+        gyro[i] = multfix16(gyro[i], 500<<16) ; // deg/sec
     }
 }
+
+// Raw samples, as read: registers 0x3B to 0x48 (accel, temperature, gyro,
+// high byte first)
+#define BURST_BYTES 14
+typedef struct {
+    uint32_t time_us ;
+    uint8_t raw[BURST_BYTES] ;
+} raw_sample ;
+
+static raw_sample ring[MPU6050_RING] ;
+static volatile uint32_t ring_head = 0 ;   // written by the DMA interrupt
+static volatile uint32_t ring_tail = 0 ;   // written by mpu6050_pop_sample
+volatile uint32_t mpu6050_dropped = 0 ;
+
+// Commands for the I2C data register: write the first register's address,
+// then (after a restart) read 14 bytes, stopping after the last
+static uint32_t burst_cmds[1 + BURST_BYTES] ;
+
+// Where the read in progress goes, and when the sensor asked for it
+static uint8_t burst_buf[BURST_BYTES] ;
+static uint32_t burst_time ;
+static volatile bool burst_busy = false ;
+
+static int cmd_chan = -1, data_chan = -1 ;
+
+// Data-ready: start a burst read, unless the last one hasn't finished
+static void mpu6050_int_handler() {
+    if (!(gpio_get_irq_event_mask(MPU6050_INT_PIN) & GPIO_IRQ_EDGE_RISE)) return ;
+    gpio_acknowledge_irq(MPU6050_INT_PIN, GPIO_IRQ_EDGE_RISE) ;
+
+    if (burst_busy) {
+        mpu6050_dropped++ ;
+        // A read still going after two sample periods was NAKed, and the
+        // I2C block threw its commands away, so start over. (The channel
+        // interrupt is masked around the abort, which can raise it.)
+        if ((time_us_32() - burst_time) < 2000) return ;
+        dma_channel_set_irq0_enabled(data_chan, false) ;
+        dma_channel_abort(cmd_chan) ;
+        dma_channel_abort(data_chan) ;
+        dma_hw->ints0 = (1u << data_chan) ;
+        dma_channel_set_irq0_enabled(data_chan, true) ;
+        (void)i2c_get_hw(I2C_CHAN)->clr_tx_abrt ;
+    }
+    burst_busy = true ;
+    burst_time = time_us_32() ;
+    // The data channel waits on the I2C receive FIFO; the command channel
+    // feeds the transmit FIFO and starts the transfer
+    dma_channel_set_write_addr(data_chan, burst_buf, true) ;
+    dma_channel_set_read_addr(cmd_chan, burst_cmds, true) ;
+}
+
+// The last byte is in: keep the sample
+static void mpu6050_dma_handler() {
+    // DMA_IRQ_0 may be shared, so check that it's ours
+    if (!(dma_hw->ints0 & (1u << data_chan))) return ;
+    dma_hw->ints0 = (1u << data_chan) ;
+
+    uint32_t head = ring_head ;
+    if ((head - ring_tail) < MPU6050_RING) {
+        raw_sample * s = &ring[head & (MPU6050_RING - 1)] ;
+        s->time_us = burst_time ;
+        for (int i = 0; i < BURST_BYTES; i++) s->raw[i] = burst_buf[i] ;
+        __dmb() ;
+        ring_head = head + 1 ;
+    }
+    else {
+        mpu6050_dropped++ ;
+    }
+    burst_busy = false ;
+}
+
+void mpu6050_start_sampling() {
+    i2c_hw_t * hw = i2c_get_hw(I2C_CHAN) ;
+
+    burst_cmds[0] = 0x3B ;
+    for (int i = 0; i < BURST_BYTES; i++) {
+        burst_cmds[1 + i] = I2C_IC_DATA_CMD_CMD_BITS ;                   // read
+    }
+    burst_cmds[1] |= I2C_IC_DATA_CMD_RESTART_BITS ;
+    burst_cmds[BURST_BYTES] |= I2C_IC_DATA_CMD_STOP_BITS ;
+
+    // Talk to the sensor, with the DMA request lines on. (The target
+    // address can only be changed with the block disabled.)
+    hw->enable = 0 ;
+    hw->tar = ADDRESS ;
+    hw->enable = 1 ;
+    hw->dma_cr = I2C_IC_DMA_CR_TDMAE_BITS | I2C_IC_DMA_CR_RDMAE_BITS ;
+
+    cmd_chan = hw_claim_dma("mpu6050") ;
+    data_chan = hw_claim_dma("mpu6050") ;
+
+    // Commands out, one word each, paced by the transmit FIFO
+    dma_channel_config c = dma_channel_get_default_config(cmd_chan) ;
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32) ;
+    channel_config_set_read_increment(&c, true) ;
+    channel_config_set_write_increment(&c, false) ;
+    channel_config_set_dreq(&c, i2c_get_dreq(I2C_CHAN, true)) ;
+    dma_channel_configure(cmd_chan, &c, &hw->data_cmd, burst_cmds, 1 + BURST_BYTES, false) ;
+
+    // Bytes in, paced by the receive FIFO
+    c = dma_channel_get_default_config(data_chan) ;
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_8) ;
+    channel_config_set_read_increment(&c, false) ;
+    channel_config_set_write_increment(&c, true) ;
+    channel_config_set_dreq(&c, i2c_get_dreq(I2C_CHAN, false)) ;
+    dma_channel_configure(data_chan, &c, burst_buf, &hw->data_cmd, BURST_BYTES, false) ;
+
+    dma_channel_set_irq0_enabled(data_chan, true) ;
+    irq_add_shared_handler(DMA_IRQ_0, mpu6050_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY) ;
+    irq_set_enabled(DMA_IRQ_0, true) ;
+
+    // The sensor pulses its interrupt pin high as each sample is ready
+    gpio_init(MPU6050_INT_PIN) ;
+    gpio_set_dir(MPU6050_INT_PIN, GPIO_IN) ;
+    gpio_add_raw_irq_handler(MPU6050_INT_PIN, mpu6050_int_handler) ;
+    gpio_set_irq_enabled(MPU6050_INT_PIN, GPIO_IRQ_EDGE_RISE, true) ;
+    irq_set_enabled(IO_IRQ_BANK0, true) ;
+}
+
+int mpu6050_samples_available() {
+    return ring_head - ring_tail ;
+}
+
+// Take the oldest sample, returning false if there isn't one
+bool mpu6050_pop_sample(mpu6050_sample * sample) {
+    uint32_t tail = ring_tail ;
+    if (tail == ring_head) return false ;
+    __dmb() ;
+    const raw_sample * s = &ring[tail & (MPU6050_RING - 1)] ;
+
+    sample->time_us = s->time_us ;
+    for (int i = 0; i < 3; i++) {
+        int16_t temp_accel = (s->raw[i<<1] << 8 | s->raw[(i<<1) + 1]) ;
+        sample->accel[i] = temp_accel ;
+        sample->accel[i] <<= 2 ; // convert to g's (fixed point)
+        // (gyro after the two temperature bytes)
+        int16_t temp_gyro = (s->raw[8 + (i<<1)] << 8 | s->raw[8 + (i<<1) + 1]) ;
+        sample->gyro[i] = temp_gyro ;
+        sample->gyro[i] = multfix16(sample->gyro[i], 500<<16) ; // deg/sec
+    }
+    __dmb() ;
+    ring_tail = tail + 1 ;
+    return true ;
+}
 /////////////////////////////////////////////////////////////////
\ No newline at end of file
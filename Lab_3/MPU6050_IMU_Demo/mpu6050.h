@@ -1,8 +1,25 @@
 /**
  * Hunter Adams (vha3@cornell.edu)
  * 
+ * SAMPLING
+ *  - mpu6050_read_raw() reads the sensor with blocking I2C calls (about
+ *    400 us at 400 kHz), so it's for setup, not interrupts
+ *  - mpu6050_start_sampling() hands the I2C channel over to DMA. Each
+ *    data-ready pulse on MPU6050_INT_PIN (1 kHz, see mpu6050_reset) starts
+ *    one 14-byte burst read of accel, temperature and gyro, and the DMA
+ *    completion interrupt stores it, timestamped, in a ring. The CPU only
+ *    spends a few microseconds an interrupt; mpu6050_pop_sample() takes
+ *    samples out, oldest first.
+ *  - After that, don't use the blocking calls on I2C_CHAN
+ *
+ * RESOURCES USED (sampling)
+ *  - Two DMA channels, claimed from lib/hw_claim
+ *  - DMA_IRQ_0 and the GPIO interrupt (IO_IRQ_BANK0), on the core that
+ *    calls mpu6050_start_sampling()
  *
  */
+#include <stdint.h>
+#include <stdbool.h>
 
 #define ADDRESS 0x68
 #define I2C_CHAN i2c0
@@ -10,14 +27,18 @@
 #define SCL_PIN  9
 #define I2C_BAUD_RATE 400000
 
-// Fixed point data type
-typedef signed int fix15 ;
-#define multfix15(a,b) ((fix15)(((( signed long long)(a))*(( signed long long)(b)))>>16)) 
-#define float2fix15(a) ((fix15)((a)*65536.0f)) // 2^16
-#define fix2float15(a) ((float)(a)/65536.0f) 
-#define int2fix15(a) ((a)<<16)
-#define fix2int15(a) ((a)>>16)
-#define divfix(a,b) ((fix15)(((( signed long long)(a) << 16 / (b)))))
+// Data-ready interrupt from the sensor
+#ifndef MPU6050_INT_PIN
+#define MPU6050_INT_PIN 10
+#endif
+
+// Samples the ring holds (a power of two)
+#ifndef MPU6050_RING
+#define MPU6050_RING 64
+#endif
+
+// Fixed point data type (fix16, 16.16)
+#include "fixed_point.h"
 // Parameter values
 #define oneeightyoverpi 3754936
 #define zeropt001 65
@@ -27,6 +48,22 @@ typedef signed int fix15 ;
 #define zeropt1 6553
 #define zeropt9 58982
 
-// VGA primitives - usable in main
+// MPU6050 - set it up (awake, its sample rate and ranges), and read one
+// sample over I2C, blocking. Once mpu6050_start_sampling() is running,
+// take samples from the ring below instead.
 void mpu6050_reset(void) ;
-void mpu6050_read_raw(fix15 accel[3], fix15 gyro[3]) ;
\ No newline at end of file
+void mpu6050_read_raw(fix16 accel[3], fix16 gyro[3]) ;
+
+// One sample: when the sensor said it was ready, and the measurements
+// in the same units as mpu6050_read_raw()
+typedef struct {
+    uint32_t time_us ;
+    fix16 accel[3] ;
+    fix16 gyro[3] ;
+} mpu6050_sample ;
+
+void mpu6050_start_sampling(void) ;
+int mpu6050_samples_available(void) ;
+bool mpu6050_pop_sample(mpu6050_sample * sample) ;
+// Samples lost because the ring was full, or a read was still going
+extern volatile uint32_t mpu6050_dropped ;
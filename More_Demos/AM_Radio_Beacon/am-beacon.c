@@ -1,19 +1,30 @@
 /**
  * V. Hunter Adams (vha3@cornell.edu)
- * 
+ *
  * AM Radio beacon with PWM
- * 
+ *
  * This demonstration uses a PWM channel
  * to generate a 1KHz AM radio beacon.
  * Tune your SDR to 41.667MHz.
- * 
+ *
+ * The beacon keys a 1 kHz tone for a second, sends plain carrier for a
+ * second, then its Morse ID on the tone, over and over. The pattern is
+ * compiled into DMA blocks by the keyer (keyer.h), and played into the
+ * PWM compare register by DMA, so the CPU has nothing to do while it
+ * transmits; it just waits for serial commands:
+ *  - m TEXT ---> use TEXT as the Morse ID
+ *  - f TEXT ---> send TEXT as FSK (300 baud, 1070/1270 Hz as in Bell
+ *                103), between seconds of carrier
+ *  - c ---> carrier only,  s ---> stop (no carrier)
+ * A new pattern starts at the end of the one playing.
+ *
  * HARDWARE CONNECTIONS
  *   - GPIO 4 ---> PWM output
- * 
+ *
  * RESOURCES CONSUMED
- *   - 1 repeating timer
+ *   - 2 DMA channels (claimed) and a DMA timer
  *   - 1 PWM channel
- * 
+ *
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,6 +34,7 @@
 #include "pico/multicore.h"
 
 #include "hardware/pwm.h"
+#include "keyer.h"
 
 // PWM wrap value and clock divide value
 // For a CPU rate of 250 MHz, this gives
@@ -34,42 +46,57 @@
 // PWM pin
 #define PWM_PIN 4
 
+// Morse speed, and the ID sent to start with
+#define MORSE_WPM 20
+#define DEFAULT_ID "DE PICO BEACON"
+
 // Variable to hold PWM slice number
 uint slice_num ;
 
-// DMA channel
-int control_chan = 3 ;
+// Two patterns: one playing, and the next one built in the other
+keyer_pattern patterns[2] ;
+int next_pattern = 0 ;
+
+// Tones: the beacon's, and FSK mark and space
+int beacon_tone, mark_tone, space_tone ;
+
+// The beacon: tone, carrier, then the ID
+void beaconPattern(keyer_pattern * p, const char * id) {
+    keyer_begin(p) ;
+    keyer_tone(p, beacon_tone, keyer_ms(1000)) ;
+    keyer_level(p, DEFAULT_DUTY, keyer_ms(1000)) ;
+    keyer_morse(p, id, MORSE_WPM, beacon_tone, DEFAULT_DUTY) ;
+    keyer_level(p, DEFAULT_DUTY, keyer_ms(1000)) ;
+    keyer_finish(p, 1) ;
+}
 
-// Some state information for use in ISR
-unsigned int counter ;
-unsigned int state ;
+// FSK text between seconds of carrier
+void fskPattern(keyer_pattern * p, const char * text) {
+    keyer_begin(p) ;
+    keyer_level(p, DEFAULT_DUTY, keyer_ms(1000)) ;
+    keyer_fsk(p, (const uint8_t *)text, strlen(text), 300, mark_tone, space_tone) ;
+    keyer_finish(p, 1) ;
+}
 
-// Timer ISR
-bool repeating_timer_callback(struct repeating_timer *t) {
+// A steady level
+void levelPattern(keyer_pattern * p, int level) {
+    keyer_begin(p) ;
+    keyer_level(p, level, keyer_ms(100)) ;
+    keyer_finish(p, 1) ;
+}
 
-    // Generate 1KHz tone
-    if (counter < 1000){
-        if (state) {
-            pwm_set_chan_level(slice_num, PWM_CHAN_A, DEFAULT_DUTY) ;
-            state = 0 ;
-        }
-        else {
-            pwm_set_chan_level(slice_num, PWM_CHAN_A, 0) ;
-            state = 1 ;
-        }
-    }
-    // Generate carrier wave
-    else if (counter < 2000) {
-        pwm_set_chan_level(slice_num, PWM_CHAN_A, DEFAULT_DUTY) ;
-    }
-    // Reset
-    else {
-        counter = 0 ;
-    }
-    counter += 1 ;
-    return true;
+// The pattern to build into next, once it's free
+keyer_pattern * nextPattern() {
+    keyer_pattern * p = &patterns[next_pattern] ;
+    while (keyer_uses(p)) sleep_ms(10) ;
+    next_pattern ^= 1 ;
+    return p ;
 }
 
+void startPattern(keyer_pattern * p) {
+    if (p->overflow) printf("pattern too long, cut short\n") ;
+    keyer_start(p) ;
+}
 
 int main() {
 
@@ -82,7 +109,7 @@ int main() {
     ////////////////////////////////////////////////////////////////////////
     ///////////////////////// PWM CONFIGURATION ////////////////////////////
     ////////////////////////////////////////////////////////////////////////
-    // Tell GPIO 4 that it is allocated to the PWM, max slew rate and 
+    // Tell GPIO 4 that it is allocated to the PWM, max slew rate and
     // drive strength
     gpio_set_function(PWM_PIN, GPIO_FUNC_PWM);
     gpio_set_drive_strength(PWM_PIN, 3);
@@ -102,20 +129,51 @@ int main() {
     pwm_set_mask_enabled((1u << slice_num));
 
     ////////////////////////////////////////////////////////////////////////
-    /////////////////////////// REPEATING TIMER ////////////////////////////
+    ////////////////////////////// KEYER ///////////////////////////////////
     ////////////////////////////////////////////////////////////////////////
-    // Create a repeating timer that calls repeating_timer_callback.
-    // If the delay is > 0 then this is the delay between the previous callback ending and the next starting.
-    // If the delay is negative (see below) then the next call to the callback will be exactly x us after the
-    // start of the call to the last callback
-    struct repeating_timer timer;
+    // The tones key the carrier fully on and off
+    keyer_init(slice_num) ;
+    beacon_tone = keyer_add_tone(1000.0f, DEFAULT_DUTY, 0) ;
+    mark_tone = keyer_add_tone(1270.0f, DEFAULT_DUTY, 0) ;
+    space_tone = keyer_add_tone(1070.0f, DEFAULT_DUTY, 0) ;
 
-    // Negative delay so means we will call repeating_timer_callback, and call it again
-    // 25us (40kHz) later regardless of how long the callback took to execute
-    add_repeating_timer_us(-1000, repeating_timer_callback, NULL, &timer);
+    beaconPattern(nextPattern(), DEFAULT_ID) ;
+    startPattern(&patterns[0]) ;
 
+    // Nothing to do while it transmits but wait for a command
+    static char line[128] ;
     while(1) {
-
+        printf("m TEXT (Morse ID), f TEXT (FSK), c (carrier), s (stop): ") ;
+        int n = 0 ;
+        int c ;
+        while (((c = getchar()) != '\r') && (c != '\n')) {
+            if ((c >= ' ') && (n < (int)sizeof(line) - 1)) line[n++] = c ;
+        }
+        line[n] = 0 ;
+        printf("\n") ;
+
+        keyer_pattern * p ;
+        const char * text = (n > 2) ? &line[2] : "" ;
+        switch (line[0]) {
+        case 'm':
+            p = nextPattern() ;
+            beaconPattern(p, text) ;
+            startPattern(p) ;
+            break ;
+        case 'f':
+            p = nextPattern() ;
+            fskPattern(p, text) ;
+            startPattern(p) ;
+            break ;
+        case 'c':
+            p = nextPattern() ;
+            levelPattern(p, DEFAULT_DUTY) ;
+            startPattern(p) ;
+            break ;
+        case 's':
+            keyer_stop(0) ;
+            break ;
+        }
     }
 
 }
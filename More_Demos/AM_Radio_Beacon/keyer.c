@@ -0,0 +1,257 @@
+/**
+ * DMA keying sequencer (see keyer.h)
+ *
+ */
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hw_claim.h"
+#include "keyer.h"
+
+// The channels, the timer, and the compare register they write
+static int data_chan = -1, ctrl_chan = -1 ;
+static int keyer_timer = -1 ;
+static volatile void * keyer_cc ;
+
+// Data channel control words: a tone (through a buffer), a steady level
+// (one level over and over), and the loop block (one word, unpaced)
+static uint32_t tone_ctrl, level_ctrl, loop_ctrl ;
+
+// The pattern a looping one goes back to (read by its loop block), and
+// whether the last one started loops
+static const keyer_block * volatile keyer_next ;
+static char next_loops = 0 ;
+
+// Every level, for steady blocks to read
+static uint16_t levels[KEYER_MAX_LEVEL + 1] ;
+
+// Tones: a buffer of whole cycles each, and its length in ticks
+static uint16_t waves[KEYER_TONES][KEYER_WAVE] ;
+static int wave_len[KEYER_TONES] ;
+static float wave_freq[KEYER_TONES] ;
+static short wave_hi[KEYER_TONES], wave_lo[KEYER_TONES] ;
+static int tones = 0 ;
+
+// Set the DMA timer to rate: the system clock times X/Y, each 16 bits,
+// for X <= Y (as in lib/dds_audio, the closest of every X that fits)
+static void setTimerRate(float rate) {
+    float sys = (float)clock_get_hz(clk_sys) ;
+    uint16_t best_x = 1, best_y = 0xFFFF ;
+    float best_err = 1e30f ;
+    for (uint32_t x=1; x<=0xFFFF; x++) {
+        uint32_t y = (uint32_t)((float)x * sys / rate + 0.5f) ;
+        if (y > 0xFFFF) break ;
+        if (y < x) continue ;
+        float err = fabsf(sys * (float)x / (float)y - rate) ;
+        if (err < best_err) {
+            best_err = err ;
+            best_x = x ;
+            best_y = y ;
+        }
+    }
+    dma_timer_set_fraction(keyer_timer, best_x, best_y) ;
+}
+
+void keyer_init(uint slice) {
+    if (data_chan < 0) {
+        data_chan = hw_claim_dma("keyer") ;
+        ctrl_chan = hw_claim_dma("keyer") ;
+        keyer_timer = hw_claim_dma_timer("keyer") ;
+    }
+    keyer_cc = &pwm_hw->slice[slice].cc ;
+    setTimerRate(KEYER_RATE) ;
+
+    for (int i=0; i<=KEYER_MAX_LEVEL; i++) levels[i] = i ;
+
+    // Each data block chains back to the control channel for the next
+    dma_channel_config c = dma_channel_get_default_config(data_chan) ;
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16) ;
+    channel_config_set_read_increment(&c, true) ;
+    channel_config_set_write_increment(&c, false) ;
+    channel_config_set_dreq(&c, dma_get_timer_dreq(keyer_timer)) ;
+    channel_config_set_chain_to(&c, ctrl_chan) ;
+    tone_ctrl = channel_config_get_ctrl_value(&c) ;
+    channel_config_set_read_increment(&c, false) ;
+    level_ctrl = channel_config_get_ctrl_value(&c) ;
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32) ;
+    channel_config_set_dreq(&c, DREQ_FORCE) ;
+    loop_ctrl = channel_config_get_ctrl_value(&c) ;
+
+    // The control channel writes the four alias 1 registers of the data
+    // channel (the last one triggers it), wrapping back to the first
+    dma_channel_config k = dma_channel_get_default_config(ctrl_chan) ;
+    channel_config_set_transfer_data_size(&k, DMA_SIZE_32) ;
+    channel_config_set_read_increment(&k, true) ;
+    channel_config_set_write_increment(&k, true) ;
+    channel_config_set_ring(&k, true, 4) ;                  // 4 words
+    dma_channel_configure(ctrl_chan, &k, &dma_hw->ch[data_chan].al1_ctrl, NULL, 4, false) ;
+}
+
+int keyer_add_tone(float freq, int hi, int lo) {
+    int i ;
+    // The same tone again is the same buffer
+    for (i=0; i<tones; i++) {
+        if ((wave_freq[i] == freq) && (wave_hi[i] == hi) && (wave_lo[i] == lo)) return i ;
+    }
+    int period = (int)((float)KEYER_RATE / freq + 0.5f) ;
+    if ((tones == KEYER_TONES) || (period < 2) || (period > KEYER_WAVE)) return -1 ;
+    if (hi > KEYER_MAX_LEVEL) hi = KEYER_MAX_LEVEL ;
+    if (lo < 0) lo = 0 ;
+
+    // As many whole cycles as fit, high for the first half of each
+    int len = (KEYER_WAVE / period) * period ;
+    for (i=0; i<len; i++) {
+        waves[tones][i] = ((i % period) < (period >> 1)) ? hi : lo ;
+    }
+    wave_len[tones] = len ;
+    wave_freq[tones] = freq ;
+    wave_hi[tones] = hi ;
+    wave_lo[tones] = lo ;
+    return tones++ ;
+}
+
+void keyer_begin(keyer_pattern * p) {
+    p->count = 0 ;
+    p->overflow = 0 ;
+}
+
+// Add a block, saving the last slot for keyer_finish()
+static void addBlock(keyer_pattern * p, uint32_t ctrl, const void * from, uint32_t count) {
+    if (!count) return ;
+    if (p->count >= KEYER_MAX_BLOCKS - 1) {
+        p->overflow = 1 ;
+        return ;
+    }
+    keyer_block * b = &p->blocks[p->count++] ;
+    b->ctrl = ctrl ;
+    b->read_addr = from ;
+    b->write_addr = keyer_cc ;
+    b->trans_count = count ;
+}
+
+void keyer_level(keyer_pattern * p, int level, uint32_t ticks) {
+    if (level < 0) level = 0 ;
+    if (level > KEYER_MAX_LEVEL) level = KEYER_MAX_LEVEL ;
+    // The same level running on is one longer block
+    if (p->count && (p->blocks[p->count-1].read_addr == &levels[level])) {
+        p->blocks[p->count-1].trans_count += ticks ;
+        return ;
+    }
+    addBlock(p, level_ctrl, &levels[level], ticks) ;
+}
+
+void keyer_tone(keyer_pattern * p, int tone, uint32_t ticks) {
+    if ((tone < 0) || (tone >= tones)) return ;
+    uint32_t len = wave_len[tone] ;
+    for (; ticks > len; ticks -= len) addBlock(p, tone_ctrl, waves[tone], len) ;
+    addBlock(p, tone_ctrl, waves[tone], ticks) ;
+}
+
+// Morse for a character, or NULL
+static const char * morseCode(char ch) {
+    static const char * letters[26] = {
+        ".-", "-...", "-.-.", "-..", ".", "..-.", "--.", "....", "..", ".---",
+        "-.-", ".-..", "--", "-.", "---", ".--.", "--.-", ".-.", "...", "-",
+        "..-", "...-", ".--", "-..-", "-.--", "--.."
+    } ;
+    static const char * digits[10] = {
+        "-----", ".----", "..---", "...--", "....-",
+        ".....", "-....", "--...", "---..", "----."
+    } ;
+    ch = toupper((unsigned char)ch) ;
+    if ((ch >= 'A') && (ch <= 'Z')) return letters[ch - 'A'] ;
+    if ((ch >= '0') && (ch <= '9')) return digits[ch - '0'] ;
+    switch (ch) {
+    case '/': return "-..-." ;
+    case '.': return ".-.-.-" ;
+    case ',': return "--..--" ;
+    case '?': return "..--.." ;
+    case '=': return "-...-" ;
+    }
+    return NULL ;
+}
+
+void keyer_morse(keyer_pattern * p, const char * text, int wpm, int tone, int off_level) {
+    // A dit is 1.2 / wpm seconds (PARIS timing); a dah is 3, with 1
+    // between the parts of a letter, 3 between letters and 7 between words
+    uint32_t dit = (uint32_t)KEYER_RATE * 12 / (10 * wpm) ;
+    for (; *text; text++) {
+        if (*text == ' ') {
+            keyer_level(p, off_level, 4 * dit) ;    // 3 after the letter, so 7
+            continue ;
+        }
+        const char * code = morseCode(*text) ;
+        if (!code) continue ;
+        for (; *code; code++) {
+            keyer_tone(p, tone, (*code == '-') ? 3 * dit : dit) ;
+            keyer_level(p, off_level, dit) ;
+        }
+        keyer_level(p, off_level, 2 * dit) ;
+    }
+}
+
+void keyer_fsk(keyer_pattern * p, const uint8_t * bytes, int count, int baud, int mark, int space) {
+    // Bits end on the nearest tick of where they should, so the rate is
+    // right on average
+    uint64_t at = 0 ;
+    uint32_t done = 0 ;
+    for (int i=0; i<count; i++) {
+        uint32_t frame = 0x200 | ((uint32_t)bytes[i] << 1) ;   // start 0, stop 1
+        for (int bit=0; bit<10; bit++) {
+            at += KEYER_RATE ;
+            uint32_t end = (uint32_t)((at + baud / 2) / baud) ;
+            keyer_tone(p, ((frame >> bit) & 1) ? mark : space, end - done) ;
+            done = end ;
+        }
+    }
+}
+
+void keyer_finish(keyer_pattern * p, int loop) {
+    keyer_block * b = &p->blocks[p->count++] ;
+    if (loop) {
+        // Copy keyer_next into the control channel's read address (not a
+        // trigger), then chain to it, which starts it from there
+        b->ctrl = loop_ctrl ;
+        b->read_addr = (const void *)&keyer_next ;
+        b->write_addr = &dma_hw->ch[ctrl_chan].read_addr ;
+        b->trans_count = 1 ;
+    }
+    else {
+        // A null block: the control word turns the data channel off, and
+        // the zero count is a null trigger
+        memset(b, 0, sizeof(*b)) ;
+    }
+}
+
+int keyer_busy(void) {
+    return dma_channel_is_busy(data_chan) || dma_channel_is_busy(ctrl_chan) ;
+}
+
+int keyer_uses(const keyer_pattern * p) {
+    if (!keyer_busy()) return 0 ;
+    if (keyer_next == p->blocks) return 1 ;
+    uintptr_t at = dma_hw->ch[ctrl_chan].read_addr ;
+    return (at >= (uintptr_t)p->blocks) && (at <= (uintptr_t)&p->blocks[p->count]) ;
+}
+
+void keyer_start(keyer_pattern * p) {
+    // A one-shot pattern never gets to its end of loop, so it's cut short
+    if (!next_loops) keyer_stop(0) ;
+    next_loops = p->count && (p->blocks[p->count-1].ctrl == loop_ctrl) ;
+    keyer_next = p->blocks ;
+    // A looping pattern picks up keyer_next at the end of its loop
+    if (keyer_busy()) return ;
+    dma_channel_set_read_addr(ctrl_chan, p->blocks, true) ;
+}
+
+void keyer_stop(int level) {
+    dma_channel_abort(ctrl_chan) ;
+    dma_channel_abort(data_chan) ;
+    keyer_next = NULL ;
+    next_loops = 0 ;
+    // Both halves, as the DMA writes them
+    *(volatile uint32_t *)keyer_cc = ((uint32_t)level << 16) | level ;
+}
@@ -0,0 +1,101 @@
+/**
+ * DMA keying sequencer for a PWM transmitter
+ *
+ * A keying pattern (Morse, FSK, or any run of tones and steady levels) is
+ * compiled into a list of DMA control blocks, and played with no CPU at
+ * all: a data channel writes PWM levels into the slice's compare
+ * register, paced by a DMA timer at KEYER_RATE, and a control channel
+ * loads the data channel with each block in turn (its control word,
+ * source, destination and length, as in the SDK's control_blocks
+ * example). A steady level is one block however long it lasts, reading
+ * one level over and over; a tone reads a buffer of whole cycles of a
+ * square wave, a block per buffer.
+ *
+ * A looping pattern ends with a block that copies keyer_next into the
+ * control channel's read address, so the control channel goes back to
+ * the start. keyer_start() on a new pattern while one is looping just
+ * changes keyer_next, so the change happens at the end of the loop, with
+ * no gap.
+ *
+ * USE
+ *  - keyer_init(slice) claims the DMA channels and timer. Levels are
+ *    16-bit writes to the slice's compare register, which the bus copies
+ *    to both halves, so both the slice's channels get them.
+ *  - keyer_add_tone(freq, hi, lo) makes a square-wave tone between two
+ *    levels, and returns its handle (or -1 if there's no room)
+ *  - keyer_begin(&p), then keyer_level(), keyer_tone(), keyer_morse()
+ *    or keyer_fsk() to add to it, and keyer_finish(&p, loop)
+ *  - keyer_start(&p) plays it: next, if a looping pattern is playing,
+ *    or at once, cutting short one that doesn't loop. keyer_stop(level)
+ *    stops at once, leaving the PWM at level.
+ *  - A pattern mustn't be changed while it's playing, or queued to play
+ *    next (keyer_uses() says): build into a second one, and alternate
+ *
+ * Durations are in ticks of KEYER_RATE (keyer_ms() converts). Tones are
+ * rounded to a whole number of ticks per cycle.
+ *
+ * RESOURCES USED
+ *  - 2 DMA channels and a DMA timer (claimed from lib/hw_claim)
+ *
+ */
+#include <stdint.h>
+#include "hardware/pwm.h"
+
+// Ticks per second: the rate levels are written to the PWM
+#ifndef KEYER_RATE
+#define KEYER_RATE 50000
+#endif
+
+// Tones at once, and the most ticks of whole cycles each one keeps
+#ifndef KEYER_TONES
+#define KEYER_TONES 4
+#endif
+#ifndef KEYER_WAVE
+#define KEYER_WAVE 1024
+#endif
+
+// Blocks in a pattern
+#ifndef KEYER_MAX_BLOCKS
+#define KEYER_MAX_BLOCKS 512
+#endif
+
+// Highest PWM level a pattern uses
+#define KEYER_MAX_LEVEL 255
+
+#define keyer_ms(ms) ((uint32_t)((ms) * (KEYER_RATE / 1000)))
+
+// One DMA control block: the data channel's alias 1 registers
+typedef struct {
+    uint32_t ctrl ;
+    const void * read_addr ;
+    volatile void * write_addr ;
+    uint32_t trans_count ;
+} keyer_block ;
+
+typedef struct {
+    int count ;
+    char overflow ;         // blocks didn't fit, and were dropped
+    keyer_block blocks[KEYER_MAX_BLOCKS] ;
+} keyer_pattern ;
+
+void keyer_init(uint slice) ;
+int keyer_add_tone(float freq, int hi, int lo) ;
+
+void keyer_begin(keyer_pattern * p) ;
+// A steady level, or a tone, for ticks
+void keyer_level(keyer_pattern * p, int level, uint32_t ticks) ;
+void keyer_tone(keyer_pattern * p, int tone, uint32_t ticks) ;
+// Morse for text (letters, digits and / . , ? =), at wpm words a minute:
+// key down is tone, and key up (and the gaps) level off_level
+void keyer_morse(keyer_pattern * p, const char * text, int wpm, int tone, int off_level) ;
+// Bytes as asynchronous serial (a start bit, 8 bits from the lowest, a
+// stop bit) at baud, mark (1) on one tone and space (0) on another
+void keyer_fsk(keyer_pattern * p, const uint8_t * bytes, int count, int baud, int mark, int space) ;
+// The last block: back to the start (loop), or stop
+void keyer_finish(keyer_pattern * p, int loop) ;
+
+void keyer_start(keyer_pattern * p) ;
+void keyer_stop(int level) ;
+// 1 while a pattern is playing, and while p is playing or queued
+int keyer_busy(void) ;
+int keyer_uses(const keyer_pattern * p) ;
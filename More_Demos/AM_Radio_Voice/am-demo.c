@@ -1,25 +1,46 @@
 /**
  * V. Hunter Adams (vha3@cornell.edu)
- * 
+ *
  * AM Radio transmission with PWM
- * 
+ *
  * This demonstration uses a PWM channel
  * to generate an AM radio transmission modulated
  * by an ADC input. Tune your radio to 980kHz.
- * 
+ *
+ * The audio goes through a streaming pipeline, paced by the hardware
+ * from end to end:
+ *  - The ADC captures at Fs into a ping-pong buffer (a sample channel,
+ *    and a control channel that points it at each half in turn). Each
+ *    finished half raises DMA_IRQ_0 on core 1.
+ *  - Core 1 takes each half through the fixed-point stages: DC removal
+ *    (a one-pole high-pass), AGC (a peak envelope, with the gain ramped
+ *    across each block so it doesn't click), and a 4x polyphase FIR
+ *    interpolator (lib/fix_filter's, designed in CMakeLists.txt). Each
+ *    output sample is turned into a PWM level, with the rounding error
+ *    carried into the next one (first-order noise shaping), so the 8-bit
+ *    duty averages to finer steps than it has.
+ *  - A DMA timer at 4 Fs paces a second pair of channels that stream the
+ *    levels into the PWM compare register, half a buffer at a time, as
+ *    in lib/dds_audio
+ * The ADC clock (48 MHz, from the USB PLL) and the system clock (250 MHz)
+ * both come from the crystal, so the two rates stay exactly 1:4.
+ *
  * HARDWARE CONNECTIONS
  *   - GPIO 4 ---> PWM output
- *   - GPIO 25 --> ADC input
- * 
+ *   - GPIO 26 --> ADC input
+ *
  * RESOURCES CONSUMED
  *   - ADC
- *   - 2 DMA channels
+ *   - 4 DMA channels and a DMA timer (claimed from lib/hw_claim)
+ *   - DMA_IRQ_0, on core 1
  *   - 1 PWM channel
- * 
+ *   - Core 1 (the filters)
+ *
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 
 #include "pico/stdlib.h"
 #include "pico/multicore.h"
@@ -27,12 +48,18 @@
 #include "hardware/pwm.h"
 #include "hardware/dma.h"
 #include "hardware/adc.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hw_claim.h"
+#include "fix_filter.h"
+#include "am_interp.h"
 
 // PWM wrap value and clock divide value
 // For a CPU rate of 250 MHz, this gives
 // a PWM frequency of ~980kHz
 #define WRAPVAL 255
 #define CLKDIV 1.0f
+#define SYSCLK 250000000
 
 // ADC Mux input 0, on GPIO 26
 // Sample rate of 10KHz, ADC clock rate of 48MHz
@@ -44,27 +71,168 @@
 // PWM pin
 #define PWM_PIN 4
 
+// Samples per capture block (half the ping-pong buffer), and output
+// samples per input sample (the interpolator's factor)
+#define BLOCK 64
+#define UPSAMPLE AM_INTERP_FACTOR
+
+// DC tracking: the input's mean moves 1/2^DC_SHIFT of the way toward
+// each sample (a corner of about Fs / (2 pi 2^DC_SHIFT), 2 Hz here)
+#define DC_SHIFT 10
+
+// AGC: the peaks are brought to AGC_TARGET (of +/-2048, full
+// modulation), with at most AGC_MAX_GAIN of gain so silence stays quiet.
+// The envelope follows a louder peak at once, and falls back by
+// 1/2^AGC_RELEASE_SHIFT of the way per block (about 100 ms).
+#define AGC_TARGET 1536
+#define AGC_MAX_GAIN 16
+#define AGC_RELEASE_SHIFT 4
+
 
 // Variable to hold PWM slice number
 uint slice_num ;
 
+// DMA channels and the DMA timer, claimed in main
+int sample_chan, control_chan ;
+int out_chan, out_control_chan ;
+int out_timer ;
+
+// Capture ping-pong buffer (12-bit samples), and the ring of its halves'
+// addresses for the control channel (aligned to its size for the ring)
+uint16_t capture[2][BLOCK] ;
+uint16_t * capture_ring[2] __attribute__((aligned(8))) ;
+
+// PWM levels, the same for the output (one 32-bit compare register write
+// each: channel A in the low half)
+uint32_t duty[2][BLOCK * UPSAMPLE] ;
+uint32_t * duty_ring[2] __attribute__((aligned(8))) ;
+
+// Blocks captured (DMA interrupt), filtered (core 1), and filtered
+// after they should have started playing
+volatile unsigned int blocks_captured = 0 ;
+volatile unsigned int blocks_done = 0 ;
+volatile unsigned int blocks_late = 0 ;
+
+// The interpolator (a windowed-sinc lowpass at the input's Nyquist, each
+// phase scaled to a gain of 1, so the levels between the input samples
+// come out as loud as those on them) and its delay line
+fix_fir interpolator ;
+int16_t interp_delay[AM_INTERP_DELAY] ;
+
+// Filter state: the input's mean (Q16), the AGC envelope and gain (Q8),
+// and the rounding error carried between levels (Q8)
+int dc_q16 = 2048 << 16 ;
+int envelope = AGC_TARGET / AGC_MAX_GAIN ;
+volatile int gain_q8 = AGC_MAX_GAIN << 8 ;
+int duty_error = 0 ;
+
+// A block after the AGC, and after the interpolator
+int16_t x[BLOCK] ;
+int16_t upsampled[BLOCK * UPSAMPLE] ;
+
+// Core 1 time per block (us), for the report
+volatile unsigned int filter_us = 0 ;
+
+// Filter one captured block into one block of PWM levels
+void filterBlock(const uint16_t * in, uint32_t * out) {
+    int i ;
+
+    // DC removal, and the block's peak
+    int peak = 0 ;
+    for (i=0; i<BLOCK; i++) {
+        int s = ((int)in[i] << 16) - dc_q16 ;
+        dc_q16 += s >> DC_SHIFT ;
+        x[i] = s >> 16 ;
+        if (abs(x[i]) > peak) peak = abs(x[i]) ;
+    }
+
+    // AGC: the gain for this block's envelope (one division a block),
+    // ramped to from the last block's over the block
+    if (peak > envelope) envelope = peak ;
+    else envelope -= (envelope - peak) >> AGC_RELEASE_SHIFT ;
+    if (envelope < AGC_TARGET / AGC_MAX_GAIN) envelope = AGC_TARGET / AGC_MAX_GAIN ;
+    int target_q8 = (AGC_TARGET << 8) / envelope ;
+    int g = gain_q8 << 6 ;                              // Q14, for the ramp
+    int step = ((target_q8 << 6) - g) / BLOCK ;
+    for (i=0; i<BLOCK; i++) {
+        g += step ;
+        int s = (x[i] * (g >> 6)) >> 8 ;
+        x[i] = (s > 2047) ? 2047 : (s < -2048) ? -2048 : s ;
+    }
+    gain_q8 = target_q8 ;
+
+    // Interpolate, then make each output a PWM level about the middle, in
+    // Q8, with the last one's rounding error added on before rounding
+    // again
+    fix_interp_block(&interpolator, x, upsampled, BLOCK) ;
+    for (i=0; i<BLOCK*UPSAMPLE; i++) {
+        int level_q8 = ((WRAPVAL + 1) << 7) + ((upsampled[i] * (WRAPVAL + 1)) >> 4) + duty_error ;
+        int level = level_q8 >> 8 ;
+        if (level < 0) level = 0 ;
+        if (level > WRAPVAL) level = WRAPVAL ;
+        duty_error = level_q8 - (level << 8) ;
+        // Past the ends the error can't be taken back, so drop it
+        if ((duty_error > 255) || (duty_error < 0)) duty_error = 0 ;
+        *out++ = level ;
+    }
+}
 
-// Array for shuffling ADC sample
-unsigned char new_duty[4] = {64, 0, 0, 0} ;
+// Count each finished capture block. The output starts as block 1
+// finishes, a block behind the capture: block n then plays from when
+// block n + 1 is captured, and the half it goes to has just finished
+// playing block n - 2.
+void capture_irq_handler() {
+    // DMA_IRQ_0 may be shared, so check that it's ours
+    if (dma_hw->ints0 & (1u << sample_chan)) {
+        dma_hw->ints0 = 1u << sample_chan ;
+        blocks_captured++ ;
+        if (blocks_captured == 2) dma_start_channel_mask(1u << out_control_chan) ;
+    }
+}
 
+// Core 1: filter each block as it's captured. Block n goes to half n & 1
+// of the output, which starts playing it one block time after it was
+// captured, so every block (the first too) has one block time to be
+// filtered. One that takes longer is counted late.
+void core1_entry() {
+    // Finished blocks interrupt this core
+    dma_channel_set_irq0_enabled(sample_chan, true) ;
+    irq_add_shared_handler(DMA_IRQ_0, capture_irq_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY) ;
+    irq_set_enabled(DMA_IRQ_0, true) ;
+
+    // Start the capture channels (before the ADC!), then the ADC
+    dma_start_channel_mask(1u << control_chan) ;
+    adc_run(true) ;
+
+    while (true) {
+        while (blocks_done == blocks_captured) tight_loop_contents() ;
+
+        uint32_t begin = time_us_32() ;
+        unsigned int n = blocks_done ;
+        filterBlock(capture[n & 1], duty[n & 1]) ;
+        filter_us = time_us_32() - begin ;
+        blocks_done = n + 1 ;
+
+        // Block n should have started playing when block n + 1 was
+        // captured
+        if (blocks_captured > n + 1) blocks_late++ ;
+    }
+}
 
 int main() {
 
     // Overclock to 250MHz
-    set_sys_clock_khz(250000, true);
+    set_sys_clock_khz(SYSCLK / 1000, true);
 
     // Initialize stdio
     stdio_init_all();
 
+    fix_fir_init(&interpolator, &am_interp, interp_delay) ;
+
     ////////////////////////////////////////////////////////////////////////
     ///////////////////////// PWM CONFIGURATION ////////////////////////////
     ////////////////////////////////////////////////////////////////////////
-    // Tell GPIO 4 that it is allocated to the PWM, max slew rate and 
+    // Tell GPIO 4 that it is allocated to the PWM, max slew rate and
     // drive strength
     gpio_set_function(PWM_PIN, GPIO_FUNC_PWM);
     gpio_set_drive_strength(PWM_PIN, 3);
@@ -101,8 +269,8 @@ int main() {
         true,    // Write each completed conversion to the sample FIFO
         true,    // Enable DMA data request (DREQ)
         1,       // DREQ (and IRQ) asserted when at least 1 sample present
-        false,   // We won't see the ERR bit because of 8 bit reads; disable.
-        true     // Shift each sample to 8 bits when pushing to FIFO
+        false,   // No ERR bit
+        false    // Keep all 12 bits of each sample
     );
 
     // Divisor of 0 -> full speed. Free-running capture with the divider is
@@ -111,27 +279,36 @@ int main() {
     // cycles, so in general you want a divider of 0 (hold down the button
     // continuously) or > 95 (take samples less frequently than 96 cycle
     // intervals). This is all timed by the 48 MHz ADC clock. This is setup
-    // to grab a sample at 10kHz (48Mhz/10kHz - 1)
-    adc_set_clkdiv(ADCCLK/Fs);
+    // to grab a sample at exactly 10kHz (48Mhz/10kHz - 1), so the output
+    // timer keeps in step
+    adc_set_clkdiv(ADCCLK/Fs - 1);
 
     ///////////////////////////////////////////////////////////////////////
     // ============================== DMA CONFIGURATION ===================
     ///////////////////////////////////////////////////////////////////////
-    
-    // DMA channels for sampling ADC. Using 2 and 3 in case I want to add
-    // the VGA driver to this project
-    int sample_chan = 2 ;
-    int control_chan = 3 ;
+
+    // DMA channels for sampling the ADC and for the PWM levels, claimed
+    // from lib/hw_claim (in case I want to add the VGA driver to this project)
+    sample_chan = hw_claim_dma("am_demo") ;
+    control_chan = hw_claim_dma("am_demo") ;
+    out_chan = hw_claim_dma("am_demo") ;
+    out_control_chan = hw_claim_dma("am_demo") ;
+    out_timer = hw_claim_dma_timer("am_demo") ;
+
+    capture_ring[0] = capture[0] ;
+    capture_ring[1] = capture[1] ;
+    duty_ring[0] = duty[0] ;
+    duty_ring[1] = duty[1] ;
 
     // Channel configurations (start with the default)
     dma_channel_config c2 = dma_channel_get_default_config(sample_chan);
     dma_channel_config c3 = dma_channel_get_default_config(control_chan);
 
     // Setup the ADC sample channel
-    // Reading from constant address, in 8-bit chunks, writing to constant address
-    channel_config_set_transfer_data_size(&c2, DMA_SIZE_8);
+    // Reading from constant address, in 16-bit chunks, into a block
+    channel_config_set_transfer_data_size(&c2, DMA_SIZE_16);
     channel_config_set_read_increment(&c2, false);
-    channel_config_set_write_increment(&c2, false);
+    channel_config_set_write_increment(&c2, true);
     // Pace transfers based on availability of ADC samples
     channel_config_set_dreq(&c2, DREQ_ADC);
     // Chain to control channel
@@ -139,33 +316,73 @@ int main() {
     // Configure the channel
     dma_channel_configure(sample_chan,
         &c2,                // channel config
-        &new_duty[0],       // dst
+        capture[0],         // dst
         &adc_hw->fifo,      // src
-        1,                  // transfer count
+        BLOCK,              // transfer count
         false               // don't start immediately
     );
 
-    // Setup the control channel
+    // Setup the control channel (hands the sample channel each half)
     channel_config_set_transfer_data_size(&c3, DMA_SIZE_32);  // 32-bit txfers
-    channel_config_set_read_increment(&c3, false);            // no read incrementing
+    channel_config_set_read_increment(&c3, true);             // step through the halves
+    channel_config_set_ring(&c3, false, 3);                   // and wrap (2 words)
     channel_config_set_write_increment(&c3, false);           // no write incrementing
     channel_config_set_chain_to(&c3, sample_chan);            // chain to sample chan
 
     dma_channel_configure(
-        control_chan,                  // Channel to be configured
-        &c3,                           // The configuration we just created
+        control_chan,                         // Channel to be configured
+        &c3,                                  // The configuration we just created
+        &dma_hw->ch[sample_chan].write_addr,  // Write address (sample channel write address)
+        &capture_ring[0],                     // Read address (ring of block addresses)
+        1,                                    // Number of transfers
+        false                                 // Don't start immediately
+    );
+
+    // Output channel: one level per tick of the DMA timer, at UPSAMPLE Fs
+    // (exactly: the system clock over a 16-bit fraction)
+    dma_timer_set_fraction(out_timer, 1, SYSCLK / (Fs * UPSAMPLE)) ;
+
+    dma_channel_config c4 = dma_channel_get_default_config(out_chan);
+    channel_config_set_transfer_data_size(&c4, DMA_SIZE_32);            // 32-bit txfers
+    channel_config_set_read_increment(&c4, true);                       // through the levels
+    channel_config_set_write_increment(&c4, false);                     // no write incrementing
+    channel_config_set_dreq(&c4, dma_get_timer_dreq(out_timer));        // paced by the DMA timer
+    channel_config_set_chain_to(&c4, out_control_chan);                 // chain to control channel
+
+    dma_channel_configure(
+        out_chan,                      // Channel to be configured
+        &c4,                           // The configuration we just created
         &pwm_hw->slice[slice_num].cc,  // Write address (PWM counter compare reg)
-        &new_duty[0],                  // Read address (where the other DMA put the data)
-        1,                             // Number of transfers
+        duty[0],                       // The initial read address
+        BLOCK * UPSAMPLE,              // Number of transfers; one block of levels
         false                          // Don't start immediately
     );
 
-    // Start the DMA channel (before the ADC!)
-    dma_start_channel_mask(1u << sample_chan) ;
+    // Output control channel (hands the output channel each half)
+    dma_channel_config c5 = dma_channel_get_default_config(out_control_chan);
+    channel_config_set_transfer_data_size(&c5, DMA_SIZE_32);            // 32-bit txfers
+    channel_config_set_read_increment(&c5, true);                       // step through the halves
+    channel_config_set_ring(&c5, false, 3);                             // and wrap (2 words)
+    channel_config_set_write_increment(&c5, false);                     // no write incrementing
 
-    // Start the ADC
-    adc_run(true) ;
+    dma_channel_configure(
+        out_control_chan,                        // Channel to be configured
+        &c5,                                     // The configuration we just created
+        &dma_hw->ch[out_chan].al3_read_addr_trig,// Write address (output read address trigger)
+        &duty_ring[0],                           // Read address (ring of block addresses)
+        1,                                       // Number of transfers
+        false                                    // Don't start immediately
+    );
+
+    // Core 1 takes the capture interrupt, starts the capture and filters
+    multicore_launch_core1(core1_entry) ;
 
-    // Exit main :)
+    // Report on the pipeline once a second
+    while (true) {
+        sleep_ms(1000) ;
+        printf("blocks %u, late %u, filter %u us of %u, gain %.2f\n",
+               blocks_done, blocks_late, filter_us, (unsigned int)(BLOCK * 1000000 / Fs),
+               gain_q8 / 256.0f) ;
+    }
 
 }
@@ -3,6 +3,16 @@
  * 
  * CAN Transciever test code
  * 
+ * Boots (and whether the watchdog caused them) and the counts once a
+ * second are logged to flash (lib/flash_log), and the log from before
+ * is summed up at startup, so what happened before a reboot isn't lost.
+ * The demo is built copy_to_ram (CMakeLists.txt), so nothing runs from
+ * flash and neither core's interrupts stop while the log is written.
+ * The log is written from core 1, by a thread beside the send thread: a
+ * sector erase (every 4 kB of log) holds up core 1's threads for tens of
+ * ms, while the CAN interrupts on both cores, and core 0's receive
+ * thread, carry on.
+ * 
  */
 
 // Standard C libraries
@@ -18,6 +28,8 @@
 #include "can_driver.h"
 // Protothreads
 #include "pt_cornell_rp2040_v1.h"
+// Flash logging
+#include "flash_log.h"
 
 
 //                                   USER GLOBALS
@@ -27,43 +39,80 @@ volatile int number_sent = 0 ;
 volatile int number_received = 0 ;
 volatile int number_missed = 0 ;
 
-// Flag for indicating that it is unsafe to transmit
-volatile int unsafe_to_tx = 1 ;
+// Log record types (FLASH_LOG_BOOT is the logger's own)
+#define LOG_COUNTS 1
+typedef struct {
+    int sent, received, missed ;
+} log_counts ;
 
 
 
 //                        USER INTERRUPT SERVICE ROUTINES
 //
-// ISR entered at the end of packet transmit.
-void tx_handler() {
+// ISR entered at the end of packet transmit. Starts the next queued packet.
+// The ISRs, and the driver functions they call, run from RAM (hotpath.h).
+void HOT_ISR(tx_handler)() {
     // Abort/reset DMA channel, clear FIFO, clear PIO irq
     resetTransmitter() ;
     // Toggle the LED
     gpio_put(LED_PIN, !gpio_get(LED_PIN)) ;
     // Increment number of messages sent
     number_sent += 1 ;
-    // Signal to thread that it is safe to transmit
-    unsafe_to_tx = 0 ;
 }
 // ISR entered when a packet is available for attempted receipt.
-void rx_handler() {
-    // Abort/reset DMA channel
+void HOT_ISR(rx_handler)() {
+    // Abort/reset DMA channel, queueing the packet if it passes the filters
     resetReceiver() ;
-    // Attempt packet receipt
-    if (attemptPacketReceive()) {
-        // Increment number of messages received
-        number_received += 1 ;
-    }
-    // Count number of rejected packets
-    else {
-        number_missed += 1 ;
-    }
     // Clear the interrupt to receive the next message
     acceptNewPacket() ;
 }
 
 
 
+//                                  BUS STATISTICS
+//
+// Print the driver's counters, and the nonzero bins of the RX latency
+// histogram (each labelled with its upper bound)
+void printStats() {
+    can_stats stats ;
+    int i ;
+    canGetStats(&stats, 0) ;
+    printf("TX: %u sent, %u arbitration lost, %u queue full, queue high %u\n",
+            stats.tx_packets, stats.tx_arbitration_lost, stats.tx_queue_full, stats.tx_queue_high) ;
+    printf("RX: %u valid, %u filtered, %u overflowed, %u DMA overruns, queue high %u\n",
+            stats.rx_packets, stats.rx_filtered, stats.rx_overflows, stats.rx_dma_overruns,
+            stats.rx_queue_high) ;
+    printf("RX errors: %u length, %u stuffing, %u checksum\n",
+            stats.rx_length_errors, stats.rx_stuff_errors, stats.rx_crc_errors) ;
+    printf("RX latency (max %uus):", stats.rx_latency_max) ;
+    for (i=0; i<CAN_LATENCY_BINS; i++) {
+        if (stats.rx_latency[i]) printf(" <%uus:%u", 1u<<i, stats.rx_latency[i]) ;
+    }
+    printf("\n\n") ;
+}
+// Sum up the log (from before this boot, until protothread_log runs)
+void printLog() {
+    flash_log_reader r ;
+    flash_log_record rec ;
+    log_counts last = {0, 0, 0} ;
+    int boots = 0, watchdog_boots = 0, records = 0 ;
+    flash_log_read_start(&r) ;
+    while (flash_log_read_next(&r, &rec)) {
+        records++ ;
+        if ((rec.type == FLASH_LOG_BOOT) && (rec.len == 1)) {
+            boots++ ;
+            watchdog_boots += rec.data[0] ;
+        }
+        else if ((rec.type == LOG_COUNTS) && (rec.len == sizeof(last))) {
+            memcpy(&last, rec.data, sizeof(last)) ;
+        }
+    }
+    printf("Log: %d records, %d boots (%d by the watchdog)\n", records, boots, watchdog_boots) ;
+    printf("Last logged: %d sent, %d received, %d rejected\n\n", last.sent, last.received, last.missed) ;
+}
+
+
+
 //                                 THREADS (USER CODE)
 //
 // Thread runs on core 1.
@@ -79,13 +128,13 @@ static PT_THREAD (protothread_send(struct pt *pt))
       while(1) {
         // If packets remain . . .
         if (number_to_send) {
-            // Indicate that it is unsafe to transmit
-            unsafe_to_tx = 1 ;
-            // Send a packet
-            sendPacket() ;
+            // Queue a packet, yielding while the mailboxes are full
+            while (!sendPacket()) {
+                PT_YIELD(pt) ;
+            }
             // Decrement the remaining number of packets to send ;
             number_to_send -= 1 ;
-            // Randomize the payload WHILE previous packet is being sent
+            // Randomize the payload (the queued packet has its own copy)
             payload[0] = rand()&0b0111111111111111 ;
             payload[1] = rand()&0b0111111111111111 ;
             payload[2] = rand()&0b0111111111111111 ;
@@ -95,21 +144,41 @@ static PT_THREAD (protothread_send(struct pt *pt))
             if (((number_to_send+1) % 1000)==0) {
                 printf("Sent: %d\n", number_sent) ;
                 printf("Received: %d\n", number_received) ;
-                printf("Rejected: %d\n\n", number_missed) ;
+                printf("Rejected: %d\n", number_missed) ;
+                printStats() ;
             }
-            // Wait until it's safe to send again
-            while(unsafe_to_tx) {} ;
         }
         // If no packets remain, print some data
         else {
             sleep_ms(500) ;
             printf("Number sent: %d\n", number_sent) ;
             printf("Number received: %d\n", number_received) ;
-            printf("Number rejected: %d\n\n", number_missed) ;
+            printf("Number rejected: %d\n", number_missed) ;
+            printStats() ;
         }
       } 
   PT_END(pt);
 }
+// Thread runs on core 0. Checks the packets queued by rx_handler.
+static PT_THREAD (protothread_receive(struct pt *pt))
+{
+    PT_BEGIN(pt);
+
+      while(1) {
+        // Wait for a packet
+        PT_YIELD_UNTIL(pt, canPacketsWaiting()) ;
+        // Attempt packet receipt
+        if (attemptPacketReceive()) {
+            // Increment number of messages received
+            number_received += 1 ;
+        }
+        // Count number of rejected packets
+        else {
+            number_missed += 1 ;
+        }
+      }
+  PT_END(pt);
+}
 // Thread runs on core 0
 static PT_THREAD (protothread_watchdog(struct pt *pt))
 {
@@ -120,11 +189,30 @@ static PT_THREAD (protothread_watchdog(struct pt *pt))
     watchdog_enable(1000, 1);
 
       while(1) {
-        sleep_ms(100) ;
+        // Yield (rather than sleep) so that the receive thread keeps up
+        PT_YIELD_usec(100000) ;
         watchdog_update();
       } 
   PT_END(pt);
 }
+// Thread runs on core 1, away from the receive thread. Logs the counts
+// once a second, and writes the log to flash.
+static PT_THREAD (protothread_log(struct pt *pt))
+{
+    PT_BEGIN(pt);
+
+    static uint32_t last_log = 0 ;
+      while(1) {
+        PT_YIELD_usec(10000) ;
+        if ((time_us_32() - last_log) >= 1000000) {
+            last_log = time_us_32() ;
+            log_counts counts = {number_sent, number_received, number_missed} ;
+            flash_log_write(LOG_COUNTS, &counts, sizeof(counts)) ;
+        }
+        flash_log_service() ;
+      } 
+  PT_END(pt);
+}
 
 
 
@@ -134,8 +222,9 @@ static PT_THREAD (protothread_watchdog(struct pt *pt))
 void core1_main() {
     // CAN transmitter will run on core 1
     setupCANTX(tx_handler) ;
-    // Add the send thread
+    // Add the send thread, and the one that writes the log
     pt_add_thread(protothread_send) ;
+    pt_add_thread(protothread_log) ;
     // Start the threader
     pt_schedule_start ;
 }
@@ -156,6 +245,11 @@ int main() {
     // Print greeting
     printf("System starting up\n\n") ;
 
+    // Start the log (its boot record for this time waits in SRAM), and
+    // sum up what was logged before
+    flash_log_init() ;
+    printLog() ;
+
     // Initialize LED
     gpio_init(LED_PIN) ;
     gpio_set_dir(LED_PIN, GPIO_OUT) ;
@@ -168,7 +262,8 @@ int main() {
     // Setup the CAN receiver on core 0
     setupCANRX(rx_handler) ;
 
-    // Add thread to scheduler, and start it
+    // Add threads to scheduler, and start it
+    pt_add_thread(protothread_receive) ;
     pt_add_thread(protothread_watchdog) ;
     pt_schedule_start ;
 }
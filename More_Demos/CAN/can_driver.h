@@ -3,11 +3,22 @@
  * 
  * CAN driver code
  * 
+ * Resources utilized (claimed from lib/hw_claim as they're set up)
+ * - 2 state machines on PIO block 0 (TX and idle check), and 1 on
+ *   PIO block 1 (RX)
+ * - 4 DMA channels
+ * - PIO 0 IRQ flags 0 and 3, PIO0_IRQ_0 and PIO0_IRQ_1 (TX), PIO 0 IRQ
+ *   flags 6 and 7 (between the TX and idle check machines), PIO 1 IRQ
+ *   flag 0 and PIO1_IRQ_0 (RX), and DMA_IRQ_0
+ * 
  */
 
 // Includes
 #include "hardware/pio.h"
 #include "hardware/dma.h"
+#include "hardware/timer.h"
+#include "hotpath.h"
+#include "hw_claim.h"
 #include "can.pio.h"
 #include "can_parameters.h"
 
@@ -24,14 +35,61 @@
 
 //          OTHER BUFFERS FOR STORING STUFFED/UNSTUFFED PACKETS FOR TX/RX
 //
-// Assembled packet for transmission (unstuffed then stuffed)
+// Assembled packet for transmission (unstuffed, then stuffed into a mailbox)
 unsigned short tx_packet_unstuffed[MAX_PACKET_LEN>>1] = {0} ;
-unsigned short tx_packet_stuffed[MAX_STUFFED_PACKET_LEN>>1] = {0} ;
-unsigned short * tx_packet_stuffed_pointer = &tx_packet_stuffed[0] ;
 
-// Buffer for received packets (stuffed then unstuffed)
-unsigned char rx_packet_stuffed[MAX_STUFFED_PACKET_LEN] = {0} ;
-unsigned char * rx_packet_stuffed_pointer = &rx_packet_stuffed[0] ;
+// TX mailboxes. Each holds a stuffed packet that is waiting to be sent (or
+// being sent). When the transmitter comes free, it takes the waiting packet
+// with the lowest arbitration value (the one that would win arbitration on
+// the bus), the oldest first among equal values.
+enum {TX_FREE, TX_READY, TX_SENDING} ;
+typedef struct {
+    unsigned short stuffed[MAX_STUFFED_PACKET_LEN>>1] ;
+    unsigned short arbitration ;
+    unsigned int order ;                // queueing order
+    volatile unsigned char state ;      // TX_FREE, TX_READY or TX_SENDING
+} can_mailbox ;
+can_mailbox tx_mailboxes[CAN_TX_MAILBOXES] ;
+unsigned int tx_order = 0 ;
+// Mailbox being sent, or -1
+volatile int tx_sending = -1 ;
+unsigned short * tx_packet_stuffed_pointer = &tx_mailboxes[0].stuffed[0] ;
+
+// Ring of buffers for received (stuffed) packets. The DMA channel fills
+// the one at rx_head, and those from rx_tail up to it wait to be unstuffed
+// and checked by attemptPacketReceive.
+unsigned char rx_ring[CAN_RX_BUFFERS][MAX_STUFFED_PACKET_LEN] = {0} ;
+unsigned char * rx_packet_stuffed_pointer = &rx_ring[0][0] ;
+volatile unsigned int rx_head = 0 ;
+volatile unsigned int rx_tail = 0 ;
+// When each buffer's packet ended (us)
+unsigned int rx_time[CAN_RX_BUFFERS] ;
+
+
+//                               BUS STATISTICS
+//
+// Counted by the driver as it goes. Each count is kept by one core (TX on
+// the TX core, RX on the RX core). CAN_LATENCY_BINS bins the time from the
+// end of a packet (the RX ISR) to attemptPacketReceive: bin 0 is under 1us
+// and bin n is 2^(n-1) to 2^n - 1 us, with the last bin taking the rest.
+typedef struct {
+    unsigned int tx_packets ;           // packets sent
+    unsigned int tx_arbitration_lost ;  // times another node won arbitration
+    unsigned int tx_queue_full ;        // packets refused by canQueuePacket
+    unsigned int tx_queue_high ;        // most mailboxes in use at once
+    unsigned int rx_packets ;           // valid packets received
+    unsigned int rx_filtered ;          // turned away by the acceptance filters
+    unsigned int rx_overflows ;         // turned away for want of a buffer
+    unsigned int rx_dma_overruns ;      // longer than a buffer (see dma_handler)
+    unsigned int rx_length_errors ;     // payload length over MAX_PAYLOAD_SIZE
+    unsigned int rx_stuff_errors ;      // a stuff bit of the wrong polarity
+    unsigned int rx_crc_errors ;        // checksum mismatch
+    unsigned int rx_queue_high ;        // most packets waiting at once
+    unsigned int rx_latency_max ;       // worst RX ISR to attemptPacketReceive (us)
+    unsigned int rx_latency[CAN_LATENCY_BINS] ;
+} can_stats ;
+
+volatile can_stats can_bus_stats ;
 
 // For re-initializing these buffers
 unsigned char zero_packet[MAX_STUFFED_PACKET_LEN] = {0} ;
@@ -43,213 +101,180 @@ unsigned char zero_packet[MAX_STUFFED_PACKET_LEN] = {0} ;
 // Our PIO blocks
 PIO pio_0 = pio0 ;
 PIO pio_1 = pio1 ;
-// Our state machines
-int can_tx_sm         = 0 ;
-int can_idle_check_sm = 1 ;
-int can_rx_sm         = 0 ;
-// Select dma channels
-int dma_chan_0  = 0 ;
-int dma_chan_1  = 1 ;
-int dma_chan_2  = 2 ;
-int dma_chan_3  = 3 ;
-int dma_chan_4  = 4 ;
+// Our state machines and dma channels (claimed by the setup functions)
+int can_tx_sm         = -1 ;
+int can_idle_check_sm = -1 ;
+int can_rx_sm         = -1 ;
+int dma_chan_0  = -1 ;
+int dma_chan_1  = -1 ;
+int dma_chan_2  = -1 ;
+int dma_chan_3  = -1 ;
 // Dummy DMA source/destination for chained channel
 unsigned int dummy_source = 0 ;
 unsigned int dummy_dest   = 0 ;
 
 
+//                              ACCEPTANCE FILTERS
+//
+// A packet is accepted if its arbitration value (the first two bytes
+// received) matches the id of any filter in every bit set in its mask.
+// With no filters, every packet is accepted. Set them up before
+// setupCANRX; the receive ISR checks them.
+typedef struct {
+    unsigned short id ;
+    unsigned short mask ;
+} can_filter ;
+
+can_filter can_filters[CAN_MAX_FILTERS] = {{MY_ARBITRATION_VALUE, 0xFFFF},
+                                           {NETWORK_BROADCAST, 0xFFFF}} ;
+int can_filter_count = 2 ;
+
+// Remove every filter
+void canClearFilters() {
+    can_filter_count = 0 ;
+}
+// Add a filter. Returns 0 if the table is full.
+int canAddFilter(unsigned short id, unsigned short mask) {
+    if (can_filter_count >= CAN_MAX_FILTERS) return 0 ;
+    can_filters[can_filter_count].id = id ;
+    can_filters[can_filter_count].mask = mask ;
+    can_filter_count += 1 ;
+    return 1 ;
+}
+// Does an arbitration value pass the filters?
+static HOT_INLINE int canAccept(unsigned short arb) {
+    int i ;
+    if (can_filter_count == 0) return 1 ;
+    for (i = 0; i < can_filter_count; i++) {
+        if (((arb ^ can_filters[i].id) & can_filters[i].mask) == 0) return 1 ;
+    }
+    return 0 ;
+}
+
+
 //               FUNCTION WHICH COMPUTES CHECKSUM (TX & RX)
 //
-// Function which computes the checksum over a series of bytes
-unsigned short culCalcCRC(char crcData, unsigned short crcReg) {
-    int i;
-    for (i = 0; i < 8; i++) {
-        if (((crcReg & 0x8000) >> 8) ^ (crcData & 0x80)) {
-            crcReg = (crcReg << 1) ^ CRC16_POLY;
-        } else {
-          crcReg = (crcReg << 1);
+// CRC of every byte value, so the checksum takes one lookup per byte
+// rather than a branch per bit. Built by the setup functions (in RAM,
+// so lookups don't wait on flash).
+unsigned short crc16_table[256] ;
+
+// Fill crc16_table by running each byte value through the bitwise CRC
+void buildCRCTable() {
+    int i, j ;
+    for (i = 0; i < 256; i++) {
+        unsigned short crcReg = i << 8 ;
+        for (j = 0; j < 8; j++) {
+            crcReg = (crcReg & 0x8000) ? ((crcReg << 1) ^ CRC16_POLY) : (crcReg << 1) ;
         }
-        crcData <<= 1;
+        crc16_table[i] = crcReg ;
     }
-    return crcReg;
+}
+
+// Function which computes the checksum over a series of bytes (inlined
+// into the packet functions, which run from RAM)
+static HOT_INLINE unsigned short culCalcCRC(char crcData, unsigned short crcReg) {
+    return (crcReg << 8) ^ crc16_table[((crcReg >> 8) ^ crcData) & 0xFF] ;
 }
 
 
 //                 FUNCTIONS USED FOR PACKET TRANSMISSION
 //
-// Helper function which access a particular bit in an unsigned short.
-// It returns that bit (0 or 1) as an unsigned short.
-unsigned short getBitShort(unsigned short * shorty, unsigned char bitnum) {
-    switch(bitnum) {
-        case 0:
-            return ((*shorty & 0x8000) >> 15) ;
-        case 1:
-            return ((*shorty & 0x4000) >> 14) ;
-        case 2:
-            return ((*shorty & 0x2000) >> 13) ;
-        case 3:
-            return ((*shorty & 0x1000) >> 12) ;
-        case 4:
-            return ((*shorty & 0x0800) >> 11) ;
-        case 5:
-            return ((*shorty & 0x0400) >> 10) ;
-        case 6:
-            return ((*shorty & 0x0200) >> 9) ;
-        case 7:
-            return ((*shorty & 0x0100) >> 8) ;
-        case 8:
-            return ((*shorty & 0x0080) >> 7) ;
-        case 9:
-            return ((*shorty & 0x0040) >> 6) ;
-        case 10:
-            return ((*shorty & 0x0020) >> 5) ;
-        case 11:
-            return ((*shorty & 0x0010) >> 4) ;
-        case 12:
-            return ((*shorty & 0x0008) >> 3) ;
-        case 13:
-            return ((*shorty & 0x0004) >> 2) ;
-        case 14:
-            return ((*shorty & 0x0002) >> 1) ;
-        case 15:
-            return ((*shorty & 0x0001) >> 0) ;
-        default:
-            return 0xFFFF ;
-    }
+// Bit stuffing runs on shift registers rather than one bit at a time
+// through the buffers. The state between words is the value of the last
+// bit and the length of the run of equal bits it ends (at most 4, since a
+// run of 5 is always broken by a stuff bit).
+//
+// Helper which checks whether a word of 'bits' bits (MSB first) could
+// complete a run of 5, given the run it follows. The run is written in
+// front of the word as 4 context bits, and 4 equal neighbouring pairs in
+// a row (no transitions) mark a run of 5. If it can't, the whole word
+// can be copied at once.
+static HOT_INLINE int runOfFive(unsigned int word, int bits, unsigned int last, int run) {
+    unsigned int context = last ? ((1u << run) - 1) : (0xF & ~((1u << run) - 1)) ;
+    unsigned int window = (context << bits) | word ;
+    unsigned int same = ~(window ^ (window >> 1)) & ((1u << (bits + 3)) - 1) ;
+    return (same & (same >> 1) & (same >> 2) & (same >> 3) & ((1u << bits) - 1)) != 0 ;
 }
-// Helper function which modifies a single bit in an unsigned short. The first argument
-// is a pointer to the short that will be modified. The second is the bit number (0-15) to
-// modify. And the third is the value (0 or 1) to which we would like it modified.
-void modifyBitShort(unsigned short * shorty, unsigned char bitnum, unsigned short value) {
-    switch(bitnum) {
-        case 15:
-            *shorty |= ((value << 0) & 0x0001) ;
-            break ;
-        case 14:
-            *shorty |= ((value << 1) & 0x0002) ;
-            break ;
-        case 13:
-            *shorty |= ((value << 2) & 0x0004) ;
-            break ;
-        case 12:
-            *shorty |= ((value << 3) & 0x0008) ;
-            break ;
-        case 11:
-            *shorty |= ((value << 4) & 0x0010) ;
-            break ;
-        case 10:
-            *shorty |= ((value << 5) & 0x0020) ;
-            break ;
-        case 9:
-            *shorty |= ((value << 6) & 0x0040) ;
-            break ;
-        case 8:
-            *shorty |= ((value << 7) & 0x0080) ;
-            break ;
-        case 7:
-            *shorty |= ((value << 8) & 0x0100) ;
-            break ;
-        case 6:
-            *shorty |= ((value << 9) & 0x0200) ;
-            break ;
-        case 5:
-            *shorty |= ((value << 10) & 0x0400) ;
-            break ;
-        case 4:
-            *shorty |= ((value << 11) & 0x0800) ;
-            break ;
-        case 3:
-            *shorty |= ((value << 12) & 0x1000) ;
-            break ;
-        case 2:
-            *shorty |= ((value << 13) & 0x2000) ;
-            break ;
-        case 1:
-            *shorty |= ((value << 14) & 0x4000) ;
-            break ;
-        case 0:
-            *shorty |= ((value << 15) & 0x8000) ;
-            break ;
-        default:
-            printf("Invalid argument to modifyBitChar   \n") ;
-            break ;
-    }
+// Length of the run of equal bits at the end of a word that contains no
+// run of 5 (the run doesn't reach into the context)
+static HOT_INLINE int trailingRun(unsigned int word) {
+    return __builtin_ctz((word ^ (word >> 1)) | 0x10) + 1 ;
 }
 // Assumes that the final element in the unstuffed buffer is 0xFFFF
-void bitStuff(unsigned short * unstuffed, unsigned short * stuffed) {
+void HOT_KERNEL(bitStuff)(unsigned short * unstuffed, unsigned short * stuffed) {
     // Clear the buffer
     memcpy(&stuffed[0], &zero_packet[0], MAX_STUFFED_PACKET_LEN) ;
 
-    // Variables for monitoring position in each buffer
-    int stuffed_index   = 0 ;
-    int unstuffed_index = 0 ;
-    int stuffed_bit     = 0 ;
-    int unstuffed_bit   = 0 ;
-
-    // Accumulated bit run length
-    int bit_run_len = 1 ;
+    // Stuffed bits not yet written out, and how many there are
+    unsigned int acc = 0 ;
+    int acc_bits     = 0 ;
+    int stuffed_index = 0 ;
 
-    // Memory of old bit value
-    unsigned short new_val = 0 ;
-    unsigned short old_val = 2 ;
+    // Current run of equal bits
+    unsigned int last = 0 ;
+    int run           = 0 ;
 
+    int i, b ;
     // Until we find the end of frame . . .
-    while ((*(unstuffed + unstuffed_index) != 0xFFFF) && (unstuffed_index < MAX_PACKET_LEN)) {
-        new_val = getBitShort((unstuffed + unstuffed_index), unstuffed_bit) ;
-        bit_run_len = (new_val==old_val)?(bit_run_len+1):1 ;
-        old_val = new_val ;
-
-        if (bit_run_len < 5) {
-            modifyBitShort(stuffed+stuffed_index, stuffed_bit, new_val) ;
-            stuffed_bit = (stuffed_bit<15)?(stuffed_bit+1):0 ;
-            stuffed_index = (stuffed_bit==0)?(stuffed_index+1):stuffed_index ;
-            unstuffed_bit = (unstuffed_bit<15)?(unstuffed_bit+1):0 ;
-            unstuffed_index = (unstuffed_bit==0)?(unstuffed_index+1):unstuffed_index ;
-
+    for (i = 0; (unstuffed[i] != 0xFFFF) && (i < (MAX_PACKET_LEN>>1)); i++) {
+        unsigned int word = unstuffed[i] ;
+
+        // No stuff bits in this word: copy it
+        if (!runOfFive(word, 16, last, run)) {
+            acc = (acc << 16) | word ;
+            stuffed[stuffed_index++] = acc >> acc_bits ;
+            last = word & 1 ;
+            run = trailingRun(word) ;
+            continue ;
         }
-        else {
-            modifyBitShort(stuffed+stuffed_index, stuffed_bit, new_val) ;
-            stuffed_bit = (stuffed_bit<15)?(stuffed_bit+1):0 ;
-            stuffed_index = (stuffed_bit==0)?(stuffed_index+1):stuffed_index ;
-
-            modifyBitShort(stuffed+stuffed_index, stuffed_bit, !new_val) ;
-            stuffed_bit = (stuffed_bit<15)?(stuffed_bit+1):0 ;
-            stuffed_index = (stuffed_bit==0)?(stuffed_index+1):stuffed_index ;
-            unstuffed_bit = (unstuffed_bit<15)?(unstuffed_bit+1):0 ;
-            unstuffed_index = (unstuffed_bit==0)?(unstuffed_index+1):unstuffed_index ;
-
-            bit_run_len = 1 ;
-            old_val = !new_val ;
+
+        // Otherwise shift it in a bit at a time, stuffing after each run of 5
+        for (b = 15; b >= 0; b--) {
+            unsigned int bit = (word >> b) & 1 ;
+            run = (bit == last) ? (run + 1) : 1 ;
+            last = bit ;
+            acc = (acc << 1) | bit ;
+            acc_bits += 1 ;
+            if (run == 5) {
+                acc = (acc << 1) | (bit ^ 1) ;
+                acc_bits += 1 ;
+                last = bit ^ 1 ;
+                run = 1 ;
+            }
+            if (acc_bits >= 16) {
+                acc_bits -= 16 ;
+                stuffed[stuffed_index++] = acc >> acc_bits ;
+            }
         }
     }
-    // Pack out rest of that index with zeroes
-    while(stuffed_bit <= 15) {
-        modifyBitShort(stuffed+stuffed_index, stuffed_bit, 0) ;
-        stuffed_bit += 1 ;
-    }
+    // Pack out rest of the last word with zeroes
+    stuffed[stuffed_index] = (acc << (16 - acc_bits)) & 0xFFFF ;
 
     // Postpend a short of all ones
     stuffed_index += 1 ;
-    *(stuffed + stuffed_index) = *(unstuffed + unstuffed_index) ;
+    stuffed[stuffed_index] = unstuffed[i] ;
 }
-// Assemble the unstuffed packet for transmit using the global values for
-// arbitration, reserve byte, payload length, and the payload. This function
-// automatically computes and appends the checksum, then appends the EOF.
-void sendPacket() {
+// Assemble the unstuffed packet for transmit from an arbitration value,
+// reserve byte, payload length, and the payload, then stuff it into a
+// mailbox's buffer. This function automatically computes and appends the
+// checksum, then appends the EOF.
+void HOT_KERNEL(assemblePacket)(unsigned short arb, unsigned char reserve, const unsigned short * data,
+                                unsigned char len, unsigned short * stuffed) {
     // Incrementer
     int i ;
     // Load arbitration
-    tx_packet_unstuffed[0] = arbitration ;
+    tx_packet_unstuffed[0] = arb ;
     // Load reserve byte and payload length
-    tx_packet_unstuffed[1] =  (((((unsigned short)reserve_byte)<<8) & 0xFF00) |
-                             (((unsigned short)payload_len) & 0x00FF));
+    tx_packet_unstuffed[1] =  (((((unsigned short)reserve)<<8) & 0xFF00) |
+                             (((unsigned short)len) & 0x00FF));
     // Load payload
-    memcpy(&tx_packet_unstuffed[2], &payload[0], payload_len) ;
+    memcpy(&tx_packet_unstuffed[2], &data[0], len) ;
     // Compute checksum
     unsigned short checksum = CRC_INIT; // Init value for CRC calculation
     while (checksum == 0xFFFF) {
         tx_packet_unstuffed[1] ^= 0x8000 ;
-        for (i = 0; i < ((payload_len>>1)+2); i++) {
+        for (i = 0; i < ((len>>1)+2); i++) {
           checksum = culCalcCRC((tx_packet_unstuffed[i]>>8)&0xFF, checksum);
           checksum = culCalcCRC((tx_packet_unstuffed[i])&0xFF, checksum);
         }
@@ -262,193 +287,199 @@ void sendPacket() {
 
     // // Print the populated packet
     // printf("\nPopulated packet\n") ;
-    // for(i=0; i<((payload_len>>1)+6); i++){
+    // for(i=0; i<((len>>1)+6); i++){
     //     printf("%04x", tx_packet_unstuffed[i]) ;
     // }
     // printf("\n") ;
 
     // Bit stuff the packet
-    bitStuff(tx_packet_unstuffed, tx_packet_stuffed) ;
+    bitStuff(tx_packet_unstuffed, stuffed) ;
 
     // // Print packet after stuffing
     // printf("Stuffed packet:\n") ;
-    // for (i=0; i<((payload_len>>1)+6); i++){
-    //     printf("%04x", tx_packet_stuffed[i]) ;
+    // for (i=0; i<((len>>1)+6); i++){
+    //     printf("%04x", stuffed[i]) ;
     // }
     // printf("\n") ;
-
+}
+// If the transmitter is free, start sending the best waiting packet. Call
+// from the TX ISR, or with interrupts off.
+void HOT_ISR(startNextPacket)() {
+    int i ;
+    int best = -1 ;
+    if (tx_sending >= 0) return ;
+    for (i = 0; i < CAN_TX_MAILBOXES; i++) {
+        if (tx_mailboxes[i].state != TX_READY) continue ;
+        if ((best < 0) ||
+            (tx_mailboxes[i].arbitration < tx_mailboxes[best].arbitration) ||
+            ((tx_mailboxes[i].arbitration == tx_mailboxes[best].arbitration) &&
+             ((int)(tx_mailboxes[i].order - tx_mailboxes[best].order) < 0))) {
+            best = i ;
+        }
+    }
+    if (best < 0) return ;
+    tx_mailboxes[best].state = TX_SENDING ;
+    tx_sending = best ;
     // BEGIN TRANSMISSION
-    dma_start_channel_mask((1u << dma_chan_0)) ;
+    dma_channel_set_read_addr(dma_chan_0, tx_mailboxes[best].stuffed, true) ;
 }
-
-
-//                   FUNCTIONS USED FOR PACKET RECEPTION
-//
-// Helper function which access a particular bit in an unsigned char.
-// It returns that bit (0 or 1) as an unsigned char.
-unsigned char getBitChar(unsigned char * byte, unsigned char bitnum) {
-    switch(bitnum) {
-        case 0:
-            return ((*byte & 0x80) >> 7) ;
-        case 1:
-            return ((*byte & 0x40) >> 6) ;
-        case 2:
-            return ((*byte & 0x20) >> 5) ;
-        case 3:
-            return ((*byte & 0x10) >> 4) ;
-        case 4:
-            return ((*byte & 0x08) >> 3) ;
-        case 5:
-            return ((*byte & 0x04) >> 2) ;
-        case 6:
-            return ((*byte & 0x02) >> 1) ;
-        case 7:
-            return ((*byte & 0x01) >> 0) ;
-        default:
-            return 0xFF ;
+// Number of packets queued or being sent
+int canTxPending() {
+    int i, n = 0 ;
+    for (i = 0; i < CAN_TX_MAILBOXES; i++) {
+        if (tx_mailboxes[i].state != TX_FREE) n++ ;
     }
+    return n ;
 }
-// Helper function which modifies a single bit in an unsigned char. The first argument
-// is a pointer to the char that will be modified. The second is the bit number (0-7) to
-// modify. And the third is the value (0 or 1) to which we would like it modified.
-void modifyBitChar(unsigned char * byte, unsigned char bitnum, unsigned char value) {
-    switch(bitnum) {
-        case 7:
-            *byte |= ((value << 0) & 0x01) ;
-            break ;
-        case 6:
-            *byte |= ((value << 1) & 0x02) ;
-            break ;
-        case 5:
-            *byte |= ((value << 2) & 0x04) ;
-            break ;
-        case 4:
-            *byte |= ((value << 3) & 0x08) ;
-            break ;
-        case 3:
-            *byte |= ((value << 4) & 0x10) ;
-            break ;
-        case 2:
-            *byte |= ((value << 5) & 0x20) ;
-            break ;
-        case 1:
-            *byte |= ((value << 6) & 0x40) ;
-            break ;
-        case 0:
-            *byte |= ((value << 7) & 0x80) ;
-            break ;
-        default:
-            printf("Invalid argument to modifyBitChar   \n") ;
-            break ;
+// Queue a packet for transmission, and return without waiting for it.
+// Returns 1 if it was queued, or 0 if every mailbox is full (or the
+// payload is too long). Call from the core that runs the TX ISR.
+int canQueuePacket(unsigned short arb, unsigned char reserve, const unsigned short * data,
+                   unsigned char len) {
+    int i ;
+    if (len > MAX_PAYLOAD_SIZE) return 0 ;
+    for (i = 0; i < CAN_TX_MAILBOXES; i++) {
+        if (tx_mailboxes[i].state == TX_FREE) break ;
+    }
+    if (i == CAN_TX_MAILBOXES) {
+        can_bus_stats.tx_queue_full += 1 ;
+        return 0 ;
     }
+
+    // The ISR leaves free mailboxes alone, so fill this one with it running
+    assemblePacket(arb, reserve, data, len, tx_mailboxes[i].stuffed) ;
+    tx_mailboxes[i].arbitration = arb ;
+    tx_mailboxes[i].order = tx_order++ ;
+
+    uint32_t irq_state = save_and_disable_interrupts() ;
+    tx_mailboxes[i].state = TX_READY ;
+    startNextPacket() ;
+    restore_interrupts(irq_state) ;
+
+    int pending = canTxPending() ;
+    if (pending > can_bus_stats.tx_queue_high) can_bus_stats.tx_queue_high = pending ;
+    return 1 ;
+}
+// Queue a packet from the global values for arbitration, reserve byte,
+// payload length, and the payload. Returns 1 if it was queued.
+int sendPacket() {
+    return canQueuePacket(arbitration, reserve_byte, payload, payload_len) ;
 }
+
+
+
+
+//                   FUNCTIONS USED FOR PACKET RECEPTION
+//
 // Function which takes a pointer to a stuffed character array,
 // and a pointer to an array where we would like the unstuffed
 // data to be stored. Function unstuffs the first array and stores
-// the result in the second.
+// the result in the second, up to len bytes. Uses the same
+// shift-register scheme as bitStuff, a byte at a time. Returns the
+// position (in unstuffed bits) of the first stuff bit with the wrong
+// polarity, or -1.
 //
 // Why not do an in-place replacement? I think that it will be nice
 // to start gathering the next stuffed buffer while doing work on the
 // last one.
-void unBitStuff(unsigned char * stuffed, unsigned char * unstuffed) {
+int HOT_ISR(unBitStuff)(unsigned char * stuffed, unsigned char * unstuffed, int len) {
     // Clear the buffer
-    memcpy(&unstuffed[0], &zero_packet[0], MAX_STUFFED_PACKET_LEN) ;
+    memcpy(&unstuffed[0], &zero_packet[0], len) ;
 
-    // Variables for monitoring position in each buffer
-    int stuffed_index   = 0 ;
+    // Unstuffed bits not yet written out, and how many there are
+    unsigned int acc = 0 ;
+    int acc_bits     = 0 ;
     int unstuffed_index = 0 ;
-    int stuffed_bit     = 0 ;
-    int unstuffed_bit   = 0 ;
-
-    // Accumulated bit run length
-    int bit_run_len     = 0 ;
 
-    // Memory of old bit value
-    unsigned char new_val = 0 ;
-    unsigned char old_val = 2 ;
+    // Current run of equal bits, and whether the next bit is a stuff bit
+    unsigned int last = 0 ;
+    int run           = 0 ;
+    int skip          = 0 ;
+    int bad_stuff     = -1 ;
 
+    int i, b ;
     // Until we find the end of frame . . .
-    while ((*(stuffed + stuffed_index) != 0xFF) && (stuffed_index < (MAX_STUFFED_PACKET_LEN))) {
-        // Get a new bit, update the bit run length, and update the bit memory
-        new_val = getBitChar((stuffed+stuffed_index), stuffed_bit) ;
-        bit_run_len = (new_val==old_val)?(bit_run_len+1):1 ;
-        old_val = new_val ;
-
-        // If our bit run length is less than 5, update the unstuffed buffer
-        // and increment position in each buffer.
-        if (bit_run_len < 5) {
-
-            modifyBitChar(unstuffed+unstuffed_index, unstuffed_bit, new_val) ;
-
-            unstuffed_bit = (unstuffed_bit<7)?(unstuffed_bit+1):0 ;
-            unstuffed_index = (unstuffed_bit==0)?(unstuffed_index+1):unstuffed_index ;
-
-            stuffed_bit = (stuffed_bit<7)?(stuffed_bit+1):0 ;
-            stuffed_index = (stuffed_bit==0)?(stuffed_index+1):stuffed_index ;
-
+    for (i = 0; (stuffed[i] != 0xFF) && (i < MAX_STUFFED_PACKET_LEN) &&
+                (unstuffed_index < len); i++) {
+        unsigned int byte = stuffed[i] ;
+
+        // No stuff bits in this byte: copy it
+        if (!skip && !runOfFive(byte, 8, last, run)) {
+            acc = (acc << 8) | byte ;
+            unstuffed[unstuffed_index++] = acc >> acc_bits ;
+            last = byte & 1 ;
+            run = trailingRun(byte) ;
+            continue ;
         }
 
-        // If our bit run length is 5, update the unstuffed buffer. Then
-        // increment the unstuffed buffer by ONE and the stuffed buffer by TWO
-        // in order to skip over the stuff bit.
-        else {
-            modifyBitChar(unstuffed+unstuffed_index, unstuffed_bit, new_val) ;
-            unstuffed_bit = (unstuffed_bit<7)?(unstuffed_bit+1):0 ;
-            unstuffed_index = (unstuffed_bit==0)?(unstuffed_index+1):unstuffed_index ;
-
-            stuffed_bit = (stuffed_bit<7)?(stuffed_bit+1):0 ;
-            stuffed_index = (stuffed_bit==0)?(stuffed_index+1):stuffed_index ;
-            stuffed_bit = (stuffed_bit<7)?(stuffed_bit+1):0 ;
-            stuffed_index = (stuffed_bit==0)?(stuffed_index+1):stuffed_index ;
-
-            // Reset bit run length
-            bit_run_len = 1 ;
-            // We jumped over a stuffed bit, opposite polarity to
-            // the last bit that we measured
-            old_val = !new_val ;
+        // Otherwise shift it in a bit at a time, dropping the bit after
+        // each run of 5. It's opposite polarity to the run, whatever we read
+        // (but note where it wasn't).
+        for (b = 7; b >= 0; b--) {
+            unsigned int bit = (byte >> b) & 1 ;
+            if (skip) {
+                if ((bit == last) && (bad_stuff < 0)) {
+                    bad_stuff = (unstuffed_index << 3) + acc_bits ;
+                }
+                skip = 0 ;
+                last ^= 1 ;
+                run = 1 ;
+                continue ;
+            }
+            run = (bit == last) ? (run + 1) : 1 ;
+            last = bit ;
+            acc = (acc << 1) | bit ;
+            acc_bits += 1 ;
+            skip = (run == 5) ;
+            if (acc_bits == 8) {
+                acc_bits = 0 ;
+                unstuffed[unstuffed_index++] = acc ;
+                if (unstuffed_index == len) return bad_stuff ;
+            }
         }
     }
-
+    // Whatever is left of the last byte
+    if (acc_bits && (unstuffed_index < len)) {
+        unstuffed[unstuffed_index] = acc << (8 - acc_bits) ;
+    }
+    return bad_stuff ;
+}
+// Number of packets waiting in the RX ring
+static inline int canPacketsWaiting() {
+    return rx_head - rx_tail ;
 }
-// Function assumes that a stuffed packet lives in rx_packet_stuffed.
-// It unpacks that packet, checks the arbitration bits, and checks the
-// checksum. If it is a valid packet (correct arbitration and checksum)
-// then the function returns 1. Else it returns 0. Valid packet will
-// remain in rx_packet_unstuffed for user to access.
-unsigned char attemptPacketReceive() {
-    // // Print packet received stuffed packet
+// Function unpacks the oldest packet waiting in the RX ring, checks
+// its length and checksum, and frees its buffer. Call it outside the
+// ISR (from a thread) while canPacketsWaiting(). If it is a valid packet
+// (correct length and checksum) then the function returns 1. Else it
+// returns 0. Valid packet will remain in rx_packet_unstuffed for user to
+// access. The arbitration bits were checked (by the acceptance filters)
+// before the packet was queued.
+unsigned char HOT_KERNEL(attemptPacketReceive)() {
     int i ;
-    // printf("Received (stuffed) packet:\n") ;
-    // for (i=0; i<22; i++){
-    //     printf("%02x", rx_packet_stuffed[i]) ;
-    // }
-    // printf("\n") ;
+    if (rx_head == rx_tail) return 0 ;
 
-    // Unstuff the received packet
-    unBitStuff(rx_packet_stuffed, rx_packet_unstuffed) ;
+    // Time from the end of the packet to now
+    unsigned int latency = time_us_32() - rx_time[rx_tail % CAN_RX_BUFFERS] ;
+    int bin = latency ? (32 - __builtin_clz(latency)) : 0 ;
+    can_bus_stats.rx_latency[(bin < CAN_LATENCY_BINS) ? bin : (CAN_LATENCY_BINS - 1)] += 1 ;
+    if (latency > can_bus_stats.rx_latency_max) can_bus_stats.rx_latency_max = latency ;
 
-    // // Print the packet after unstuffing
-    // printf("Packet after unstuffing:\n") ;
-    // for (i=0; i<22; i++){
-    //     printf("%02x", rx_packet_unstuffed[i]) ;
-    // }
-    // printf("\n\n") ;
-
-    // Check arbitration bits
-    if ((rx_packet_unstuffed[0]!=((MY_ARBITRATION_VALUE>>8)&0xFF))&&
-        (rx_packet_unstuffed[0]!=((NETWORK_BROADCAST>>8)&0xFF))) {
-        // printf("Failed at arbitration 1\n");
-        return 0 ;
-    }
-    if ((rx_packet_unstuffed[1]!=((MY_ARBITRATION_VALUE)&0xFF))&&
-        (rx_packet_unstuffed[1]!=((NETWORK_BROADCAST)&0xFF))) {
-        // printf("Failed at arbitration 2\n");
-        return 0 ;
-    }
+    // Unstuff the received packet, then free its buffer
+    int bad_stuff = unBitStuff(rx_ring[rx_tail % CAN_RX_BUFFERS], rx_packet_unstuffed, MAX_PACKET_LEN) ;
+    rx_tail += 1 ;
 
     // Check packet length
     if (rx_packet_unstuffed[3] > MAX_PAYLOAD_SIZE) {
         // printf("Invalid packet length\n") ;
+        can_bus_stats.rx_length_errors += 1 ;
+        return 0 ;
+    }
+
+    // Check stuffing up to the end of the checksum (the zero padding and the
+    // EOF after it break the rule)
+    if ((bad_stuff >= 0) && (bad_stuff <= ((rx_packet_unstuffed[3] + 6) << 3))) {
+        can_bus_stats.rx_stuff_errors += 1 ;
         return 0 ;
     }
 
@@ -459,10 +490,12 @@ unsigned char attemptPacketReceive() {
     }
     if ((rx_packet_unstuffed[i]==((checksum>>8)&0xFF)) &&
         (rx_packet_unstuffed[i+1]==((checksum)&0xFF))) {
+        can_bus_stats.rx_packets += 1 ;
         return 1 ;
     }
     else {
         // printf("Failed at checksum\n") ;
+        can_bus_stats.rx_crc_errors += 1 ;
         return 0 ;
     }
 }
@@ -473,27 +506,43 @@ unsigned char attemptPacketReceive() {
 //                        DRIVER INTERRUPT SERVICE ROUTINES
 //
 // In the event of an overrun on the RX DMA channel (happens when a new node
-// joins the network), this ISR resets the DMA channel
-void dma_handler() {
+// joins the network), this ISR resets the DMA channel to the start of the
+// same buffer
+void HOT_ISR(dma_handler)() {
     // Clear the interrupt request
     dma_hw->ints0 = 1u << dma_chan_1;
+    can_bus_stats.rx_dma_overruns += 1 ;
     // Reset the DMA channel write address, and start the channel
     dma_channel_set_write_addr(dma_chan_1, rx_packet_stuffed_pointer, true) ;
 }
 
 
+// The TX machine raises irq 3 each time it loses arbitration (it then
+// waits for the bus to go idle and tries again by itself)
+void HOT_ISR(arbitration_lost_handler)() {
+    pio_interrupt_clear(pio_0, 3) ;
+    can_bus_stats.tx_arbitration_lost += 1 ;
+}
+
+
 //                  CAN SETUP FUNCTIONS. CALL ON CORE WHERE YOU WANT TO RUN
 //
 void setupIdleCheck() {
 
-    // Load PIO program onto PIO0
-    uint can_idle_offset = pio_add_program(pio_0, &idle_check_program) ;
+    // Claim a state machine and DMA channels, and load the PIO program onto PIO0
+    can_idle_check_sm = hw_claim_sm(pio_0, "can idle") ;
+    dma_chan_2 = hw_claim_dma("can idle") ;
+    dma_chan_3 = hw_claim_dma("can idle") ;
+    uint can_idle_offset = hw_add_program(pio_0, &idle_check_program, "can idle") ;
+    hw_claim_pio_irq(pio_0, 6, "can idle") ;
+    hw_claim_pio_irq(pio_0, 7, "can idle") ;
 
     // Initialize the PIO program
     idle_check_program_init(pio_0, can_idle_check_sm, can_idle_offset, CAN_TX+1, CLKDIV) ;
 
-    // Zero the irq 1
-    pio_interrupt_clear(pio_0, 1) ;
+    // Zero the handshake irqs
+    pio_interrupt_clear(pio_0, 6) ;
+    pio_interrupt_clear(pio_0, 7) ;
 
     // Start the PIO program
     pio_sm_set_enabled(pio_0, can_idle_check_sm, true) ;
@@ -503,7 +552,7 @@ void setupIdleCheck() {
     channel_config_set_transfer_data_size(&c2, DMA_SIZE_32);
     channel_config_set_read_increment(&c2, false);
     channel_config_set_write_increment(&c2, false);
-    channel_config_set_dreq(&c2, DREQ_PIO0_TX1) ;
+    channel_config_set_dreq(&c2, pio_get_dreq(pio_0, can_idle_check_sm, true)) ;
     channel_config_set_chain_to(&c2, dma_chan_3);
 
     dma_channel_configure(
@@ -542,11 +591,18 @@ void setupCANTX(irq_handler_t handler) {
     gpio_set_dir(TRANSCIEVER_EN, GPIO_OUT) ;
     gpio_put(TRANSCIEVER_EN, 0) ;
 
+    // Checksum lookup table
+    buildCRCTable() ;
+
     // Setup the idle checking system
     setupIdleCheck() ;
 
-    // Load PIO programs onto PIO0
-    uint can_tx_offset = pio_add_program(pio_0, &can_tx_program) ;
+    // Claim a state machine and DMA channel, and load the PIO program onto PIO0
+    can_tx_sm = hw_claim_sm(pio_0, "can tx") ;
+    dma_chan_0 = hw_claim_dma("can tx") ;
+    uint can_tx_offset = hw_add_program(pio_0, &can_tx_program, "can tx") ;
+    hw_claim_pio_irq(pio_0, 0, "can tx") ;
+    hw_claim_pio_irq(pio_0, 3, "can tx") ;
 
     // Initialize the PIO program
     can_tx_program_init(pio_0, can_tx_sm, can_tx_offset, CAN_TX, CLKDIV) ;
@@ -557,20 +613,26 @@ void setupCANTX(irq_handler_t handler) {
     irq_set_exclusive_handler(PIO0_IRQ_0, handler) ;
     irq_set_enabled(PIO0_IRQ_0, true) ;
 
+    // Count lost arbitrations on the other PIO 0 interrupt line
+    pio_interrupt_clear(pio_0, 3) ;
+    pio_set_irq1_source_enabled(pio_0, pis_interrupt3, true) ;
+    irq_set_exclusive_handler(PIO0_IRQ_1, arbitration_lost_handler) ;
+    irq_set_enabled(PIO0_IRQ_1, true) ;
+
     // Channel Zero (sends data to TX PIO machine)
     dma_channel_config c0 = dma_channel_get_default_config(dma_chan_0);
     channel_config_set_transfer_data_size(&c0, DMA_SIZE_16);
     channel_config_set_read_increment(&c0, true);
     channel_config_set_write_increment(&c0, false);
-    channel_config_set_dreq(&c0, DREQ_PIO0_TX0) ;
+    channel_config_set_dreq(&c0, pio_get_dreq(pio_0, can_tx_sm, true)) ;
 
     dma_channel_configure(
-        dma_chan_0,                     // Channel to be configured
-        &c0,                            // The configuration we just created
-        &pio_0->txf[can_tx_sm],         // write address (transmit PIO TX FIFO)
-        tx_packet_stuffed_pointer,      // read address (start of stuffed packet)
-        sizeof(tx_packet_stuffed)>>1,   // Number of transfers (aborts early!)
-        false                           // Don't start immediately.
+        dma_chan_0,                         // Channel to be configured
+        &c0,                                // The configuration we just created
+        &pio_0->txf[can_tx_sm],             // write address (transmit PIO TX FIFO)
+        tx_packet_stuffed_pointer,          // read address (start of stuffed packet)
+        sizeof(tx_mailboxes[0].stuffed)>>1, // Number of transfers (aborts early!)
+        false                               // Don't start immediately.
     );
 
     // Start the TX PIO program (sets output high, among other things)
@@ -588,8 +650,14 @@ void setupCANTX(irq_handler_t handler) {
 // channel for moving data from the receive PIO.
 void setupCANRX(irq_handler_t handler) {
 
-    // Load pio program onto PIO 1
-    uint can_rx_offset = pio_add_program(pio_1, &can_rx_program) ;
+    // Checksum lookup table
+    buildCRCTable() ;
+
+    // Claim a state machine and DMA channel, and load the pio program onto PIO 1
+    can_rx_sm = hw_claim_sm(pio_1, "can rx") ;
+    dma_chan_1 = hw_claim_dma("can rx") ;
+    uint can_rx_offset = hw_add_program(pio_1, &can_rx_program, "can rx") ;
+    hw_claim_pio_irq(pio_1, 0, "can rx") ;
 
     // Initialize the PIO programs
     can_rx_program_init(pio_1, can_rx_sm, can_rx_offset, CAN_TX+1, CLKDIV) ;
@@ -605,14 +673,14 @@ void setupCANRX(irq_handler_t handler) {
     channel_config_set_transfer_data_size(&c1, DMA_SIZE_8);
     channel_config_set_read_increment(&c1, false);
     channel_config_set_write_increment(&c1, true);
-    channel_config_set_dreq(&c1, DREQ_PIO1_RX0) ;
+    channel_config_set_dreq(&c1, pio_get_dreq(pio_1, can_rx_sm, false)) ;
 
     dma_channel_configure(
         dma_chan_1,                 // Channel to be configured
         &c1,                        // The configuration we just created
         rx_packet_stuffed_pointer,  // write address (receive buffer)
         &pio_1->rxf[can_rx_sm],     // read address (receive PIO RX FIFO)
-        sizeof(rx_packet_stuffed),  // Number of transfers (aborts early!!)
+        sizeof(rx_ring[0]),         // Number of transfers (aborts early!!)
         false                       // Don't start immediately.
     );
   
@@ -633,22 +701,33 @@ void setupCANRX(irq_handler_t handler) {
 
 //                              API HELPER FUNCTIONS
 //
-// Call in the tx_handler interrupt service routine to reset the transmitter
-static inline void resetTransmitter() {
+// Call in the tx_handler interrupt service routine to reset the transmitter.
+// Frees the mailbox that was sent, and starts the next waiting packet.
+static HOT_INLINE void resetTransmitter() {
     // Abort the DMA channel sending data to the TX PIO (EOF found)
     dma_channel_abort(dma_chan_0) ;
     // Drain the TX FIFO
     pio_sm_drain_tx_fifo(pio_0, can_tx_sm) ;
     // Unstall the PIO state machine
     pio_interrupt_clear(pio_0, 0) ;
-    // Reset the DMA channel read address, don't start channel yet
-    dma_channel_set_read_addr(dma_chan_0, tx_packet_stuffed_pointer, false) ;
+    // Free the mailbox
+    if (tx_sending >= 0) {
+        tx_mailboxes[tx_sending].state = TX_FREE ;
+        tx_sending = -1 ;
+        can_bus_stats.tx_packets += 1 ;
+    }
     // WHY IS THIS NECESSARY? Did not need this until I added the transcievers
     sleep_us(10) ;
+    // Send the next packet (the TX machine waits for the bus to go idle)
+    startNextPacket() ;
 }
 
-// Call in the rx_handler interrupt service routing to reset the receiver
-static inline void resetReceiver() {
+// Call in the rx_handler interrupt service routing to reset the receiver.
+// Unstuffs just the arbitration bits of the packet, and if they pass the
+// acceptance filters (and another buffer is free) queues the packet for
+// attemptPacketReceive and moves on to the next buffer. Returns 1 if the
+// packet was queued.
+static HOT_INLINE int resetReceiver() {
     // Full message received, abort DMA channel 2
     // disable the channel on IRQ0
     dma_channel_set_irq0_enabled(dma_chan_1, false);
@@ -658,15 +737,41 @@ static inline void resetReceiver() {
     dma_channel_acknowledge_irq0(dma_chan_1);
     // re-enable the channel on IRQ0
     dma_channel_set_irq0_enabled(dma_chan_1, true);
+
+    // Filter, then queue the packet (keeping one buffer for the DMA channel)
+    int queued = 0 ;
+    unsigned char arb[2] ;
+    unBitStuff(rx_packet_stuffed_pointer, arb, 2) ;
+    if (!canAccept((arb[0] << 8) | arb[1])) {
+        can_bus_stats.rx_filtered += 1 ;
+    }
+    else if ((rx_head - rx_tail) >= (CAN_RX_BUFFERS - 1)) {
+        can_bus_stats.rx_overflows += 1 ;
+    }
+    else {
+        rx_time[rx_head % CAN_RX_BUFFERS] = time_us_32() ;
+        rx_head += 1 ;
+        queued = 1 ;
+        if ((rx_head - rx_tail) > can_bus_stats.rx_queue_high) {
+            can_bus_stats.rx_queue_high = rx_head - rx_tail ;
+        }
+    }
+
     // Reset the DMA channel write address, and start the channel
+    rx_packet_stuffed_pointer = rx_ring[rx_head % CAN_RX_BUFFERS] ;
     dma_channel_set_write_addr(dma_chan_1, rx_packet_stuffed_pointer, true) ;
+    return queued ;
 }
 
-// At end of receive ISR, clear interrupt to accept new packets
-static inline void acceptNewPacket() {
+// At end of receive ISR, clear interrupt to accept new packets (which can
+// be as soon as resetReceiver returns)
+static HOT_INLINE void acceptNewPacket() {
     pio_interrupt_clear(pio_1, 0) ;
 }
 
-
-
-
+// Copy out the bus statistics, and optionally zero them. (A count updated
+// on the other core while it's zeroed may be lost.)
+void canGetStats(can_stats * stats, int reset) {
+    memcpy(stats, (const void *)&can_bus_stats, sizeof(can_stats)) ;
+    if (reset) memset((void *)&can_bus_stats, 0, sizeof(can_stats)) ;
+}
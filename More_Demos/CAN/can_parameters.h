@@ -22,6 +22,15 @@
 // My own identity, and a broadcast value
 #define MY_ARBITRATION_VALUE    0x3234
 #define NETWORK_BROADCAST       0x5555
+// Number of TX mailboxes (packets queued for transmission)
+#define CAN_TX_MAILBOXES        8
+// Number of RX buffers, a power of two (one is filled while the rest wait
+// to be processed)
+#define CAN_RX_BUFFERS          8
+// Size of the acceptance filter table
+#define CAN_MAX_FILTERS         8
+// Bins in the RX latency histogram (powers of two of us)
+#define CAN_LATENCY_BINS        16
 // Time to wait (in bit times) for bus to be idle before tx. Dynamically modifiable.
 unsigned int tx_idle_time = 500 ;
 
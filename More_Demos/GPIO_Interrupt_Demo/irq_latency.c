@@ -0,0 +1,265 @@
+/**
+ * GPIO interrupt latency, measured on the board
+ *
+ * irq_timing.c needs a scope to see how long its interrupt takes. Here a
+ * PIO state machine is both the signal generator and the stopwatch
+ * (irq_latency.pio): it raises and lowers a stimulus pin, which the CPU
+ * takes a GPIO interrupt on, and counts system clock cycles until the
+ * handler has copied the stimulus to a response pin. Both pins are
+ * outputs, and a pin's input reads its own pad, so there's nothing to
+ * wire. Each edge's latency goes to a histogram, a million edges to a
+ * run, with the main loop (in SRAM) taking the counts from the FIFO.
+ *
+ * Each run is one way of taking the interrupt:
+ *  - sdk: gpio_set_irq_enabled_with_callback(), the SDK's dispatcher,
+ *    which finds the pin and acknowledges it before calling us
+ *  - raw: irq_set_exclusive_handler() on IO_IRQ_BANK0, which answers
+ *    first and acknowledges after
+ *  - handler in flash (through the XIP cache, warm), in flash with the
+ *    cache flushed before each edge (cold, as when the rest of the
+ *    program has pushed the handler out), or in SRAM (lib/hotpath)
+ * and all of them again with VGA scanout running (initVGA(); its DMA
+ * shares the bus), so six runs each without and with VGA.
+ *
+ * OUTPUT (serial, 115200 baud), cycles of the system clock
+ *  - "# sysclk_hz,<hz>", and other comments, start with #
+ *  - latency,<run>,<edges>,<min>,<mean>,<p50>,<p99>,<p99.9>,<max>,<stddev>
+ *    (jitter is max - min, or the spread of the percentiles)
+ *  - hist,<run>,<cycles>,<edges> for every bin that has any (bins are
+ *    IRQ_HIST_BIN cycles wide, and the last one is everything over
+ *    IRQ_HIST_CYCLES, where a percentile there reads IRQ_HIST_CYCLES)
+ *  - Each latency is from the stimulus edge to the response, as the
+ *    state machine sees it, so the input synchronizers and the state
+ *    machine's own sampling (a count is 2 cycles) are in the numbers
+ *
+ * HARDWARE CONNECTIONS
+ *  - Nothing needed. GPIO 2 (stimulus) and GPIO 3 (response) can go to
+ *    a scope to check the numbers.
+ *  - The VGA connections of lib/vga_graphics, for the VGA runs,
+ *    optionally
+ *
+ * RESOURCES USED
+ *  - A state machine on PIO 1 (VGA has PIO 0), claimed from lib/hw_claim
+ *  - IO_IRQ_BANK0 on core 0
+ *  - Those of lib/vga_graphics, for the runs with VGA
+ *
+ */
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/iobank0.h"
+#include "hardware/structs/xip_ctrl.h"
+
+#include "hotpath.h"
+#include "hw_claim.h"
+#include "vga_graphics.h"
+#include "irq_latency.pio.h"
+
+// The stimulus (driven by the state machine) and response (by the
+// handler) pins
+#define STIM_PIN 2
+#define RESP_PIN 3
+
+// Edges in each run, and the gap from each response to the next edge
+#ifndef IRQ_EDGES
+#define IRQ_EDGES 1000000
+#endif
+#ifndef IRQ_GAP_US
+#define IRQ_GAP_US 10
+#endif
+
+// Histogram bins
+#ifndef IRQ_HIST_BIN
+#define IRQ_HIST_BIN 2
+#endif
+#ifndef IRQ_HIST_CYCLES
+#define IRQ_HIST_CYCLES 2048
+#endif
+#define IRQ_HIST_BINS (IRQ_HIST_CYCLES / IRQ_HIST_BIN + 1)
+
+#define EDGES (GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL)
+
+PIO pio = pio1 ;
+uint sm, offset ;
+
+// Latency histogram and moments of the current run
+uint32_t histogram[IRQ_HIST_BINS] ;
+uint32_t lat_min, lat_max ;
+uint64_t lat_sum, lat_sum_sq ;
+
+////////////////////////////// The handlers //////////////////////////////
+
+// Copy the stimulus to the response pin, first thing
+#define RESPOND() {                                                 \
+    if (sio_hw->gpio_in & (1u << STIM_PIN)) sio_hw->gpio_set = 1u << RESP_PIN ; \
+    else sio_hw->gpio_clr = 1u << RESP_PIN ;                        \
+}
+// Acknowledge both edges (as gpio_acknowledge_irq does, but inlined)
+#define ACKNOWLEDGE() {                                             \
+    io_bank0_hw->intr[STIM_PIN / 8] = EDGES << (4 * (STIM_PIN % 8)) ; \
+}
+
+// For the SDK's dispatcher, which has acknowledged already
+void sdk_callback_flash(uint gpio, uint32_t events) {
+    RESPOND()
+}
+void HOT_ISR(sdk_callback_sram)(uint gpio, uint32_t events) {
+    RESPOND()
+}
+
+// For IO_IRQ_BANK0 itself
+void raw_handler_flash(void) {
+    RESPOND()
+    ACKNOWLEDGE()
+}
+void HOT_ISR(raw_handler_sram)(void) {
+    RESPOND()
+    ACKNOWLEDGE()
+}
+
+typedef struct {
+    const char * name ;
+    gpio_irq_callback_t callback ;      // the SDK's dispatcher calls this,
+    irq_handler_t handler ;             // or this is the handler
+    char cold ;                         // flush the XIP cache before each edge
+} irq_run ;
+
+static const irq_run runs[] = {
+    {"sdk_flash", sdk_callback_flash, NULL, 0},
+    {"sdk_flash_cold", sdk_callback_flash, NULL, 1},
+    {"sdk_sram", sdk_callback_sram, NULL, 0},
+    {"raw_flash", NULL, raw_handler_flash, 0},
+    {"raw_flash_cold", NULL, raw_handler_flash, 1},
+    {"raw_sram", NULL, raw_handler_sram, 0},
+} ;
+
+static void attach(const irq_run * run) {
+    gpio_acknowledge_irq(STIM_PIN, EDGES) ;
+    if (run->callback) {
+        gpio_set_irq_enabled_with_callback(STIM_PIN, EDGES, true, run->callback) ;
+    }
+    else {
+        irq_set_exclusive_handler(IO_IRQ_BANK0, run->handler) ;
+        gpio_set_irq_enabled(STIM_PIN, EDGES, true) ;
+    }
+    irq_set_enabled(IO_IRQ_BANK0, true) ;
+}
+
+static void detach(const irq_run * run) {
+    gpio_set_irq_enabled(STIM_PIN, EDGES, false) ;
+    irq_set_enabled(IO_IRQ_BANK0, false) ;
+    // Either way IO_IRQ_BANK0 is left without a handler, for the next run
+    if (run->callback) gpio_set_irq_callback(NULL) ;
+    else irq_remove_handler(IO_IRQ_BANK0, run->handler) ;
+}
+
+/////////////////////////////// Measuring ////////////////////////////////
+
+// Take edges counts off the FIFO into the histogram. In SRAM, so it
+// doesn't use the XIP cache (and, cold, leaves it empty for the handler).
+static void HOT_KERNEL(collect)(int edges, int cold) {
+    for (int i=0; i<edges; i++) {
+        uint32_t count = pio_sm_get_blocking(pio, sm) ;
+        // A fall's count is one more (see irq_latency.pio). Edges come
+        // in pairs, rise first.
+        if (i & 1) count-- ;
+        uint32_t cycles = 2 * count ;
+        if (cold) {
+            // The next edge is a gap away; reading the flush register
+            // waits for the flush to finish
+            xip_ctrl_hw->flush = 1 ;
+            (void)xip_ctrl_hw->flush ;
+        }
+        uint32_t bin = cycles / IRQ_HIST_BIN ;
+        histogram[(bin < IRQ_HIST_BINS - 1) ? bin : IRQ_HIST_BINS - 1]++ ;
+        if (cycles < lat_min) lat_min = cycles ;
+        if (cycles > lat_max) lat_max = cycles ;
+        lat_sum += cycles ;
+        lat_sum_sq += (uint64_t)cycles * cycles ;
+    }
+}
+
+// The latency that fraction of the edges came within
+static uint32_t percentile(int edges, double fraction) {
+    uint64_t want = (uint64_t)ceil(edges * fraction) ;
+    uint64_t seen = 0 ;
+    for (int b=0; b<IRQ_HIST_BINS; b++) {
+        seen += histogram[b] ;
+        if (seen >= want) return b * IRQ_HIST_BIN ;
+    }
+    return IRQ_HIST_CYCLES ;
+}
+
+static void measure(const irq_run * run, const char * vga) {
+    char name[32] ;
+    snprintf(name, sizeof(name), "%s_vga_%s", run->name, vga) ;
+
+    memset(histogram, 0, sizeof(histogram)) ;
+    lat_min = 0xFFFFFFFF ;
+    lat_max = 0 ;
+    lat_sum = lat_sum_sq = 0 ;
+
+    // Both pins low, then the handler, then the edges
+    gpio_put(RESP_PIN, 0) ;
+    irq_latency_program_init(pio, sm, offset, STIM_PIN, RESP_PIN) ;
+    attach(run) ;
+    pio_sm_put_blocking(pio, sm, clock_get_hz(clk_sys) / 1000000 * IRQ_GAP_US) ;
+    pio_sm_set_enabled(pio, sm, true) ;
+
+    collect(IRQ_EDGES, run->cold) ;
+
+    pio_sm_set_enabled(pio, sm, false) ;
+    detach(run) ;
+    pio_sm_clear_fifos(pio, sm) ;
+
+    double mean = (double)lat_sum / IRQ_EDGES ;
+    double var = (double)lat_sum_sq / IRQ_EDGES - mean * mean ;
+    printf("latency,%s,%d,%u,%.1f,%u,%u,%u,%u,%.1f\n", name, IRQ_EDGES,
+           lat_min, mean, percentile(IRQ_EDGES, 0.5), percentile(IRQ_EDGES, 0.99),
+           percentile(IRQ_EDGES, 0.999), lat_max, sqrt(var > 0 ? var : 0)) ;
+    for (int b=0; b<IRQ_HIST_BINS; b++) {
+        if (histogram[b]) printf("hist,%s,%d,%u\n", name, b * IRQ_HIST_BIN, histogram[b]) ;
+    }
+}
+
+int main() {
+    // Initialize stdio
+    stdio_init_all();
+    sleep_ms(2000) ;
+    printf("# GPIO interrupt latency\n") ;
+    printf("# sysclk_hz,%u\n", (unsigned int)clock_get_hz(clk_sys)) ;
+    printf("# latency,run,edges,min,mean,p50,p99,p99.9,max,stddev\n") ;
+
+    // The response pin, for the handlers
+    gpio_init(RESP_PIN) ;
+    gpio_set_dir(RESP_PIN, GPIO_OUT) ;
+    gpio_put(RESP_PIN, 0) ;
+
+    // The stimulus and stopwatch, on PIO 1 so VGA can have PIO 0
+    sm = hw_claim_sm(pio, "irq_latency") ;
+    offset = hw_add_program(pio, &irq_latency_program, "irq_latency") ;
+
+    int i, n = sizeof(runs) / sizeof(runs[0]) ;
+    for (i=0; i<n; i++) measure(&runs[i], "off") ;
+
+    initVGA() ;
+    // Something on the screen, as the demos would have
+    fillRect(0, 0, 640, 480, BLUE) ;
+    setTextColor(WHITE) ;
+    setCursor(10, 10) ;
+    setTextSize(2) ;
+    writeString("Measuring GPIO interrupt latency") ;
+    for (i=0; i<n; i++) measure(&runs[i], "on") ;
+
+    printf("# done\n") ;
+    while (1) {
+        tight_loop_contents() ;
+    }
+}
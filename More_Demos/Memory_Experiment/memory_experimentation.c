@@ -3,21 +3,84 @@
  * 
  * Experimenting with executing code from RAM
  * 
+ * The same function three times over: in flash (the default, where it
+ * runs through the XIP cache), in main SRAM, and in core 0's scratch
+ * bank, placed with the annotations in lib/hotpath/hotpath.h. Every five
+ * seconds each one is timed cold (just after the XIP cache is flushed)
+ * and warm, and their addresses are printed. The flash copy is much
+ * slower cold, since each cache line it runs has to be read from the
+ * flash chip; the RAM copies take the same time either way.
+ * 
+ * mem_experiment.placement.txt, in the build directory, lists where
+ * everything in the program landed.
+ * 
+ * HARDWARE CONNECTIONS
+ *  - GPIO 25 ---> LED (on the board)
+ * 
+ * RESOURCES USED
+ *  - The SysTick of core 0, for timing
+ *  - A little of scratch Y, next to core 0's stack
+ * 
  */
 
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "hardware/gpio.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+#include "hotpath.h"
+
+unsigned int variable ;
+
+// A few cache lines of code (xorshift steps), showing the low bit on
+// the LED
+#define XORSHIFT(x) x ^= x << 13 ; x ^= x >> 17 ; x ^= x << 5 ;
+#define BODY(x) {                                           \
+    XORSHIFT(x) XORSHIFT(x) XORSHIFT(x) XORSHIFT(x)         \
+    XORSHIFT(x) XORSHIFT(x) XORSHIFT(x) XORSHIFT(x)         \
+    gpio_put(25, x & 1) ;                                   \
+    return x ;                                              \
+}
 
-int variable ;
+// In flash
+unsigned int function_one(unsigned int x) BODY(x)
 
-// GPIO ISR. Toggles LED
-void function_one() {
-    gpio_put(25,0) ;
+// In main SRAM
+unsigned int HOT_KERNEL(function_two)(unsigned int x) BODY(x)
+
+// In scratch Y, which only core 0 uses (for its stack)
+unsigned int HOT_CORE0(function_three)(unsigned int x) BODY(x)
+
+typedef unsigned int (*test_function)(unsigned int) ;
+
+// Cycles for one call, after flushing the XIP cache if cold. This runs
+// from RAM, so the only fetches from flash are the function's own.
+static unsigned int HOT_KERNEL(timeCall)(test_function f, int cold) {
+    if (cold) {
+        // Reading the flush register waits for the flush to finish
+        xip_ctrl_hw->flush = 1 ;
+        (void)xip_ctrl_hw->flush ;
+    }
+    // SysTick counts down, and wraps at 24 bits
+    unsigned int start = systick_hw->cvr ;
+    variable = f(variable) ;
+    return (start - systick_hw->cvr) & 0xFFFFFF ;
 }
 
-void __not_in_flash_func(function_two)() {
-    gpio_put(25,1) ;
+// Which memory an address is in
+static const char * region(const void * p) {
+    uintptr_t a = (uintptr_t)p ;
+    if ((a >> 12) == 0x20040) return "scratch X" ;
+    if ((a >> 12) == 0x20041) return "scratch Y" ;
+    if ((a >> 28) == 0x2) return "SRAM" ;
+    return "flash" ;
+}
+
+static void report(const char * name, test_function f) {
+    unsigned int cold = timeCall(f, 1) ;
+    unsigned int warm = timeCall(f, 0) ;
+    printf("%s: %08x (%s), %u cycles cold, %u warm\n", name,
+           (unsigned int)(uintptr_t)f, region((const void *)f), cold, warm) ;
 }
 
 int main() {
@@ -25,18 +88,24 @@ int main() {
     stdio_init_all();
     printf("Memory experiment\n");
 
-    // Set GPIO's 3 to output
+    // Set GPIO 25 (the LED) to output
     gpio_init(25) ;
     gpio_set_dir(25, GPIO_OUT);
 
-    // Set GPIO 3 to zero
+    // Set GPIO 25 to zero
     gpio_put(25, 0) ;
 
+    // SysTick free running at the system clock
+    systick_hw->rvr = 0xFFFFFF ;
+    systick_hw->csr = 0x5 ;
+
+    variable = 1 ;
     while (1) {
         
-        printf("Function 1: %x\n", (unsigned long int)function_one) ;
-        printf("Function 2: %x\n", (unsigned long int)function_two) ;
-        printf("Variable location: %x\n\n", (unsigned long int)&variable) ;
+        report("Function 1", function_one) ;
+        report("Function 2", function_two) ;
+        report("Function 3", function_three) ;
+        printf("Variable location: %08x (%s)\n\n", (unsigned int)(uintptr_t)&variable, region(&variable)) ;
         sleep_ms(5000) ;
     }
 
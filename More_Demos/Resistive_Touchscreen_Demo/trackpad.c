@@ -1,10 +1,22 @@
 /**
  * Hunter Adams (vha3@cornell.edu)
- * 
+ *
  * Uses resistive touchscreen to draw to VGA.
- * 
+ *
  * https://vanhunteradams.com/Pico/VGA/Trackpad.html
- * 
+ *
+ * The touchscreen driver scans the panel by DMA and queues touch events;
+ * a protothread takes them and draws, joining each point of a stroke to
+ * the one before. Along the top are the controls: a swatch for each
+ * color, CLEAR, and CAL to calibrate the panel.
+ *
+ * CALIBRATION
+ *  - Touch each of the three crosses in turn. The map is worked out from
+ *    them and saved in flash, where the other touchscreen demos find it.
+ *  - It starts by itself if there's no calibration in flash yet, and
+ *    can be run again from CAL, or by typing c on the serial port
+ *  - Once a second the scan rate, dropped events and the pressure are
+ *    printed on the serial port, to help set TOUCH_Z_MIN for a panel
  *
  * HARDWARE CONNECTIONS
  *  - GPIO 16 ---> VGA Hsync
@@ -13,11 +25,14 @@
  *  - GPIO 19 ---> 330 ohm resistor ---> VGA Green
  *  - GPIO 20 ---> 330 ohm resistor ---> VGA Blue
  *  - RP2040 GND ---> VGA GND
+ *  - Touchscreen: see lib/touchscreen/touchscreen.h
  *
  * RESOURCES USED
- *  - PIO state machines 0, 1, and 2 on PIO instance 0
- *  - DMA channels 0, 1, 2, and 3
+ *  - 3 PIO state machines on PIO instance 0, and 2 DMA channels, for
+ *    VGA (claimed from lib/hw_claim)
  *  - 153.6 kBytes of RAM (for pixel color data)
+ *  - The ADC, one more DMA channel (claimed), DMA_IRQ_0 and the last
+ *    sector of flash (touchscreen)
  *
  */
 
@@ -27,146 +42,189 @@
 #include "pico/stdlib.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
-#include "hardware/adc.h"
-
-// Attached to resistive touchscreen
-#define XMINUS 6
-#define YPLUS 7
-#define XPLUS 8
-#define YMINUS 9
-
-// Setup for reading the y coordinate
-// Y+ and Y- set to input (high impedance)
-// X+ and X- set to output
-void setupY(void) {
-
-    // direction
-    gpio_set_dir(XMINUS, GPIO_OUT) ;
-    gpio_set_dir(XPLUS, GPIO_OUT) ;
-    gpio_set_dir(YPLUS, GPIO_IN) ;
-    gpio_set_dir(YMINUS, GPIO_IN) ;
-
-    // values
-    gpio_put(XMINUS, 0);
-    gpio_put(XPLUS, 1);
-
+#include "touchscreen.h"
+#include "pt_cornell_rp2040_v1.h"
+
+// The controls along the top: a swatch per color (RED to WHITE), then
+// CLEAR and CAL
+#define TOOLBAR_H   40
+#define SWATCH_W    40
+#define CLEAR_X     440
+#define CAL_X       540
+#define BUTTON_W    100
+
+// Where the calibration crosses go (well in from the edges, and not in
+// a line)
+static const short cal_x[3] = {64, 576, 320} ;
+static const short cal_y[3] = {80, 240, 432} ;
+
+static char pen_color = WHITE ;
+static volatile char cal_requested = 0 ;
+
+static void drawButton(short x, const char * label) {
+    fillRect(x, 0, BUTTON_W, TOOLBAR_H, BLACK) ;
+    drawRect(x + 2, 2, BUTTON_W - 4, TOOLBAR_H - 4, WHITE) ;
+    setTextColor2(WHITE, BLACK) ;
+    setTextSize(2) ;
+    setCursor(x + 14, 13) ;
+    writeString((char *)label) ;
 }
 
-// Setup for reading the x coordinate
-// X+ and X- set to input (high impedance)
-// Y+ and Y- set to output
-void setupX(void) {
-
-    // direction
-    gpio_set_dir(XMINUS, GPIO_IN) ;
-    gpio_set_dir(XPLUS, GPIO_IN) ;
-    gpio_set_dir(YPLUS, GPIO_OUT) ;
-    gpio_set_dir(YMINUS, GPIO_OUT) ;
+// The toolbar, with a frame round the pen's color
+static void drawToolbar(void) {
+    char c ;
+    fillRect(0, 0, 640, TOOLBAR_H, BLACK) ;
+    for (c = RED; c <= WHITE; c++) {
+        short x = (c - RED) * SWATCH_W ;
+        fillRect(x + 4, 4, SWATCH_W - 8, TOOLBAR_H - 8, c) ;
+        if (c == pen_color) drawRect(x + 1, 1, SWATCH_W - 2, TOOLBAR_H - 2, WHITE) ;
+    }
+    drawButton(CLEAR_X, "CLEAR") ;
+    drawButton(CAL_X, "CAL") ;
+    drawHLine(0, TOOLBAR_H, 640, WHITE) ;
+}
 
-    // values
-    gpio_put(YMINUS, 0);
-    gpio_put(YPLUS, 1);
+static void drawCanvas(void) {
+    clearScreen(BLACK) ;
+    drawToolbar() ;
+}
 
+// A touch on the toolbar
+static void pressControl(short x) {
+    if (x < (WHITE - RED + 1) * SWATCH_W) {
+        pen_color = RED + x / SWATCH_W ;
+        drawToolbar() ;
+    }
+    else if ((x >= CLEAR_X) && (x < CLEAR_X + BUTTON_W)) drawCanvas() ;
+    else if ((x >= CAL_X) && (x < CAL_X + BUTTON_W)) cal_requested = 1 ;
 }
 
-// Selects between measuring x/y coord
-volatile int chooser;
-
-// Raw ADC measurements
-volatile uint adc_x_raw ;
-volatile uint adc_y_raw ;
-
-// X/Y buffers for filtering
-volatile uint xarray[16] ;
-volatile uint yarray[16] ;
-
-// Accumulation and output of filter
-volatile float xout ;
-volatile float yout ;
-volatile int xret ;
-volatile int yret ;
-
-// Pointer to index in sample buffer
-unsigned char xpointer = 0 ;
-unsigned char ypointer = 0 ;
-
-// Timer ISR
-bool repeating_timer_callback(struct repeating_timer *t) {
-    // Read X coord
-    if (chooser == 1) {
-        setupX() ;
-        adc_select_input(0);
-        adc_x_raw = adc_read();
-
-        xarray[xpointer & 0x0F] = adc_x_raw ;
-
-        xout = 0 ;
-        xret = 0 ;
-        for (int i=0; i<16; i++) {
-            xout += xarray[i] ;
+// Calibrate: the average raw reading of a touch on each cross, mapped to
+// where the cross is
+static PT_THREAD (calibrate(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    static int raw_x[3], raw_y[3] ;
+    static int point, sum_x, sum_y, n ;
+    static touch_event e ;
+    for (point=0; point<3; point++) {
+        clearScreen(BLACK) ;
+        setTextColor2(WHITE, BLACK) ;
+        setTextSize(2) ;
+        setCursor(200, 220) ;
+        writeString("Touch the cross") ;
+        drawHLine(cal_x[point] - 10, cal_y[point], 21, WHITE) ;
+        drawVLine(cal_x[point], cal_y[point] - 10, 21, WHITE) ;
+
+        // Average the whole of one touch (up events count once there's
+        // been a touch, so the one that asked for this is let go first)
+        sum_x = sum_y = n = 0 ;
+        while (1) {
+            PT_YIELD_UNTIL(pt, touch_get_event(&e)) ;
+            if (e.type != TOUCH_UP) {
+                sum_x += e.raw_x ;
+                sum_y += e.raw_y ;
+                n++ ;
+            }
+            else if (n) break ;
         }
-        xret = ((uint)(xout))>>4 ;
-
-        xpointer += 1 ;
+        raw_x[point] = sum_x / n ;
+        raw_y[point] = sum_y / n ;
+    }
 
-        chooser = 0 ;
+    touch_calibration cal ;
+    if (touch_cal_compute(&cal, raw_x, raw_y, cal_x, cal_y)) {
+        touch_cal_set(&cal) ;
+        touch_cal_save() ;
+        sprintf(pt_serial_out_buffer, "calibrated: %ld %ld %ld / %ld %ld %ld\r\n",
+                (long)cal.a, (long)cal.b, (long)cal.c, (long)cal.d, (long)cal.e, (long)cal.f) ;
     }
-    // Read Y coord
     else {
-        setupY() ;
-        adc_select_input(1);
-        adc_y_raw = adc_read();
-
-        yarray[ypointer & 0x0F] = adc_y_raw ;
+        sprintf(pt_serial_out_buffer, "calibration failed (points too close), kept the old one\r\n") ;
+    }
+    serial_write ;
+    PT_END(pt);
+}
 
-        yout = 0 ;
-        yret = 0 ;
-        for (int i=0; i<16; i++) {
-            yout += yarray[i] ;
+// The controls and the strokes, as the events come in
+static PT_THREAD (protothread_draw(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    static struct pt pt_cal ;
+    static touch_event e ;
+    static char drawing = 0 ;
+    static short last_x, last_y ;
+    drawCanvas() ;
+    while(1) {
+        PT_YIELD_UNTIL(pt, cal_requested || touch_get_event(&e)) ;
+        if (cal_requested) {
+            PT_SPAWN(pt, &pt_cal, calibrate(&pt_cal)) ;
+            cal_requested = 0 ;
+            drawing = 0 ;
+            drawCanvas() ;
+            continue ;
         }
-        yret = ((uint)(yout))>>4 ;
-
-        ypointer += 1 ;
-
-        chooser = 1 ;
+        // A stroke starts on the canvas, and stays on it
+        if (e.type == TOUCH_DOWN) {
+            drawing = (e.y > TOOLBAR_H) ;
+            if (!drawing) pressControl(e.x) ;
+            else drawPixel(e.x, e.y, pen_color) ;
+        }
+        else if (drawing && (e.type == TOUCH_MOVE)) {
+            if (e.y <= TOOLBAR_H) e.y = TOOLBAR_H + 1 ;
+            drawLine(last_x, last_y, e.x, e.y, pen_color) ;
+        }
+        else drawing = 0 ;
+        last_x = e.x ;
+        last_y = e.y ;
     }
+    PT_END(pt);
+}
 
-    // Scale and draw to VGA
-    if ((xret<3500) && (xret>1500) && (yret<2600) && (yret>1700)) {
-        drawPixel(640-(((xret - 1500) * (640)) / (3500 - 1500)),
-            (((yret - 1700) * (480)) / (2600 - 1700)), WHITE) ;
+// c to calibrate
+static PT_THREAD (protothread_serial(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    while(1) {
+        serial_read ;
+        if (pt_serial_in_buffer[0] == 'c') cal_requested = 1 ;
     }
+    PT_END(pt);
 }
 
+// Report the scan rate, any events that didn't fit in the queue, and the
+// pressure
+static PT_THREAD (protothread_stats(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    static unsigned int last_scans = 0 ;
+    while(1) {
+        PT_YIELD_usec(1000000) ;
+        unsigned int now = touch_scans() ;
+        sprintf(pt_serial_out_buffer, "scans/s %u, dropped %u, pressure %d\r\n",
+                now - last_scans, touch_dropped, touch_pressure()) ;
+        last_scans = now ;
+        serial_write ;
+    }
+    PT_END(pt);
+}
 
 int main() {
 
     // Initialize stdio
     stdio_init_all();
 
-    // Initialize ADC
-    adc_init();
-    // Make sure GPIO is high-impedance, no pullups etc
-    adc_gpio_init(26);
-    adc_gpio_init(27);
-
     // Initialize the VGA screen
     initVGA() ;
 
-    // Initialize GPIO
-    gpio_init(XMINUS) ;
-    gpio_init(YPLUS) ;
-    gpio_init(XPLUS) ;
-    gpio_init(YMINUS) ;
+    // Initialize the touchscreen (ADC, GPIO, its DMA channel and the
+    // calibration), and calibrate if there wasn't one to load
+    touch_init() ;
+    cal_requested = !touch_cal_load() ;
 
-    // Repeating timer struct
-    struct repeating_timer timer;
-
-    // Negative delay so means we will call repeating_timer_callback, and call it again
-    // 25us (40kHz) later regardless of how long the callback took to execute
-    add_repeating_timer_us(-500, repeating_timer_callback, NULL, &timer);
-
-    while(1) {
-    }
+    pt_add_thread(protothread_draw) ;
+    pt_add_thread(protothread_serial) ;
+    pt_add_thread(protothread_stats) ;
+    pt_schedule_start ;
 
 }
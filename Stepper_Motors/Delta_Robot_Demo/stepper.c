@@ -1,4 +1,3 @@
-
 /**
  * V. Hunter Adams
  * vha3@cornell.edu
@@ -8,165 +7,96 @@
  * driver, which moves a 3D-printed delta robot thru
  * a sample maneuver.
  * 
+ * The maneuver is a list of straight lines for the
+ * effector. The stepper library's motion queue turns
+ * each into short segments, with every motor paced to
+ * finish each segment together, so the effector moves
+ * in straight lines rather than one motor at a time.
+ * 
  * See link below.
  * 
  * https://vanhunteradams.com/Pico/Steppers/Lorenz.html#Delta-Robot
  * 
 */
 
-#include "motor_library.h"
+#include <stdio.h>
 #include <math.h>
+#include "pico/stdlib.h"
+#include "stepper_motion.h"
+#include "delta_kinematics.h"
 
 #define MOTOR1_IN1 2
 #define MOTOR2_IN1 6
 #define MOTOR3_IN1 10
-// #define MOTOR4_IN1 14
 
-volatile int state1 = 0 ;
-volatile int state2 = 0 ;
-volatile int state3 = 0 ;
-// volatile int state4 = 0 ;
+stepper_t motors[3] ;
 
+// Effector height when the motors are at step 0 (mm), and the drawing
+// height below it
+#define HOME_Z -100.0f
+#define DRAW_Z -125.0f
 
-void pio0_interrupt_handler() {
-    pio_interrupt_clear(pio_0, 1) ;
-    if (state1 == 0) {
-        SET_DIRECTION_MOTOR_1(COUNTERCLOCKWISE) ;
-        state1 = 1 ;
-        MOVE_STEPS_MOTOR_1(600) ;
-    }
-    else if (state1 == 1) {
-        SET_DIRECTION_MOTOR_1(CLOCKWISE) ;
-        state1 = 2 ;
-        MOVE_STEPS_MOTOR_1(200) ;
-    }
-    else if (state1 == 2) {
-        SET_DIRECTION_MOTOR_1(COUNTERCLOCKWISE) ;
-        state1 = 3 ;
-        MOVE_STEPS_MOTOR_1(200) ;
-    }
-    else if (state1 == 3) {
-        SET_DIRECTION_MOTOR_1(STOPPED) ;
-        state1 = 4 ;
-        MOVE_STEPS_MOTOR_1(800) ;
-    }
-    else if (state1 == 4) {
-        SET_DIRECTION_MOTOR_1(CLOCKWISE) ;
-        state1 = 5 ;
-        MOVE_STEPS_MOTOR_1(800) ;
-    }
-    else if (state1 == 5) {
-        SET_DIRECTION_MOTOR_1(COUNTERCLOCKWISE) ;
-        state1 = 6 ;
-        MOVE_STEPS_MOTOR_1(200) ;
-    }
-    else {
-        SET_DIRECTION_MOTOR_1(STOPPED) ;
-        state1 = 0 ;
-        MOVE_STEPS_MOTOR_1(1000) ;
-    }
-    // MOVE_STEPS_MOTOR_1(600) ;
-}
+// Speed along the path (mm/s)
+#define SPEED 40.0f
 
-void pio0_interrupt_handler_2() {
-    pio_interrupt_clear(pio_0, 0) ;
-    if (state3 == 0) {
-        SET_DIRECTION_MOTOR_3(COUNTERCLOCKWISE) ;
-        state3 = 1 ;
-        MOVE_STEPS_MOTOR_3(600) ;
-    }
-    else if (state3 == 1) {
-        SET_DIRECTION_MOTOR_3(STOPPED) ;
-        state3 = 2 ;
-        MOVE_STEPS_MOTOR_3(400) ;
-    }
-    else if (state3 == 2) {
-        SET_DIRECTION_MOTOR_3(CLOCKWISE) ;
-        state3 = 3 ;
-        MOVE_STEPS_MOTOR_3(200) ;
-    }
-    else if (state3 == 3) {
-        SET_DIRECTION_MOTOR_3(COUNTERCLOCKWISE) ;
-        state3 = 4 ;
-        MOVE_STEPS_MOTOR_3(200) ;
-    }
-    else if (state3 == 4) {
-        SET_DIRECTION_MOTOR_3(STOPPED) ;
-        state3 = 5 ;
-        MOVE_STEPS_MOTOR_3(400) ;
-    }
-    else if (state3 == 5) {
-        SET_DIRECTION_MOTOR_3(CLOCKWISE) ;
-        state3 = 6 ;
-        MOVE_STEPS_MOTOR_3(800) ;
-    }
-    else if (state3 == 6) {
-        SET_DIRECTION_MOTOR_3(COUNTERCLOCKWISE) ;
-        state3 = 7 ;
-        MOVE_STEPS_MOTOR_3(200) ;
-    }
-    else {
-        SET_DIRECTION_MOTOR_3(STOPPED) ;
-        state3 = 0 ;
-        MOVE_STEPS_MOTOR_3(1000) ;
-    }
-    // MOVE_STEPS_MOTOR_3(600) ;
-}
+// The robot's dimensions (mm). Half steps of a 28BYJ-48 are 4096 a turn.
+delta_geometry geometry = {
+    .base = 120.0f,
+    .effector = 40.0f,
+    .upper = 50.0f,
+    .lower = 120.0f,
+    .steps_per_radian = 4096.0f / 6.2831853f,
+} ;
 
-void pio1_interrupt_handler() {
-    pio_interrupt_clear(pio_1, 1) ;
-    if (state2 == 0) {
-        SET_DIRECTION_MOTOR_2(COUNTERCLOCKWISE) ;
-        state2 = 1 ;
-        MOVE_STEPS_MOTOR_2(600) ;
-    }
-    else if (state2 == 1) {
-        SET_DIRECTION_MOTOR_2(STOPPED) ;
-        state2 = 2 ;
-        MOVE_STEPS_MOTOR_2(800) ;
-    }
-    else if (state2 == 2) {
-        SET_DIRECTION_MOTOR_2(CLOCKWISE) ;
-        state2 = 3 ;
-        MOVE_STEPS_MOTOR_2(200) ;
-    }
-    else if (state2 == 3) {
-        SET_DIRECTION_MOTOR_2(COUNTERCLOCKWISE) ;
-        state2 = 4 ;
-        MOVE_STEPS_MOTOR_2(200) ;
-    }
-    else if (state2 == 4) {
-        SET_DIRECTION_MOTOR_2(CLOCKWISE) ;
-        state2 = 5 ;
-        MOVE_STEPS_MOTOR_2(800) ;
-    }
-    else if (state2 == 5) {
-        SET_DIRECTION_MOTOR_2(COUNTERCLOCKWISE) ;
-        state2 = 6 ;
-        MOVE_STEPS_MOTOR_2(200) ;
-    }
-    else {
-        SET_DIRECTION_MOTOR_2(STOPPED) ;
-        state2 = 0 ;
-        MOVE_STEPS_MOTOR_2(1000) ;
+delta_robot robot = {
+    .max_rate = 900.0f,
+} ;
+
+// Down, a square, a circle, and back up
+void maneuver() {
+    delta_move_to(&robot, 0.0f, 0.0f, DRAW_Z, SPEED) ;
+    motion_queue_dwell(0.5f) ;
+
+    delta_move_to(&robot, 25.0f, 25.0f, DRAW_Z, SPEED) ;
+    delta_move_to(&robot, -25.0f, 25.0f, DRAW_Z, SPEED) ;
+    delta_move_to(&robot, -25.0f, -25.0f, DRAW_Z, SPEED) ;
+    delta_move_to(&robot, 25.0f, -25.0f, DRAW_Z, SPEED) ;
+    delta_move_to(&robot, 25.0f, 25.0f, DRAW_Z, SPEED) ;
+    motion_queue_dwell(0.5f) ;
+
+    delta_move_to(&robot, 25.0f, 0.0f, DRAW_Z, SPEED) ;
+    for (int i=1; i<=36; i++) {
+        float angle = (float)i * 6.2831853f / 36.0f ;
+        delta_move_to(&robot, 25.0f * cosf(angle), 25.0f * sinf(angle), DRAW_Z, SPEED) ;
     }
-    // MOVE_STEPS_MOTOR_2(600) ;
-}
+    motion_queue_dwell(0.5f) ;
 
+    delta_move_to(&robot, 0.0f, 0.0f, HOME_Z, SPEED) ;
+    motion_queue_dwell(1.0f) ;
+}
 
 int main() {
     stdio_init_all();
 
-    // Setup each motor
-    setupMotor1(MOTOR1_IN1, pio0_interrupt_handler) ;
-    setupMotor2(MOTOR2_IN1, pio1_interrupt_handler) ;
-    setupMotor3(MOTOR3_IN1, pio0_interrupt_handler_2) ;
-    
-    // Call the interrupt handlers
-    pio1_interrupt_handler() ;
-    pio0_interrupt_handler() ;
-    pio0_interrupt_handler_2() ;
+    // A state machine and two DMA channels each
+    const unsigned int pins[3] = {MOTOR1_IN1, MOTOR2_IN1, MOTOR3_IN1} ;
+    for (int i=0; i<3; i++) {
+        if (!stepper_init(&motors[i], pins[i])) {
+            printf("No state machine or DMA channel for motor %d\n", i + 1) ;
+            while (true) {
+            }
+        }
+        motion_add_axis(i, &motors[i]) ;
+    }
+
+    if (delta_init(&robot, &geometry, 0.0f, 0.0f, HOME_Z)) {
+        printf("Home position is out of reach\n") ;
+        while (true) {
+        }
+    }
 
+    // Queueing waits for room, so this keeps the queue full
     while (true) {
+        maneuver() ;
     }
 }
@@ -10,9 +10,11 @@
 #include "hardware/pio.h"
 #include "hardware/dma.h"
 #include "hardware/irq.h"
+#include "hw_claim.h"
 #include "stepper.pio.h"
 #include "pacer.pio.h"
 #include "counter.pio.h"
+#include "stepper_profile.h"
 
 // Some macros for motor direction
 #define COUNTERCLOCKWISE 2
@@ -40,24 +42,39 @@ unsigned char * address_pointer_motor2 = &pulse_sequence_forward[0] ;
 unsigned int * pulse_length_motor2_address_pointer = &pulse_length_motor2 ;
 unsigned int * pulse_count_motor2_address_pointer = &pulse_count_motor2 ;
 
+// Whether each motor's pacer is running an acceleration profile rather
+// than looping on its pulse length
+int profiled_motor1 = 0 ;
+int profiled_motor2 = 0 ;
+
 // Macros for setting motor steps, speed, and direction (motor1)
-#define MOVE_STEPS_MOTOR_1(a) pulse_count_motor1=a; dma_channel_start(dma_chan_4)
+#define MOVE_STEPS_MOTOR_1(a) pulse_count_motor1=a; if (profiled_motor1) resumeSpeed(pio_0, dma_chan_2, dma_chan_3, pulse_length_motor1_address_pointer, &profiled_motor1); dma_channel_start(dma_chan_4)
 #define SET_SPEED_MOTOR_1(a) pulse_length_motor1=a
 #define SET_DIRECTION_MOTOR_1(a) address_pointer_motor1 = (a==2) ? &pulse_sequence_forward[0] : (a==1) ? &pulse_sequence_backward[0] : &pulse_sequence_stationary[0]
 
 // Macros for setting motor steps, speed, and direction (motor2)
-#define MOVE_STEPS_MOTOR_2(a) pulse_count_motor2=a; dma_channel_start(dma_chan_9)
+#define MOVE_STEPS_MOTOR_2(a) pulse_count_motor2=a; if (profiled_motor2) resumeSpeed(pio_1, dma_chan_7, dma_chan_8, pulse_length_motor2_address_pointer, &profiled_motor2); dma_channel_start(dma_chan_9)
 #define SET_SPEED_MOTOR_2(a) pulse_length_motor2=a
 #define SET_DIRECTION_MOTOR_2(a) address_pointer_motor2 = (a==2) ? &pulse_sequence_forward[0] : (a==1) ? &pulse_sequence_backward[0] : &pulse_sequence_stationary[0]
 
+// Macros for moving with an acceleration profile (stepper_profile.h), one
+// pacer count per step. Start it with the motor stopped (from the ISR
+// that ends the last move, say), and leave the profile alone until the
+// move is done. The next MOVE_STEPS goes back to the pulse length.
+#define MOVE_PROFILE_MOTOR_1(p) moveProfile(pio_0, pacer_offset_motor1, dma_chan_2, dma_chan_3, dma_chan_4, &pulse_count_motor1, &profiled_motor1, p)
+#define MOVE_PROFILE_MOTOR_2(p) moveProfile(pio_1, pacer_offset_motor2, dma_chan_7, dma_chan_8, dma_chan_9, &pulse_count_motor2, &profiled_motor2, p)
+
 // Choose pio0 or pio1 (we'll have a motor on each)
 PIO pio_0 = pio0;
 PIO pio_1 = pio1;
 
-// Select state machines
-int pulse_sm = 0;
-int pacer_sm = 1;
-int count_sm = 2;
+// State machines, [0] on pio_0 (motor 1) and [1] on pio_1 (motor 2).
+// The programs signal each other with their PIO's IRQ flags 6 and 7,
+// and the CPU with flag 0 (all claimed from lib/hw_claim), and each
+// motor takes three state machines, so each has a PIO to itself.
+int pulse_sm[2];
+int pacer_sm[2];
+int count_sm[2];
 
 // DMA channels
 // 0 sends pulse train data to motor 1, 1 reconfigures and restarts 0
@@ -67,33 +84,85 @@ int count_sm = 2;
 // 5 sends pulse train data to motor 2, 6 reconfigures and restarts 0
 // 7 sends pulse length data to motor 2, 8 reconfigures and restarts 2
 // 9 sends step count to motor 2 (channel started in software)
-int dma_chan_0 = 0;
-int dma_chan_1 = 1;
-int dma_chan_2 = 2;
-int dma_chan_3 = 3;
-int dma_chan_4 = 4;
-int dma_chan_5 = 5;
-int dma_chan_6 = 6;
-int dma_chan_7 = 7;
-int dma_chan_8 = 8;
-int dma_chan_9 = 9;
+//
+// (All claimed from lib/hw_claim by setupMotor1() and setupMotor2())
+int dma_chan_0, dma_chan_1, dma_chan_2, dma_chan_3, dma_chan_4 ;
+int dma_chan_5, dma_chan_6, dma_chan_7, dma_chan_8, dma_chan_9 ;
+
+// Where the pacer program is on each PIO
+uint pacer_offset_motor1 ;
+uint pacer_offset_motor2 ;
+
+// Stream a profile's pacer counts to the pacer, and move that many steps.
+// The data channel stops chaining to its control channel before either
+// is aborted, so the pulse length loop can't restart itself, and the
+// pacer is restarted so that the first step waits for the first count
+// (not the rest of one from the loop).
+void moveProfile(PIO pio, uint pacer_offset, int data_chan, int ctrl_chan, int count_chan,
+                 unsigned int * count, int * profiled, const stepper_profile * p) {
+    if (p->steps <= 0) return ;
+
+    dma_channel_config c = dma_get_channel_config(data_chan) ;
+    channel_config_set_read_increment(&c, true) ;
+    channel_config_set_chain_to(&c, data_chan) ;
+    dma_channel_set_config(data_chan, &c, false) ;
+    dma_channel_abort(ctrl_chan) ;
+    dma_channel_abort(data_chan) ;
+
+    uint sm = pacer_sm[pio_get_index(pio)] ;
+    pio_sm_set_enabled(pio, sm, false) ;
+    pio_sm_clear_fifos(pio, sm) ;
+    pio_sm_restart(pio, sm) ;
+    pio_sm_exec(pio, sm, pio_encode_jmp(pacer_offset)) ;
+    pio_sm_set_enabled(pio, sm, true) ;
+
+    dma_channel_transfer_from_buffer_now(data_chan, p->delays, p->steps) ;
+    *profiled = 1 ;
+
+    // The counter makes one step more than it's sent
+    *count = p->steps - 1 ;
+    dma_channel_start(count_chan) ;
+}
+
+// Back to looping on the pulse length. If a profile is still being sent,
+// the rest of its steps are at the pulse length.
+void resumeSpeed(PIO pio, int data_chan, int ctrl_chan, unsigned int * length, int * profiled) {
+    dma_channel_abort(data_chan) ;
+    dma_channel_config c = dma_get_channel_config(data_chan) ;
+    channel_config_set_read_increment(&c, false) ;
+    channel_config_set_chain_to(&c, ctrl_chan) ;
+    dma_channel_configure(data_chan, &c, &pio->txf[pacer_sm[pio_get_index(pio)]], length, 1, true) ;
+    *profiled = 0 ;
+}
 
 
 void setupMotor1(unsigned int in1, irq_handler_t handler) {
-    // Load PIO programs onto PIO0
-    uint pio0_offset_0 = pio_add_program(pio_0, &stepper_program);
-    uint pio0_offset_1 = pio_add_program(pio_0, &pacer_program);
-    uint pio0_offset_2 = pio_add_program(pio_0, &counter_program);
+    // Claim state machines and DMA channels, and load PIO programs onto PIO0
+    pulse_sm[0] = hw_claim_sm(pio_0, "motor 1");
+    pacer_sm[0] = hw_claim_sm(pio_0, "motor 1");
+    count_sm[0] = hw_claim_sm(pio_0, "motor 1");
+    dma_chan_0 = hw_claim_dma("motor 1");
+    dma_chan_1 = hw_claim_dma("motor 1");
+    dma_chan_2 = hw_claim_dma("motor 1");
+    dma_chan_3 = hw_claim_dma("motor 1");
+    dma_chan_4 = hw_claim_dma("motor 1");
+    uint pio0_offset_0 = hw_add_program(pio_0, &stepper_program, "motor 1");
+    uint pio0_offset_1 = hw_add_program(pio_0, &pacer_program, "motor 1");
+    pacer_offset_motor1 = pio0_offset_1 ;
+    uint pio0_offset_2 = hw_add_program(pio_0, &counter_program, "motor 1");
+    hw_claim_pio_irq(pio_0, 0, "motor 1");
+    hw_claim_pio_irq(pio_0, 6, "motor 1");
+    hw_claim_pio_irq(pio_0, 7, "motor 1");
 
     // Initialize PIO programs
-    stepper_program_init(pio_0, pulse_sm, pio0_offset_0, in1);
-    pacer_program_init(pio_0, pacer_sm, pio0_offset_1);
-    counter_program_init(pio_0, count_sm, pio0_offset_2) ;
+    stepper_program_init(pio_0, pulse_sm[0], pio0_offset_0, in1);
+    pacer_program_init(pio_0, pacer_sm[0], pio0_offset_1);
+    counter_program_init(pio_0, count_sm[0], pio0_offset_2) ;
 
     // Start the PIO programs
-    pio_sm_set_enabled(pio_0, pulse_sm, true);
-    pio_sm_set_enabled(pio_0, pacer_sm, true);
-    pio_sm_set_enabled(pio_0, count_sm, true);
+    pio_sm_set_enabled(pio_0, pulse_sm[0], true);
+    pio_sm_set_enabled(pio_0, pacer_sm[0], true);
+    pio_sm_set_enabled(pio_0, count_sm[0], true);
 
     // Setup interrupts
     pio_interrupt_clear(pio_0, 0) ;
@@ -110,13 +179,13 @@ void setupMotor1(unsigned int in1, irq_handler_t handler) {
     channel_config_set_transfer_data_size(&c0, DMA_SIZE_8);              // 32-bit txfers
     channel_config_set_read_increment(&c0, true);                        // no read incrementing
     channel_config_set_write_increment(&c0, false);                      // no write incrementing
-    channel_config_set_dreq(&c0, DREQ_PIO0_TX0) ;                        // DREQ_PIO0_TX0 pacing (FIFO)
+    channel_config_set_dreq(&c0, pio_get_dreq(pio_0, pulse_sm[0], true)); // stepper TX FIFO pacing
     channel_config_set_chain_to(&c0, dma_chan_1);                        // chain to other channel
 
     dma_channel_configure(
         dma_chan_0,                 // Channel to be configured
         &c0,                        // The configuration we just created
-        &pio_0->txf[pulse_sm],        // write address (stepper PIO TX FIFO)
+        &pio_0->txf[pulse_sm[0]],        // write address (stepper PIO TX FIFO)
         address_pointer_motor1,
         8,                          // Number of transfers; in this case each is 4 byte.
         false                       // Don't start immediately.
@@ -145,13 +214,13 @@ void setupMotor1(unsigned int in1, irq_handler_t handler) {
     channel_config_set_transfer_data_size(&c2, DMA_SIZE_32);              // 32-bit txfers
     channel_config_set_read_increment(&c2, false);                        // no read incrementing
     channel_config_set_write_increment(&c2, false);                      // no write incrementing
-    channel_config_set_dreq(&c2, DREQ_PIO0_TX1) ;                        // DREQ_PIO0_TX1 pacing (FIFO)
+    channel_config_set_dreq(&c2, pio_get_dreq(pio_0, pacer_sm[0], true)); // pacer TX FIFO pacing
     channel_config_set_chain_to(&c2, dma_chan_3);                        // chain to other channel
 
     dma_channel_configure(
         dma_chan_2,                 // Channel to be configured
         &c2,                        // The configuration we just created
-        &pio_0->txf[pacer_sm],        // write address (pacer PIO TX FIFO)
+        &pio_0->txf[pacer_sm[0]],        // write address (pacer PIO TX FIFO)
         pulse_length_motor1_address_pointer,
         1,                          // Number of transfers; in this case each is 4 byte.
         false                       // Don't start immediately.
@@ -184,7 +253,7 @@ void setupMotor1(unsigned int in1, irq_handler_t handler) {
     dma_channel_configure(
         dma_chan_4,                 // Channel to be configured
         &c4,                        // The configuration we just created
-        &pio_0->txf[count_sm],        // write address (pacer PIO TX FIFO)
+        &pio_0->txf[count_sm[0]],        // write address (pacer PIO TX FIFO)
         pulse_count_motor1_address_pointer,
         1,                          // Number of transfers; in this case each is 4 byte.
         false                       // Don't start immediately.
@@ -196,18 +265,30 @@ void setupMotor1(unsigned int in1, irq_handler_t handler) {
 
 void setupMotor2(unsigned int in1, irq_handler_t handler) {
 
-    // Load PIO programs onto PIO1
-    uint pio1_offset_0 = pio_add_program(pio_1, &stepper_program);
-    uint pio1_offset_1 = pio_add_program(pio_1, &pacer_program);
-    uint pio1_offset_2 = pio_add_program(pio_1, &counter_program);
-
-    stepper_program_init(pio_1, pulse_sm, pio1_offset_0, in1);
-    pacer_program_init(pio_1, pacer_sm, pio1_offset_1);
-    counter_program_init(pio_1, count_sm, pio1_offset_2) ;
-
-    pio_sm_set_enabled(pio_1, pulse_sm, true);
-    pio_sm_set_enabled(pio_1, pacer_sm, true);
-    pio_sm_set_enabled(pio_1, count_sm, true);
+    // Claim state machines and DMA channels, and load PIO programs onto PIO1
+    pulse_sm[1] = hw_claim_sm(pio_1, "motor 2");
+    pacer_sm[1] = hw_claim_sm(pio_1, "motor 2");
+    count_sm[1] = hw_claim_sm(pio_1, "motor 2");
+    dma_chan_5 = hw_claim_dma("motor 2");
+    dma_chan_6 = hw_claim_dma("motor 2");
+    dma_chan_7 = hw_claim_dma("motor 2");
+    dma_chan_8 = hw_claim_dma("motor 2");
+    dma_chan_9 = hw_claim_dma("motor 2");
+    uint pio1_offset_0 = hw_add_program(pio_1, &stepper_program, "motor 2");
+    uint pio1_offset_1 = hw_add_program(pio_1, &pacer_program, "motor 2");
+    pacer_offset_motor2 = pio1_offset_1 ;
+    uint pio1_offset_2 = hw_add_program(pio_1, &counter_program, "motor 2");
+    hw_claim_pio_irq(pio_1, 0, "motor 2");
+    hw_claim_pio_irq(pio_1, 6, "motor 2");
+    hw_claim_pio_irq(pio_1, 7, "motor 2");
+
+    stepper_program_init(pio_1, pulse_sm[1], pio1_offset_0, in1);
+    pacer_program_init(pio_1, pacer_sm[1], pio1_offset_1);
+    counter_program_init(pio_1, count_sm[1], pio1_offset_2) ;
+
+    pio_sm_set_enabled(pio_1, pulse_sm[1], true);
+    pio_sm_set_enabled(pio_1, pacer_sm[1], true);
+    pio_sm_set_enabled(pio_1, count_sm[1], true);
 
     pio_interrupt_clear(pio_1, 0) ;
     pio_set_irq0_source_enabled(pio_1, PIO_INTR_SM0_LSB, true) ;
@@ -223,13 +304,13 @@ void setupMotor2(unsigned int in1, irq_handler_t handler) {
     channel_config_set_transfer_data_size(&c5, DMA_SIZE_8);              // 32-bit txfers
     channel_config_set_read_increment(&c5, true);                        // no read incrementing
     channel_config_set_write_increment(&c5, false);                      // no write incrementing
-    channel_config_set_dreq(&c5, DREQ_PIO1_TX0) ;                        // DREQ_PIO0_TX0 pacing (FIFO)
+    channel_config_set_dreq(&c5, pio_get_dreq(pio_1, pulse_sm[1], true)); // stepper TX FIFO pacing
     channel_config_set_chain_to(&c5, dma_chan_6);                        // chain to other channel
 
     dma_channel_configure(
         dma_chan_5,                 // Channel to be configured
         &c5,                        // The configuration we just created
-        &pio_1->txf[pulse_sm],        // write address (stepper PIO TX FIFO)
+        &pio_1->txf[pulse_sm[1]],        // write address (stepper PIO TX FIFO)
         address_pointer_motor2,
         8,                          // Number of transfers; in this case each is 4 byte.
         false                       // Don't start immediately.
@@ -258,13 +339,13 @@ void setupMotor2(unsigned int in1, irq_handler_t handler) {
     channel_config_set_transfer_data_size(&c7, DMA_SIZE_32);              // 32-bit txfers
     channel_config_set_read_increment(&c7, false);                        // no read incrementing
     channel_config_set_write_increment(&c7, false);                      // no write incrementing
-    channel_config_set_dreq(&c7, DREQ_PIO1_TX1) ;                        // DREQ_PIO0_TX1 pacing (FIFO)
+    channel_config_set_dreq(&c7, pio_get_dreq(pio_1, pacer_sm[1], true)); // pacer TX FIFO pacing
     channel_config_set_chain_to(&c7, dma_chan_8);                        // chain to other channel
 
     dma_channel_configure(
         dma_chan_7,                 // Channel to be configured
         &c7,                        // The configuration we just created
-        &pio_1->txf[pacer_sm],        // write address (pacer PIO TX FIFO)
+        &pio_1->txf[pacer_sm[1]],        // write address (pacer PIO TX FIFO)
         pulse_length_motor2_address_pointer,
         1,                          // Number of transfers; in this case each is 4 byte.
         false                       // Don't start immediately.
@@ -297,7 +378,7 @@ void setupMotor2(unsigned int in1, irq_handler_t handler) {
     dma_channel_configure(
         dma_chan_9,                 // Channel to be configured
         &c9,                        // The configuration we just created
-        &pio_1->txf[count_sm],        // write address (pacer PIO TX FIFO)
+        &pio_1->txf[count_sm[1]],        // write address (pacer PIO TX FIFO)
         pulse_count_motor2_address_pointer,
         1,                          // Number of transfers; in this case each is 4 byte.
         false                       // Don't start immediately.
@@ -11,10 +11,16 @@
  * 
  * https://vanhunteradams.com/Pico/Steppers/Lorenz.html
  * 
+ * With PROFILED_MOVES set, the motors instead turn back
+ * and forth, half a turn each way, speeding up and slowing
+ * down with an acceleration profile that DMA streams to
+ * the pacer.
+ * 
  * 
 */
 
 #include "motor_library.h"
+#include "hardware/clocks.h"
 #include <math.h>
 
 #define MOTOR1_IN1 2
@@ -24,6 +30,16 @@
 
 #define Fs 50.0
 
+// 1 for back and forth moves with acceleration profiles, 0 for the
+// Lorenz curve. PROFILE_SCURVE picks the S-curve over the trapezoid.
+#define PROFILED_MOVES 0
+#define PROFILE_SCURVE 1
+#define PROFILE_STEPS 2048
+
+// One profile, shared by both motors (the DMA only reads it)
+unsigned int profile_delays[PROFILE_STEPS] ;
+stepper_profile profile ;
+
 // Variables to hold motor speed
 volatile unsigned int motorspeed = 125000;
 volatile unsigned int motorspeed2 = 125000 ;
@@ -134,6 +150,20 @@ bool repeating_timer_callback(struct repeating_timer *t) {
 }
 
 // Position control interrupts
+#if PROFILED_MOVES
+void pio0_interrupt_handler() {
+    pio_interrupt_clear(pio_0, 0) ;
+    direction = !direction ;
+    SET_DIRECTION_MOTOR_1(direction ? CLOCKWISE : COUNTERCLOCKWISE) ;
+    MOVE_PROFILE_MOTOR_1(&profile) ;
+}
+void pio1_interrupt_handler() {
+    pio_interrupt_clear(pio_1, 0) ;
+    direction2 = !direction2 ;
+    SET_DIRECTION_MOTOR_2(direction2 ? CLOCKWISE : COUNTERCLOCKWISE) ;
+    MOVE_PROFILE_MOTOR_2(&profile) ;
+}
+#else
 void pio0_interrupt_handler() {
     pio_interrupt_clear(pio_0, 0) ;
     MOVE_STEPS_MOTOR_1(0xFFFFFFFF) ;
@@ -142,6 +172,7 @@ void pio1_interrupt_handler() {
     pio_interrupt_clear(pio_1, 0) ;
     MOVE_STEPS_MOTOR_2(0xFFFFFFFF) ;
 }
+#endif
 
 int main() {
     stdio_init_all();
@@ -150,12 +181,23 @@ int main() {
     setupMotor1(MOTOR1_IN1, pio0_interrupt_handler) ;
     setupMotor2(MOTOR2_IN1, pio1_interrupt_handler) ;
 
+#if PROFILED_MOVES
+    // Half a turn (half steps) from 100 to 1000 steps/s and back, at
+    // 2000 steps/s^2
+    stepper_profile_init(&profile, profile_delays, PROFILE_STEPS, (float)clock_get_hz(clk_sys)) ;
+#if PROFILE_SCURVE
+    stepper_profile_scurve(&profile, PROFILE_STEPS, 100.0f, 1000.0f, 2000.0f) ;
+#else
+    stepper_profile_trapezoid(&profile, PROFILE_STEPS, 100.0f, 1000.0f, 2000.0f) ;
+#endif
+#else
     // Create a repeating timer that calls repeating_timer_callback.
     struct repeating_timer timer;
 
     // Negative delay so means we will call repeating_timer_callback, and call it again
     // 50ms (20 Hz) later regardless of how long the callback took to execute
     add_repeating_timer_ms(-20, repeating_timer_callback, NULL, &timer);
+#endif
     
     // Call the interrupt handlers
     pio1_interrupt_handler() ;
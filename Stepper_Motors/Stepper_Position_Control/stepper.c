@@ -5,25 +5,28 @@
  * September, 2021
  * 
  * This demonstrates position control of four
- * ULN2003 stepper motors. The motors are controlled
- * from a collection of PIO state machines, each of
- * which interrupts the C code. Each motor has an
- * associated ISR.
+ * ULN2003 stepper motors. Each motor is a stepper_t
+ * from the stepper library, with one PIO state machine
+ * and two DMA channels (step words, and the count of
+ * steps taken), and a callback at the end of each of
+ * its moves.
  * 
  * This is for position control only. Speed is fixed.
  * 
- * Each ISR implements a very simple state machine that
- * moves each motor back and forth.
+ * Each callback implements a very simple state machine
+ * that moves its motor back and forth.
  * 
- * Note that this uses all 12 DMA channels, and all 4
- * state machines on each of the two PIO coprocessors.
+ * The four motors take all of PIO1 and eight DMA
+ * channels (claimed from lib/hw_claim), so PIO0
+ * and four channels are free for VGA.
  * 
  * https://vanhunteradams.com/Pico/Steppers/Lorenz.html
  * 
 */
 
-#include "motor_library.h"
-#include <math.h>
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "stepper.h"
 
 // Base pins for each motor
 #define MOTOR1_IN1 2
@@ -31,95 +34,59 @@
 #define MOTOR3_IN1 10
 #define MOTOR4_IN1 14
 
-// State machine variables
-volatile int state1 = 0 ;
-volatile int state2 = 0 ;
-volatile int state3 = 0 ;
-volatile int state4 = 0 ;
+// Speed of every motor (half steps per second)
+#define SPEED 960.0f
 
-// A collection of ISR's
-void pio0_interrupt_handler() {
-    pio_interrupt_clear(pio_0, 1) ;
-    if (state1 == 0) {
-        SET_DIRECTION_MOTOR_1(COUNTERCLOCKWISE) ;
-        state1 = 1 ;
-    }
-    else if (state1 == 1) {
-        SET_DIRECTION_MOTOR_1(CLOCKWISE) ;
-        state1 = 2 ;
-    }
-    else {
-        SET_DIRECTION_MOTOR_1(STOPPED) ;
-        state1 = 0 ;
-    }
-    MOVE_STEPS_MOTOR_1(1024) ;
-}
+// 1 to microstep motor 1 (its moves and speed are scaled to match)
+#define MICROSTEP 0
 
-void pio0_interrupt_handler_2() {
-    pio_interrupt_clear(pio_0, 0) ;
-    if (state3 == 0) {
-        SET_DIRECTION_MOTOR_3(COUNTERCLOCKWISE) ;
-        state3 = 1 ;
-    }
-    else if (state3 == 1) {
-        SET_DIRECTION_MOTOR_3(CLOCKWISE) ;
-        state3 = 2 ;
-    }
-    else {
-        SET_DIRECTION_MOTOR_3(STOPPED) ;
-        state3 = 0 ;
-    }
-    MOVE_STEPS_MOTOR_3(4096) ;
-}
+// Motors, their pins, and the length of each one's moves
+stepper_t motors[4] ;
+const unsigned int motor_pins[4] = {MOTOR1_IN1, MOTOR2_IN1, MOTOR3_IN1, MOTOR4_IN1} ;
+int move_steps[4] = {1024, 2048, 4096, 8192} ;
 
-void pio1_interrupt_handler() {
-    pio_interrupt_clear(pio_1, 1) ;
-    if (state2 == 0) {
-        SET_DIRECTION_MOTOR_2(COUNTERCLOCKWISE) ;
-        state2 = 1 ;
-    }
-    else if (state2 == 1) {
-        SET_DIRECTION_MOTOR_2(CLOCKWISE) ;
-        state2 = 2 ;
-    }
-    else {
-        SET_DIRECTION_MOTOR_2(STOPPED) ;
-        state2 = 0 ;
-    }
-    MOVE_STEPS_MOTOR_2(2048) ;
-}
+// State machine variables
+volatile int state[4] ;
 
-void pio1_interrupt_handler_2() {
-    pio_interrupt_clear(pio_1, 0) ;
-    if (state4 == 0) {
-        SET_DIRECTION_MOTOR_4(COUNTERCLOCKWISE) ;
-        state4 = 1 ;
+// Called at the end of each move: forward, back, then rest
+void motor_done(stepper_t * motor) {
+    int i = motor - motors ;
+    if (state[i] == 0) {
+        stepper_move(motor, move_steps[i]) ;
+        state[i] = 1 ;
     }
-    else if (state4 == 1) {
-        SET_DIRECTION_MOTOR_4(CLOCKWISE) ;
-        state4 = 2 ;
+    else if (state[i] == 1) {
+        stepper_move(motor, -move_steps[i]) ;
+        state[i] = 2 ;
     }
     else {
-        SET_DIRECTION_MOTOR_4(STOPPED) ;
-        state4 = 0 ;
+        stepper_idle(motor, move_steps[i]) ;
+        state[i] = 0 ;
     }
-    MOVE_STEPS_MOTOR_4(8192) ;
 }
 
 int main() {
     stdio_init_all();
 
     // Setup each motor
-    setupMotor1(MOTOR1_IN1, pio0_interrupt_handler) ;
-    setupMotor2(MOTOR2_IN1, pio1_interrupt_handler) ;
-    setupMotor3(MOTOR3_IN1, pio0_interrupt_handler_2) ;
-    setupMotor4(MOTOR4_IN1, pio1_interrupt_handler_2) ;
-    
-    // Call the interrupt handlers
-    pio1_interrupt_handler() ;
-    pio0_interrupt_handler() ;
-    pio0_interrupt_handler_2() ;
-    pio1_interrupt_handler_2() ;
+    for (int i=0; i<4; i++) {
+        if (!stepper_init(&motors[i], motor_pins[i])) {
+            printf("No state machine or DMA channel for motor %d\n", i + 1) ;
+            while (true) {
+            }
+        }
+        stepper_set_speed(&motors[i], SPEED) ;
+        stepper_on_done(&motors[i], motor_done) ;
+    }
+    if (MICROSTEP && stepper_microstep(&motors[0])) {
+        stepper_set_speed(&motors[0], SPEED * STEPPER_MICROSTEPS / 2) ;
+        move_steps[0] *= STEPPER_MICROSTEPS / 2 ;
+    }
+
+    // Call the callbacks
+    for (int i=0; i<4; i++) {
+        motor_done(&motors[i]) ;
+    }
 
     while (true) {
     }
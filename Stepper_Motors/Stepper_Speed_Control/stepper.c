@@ -6,12 +6,19 @@
  * 
  * Uses DDS to set the velocity of 4 ULN2003 stepper motors.
  * 
+ * Each motor is a stepper_t from the stepper library.
+ * The DDS timer sets how many steps each motor takes
+ * per interrupt, and each motor's end-of-move callback
+ * queues its next interrupt's worth, so the motors
+ * keep running without a gap between moves.
+ * 
  * https://vanhunteradams.com/Pico/Steppers/Lorenz.html
  * 
 */
 
-#include "motor_library.h"
 #include <math.h>
+#include "pico/stdlib.h"
+#include "stepper.h"
 
 // Motor base pins
 #define MOTOR1_IN1 2
@@ -24,98 +31,56 @@
 #define Fs 50.0
 
 // the DDS units:
-volatile unsigned int phase_accum_main_0;
-volatile unsigned int phase_accum_main_1;
-volatile unsigned int phase_accum_main_2;
-volatile unsigned int phase_accum_main_3;
-volatile unsigned int phase_incr_main_0 = (unsigned int)((.125*two32)/Fs) ;
-volatile unsigned int phase_incr_main_1 = (unsigned int)((.0625*two32)/Fs) ;
-volatile unsigned int phase_incr_main_2 = (unsigned int)((.03125*two32)/Fs) ;
-volatile unsigned int phase_incr_main_3 = (unsigned int)((.015625*two32)/Fs) ;
+volatile unsigned int phase_accum_main[4];
+volatile unsigned int phase_incr_main[4] = {(unsigned int)((.125*two32)/Fs),
+                                            (unsigned int)((.0625*two32)/Fs),
+                                            (unsigned int)((.03125*two32)/Fs),
+                                            (unsigned int)((.015625*two32)/Fs)} ;
 
 // DDS sine table
 #define sine_table_size 256
 volatile float sin_table[sine_table_size] ;
 
-// Variables to hold motor speed
-volatile unsigned int motorspeed_0 = 125000;
-volatile unsigned int motorspeed_1 = 125000;
-volatile unsigned int motorspeed_2 = 125000;
-volatile unsigned int motorspeed_3 = 125000 ;
-
-// Sine table values
-volatile float sineval_0 ;
-volatile float sineval_1 ;
-volatile float sineval_2 ;
-volatile float sineval_3 ;
-
-// Speed values
-volatile float speed_0 ;
-volatile float speed_1 ;
-volatile float speed_2 ;
-volatile float speed_3 ;
+// Sine table values (signed steps per interrupt)
+volatile float sineval[4] ;
 
-// Motor directions
-unsigned int motor0_direction ;
-unsigned int motor1_direction ;
-unsigned int motor2_direction ;
-unsigned int motor3_direction ;
-
-// Converts from desired motor velocity (steps/interrupt) to wait time
-#define convert(a) (unsigned int)(125000000./(Fs*(float)a))
+// The motors
+stepper_t motors[4] ;
+const unsigned int motor_pins[4] = {MOTOR1_IN1, MOTOR2_IN1, MOTOR3_IN1, MOTOR4_IN1} ;
 
 
 bool repeating_timer_callback(struct repeating_timer *t) {
 
     // DDS phase and sine table lookup
-    phase_accum_main_0 += phase_incr_main_0  ;
-    phase_accum_main_1 += phase_incr_main_1  ;
-    phase_accum_main_2 += phase_incr_main_2  ;
-    phase_accum_main_3 += phase_incr_main_3  ;
-
-    sineval_0 = sin_table[phase_accum_main_0 >> 24] ;
-    sineval_1 = sin_table[phase_accum_main_1 >> 24] ;
-    sineval_2 = sin_table[phase_accum_main_2 >> 24] ;
-    sineval_3 = sin_table[phase_accum_main_3 >> 24] ;
-
-    motor0_direction = (sineval_0>0) ? CLOCKWISE : COUNTERCLOCKWISE  ;
-    motor1_direction = (sineval_1>0) ? CLOCKWISE : COUNTERCLOCKWISE  ;
-    motor2_direction = (sineval_2>0) ? CLOCKWISE : COUNTERCLOCKWISE ;
-    motor3_direction = (sineval_3>0) ? CLOCKWISE : COUNTERCLOCKWISE ;
-
-    SET_DIRECTION_MOTOR_1(motor0_direction) ;
-    SET_DIRECTION_MOTOR_2(motor1_direction) ;
-    SET_DIRECTION_MOTOR_3(motor2_direction) ;
-    SET_DIRECTION_MOTOR_4(motor3_direction) ;
-
-    speed_0 = (sineval_0>0) ? sineval_0:-sineval_0 ;
-    speed_1 = (sineval_1>0) ? sineval_1:-sineval_1 ;
-    speed_2 = (sineval_2>0) ? sineval_2:-sineval_2 ;
-    speed_3 = (sineval_3>0) ? sineval_3:-sineval_3 ;
-
-    motorspeed_0 = convert(speed_0) ;
-    motorspeed_1 = convert(speed_1) ;
-    motorspeed_2 = convert(speed_2) ;
-    motorspeed_3 = convert(speed_3) ;
-
-    SET_SPEED_MOTOR_1(motorspeed_0) ;
-    SET_SPEED_MOTOR_2(motorspeed_1) ;
-    SET_SPEED_MOTOR_3(motorspeed_2) ;
-    SET_SPEED_MOTOR_4(motorspeed_3) ;
+    for (int i=0; i<4; i++) {
+        phase_accum_main[i] += phase_incr_main[i] ;
+        sineval[i] = sin_table[phase_accum_main[i] >> 24] ;
+    }
 
     return true;
 }
 
+// Called at the end of each move: the next interrupt's worth of steps,
+// spread over the interrupt (positive sine values are clockwise, which
+// is backwards)
+void motor_done(stepper_t * motor) {
+    int i = motor - motors ;
+    int steps = (int)sineval[i] ;
+    int speed = (steps > 0) ? steps : -steps ;
+    if (speed == 0) {
+        stepper_set_speed(motor, Fs) ;
+        stepper_idle(motor, 1) ;
+    }
+    else {
+        stepper_set_speed(motor, Fs * (float)speed) ;
+        stepper_move(motor, -steps) ;
+    }
+}
+
 
 int main() {
     stdio_init_all();
 
-    // Setup each motor
-    setupMotor1(MOTOR1_IN1);//, pio0_interrupt_handler) ;
-    setupMotor2(MOTOR2_IN1);//, pio1_interrupt_handler) ;
-    setupMotor3(MOTOR3_IN1);//, pio1_interrupt_handler) ;
-    setupMotor4(MOTOR4_IN1);
-
     // === build the sine lookup table =======
     // scaled to produce values between 0 and 20, max number of steps per interrupt
     // at 50Hz
@@ -124,6 +89,14 @@ int main() {
          sin_table[ii] = (int)((20.*sin((float)ii*6.283/(float)sine_table_size)));
     }
 
+    // Setup each motor, and start it
+    for (ii = 0; ii < 4; ii++) {
+        if (stepper_init(&motors[ii], motor_pins[ii])) {
+            stepper_on_done(&motors[ii], motor_done) ;
+            motor_done(&motors[ii]) ;
+        }
+    }
+
     // Create a repeating timer that calls repeating_timer_callback.
     struct repeating_timer timer;
 
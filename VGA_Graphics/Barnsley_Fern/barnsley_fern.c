@@ -4,6 +4,17 @@
  * Barnsley Fern calculation and visualization
  * Uses PIO-assembly VGA driver
  *
+ * The fern is one table of maps for the IFS renderer in ifs.c (another,
+ * the Sierpinski triangle, is drawn with IFS_FRACTAL=1). With
+ * FERN_DUAL_CORE (default 1) each core runs its own stream of points,
+ * with its own seed, into the same screen. The two can now and then
+ * write the same byte of the pixel array at once and lose a pixel, but
+ * the points land on the attractor so often that it's soon drawn again.
+ *
+ * The fern-density build (IFS_DENSITY=1, VGA_BPP 8) counts the hits on
+ * each pixel instead (lib/vga_density) and draws how dense the points
+ * are, on a log scale of palette colors, every DENSITY_BATCH points.
+ *
  * HARDWARE CONNECTIONS
  *  - GPIO 16 ---> VGA Hsync
  *  - GPIO 17 ---> VGA Vsync
@@ -13,15 +24,20 @@
  *  - RP2040 GND ---> VGA GND
  *
  * RESOURCES USED
- *  - PIO state machines 0, 1, and 2 on PIO instance 0
- *  - DMA channels 0 and 1
+ *  - 3 PIO state machines on PIO instance 0, and 2 DMA channels, for
+ *    VGA (claimed from lib/hw_claim)
  *  - 153.6 kBytes of RAM (for pixel color data)
  *
  */
 #include "vga_graphics.h"
+#include "ifs.h"
+#if IFS_DENSITY
+#include "vga_density.h"
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
 
@@ -29,56 +45,73 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////// Stuff for Barnsley fern ////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-// Fixed point data type
-typedef signed int fix15 ;
-#define multfix15(a,b) ((fix15)(((( signed long long)(a))*(( signed long long)(b)))>>15)) 
-#define float2fix15(a) ((fix15)((a)*32768.0f)) // 2^15
-#define fix2float15(a) ((float)(a)/32768.0f) 
-#define int2fix15(a) ((a)<<15)
-
-// Maximum number of iterations
-#define max_count 50000
-
-
-// State transition equations
-fix15 f1y_coeff_1 = float2fix15(0.16) ; ;
-#define F1x(a,b) 0 ;
-#define F1y(a,b) ((fix15)(multfix15(a,f1y_coeff_1)))
-
-fix15 f2x_coeff_1 = float2fix15(0.85) ;
-fix15 f2x_coeff_2 = float2fix15(0.04) ;
-#define F2x(a,b) ((fix15)(multfix15(f2x_coeff_1,a) + multfix15(f2x_coeff_2,b)))
-fix15 f2y_coeff_1 = float2fix15(-0.04) ;
-fix15 f2y_coeff_2 = float2fix15(0.85) ;
-fix15 f2y_coeff_3 = float2fix15(1.6) ;
-#define F2y(a,b) ((fix15)(multfix15(f2y_coeff_1,a) + multfix15(f2y_coeff_2,b) + f2y_coeff_3))
-
-fix15 f3x_coeff_1 = float2fix15(0.2) ;
-fix15 f3x_coeff_2 = float2fix15(0.26) ;
-#define F3x(a,b) ((fix15)(multfix15(f3x_coeff_1,a) - multfix15(f3x_coeff_2,b)))
-fix15 f3y_coeff_1 = float2fix15(0.23) ;
-fix15 f3y_coeff_2 = float2fix15(0.22) ;
-fix15 f3y_coeff_3 = float2fix15(1.6) ;
-#define F3y(a,b) ((fix15)(multfix15(f3y_coeff_1,a) + multfix15(f3y_coeff_2,b) + f3y_coeff_3))
-
-fix15 f4x_coeff_1 = float2fix15(-0.15) ;
-fix15 f4x_coeff_2 = float2fix15(0.28) ;
-#define F4x(a,b) ((fix15)(multfix15(f4x_coeff_1,a) + multfix15(f4x_coeff_2,b)))
-fix15 f4y_coeff_1 = float2fix15(0.26) ;
-fix15 f4y_coeff_2 = float2fix15(0.24) ;
-fix15 f4y_coeff_3 = float2fix15(0.44) ;
-#define F4y(a,b) ((fix15)(multfix15(f4y_coeff_1,a) + multfix15(f4y_coeff_2,b) + f4y_coeff_3))
-
-// Probability thresholds (rearrange for faster execution, check lowest range last)
-#define F1_THRESH 21474835
-#define F2_THRESH 1846835936
-#define F3_THRESH 1997159792
-
-fix15 vga_scale = float2fix15(45.0) ;
+// Number of points
+#ifndef max_count
+#define max_count 1000000
+#endif
+
+// Points (on both cores together) between redraws when counting them
+#define DENSITY_BATCH 250000
+
+// Run a stream of points on each core (each does half)
+#ifndef FERN_DUAL_CORE
+#define FERN_DUAL_CORE 1
+#endif
+
+// Which IFS to draw: 0 for the fern, 1 for the Sierpinski triangle
+#ifndef IFS_FRACTAL
+#define IFS_FRACTAL 0
+#endif
+
+// State transition equations: x' = a x + b y + e, y' = c x + d y + f
+//   {a, b, c, d, e, f, probability, color}
+const ifs_map fern_maps[] = {
+    {0, 0, 0, float2fix15(0.16), 0, 0,
+        0.01f, GREEN},
+    {float2fix15(0.85), float2fix15(0.04), float2fix15(-0.04), float2fix15(0.85), 0, float2fix15(1.6),
+        0.85f, GREEN},
+    {float2fix15(0.2), float2fix15(-0.26), float2fix15(0.23), float2fix15(0.22), 0, float2fix15(1.6),
+        0.07f, GREEN},
+    {float2fix15(-0.15), float2fix15(0.28), float2fix15(0.26), float2fix15(0.24), 0, float2fix15(0.44),
+        0.07f, GREEN},
+} ;
+
+// Each corner of the triangle in its own color
+const ifs_map sierpinski_maps[] = {
+    {float2fix15(0.5), 0, 0, float2fix15(0.5), 0, 0,
+        1.0f, RED},
+    {float2fix15(0.5), 0, 0, float2fix15(0.5), float2fix15(0.5), 0,
+        1.0f, GREEN},
+    {float2fix15(0.5), 0, 0, float2fix15(0.5), float2fix15(0.25), float2fix15(0.433),
+        1.0f, BLUE},
+} ;
+
+ifs_system fractal ;
+ifs_stream streams[2] ;
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
+// Core 1 entry point
+void core1_entry() {
+    while (true) {
+        // Wait for core 0 to say how many points, run them on the second
+        // stream, and say when they're done
+        int points = multicore_fifo_pop_blocking() ;
+        ifsRun(&fractal, &streams[1], points) ;
+        multicore_fifo_push_blocking(0) ;
+    }
+}
 
+// Run points on both cores (or just this one)
+void runPoints(int points) {
+#if FERN_DUAL_CORE
+    multicore_fifo_push_blocking(points/2) ;
+    ifsRun(&fractal, &streams[0], points - points/2) ;
+    multicore_fifo_pop_blocking() ;
+#else
+    ifsRun(&fractal, &streams[0], points) ;
+#endif
+}
 
 int main() {
 
@@ -92,51 +125,38 @@ int main() {
     // ===================================== Fern =======================================================
     /////////////////////////////////////////////////////////////////////////////////////////////////////
 
-    fix15 x_old ;
-    fix15 y_old ;
-    fix15 x_new ;
-    fix15 y_new ;
-
-    fix15 scaled_x ;
-    fix15 scaled_y ;
-    
-    x_old = 0 ;
-    y_old = 0 ;
+    // (Laid out for 640x480, and scaled to the drawing size)
+#if IFS_FRACTAL == 1
+    ifsInit(&fractal, sierpinski_maps, 3, 520.0f * VGA_HEIGHT / 480, 60 * VGA_WIDTH / 640, 460 * VGA_HEIGHT / 480) ;
+#else
+    ifsInit(&fractal, fern_maps, 4, 45.0f * VGA_HEIGHT / 480, VGA_WIDTH / 2, 460 * VGA_HEIGHT / 480) ;
+#endif
+    ifsSeed(&streams[0], 1) ;
+    ifsSeed(&streams[1], 0x9E3779B9) ;
+#if FERN_DUAL_CORE
+    multicore_launch_core1(core1_entry) ;
+#endif
 
     uint32_t start_time ;
     uint32_t end_time ;
 
     start_time = time_us_32() ;
-    
-    for (int i=0; i<max_count; i++) {
-
-        int test = rand() ;
-
-        if (test<F1_THRESH) {
-            x_new = F1x(x_old, y_old) ;
-            y_new = F1y(x_old, y_old) ;
-        }
-        else if (test<F2_THRESH) {
-            x_new = F2x(x_old, y_old) ;
-            y_new = F2y(x_old, y_old) ;
-        }
-        else if (test<F3_THRESH) {
-            x_new = F3x(x_old, y_old) ;
-            y_new = F3y(x_old, y_old) ;
-        }
-        else {
-            x_new = F4x(x_old, y_old) ;
-            y_new = F4y(x_old, y_old) ;
-        }
-
-        scaled_x = multfix15(vga_scale, x_new) ;
-        scaled_y = multfix15(vga_scale, y_new) ;
-
-        drawPixel((scaled_x>>15) + 320, 460-(scaled_y>>15), GREEN) ;
-        
-        x_old = x_new ;
-        y_old = y_new ;
+
+#if IFS_DENSITY
+    // Count the points a batch at a time, redrawing the density between
+    // batches so it fills in as it goes
+    static const unsigned char fern_ramp[] = {BLUE, GREEN, CYAN, YELLOW, WHITE} ;
+    vga_density_palette(fern_ramp, sizeof(fern_ramp)) ;
+    vga_density_clear() ;
+    int done, max_hits = 0 ;
+    for (done=0; done<max_count; done+=DENSITY_BATCH) {
+        runPoints((max_count - done < DENSITY_BATCH) ? max_count - done : DENSITY_BATCH) ;
+        max_hits = vga_density_render() ;
     }
+    printf("\n Busiest pixel: %d hits\n", max_hits) ;
+#else
+    runPoints(max_count) ;
+#endif
 
     end_time = time_us_32() ;
     printf("\n\n Time to compute %d points: %3.6f sec\n\n", max_count, (float)((end_time-start_time)/1000000.)) ;
@@ -0,0 +1,101 @@
+/**
+ * Chaos game IFS renderer (see ifs.h)
+ *
+ */
+#include "vga_graphics.h"
+#include "ifs.h"
+#if IFS_DENSITY
+#include "vga_density.h"
+#endif
+
+void ifsInit(ifs_system * ifs, const ifs_map * maps, int count, float scale, short x0, short y0) {
+    float scaled[IFS_MAX_MAPS] ;
+    unsigned char small[IFS_MAX_MAPS], large[IFS_MAX_MAPS] ;
+    int n_small = 0, n_large = 0 ;
+    float total = 0.0f ;
+    int i ;
+
+    if (count > IFS_MAX_MAPS) count = IFS_MAX_MAPS ;
+    ifs->count = count ;
+    ifs->scale = float2fix15(scale) ;
+    ifs->x0 = x0 ;
+    ifs->y0 = y0 ;
+    for (i=0; i<count; i++) {
+        ifs->maps[i] = maps[i] ;
+        total += maps[i].p ;
+    }
+
+    // Alias table (Vose's method). Each of the count columns is equally
+    // likely, and holds its own map with some probability and one other
+    // map for the rest, so that every map comes out at its own rate.
+    for (i=0; i<count; i++) {
+        scaled[i] = maps[i].p * count / total ;
+        if (scaled[i] < 1.0f) small[n_small++] = i ;
+        else large[n_large++] = i ;
+    }
+    while (n_small && n_large) {
+        int s = small[--n_small] ;
+        int l = large[--n_large] ;
+        ifs->alias_prob[s] = (uint32_t)(scaled[s] * 65536.0f) ;
+        ifs->alias[s] = l ;
+        scaled[l] -= 1.0f - scaled[s] ;
+        if (scaled[l] < 1.0f) small[n_small++] = l ;
+        else large[n_large++] = l ;
+    }
+    // What's left is (to rounding) exactly 1, so never aliased
+    while (n_large) {
+        int l = large[--n_large] ;
+        ifs->alias_prob[l] = 65536 ;
+        ifs->alias[l] = l ;
+    }
+    while (n_small) {
+        int s = small[--n_small] ;
+        ifs->alias_prob[s] = 65536 ;
+        ifs->alias[s] = s ;
+    }
+}
+
+void ifsSeed(ifs_stream * stream, uint32_t seed) {
+    stream->x = 0 ;
+    stream->y = 0 ;
+    // xorshift must not start at 0
+    stream->rng = seed ? seed : 0x2545F491 ;
+    stream->settle = IFS_SETTLE ;
+}
+
+void ifsRun(const ifs_system * ifs, ifs_stream * stream, int points) {
+    fix15 x = stream->x ;
+    fix15 y = stream->y ;
+    uint32_t r = stream->rng ;
+    int i ;
+
+    for (i=-stream->settle; i<points; i++) {
+        // xorshift32: the top 16 bits pick a column of the alias table,
+        // and the bottom 16 which of its two maps to take
+        r ^= r << 13 ;
+        r ^= r >> 17 ;
+        r ^= r << 5 ;
+        int k = ((r >> 16) * ifs->count) >> 16 ;
+        if ((r & 0xFFFF) >= ifs->alias_prob[k]) k = ifs->alias[k] ;
+        const ifs_map * m = &ifs->maps[k] ;
+
+        fix15 x_new = multfix15(m->a, x) + multfix15(m->b, y) + m->e ;
+        y = multfix15(m->c, x) + multfix15(m->d, y) + m->f ;
+        x = x_new ;
+
+        if (i >= 0) {
+            short px = ifs->x0 + (multfix15(ifs->scale, x)>>15) ;
+            short py = ifs->y0 - (multfix15(ifs->scale, y)>>15) ;
+#if IFS_DENSITY
+            vga_density_add(px, py) ;
+#else
+            drawPixel(px, py, m->color) ;
+#endif
+        }
+    }
+
+    stream->x = x ;
+    stream->y = y ;
+    stream->rng = r ;
+    stream->settle = 0 ;
+}
@@ -0,0 +1,67 @@
+/**
+ * Iterated function system (IFS) renderer, by the chaos game
+ *
+ * An IFS is a handful of affine maps, each picked with its own
+ * probability. A point is sent through a randomly chosen map over and
+ * over, and drawn each time; the points it lands on fill in the
+ * attractor (the Barnsley fern, the Sierpinski triangle...). Each IFS
+ * is a table of maps, so a new fractal is new data rather than code.
+ *
+ * The random numbers come from a xorshift32 generator (a few cycles,
+ * where newlib's rand() takes a division), and each point picks its map
+ * with one lookup in an alias table (Walker/Vose), rather than comparing
+ * against a chain of thresholds.
+ *
+ * USE
+ *  - ifsInit(&ifs, maps, count, scale, x0, y0) builds the alias table;
+ *    point (x, y) is drawn at pixel (x0 + scale*x, y0 - scale*y)
+ *  - ifsSeed(&stream, seed), then ifsRun(&ifs, &stream, points) runs one
+ *    stream of points. Streams are independent, so each core can run
+ *    its own (with a different seed) on the same ifs.
+ *  - Built with IFS_DENSITY=1, points are counted with vga_density_add()
+ *    (lib/vga_density) instead of drawn, and vga_density_render() draws
+ *    them; the maps' colors are unused
+ *
+ */
+#include <stdint.h>
+
+#include "fixed_point.h"
+
+// Count points rather than draw them (build-time)
+#ifndef IFS_DENSITY
+#define IFS_DENSITY 0
+#endif
+
+// Most maps in one IFS
+#define IFS_MAX_MAPS 8
+
+// Points each stream iterates before it starts drawing, to land on the
+// attractor
+#define IFS_SETTLE 16
+
+// One map: x' = a x + b y + e, y' = c x + d y + f, chosen with
+// probability p, and the color of the points it lands on
+typedef struct {
+    fix15 a, b, c, d, e, f ;
+    float p ;
+    char color ;
+} ifs_map ;
+
+typedef struct {
+    ifs_map maps[IFS_MAX_MAPS] ;
+    int count ;
+    fix15 scale ;                           // pixels per unit
+    short x0, y0 ;                          // pixel of the origin
+    uint32_t alias_prob[IFS_MAX_MAPS] ;     // keep map i below this (of 65536)...
+    unsigned char alias[IFS_MAX_MAPS] ;     // ...otherwise take this one
+} ifs_system ;
+
+typedef struct {
+    fix15 x, y ;
+    uint32_t rng ;      // xorshift32 state
+    int settle ;        // points still to go before drawing
+} ifs_stream ;
+
+void ifsInit(ifs_system * ifs, const ifs_map * maps, int count, float scale, short x0, short y0) ;
+void ifsSeed(ifs_stream * stream, uint32_t seed) ;
+void ifsRun(const ifs_system * ifs, ifs_stream * stream, int points) ;
@@ -0,0 +1,24 @@
+/**
+ * Game of Life cells, drawn straight into the VGA pixel array
+ *
+ * The VGA driver is built at low resolution (VGA_LOW_RES), so each cell
+ * is one 320x240 pixel, which the screen shows as 2x2. Cell (x, y) is
+ * the low (even x) or high 3 bits of byte 160*y + x/2 of the array. The
+ * board itself is kept in life.c.
+ *
+ */
+#include "cells.h"
+
+// The pixel array in vga_graphics.c (single-buffered, 3 bit/pixel, 320x240)
+extern unsigned char vga_data_array[] ;
+
+// VGA routine to draw a cell
+void drawCell(short x, short y, char color) {
+
+    // Which byte, and which pixel of the two in it
+    unsigned char * p = &vga_data_array[(160 * y) + (x>>1)] ;
+    int shift = (x & 1) * 3 ;
+
+    *p = (*p & ~(0x7 << shift)) | (color << shift) ;
+
+}
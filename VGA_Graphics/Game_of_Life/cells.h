@@ -0,0 +1,2 @@
+// Game of Life cells (a low resolution pixel each), drawn into the VGA pixel array
+void drawCell(short x, short y, char color) ;
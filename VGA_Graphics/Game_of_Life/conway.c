@@ -4,6 +4,16 @@
  * Conway's Game of Life
  * Uses PIO-assembly VGA driver
  *
+ * The board is bit-packed, apart from the screen (life.c), and only the
+ * cells that change are drawn each generation. Only the parts of the
+ * board where something changed last generation are computed.
+ *
+ * Both cores step each generation, taking rows of tiles (32x8 cells)
+ * from a shared counter. Core 1 starts on the next generation while
+ * core 0 draws the last one, so the drawing overlaps the stepping and
+ * core 0 takes fewer rows. The FIFO carries core 1's start signal and
+ * its reply when its rows are done, which is the end of the generation.
+ *
  * HARDWARE CONNECTIONS
  *  - GPIO 16 ---> VGA Hsync
  *  - GPIO 17 ---> VGA Vsync
@@ -13,20 +23,55 @@
  *  - RP2040 GND ---> VGA GND
  *
  * RESOURCES USED
- *  - PIO state machines 0, 1, and 2 on PIO instance 0
- *  - DMA channels 0 and 1
- *  - 153.6 kBytes of RAM (for pixel color data)
+ *  - 3 PIO state machines on PIO instance 0, and 2 DMA channels, for
+ *    VGA (claimed from lib/hw_claim)
+ *  - 38.4 kBytes of RAM (for pixel color data, at 320x240: VGA_LOW_RES)
+ *  - One hardware spinlock (claimed)
  *
  */
 #include "vga_graphics.h"
+#include "life.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include "hardware/pio.h"
 #include "hardware/dma.h"
+#include "hardware/sync.h"
+
+// Next row of tiles to step (both cores take rows until there are none
+// left), and the spinlock that guards it
+spin_lock_t * row_lock ;
+volatile int next_row ;
+
+// Take the next row of tiles, or -1 if they're all taken
+int takeRow() {
+    uint32_t irq_state = spin_lock_blocking(row_lock) ;
+    int row = (next_row < LIFE_TILE_ROWS) ? next_row++ : -1 ;
+    spin_unlock(row_lock, irq_state) ;
+    return row ;
+}
 
+// Step rows of tiles until there are none left. Returns how many tiles
+// this core computed.
+int stepRows() {
+    int tiles = 0 ;
+    int row ;
+    while ((row = takeRow()) >= 0) {
+        tiles += lifeStepRows(row, row + 1) ;
+    }
+    return tiles ;
+}
 
+// Core 1 entry point
+void core1_entry() {
+    while (true) {
+        // Wait for core 0 to start a generation, then help step it
+        multicore_fifo_pop_blocking() ;
+        multicore_fifo_push_blocking(stepRows()) ;
+    }
+}
 
 int main() {
 
@@ -36,93 +81,56 @@ int main() {
     // Initialize VGA
     initVGA() ;
 
+    // Spinlock for the row counter
+    row_lock = spin_lock_init(spin_lock_claim_unused(true)) ;
+
+    // Launch core 1
+    multicore_launch_core1(core1_entry) ;
+
     /////////////////////////////////////////////////////////////////////
     /////////////////////////////////////// Game of Life ////////////////
     /////////////////////////////////////////////////////////////////////
 
-    // Initialize the screen (specific eternal growth initial conditions)
-    drawCell(160, -50+70, WHITE) ;
-    drawCell(160, -50+71, WHITE) ;
-    drawCell(160, -50+72, WHITE) ;
-    drawCell(160, -50+73, WHITE) ;
-    drawCell(160, -50+74, WHITE) ;
-    drawCell(160, -50+75, WHITE) ;
-    drawCell(160, -50+76, WHITE) ;
-    drawCell(160, -50+77, WHITE) ;
-
-    drawCell(160, -50+79, WHITE) ;
-    drawCell(160, -50+80, WHITE) ;
-    drawCell(160, -50+81, WHITE) ;
-    drawCell(160, -50+82, WHITE) ;
-    drawCell(160, -50+83, WHITE) ;
-
-    drawCell(160, -50+87, WHITE) ;
-    drawCell(160, -50+88, WHITE) ;
-    drawCell(160, -50+89, WHITE) ;
-
-    drawCell(160, -50+96, WHITE) ;
-    drawCell(160, -50+97, WHITE) ;
-    drawCell(160, -50+98, WHITE) ;
-    drawCell(160, -50+99, WHITE) ;
-    drawCell(160, -50+100, WHITE) ;
-    drawCell(160, -50+101, WHITE) ;
-    drawCell(160, -50+102, WHITE) ;
-
-    drawCell(160, -50+104, WHITE) ;
-    drawCell(160, -50+105, WHITE) ;
-    drawCell(160, -50+106, WHITE) ;
-    drawCell(160, -50+107, WHITE) ;
-    drawCell(160, -50+108, WHITE) ;
-    
-    int i = 0 ;
-    int j = 0 ;
-    char saved_row[320] = {BLACK} ;
-    char updated_row[320] = {BLACK} ;
-    int saved_row_num = 238 ;
-
-    int living ;
-    int neighbors ;
+    // Initialize the board (specific eternal growth initial conditions):
+    // runs of live cells down column 160
+    const short runs[][2] = {{70, 77}, {79, 83}, {87, 89}, {96, 102}, {104, 108}} ;
+    int i, j ;
+    lifeClear() ;
+    for (i=0; i<5; i++) {
+        for (j=runs[i][0]; j<=runs[i][1]; j++) {
+            lifeSet(160, -50+j, 1) ;
+        }
+    }
+    lifeDraw() ;
+
+    int drawn ;
+    int tiles_core_0, tiles_core_1 ;
 
     uint32_t start_time ;
+    uint32_t draw_time ;
     uint32_t end_time ;
 
     while(1) {
 
         start_time = time_us_32() ;
 
-        for (j=1; j<239; j++) {
-            for (i=1; i<319; i++) {
-                // Check if cell is alive, and get number of neighbors
-                living = isAlive(i, j) ;
-                neighbors = checkNeighbors(i, j) ;
-
-                // Apply rules, save living/dead status in saved_row array
-                if (living && ((neighbors==2) || (neighbors==3))) {
-                    updated_row[i] = WHITE ;
-                }
-
-                else if (!living && (neighbors==3)) {
-                    updated_row[i] = WHITE ;
-                }
-
-                else {
-                    updated_row[i] = BLACK ;
-                }
-            }
-            // Draw the saved row
-            for (i=0; i<319; i++) {
-                drawCell(i, saved_row_num, saved_row[i]) ;
-            }
-            // Move the updated row to the saved row
-            memcpy(saved_row, updated_row, 320) ;
-            // Increment the saved row number, wrapping at 318
-            saved_row_num += 1 ;
-            if (saved_row_num >= 239) {
-                saved_row_num = 1 ;
-            }
-        }
+        // Core 1 starts on the next generation while core 0 draws this
+        // one (which the step only reads), then joins in
+        next_row = 0 ;
+        multicore_fifo_push_blocking(0) ;
+        drawn = lifeDraw() ;
+        draw_time = time_us_32() ;
+        tiles_core_0 = stepRows() ;
+
+        // Wait for core 1 to finish its rows before the swap
+        tiles_core_1 = multicore_fifo_pop_blocking() ;
+        lifeFinishStep(tiles_core_0 + tiles_core_1) ;
 
         end_time = time_us_32() ;
-        printf("Time to animate: %f\n", (float)(end_time-start_time)*(1./1000000.)) ;
+        if ((life_generation & 0xFF) == 0) {
+            printf("Generation %u: %d alive, %d drawn, %d of %d tiles stepped (core 0 %d, core 1 %d), %d us (%d drawing)\n",
+                    life_generation, lifePopulation(), drawn, life_tiles_stepped, LIFE_TILE_ROWS * LIFE_WORDS,
+                    tiles_core_0, tiles_core_1, (int)(end_time - start_time), (int)(draw_time - start_time)) ;
+        }
     }
 }
@@ -0,0 +1,211 @@
+/**
+ * Bit-packed Game of Life engine (see life.h)
+ *
+ */
+#include "vga_graphics.h"
+#include "cells.h"
+#include "life.h"
+#include <string.h>
+
+// Visible part of the board (cells are low resolution pixels, 2x2 on the screen)
+#define SHOWN_W ((LIFE_W < 320) ? LIFE_W : 320)
+#define SHOWN_H ((LIFE_H < 240) ? LIFE_H : 240)
+#define SHOWN_WORDS ((SHOWN_W + 31) / 32)
+
+// This generation and the next, and the board as it is on the screen
+static uint32_t life_grids[2][LIFE_H][LIFE_WORDS] ;
+static uint32_t life_shown[SHOWN_H][SHOWN_WORDS] ;
+static int life_cur = 0 ;
+
+// Tiles that changed on the way to each generation, one bit per tile
+// column for each row of tiles
+#define TILE_MASK ((LIFE_WORDS == 32) ? 0xFFFFFFFFu : ((1u << LIFE_WORDS) - 1))
+static uint32_t life_changed[2][LIFE_TILE_ROWS] ;
+
+// The dead row beyond the top and bottom edges
+static const uint32_t life_dead[LIFE_WORDS] ;
+
+unsigned int life_generation = 0 ;
+int life_tiles_stepped = 0 ;
+
+void lifeClear() {
+    memset(life_grids, 0, sizeof(life_grids)) ;
+    // Whatever was there before has gone, so everything needs a look
+    memset(life_changed, 0xFF, sizeof(life_changed)) ;
+    life_generation = 0 ;
+}
+
+void lifeSet(short x, short y, char alive) {
+    if ((x < 0) || (x >= LIFE_W) || (y < 0) || (y >= LIFE_H)) return ;
+    uint32_t * word = &life_grids[life_cur][y][x >> 5] ;
+    if (alive) *word |= (1u << (x & 31)) ;
+    else *word &= ~(1u << (x & 31)) ;
+    life_changed[life_cur][y / LIFE_TILE_H] |= (1u << (x >> 5)) ;
+}
+
+int lifeGet(short x, short y) {
+    if ((x < 0) || (x >= LIFE_W) || (y < 0) || (y >= LIFE_H)) return 0 ;
+    return (life_grids[life_cur][y][x >> 5] >> (x & 31)) & 1 ;
+}
+
+// The next generation of 32 cells (c), from their neighbors to the
+// northwest, north... southeast, each a word lined up with c
+static inline uint32_t lifeWord(uint32_t nw, uint32_t n, uint32_t ne,
+                                uint32_t w, uint32_t c, uint32_t e,
+                                uint32_t sw, uint32_t s, uint32_t se) {
+    // Two-bit counts of the three above (t1 t0), the three below (b1 b0)
+    // and the two beside (m1 m0)
+    uint32_t t0 = nw ^ n ^ ne ;
+    uint32_t t1 = (nw & n) | (ne & (nw ^ n)) ;
+    uint32_t b0 = sw ^ s ^ se ;
+    uint32_t b1 = (sw & s) | (se & (sw ^ s)) ;
+    uint32_t m0 = w ^ e ;
+    uint32_t m1 = w & e ;
+
+    // Add the ones: bit 0 of the count, and a carry into the twos
+    uint32_t s0 = t0 ^ b0 ^ m0 ;
+    uint32_t c0 = (t0 & b0) | (m0 & (t0 ^ b0)) ;
+
+    // The count is 2 or 3 if exactly one of the four twos is set (an odd
+    // number of them, but not three)
+    uint32_t odd = t1 ^ b1 ^ m1 ^ c0 ;
+    uint32_t two_plus = (t1 & b1) | (m1 & c0) | ((t1 ^ b1) & (m1 ^ c0)) ;
+
+    // Born with 3, survives with 2 or 3
+    return odd & ~two_plus & (s0 | c) ;
+}
+
+// Row y of a grid, or past the top and bottom edges, the dead row (or
+// with LIFE_WRAP, the row at the other edge)
+static inline const uint32_t * lifeRowAt(uint32_t (*grid)[LIFE_WORDS], int y) {
+#if LIFE_WRAP
+    if (y < 0) y = LIFE_H - 1 ;
+    if (y >= LIFE_H) y = 0 ;
+#else
+    if ((y < 0) || (y >= LIFE_H)) return life_dead ;
+#endif
+    return grid[y] ;
+}
+
+// The next generation of word w of a row, from it and the rows above and
+// below. Past the left and right edges the words are dead (or wrap).
+static inline uint32_t lifeNextWord(const uint32_t * above, const uint32_t * row, const uint32_t * below, int w) {
+    uint32_t a = above[w], m = row[w], b = below[w] ;
+    uint32_t ap, mp, bp, an, mn, bn ;
+#if LIFE_WRAP
+    int l = (w > 0) ? w - 1 : LIFE_WORDS - 1 ;
+    int r = (w < LIFE_WORDS - 1) ? w + 1 : 0 ;
+    ap = above[l] ; mp = row[l] ; bp = below[l] ;
+    an = above[r] ; mn = row[r] ; bn = below[r] ;
+#else
+    ap = mp = bp = an = mn = bn = 0 ;
+    if (w > 0) {
+        ap = above[w-1] ; mp = row[w-1] ; bp = below[w-1] ;
+    }
+    if (w < LIFE_WORDS - 1) {
+        an = above[w+1] ; mn = row[w+1] ; bn = below[w+1] ;
+    }
+#endif
+    // Cell x-1 is one bit down, and x+1 one bit up
+    return lifeWord((a << 1) | (ap >> 31), a, (a >> 1) | (an << 31),
+                    (m << 1) | (mp >> 31), m, (m >> 1) | (mn << 31),
+                    (b << 1) | (bp >> 31), b, (b >> 1) | (bn << 31)) ;
+}
+
+// Tile columns next to (or in) those set in a row of tile bits
+static inline uint32_t lifeSpread(uint32_t m) {
+    uint32_t spread = m | (m << 1) | (m >> 1) ;
+#if LIFE_WRAP
+    spread |= (m >> (LIFE_WORDS - 1)) | (m << (LIFE_WORDS - 1)) ;
+#endif
+    return spread & TILE_MASK ;
+}
+
+// Tiles next to (or in) those that changed on the way to this generation,
+// for a row of tiles
+static inline uint32_t lifeActive(const uint32_t * changed, int ty) {
+    uint32_t m = changed[ty] ;
+#if LIFE_WRAP
+    m |= changed[(ty > 0) ? ty - 1 : LIFE_TILE_ROWS - 1] ;
+    m |= changed[(ty < LIFE_TILE_ROWS - 1) ? ty + 1 : 0] ;
+#else
+    if (ty > 0) m |= changed[ty-1] ;
+    if (ty < LIFE_TILE_ROWS - 1) m |= changed[ty+1] ;
+#endif
+    return lifeSpread(m) ;
+}
+
+int lifeStepRows(int ty0, int ty1) {
+    uint32_t (*cur)[LIFE_WORDS] = life_grids[life_cur] ;
+    uint32_t (*next)[LIFE_WORDS] = life_grids[life_cur ^ 1] ;
+    const uint32_t * changed = life_changed[life_cur] ;
+    int tx, ty, y ;
+    int stepped = 0 ;
+    for (ty=ty0; ty<ty1; ty++) {
+        uint32_t active = lifeActive(changed, ty) ;
+        uint32_t now_changed = 0 ;
+        int y0 = ty * LIFE_TILE_H ;
+        for (tx=0; tx<LIFE_WORDS; tx++) {
+            // Nothing nearby changed, so neither will this tile
+            if (!(active & (1u << tx))) {
+                for (y=y0; y<y0+LIFE_TILE_H; y++) {
+                    next[y][tx] = cur[y][tx] ;
+                }
+                continue ;
+            }
+            uint32_t diff = 0 ;
+            for (y=y0; y<y0+LIFE_TILE_H; y++) {
+                uint32_t word = lifeNextWord(lifeRowAt(cur, y-1), cur[y], lifeRowAt(cur, y+1), tx) ;
+                diff |= word ^ cur[y][tx] ;
+                next[y][tx] = word ;
+            }
+            if (diff) now_changed |= (1u << tx) ;
+            stepped++ ;
+        }
+        life_changed[life_cur ^ 1][ty] = now_changed ;
+    }
+    return stepped ;
+}
+
+void lifeFinishStep(int tiles_stepped) {
+    life_tiles_stepped = tiles_stepped ;
+    life_cur ^= 1 ;
+    life_generation++ ;
+}
+
+void lifeStep() {
+    lifeFinishStep(lifeStepRows(0, LIFE_TILE_ROWS)) ;
+}
+
+int lifeDraw() {
+    uint32_t (*cur)[LIFE_WORDS] = life_grids[life_cur] ;
+    int drawn = 0 ;
+    int x, y, w ;
+    for (y=0; y<SHOWN_H; y++) {
+        for (w=0; w<SHOWN_WORDS; w++) {
+            uint32_t changed = cur[y][w] ^ life_shown[y][w] ;
+            while (changed) {
+                x = (w << 5) + __builtin_ctz(changed) ;
+                if (x < SHOWN_W) {
+                    drawCell(x, y, lifeGet(x, y) ? WHITE : BLACK) ;
+                    drawn++ ;
+                }
+                changed &= changed - 1 ;
+            }
+            life_shown[y][w] = cur[y][w] ;
+        }
+    }
+    return drawn ;
+}
+
+int lifePopulation() {
+    uint32_t (*cur)[LIFE_WORDS] = life_grids[life_cur] ;
+    int population = 0 ;
+    int y, w ;
+    for (y=0; y<LIFE_H; y++) {
+        for (w=0; w<LIFE_WORDS; w++) {
+            population += __builtin_popcount(cur[y][w]) ;
+        }
+    }
+    return population ;
+}
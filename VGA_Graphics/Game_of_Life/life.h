@@ -0,0 +1,78 @@
+/**
+ * Bit-packed Game of Life engine
+ *
+ * The board is kept apart from the screen, one bit per cell and 32 cells
+ * to a word (bit k of word w of a row is cell 32w + k). A generation
+ * works a word at a time: the eight neighbors of all 32 cells are the
+ * words above, beside and below, shifted a bit left or right, and they
+ * are counted with bitwise adders (all 32 counts at once). Cells beyond
+ * the edges of the board are dead, or with LIFE_WRAP=1 the board wraps
+ * around (a torus).
+ *
+ * The board is split into tiles of 32x8 cells (a word wide), and only
+ * tiles that changed last generation, or that are next to one that did,
+ * are computed; the rest are known to stay as they are. Once the
+ * pattern has settled to still lifes, a generation costs about the same
+ * as copying the board, and chaotic patterns in a corner of a big board
+ * cost no more than on a small one.
+ *
+ * The screen is a separate copy of the board as last drawn, so lifeDraw()
+ * only draws the cells that have changed since (with drawCell() from
+ * cells.h), however many generations ago that was.
+ *
+ * USE
+ *  - lifeSet(x, y, 1) to set up the first generation, then lifeDraw()
+ *  - lifeStep() computes the next generation
+ *  - Or, to share it between the cores: lifeStepRows(ty0, ty1) computes
+ *    rows ty0 to ty1 - 1 of tiles of the next generation, and once every
+ *    row has been done (each once, on whichever core, in any order),
+ *    lifeFinishStep() makes it the current one. The rows only read the
+ *    current generation, so the cells at the edges of each row of tiles
+ *    need no copying between the cores, and lifeDraw() can draw the
+ *    current generation meanwhile.
+ *  - lifeDraw() brings the screen up to date, and returns how many cells
+ *    it drew
+ *
+ */
+#include <stdint.h>
+
+// Board size in cells (build-time). The width is a multiple of 32 (up to
+// 1024) and the height of 8; the screen shows up to 320x240 of it.
+#ifndef LIFE_W
+#define LIFE_W 320
+#endif
+#ifndef LIFE_H
+#define LIFE_H 240
+#endif
+#if ((LIFE_W % 32) != 0) || (LIFE_W > 1024)
+#error "LIFE_W must be a multiple of 32, up to 1024"
+#endif
+#if (LIFE_H % 8) != 0
+#error "LIFE_H must be a multiple of 8"
+#endif
+#define LIFE_WORDS (LIFE_W / 32)
+
+// Tiles are a word wide and LIFE_TILE_H rows high
+#define LIFE_TILE_H 8
+#define LIFE_TILE_ROWS (LIFE_H / LIFE_TILE_H)
+
+// Wrap the board around at its edges (build-time)
+#ifndef LIFE_WRAP
+#define LIFE_WRAP 0
+#endif
+
+// Generations since the board was cleared, and of the tiles, how many
+// were computed in the last one
+extern unsigned int life_generation ;
+extern int life_tiles_stepped ;
+
+void lifeClear(void) ;
+void lifeSet(short x, short y, char alive) ;
+int lifeGet(short x, short y) ;
+void lifeStep(void) ;
+// Returns how many tiles it computed; lifeFinishStep() takes the total
+int lifeStepRows(int ty0, int ty1) ;
+void lifeFinishStep(int tiles_stepped) ;
+int lifeDraw(void) ;
+// Cells alive in the current generation
+int lifePopulation(void) ;
@@ -0,0 +1,116 @@
+/**
+ * Mandelbrot set iteration, shared by the multicore Mandelbrot demos
+ *
+ * The fixed point (fix28) iteration with its shortcuts (see
+ * mandelbrot_shared.c), the bands of iteration counts that points are
+ * colored by, and a job counter that both cores take work from.
+ *
+ * USE
+ *  - mandelbrot(Cre, Cim) gives the iteration count at a point, and
+ *    band_colors[countBand(count)] its color
+ *  - Claim job_lock (spin_lock_init(spin_lock_claim_unused(true))) once,
+ *    then for each batch of work startJobs(n), and on each core call
+ *    takeJob() until it returns -1
+ *  - abortJobs() makes takeJob() return -1 from then on, so both cores
+ *    stop at the end of the job they're on
+ *
+ */
+// (Include vga_graphics.h first, for the colors)
+#include "hardware/sync.h"
+
+#include "fixed_point.h"
+
+// Maximum number of iterations
+#define max_count 1000
+
+// Jobs in this batch, and the next one to take. The caller decides what
+// a job is; the counter only hands out each number once.
+spin_lock_t * job_lock ;
+volatile int next_job ;
+volatile int job_count ;
+
+// Points iterated by each core this frame
+int iterated[2] ;
+
+// Start a batch of n jobs
+void startJobs(int n) {
+    uint32_t irq_state = spin_lock_blocking(job_lock) ;
+    next_job = 0 ;
+    job_count = n ;
+    spin_unlock(job_lock, irq_state) ;
+}
+
+// Take the next job, or -1 if they're all taken
+int takeJob() {
+    uint32_t irq_state = spin_lock_blocking(job_lock) ;
+    int job = (next_job < job_count) ? next_job++ : -1 ;
+    spin_unlock(job_lock, irq_state) ;
+    return job ;
+}
+
+// Hand out no more jobs from this batch
+void abortJobs() {
+    uint32_t irq_state = spin_lock_blocking(job_lock) ;
+    job_count = 0 ;
+    spin_unlock(job_lock, irq_state) ;
+}
+
+// Is the point in the main cardioid or the period-2 bulb? (Only tested
+// near them, where none of the products can overflow.)
+int inMainBulbs(fix28 Cre, fix28 Cim) {
+    if ((Cim <= -ONEfix28) || (Cim >= ONEfix28) || (Cre <= -int2fix28(2)) || (Cre >= ONEfix28)) return 0 ;
+    fix28 Cim_sq = sqrfix28(Cim) ;
+    fix28 a = Cre - (ONEfix28>>2) ;
+    fix28 q = sqrfix28(a) + Cim_sq ;
+    if ((q <= ONEfix28) && (multfix28(q, q + a) <= (Cim_sq>>2))) return 1 ;
+    fix28 b = Cre + ONEfix28 ;
+    return (sqrfix28(b) + Cim_sq) <= SIXTEENTHfix28 ;
+}
+
+// Iterate one point, returning the iteration count
+int mandelbrot(fix28 Cre, fix28 Cim) {
+    fix28 Zre, Zim ;
+    fix28 Zre_sq, Zim_sq ;
+    fix28 Zre_saved, Zim_saved ;
+    int count = 0 ;
+    int next_save = 8 ;
+
+    if (inMainBulbs(Cre, Cim)) return max_count ;
+    iterated[get_core_num()]++ ;
+
+    Zre = Zre_sq = Zim = Zim_sq = 0 ;
+    Zre_saved = Zim_saved = 0 ;
+
+    // Mandelbrot iteration
+    while (count++ < max_count) {
+        Zim = (multfix28(Zre, Zim)<<1) + Cim ;
+        Zre = Zre_sq - Zim_sq + Cre ;
+        Zre_sq = sqrfix28(Zre) ;
+        Zim_sq = sqrfix28(Zim) ;
+
+        if ((Zre_sq + Zim_sq) >= FOURfix28) break ;
+
+        // Back where we were: it's a cycle, so the point is in the set
+        if ((Zre == Zre_saved) && (Zim == Zim_saved)) return max_count ;
+        if (count == next_save) {
+            Zre_saved = Zre ;
+            Zim_saved = Zim ;
+            next_save <<= 1 ;
+        }
+    }
+    return count ;
+}
+
+// The band of iteration counts that a count is in, and each band's color
+// (two bands are red)
+int countBand(int count) {
+    if (count >= max_count) return 0 ;
+    else if (count >= (max_count>>1)) return 1 ;
+    else if (count >= (max_count>>2)) return 2 ;
+    else if (count >= (max_count>>3)) return 3 ;
+    else if (count >= (max_count>>4)) return 4 ;
+    else if (count >= (max_count>>5)) return 5 ;
+    else if (count >= (max_count>>6)) return 6 ;
+    else return 7 ;
+}
+const char band_colors[8] = {BLACK, WHITE, CYAN, BLUE, RED, YELLOW, MAGENTA, RED} ;
@@ -0,0 +1,324 @@
+/**
+ * Hunter Adams (vha3@cornell.edu)
+ *
+ * Interactive Mandelbrot set explorer, drawn by both cores
+ * Uses PIO-assembly VGA driver.
+ *
+ * Pan and zoom from a serial terminal (or the touchscreen, with
+ * MANDEL_TOUCH=1). Each view is drawn in passes that get finer: first
+ * one point in every 8x8 block, each filling its block, then the points
+ * that a 4x4 grid adds, and so on down to single pixels. No pass repeats
+ * a point that an earlier one iterated, so the full picture costs what a
+ * single pass would, but a rough picture is up within a few milliseconds
+ * of a key press. A key that arrives mid-frame stops the frame at once
+ * (both cores finish their row of blocks and take no more).
+ *
+ * Panning a finished picture moves it with shiftScreen(), so only the
+ * strip that comes into view is computed (in passes too).
+ *
+ * Both cores take rows of blocks from the job counter in mandelbrot.h,
+ * with the same shortcuts as mandelbrot_shared.c.
+ *
+ * CONTROLS (serial)
+ *  - w, a, s, d ---> pan up, left, down, right (by PAN_STEP pixels)
+ *  - z or + ---> zoom in 2x,  x or - ---> zoom out 2x (about the center)
+ *  - r ---> back to the whole set
+ *  - Touchscreen (MANDEL_TOUCH=1): touch a point to zoom in on it, or
+ *    the top left corner to zoom out
+ *
+ * https://vanhunteradams.com/FixedPoint/FixedPoint.html
+ * https://vanhunteradams.com/Pico/VGA/VGA.html
+ *
+ * HARDWARE CONNECTIONS
+ *  - GPIO 16 ---> VGA Hsync
+ *  - GPIO 17 ---> VGA Vsync
+ *  - GPIO 18 ---> 330 ohm resistor ---> VGA Red
+ *  - GPIO 19 ---> 330 ohm resistor ---> VGA Green
+ *  - GPIO 20 ---> 330 ohm resistor ---> VGA Blue
+ *  - RP2040 GND ---> VGA GND
+ *  - Touchscreen (optional): see lib/touchscreen/touchscreen.h
+ *
+ * RESOURCES USED
+ *  - 3 PIO state machines on PIO instance 0, and 2 DMA channels, for
+ *    VGA (claimed from lib/hw_claim)
+ *  - 153.6 kBytes of RAM (for pixel color data)
+ *  - One hardware spinlock (claimed)
+ *  - With MANDEL_TOUCH, the ADC, one more DMA channel (claimed) and
+ *    DMA_IRQ_0, and the touchscreen calibration in flash (see the
+ *    trackpad demo)
+ *
+ */
+#include "vga_graphics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "mandelbrot.h"
+
+// Zoom and pan with the touchscreen too. Off by default: with no panel
+// connected, the floating ADC inputs can look like touches.
+#ifndef MANDEL_TOUCH
+#define MANDEL_TOUCH 0
+#endif
+#if MANDEL_TOUCH
+#include "touchscreen.h"
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////// Stuff for Mandelbrot ///////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Block size of the first pass (a power of two, at most 8 so that blocks
+// and pans stay whole bytes of the pixel array in every VGA mode)
+#define FIRST_BLOCK 8
+
+// Pixels per pan (a multiple of FIRST_BLOCK)
+#define PAN_STEP 64
+
+// Limits of the view: the center stays within 2 of the origin, a pixel
+// is no wider than 1/128 (the screen a little wider than the +/-2 box)
+// and no narrower than 16 LSBs of fix28 (about 80000x zoom). Inside
+// them, no pixel's coordinates can overflow.
+#define CENTER_MAX int2fix28(2)
+#define STEP_MAX   (ONEfix28 / 128)
+#define STEP_MIN   16
+
+// The view: its center, and the width of a pixel
+fix28 view_cx, view_cy ;
+fix28 view_step ;
+
+// Coordinates of each pixel column and row (shared by both cores)
+fix28 x[640] ;
+fix28 y[480] ;
+
+// What's left to draw: a rectangle (multiples of FIRST_BLOCK), or none
+// when the picture is finished
+short region_x, region_y, region_w, region_h ;
+
+// Block size of the pass being drawn
+volatile int pass_size ;
+
+// A command waiting to be carried out, or 0, and where a touch landed
+volatile int pending_cmd ;
+short tap_x, tap_y ;
+
+// Count of a point, skipping those outside the +/-2 box. (They escape
+// at once, and zoomed out, far enough from the origin to overflow.)
+int pointCount(fix28 Cre, fix28 Cim) {
+    if ((Cre >= int2fix28(2)) || (Cre <= -int2fix28(2)) ||
+        (Cim >= int2fix28(2)) || (Cim <= -int2fix28(2))) return 1 ;
+    return mandelbrot(Cre, Cim) ;
+}
+
+// Draw one row of blocks of the current pass. After the first pass,
+// points on every other row and column were done by the one before.
+void drawBlockRow(int job) {
+    int n = pass_size ;
+    int j = region_y + job * n ;
+    int i ;
+    for (i=0; i<(region_w / n); i++) {
+        if ((n < FIRST_BLOCK) && !(job & 1) && !(i & 1)) continue ;
+        int px = region_x + i * n ;
+        char color = band_colors[countBand(pointCount(x[px], y[j]))] ;
+        if (n == 1) drawPixel(px, j, color) ;
+        else fillRect(px, j, n, n, color) ;
+    }
+}
+
+// Look for a command (waiting up to timeout_us for a key), and stop the
+// frame being drawn if there is one
+void checkInput(uint32_t timeout_us) {
+    if (pending_cmd) return ;
+    int c = getchar_timeout_us(timeout_us) ;
+    if ((c > 0) && strchr("wasdzx+-=r", c)) {
+        pending_cmd = c ;
+    }
+#if MANDEL_TOUCH
+    // The driver has already debounced the touch, so it counts as soon as
+    // it's down (and its moves and release are passed over)
+    touch_event e ;
+    while (touch_get_event(&e)) {
+        if ((e.type == TOUCH_DOWN) && !pending_cmd) {
+            tap_x = e.x ;
+            tap_y = e.y ;
+            pending_cmd = ((e.x < 64) && (e.y < 64)) ? 'x' : 't' ;
+        }
+    }
+#endif
+    if (pending_cmd) abortJobs() ;
+}
+
+// Draw rows of blocks until there are none left (core 0 also watches for
+// commands between them). Returns how many this core drew.
+int drawJobs() {
+    int jobs = 0 ;
+    int job ;
+    while ((job = takeJob()) >= 0) {
+        drawBlockRow(job) ;
+        jobs++ ;
+        if (get_core_num() == 0) checkInput(0) ;
+    }
+    return jobs ;
+}
+
+// Draw the region in passes, both cores at once. Returns 1 if it got to
+// the end, 0 if a command stopped it.
+int drawRegion() {
+    int n ;
+    for (n=FIRST_BLOCK; n>=1; n>>=1) {
+        pass_size = n ;
+        startJobs(region_h / n) ;
+        multicore_fifo_push_blocking(n) ;
+        drawJobs() ;
+        multicore_fifo_pop_blocking() ;
+        if (pending_cmd) return 0 ;
+    }
+    return 1 ;
+}
+
+// Pixel coordinates of the view
+void setCoordinates() {
+    int i, j ;
+    for (i=0; i<640; i++) {
+        x[i] = view_cx + (i - 320) * view_step ;
+    }
+    for (j=0; j<480; j++) {
+        y[j] = view_cy - (j - 240) * view_step ;
+    }
+}
+
+void setRegion(short rx, short ry, short rw, short rh) {
+    region_x = rx ;
+    region_y = ry ;
+    region_w = rw ;
+    region_h = rh ;
+}
+
+// Move the view dx pixels right and dy down. If the picture was finished
+// it's moved along and only the strip uncovered is drawn; otherwise it's
+// all drawn again.
+void pan(int dx, int dy) {
+    fix28 cx = view_cx + dx * view_step ;
+    fix28 cy = view_cy - dy * view_step ;
+    if ((cx > CENTER_MAX) || (cx < -CENTER_MAX) || (cy > CENTER_MAX) || (cy < -CENTER_MAX)) return ;
+    view_cx = cx ;
+    view_cy = cy ;
+    setCoordinates() ;
+
+    if (region_h > 0) {
+        setRegion(0, 0, 640, 480) ;
+        return ;
+    }
+    shiftScreen(-dx, -dy) ;
+    if (dx > 0)      setRegion(640 - dx, 0, dx, 480) ;
+    else if (dx < 0) setRegion(0, 0, -dx, 480) ;
+    else if (dy > 0) setRegion(0, 480 - dy, 640, dy) ;
+    else             setRegion(0, 0, 640, -dy) ;
+}
+
+// Center the view on pixel (px, py), and zoom in (1), out (-1) or neither
+void zoom(short px, short py, int dir) {
+    fix28 cx = view_cx + (px - 320) * view_step ;
+    fix28 cy = view_cy - (py - 240) * view_step ;
+    if (cx > CENTER_MAX) cx = CENTER_MAX ;
+    if (cx < -CENTER_MAX) cx = -CENTER_MAX ;
+    if (cy > CENTER_MAX) cy = CENTER_MAX ;
+    if (cy < -CENTER_MAX) cy = -CENTER_MAX ;
+    view_cx = cx ;
+    view_cy = cy ;
+    if (dir > 0) view_step >>= 1 ;
+    if (dir < 0) view_step <<= 1 ;
+    if (view_step < STEP_MIN) view_step = STEP_MIN ;
+    if (view_step > STEP_MAX) view_step = STEP_MAX ;
+    setCoordinates() ;
+    setRegion(0, 0, 640, 480) ;
+}
+
+// The whole set, -2 to 1 across the screen as in mandelbrot_shared.c
+void resetView() {
+    view_cx = float2fix28(-0.5f) ;
+    view_cy = 0 ;
+    view_step = (3 * ONEfix28) / 640 ;
+    setCoordinates() ;
+    setRegion(0, 0, 640, 480) ;
+}
+
+void doCommand(int c) {
+    switch (c) {
+    case 'w': pan(0, -PAN_STEP) ; break ;
+    case 'a': pan(-PAN_STEP, 0) ; break ;
+    case 's': pan(0, PAN_STEP) ; break ;
+    case 'd': pan(PAN_STEP, 0) ; break ;
+    case 'z': case '+': case '=': zoom(320, 240, 1) ; break ;
+    case 'x': case '-': zoom(320, 240, -1) ; break ;
+    case 't': zoom(tap_x, tap_y, 1) ; break ;
+    case 'r': resetView() ; break ;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Core 1 entry point
+void core1_entry() {
+    while (true) {
+        // Wait for core 0 to start a pass, then help draw it
+        multicore_fifo_pop_blocking() ;
+        multicore_fifo_push_blocking(drawJobs()) ;
+    }
+}
+
+int main() {
+
+    // Initialize stdio
+    stdio_init_all();
+
+    // Initialize VGA
+    initVGA() ;
+
+#if MANDEL_TOUCH
+    // Initialize the touchscreen
+    touch_init() ;
+#endif
+
+    // Spinlock for the job counter
+    job_lock = spin_lock_init(spin_lock_claim_unused(true)) ;
+
+    // Launch core 1
+    multicore_launch_core1(core1_entry) ;
+
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    // ===================================== Mandelbrot =================================================
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    uint32_t begin_time ;
+    float total_time ;
+
+    printf("\nw/a/s/d: pan, z/x: zoom in/out, r: reset\n") ;
+    resetView() ;
+
+    while (true) {
+
+        // Draw what's left of the picture
+        if (region_h > 0) {
+            begin_time = time_us_32() ;
+            iterated[0] = iterated[1] = 0 ;
+
+            if (drawRegion()) {
+                total_time = (float)(time_us_32() - begin_time)*(1./1000000.) ;
+                printf("Center (%f, %f), %.3g per pixel: %3.6f seconds, iterated %d of %d points\n",
+                        fix2float28(view_cx), fix2float28(view_cy), fix2float28(view_step),
+                        total_time, iterated[0] + iterated[1], region_w * region_h) ;
+                setRegion(0, 0, 0, 0) ;
+            }
+        }
+
+        // Wait for the next command
+        while (!pending_cmd) {
+            checkInput(10000) ;
+        }
+        doCommand(pending_cmd) ;
+        pending_cmd = 0 ;
+    }
+}
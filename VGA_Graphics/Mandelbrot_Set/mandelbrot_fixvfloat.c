@@ -20,8 +20,8 @@
  *  - RP2040 GND ---> VGA GND
  *
  * RESOURCES USED
- *  - PIO state machines 0, 1, and 2 on PIO instance 0
- *  - DMA channels 0 and 1
+ *  - 3 PIO state machines on PIO instance 0, and 2 DMA channels, for
+ *    VGA (claimed from lib/hw_claim)
  *  - 153.6 kBytes of RAM (for pixel color data)
  *
  */
@@ -36,16 +36,8 @@
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////// Stuff for Mandelbrot ///////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////
-// Fixed point data type
-typedef signed int fix28 ;
-#define multfix28(a,b) ((fix28)(((( signed long long)(a))*(( signed long long)(b)))>>28)) 
-#define float2fix28(a) ((fix28)((a)*268435456.0f)) // 2^28
-#define fix2float28(a) ((float)(a)/268435456.0f) 
-#define int2fix28(a) ((a)<<28)
-// the fixed point value 4
-#define FOURfix28 0x40000000 
-#define SIXTEENTHfix28 0x01000000
-#define ONEfix28 0x10000000
+// Fixed point data type (fix28)
+#include "fixed_point.h"
 
 // Maximum number of iterations
 #define max_count 1000
@@ -182,8 +174,8 @@ int main() {
                 while (count++ < max_count) {
                     Zim = (multfix28(Zre, Zim)<<1) + Cim ;
                     Zre = Zre_sq - Zim_sq + Cre ;
-                    Zre_sq = multfix28(Zre, Zre) ;
-                    Zim_sq = multfix28(Zim, Zim) ;
+                    Zre_sq = sqrfix28(Zre) ;
+                    Zim_sq = sqrfix28(Zim) ;
 
                     if ((Zre_sq + Zim_sq) >= FOURfix28) break ;
                 }
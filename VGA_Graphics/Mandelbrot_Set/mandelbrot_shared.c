@@ -0,0 +1,216 @@
+/**
+ * Hunter Adams (vha3@cornell.edu)
+ *
+ * Mandelbrot set calculation and visualization, shared between the cores
+ * Uses PIO-assembly VGA driver.
+ *
+ * Both cores draw the whole 640x480 set in fixed point, taking one row
+ * at a time from a shared counter (guarded by a hardware spinlock) until
+ * none are left. Rows near the set take far longer than rows away from
+ * it, so rather than split the screen in two, each core keeps taking
+ * rows until the frame is done. The frame takes about half as long as
+ * it would on one core. (mandelbrot_fixvfloat.c is the fixed point vs.
+ * floating point benchmark, with a half screen on each core.)
+ *
+ * SHORTCUTS
+ *  (The iteration and both shortcuts below are in mandelbrot.h.)
+ *  - Points in the main cardioid or the period-2 bulb are known to be in
+ *    the set, so they aren't iterated at all
+ *  - Other points in the set get caught in a cycle. The iteration saves z
+ *    at steps 8, 16, 32... (Brent's method), and stops as soon as z comes
+ *    back to the saved value exactly.
+ *  - With MANDEL_SUBDIVIDE (default 1) the cores take 32x32 tiles rather
+ *    than rows. Only a tile's border is iterated at first; if it's all in
+ *    one band of counts, the inside is filled with that band's color (the
+ *    points beyond each count are a connected region, so nothing can be
+ *    hiding inside, short of features finer than a pixel). Otherwise the
+ *    tile is split in four and each quarter is tried the same way, down
+ *    to 4x4.
+ *
+ * https://vanhunteradams.com/FixedPoint/FixedPoint.html
+ * https://vanhunteradams.com/Pico/VGA/VGA.html
+ *
+ * HARDWARE CONNECTIONS
+ *  - GPIO 16 ---> VGA Hsync
+ *  - GPIO 17 ---> VGA Vsync
+ *  - GPIO 18 ---> 330 ohm resistor ---> VGA Red
+ *  - GPIO 19 ---> 330 ohm resistor ---> VGA Green
+ *  - GPIO 20 ---> 330 ohm resistor ---> VGA Blue
+ *  - RP2040 GND ---> VGA GND
+ *
+ * RESOURCES USED
+ *  - 3 PIO state machines on PIO instance 0, and 2 DMA channels, for
+ *    VGA (claimed from lib/hw_claim)
+ *  - 153.6 kBytes of RAM (for pixel color data)
+ *  - One hardware spinlock (claimed)
+ *
+ */
+#include "vga_graphics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/sync.h"
+#include "mandelbrot.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+/////////////// Stuff for Mandelbrot ///////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Fill uniform tiles without iterating their insides
+#ifndef MANDEL_SUBDIVIDE
+#define MANDEL_SUBDIVIDE 1
+#endif
+#define TILE 32
+#define TILE_MIN 4
+
+// Coordinates of each pixel column and row (shared by both cores)
+fix28 x[640] ;
+fix28 y[480] ;
+
+// Jobs (rows or tiles) in a frame. No two rows share a byte of the pixel
+// array, and nor do tiles (they start at even columns), so the cores
+// never write the same byte.
+#if MANDEL_SUBDIVIDE
+#define JOBS ((640/TILE) * (480/TILE))
+#else
+#define JOBS 480
+#endif
+
+#if MANDEL_SUBDIVIDE
+// Bands of the tile each core is drawing, or -1 where not yet known
+signed char tile_bands[2][TILE][TILE] ;
+
+// Band of pixel (i, j) of the tile at (tx, ty), iterating and drawing it
+// the first time it's asked for
+int tileBand(signed char (*bands)[TILE], int tx, int ty, int i, int j) {
+    if (bands[j][i] < 0) {
+        bands[j][i] = countBand(mandelbrot(x[tx+i], y[ty+j])) ;
+        drawPixel(tx+i, ty+j, band_colors[bands[j][i]]) ;
+    }
+    return bands[j][i] ;
+}
+
+// Draw the w x h rectangle at (i0, j0) in a tile: its border, then either
+// a fill (if the border is all one band) or its four quarters, which
+// share its middle row and column
+void subdivide(signed char (*bands)[TILE], int tx, int ty, int i0, int j0, int w, int h) {
+    int i, j ;
+    int i1 = i0 + w - 1 ;
+    int j1 = j0 + h - 1 ;
+    int band = tileBand(bands, tx, ty, i0, j0) ;
+    char uniform = 1 ;
+    for (i=i0; i<=i1; i++) {
+        if (tileBand(bands, tx, ty, i, j0) != band) uniform = 0 ;
+        if (tileBand(bands, tx, ty, i, j1) != band) uniform = 0 ;
+    }
+    for (j=j0+1; j<j1; j++) {
+        if (tileBand(bands, tx, ty, i0, j) != band) uniform = 0 ;
+        if (tileBand(bands, tx, ty, i1, j) != band) uniform = 0 ;
+    }
+
+    if (uniform) {
+        fillRect(tx+i0+1, ty+j0+1, w-2, h-2, band_colors[band]) ;
+    }
+    else if ((w <= TILE_MIN) || (h <= TILE_MIN)) {
+        for (j=j0+1; j<j1; j++) {
+            for (i=i0+1; i<i1; i++) {
+                tileBand(bands, tx, ty, i, j) ;
+            }
+        }
+    }
+    else {
+        int hw = w >> 1 ;
+        int hh = h >> 1 ;
+        subdivide(bands, tx, ty, i0,      j0,      hw + 1, hh + 1) ;
+        subdivide(bands, tx, ty, i0 + hw, j0,      w - hw, hh + 1) ;
+        subdivide(bands, tx, ty, i0,      j0 + hh, hw + 1, h - hh) ;
+        subdivide(bands, tx, ty, i0 + hw, j0 + hh, w - hw, h - hh) ;
+    }
+}
+#endif
+
+// Draw jobs until there are none left. Returns how many this core drew.
+int drawJobs() {
+    int jobs = 0 ;
+    int job ;
+    while ((job = takeJob()) >= 0) {
+#if MANDEL_SUBDIVIDE
+        signed char (*bands)[TILE] = tile_bands[get_core_num()] ;
+        memset(bands, -1, TILE * TILE) ;
+        subdivide(bands, (job % (640/TILE)) * TILE, (job / (640/TILE)) * TILE, 0, 0, TILE, TILE) ;
+#else
+        int i ;
+        for (i=0; i<640; i++) {
+            drawPixel(i, job, band_colors[countBand(mandelbrot(x[i], y[job]))]) ;
+        }
+#endif
+        jobs++ ;
+    }
+    return jobs ;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Core 1 entry point
+void core1_entry() {
+    while (true) {
+        // Wait for core 0 to start a frame, then help draw it
+        multicore_fifo_pop_blocking() ;
+        multicore_fifo_push_blocking(drawJobs()) ;
+    }
+}
+
+int main() {
+
+    // Initialize stdio
+    stdio_init_all();
+
+    // Initialize VGA
+    initVGA() ;
+
+    // Spinlock for the job counter
+    job_lock = spin_lock_init(spin_lock_claim_unused(true)) ;
+
+    // Launch core 1
+    multicore_launch_core1(core1_entry) ;
+
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    // ===================================== Mandelbrot =================================================
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    int i, j ;
+    int jobs_core_0, jobs_core_1 ;
+    uint32_t begin_time ;
+    uint32_t end_time ;
+    float total_time ;
+    while (true) {
+
+        // x values
+        for (i=0; i<640; i++) {
+            x[i] = float2fix28(-2.0f + 3.0f * (float)i/640.0f) ;
+        }
+
+        // y values
+        for (j=0; j<480; j++) {
+            y[j] = float2fix28( 1.0f - 2.0f * (float)j/480.0f) ;
+        }
+
+        begin_time = time_us_32() ;
+
+        // Start both cores on the frame
+        startJobs(JOBS) ;
+        iterated[0] = iterated[1] = 0 ;
+        multicore_fifo_push_blocking(0) ;
+        jobs_core_0 = drawJobs() ;
+        jobs_core_1 = multicore_fifo_pop_blocking() ;
+
+        end_time = time_us_32() ;
+        total_time = (float)(end_time - begin_time)*(1./1000000.) ;
+
+        printf("\nTotal time: %3.6f seconds (core 0 drew %d %s, core 1 drew %d)\n",
+                total_time, jobs_core_0, MANDEL_SUBDIVIDE ? "tiles" : "rows", jobs_core_1) ;
+        printf("Iterated %d of 307200 points\n", iterated[0] + iterated[1]) ;
+    }
+}
@@ -0,0 +1,102 @@
+/*
+* ADSR envelopes. The curve table holds (1 - e^(-k u)) / (1 - e^-k) for
+* u from 0 to 1 in 256 steps (k = 5, so each stage is within 1% of its
+* target about 90% of the way through), and a stage's amplitude is
+* start + (target - start) * curve(u). All of it is 32-bit arithmetic.
+*/
+
+#include <math.h>
+#include "hotpath.h"
+#include "dds_adsr.h"
+
+#define CURVE_BITS 8
+#define CURVE_SIZE (1 << CURVE_BITS)
+#define CURVE_K    5.0f
+
+// The curve, 1.15, with an extra entry so u = 1 interpolates
+static fix15 dds_curve[CURVE_SIZE + 1] ;
+
+static void buildCurve() {
+    for (int i=0; i<=CURVE_SIZE; i++) {
+        float u = (float)i / CURVE_SIZE ;
+        dds_curve[i] = (fix15)lroundf(32768.0f * (1.0f - expf(-CURVE_K * u)) / (1.0f - expf(-CURVE_K))) ;
+    }
+}
+
+// Position per sample for a stage of 'samples' samples
+static uint32_t stageRate(int samples) {
+    return (samples > 0) ? (DDS_ADSR_END / samples) + 1 : DDS_ADSR_END ;
+}
+
+void dds_adsr_set(dds_adsr * env, float fs, float attack_ms, float decay_ms, float sustain, float release_ms) {
+    if (dds_curve[CURVE_SIZE] == 0) buildCurve() ;
+    if (sustain < 0.0f) sustain = 0.0f ;
+    if (sustain > 1.0f) sustain = 1.0f ;
+    env->attack = (int)(attack_ms * fs / 1000.0f) ;
+    env->decay = (int)(decay_ms * fs / 1000.0f) ;
+    env->release = (int)(release_ms * fs / 1000.0f) ;
+    env->sustain = (fix15)(sustain * 32768.0f) ;
+    env->attack_rate = stageRate(env->attack) ;
+    env->decay_rate = stageRate(env->decay) ;
+    env->release_rate = stageRate(env->release) ;
+}
+
+// From the amplitude now (so a retriggered or early-released note
+// doesn't jump)
+void dds_adsr_note_on(dds_adsr_state * s) {
+    s->stage = DDS_ATTACK ;
+    s->pos = 0 ;
+    s->start = s->amplitude ;
+}
+
+void dds_adsr_note_off(dds_adsr_state * s) {
+    if (s->stage == DDS_OFF) return ;
+    s->stage = DDS_RELEASE ;
+    s->pos = 0 ;
+    s->start = s->amplitude ;
+}
+
+// The curve at position pos (0 to DDS_ADSR_END), interpolated
+static HOT_INLINE fix15 curveAt(uint32_t pos) {
+    uint32_t i = pos >> (16 - CURVE_BITS) ;
+    int frac = pos & ((1 << (16 - CURVE_BITS)) - 1) ;
+    return dds_curve[i] + (((dds_curve[i + 1] - dds_curve[i]) * frac) >> (16 - CURVE_BITS)) ;
+}
+
+fix15 HOT_KERNEL(dds_adsr_advance)(const dds_adsr * env, dds_adsr_state * s, fix15 level, int frames) {
+    uint32_t rate ;
+    fix15 target ;
+    switch (s->stage) {
+    case DDS_ATTACK:
+        rate = env->attack_rate ;
+        target = level ;
+        break ;
+    case DDS_DECAY:
+        rate = env->decay_rate ;
+        target = (level * env->sustain) >> 15 ;
+        break ;
+    case DDS_RELEASE:
+        rate = env->release_rate ;
+        target = 0 ;
+        break ;
+    case DDS_SUSTAIN:
+        s->amplitude = (level * env->sustain) >> 15 ;
+        return s->amplitude ;
+    default:
+        return s->amplitude ;
+    }
+
+    s->pos += rate * frames ;
+    if (s->pos >= DDS_ADSR_END) {
+        // End of the stage (the rest of this block is spent at its target)
+        s->amplitude = target ;
+        s->start = target ;
+        s->pos = 0 ;
+        s->stage = (s->stage == DDS_ATTACK) ? DDS_DECAY :
+                   (s->stage == DDS_DECAY) ? DDS_SUSTAIN : DDS_OFF ;
+    }
+    else {
+        s->amplitude = s->start + (((target - s->start) * curveAt(s->pos)) >> 15) ;
+    }
+    return s->amplitude ;
+}
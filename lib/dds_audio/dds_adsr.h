@@ -0,0 +1,56 @@
+/**
+ * ADSR envelope generator, evaluated at control rate
+ *
+ * An envelope is attack, decay and release times and a sustain level,
+ * set at run time with dds_adsr_set(). Every stage is an exponential
+ * approach from where the amplitude was when the stage began to the
+ * stage's target, read from a lookup table with linear interpolation.
+ * It's evaluated once per block: dds_adsr_advance() gives the amplitude
+ * at the end of the next block (the caller ramps to it within the block).
+ *
+ * USE
+ *  - dds_adsr_set(&env, Fs, attack_ms, decay_ms, sustain, release_ms),
+ *    any time (sustain is a fraction of the note's level, 0 to 1)
+ *  - Keep a dds_adsr_state per note. dds_adsr_note_on()/_note_off()
+ *    start the attack or release stage, and dds_adsr_advance() moves it
+ *    on by a block and returns the new amplitude.
+ *  - The dds_voices bank does all this for each of its voices
+ *
+ */
+#ifndef DDS_ADSR_H
+#define DDS_ADSR_H
+
+#include <stdint.h>
+#include "fixed_point.h"
+
+// Envelope stages
+enum dds_stage {DDS_OFF, DDS_ATTACK, DDS_DECAY, DDS_SUSTAIN, DDS_RELEASE} ;
+
+// Position through a stage runs from 0 to DDS_ADSR_END
+#define DDS_ADSR_END 65536
+
+typedef struct {
+    int attack, decay, release ;            // stage lengths (samples)
+    fix15 sustain ;                         // sustain level, 0 to 1
+    uint32_t attack_rate ;                  // stage position per sample
+    uint32_t decay_rate ;
+    uint32_t release_rate ;
+} dds_adsr ;
+
+void dds_adsr_set(dds_adsr * env, float fs, float attack_ms, float decay_ms, float sustain, float release_ms) ;
+
+// Where one note is in an envelope
+typedef struct {
+    unsigned char stage ;                   // enum dds_stage
+    uint32_t pos ;                          // position through the stage
+    fix15 start ;                           // amplitude when the stage began
+    fix15 amplitude ;                       // amplitude now
+} dds_adsr_state ;
+
+void dds_adsr_note_on(dds_adsr_state * s) ;
+void dds_adsr_note_off(dds_adsr_state * s) ;
+// Advance by 'frames' samples for a note of peak 'level', returning the
+// amplitude at the end
+fix15 dds_adsr_advance(const dds_adsr * env, dds_adsr_state * s, fix15 level, int frames) ;
+
+#endif
@@ -0,0 +1,203 @@
+/*
+* Block-rendered DAC output. A data channel sends one block of DAC words
+* to the SPI data register, one per DMA timer tick, then chains to a
+* control channel that writes the address of the other block (from a
+* two-entry ring, so it never needs restarting) to the data channel's
+* read-address trigger. Each finished block raises DMA_IRQ_0, and the
+* block is rendered again while the other one is sent. Optionally a PIO
+* state machine pulses LDAC after every frame (dds_ldac.pio). Renders
+* are timed with SysTick.
+*/
+
+#include <math.h>
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
+#include "hardware/structs/systick.h"
+#include "hw_claim.h"
+#include "dds_audio.h"
+#include "dds_ldac.pio.h"
+
+// The ping-pong buffer, and the ring of its two halves' addresses that
+// the control channel reads (aligned to its size for the DMA ring)
+static uint16_t dds_buffers[2][DDS_BLOCK * DDS_MAX_CHANNELS] __attribute__((aligned(4))) ;
+static uint16_t * dds_block_ring[2] __attribute__((aligned(8))) ;
+
+static int data_chan = -1, ctrl_chan = -1 ;
+static int dds_timer = -1 ;
+static int dds_channels = 1 ;
+static spi_inst_t * dds_spi ;
+static dds_render_t dds_render ;
+
+// LDAC state machine, if there is one
+#define LDAC_PIO pio1
+static int ldac_sm = -1 ;
+static uint ldac_offset, ldac_cs_pin, ldac_pin ;
+
+// Blocks sent so far. Block n was sent from half n & 1.
+static volatile unsigned int dds_blocks = 0 ;
+
+// Render timing, and a request from dds_audio_get_stats() to clear it
+static dds_audio_stats dds_stats ;
+static volatile int dds_stats_reset = 1 ;
+static float dds_fs ;
+
+// Set the DMA timer to tick 'rate' times a second. It runs at sys_clk*X/Y
+// for 16-bit X <= Y, so try every X that keeps Y in range and keep the
+// closest.
+static void setTimerRate(float rate) {
+    float sys = (float)clock_get_hz(clk_sys) ;
+    uint16_t best_x = 1, best_y = 0xFFFF ;
+    float best_err = 1e30f ;
+    for (uint32_t x=1; x<=0xFFFF; x++) {
+        uint32_t y = (uint32_t)((float)x * sys / rate + 0.5f) ;
+        if (y > 0xFFFF) break ;
+        if (y < x) continue ;
+        float err = fabsf(sys * (float)x / (float)y - rate) ;
+        if (err < best_err) {
+            best_err = err ;
+            best_x = x ;
+            best_y = y ;
+        }
+    }
+    dma_timer_set_fraction(dds_timer, best_x, best_y) ;
+}
+
+// A block has been sent: render it again while the other one goes out
+static void HOT_ISR(dds_block_handler)() {
+    // DMA_IRQ_0 may be shared, so check that it's ours
+    if (!(dma_hw->ints0 & (1u << data_chan))) return ;
+    dma_hw->ints0 = (1u << data_chan) ;
+
+    int half = dds_blocks & 1 ;
+    dds_blocks++ ;
+
+    // SysTick counts down, and wraps at 24 bits
+    uint32_t start = systick_hw->cvr ;
+    dds_render(dds_buffers[half], DDS_BLOCK) ;
+    uint32_t cycles = (start - systick_hw->cvr) & 0xFFFFFF ;
+
+    if (dds_stats_reset) {
+        dds_stats_reset = 0 ;
+        dds_stats.blocks = 0 ;
+        dds_stats.missed = 0 ;
+        dds_stats.min_cycles = 0xFFFFFFFF ;
+        dds_stats.max_cycles = 0 ;
+        dds_stats.total_cycles = 0 ;
+    }
+    dds_stats.blocks++ ;
+    dds_stats.total_cycles += cycles ;
+    if (cycles < dds_stats.min_cycles) dds_stats.min_cycles = cycles ;
+    if (cycles > dds_stats.max_cycles) dds_stats.max_cycles = cycles ;
+
+    // Late if the data channel has already moved on to this half
+    uint32_t addr = dma_hw->ch[data_chan].read_addr ;
+    if ((addr >= (uint32_t)dds_buffers[half]) &&
+        (addr < (uint32_t)(dds_buffers[half] + DDS_BLOCK * dds_channels))) {
+        dds_stats.missed++ ;
+    }
+}
+
+void dds_audio_init(spi_inst_t * spi, float fs, int channels, dds_render_t render) {
+    dds_spi = spi ;
+    dds_render = render ;
+    dds_channels = (channels < 1) ? 1 : (channels > DDS_MAX_CHANNELS) ? DDS_MAX_CHANNELS : channels ;
+
+    if (data_chan < 0) {
+        data_chan = hw_claim_dma("dds_audio") ;
+        ctrl_chan = hw_claim_dma("dds_audio") ;
+        dds_timer = hw_claim_dma_timer("dds_audio") ;
+    }
+
+    // One DAC word per tick: channels words per sample
+    dds_fs = fs ;
+    setTimerRate(fs * dds_channels) ;
+
+    dds_block_ring[0] = dds_buffers[0] ;
+    dds_block_ring[1] = dds_buffers[1] ;
+}
+
+void dds_audio_ldac(unsigned int cs_pin, unsigned int pin) {
+    if (ldac_sm < 0) {
+        ldac_sm = hw_claim_sm(LDAC_PIO, "dds_audio ldac") ;
+        ldac_offset = hw_add_program(LDAC_PIO, &dds_ldac_program, "dds_audio ldac") ;
+    }
+    ldac_cs_pin = cs_pin ;
+    ldac_pin = pin ;
+}
+
+void dds_audio_start() {
+    // Free-running SysTick on this core (the one that renders), at the
+    // system clock
+    systick_hw->rvr = 0xFFFFFF ;
+    systick_hw->csr = 0x5 ;
+    dds_stats.core = get_core_num() ;
+    dds_stats.budget_cycles = (uint32_t)((float)clock_get_hz(clk_sys) * DDS_BLOCK / dds_fs) ;
+    dds_stats_reset = 1 ;
+
+    // Both halves start full
+    dds_blocks = 0 ;
+    dds_render(dds_buffers[0], DDS_BLOCK) ;
+    dds_render(dds_buffers[1], DDS_BLOCK) ;
+
+    // The LDAC state machine counts words from the first one, so it
+    // starts (from the top) before any are sent
+    if (ldac_sm >= 0) {
+        pio_sm_set_enabled(LDAC_PIO, ldac_sm, false) ;
+        dds_ldac_program_init(LDAC_PIO, ldac_sm, ldac_offset, ldac_cs_pin, ldac_pin, dds_channels) ;
+        pio_sm_set_enabled(LDAC_PIO, ldac_sm, true) ;
+    }
+
+    // Data channel (sends one block to the SPI data register)
+    dma_channel_config c0 = dma_channel_get_default_config(data_chan);   // default configs
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_16);             // 16-bit txfers
+    channel_config_set_read_increment(&c0, true);                        // yes read incrementing
+    channel_config_set_write_increment(&c0, false);                      // no write incrementing
+    channel_config_set_dreq(&c0, dma_get_timer_dreq(dds_timer));         // paced by the DMA timer
+    channel_config_set_chain_to(&c0, ctrl_chan);                         // chain to control channel
+
+    dma_channel_configure(
+        data_chan,                  // Channel to be configured
+        &c0,                        // The configuration we just created
+        &spi_get_hw(dds_spi)->dr,   // write address (SPI data register)
+        dds_buffers[0],             // The initial read address
+        DDS_BLOCK * dds_channels,   // Number of transfers; one block of words
+        false                       // Don't start immediately.
+    );
+
+    // Control channel (hands the data channel the other half)
+    dma_channel_config c1 = dma_channel_get_default_config(ctrl_chan);   // default configs
+    channel_config_set_transfer_data_size(&c1, DMA_SIZE_32);             // 32-bit txfers
+    channel_config_set_read_increment(&c1, true);                        // yes read incrementing
+    channel_config_set_write_increment(&c1, false);                      // no write incrementing
+    channel_config_set_ring(&c1, false, 3);                              // wrap the read address (2 words)
+
+    dma_channel_configure(
+        ctrl_chan,                                  // Channel to be configured
+        &c1,                                        // The configuration we just created
+        &dma_hw->ch[data_chan].al3_read_addr_trig,  // Write address (data channel read address trigger)
+        &dds_block_ring[0],                         // Read address (ring of block addresses)
+        1,                                          // Number of transfers, in this case each is 4 byte
+        false                                       // Don't start immediately.
+    );
+
+    // Each finished block raises DMA_IRQ_0 on this core
+    dma_channel_set_irq0_enabled(data_chan, true);
+    irq_add_shared_handler(DMA_IRQ_0, dds_block_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    // The control channel starts first, handing the data channel half 0
+    dma_start_channel_mask(1u << ctrl_chan) ;
+}
+
+unsigned int dds_audio_blocks() {
+    return dds_blocks ;
+}
+
+void dds_audio_get_stats(dds_audio_stats * stats, int reset) {
+    *stats = dds_stats ;
+    if (stats->blocks == 0) stats->min_cycles = 0 ;
+    if (reset) dds_stats_reset = 1 ;
+}
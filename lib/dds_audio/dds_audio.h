@@ -0,0 +1,98 @@
+/**
+ * Block-rendered audio output to the MCP4822 SPI DAC
+ *
+ * Instead of a timer interrupt per sample, samples are rendered a block
+ * at a time into one half of a ping-pong buffer while DMA streams the
+ * other half to the SPI TX FIFO, paced by a DMA timer (the scheme of
+ * f_DMA_Demo, with the control channel alternating between the halves).
+ * The CPU is interrupted once per block rather than once per sample.
+ *
+ * USE
+ *  - Set up the SPI port (16-bit format) and its pins as before
+ *  - dds_audio_init(spi, Fs, channels, render) with the sample rate, the
+ *    number of DAC words per sample (1, or 2 for both DAC channels), and
+ *    a function that fills a block
+ *  - dds_audio_start() renders the first two blocks and starts output.
+ *    The render function is then called from DMA_IRQ_0, on the core that
+ *    called dds_audio_start(), each time a block has been sent.
+ *  - render(block, frames) writes frames * channels DAC words (config
+ *    bits included, e.g. DAC_CONFIG_CHAN_A | value), channel by channel
+ *    within each frame. It must finish within one block period, so put
+ *    it in RAM with HOT_ISR() (hotpath.h), as the handler and the voice
+ *    bank's renderer are.
+ *  - Both channels' words go out in one stream, so with LDAC tied low
+ *    channel A changes one word time before B. To change them together,
+ *    call dds_audio_ldac(cs_pin, ldac_pin) before dds_audio_start()
+ *    (instead of driving LDAC low as a GPIO): a PIO program holds LDAC
+ *    high and pulses it once per frame, after the frame's last word.
+ *
+ * RESOURCES USED
+ *  - Two DMA channels and a DMA timer, claimed from lib/hw_claim in
+ *    dds_audio_init()
+ *  - DMA_IRQ_0 (shared handler)
+ *  - 2 * DDS_BLOCK * channels 16-bit words for the buffers
+ *  - With dds_audio_ldac(), a state machine (claimed) and 5 instructions
+ *    on pio1
+ *  - The SysTick of the core that calls dds_audio_start(), free running
+ *    at the system clock, to time the render function
+ *
+ * STATS
+ *  - Each render is timed in cycles. dds_audio_get_stats() gives the
+ *    minimum, maximum and total render time since the last reset, the
+ *    cycle budget for one block, and the number of blocks that missed
+ *    their deadline (the DMA had started sending a block before it was
+ *    rendered, so part of an old block was heard). Utilization is the
+ *    total over blocks * budget.
+ *  - Stats are updated from the interrupt, so a copy taken on the other
+ *    core may mix two blocks' updates. Pass reset to start a new window
+ *    (the interrupt clears them at its next block).
+ *
+ */
+#ifndef DDS_AUDIO_H
+#define DDS_AUDIO_H
+
+#include <stdint.h>
+#include "hardware/spi.h"
+#include "hotpath.h"
+
+// Frames per block (build-time, 64 to 256). Larger blocks wake the CPU
+// less often; smaller ones respond sooner.
+#ifndef DDS_BLOCK
+#define DDS_BLOCK 128
+#endif
+
+#if (DDS_BLOCK < 64) || (DDS_BLOCK > 256)
+#error "DDS_BLOCK must be 64 to 256 frames"
+#endif
+
+// DAC words per frame at most (DAC channels A and B)
+#define DDS_MAX_CHANNELS 2
+
+// MCP4822 config bits: channel A or B, 1x gain, active
+#define DAC_CONFIG_CHAN_A 0b0011000000000000
+#define DAC_CONFIG_CHAN_B 0b1011000000000000
+
+// Fills one block of frames * channels DAC words
+typedef void (*dds_render_t)(uint16_t * block, int frames) ;
+
+// Render timing since the last reset (see STATS above)
+typedef struct {
+    unsigned int blocks ;                   // blocks rendered
+    unsigned int missed ;                   // blocks rendered too late
+    uint32_t min_cycles ;                   // per block
+    uint32_t max_cycles ;
+    uint64_t total_cycles ;
+    uint32_t budget_cycles ;                // one block period
+    int core ;                              // core rendering the blocks
+} dds_audio_stats ;
+
+void dds_audio_init(spi_inst_t * spi, float fs, int channels, dds_render_t render) ;
+// Drive LDAC from PIO (see above)
+void dds_audio_ldac(unsigned int cs_pin, unsigned int ldac_pin) ;
+void dds_audio_start(void) ;
+// Number of blocks sent so far
+unsigned int dds_audio_blocks(void) ;
+// Copy the render stats, and optionally start a new window
+void dds_audio_get_stats(dds_audio_stats * stats, int reset) ;
+
+#endif
@@ -0,0 +1,138 @@
+/*
+* DDS voice bank. Each voice's amplitude is a linear ramp within a
+* block, from its value at the start of the block to the value that its
+* envelope gives at the end, so the per-sample loop never tests the
+* stage. Voices are mixed as 16.15 samples and scaled to the 12-bit
+* DAC (a full-scale voice at gain 1 spans the whole DAC range). A voice's
+* phase steps, and looks up its sine table entry, on an interpolator.
+*/
+
+#include <string.h>
+#include "dds_audio.h"
+#include "dds_voices.h"
+
+#define two32 4294967296.0  // 2^32 (a constant)
+
+// One cycle of sine, packed with the step to the next entry (see
+// gen_sine.py), generated for each size at configure time
+#if (DDS_SINE_BITS == 8)
+#include "dds_sine_8.h"
+#elif (DDS_SINE_BITS == 9)
+#include "dds_sine_9.h"
+#elif (DDS_SINE_BITS == 10)
+#include "dds_sine_10.h"
+#elif (DDS_SINE_BITS == 11)
+#include "dds_sine_11.h"
+#else
+#include "dds_sine_12.h"
+#endif
+
+// The table index is the top DDS_SINE_BITS of phase, and the
+// interpolation fraction the 15 below them
+#define SINE_SHIFT (32 - DDS_SINE_BITS)
+#define FRAC_SHIFT (SINE_SHIFT - 15)
+
+// The interpolator that steps a voice's phase and looks up its table
+// entry (see fix_phase_init()). interp0 is left for the app; this one is
+// saved and restored around each block, as rendering is in an interrupt.
+#define SINE_INTERP interp1
+
+// The next sine sample of the voice in SINE_INTERP, 1.15
+static HOT_INLINE int nextSine(void) {
+#if DDS_SINE_INTERP
+    int frac = (fix_phase_get(SINE_INTERP) >> FRAC_SHIFT) & 0x7FFF ;
+    uint32_t e = *(const uint32_t *)fix_phase_next(SINE_INTERP) ;
+    return (short)e + ((((int)e >> 16) * frac) >> 15) ;
+#else
+    return (short)*(const uint32_t *)fix_phase_next(SINE_INTERP) ;
+#endif
+}
+
+// Per-channel mixes of the block being rendered
+static int dds_mix[DDS_MAX_CHANNELS][DDS_BLOCK] ;
+
+// DAC config bits for each channel
+static const uint16_t dds_config[DDS_MAX_CHANNELS] = {DAC_CONFIG_CHAN_A, DAC_CONFIG_CHAN_B} ;
+
+void dds_voices_init(dds_voice_bank * bank, float fs) {
+    memset(bank, 0, sizeof(*bank)) ;
+    bank->fs = fs ;
+    bank->gain = 32768 ;
+    dds_adsr_set(&bank->instant, fs, 0.0f, 0.0f, 1.0f, 0.0f) ;
+    for (int v=0; v<DDS_VOICES; v++) {
+        bank->envelope[v] = &bank->instant ;
+    }
+}
+
+void dds_voice_set_freq(dds_voice_bank * bank, int v, float freq) {
+    if ((v < 0) || (v >= DDS_VOICES)) return ;
+    bank->incr[v] = (uint32_t)((freq * two32) / bank->fs) ;
+}
+
+void dds_voice_set_channel(dds_voice_bank * bank, int v, int channel) {
+    if ((v < 0) || (v >= DDS_VOICES)) return ;
+    bank->channel[v] = channel ;
+}
+
+void dds_voice_set_envelope(dds_voice_bank * bank, int v, const dds_adsr * env) {
+    if ((v < 0) || (v >= DDS_VOICES)) return ;
+    bank->envelope[v] = env ? env : &bank->instant ;
+}
+
+void dds_voice_note_on(dds_voice_bank * bank, int v, fix15 level) {
+    if ((v < 0) || (v >= DDS_VOICES)) return ;
+    bank->level[v] = level ;
+    dds_adsr_note_on(&bank->env[v]) ;
+}
+
+void dds_voice_note_off(dds_voice_bank * bank, int v) {
+    if ((v < 0) || (v >= DDS_VOICES)) return ;
+    dds_adsr_note_off(&bank->env[v]) ;
+}
+
+int dds_voices_active(const dds_voice_bank * bank) {
+    int n = 0 ;
+    for (int v=0; v<DDS_VOICES; v++) {
+        if (bank->env[v].stage != DDS_OFF) n++ ;
+    }
+    return n ;
+}
+
+void HOT_KERNEL(dds_voices_render)(dds_voice_bank * bank, uint16_t * block, int frames, int channels) {
+    int i, c, v ;
+    if (frames > DDS_BLOCK) frames = DDS_BLOCK ;
+    if (channels > DDS_MAX_CHANNELS) channels = DDS_MAX_CHANNELS ;
+    for (c=0; c<channels; c++) {
+        memset(dds_mix[c], 0, frames * sizeof(int)) ;
+    }
+
+    interp_hw_save_t saved ;
+    interp_save(SINE_INTERP, &saved) ;
+    fix_phase_init(SINE_INTERP, dds_sine, DDS_SINE_BITS, 2) ;
+
+    // Each voice adds a whole block to its channel's mix
+    for (v=0; v<DDS_VOICES; v++) {
+        if (bank->env[v].stage == DDS_OFF) continue ;
+        int * mix = dds_mix[(bank->channel[v] < channels) ? bank->channel[v] : 0] ;
+        fix15 a = bank->env[v].amplitude ;
+        fix15 end = dds_adsr_advance(bank->envelope[v], &bank->env[v], bank->level[v], frames) ;
+        fix15 step = (end - a) / frames ;
+        fix_phase_set(SINE_INTERP, bank->phase[v], bank->incr[v]) ;
+        for (i=0; i<frames; i++) {
+            mix[i] += (nextSine() * a) >> 15 ;
+            a += step ;
+        }
+        bank->phase[v] = fix_phase_get(SINE_INTERP) ;
+    }
+    interp_restore(SINE_INTERP, &saved) ;
+
+    // Scale, saturate and pack, channel by channel within each frame
+    for (i=0; i<frames; i++) {
+        for (c=0; c<channels; c++) {
+            int s = 2048 + (((dds_mix[c][i] >> 4) * bank->gain) >> 15) ;
+            if (s < 0) s = 0 ;
+            if (s > 4095) s = 4095 ;
+            *block++ = dds_config[c] | s ;
+        }
+    }
+}
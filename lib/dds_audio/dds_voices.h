@@ -0,0 +1,81 @@
+/**
+ * Polyphonic DDS voice bank, rendered a block at a time
+ *
+ * Each voice is a sine oscillator (phase accumulator and increment) with
+ * an ADSR amplitude envelope (dds_adsr.h), assigned to one DAC channel.
+ * The voice state is kept as one array per field, and each voice renders
+ * a whole block into a per-channel mix before the next, so the inner
+ * loop is a table lookup, a multiply and two adds per voice-sample (one
+ * more multiply to interpolate the table), with no branches.
+ * The mix is scaled, saturated and packed into DAC words at the end.
+ *
+ * USE
+ *  - dds_voices_init(&bank, Fs)
+ *  - dds_voice_set_freq() and dds_voice_set_channel() for each voice,
+ *    and dds_voice_set_envelope() to give it an envelope (voices share
+ *    the bank's own, instant on and off, until then)
+ *  - dds_voice_note_on(&bank, v, level) starts voice v's attack towards
+ *    peak level, and dds_voice_note_off(&bank, v) its release
+ *  - In the dds_audio render function, dds_voices_render(&bank, block,
+ *    frames, channels) fills the block
+ *  - The envelope advances a block at a time: stage changes take effect
+ *    at the next block boundary, and ramps are linear within a block
+ *
+ * SINE TABLE
+ *  - DDS_SINE_BITS (8 to 12, default 10) sets the table to 2^bits
+ *    entries. It's const, generated at configure time, so it's in flash;
+ *    at 12 bits (16 KB) it no longer fits in the XIP cache with
+ *    everything else.
+ *  - With DDS_SINE_INTERP (default 1) each sample interpolates between
+ *    two entries using the next 15 bits of phase. Each entry holds its
+ *    value and the step to the next, so that's one extra multiply. With
+ *    DDS_SINE_INTERP=0 the phase is truncated, as in the other DDS demos.
+ *
+ */
+#ifndef DDS_VOICES_H
+#define DDS_VOICES_H
+
+#include <stdint.h>
+#include "dds_adsr.h"
+
+// Voices in a bank (build-time)
+#ifndef DDS_VOICES
+#define DDS_VOICES 16
+#endif
+
+// Sine table size and interpolation (build-time)
+#ifndef DDS_SINE_BITS
+#define DDS_SINE_BITS 10
+#endif
+#if (DDS_SINE_BITS < 8) || (DDS_SINE_BITS > 12)
+#error "DDS_SINE_BITS must be between 8 (256 entries) and 12 (4096 entries)"
+#endif
+#ifndef DDS_SINE_INTERP
+#define DDS_SINE_INTERP 1
+#endif
+
+typedef struct {
+    float fs ;                              // sample rate (Hz)
+    fix15 gain ;                            // applied to each channel's mix
+    uint32_t phase[DDS_VOICES] ;            // phase accumulators
+    uint32_t incr[DDS_VOICES] ;             // phase increments (frequency)
+    fix15 level[DDS_VOICES] ;               // peak levels, 0 to 1
+    unsigned char channel[DDS_VOICES] ;     // DAC channel (0 is A, 1 is B)
+    const dds_adsr * envelope[DDS_VOICES] ; // envelope shapes
+    dds_adsr_state env[DDS_VOICES] ;        // envelope stages and amplitudes
+    dds_adsr instant ;                      // the default envelope
+} dds_voice_bank ;
+
+void dds_voices_init(dds_voice_bank * bank, float fs) ;
+void dds_voice_set_freq(dds_voice_bank * bank, int v, float freq) ;
+void dds_voice_set_channel(dds_voice_bank * bank, int v, int channel) ;
+// The envelope is used, not copied, so it can be changed while playing
+void dds_voice_set_envelope(dds_voice_bank * bank, int v, const dds_adsr * env) ;
+void dds_voice_note_on(dds_voice_bank * bank, int v, fix15 level) ;
+void dds_voice_note_off(dds_voice_bank * bank, int v) ;
+// Number of voices not DDS_OFF
+int dds_voices_active(const dds_voice_bank * bank) ;
+// Fill a block of frames * channels DAC words (see dds_audio.h)
+void dds_voices_render(dds_voice_bank * bank, uint16_t * block, int frames, int channels) ;
+
+#endif
@@ -0,0 +1,45 @@
+#!/usr/bin/env python3
+"""
+Writes a 2^BITS entry sine table for the dds_voices bank into a header.
+Each entry packs the sample (1.15) in the low half-word and the step to
+the next sample in the high half-word, so interpolating between entries
+costs one multiply. Run by CMake at configure time, once per supported
+size.
+
+    gen_sine.py BITS OUTPUT
+"""
+
+import math
+import sys
+
+
+def main():
+    bits = int(sys.argv[1])
+    n = 1 << bits
+    values = [int(round(32767.0 * math.sin(2.0 * math.pi * i / n))) for i in range(n)]
+    packed = []
+    for i in range(n):
+        delta = values[(i + 1) % n] - values[i]
+        packed.append((values[i] & 0xFFFF) | ((delta & 0xFFFF) << 16))
+
+    lines = [
+        '// Generated by gen_sine.py %d - do not edit' % bits,
+        '',
+        '#if (DDS_SINE_BITS != %d)' % bits,
+        '#error "dds_voices sine table included for the wrong size"',
+        '#endif',
+        '',
+        '// sin(2pi i/N) in the low half-word, sin(2pi (i+1)/N) - sin(2pi i/N)',
+        '// in the high half-word, both 1.15',
+        'static const uint32_t dds_sine[%d] = {' % n,
+    ]
+    for i in range(0, n, 8):
+        lines.append('    ' + ', '.join('0x%08x' % v for v in packed[i:i + 8]) + ',')
+    lines.append('} ;')
+    lines.append('')
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(lines))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,237 @@
+/*
+* Fixed-point radix-4 FFT. For how the radix-2 version this grew from
+* works, see https://vanhunteradams.com/FFT/FFT.html
+*/
+
+#include "hotpath.h"
+#include "fix_fft.h"
+
+// The twiddles, bit-reversal swaps and Hann window, generated for each
+// size by gen_tables.py at configure time. They're const, so they stay
+// in flash.
+#if (FFT_LOG2_N == 8)
+#include "fix_fft_tables_8.h"
+#elif (FFT_LOG2_N == 9)
+#include "fix_fft_tables_9.h"
+#elif (FFT_LOG2_N == 10)
+#include "fix_fft_tables_10.h"
+#elif (FFT_LOG2_N == 11)
+#include "fix_fft_tables_11.h"
+#else
+#include "fix_fft_tables_12.h"
+#endif
+
+// a*w>>15 for a 16.15 value a (below 2^30) and a 1.15 twiddle w, as two
+// 32-bit multiplies (the M0+ has no 32x32->64 multiply)
+static HOT_INLINE fix15 multw(fix15 a, int w) {
+    return ((a >> 16) * w * 2) + (((int)(a & 0xFFFF) * w) >> 15) ;
+}
+
+// In-place FFT of n = 2^bits points, with point i at re[i*step] and
+// im[i*step]. Inlined into fft_complex() and fft_real(), which pass
+// constants, so the indexing costs nothing for separate arrays. Those
+// run from RAM; the tables are read through the XIP cache.
+static HOT_INLINE void fft_kernel(fix15 re[], fix15 im[], const int step, const int bits,
+                              const uint32_t swaps[], const int swap_count) {
+
+    const int n = 1 << bits ;
+    int i, m, k ;
+    int L ;         // length of the FFT's being combined
+    int stride ;    // twiddle table step for this pass
+    fix15 tr, ti ;
+
+    //////////////////////////////////////////////////////////////////////////
+    ////////////////////////// BIT REVERSAL //////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////
+    for (k=0; k<swap_count; k++) {
+        int a = (swaps[k] & 0xFFFF) * step ;
+        int b = (swaps[k] >> 16) * step ;
+        tr = re[a] ; re[a] = re[b] ; re[b] = tr ;
+        ti = im[a] ; im[a] = im[b] ; im[b] = ti ;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    ////////////////////////// RADIX-2 PASS //////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////
+    // An odd power of two leaves one factor of 2 over from the radix-4
+    // passes. Do it first, where the only twiddle is 1.
+    L = 1 ;
+    if (bits & 1) {
+        for (i=0; i<n*step; i+=2*step) {
+            fix15 ar = re[i] >> 1, ai = im[i] >> 1 ;
+            fix15 br = re[i+step] >> 1, bi = im[i+step] >> 1 ;
+            re[i] = ar + br ;
+            im[i] = ai + bi ;
+            re[i+step] = ar - br ;
+            im[i+step] = ai - bi ;
+        }
+        L = 2 ;
+    }
+
+    //////////////////////////////////////////////////////////////////////////
+    ////////////////////////// RADIX-4 PASSES ////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////
+    // Each pass combines four FFT's of length L (at i, i+L, i+2L and i+3L,
+    // in bit-reversed order) into one of length 4L. All four inputs are
+    // divided by 4 on the way in.
+    while (L < n) {
+        // W of the length 4L FFT is W^(FFT_N/4L) of the table's
+        stride = FFT_N / (4 * L) ;
+        for (m=0; m<L; m++) {
+            // W^2m, W^m and W^3m of the length 4L FFT
+            uint32_t w1 = fft_twiddles[2 * m * stride] ;
+            uint32_t w2 = fft_twiddles[m * stride] ;
+            uint32_t w3 = fft_twiddles[3 * m * stride] ;
+            int c1 = (short)w1, s1 = (int)w1 >> 16 ;
+            int c2 = (short)w2, s2 = (int)w2 >> 16 ;
+            int c3 = (short)w3, s3 = (int)w3 >> 16 ;
+            for (i=m*step; i<n*step; i+=4*L*step) {
+                int i1 = i + L*step, i2 = i + 2*L*step, i3 = i + 3*L*step ;
+                fix15 t0r, t0i, t1r, t1i, t2r, t2i, t3r, t3i ;
+                // twiddle the inputs (the first column has W = 1)
+                t0r = re[i] >> 2 ;
+                t0i = im[i] >> 2 ;
+                if (m == 0) {
+                    t1r = re[i1] >> 2 ;   t1i = im[i1] >> 2 ;
+                    t2r = re[i2] >> 2 ;   t2i = im[i2] >> 2 ;
+                    t3r = re[i3] >> 2 ;   t3i = im[i3] >> 2 ;
+                }
+                else {
+                    tr = re[i1] ; ti = im[i1] ;
+                    t1r = (multw(tr, c1) + multw(ti, s1)) >> 2 ;
+                    t1i = (multw(ti, c1) - multw(tr, s1)) >> 2 ;
+                    tr = re[i2] ; ti = im[i2] ;
+                    t2r = (multw(tr, c2) + multw(ti, s2)) >> 2 ;
+                    t2i = (multw(ti, c2) - multw(tr, s2)) >> 2 ;
+                    tr = re[i3] ; ti = im[i3] ;
+                    t3r = (multw(tr, c3) + multw(ti, s3)) >> 2 ;
+                    t3i = (multw(ti, c3) - multw(tr, s3)) >> 2 ;
+                }
+                // 4-point butterfly (its twiddles are 1, -j, -1, j)
+                fix15 ar = t0r + t1r, ai = t0i + t1i ;
+                fix15 br = t0r - t1r, bi = t0i - t1i ;
+                fix15 cr = t2r + t3r, ci = t2i + t3i ;
+                fix15 dr = t2r - t3r, di = t2i - t3i ;
+                re[i]  = ar + cr ;
+                im[i]  = ai + ci ;
+                re[i2] = ar - cr ;
+                im[i2] = ai - ci ;
+                re[i1] = br + di ;
+                im[i1] = bi - dr ;
+                re[i3] = br - di ;
+                im[i3] = bi + dr ;
+            }
+        }
+        L <<= 2 ;
+    }
+}
+
+void HOT_KERNEL(fft_complex)(fix15 fr[], fix15 fi[]) {
+    fft_kernel(fr, fi, 1, FFT_LOG2_N, fft_swaps, FFT_SWAP_COUNT) ;
+}
+
+void HOT_KERNEL(fft_real)(fix15 x[]) {
+
+    const int half = FFT_N / 2 ;
+    int k ;
+
+    // The even samples are the real parts and the odd samples the imaginary
+    // parts of an FFT_N/2 point complex sequence z, already interleaved
+    fft_kernel(x, x + 1, 2, FFT_LOG2_N - 1, fft_half_swaps, FFT_HALF_SWAP_COUNT) ;
+
+    //////////////////////////////////////////////////////////////////////////
+    ////////////////////////// SPLIT /////////////////////////////////////////
+    //////////////////////////////////////////////////////////////////////////
+    // With Z = FFT(z), the even samples' FFT is E[k] = (Z[k] + Z*[N/2-k])/2
+    // and the odd samples' is O[k] = (Z[k] - Z*[N/2-k])/2j, then
+    // X[k] = E[k] + W^k O[k] and X[N/2-k] = (E[k] - W^k O[k])*.
+    // Everything is halved again so X comes out divided by FFT_N.
+
+    // DC and Nyquist are real: X[0] = Zr + Zi and X[N/2] = Zr - Zi
+    fix15 r0 = x[0] >> 1, i0 = x[1] >> 1 ;
+    x[0] = r0 + i0 ;
+    x[1] = r0 - i0 ;
+
+    for (k=1; k<half/2; k++) {
+        fix15 ar = x[2*k], ai = x[2*k+1] ;
+        fix15 br = x[2*(half-k)], bi = x[2*(half-k)+1] ;
+        // E and O (quartered)
+        fix15 er = (ar >> 2) + (br >> 2), ei = (ai >> 2) - (bi >> 2) ;
+        fix15 qr = (ai >> 2) + (bi >> 2), qi = (br >> 2) - (ar >> 2) ;
+        // W^k O
+        uint32_t w = fft_twiddles[k] ;
+        int c = (short)w, s = (int)w >> 16 ;
+        fix15 tr = multw(qr, c) + multw(qi, s) ;
+        fix15 ti = multw(qi, c) - multw(qr, s) ;
+        x[2*k] = er + tr ;
+        x[2*k+1] = ei + ti ;
+        x[2*(half-k)] = er - tr ;
+        x[2*(half-k)+1] = ti - ei ;
+    }
+
+    // X[N/4] = Z*[N/4] (halved)
+    x[half] = x[half] >> 1 ;
+    x[half+1] = -(x[half+1] >> 1) ;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// ========================= Magnitude and dB ================================
+//////////////////////////////////////////////////////////////////////////////
+
+// floor(sqrt(x)), from a table seed and one Newton step
+static HOT_INLINE uint32_t isqrt32(uint32_t x) {
+    if (x == 0) return 0 ;
+    // normalize by an even shift to [2^30, 2^32)
+    int n = __builtin_clz(x) & ~1 ;
+    uint32_t xn = x << n ;
+    uint32_t y = fft_sqrt_seed[(xn >> 24) - 64] ;
+    y = ((y + xn / y) >> 1) >> (n >> 1) ;
+    // the shift back can leave it one off
+    if (y > 0xFFFF) y = 0xFFFF ;
+    if (y * y > x) y-- ;
+    else if (y < 0xFFFF && (y + 1) * (y + 1) <= x) y++ ;
+    return y ;
+}
+
+fix15 HOT_KERNEL(fft_mag)(fix15 re, fix15 im) {
+    uint32_t a = (re < 0) ? -re : re ;
+    uint32_t b = (im < 0) ? -im : im ;
+    uint32_t m = (a > b) ? a : b ;
+    // scale both down to 15 bits so the sum of squares fits in 32
+    int s = 17 - __builtin_clz(m | 1) ;
+    if (s < 0) s = 0 ;
+    a >>= s ;
+    b >>= s ;
+    return (fix15)(isqrt32(a*a + b*b) << s) ;
+}
+
+void HOT_KERNEL(fft_real_mag)(const fix15 x[], fix15 mag[]) {
+    int k ;
+    // DC and Nyquist share bin 0's slot, and are real
+    fix15 dc = x[0] ;
+    mag[0] = (dc < 0) ? -dc : dc ;
+    for (k=1; k<(FFT_N>>1); k++) {
+        mag[k] = fft_mag(x[2*k], x[2*k+1]) ;
+    }
+}
+
+fix15 fft_db(fix15 mag) {
+    if (mag <= 0) return FFT_DB_FLOOR ;
+    // log2(mag) = integer part (position of the leading one, less the 15
+    // fraction bits) + a table lookup on the 8 bits after it
+    int lead = 31 - __builtin_clz((uint32_t)mag) ;
+    uint32_t frac = (lead >= 8) ? ((uint32_t)mag >> (lead - 8)) & 0xFF
+                                : ((uint32_t)mag << (8 - lead)) & 0xFF ;
+    fix15 log2 = (lead - 15) * 32768 + fft_log2_frac[frac] ;
+    // 20 log10(mag) = 6.0206 log2(mag), and 0.0206 is 675 in 1.15
+    fix15 db = log2 * 6 + ((log2 * 675) >> 15) ;
+    return (db < FFT_DB_FLOOR) ? FFT_DB_FLOOR : db ;
+}
+
+void fft_db_array(const fix15 mag[], fix15 db[], int count) {
+    int k ;
+    for (k=0; k<count; k++) {
+        db[k] = fft_db(mag[k]) ;
+    }
+}
+
@@ -0,0 +1,76 @@
+/**
+ * Fixed-point (16.15) FFT for the RP2040
+ *
+ * A radix-4 decimation-in-time FFT, with one radix-2 pass first when the
+ * length is an odd power of two. The bit-reversal permutation is a table
+ * of swaps and the twiddles are a table of packed cos/sin pairs. Both,
+ * and a Hann window, are generated at build time (gen_tables.py) for each
+ * size and live in flash. fft_real() handles real input at half cost.
+ *
+ * SIZE
+ *  - Set FFT_LOG2_N (e.g. target_compile_definitions(app PRIVATE
+ *    FFT_LOG2_N=11)) for a 2^FFT_LOG2_N point FFT, 256 to 4096 points.
+ *    The default is 1024 points.
+ *  - The tables take 10*FFT_N bytes of flash (10 kBytes at 1024 points)
+ *
+ * REAL INPUT
+ *  - fft_real() transforms FFT_N real samples as an FFT_N/2 point complex
+ *    FFT (even samples real, odd samples imaginary) and a split pass, in
+ *    about half the time of fft_complex() and with no imaginary array.
+ *  - The result replaces the samples: bin k's real part in x[2k] and its
+ *    imaginary part in x[2k+1], for k = 1 ... FFT_N/2-1. DC and Nyquist
+ *    are real, so bin 0 is in x[0] and bin FFT_N/2 in x[1].
+ *
+ * SCALING
+ *  - Like the radix-2 FFTfix() this replaces, each pass scales its outputs
+ *    so that the whole transform is divided by FFT_N, and can't overflow
+ *    for inputs below 2^30 in magnitude.
+ *
+ * MAGNITUDE AND dB
+ *  - fft_mag() is sqrt(re^2 + im^2) to about 15 significant bits (alpha
+ *    max plus beta min is off by up to 4%), with 32-bit multiplies and
+ *    one divide. fft_real_mag() does it for every bin of fft_real().
+ *  - fft_db() is 20 log10(mag), in 16.15, from a 256-entry log2 table
+ *    (within 0.04 dB), clamped below at FFT_DB_FLOOR.
+ *
+ * NOTE
+ *  - A radix-4 butterfly does three complex twiddle multiplies for four
+ *    points where two radix-2 passes do four, and with twiddles of 16
+ *    bits, each is two 32-bit products (multfix15() takes four)
+ *
+ */
+#ifndef FIX_FFT_H
+#define FIX_FFT_H
+
+#include <stdint.h>
+#include "fixed_point.h"
+
+#ifndef FFT_LOG2_N
+#define FFT_LOG2_N 10
+#endif
+#if (FFT_LOG2_N < 8) || (FFT_LOG2_N > 12)
+#error "FFT_LOG2_N must be between 8 (256 points) and 12 (4096 points)"
+#endif
+
+#define FFT_N (1 << FFT_LOG2_N)
+
+// Hann window for FFT_N points, 16.15
+extern const fix15 fft_hann[FFT_N] ;
+
+// In-place FFT of FFT_N points, real parts in fr[] and imaginary in fi[]
+void fft_complex(fix15 fr[], fix15 fi[]) ;
+// In-place FFT of FFT_N real samples in x[] (see REAL INPUT above)
+void fft_real(fix15 x[]) ;
+
+// Lowest value fft_db() returns (-120 dB), also for a magnitude of 0
+#define FFT_DB_FLOOR (-120 * 32768)
+// Magnitude of re + j im
+fix15 fft_mag(fix15 re, fix15 im) ;
+// Magnitudes of bins 0 ... FFT_N/2-1 of fft_real()'s result, into mag[]
+// (which may be x[] itself). Bin 0 is the DC term.
+void fft_real_mag(const fix15 x[], fix15 mag[]) ;
+// 20 log10(mag), in 16.15
+fix15 fft_db(fix15 mag) ;
+void fft_db_array(const fix15 mag[], fix15 db[], int count) ;
+
+#endif
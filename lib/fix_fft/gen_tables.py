@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Writes the constant tables for a 2^LOG2_N point fix_fft into a header:
+the packed twiddles, the bit-reversal swaps at N and N/2 points, the
+square root and log2 tables, and a Hann window. Run by CMake at configure time, once per supported size.
+
+    gen_tables.py LOG2_N OUTPUT
+"""
+
+import math
+import sys
+
+
+def twiddle_value(v):
+    # 1.15, saturating +1.0 to the largest half-word
+    return min(int(round(v * 32768.0)), 32767)
+
+
+def swaps(bits):
+    out = []
+    for k in range(1, (1 << bits) - 1):
+        r = int(format(k, '0%db' % bits)[::-1], 2)
+        if r > k:
+            out.append(k | (r << 16))
+    return out
+
+
+def table(ctype, name, values, fmt, storage='static '):
+    lines = ['%sconst %s %s[%d] = {' % (storage, ctype, name, max(len(values), 1))]
+    for i in range(0, len(values), 8):
+        lines.append('    ' + ', '.join(fmt(v) for v in values[i:i + 8]) + ',')
+    if not values:
+        lines.append('    0')
+    lines.append('} ;')
+    return '\n'.join(lines)
+
+
+def main():
+    bits = int(sys.argv[1])
+    n = 1 << bits
+    twiddles = []
+    for k in range(3 * n // 4):
+        a = 2.0 * math.pi * k / n
+        c = twiddle_value(math.cos(a)) & 0xFFFF
+        s = twiddle_value(math.sin(a)) & 0xFFFF
+        twiddles.append(c | (s << 16))
+    # periodic Hann window, 16.15
+    hann = [int(round(0.5 * (1.0 - math.cos(2.0 * math.pi * i / n)) * 32768.0))
+            for i in range(n)]
+    full = swaps(bits)
+    half = swaps(bits - 1)
+    # sqrt((i + 0.5) * 2^24) for the top byte i (64...255) of a 32-bit
+    # value normalized to [2^30, 2^32)
+    sqrt_seed = [int(round(math.sqrt((i + 0.5) * 2 ** 24))) for i in range(64, 256)]
+    # log2(1 + (i + 0.5)/256), 1.15
+    log2_frac = [int(round(math.log2(1.0 + (i + 0.5) / 256.0) * 32768.0)) for i in range(256)]
+
+    hexfmt = lambda v: '0x%08x' % v
+    out = [
+        '// Generated by gen_tables.py %d - do not edit' % bits,
+        '',
+        '#if (FFT_LOG2_N != %d)' % bits,
+        '#error "fix_fft tables included for the wrong size"',
+        '#endif',
+        '',
+        '// W^k = cos(2pi k/N) - j sin(2pi k/N), cos in the low half-word',
+        table('uint32_t', 'fft_twiddles', twiddles, hexfmt),
+        '',
+        '// Bit-reversal swaps at N points, index in the low half-word',
+        '#define FFT_SWAP_COUNT %d' % len(full),
+        table('uint32_t', 'fft_swaps', full, hexfmt),
+        '',
+        '// Bit-reversal swaps at N/2 points',
+        '#define FFT_HALF_SWAP_COUNT %d' % len(half),
+        table('uint32_t', 'fft_half_swaps', half, hexfmt),
+        '',
+        '// Seeds for the integer square root, by top byte - 64',
+        table('uint16_t', 'fft_sqrt_seed', sqrt_seed, str),
+        '',
+        '// Fractional log2 by the 8 bits after the leading one, 1.15',
+        table('uint16_t', 'fft_log2_frac', log2_frac, str),
+        '',
+        '// Hann window, 16.15 (declared in fix_fft.h)',
+        table('fix15', 'fft_hann', hann, str, storage=''),
+        '',
+    ]
+    with open(sys.argv[2], 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
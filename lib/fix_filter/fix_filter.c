@@ -0,0 +1,185 @@
+/**
+ * Fixed-point FIR and IIR filters (see fix_filter.h)
+ *
+ */
+#include <string.h>
+#include "hotpath.h"
+#include "fix_filter.h"
+
+//////////////////////////////// FIR /////////////////////////////////////
+
+void fix_fir_init(fix_fir * f, const fix_fir_design * design, int16_t * delay) {
+    f->coeffs = design->coeffs ;
+    f->taps = design->taps ;
+    f->shift = design->shift ;
+    f->factor = design->factor ;
+    f->delay = delay ;
+    fix_fir_reset(f) ;
+}
+
+void fix_fir_reset(fix_fir * f) {
+    memset(f->delay, 0, 2 * f->taps * sizeof(int16_t)) ;
+    f->pos = 0 ;
+    f->phase = 0 ;
+}
+
+// A new sample at pos - 1, in both copies of the delay line, which
+// leaves the newest taps samples in a row from there
+static HOT_INLINE int fir_push(int16_t * delay, int taps, int pos, int16_t x) {
+    pos = pos ? pos - 1 : taps - 1 ;
+    delay[pos] = x ;
+    delay[pos + taps] = x ;
+    return pos ;
+}
+
+// sum h[k] x[k], four taps at a time
+static HOT_INLINE int32_t fir_dot(const int16_t * h, const int16_t * x, int taps) {
+    int32_t acc = 0 ;
+    while (taps >= 4) {
+        acc += h[0] * x[0] + h[1] * x[1] + h[2] * x[2] + h[3] * x[3] ;
+        h += 4 ;
+        x += 4 ;
+        taps -= 4 ;
+    }
+    while (taps--) acc += *h++ * *x++ ;
+    return acc ;
+}
+
+// Rounded, and saturated to 16 bits
+static HOT_INLINE int16_t fir_out(int32_t acc, int shift) {
+    int32_t y = (acc + (1 << (shift - 1))) >> shift ;
+    if (y > 32767) return 32767 ;
+    if (y < -32768) return -32768 ;
+    return (int16_t)y ;
+}
+
+void HOT_KERNEL(fix_fir_block)(fix_fir * f, const int16_t * in, int16_t * out, int n) {
+    const int16_t * h = f->coeffs ;
+    int16_t * delay = f->delay ;
+    int taps = f->taps, shift = f->shift, pos = f->pos ;
+    for (int i=0; i<n; i++) {
+        pos = fir_push(delay, taps, pos, in[i]) ;
+        out[i] = fir_out(fir_dot(h, &delay[pos], taps), shift) ;
+    }
+    f->pos = pos ;
+}
+
+int16_t HOT_KERNEL(fix_fir_sample)(fix_fir * f, int16_t x) {
+    f->pos = fir_push(f->delay, f->taps, f->pos, x) ;
+    return fir_out(fir_dot(f->coeffs, &f->delay[f->pos], f->taps), f->shift) ;
+}
+
+int HOT_KERNEL(fix_decim_block)(fix_fir * f, const int16_t * in, int16_t * out, int n) {
+    const int16_t * h = f->coeffs ;
+    int16_t * delay = f->delay ;
+    int taps = f->taps, shift = f->shift, pos = f->pos ;
+    int phase = f->phase, factor = f->factor ;
+    int done = 0 ;
+    for (int i=0; i<n; i++) {
+        pos = fir_push(delay, taps, pos, in[i]) ;
+        if (++phase < factor) continue ;
+        phase = 0 ;
+        out[done++] = fir_out(fir_dot(h, &delay[pos], taps), shift) ;
+    }
+    f->pos = pos ;
+    f->phase = phase ;
+    return done ;
+}
+
+void HOT_KERNEL(fix_interp_block)(fix_fir * f, const int16_t * in, int16_t * out, int n) {
+    int16_t * delay = f->delay ;
+    int taps = f->taps, shift = f->shift, pos = f->pos, factor = f->factor ;
+    for (int i=0; i<n; i++) {
+        pos = fir_push(delay, taps, pos, in[i]) ;
+        // Phase p's taps follow phase p - 1's
+        const int16_t * h = f->coeffs ;
+        for (int p=0; p<factor; p++) {
+            *out++ = fir_out(fir_dot(h, &delay[pos], taps), shift) ;
+            h += taps ;
+        }
+    }
+    f->pos = pos ;
+}
+
+//////////////////////////////// IIR /////////////////////////////////////
+
+void fix_iir_init(fix_iir * f, const fix_iir_design * design, fix15 * state) {
+    f->sections = design->sections ;
+    f->count = design->count ;
+    f->state = state ;
+    fix_iir_reset(f) ;
+}
+
+void fix_iir_reset(fix_iir * f) {
+    memset(f->state, 0, FIX_IIR_STATE(f->count) * sizeof(fix15)) ;
+}
+
+// One section over a block, two samples a turn so the state is renamed
+// rather than moved. z is its x[-1], x[-2], y[-1], y[-2], which are left
+// as they are at the end.
+static HOT_INLINE void biquad_block(const fix_biquad * c, const fix15 * in, fix15 * out, int n, fix15 * z) {
+    const fix28 b0 = c->b0, b1 = c->b1, b2 = c->b2, a1 = c->a1, a2 = c->a2 ;
+    fix15 x1 = z[0], x2 = z[1], y1 = z[2], y2 = z[3] ;
+    int i = 0 ;
+    for (; i + 1 < n; i += 2) {
+        fix15 x0 = in[i] ;
+        fix15 y0 = multfix28(b0, x0) + multfix28(b1, x1) + multfix28(b2, x2)
+                 - multfix28(a1, y1) - multfix28(a2, y2) ;
+        out[i] = y0 ;
+        fix15 u = in[i + 1] ;
+        fix15 v = multfix28(b0, u) + multfix28(b1, x0) + multfix28(b2, x1)
+                - multfix28(a1, y0) - multfix28(a2, y1) ;
+        out[i + 1] = v ;
+        x2 = x0 ; x1 = u ;
+        y2 = y0 ; y1 = v ;
+    }
+    if (i < n) {
+        fix15 x0 = in[i] ;
+        fix15 y0 = multfix28(b0, x0) + multfix28(b1, x1) + multfix28(b2, x2)
+                 - multfix28(a1, y1) - multfix28(a2, y2) ;
+        out[i] = y0 ;
+        x2 = x1 ; x1 = x0 ;
+        y2 = y1 ; y1 = y0 ;
+    }
+    z[0] = x1 ; z[1] = x2 ; z[2] = y1 ; z[3] = y2 ;
+}
+
+void HOT_KERNEL(fix_iir_block)(fix_iir * f, const fix15 * in, fix15 * out, int n) {
+    if (n <= 0) return ;
+    fix15 * state = f->state ;
+    const fix15 * src = in ;
+    // The state is shared (section s's outputs are s + 1's inputs), but
+    // a section runs over the whole block before the next, so each one
+    // starts from a copy of the history it was given
+    fix15 z[4] = { state[0], state[1] } ;
+    for (int s=0; s<f->count; s++) {
+        z[2] = state[2 * s + 2] ;
+        z[3] = state[2 * s + 3] ;
+        fix15 next_x1 = z[2], next_x2 = z[3] ;
+        biquad_block(&f->sections[s], src, out, n, z) ;
+        state[2 * s] = z[0] ;
+        state[2 * s + 1] = z[1] ;
+        state[2 * s + 2] = z[2] ;
+        state[2 * s + 3] = z[3] ;
+        z[0] = next_x1 ;
+        z[1] = next_x2 ;
+        src = out ;
+    }
+    if (f->count == 0 && out != in) memcpy(out, in, n * sizeof(fix15)) ;
+}
+
+fix15 HOT_KERNEL(fix_iir_sample)(fix_iir * f, fix15 x) {
+    fix15 * z = f->state ;
+    for (int s=0; s<f->count; s++, z += 2) {
+        const fix_biquad * c = &f->sections[s] ;
+        fix15 y = multfix28(c->b0, x) + multfix28(c->b1, z[0]) + multfix28(c->b2, z[1])
+                - multfix28(c->a1, z[2]) - multfix28(c->a2, z[3]) ;
+        z[1] = z[0] ;
+        z[0] = x ;
+        x = y ;
+    }
+    // The last section's outputs
+    z[1] = z[0] ;
+    z[0] = x ;
+    return x ;
+}
@@ -0,0 +1,116 @@
+/**
+ * Fixed-point FIR and IIR filters for the RP2040
+ *
+ * One set of filter kernels for the demos' pipelines (the AM voice
+ * path's interpolator, decimating before an FFT, smoothing touchscreen
+ * or IMU readings), each run over a block of samples at a time, in SRAM.
+ *
+ * FIR FILTERS (fix_fir)
+ *  - Samples are int16_t: 1.15 audio, or centered ADC counts. The
+ *    coefficients are int16_t too, with fraction bits of their own (the
+ *    design's shift), and each output is the sum of the products in 32
+ *    bits, rounded, shifted down and saturated to 16 bits. A design's
+ *    shift leaves room for its worst case, so the sum can't overflow.
+ *  - The delay line is kept twice over, one copy after the other: each
+ *    sample is written to both, so the newest taps samples are always
+ *    in a row, and a product never has to wrap around the end of a
+ *    circular buffer. The inner loop is four taps at a time.
+ *  - fix_fir_block() filters n samples into n
+ *  - fix_decim_block() keeps every factor'th output, and only works
+ *    those ones out (a decimator by factor, before an FFT, say)
+ *  - fix_interp_block() makes factor outputs of each input, each one a
+ *    phase of the prototype filter (its taps factor * k + p), so the
+ *    zeros between the inputs are never multiplied
+ *
+ * IIR FILTERS (fix_iir)
+ *  - A cascade of biquads (Direct Form I), on fix15 samples, with fix28
+ *    coefficients (the 15-bit coefficients of a fix15 biquad are too
+ *    coarse for a low corner). Each product is one multfix28().
+ *  - Give it samples with fraction bits (int2fix15() of an ADC count,
+ *    say) and they're kept: the fix15 has room for the gain inside the
+ *    filter
+ *  - A section's outputs are the next one's inputs, so the state is two
+ *    samples for each section and two for the input (FIX_IIR_STATE).
+ *  - fix_iir_block() runs the whole block through one section, then the
+ *    next, so each section's coefficients stay in registers; in and out
+ *    may be the same buffer
+ *
+ * DESIGNS
+ *  Coefficients are designed at configure time by gen_filters.py, into
+ *  a header for the app (from its CMakeLists.txt, see
+ *  lib/fix_filter/CMakeLists.txt):
+ *
+ *    fix_filter_design(my_app lowpass fir_lowpass fs=10000 cutoff=1000 taps=31)
+ *
+ *    #include "lowpass.h"                  // LOWPASS_DELAY, and lowpass
+ *    static int16_t delay[LOWPASS_DELAY] ;
+ *    static fix_fir filter ;
+ *    fix_fir_init(&filter, &lowpass, delay) ;
+ *    fix_fir_block(&filter, in, out, 64) ;
+ *
+ *  The coefficients go in RAM (they aren't const), as the kernels do, so
+ *  neither waits on flash.
+ *
+ */
+#ifndef FIX_FILTER_H
+#define FIX_FILTER_H
+
+#include <stdint.h>
+#include "fixed_point.h"
+
+// An FIR design: a plain FIR, decimator or interpolator
+typedef struct {
+    const int16_t * coeffs ;    // h[0] (for the newest sample) first; an interpolator's a phase at a time
+    short taps ;                // taps per output (per phase, for an interpolator)
+    short shift ;               // fraction bits of the coefficients
+    short factor ;              // decimation or interpolation factor (1 for a plain FIR)
+} fix_fir_design ;
+
+typedef struct {
+    const int16_t * coeffs ;
+    int taps ;
+    int shift ;
+    int factor ;
+    int16_t * delay ;           // 2 * taps samples, the delay line twice over
+    int pos ;                   // where the newest sample is
+    int phase ;                 // decimator: samples in since the last output
+} fix_fir ;
+
+// One biquad: y = b0 x + b1 x[-1] + b2 x[-2] - a1 y[-1] - a2 y[-2], 4.28
+typedef struct {
+    fix28 b0, b1, b2, a1, a2 ;
+} fix_biquad ;
+
+typedef struct {
+    const fix_biquad * sections ;
+    short count ;
+} fix_iir_design ;
+
+typedef struct {
+    const fix_biquad * sections ;
+    int count ;
+    fix15 * state ;             // FIX_IIR_STATE(count)
+} fix_iir ;
+
+// fix15's of state for a cascade of n sections
+#define FIX_IIR_STATE(n) (2 * ((n) + 1))
+
+// delay has 2 * design->taps samples
+void fix_fir_init(fix_fir * f, const fix_fir_design * design, int16_t * delay) ;
+void fix_fir_reset(fix_fir * f) ;
+// n samples in, n out
+void fix_fir_block(fix_fir * f, const int16_t * in, int16_t * out, int n) ;
+int16_t fix_fir_sample(fix_fir * f, int16_t x) ;
+// n samples in, one out for each factor of them; returns how many
+int fix_decim_block(fix_fir * f, const int16_t * in, int16_t * out, int n) ;
+// n samples in, n * factor out
+void fix_interp_block(fix_fir * f, const int16_t * in, int16_t * out, int n) ;
+
+// state has FIX_IIR_STATE(design->count) fix15's
+void fix_iir_init(fix_iir * f, const fix_iir_design * design, fix15 * state) ;
+void fix_iir_reset(fix_iir * f) ;
+// n samples in, n out (out may be in)
+void fix_iir_block(fix_iir * f, const fix15 * in, fix15 * out, int n) ;
+fix15 fix_iir_sample(fix_iir * f, fix15 x) ;
+
+#endif
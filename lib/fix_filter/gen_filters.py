@@ -0,0 +1,266 @@
+#!/usr/bin/env python3
+"""
+Designs a filter for fix_filter and writes its coefficients into a
+header, as a fix_fir_design or fix_iir_design called NAME. Run by CMake
+at configure time, from fix_filter_design().
+
+    gen_filters.py OUTPUT NAME KIND key=value ...
+
+FIR kinds (windowed sinc; window=hamming, hann, blackman or kaiser, with
+beta=, hamming by default):
+    fir_lowpass   fs= cutoff= taps=
+    fir_highpass  fs= cutoff= taps=         (taps odd)
+    fir_bandpass  fs= low= high= taps=
+    fir_bandstop  fs= low= high= taps=      (taps odd)
+    decimator     fs= factor= taps= [cutoff=, 0.45 fs / factor by default]
+    interpolator  fs= factor= taps= [cutoff=, 0.45 fs by default]
+        fs is the input's rate, and taps the prototype's (a multiple of
+        factor). Each phase is scaled to a gain of 1 at DC.
+
+IIR kinds (biquads by the bilinear transform, as in the Audio EQ
+Cookbook):
+    iir_lowpass   fs= cutoff= order=        (Butterworth, order even)
+    iir_highpass  fs= cutoff= order=
+    iir_bandpass  fs= center= q= [sections=1]   (0 dB at the center)
+    iir_notch     fs= center= q= [sections=1]
+"""
+
+import math
+import re
+import sys
+
+
+def fail(msg):
+    sys.stderr.write('gen_filters.py: %s\n' % msg)
+    sys.exit(1)
+
+
+def bessel_i0(x):
+    total, term, k = 1.0, 1.0, 1
+    while term > 1e-12 * total:
+        term *= (x / (2.0 * k)) ** 2
+        total += term
+        k += 1
+    return total
+
+
+def window(kind, n, beta):
+    if n == 1:
+        return [1.0]
+    w = []
+    for i in range(n):
+        a = 2.0 * math.pi * i / (n - 1)
+        if kind == 'hamming':
+            w.append(0.54 - 0.46 * math.cos(a))
+        elif kind == 'hann':
+            w.append(0.5 - 0.5 * math.cos(a))
+        elif kind == 'blackman':
+            w.append(0.42 - 0.5 * math.cos(a) + 0.08 * math.cos(2.0 * a))
+        elif kind == 'kaiser':
+            r = 2.0 * i / (n - 1) - 1.0
+            w.append(bessel_i0(beta * math.sqrt(1.0 - r * r)) / bessel_i0(beta))
+        else:
+            fail('unknown window %s' % kind)
+    return w
+
+
+def sinc_lowpass(n, fc):
+    # fc as a fraction of the sample rate
+    center = (n - 1) / 2.0
+    h = []
+    for i in range(n):
+        t = i - center
+        h.append(2.0 * fc if t == 0 else math.sin(2.0 * math.pi * fc * t) / (math.pi * t))
+    return h
+
+
+def spectral_invert(h):
+    out = [-v for v in h]
+    out[len(h) // 2] += 1.0
+    return out
+
+
+def normalized(h):
+    total = sum(h)
+    return [v / total for v in h]
+
+
+def design_fir(kind, p):
+    fs = p.number('fs')
+    taps = p.integer('taps')
+    w = window(p.get('window', 'hamming'), taps, p.number('beta', 6.0))
+    lowpass = lambda fc: [a * b for a, b in zip(sinc_lowpass(taps, fc / fs), w)]
+    factor = 1
+    dc = None                           # the DC gain to keep exactly
+    if kind in ('fir_lowpass', 'decimator'):
+        if kind == 'decimator':
+            factor = p.integer('factor')
+            h = normalized(lowpass(p.number('cutoff', 0.45 * fs / factor)))
+        else:
+            h = normalized(lowpass(p.number('cutoff')))
+        dc = 1.0
+    elif kind in ('fir_highpass', 'fir_bandstop'):
+        if taps % 2 == 0:
+            fail('%s needs an odd number of taps' % kind)
+        if kind == 'fir_highpass':
+            h = spectral_invert(normalized(lowpass(p.number('cutoff'))))
+            dc = 0.0
+        else:
+            # A lowpass at low plus a highpass at high
+            lo = normalized(lowpass(p.number('low')))
+            hi = spectral_invert(normalized(lowpass(p.number('high'))))
+            h = [a + b for a, b in zip(lo, hi)]
+            dc = 1.0
+    elif kind == 'fir_bandpass':
+        lo = normalized(lowpass(p.number('low')))
+        hi = normalized(lowpass(p.number('high')))
+        h = [b - a for a, b in zip(lo, hi)]
+        dc = 0.0
+    elif kind == 'interpolator':
+        factor = p.integer('factor')
+        if taps % factor:
+            fail('an interpolator needs a multiple of factor taps')
+        h = lowpass(p.number('cutoff', 0.45 * fs) / factor)
+    else:
+        fail('unknown kind %s' % kind)
+
+    # The phases, each one the taps an output is made of
+    if kind == 'interpolator':
+        phases = [normalized([h[factor * k + q] for k in range(taps // factor)]) for q in range(factor)]
+        dc = 1.0
+    else:
+        phases = [h]
+
+    # Fraction bits: as many as leave each tap in 16 bits, and the sum of
+    # any output's products in 32 (full-scale samples, every sign against)
+    worst = max(sum(abs(v) for v in ph) for ph in phases)
+    biggest = max(abs(v) for ph in phases for v in ph)
+    shift = 15
+    while shift > 1 and (biggest * 2 ** shift > 32767 or worst * 2 ** shift * 32768 >= 2 ** 31 - 2 ** shift):
+        shift -= 1
+    coeffs = []
+    for ph in phases:
+        q = [int(round(v * 2 ** shift)) for v in ph]
+        if dc is not None:
+            # Rounding, taken off the biggest tap, so the DC gain is exact
+            big = max(range(len(q)), key=lambda i: abs(q[i]))
+            q[big] += int(round(dc * 2 ** shift)) - sum(q)
+        coeffs.extend(q)
+    return coeffs, taps // factor if kind == 'interpolator' else taps, shift, factor
+
+
+def biquad(kind, fs, f0, q):
+    w0 = 2.0 * math.pi * f0 / fs
+    c, alpha = math.cos(w0), math.sin(w0) / (2.0 * q)
+    if kind == 'lowpass':
+        b = [(1.0 - c) / 2.0, 1.0 - c, (1.0 - c) / 2.0]
+    elif kind == 'highpass':
+        b = [(1.0 + c) / 2.0, -(1.0 + c), (1.0 + c) / 2.0]
+    elif kind == 'bandpass':
+        b = [alpha, 0.0, -alpha]
+    else:
+        b = [1.0, -2.0 * c, 1.0]
+    a0 = 1.0 + alpha
+    return [v / a0 for v in b] + [-2.0 * c / a0, (1.0 - alpha) / a0]
+
+
+def design_iir(kind, p):
+    fs = p.number('fs')
+    if kind in ('iir_lowpass', 'iir_highpass'):
+        order = p.integer('order')
+        if order < 2 or order % 2:
+            fail('a Butterworth needs an even order')
+        f0 = p.number('cutoff')
+        # Each pair of poles is a section, lowest Q first, so the gain
+        # builds up along the cascade rather than peaking early
+        qs = sorted(1.0 / (2.0 * math.cos(math.pi * (2 * k + 1) / (2 * order)))
+                    for k in range(order // 2))
+        return [biquad(kind[4:], fs, f0, q) for q in qs]
+    if kind in ('iir_bandpass', 'iir_notch'):
+        s = biquad(kind[4:], fs, p.number('center'), p.number('q'))
+        return [s] * p.integer('sections', 1)
+    fail('unknown kind %s' % kind)
+
+
+class Params:
+    def __init__(self, args):
+        self.values = {}
+        for a in args:
+            if '=' not in a:
+                fail('%s is not key=value' % a)
+            k, v = a.split('=', 1)
+            self.values[k] = v
+        self.used = set()
+
+    def get(self, key, default=None):
+        self.used.add(key)
+        if key in self.values:
+            return self.values[key]
+        if default is None:
+            fail('needs %s=' % key)
+        return default
+
+    def number(self, key, default=None):
+        return float(self.get(key, None if default is None else str(default)))
+
+    def integer(self, key, default=None):
+        return int(self.get(key, None if default is None else str(default)))
+
+
+def table(ctype, name, rows, fmt, per_line=8):
+    lines = ['static %s %s[%d] = {' % (ctype, name, len(rows))]
+    for i in range(0, len(rows), per_line):
+        lines.append('    ' + ', '.join(fmt(v) for v in rows[i:i + per_line]) + ',')
+    lines.append('} ;')
+    return lines
+
+
+def main():
+    if len(sys.argv) < 4:
+        fail('usage: gen_filters.py OUTPUT NAME KIND key=value ...')
+    output, name, kind = sys.argv[1:4]
+    if not re.match(r'^[A-Za-z_][A-Za-z0-9_]*$', name):
+        fail('%s is not a C name' % name)
+    p = Params(sys.argv[4:])
+    macro = name.upper()
+    out = [
+        '// Generated by gen_filters.py %s - do not edit' % ' '.join(sys.argv[2:]),
+        '',
+        '#include "fix_filter.h"',
+        '',
+    ]
+    if kind.startswith('iir_'):
+        sections = design_iir(kind, p)
+        for s in sections:
+            if max(abs(v) for v in s) >= 8.0:
+                fail('a coefficient is out of fix28 range')
+        out += [
+            '#define %s_SECTIONS %d' % (macro, len(sections)),
+            '#define %s_STATE FIX_IIR_STATE(%d)' % (macro, len(sections)),
+            '',
+            '// b0, b1, b2, a1, a2, 4.28',
+        ]
+        out += table('fix_biquad', '%s_sections' % name, sections,
+                     lambda s: '{ ' + ', '.join(str(int(round(v * 2 ** 28))) for v in s) + ' }', 1)
+        out += ['static const fix_iir_design %s = { %s_sections, %d } ;' % (name, name, len(sections))]
+    else:
+        coeffs, taps, shift, factor = design_fir(kind, p)
+        out += [
+            '#define %s_TAPS %d' % (macro, taps),
+            '#define %s_FACTOR %d' % (macro, factor),
+            '#define %s_DELAY %d' % (macro, 2 * taps),
+            '',
+            '// Taps, %d fraction bits%s' % (shift, ', a phase at a time' if kind == 'interpolator' else ''),
+        ]
+        out += table('int16_t', '%s_coeffs' % name, coeffs, str)
+        out += ['static const fix_fir_design %s = { %s_coeffs, %d, %d, %d } ;' % (name, name, taps, shift, factor)]
+    unused = set(p.values) - p.used
+    if unused:
+        fail('%s: unknown %s' % (kind, ', '.join(sorted(unused))))
+    out.append('')
+    with open(output, 'w') as f:
+        f.write('\n'.join(out))
+
+
+if __name__ == '__main__':
+    main()
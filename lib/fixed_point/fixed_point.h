@@ -0,0 +1,173 @@
+/**
+ * Fixed-point math for the RP2040
+ *
+ * The formats the demos use, and their arithmetic, in one place. Every
+ * format is a signed 32-bit int with the binary point at a fixed place:
+ *
+ *  - fix15: 16.15 (17 integer bits with the sign, 15 fraction bits), the
+ *    audio, FFT, boids and fern demos' format. 1.0 is 32768.
+ *  - fix16: 16.16, the IMU's (its accelerometer and gyro scales)
+ *  - fix28: 4.28, the Mandelbrot set's, for its deep zooms. It holds
+ *    -8 to 8.
+ *
+ * For each format N there are float2fixN(), fix2floatN(), int2fixN(),
+ * fix2intN(), multfixN(), sqrfixN() and divfixN(). divfix() is
+ * divfix15(), as in the apps.
+ *
+ * MULTIPLY
+ *  - The M0+ multiplies 32 x 32 bits to the low 32 bits in one cycle, but
+ *    has no 64-bit result, so ((long long)a * b) >> N is a call to
+ *    __aeabi_lmul (and sign extensions) in flash. fix_mul_shift() builds
+ *    the same result out of 16 x 16 bit products in registers: four
+ *    multiplies, and for N <= 16 only the bits that survive the shift.
+ *    sqrfixN() needs three. Both are exact: the same bits
+ *    ((long long)a * b) >> N gives, overflow included.
+ *
+ * DIVIDE
+ *  - divfixN(a, b) is ((long long)a << N) / b, exactly, rounded toward
+ *    zero. It uses the SIO divider (pico/divider.h, which saves and
+ *    restores it, so it's safe in an interrupt) 32 bits at a time: one
+ *    divide when a << N fits in 32 bits, two (the remainder again) when
+ *    the remainder does, and the SDK's 64-bit divide otherwise.
+ *  - b must not be 0
+ *
+ * TABLE LOOKUP AND PHASE ACCUMULATORS
+ *  - An interpolator adds a phase increment to an accumulator, and turns
+ *    its top bits into the address of a table entry, in one register read
+ *    (fix_phase_next()), the inner loop of a DDS oscillator:
+ *
+ *      fix_phase_init(interp0, sine_table, 8, 2) ;     // 256 x 4 bytes
+ *      fix_phase_set(interp0, phase, increment) ;
+ *      for (...) sample = *(const int *)fix_phase_next(interp0) ;
+ *      phase = fix_phase_get(interp0) ;
+ *
+ *  - Each core has its own two interpolators. One used in an interrupt
+ *    has to be saved and restored there (interp_save(), interp_restore())
+ *    if anything else on that core uses it.
+ *
+ */
+#ifndef FIXED_POINT_H
+#define FIXED_POINT_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "pico/divider.h"
+#include "hardware/interp.h"
+#include "hotpath.h"
+
+typedef signed int fix15 ;
+typedef signed int fix16 ;
+typedef signed int fix28 ;
+
+// (int32_t)(((int64_t)a * b) >> n), for a constant 0 < n < 32
+static HOT_INLINE int32_t fix_mul_shift(int32_t a, int32_t b, const int n) {
+    int32_t ah = a >> 16, bh = b >> 16 ;
+    uint32_t al = a & 0xFFFF, bl = b & 0xFFFF ;
+    uint32_t lo = al * bl ;
+    if (n <= 16) {
+        // The top product only matters below bit 32, the low one above n
+        uint32_t cross = (uint32_t)ah * bl + al * (uint32_t)bh ;
+        return (int32_t)(((uint32_t)(ah * bh) << (32 - n)) + (cross << (16 - n)) + (lo >> n)) ;
+    }
+    // The whole 64-bit product, high and low words (Hacker's Delight 8-2)
+    int32_t t = ah * (int32_t)bl + (int32_t)(lo >> 16) ;
+    int32_t w = (int32_t)al * bh + (t & 0xFFFF) ;
+    int32_t hi = ah * bh + (t >> 16) + (w >> 16) ;
+    uint32_t low = ((uint32_t)w << 16) | (lo & 0xFFFF) ;
+    return (int32_t)(((uint32_t)hi << (32 - n)) | (low >> n)) ;
+}
+
+// fix_mul_shift(a, a, n), with the two cross products as one
+static HOT_INLINE int32_t fix_sqr_shift(int32_t a, const int n) {
+    int32_t ah = a >> 16 ;
+    uint32_t al = a & 0xFFFF ;
+    uint32_t lo = al * al ;
+    int32_t m = ah * (int32_t)al ;
+    if (n <= 16) {
+        return (int32_t)(((uint32_t)(ah * ah) << (32 - n)) + ((uint32_t)m << (17 - n)) + (lo >> n)) ;
+    }
+    int32_t t = m + (int32_t)(lo >> 16) ;
+    int32_t w = m + (t & 0xFFFF) ;
+    int32_t hi = ah * ah + (t >> 16) + (w >> 16) ;
+    uint32_t low = ((uint32_t)w << 16) | (lo & 0xFFFF) ;
+    return (int32_t)(((uint32_t)hi << (32 - n)) | (low >> n)) ;
+}
+
+// (int32_t)(((int64_t)a << n) / b), for a constant 0 < n < 32
+static HOT_INLINE int32_t fix_div_shift(int32_t a, int32_t b, const int n) {
+    // a << n fits: one divide
+    if ((a >> (31 - n)) == (a >> 31)) return div_s32s32((int32_t)((uint32_t)a << n), b) ;
+    // The quotient's top bits, then the remainder's
+    int32_t r ;
+    int32_t q = divmod_s32s32_rem(a, b, &r) ;
+    if ((r >> (31 - n)) == (r >> 31)) {
+        return (int32_t)(((uint32_t)q << n) + (uint32_t)div_s32s32((int32_t)((uint32_t)r << n), b)) ;
+    }
+    return (int32_t)div_s64s64((int64_t)a << n, b) ;
+}
+
+// 16.15
+#define multfix15(a,b) fix_mul_shift((a), (b), 15)
+#define sqrfix15(a) fix_sqr_shift((a), 15)
+#define divfix15(a,b) fix_div_shift((a), (b), 15)
+#define divfix(a,b) divfix15(a,b)
+#define float2fix15(a) ((fix15)((a)*32768.0f))
+#define fix2float15(a) ((float)(a)/32768.0f)
+#define absfix15(a) abs(a)
+#define int2fix15(a) ((fix15)((a) << 15))
+#define fix2int15(a) ((int)((a) >> 15))
+#define char2fix15(a) (fix15)(((fix15)(a)) << 15)
+
+// 16.16
+#define multfix16(a,b) fix_mul_shift((a), (b), 16)
+#define sqrfix16(a) fix_sqr_shift((a), 16)
+#define divfix16(a,b) fix_div_shift((a), (b), 16)
+#define float2fix16(a) ((fix16)((a)*65536.0f))
+#define fix2float16(a) ((float)(a)/65536.0f)
+#define absfix16(a) abs(a)
+#define int2fix16(a) ((fix16)((a) << 16))
+#define fix2int16(a) ((int)((a) >> 16))
+
+// 4.28
+#define multfix28(a,b) fix_mul_shift((a), (b), 28)
+#define sqrfix28(a) fix_sqr_shift((a), 28)
+#define divfix28(a,b) fix_div_shift((a), (b), 28)
+#define float2fix28(a) ((fix28)((a)*268435456.0f))
+#define fix2float28(a) ((float)(a)/268435456.0f)
+#define int2fix28(a) ((fix28)((a) << 28))
+#define fix2int28(a) ((int)((a) >> 28))
+#define ONEfix28 int2fix28(1)
+#define FOURfix28 int2fix28(4)
+#define SIXTEENTHfix28 (ONEfix28 >> 4)
+
+// Set up interp for phase accumulation into a table of 2^bits entries of
+// 2^entry_log2 bytes each: lane 0 adds the increment (BASE0) to the phase
+// (ACCUM0) on each pop, and lane 1 makes the top bits of the phase
+// (before the add) into an address in the table
+static inline void fix_phase_init(interp_hw_t * interp, const void * table, int bits, int entry_log2) {
+    interp_config c = interp_default_config() ;
+    interp_config_set_add_raw(&c, true) ;
+    interp_set_config(interp, 0, &c) ;
+    c = interp_default_config() ;
+    interp_config_set_cross_input(&c, true) ;
+    interp_config_set_shift(&c, 32 - bits - entry_log2) ;
+    interp_config_set_mask(&c, entry_log2, entry_log2 + bits - 1) ;
+    interp_set_config(interp, 1, &c) ;
+    interp->base[1] = (uintptr_t)table ;
+}
+
+static HOT_INLINE void fix_phase_set(interp_hw_t * interp, uint32_t phase, uint32_t increment) {
+    interp->accum[0] = phase ;
+    interp->base[0] = increment ;
+}
+
+// The entry for the phase, and the step to the next
+static HOT_INLINE const void * fix_phase_next(interp_hw_t * interp) {
+    return (const void *)(uintptr_t)interp->pop[1] ;
+}
+
+static HOT_INLINE uint32_t fix_phase_get(interp_hw_t * interp) {
+    return interp->accum[0] ;
+}
+
+#endif
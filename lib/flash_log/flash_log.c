@@ -0,0 +1,292 @@
+/**
+ * Data logger, kept in flash (see flash_log.h)
+ *
+ */
+#include "pico/stdlib.h"
+#include "pico/multicore.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "hardware/watchdog.h"
+#include "hotpath.h"
+#include "flash_log.h"
+
+#if (FLASH_LOG_OFFSET % FLASH_SECTOR_SIZE) || (FLASH_LOG_SIZE % FLASH_SECTOR_SIZE)
+#error "FLASH_LOG_OFFSET and FLASH_LOG_SIZE must be whole sectors"
+#endif
+#if FLASH_LOG_SIZE < (2 * FLASH_SECTOR_SIZE)
+#error "FLASH_LOG_SIZE must be two sectors or more"
+#endif
+#if (FLASH_LOG_BUFFER & (FLASH_LOG_BUFFER - 1))
+#error "FLASH_LOG_BUFFER must be a power of 2"
+#endif
+
+#define SECTORS      (FLASH_LOG_SIZE / FLASH_SECTOR_SIZE)
+#define LOG_MAGIC    0x474F4C46u            // "FLOG"
+#define HEADER_BYTES 8                      // magic, sequence
+#define RECORD_HEAD  6                      // length, type, time
+#define RECORD_BYTES(len) (RECORD_HEAD + (len) + 1)
+#define RING_MASK    (FLASH_LOG_BUFFER - 1)
+
+typedef struct {
+    uint32_t magic ;
+    uint32_t sequence ;
+} sector_header ;
+
+static inline const uint8_t * sectorAddress(int sector) {
+    return (const uint8_t *)(XIP_BASE + FLASH_LOG_OFFSET + (sector * FLASH_SECTOR_SIZE)) ;
+}
+
+// Records waiting, as they were written (length, type, time, payload;
+// the CRC is worked out on the way to flash). Writers add at head,
+// under the spinlock, and flash_log_service() takes from tail.
+static uint8_t ring[FLASH_LOG_BUFFER] ;
+static volatile uint32_t ring_head = 0, ring_tail = 0 ;     // free-running
+static spin_lock_t * ring_lock ;
+static volatile unsigned int dropped = 0 ;
+
+// The sector being written, and where in it
+static int cur_sector ;
+static uint32_t cur_sequence ;
+static int cur_pos ;
+static char cur_open ;                      // 0 until it has been erased
+
+// Its page being filled: the bytes of the sector from page_start
+static uint8_t page[FLASH_PAGE_SIZE] __attribute__((aligned(4))) ;
+static int page_start ;
+static char page_dirty ;                    // holds bytes not yet programmed
+static uint32_t page_since ;                // when the first of them went in
+static volatile char flush_wanted = 0 ;
+
+static uint8_t crc8(uint8_t crc, uint8_t b) {
+    crc ^= b ;
+    for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1) ;
+    return crc ;
+}
+
+//////////////////////////////// Writing /////////////////////////////////
+
+// Copy into the ring at 'at', wrapping. (A loop rather than memcpy, which
+// may not be in SRAM.)
+static HOT_INLINE void ringPut(uint32_t at, const uint8_t * src, int n) {
+    for (int i = 0; i < n; i++) ring[(at + i) & RING_MASK] = src[i] ;
+}
+
+int HOT_KERNEL(flash_log_write)(uint8_t type, const void * data, int len) {
+    if ((len < 0) || (len > FLASH_LOG_MAX_PAYLOAD)) return 0 ;
+    uint32_t now = time_us_32() ;
+    uint8_t head[RECORD_HEAD] = {
+        (uint8_t)len, type, (uint8_t)now, (uint8_t)(now >> 8), (uint8_t)(now >> 16), (uint8_t)(now >> 24)
+    } ;
+
+    uint32_t irq_status = spin_lock_blocking(ring_lock) ;
+    uint32_t at = ring_head ;
+    if ((FLASH_LOG_BUFFER - (at - ring_tail)) < (uint32_t)(RECORD_HEAD + len)) {
+        dropped++ ;
+        spin_unlock(ring_lock, irq_status) ;
+        return 0 ;
+    }
+    ringPut(at, head, RECORD_HEAD) ;
+    ringPut(at + RECORD_HEAD, (const uint8_t *)data, len) ;
+    // (spin_unlock's barrier puts the record before the new head)
+    ring_head = at + RECORD_HEAD + len ;
+    spin_unlock(ring_lock, irq_status) ;
+    return 1 ;
+}
+
+unsigned int flash_log_dropped() {
+    return dropped ;
+}
+
+void flash_log_flush() {
+    flush_wanted = 1 ;
+}
+
+//////////////////////////////// Flash ///////////////////////////////////
+
+// One page program (data) or sector erase (data NULL), with this core's
+// interrupts off and the other core paused if it can be (unless the
+// build says neither needs it)
+static void flashOp(uint32_t offset, const uint8_t * data) {
+#if FLASH_LOG_LOCKOUT
+    char lockout = multicore_lockout_victim_is_initialized(get_core_num() ^ 1) ;
+    if (lockout) multicore_lockout_start_blocking() ;
+#endif
+#if FLASH_LOG_IRQS_OFF
+    uint32_t irq_status = save_and_disable_interrupts() ;
+#endif
+    if (data) flash_range_program(offset, data, FLASH_PAGE_SIZE) ;
+    else flash_range_erase(offset, FLASH_SECTOR_SIZE) ;
+#if FLASH_LOG_IRQS_OFF
+    restore_interrupts(irq_status) ;
+#endif
+#if FLASH_LOG_LOCKOUT
+    if (lockout) multicore_lockout_end_blocking() ;
+#endif
+}
+
+static uint32_t sectorOffset(int sector) {
+    return FLASH_LOG_OFFSET + (sector * FLASH_SECTOR_SIZE) ;
+}
+
+static void programPage() {
+    flashOp(sectorOffset(cur_sector) + page_start, page) ;
+    page_dirty = 0 ;
+}
+
+static void clearPage(int start) {
+    for (int i = 0; i < FLASH_PAGE_SIZE; i++) page[i] = 0xFF ;
+    page_start = start ;
+}
+
+// Add a byte at cur_pos. Returns 1 if that filled the page, which is
+// programmed.
+static int putByte(uint8_t b) {
+    if (!page_dirty) page_since = time_us_32() ;
+    page[cur_pos - page_start] = b ;
+    page_dirty = 1 ;
+    cur_pos++ ;
+    if ((cur_pos - page_start) < FLASH_PAGE_SIZE) return 0 ;
+    programPage() ;
+    clearPage(cur_pos) ;
+    return 1 ;
+}
+
+// Erase the sector to be written, and start it with its header
+static void openSector() {
+    flashOp(sectorOffset(cur_sector), NULL) ;
+    cur_open = 1 ;
+    cur_pos = 0 ;
+    clearPage(0) ;
+    sector_header h = { LOG_MAGIC, cur_sequence } ;
+    const uint8_t * p = (const uint8_t *)&h ;
+    for (int i = 0; i < HEADER_BYTES; i++) putByte(p[i]) ;
+}
+
+// Program what's left of the sector being written, and move on
+static int closeSector() {
+    int ops = 0 ;
+    if (page_dirty) {
+        programPage() ;
+        ops++ ;
+    }
+    cur_sector = (cur_sector + 1) % SECTORS ;
+    cur_sequence++ ;
+    cur_open = 0 ;
+    cur_pos = 0 ;
+    return ops ;
+}
+
+int flash_log_service() {
+    int ops = 0 ;
+    uint32_t tail = ring_tail ;
+    uint32_t head = ring_head ;             // every record before it is whole
+    while (tail != head) {
+        int len = ring[tail & RING_MASK] ;
+        if (cur_open && ((cur_pos + RECORD_BYTES(len)) > FLASH_SECTOR_SIZE)) ops += closeSector() ;
+        if (!cur_open) {
+            openSector() ;
+            ops++ ;
+        }
+        uint8_t crc = 0 ;
+        for (int i = 0; i < RECORD_HEAD + len; i++) {
+            uint8_t b = ring[(tail + i) & RING_MASK] ;
+            crc = crc8(crc, b) ;
+            ops += putByte(b) ;
+        }
+        ops += putByte(crc) ;
+        tail += RECORD_HEAD + len ;
+        ring_tail = tail ;                  // room for the writers at once
+    }
+    if (page_dirty && (flush_wanted || ((time_us_32() - page_since) >= FLASH_LOG_FLUSH_US))) {
+        programPage() ;
+        ops++ ;
+    }
+    flush_wanted = 0 ;
+    return ops ;
+}
+
+void flash_log_erase_all() {
+    for (int s = 0; s < SECTORS; s++) flashOp(sectorOffset(s), NULL) ;
+    cur_sector = 0 ;
+    cur_sequence = 0 ;
+    cur_open = 0 ;
+    cur_pos = 0 ;
+    page_dirty = 0 ;
+}
+
+void flash_log_init() {
+    // The log mustn't be where the program is
+    extern char __flash_binary_end ;
+    if ((uintptr_t)&__flash_binary_end > (XIP_BASE + FLASH_LOG_OFFSET)) {
+        panic("flash_log: the program runs into the log at flash offset 0x%x", FLASH_LOG_OFFSET) ;
+    }
+    ring_lock = spin_lock_init(spin_lock_claim_unused(true)) ;
+
+    // Carry on after the newest sector (which is left as it is)
+    int newest = -1 ;
+    uint32_t sequence = 0 ;
+    for (int s = 0; s < SECTORS; s++) {
+        const sector_header * h = (const sector_header *)sectorAddress(s) ;
+        if (h->magic != LOG_MAGIC) continue ;
+        if ((newest < 0) || ((int32_t)(h->sequence - sequence) > 0)) {
+            newest = s ;
+            sequence = h->sequence ;
+        }
+    }
+    cur_sector = (newest < 0) ? 0 : (newest + 1) % SECTORS ;
+    cur_sequence = (newest < 0) ? 0 : sequence + 1 ;
+    cur_open = 0 ;
+    cur_pos = 0 ;
+
+    uint8_t watchdog = watchdog_caused_reboot() ? 1 : 0 ;
+    flash_log_write(FLASH_LOG_BOOT, &watchdog, 1) ;
+}
+
+//////////////////////////////// Reading /////////////////////////////////
+
+// Start at the oldest sector, and go round them all
+void flash_log_read_start(flash_log_reader * r) {
+    int oldest = cur_sector ;
+    int32_t age = 0 ;
+    for (int s = 0; s < SECTORS; s++) {
+        const sector_header * h = (const sector_header *)sectorAddress(s) ;
+        if (h->magic != LOG_MAGIC) continue ;
+        int32_t a = (int32_t)(cur_sequence - h->sequence) ;
+        if (a > age) {
+            oldest = s ;
+            age = a ;
+        }
+    }
+    r->sector = oldest ;
+    r->pos = HEADER_BYTES ;
+    r->left = SECTORS ;
+}
+
+int flash_log_read_next(flash_log_reader * r, flash_log_record * rec) {
+    while (r->left > 0) {
+        const uint8_t * base = sectorAddress(r->sector) ;
+        const sector_header * h = (const sector_header *)base ;
+        if ((h->magic == LOG_MAGIC) && ((r->pos + RECORD_BYTES(0)) <= FLASH_SECTOR_SIZE)) {
+            const uint8_t * p = base + r->pos ;
+            int len = p[0] ;
+            if ((len <= FLASH_LOG_MAX_PAYLOAD) && ((r->pos + RECORD_BYTES(len)) <= FLASH_SECTOR_SIZE)) {
+                uint8_t crc = 0 ;
+                for (int i = 0; i < RECORD_HEAD + len; i++) crc = crc8(crc, p[i]) ;
+                if (crc == p[RECORD_HEAD + len]) {
+                    rec->len = len ;
+                    rec->type = p[1] ;
+                    rec->time_us = p[2] | (p[3] << 8) | (p[4] << 16) | ((uint32_t)p[5] << 24) ;
+                    rec->data = p + RECORD_HEAD ;
+                    rec->sequence = h->sequence ;
+                    r->pos += RECORD_BYTES(len) ;
+                    return 1 ;
+                }
+            }
+        }
+        // The end of this sector's records (erased, or torn): the next one
+        r->sector = (r->sector + 1) % SECTORS ;
+        r->pos = HEADER_BYTES ;
+        r->left-- ;
+    }
+    return 0 ;
+}
@@ -0,0 +1,163 @@
+/**
+ * Data logger, kept in flash
+ *
+ * Records (a type, a time and up to 254 bytes) are queued in an SRAM
+ * ring by flash_log_write(), which any core or interrupt can call, and
+ * which never waits: it copies the record in and returns. One core runs
+ * flash_log_service() (from a protothread, say), which moves whole
+ * records from the ring into a page buffer and programs each 256-byte
+ * page of flash as it fills. Writers only ever touch SRAM (with
+ * interrupts off for the copy), so a real-time core can log thousands
+ * of bytes a second without waiting on flash.
+ *
+ * THE RING OF SECTORS
+ *  - The log is a region of 4 kB sectors (FLASH_LOG_OFFSET and
+ *    FLASH_LOG_SIZE, by default the 256 kB below the touchscreen
+ *    calibration in the last sector), written one sector after another
+ *    and round again. Each is erased once per pass, so they all wear
+ *    alike, and the oldest sector is the one erased to make room.
+ *  - Each sector starts with a magic word and a sequence number, one
+ *    more than the sector before, so flash_log_init() finds the newest
+ *    after a reset and carries on with the sector after it. (What was
+ *    left of the newest sector is left unused, so a boot costs an
+ *    erase.)
+ *  - Records don't cross sectors, so any sector reads on its own
+ *
+ * RECORDS
+ *  - length (1 byte, the payload's; 0xFF is erased flash, the end),
+ *    type (1 byte), time (4 bytes, time_us_32() when it was written),
+ *    payload, then a CRC-8 of all of it: 7 bytes more than the payload
+ *  - Type FLASH_LOG_BOOT is written by flash_log_init(), with a payload
+ *    of 1 if the watchdog caused the reboot, so boots can be told apart
+ *    (the times start again at each one)
+ *  - flash_log_read_start()/flash_log_read_next() go through the
+ *    records, oldest first, straight from flash. A record whose CRC is
+ *    wrong (power lost while its page was programmed) ends its sector.
+ *
+ * FLUSHING
+ *  - A page is programmed when it fills, or when its oldest record has
+ *    waited FLASH_LOG_FLUSH_US, or on flash_log_flush(). A page that
+ *    was programmed part-full is programmed again as it fills (erased
+ *    bytes can still be programmed, and the ones already written are
+ *    written the same), so losing the power loses at most the last
+ *    FLASH_LOG_FLUSH_US of records.
+ *  - Records that don't fit in the SRAM ring (flash busy for too long)
+ *    are dropped, and counted: flash_log_dropped()
+ *
+ * FLASH AND THE OTHER CORE
+ *  - Programming a page takes about 1 ms, and erasing a sector tens of
+ *    ms, with interrupts off (FLASH_LOG_IRQS_OFF) on the core running
+ *    flash_log_service(), and nothing may run from flash on either core
+ *    meanwhile
+ *  - If the other core has called multicore_lockout_victim_init(), it's
+ *    paused (multicore_lockout_start_blocking()) for each program and
+ *    erase: one page or one sector at a time, never a whole flush. The
+ *    lockout signals through the inter-core FIFO, so an app that uses
+ *    the FIFO itself can't have it.
+ *  - To have the other core never pause, run it from SRAM (HOT_ISR etc.
+ *    for everything it calls, see lib/hotpath; flash_log_write() is in
+ *    SRAM), leave out multicore_lockout_victim_init(), and build with
+ *    FLASH_LOG_LOCKOUT=0, which says it's safe
+ *  - A copy_to_ram binary (pico_set_binary_type(app copy_to_ram)) runs
+ *    nothing from flash, so neither core needs stopping: the defaults
+ *    are then FLASH_LOG_LOCKOUT=0 and FLASH_LOG_IRQS_OFF=0, and the
+ *    interrupts on both cores go on being taken while flash is written.
+ *    Only the thread that called flash_log_service() waits. The CAN demo
+ *    logs this way.
+ *
+ * USE
+ *  - flash_log_init() once, before anything writes, and before
+ *    flash_log_service() first runs
+ *  - flash_log_write(type, data, len) anywhere; returns 0 if dropped
+ *  - flash_log_service() often, always on the same core; returns how
+ *    many pages it programmed or sectors erased
+ *  - flash_log_erase_all() empties the log (on that core too)
+ *  - flash_log_read_start(&r), then flash_log_read_next(&r, &rec) until it
+ *    returns 0, after flash_log_init()
+ *
+ * RESOURCES USED
+ *  - FLASH_LOG_SIZE bytes of flash at FLASH_LOG_OFFSET (checked against
+ *    the end of the program at flash_log_init())
+ *  - FLASH_LOG_BUFFER bytes of SRAM for the ring, and a page more
+ *  - One hardware spinlock (claimed)
+ *
+ */
+#ifndef FLASH_LOG_H
+#define FLASH_LOG_H
+
+#include <stdint.h>
+#include "hardware/flash.h"
+
+// Where the log lives, from the start of flash: whole sectors, between
+// the end of the program and the touchscreen calibration
+#ifndef FLASH_LOG_SIZE
+#define FLASH_LOG_SIZE (256 * 1024)
+#endif
+#ifndef FLASH_LOG_OFFSET
+#define FLASH_LOG_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE - FLASH_LOG_SIZE)
+#endif
+
+// SRAM ring for records waiting to be programmed (bytes, a power of 2).
+// It holds what's logged during a sector erase and more.
+#ifndef FLASH_LOG_BUFFER
+#define FLASH_LOG_BUFFER 8192
+#endif
+
+// Longest a record waits in a part-full page before it's programmed (us)
+#ifndef FLASH_LOG_FLUSH_US
+#define FLASH_LOG_FLUSH_US 1000000
+#endif
+
+// 1 to pause the other core (if it's a lockout victim) while flash is
+// programmed and erased; 0 if it runs from SRAM and needn't be
+#ifndef FLASH_LOG_LOCKOUT
+#if PICO_COPY_TO_RAM
+#define FLASH_LOG_LOCKOUT 0
+#else
+#define FLASH_LOG_LOCKOUT 1
+#endif
+#endif
+
+// 1 to turn off interrupts on the core running flash_log_service() while
+// flash is programmed and erased; 0 if none of its handlers run from flash
+#ifndef FLASH_LOG_IRQS_OFF
+#if PICO_COPY_TO_RAM
+#define FLASH_LOG_IRQS_OFF 0
+#else
+#define FLASH_LOG_IRQS_OFF 1
+#endif
+#endif
+
+// Longest payload
+#define FLASH_LOG_MAX_PAYLOAD 254
+
+// The record flash_log_init() writes
+#define FLASH_LOG_BOOT 0xFF
+
+// A record, as read back (data points into flash)
+typedef struct {
+    uint8_t type ;
+    uint8_t len ;
+    uint32_t time_us ;
+    const uint8_t * data ;
+    uint32_t sequence ;                 // of the sector it's in
+} flash_log_record ;
+
+// Where a read has got to
+typedef struct {
+    int sector ;                        // index in the region
+    int pos ;                           // byte in the sector
+    int left ;                          // sectors still to read, this one included
+} flash_log_reader ;
+
+void flash_log_init(void) ;
+int flash_log_write(uint8_t type, const void * data, int len) ;
+int flash_log_service(void) ;
+void flash_log_flush(void) ;
+unsigned int flash_log_dropped(void) ;
+void flash_log_erase_all(void) ;
+
+void flash_log_read_start(flash_log_reader * r) ;
+int flash_log_read_next(flash_log_reader * r, flash_log_record * rec) ;
+
+#endif
@@ -0,0 +1,81 @@
+/*
+* Goertzel filter bank. Each target is the second-order resonator
+*   s[n] = x[n] + 2cos(w) s[n-1] - s[n-2]
+* run for a block of N samples, after which
+*   |X|^2 = s[N-1]^2 + s[N-2]^2 - 2cos(w) s[N-1] s[N-2]
+* and a sine of amplitude A at the target gives |X| = A N/2.
+*/
+
+#include <math.h>
+#include "goertzel.h"
+
+// s*c>>14 for a 2.14 coefficient c, as two 32-bit multiplies (the M0+
+// has no 32x32->64 multiply). Good for |s| below 2^29.
+static inline int mult14(int s, int c) {
+    return (((s >> 16) * c) << 2) + (((int)(s & 0xFFFF) * c) >> 14) ;
+}
+
+void goertzel_init(goertzel_bank * bank, float fs, int block) {
+    bank->count = 0 ;
+    bank->block = block ;
+    bank->n = 0 ;
+    bank->fs = fs ;
+}
+
+int goertzel_add(goertzel_bank * bank, float freq) {
+    if (bank->count >= GOERTZEL_MAX) return -1 ;
+    int i = bank->count++ ;
+    bank->freq[i] = freq ;
+    bank->coeff[i] = (int)lroundf(2.0f * cosf(2.0f * (float)M_PI * freq / bank->fs) * 16384.0f) ;
+    bank->s1[i] = 0 ;
+    bank->s2[i] = 0 ;
+    bank->level[i] = 0 ;
+    return i ;
+}
+
+// End of a block: work out each target's level and start over
+static void goertzel_finish(goertzel_bank * bank) {
+    int i ;
+    for (i=0; i<bank->count; i++) {
+        int64_t s1 = bank->s1[i], s2 = bank->s2[i] ;
+        int64_t power = s1*s1 + s2*s2 - (((s1*s2) >> 14) * bank->coeff[i]) ;
+        if (power < 0) power = 0 ;
+        // A = 2|X|/N
+        bank->level[i] = (fix15)(sqrtf((float)power) * 2.0f * 32768.0f / (float)bank->block) ;
+        bank->s1[i] = 0 ;
+        bank->s2[i] = 0 ;
+    }
+    bank->n = 0 ;
+}
+
+char goertzel_sample(goertzel_bank * bank, int x) {
+    int i ;
+    for (i=0; i<bank->count; i++) {
+        int s = x + mult14(bank->s1[i], bank->coeff[i]) - bank->s2[i] ;
+        bank->s2[i] = bank->s1[i] ;
+        bank->s1[i] = s ;
+    }
+    if (++bank->n < bank->block) return 0 ;
+    goertzel_finish(bank) ;
+    return 1 ;
+}
+
+int goertzel_samples_u8(goertzel_bank * bank, const uint8_t * samples, int count, int stride) {
+    int k, done = 0 ;
+    for (k=0; k<count; k++) {
+        done += goertzel_sample(bank, (int)samples[k*stride] - 128) ;
+    }
+    return done ;
+}
+
+int goertzel_samples_u16(goertzel_bank * bank, const uint16_t * samples, int count, int stride) {
+    int k, done = 0 ;
+    for (k=0; k<count; k++) {
+        done += goertzel_sample(bank, (int)samples[k*stride] - 2048) ;
+    }
+    return done ;
+}
+
+fix15 goertzel_level(const goertzel_bank * bank, int i) {
+    return bank->level[i] ;
+}
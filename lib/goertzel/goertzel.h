@@ -0,0 +1,55 @@
+/**
+ * Goertzel filter bank for the RP2040
+ *
+ * Measures the level of a few chosen frequencies in a sample stream,
+ * one sample at a time, without an FFT. Each target costs two 32-bit
+ * multiplies and a few adds per sample, so for 4-16 tones it's far
+ * cheaper than a full 1024-point FFT, and small enough to run from a
+ * DMA-completion IRQ on each block of samples as it lands.
+ *
+ * USE
+ *  - goertzel_init(&bank, Fs, block) with the sample rate and the number
+ *    of samples per measurement (the bandwidth is about Fs/block)
+ *  - goertzel_add(&bank, freq) for each target, up to GOERTZEL_MAX
+ *  - Feed samples with goertzel_samples_u8()/_u16() (raw ADC samples,
+ *    with a stride to pick one input out of a round-robin stream) or
+ *    goertzel_sample(). Each returns how many measurements it finished.
+ *  - goertzel_level() is the latest amplitude measured at a target, in
+ *    the units of the (centered) samples, 16.15
+ *
+ */
+#ifndef GOERTZEL_H
+#define GOERTZEL_H
+
+#include <stdint.h>
+#include "fixed_point.h"
+
+#ifndef GOERTZEL_MAX
+#define GOERTZEL_MAX 16
+#endif
+
+typedef struct {
+    int count ;                     // number of targets
+    int block ;                     // samples per measurement
+    int n ;                         // samples so far in this one
+    float fs ;                      // sample rate (Hz)
+    float freq[GOERTZEL_MAX] ;      // target frequencies (Hz)
+    int coeff[GOERTZEL_MAX] ;       // 2cos(2pi f/fs), 2.14
+    int s1[GOERTZEL_MAX] ;          // filter state
+    int s2[GOERTZEL_MAX] ;
+    fix15 level[GOERTZEL_MAX] ;     // latest amplitudes
+} goertzel_bank ;
+
+void goertzel_init(goertzel_bank * bank, float fs, int block) ;
+// Add a target, returning its index (or -1 if the bank is full)
+int goertzel_add(goertzel_bank * bank, float freq) ;
+// Feed one centered sample, returning 1 if it finished a measurement
+char goertzel_sample(goertzel_bank * bank, int x) ;
+// Feed count raw samples, every stride'th from samples, centered on 128
+// (8-bit) or 2048 (12-bit)
+int goertzel_samples_u8(goertzel_bank * bank, const uint8_t * samples, int count, int stride) ;
+int goertzel_samples_u16(goertzel_bank * bank, const uint16_t * samples, int count, int stride) ;
+// Latest amplitude at target i
+fix15 goertzel_level(const goertzel_bank * bank, int i) ;
+
+#endif
@@ -0,0 +1,65 @@
+/**
+ * Where hot code runs from
+ *
+ * Code runs from flash through the XIP cache unless it's put somewhere
+ * else. A cache miss costs tens of cycles, and more when DMA (VGA, above
+ * all) is busy on the bus, so an ISR or inner loop in flash takes as long
+ * as the cache lets it. Memory_Experiment shows __not_in_flash_func()
+ * moving a function to SRAM; these say why a function is there, so it's
+ * done the same way everywhere, and hotpath_report() (CMakeLists.txt)
+ * lists where everything landed.
+ *
+ * ANNOTATIONS
+ *  - HOT_ISR(name): an interrupt handler, or a timer/alarm callback, and
+ *    the driver functions it calls. Main SRAM.
+ *  - HOT_KERNEL(name): an inner loop run often enough that its speed is
+ *    the demo's (drawing a pixel, an FFT, a CRC). Main SRAM.
+ *  - HOT_CORE0(name), HOT_CORE1(name): a small handler that only ever
+ *    runs on that core, in that core's scratch bank (Y for core 0, X for
+ *    core 1, where the SDK puts its stack), so it never waits on the
+ *    other core or DMA for a bank of main SRAM.
+ *  - HOT_INLINE: a helper a hot function calls. It must be inlined
+ *    (static inline alone doesn't promise it), or it's called in flash.
+ *
+ *   void HOT_ISR(tx_handler)() { ... }
+ *   static HOT_INLINE unsigned short crc(...) { ... }
+ *
+ * The SDK's linker script already has the sections: .time_critical.*
+ * is copied into SRAM with .data, and .scratch_x.* and .scratch_y.* into
+ * the scratch banks, at startup. A scratch bank is 4 kBytes, shared with
+ * the core's stack (PICO_STACK_SIZE, PICO_CORE1_STACK_SIZE, 2 kBytes by
+ * default), and the link fails if they don't fit.
+ *
+ * Functions called from hot code (the SDK's, or others) still run from
+ * flash unless they're annotated too; SDK hardware_ calls are mostly
+ * static inline, and are inlined.
+ *
+ * BUILD OPTIONS
+ *  - HOTPATH_IN_FLASH=1 leaves everything in flash, to measure the
+ *    difference
+ *
+ */
+#ifndef HOTPATH_H
+#define HOTPATH_H
+
+#include "pico.h"
+
+#ifndef HOTPATH_IN_FLASH
+#define HOTPATH_IN_FLASH 0
+#endif
+
+#if HOTPATH_IN_FLASH
+#define HOT_ISR(name) name
+#define HOT_KERNEL(name) name
+#define HOT_CORE0(name) name
+#define HOT_CORE1(name) name
+#else
+#define HOT_ISR(name) __not_in_flash("isr." #name) name
+#define HOT_KERNEL(name) __not_in_flash("kernel." #name) name
+#define HOT_CORE0(name) __attribute__((section(".scratch_y.hot." #name))) name
+#define HOT_CORE1(name) __attribute__((section(".scratch_x.hot." #name))) name
+#endif
+
+#define HOT_INLINE __force_inline
+
+#endif
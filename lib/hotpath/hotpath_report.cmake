@@ -0,0 +1,77 @@
+# Where an ELF's code landed (see hotpath_report() in CMakeLists.txt).
+#
+#   cmake -DNM=<nm> -DELF=<app.elf> -DOUT=<report.txt> -P hotpath_report.cmake
+#
+# Functions are sorted into regions by address: flash is 0x10000000 up,
+# main SRAM 0x20000000 up, and the scratch banks X and Y 0x20040000 and
+# 0x20041000.
+execute_process(COMMAND ${NM} --print-size --defined-only ${ELF}
+    OUTPUT_VARIABLE SYMBOLS
+    RESULT_VARIABLE NM_RESULT)
+if (NOT NM_RESULT EQUAL 0)
+    message(FATAL_ERROR "hotpath_report: ${NM} failed on ${ELF}")
+endif()
+
+# Pad text with spaces to width
+function(pad VAR TEXT WIDTH)
+    string(LENGTH "${TEXT}" LEN)
+    while (LEN LESS WIDTH)
+        string(APPEND TEXT " ")
+        math(EXPR LEN "${LEN} + 1")
+    endwhile()
+    set(${VAR} "${TEXT}" PARENT_SCOPE)
+endfunction()
+
+set(REGIONS flash sram scratch_x scratch_y)
+foreach(REGION ${REGIONS})
+    set(${REGION}_BYTES 0)
+    set(${REGION}_COUNT 0)
+endforeach()
+set(OUT_OF_FLASH "")
+
+string(REPLACE "\n" ";" SYMBOLS "${SYMBOLS}")
+foreach(LINE ${SYMBOLS})
+    # address size type name, for functions (local, global or weak)
+    if (NOT LINE MATCHES "^([0-9a-f]+) ([0-9a-f]+) [tTW] (.+)$")
+        continue()
+    endif()
+    set(ADDRESS ${CMAKE_MATCH_1})
+    set(NAME ${CMAKE_MATCH_3})
+    math(EXPR SIZE "0x${CMAKE_MATCH_2}")
+    string(SUBSTRING ${ADDRESS} 0 5 PAGE)
+    if (PAGE STREQUAL "20040")
+        set(REGION scratch_x)
+    elseif (PAGE STREQUAL "20041")
+        set(REGION scratch_y)
+    elseif (ADDRESS MATCHES "^2")
+        set(REGION sram)
+    else()
+        set(REGION flash)
+    endif()
+    math(EXPR ${REGION}_BYTES "${${REGION}_BYTES} + ${SIZE}")
+    math(EXPR ${REGION}_COUNT "${${REGION}_COUNT} + 1")
+    if (NOT REGION STREQUAL "flash")
+        pad(ENTRY "${REGION}" 11)
+        pad(SIZE_TEXT "${SIZE}" 7)
+        list(APPEND OUT_OF_FLASH "${ENTRY}0x${ADDRESS}  ${SIZE_TEXT}${NAME}")
+    endif()
+endforeach()
+
+get_filename_component(ELF_NAME ${ELF} NAME)
+set(REPORT "Code placement for ${ELF_NAME}\n\n")
+string(APPEND REPORT "  region     bytes    functions\n")
+foreach(REGION ${REGIONS})
+    pad(LINE "  ${REGION}" 13)
+    pad(BYTES "${${REGION}_BYTES}" 9)
+    string(APPEND REPORT "${LINE}${BYTES}${${REGION}_COUNT}\n")
+    message(STATUS "${ELF_NAME}: ${${REGION}_BYTES} bytes of code in ${REGION}")
+endforeach()
+
+string(APPEND REPORT "\nOut of flash (sorted by region and address):\n\n")
+string(APPEND REPORT "  region     address     size   function\n")
+list(SORT OUT_OF_FLASH)
+foreach(ENTRY ${OUT_OF_FLASH})
+    string(APPEND REPORT "  ${ENTRY}\n")
+endforeach()
+
+file(WRITE ${OUT} "${REPORT}")
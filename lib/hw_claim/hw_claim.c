@@ -0,0 +1,272 @@
+/**
+ * DMA channel and PIO allocation (see hw_claim.h)
+ *
+ */
+#include <stdio.h>
+#include <string.h>
+#include "hardware/sync.h"
+#include "hotpath.h"
+#include "hw_claim.h"
+
+// Who claimed each channel, state machine and timer (NULL if it wasn't
+// claimed here)
+static const char * dma_owner[NUM_DMA_CHANNELS] ;
+static const char * sm_owner[NUM_PIOS][NUM_PIO_STATE_MACHINES] ;
+static const char * timer_owner[NUM_DMA_TIMERS] ;
+static const char * irq_owner[NUM_PIOS][HW_PIO_IRQ_FLAGS] ;
+
+// The programs loaded, where, by whom first, and how many drivers use them
+#define HW_MAX_PROGRAMS (2 * PIO_INSTRUCTION_COUNT)
+typedef struct {
+    PIO pio ;
+    const pio_program_t * program ;
+    uint offset ;
+    short users ;
+    const char * owner ;
+} hw_program ;
+static hw_program programs[HW_MAX_PROGRAMS] ;
+static int program_count = 0 ;
+
+// The panic message's list of holders
+static char holders[256] ;
+
+static const char * ownerName(const char * owner, bool claimed) {
+    if (owner) return owner ;
+    return claimed ? "?" : "-" ;
+}
+
+// Append to holders, as far as it goes
+static void addHolder(int * at, const char * fmt, int n, const char * owner) {
+    if (*at >= (int)sizeof(holders)) return ;
+    *at += snprintf(holders + *at, sizeof(holders) - *at, fmt, n, owner) ;
+}
+
+static const char * dmaHolders(void) {
+    int at = 0 ;
+    holders[0] = 0 ;
+    for (int chan=0; chan<NUM_DMA_CHANNELS; chan++) {
+        addHolder(&at, " %d:%s", chan, ownerName(dma_owner[chan], dma_channel_is_claimed(chan))) ;
+    }
+    return holders ;
+}
+
+static const char * smHolders(PIO pio) {
+    int at = 0 ;
+    holders[0] = 0 ;
+    for (int sm=0; sm<NUM_PIO_STATE_MACHINES; sm++) {
+        addHolder(&at, " %d:%s", sm, ownerName(sm_owner[pio_get_index(pio)][sm], pio_sm_is_claimed(pio, sm))) ;
+    }
+    return holders ;
+}
+
+static const char * irqHolders(PIO pio) {
+    int at = 0 ;
+    holders[0] = 0 ;
+    for (int flag=0; flag<HW_PIO_IRQ_FLAGS; flag++) {
+        addHolder(&at, " %d:%s", flag, ownerName(irq_owner[pio_get_index(pio)][flag], false)) ;
+    }
+    return holders ;
+}
+
+static const char * programHolders(PIO pio) {
+    int at = 0 ;
+    holders[0] = 0 ;
+    for (int i=0; i<program_count; i++) {
+        if (programs[i].pio != pio) continue ;
+        addHolder(&at, " %d:%s", programs[i].offset, programs[i].owner) ;
+    }
+    return holders ;
+}
+
+///////////////////////////////// DMA ////////////////////////////////////
+
+int hw_claim_dma_try(const char * owner) {
+    for (int chan = NUM_DMA_CHANNELS - 1; chan >= 0; chan--) {
+        if (!dma_channel_is_claimed(chan)) {
+            dma_channel_claim(chan) ;
+            dma_owner[chan] = owner ;
+            return chan ;
+        }
+    }
+    return -1 ;
+}
+
+int hw_claim_dma(const char * owner) {
+    int chan = hw_claim_dma_try(owner) ;
+    if (chan < 0) panic("%s: no free DMA channel (held by%s)", owner, dmaHolders()) ;
+    return chan ;
+}
+
+void hw_unclaim_dma(int chan) {
+    if ((chan < 0) || (chan >= NUM_DMA_CHANNELS)) return ;
+    dma_owner[chan] = NULL ;
+    dma_channel_unclaim(chan) ;
+}
+
+int hw_claim_dma_timer(const char * owner) {
+    int timer = dma_claim_unused_timer(false) ;
+    if (timer < 0) {
+        int at = 0 ;
+        holders[0] = 0 ;
+        for (int i=0; i<NUM_DMA_TIMERS; i++) addHolder(&at, " %d:%s", i, ownerName(timer_owner[i], true)) ;
+        panic("%s: no free DMA timer (held by%s)", owner, holders) ;
+    }
+    timer_owner[timer] = owner ;
+    return timer ;
+}
+
+///////////////////////////////// PIO ////////////////////////////////////
+
+int hw_claim_sm_try(PIO pio, const char * owner) {
+    int sm = pio_claim_unused_sm(pio, false) ;
+    if (sm >= 0) sm_owner[pio_get_index(pio)][sm] = owner ;
+    return sm ;
+}
+
+int hw_claim_sm(PIO pio, const char * owner) {
+    int sm = hw_claim_sm_try(pio, owner) ;
+    if (sm < 0) {
+        panic("%s: no free state machine on pio%d (held by%s)", owner, pio_get_index(pio), smHolders(pio)) ;
+    }
+    return sm ;
+}
+
+void hw_unclaim_sm(PIO pio, uint sm) {
+    sm_owner[pio_get_index(pio)][sm] = NULL ;
+    pio_sm_unclaim(pio, sm) ;
+}
+
+int hw_add_program_try(PIO pio, const pio_program_t * program, const char * owner) {
+    // Already there: share it
+    for (int i=0; i<program_count; i++) {
+        if ((programs[i].pio == pio) && (programs[i].program == program)) {
+            programs[i].users++ ;
+            return programs[i].offset ;
+        }
+    }
+    if ((program_count == HW_MAX_PROGRAMS) || !pio_can_add_program(pio, program)) return -1 ;
+    hw_program * p = &programs[program_count++] ;
+    p->pio = pio ;
+    p->program = program ;
+    p->offset = pio_add_program(pio, program) ;
+    p->users = 1 ;
+    p->owner = owner ;
+    return p->offset ;
+}
+
+uint hw_add_program(PIO pio, const pio_program_t * program, const char * owner) {
+    int offset = hw_add_program_try(pio, program, owner) ;
+    if (offset < 0) {
+        panic("%s: %d instructions don't fit in pio%d (programs at%s)",
+              owner, program->length, pio_get_index(pio), programHolders(pio)) ;
+    }
+    return offset ;
+}
+
+bool hw_claim_pio_irq_try(PIO pio, uint flag, const char * owner) {
+    const char ** held = &irq_owner[pio_get_index(pio)][flag & (HW_PIO_IRQ_FLAGS - 1)] ;
+    if (*held) return false ;
+    *held = owner ;
+    return true ;
+}
+
+void hw_claim_pio_irq(PIO pio, uint flag, const char * owner) {
+    if (!hw_claim_pio_irq_try(pio, flag, owner)) {
+        panic("%s: pio%d IRQ flag %d is held by %s", owner, pio_get_index(pio), flag,
+              irq_owner[pio_get_index(pio)][flag & (HW_PIO_IRQ_FLAGS - 1)]) ;
+    }
+}
+
+void hw_unclaim_pio_irq(PIO pio, uint flag) {
+    irq_owner[pio_get_index(pio)][flag & (HW_PIO_IRQ_FLAGS - 1)] = NULL ;
+}
+
+void hw_claim_pio(const pio_program_t * program, const char * owner, PIO * pio, uint * sm, uint * offset) {
+    PIO blocks[NUM_PIOS] = { pio0, pio1 } ;
+    for (int i=0; i<NUM_PIOS; i++) {
+        int s = hw_claim_sm_try(blocks[i], owner) ;
+        if (s < 0) continue ;
+        int o = hw_add_program_try(blocks[i], program, owner) ;
+        if (o < 0) {
+            hw_unclaim_sm(blocks[i], s) ;
+            continue ;
+        }
+        *pio = blocks[i] ;
+        *sm = s ;
+        *offset = o ;
+        return ;
+    }
+    panic("%s: no PIO block has a free state machine and room for %d instructions", owner, program->length) ;
+}
+
+void hw_claim_report(void) {
+    printf("DMA channels:%s\n", dmaHolders()) ;
+    for (int i=0; i<NUM_PIOS; i++) {
+        PIO pio = i ? pio1 : pio0 ;
+        printf("pio%d state machines:%s\n", i, smHolders(pio)) ;
+        printf("pio%d programs (offset:owner):%s\n", i, programHolders(pio)) ;
+        printf("pio%d IRQ flags:%s\n", i, irqHolders(pio)) ;
+    }
+}
+
+////////////////////////// Shared control channel //////////////////////////
+
+static int ctrl_chan = -1 ;
+static spin_lock_t * ctrl_lock ;
+// The driver whose turn it is, and those waiting, oldest first
+static hw_ctrl_user * ctrl_holder ;
+static hw_ctrl_user * ctrl_head ;
+static hw_ctrl_user * ctrl_tail ;
+
+int hw_ctrl_channel(void) {
+    if (ctrl_chan < 0) {
+        ctrl_lock = spin_lock_init(spin_lock_claim_unused(true)) ;
+        ctrl_chan = hw_claim_dma("hw_ctrl") ;
+        // Four words a block, into a 16-byte ring of the data channel's
+        // registers
+        dma_channel_config c = dma_channel_get_default_config(ctrl_chan) ;
+        channel_config_set_transfer_data_size(&c, DMA_SIZE_32) ;
+        channel_config_set_read_increment(&c, true) ;
+        channel_config_set_write_increment(&c, true) ;
+        channel_config_set_ring(&c, true, 4) ;
+        dma_channel_configure(ctrl_chan, &c, NULL, NULL, 4, false) ;
+    }
+    return ctrl_chan ;
+}
+
+// Turns are asked for and handed on from interrupts, so these are in RAM
+void HOT_ISR(hw_ctrl_request)(hw_ctrl_user * user) {
+    user->next = NULL ;
+    uint32_t save = spin_lock_blocking(ctrl_lock) ;
+    if (ctrl_holder == NULL) {
+        ctrl_holder = user ;
+        spin_unlock(ctrl_lock, save) ;
+        user->start(user) ;
+        return ;
+    }
+    if (ctrl_tail) ctrl_tail->next = user ;
+    else ctrl_head = user ;
+    ctrl_tail = user ;
+    spin_unlock(ctrl_lock, save) ;
+}
+
+void HOT_ISR(hw_ctrl_release)(hw_ctrl_user * user) {
+    uint32_t save = spin_lock_blocking(ctrl_lock) ;
+    if (ctrl_holder != user) {
+        spin_unlock(ctrl_lock, save) ;
+        return ;
+    }
+    hw_ctrl_user * next = ctrl_head ;
+    if (next) {
+        ctrl_head = next->next ;
+        if (ctrl_head == NULL) ctrl_tail = NULL ;
+    }
+    ctrl_holder = next ;
+    spin_unlock(ctrl_lock, save) ;
+    if (next) next->start(next) ;
+}
+
+void HOT_ISR(hw_ctrl_load)(volatile void * regs, const void * blocks) {
+    dma_channel_set_write_addr(ctrl_chan, regs, false) ;
+    dma_channel_set_read_addr(ctrl_chan, blocks, false) ;
+}
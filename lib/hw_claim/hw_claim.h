@@ -0,0 +1,132 @@
+/**
+ * DMA channel and PIO allocation for the RP2040
+ *
+ * Each driver used to pick its own DMA channels and state machines (VGA
+ * on channels 0 and 1, the FFT on 2 and 3, the UDP transmitter on all
+ * twelve), so no two of them could run on one board. With these, a
+ * driver claims what it needs when it starts, with its name, and two
+ * drivers that want the same thing get different ones.
+ *
+ * DMA CHANNELS AND TIMERS
+ *  - hw_claim_dma(owner) claims a free channel, from the top down, so a
+ *    demo that still uses a low channel without claiming it keeps
+ *    working alongside. hw_claim_dma_try() returns -1 rather than
+ *    stopping when there's none.
+ *  - hw_claim_dma_timer(owner) claims a DMA pacing timer
+ *
+ * PIO STATE MACHINES AND INSTRUCTION MEMORY
+ *  - hw_claim_sm(pio, owner) claims a free state machine on pio
+ *  - hw_add_program(pio, program, owner) loads a program into pio's
+ *    instruction memory, once: two drivers using the same program (two
+ *    steppers, say) share it, and get the same offset
+ *  - hw_claim_pio(program, owner, &pio, &sm, &offset) does both on
+ *    whichever PIO block has a free state machine and room, for a driver
+ *    that doesn't care which
+ *  - A driver that needs a particular PIO block (for its interrupt, or
+ *    its IRQ flags) claims on that one
+ *
+ * PIO IRQ FLAGS
+ *  Each PIO block has eight IRQ flags, which its programs hardcode (an
+ *  "irq wait 0 rel" is flag sm). The SDK doesn't track them, so two
+ *  drivers using the same flag on one block would see each other's.
+ *  - hw_claim_pio_irq(pio, flag, owner) claims one, and panics naming
+ *    the holder if it's taken. A driver claims each flag its programs use.
+ *    hw_claim_pio_irq_try() returns false instead.
+ *  - Flags 0 to 3 can interrupt the CPU; 4 to 7 can't, and are for state
+ *    machines signalling each other. The drivers here keep to that: VGA
+ *    uses pio0 flags 2, 4 and 5, CAN's transmitter pio0 flags 0, 3, 6 and
+ *    7, and a stepper (lib/stepper) flag sm of its block.
+ *
+ * WHEN THERE'S NONE LEFT
+ *  - hw_claim_dma(), hw_claim_sm(), hw_add_program(), hw_claim_pio() and
+ *    hw_claim_pio_irq() panic, with the name of the driver that asked and
+ *    of every driver holding one (the SDK's panic() prints it on stdio),
+ *    so a board with too many drivers stops at startup saying why, rather
+ *    than two drivers silently sharing a channel. The _try versions
+ *    return -1 (hw_claim_pio_irq_try() false).
+ *  - hw_claim_report() prints who has what
+ *
+ * SHARING A CONTROL BLOCK CHANNEL
+ *  A control block channel loads another channel's registers from a list
+ *  of blocks, one block per transfer. A driver that runs a list now and
+ *  then (the UDP transmitter, a packet at a time) needn't keep one of its
+ *  own: hw_ctrl_channel() is one channel for all of them, which they
+ *  take turns with.
+ *
+ *    hw_ctrl_user user = { start_list, "udp" } ;
+ *    hw_ctrl_request(&user) ;      // start_list(&user) runs when it's our turn
+ *    ...
+ *    void start_list(hw_ctrl_user * u) {
+ *        hw_ctrl_load(&dma_hw->ch[data_chan].read_addr, blocks) ;
+ *        (start the transfer, whose data channel chains to hw_ctrl_channel())
+ *    }
+ *    ...                           // when the last block has finished:
+ *    hw_ctrl_release(&user) ;      // the next one waiting starts
+ *
+ *  - A driver calls hw_ctrl_channel() when it starts (for its chain_to),
+ *    which claims and sets up the channel the first time
+ *  - The channel is set up once: 32-bit transfers, four words to a block,
+ *    written to four registers of the data channel in a 16-byte ring, so
+ *    each block is one alias of its registers (the last one a trigger)
+ *  - Turns are in the order they were asked for. start() runs in
+ *    hw_ctrl_request() if the channel is free, or else in the
+ *    hw_ctrl_release() of the driver before (often an interrupt), so it
+ *    has to be short, and safe there.
+ *  - A list that never ends (one that loops back to its start, as the
+ *    AM keyer's does) never gives its turn up, so it needs its own
+ *    channel
+ *
+ * Claims are made at startup (they aren't for interrupts), and go through
+ * the SDK's (dma_channel_claim(), pio_sm_claim()), so code that claims
+ * with the SDK directly is still counted, as "?".
+ *
+ * RESOURCES USED
+ *  - One DMA channel for hw_ctrl_channel(), the first time it's asked for
+ *  - A spin lock for the control channel queue
+ *
+ */
+#ifndef HW_CLAIM_H
+#define HW_CLAIM_H
+
+#include "pico/stdlib.h"
+#include "hardware/dma.h"
+#include "hardware/pio.h"
+
+// DMA channels
+int hw_claim_dma(const char * owner) ;
+int hw_claim_dma_try(const char * owner) ;
+void hw_unclaim_dma(int chan) ;
+int hw_claim_dma_timer(const char * owner) ;
+
+// PIO state machines and instruction memory
+int hw_claim_sm(PIO pio, const char * owner) ;
+int hw_claim_sm_try(PIO pio, const char * owner) ;
+void hw_unclaim_sm(PIO pio, uint sm) ;
+uint hw_add_program(PIO pio, const pio_program_t * program, const char * owner) ;
+int hw_add_program_try(PIO pio, const pio_program_t * program, const char * owner) ;
+void hw_claim_pio(const pio_program_t * program, const char * owner, PIO * pio, uint * sm, uint * offset) ;
+
+// PIO IRQ flags
+#define HW_PIO_IRQ_FLAGS 8
+void hw_claim_pio_irq(PIO pio, uint flag, const char * owner) ;
+bool hw_claim_pio_irq_try(PIO pio, uint flag, const char * owner) ;
+void hw_unclaim_pio_irq(PIO pio, uint flag) ;
+
+// Everything claimed, and by whom
+void hw_claim_report(void) ;
+
+// A driver taking its turn with the shared control block channel
+typedef struct hw_ctrl_user {
+    void (*start)(struct hw_ctrl_user * user) ;     // called when it's this one's turn
+    const char * owner ;
+    struct hw_ctrl_user * next ;                    // next in the queue
+} hw_ctrl_user ;
+
+int hw_ctrl_channel(void) ;
+void hw_ctrl_request(hw_ctrl_user * user) ;
+void hw_ctrl_release(hw_ctrl_user * user) ;
+// Point the channel at the data channel's registers (four of them, from
+// regs) and the first block, without starting it. Only during our turn.
+void hw_ctrl_load(volatile void * regs, const void * blocks) ;
+
+#endif
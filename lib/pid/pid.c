@@ -0,0 +1,115 @@
+/**
+ * Fixed-point PID controller (see pid.h)
+ *
+ */
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "pid.h"
+
+// Products saturate rather than wrap, so a large error can only pin the
+// output at a limit
+static inline pid_fix saturate(int64_t x) {
+    return (x > INT32_MAX) ? INT32_MAX : (x < -INT32_MAX) ? -INT32_MAX : (pid_fix)x ;
+}
+#define multpid(a,b) saturate((((int64_t)(a)) * ((int64_t)(b))) >> PID_FRAC_BITS)
+
+// Largest float below 2^31
+#define FLOAT_INT32_MAX 2147483520.0f
+
+// x * 2^bits as an int32, saturated in float first: a float out of the
+// int32 range doesn't convert (a large gain, or kd times the rate)
+static int32_t floatToFix(float x, int bits) {
+    x *= (float)(1u << bits) ;
+    if (x > FLOAT_INT32_MAX) x = FLOAT_INT32_MAX ;
+    if (x < -FLOAT_INT32_MAX) x = -FLOAT_INT32_MAX ;
+    return (int32_t)x ;
+}
+
+// Extra fraction bits of ki, which is small once divided by the rate
+#define KI_BITS 8
+#define KI_SHIFT (PID_FRAC_BITS + KI_BITS)
+
+void pid_init(pid_controller * pid, int rate) {
+    pid->rate = (rate > 0) ? rate : 1 ;
+    pid->kp = pid->ki = pid->kd = 0 ;
+    pid->d_shift = 0 ;
+    pid->out_min = int2pid(-32767) ;
+    pid->out_max = int2pid(32767) ;
+    pid->p_out = pid->i_out = pid->d_out = 0 ;
+    pid_reset(pid) ;
+}
+
+void pid_set_gains(pid_controller * pid, float kp, float ki, float kd) {
+    pid_fix p = floatToFix(kp, PID_FRAC_BITS) ;
+    int32_t i = floatToFix(ki / pid->rate, KI_SHIFT) ;
+    pid_fix d = floatToFix(kd * pid->rate, PID_FRAC_BITS) ;
+    // The loop may be running in an interrupt on this core, so it sees
+    // all three new gains or none
+    uint32_t save = save_and_disable_interrupts() ;
+    pid->kp = p ;
+    pid->ki = i ;
+    pid->kd = d ;
+    restore_interrupts(save) ;
+}
+
+void pid_set_limits(pid_controller * pid, float out_min, float out_max) {
+    uint32_t save = save_and_disable_interrupts() ;
+    pid->out_min = floatToFix(out_min, PID_FRAC_BITS) ;
+    pid->out_max = floatToFix(out_max, PID_FRAC_BITS) ;
+    restore_interrupts(save) ;
+}
+
+void pid_set_derivative_filter(pid_controller * pid, int shift) {
+    pid->d_shift = (shift < 0) ? 0 : (shift > 15) ? 15 : shift ;
+}
+
+void pid_reset(pid_controller * pid) {
+    pid->integral = 0 ;
+    pid->last_measurement = 0 ;
+    pid->d_term = 0 ;
+    pid->primed = 0 ;
+}
+
+pid_fix pid_update(pid_controller * pid, pid_fix setpoint, pid_fix measurement) {
+    pid_fix error = saturate((int64_t)setpoint - measurement) ;
+
+    // Proportional
+    pid_fix p = multpid(pid->kp, error) ;
+
+    // Derivative, on the measurement (no kick when the setpoint moves),
+    // through the optional one-pole filter
+    pid_fix delta = pid->primed ? saturate((int64_t)measurement - pid->last_measurement) : 0 ;
+    pid->last_measurement = measurement ;
+    pid->primed = 1 ;
+    pid_fix d_raw = -multpid(pid->kd, delta) ;
+    pid->d_term += (pid_fix)(((int64_t)d_raw - pid->d_term) >> pid->d_shift) ;
+    pid_fix d = pid->d_term ;
+
+    // Integral: the sum of ki * error per sample. Held to the limits, so
+    // it can never wind up beyond what the output can use.
+    int64_t i_limit_hi = ((int64_t)pid->out_max) << KI_SHIFT ;
+    int64_t i_limit_lo = ((int64_t)pid->out_min) << KI_SHIFT ;
+    int64_t integral = pid->integral + ((int64_t)pid->ki * error) ;
+    if (integral > i_limit_hi) integral = i_limit_hi ;
+    if (integral < i_limit_lo) integral = i_limit_lo ;
+    pid_fix i = (pid_fix)(integral >> KI_SHIFT) ;
+
+    // Clamp the output. While it's pinned at a limit, only let the
+    // integral move back away from that limit.
+    int64_t sum = (int64_t)p + i + d ;
+    pid_fix out = (pid_fix)sum ;
+    if (sum > pid->out_max) {
+        out = pid->out_max ;
+        if (integral > pid->integral) integral = pid->integral ;
+    }
+    else if (sum < pid->out_min) {
+        out = pid->out_min ;
+        if (integral < pid->integral) integral = pid->integral ;
+    }
+    pid->integral = integral ;
+
+    pid->p_out = p ;
+    pid->i_out = i ;
+    pid->d_out = d ;
+    return out ;
+}
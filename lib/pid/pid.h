@@ -0,0 +1,72 @@
+/**
+ * Fixed-point PID controller for the RP2040
+ *
+ * A PID loop meant to run from an interrupt at a fixed rate (e.g. the
+ * PWM wrap interrupt): pid_update() is straight-line integer code, a few
+ * 64-bit multiplies and no division, loops or floating point, so it takes
+ * the same short time every sample.
+ *  - The derivative is taken on the measurement rather than the error,
+ *    so a step in the setpoint doesn't kick the output. It can be
+ *    smoothed with a one-pole filter (pid_set_derivative_filter).
+ *  - The output is clamped to its limits, and the integrator stops
+ *    winding up while it is: it isn't added to in the direction that
+ *    would push the output further past a limit, and it is held within
+ *    the limits itself.
+ *
+ * USE
+ *  - pid_init(&pid, rate) with the update rate in Hz
+ *  - pid_set_gains(&pid, kp, ki, kd) and pid_set_limits(&pid, min, max).
+ *    The gains are continuous-time (ki per second, kd in seconds) and
+ *    are converted for the rate; these take floats, but aren't meant for
+ *    the interrupt (set them from a thread, e.g. from serial input).
+ *    Changing ki changes how the integral grows from then on, not what
+ *    it has built up, so the output doesn't jump.
+ *  - out = pid_update(&pid, setpoint, measurement) every sample
+ *
+ * Setpoint, measurement and output are fixed point with PID_FRAC_BITS
+ * fraction bits: 16 (the default) for 16.16, as in the IMU demo, 15 for
+ * the 17.15 of other apps. Outputs must stay within +/-32767.
+ *
+ */
+#ifndef PID_H
+#define PID_H
+
+#include <stdint.h>
+
+#ifndef PID_FRAC_BITS
+#define PID_FRAC_BITS 16
+#endif
+
+typedef int32_t pid_fix ;
+#define float2pid(a) ((pid_fix)((a) * (float)(1 << PID_FRAC_BITS)))
+#define pid2float(a) ((float)(a) / (float)(1 << PID_FRAC_BITS))
+#define int2pid(a) ((pid_fix)(a) << PID_FRAC_BITS)
+#define pid2int(a) ((int)((a) >> PID_FRAC_BITS))
+
+typedef struct {
+    int rate ;                      // updates per second
+    // Gains, per sample
+    pid_fix kp ;
+    int32_t ki ;                    // over the rate, PID_FRAC_BITS + 8 fraction bits
+    pid_fix kd ;                    // times the rate
+    int d_shift ;                   // derivative filter (0 for none)
+    pid_fix out_min, out_max ;
+    // State
+    int64_t integral ;              // sum of ki * error, 2 * PID_FRAC_BITS + 8 fraction bits
+    pid_fix last_measurement ;
+    pid_fix d_term ;
+    char primed ;                   // last_measurement is valid
+    // The terms of the latest update, to watch while tuning
+    pid_fix p_out, i_out, d_out ;
+} pid_controller ;
+
+void pid_init(pid_controller * pid, int rate) ;
+void pid_set_gains(pid_controller * pid, float kp, float ki, float kd) ;
+void pid_set_limits(pid_controller * pid, float out_min, float out_max) ;
+// Average the derivative over about 2^shift samples
+void pid_set_derivative_filter(pid_controller * pid, int shift) ;
+// Forget the integral and the last measurement
+void pid_reset(pid_controller * pid) ;
+pid_fix pid_update(pid_controller * pid, pid_fix setpoint, pid_fix measurement) ;
+
+#endif
@@ -0,0 +1,1723 @@
+/* 
+ * File:   pt_cornell_rp2040_v1.h
+ * Author: brl4 Briuce Land
+ * Bruce R Land, Cornell University
+ * Created on Dec 10, 2018
+ */
+
+/*
+ * Copyright (c) 2004-2005, Swedish Institute of Computer Science.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ * Author: Adam Dunkels <adam@sics.se>
+ *
+ * $Id: pt.h,v 1.7 2006/10/02 07:52:56 adam Exp $
+ */
+/**
+ * \addtogroup pt
+ * @{
+ */
+
+/**
+ * \file
+ * Protothreads implementation.
+ * \author
+ * Adam Dunkels <adam@sics.se>
+ *
+ */
+
+#ifndef __PT_H__
+#define __PT_H__
+
+////////////////////////
+//#include "lc.h"
+////////////////////////
+/**
+ * \file lc.h
+ * Local continuations
+ * \author
+ * Adam Dunkels <adam@sics.se>
+ *
+ */
+
+#ifdef DOXYGEN
+/**
+ * Initialize a local continuation.
+ *
+ * This operation initializes the local continuation, thereby
+ * unsetting any previously set continuation state.
+ *
+ * \hideinitializer
+ */
+#define LC_INIT(lc)
+
+/**
+ * Set a local continuation.
+ *
+ * The set operation saves the state of the function at the point
+ * where the operation is executed. As far as the set operation is
+ * concerned, the state of the function does <b>not</b> include the
+ * call-stack or local (automatic) variables, but only the program
+ * counter and such CPU registers that needs to be saved.
+ *
+ * \hideinitializer
+ */
+#define LC_SET(lc)
+
+/**
+ * Resume a local continuation.
+ *
+ * The resume operation resumes a previously set local continuation, thus
+ * restoring the state in which the function was when the local
+ * continuation was set. If the local continuation has not been
+ * previously set, the resume operation does nothing.
+ *
+ * \hideinitializer
+ */
+#define LC_RESUME(lc)
+
+/**
+ * Mark the end of local continuation usage.
+ *
+ * The end operation signifies that local continuations should not be
+ * used any more in the function. This operation is not needed for
+ * most implementations of local continuation, but is required by a
+ * few implementations.
+ *
+ * \hideinitializer 
+ */
+#define LC_END(lc)
+
+/**
+ * \var typedef lc_t;
+ *
+ * The local continuation type.
+ *
+ * \hideinitializer
+ */
+#endif /* DOXYGEN */
+
+//#ifndef __LC_H__
+//#define __LC_H__
+
+
+//#ifdef LC_INCLUDE
+//#include LC_INCLUDE
+//#else
+
+/////////////////////////////
+//#include "lc-switch.h"
+/////////////////////////////
+
+//#ifndef __LC_SWITCH_H__
+//#define __LC_SWITCH_H__
+
+/* WARNING! lc implementation using switch() does not work if an
+   LC_SET() is done within another switch() statement! */
+
+/** \hideinitializer */
+/*
+typedef unsigned short lc_t;
+
+#define LC_INIT(s) s = 0;
+
+#define LC_RESUME(s) switch(s) { case 0:
+
+#define LC_SET(s) s = __LINE__; case __LINE__:
+
+#define LC_END(s) }
+
+#endif /* __LC_SWITCH_H__ */
+
+/** @} */
+
+//#endif /* LC_INCLUDE */
+
+//#endif /* __LC_H__ */
+
+/** @} */
+/** @} */
+
+/////////////////////////////
+//#include "lc-addrlabels.h"
+/////////////////////////////
+
+#ifndef __LC_ADDRLABELS_H__
+#define __LC_ADDRLABELS_H__
+
+/** \hideinitializer */
+typedef void * lc_t;
+
+#define LC_INIT(s) s = NULL
+
+#define LC_RESUME(s)        \
+  do {            \
+    if(s != NULL) {       \
+      goto *s;          \
+    }           \
+  } while(0)
+
+#define LC_CONCAT2(s1, s2) s1##s2
+#define LC_CONCAT(s1, s2) LC_CONCAT2(s1, s2)
+
+#define LC_SET(s)       \
+  do {            \
+    LC_CONCAT(LC_LABEL, __LINE__):            \
+    (s) = &&LC_CONCAT(LC_LABEL, __LINE__);  \
+  } while(0)
+
+#define LC_END(s)
+
+#endif /* __LC_ADDRLABELS_H__ */
+
+//////////////////////////////////////////
+struct pt {
+  lc_t lc;
+};
+
+#define PT_WAITING 0
+#define PT_YIELDED 1
+#define PT_EXITED  2
+#define PT_ENDED   3
+
+/**
+ * \name Initialization
+ * @{
+ */
+
+/**
+ * Initialize a protothread.
+ *
+ * Initializes a protothread. Initialization must be done prior to
+ * starting to execute the protothread.
+ *
+ * \param pt A pointer to the protothread control structure.
+ *
+ * \sa PT_SPAWN()
+ *
+ * \hideinitializer
+ */
+#define PT_INIT(pt)   LC_INIT((pt)->lc)
+
+/** @} */
+
+/**
+ * \name Declaration and definition
+ * @{
+ */
+
+/**
+ * Declaration of a protothread.
+ *
+ * This macro is used to declare a protothread. All protothreads must
+ * be declared with this macro.
+ *
+ * \param name_args The name and arguments of the C function
+ * implementing the protothread.
+ *
+ * \hideinitializer
+ */
+#define PT_THREAD(name_args) char name_args
+
+/**
+ * Declare the start of a protothread inside the C function
+ * implementing the protothread.
+ *
+ * This macro is used to declare the starting point of a
+ * protothread. It should be placed at the start of the function in
+ * which the protothread runs. All C statements above the PT_BEGIN()
+ * invokation will be executed each time the protothread is scheduled.
+ *
+ * \param pt A pointer to the protothread control structure.
+ *
+ * \hideinitializer
+ */
+#define PT_BEGIN(pt) { char PT_YIELD_FLAG = 1; LC_RESUME((pt)->lc)
+
+/**
+ * Declare the end of a protothread.
+ *
+ * This macro is used for declaring that a protothread ends. It must
+ * always be used together with a matching PT_BEGIN() macro.
+ *
+ * \param pt A pointer to the protothread control structure.
+ *
+ * \hideinitializer
+ */
+#define PT_END(pt) LC_END((pt)->lc); PT_YIELD_FLAG = 0; \
+                   PT_INIT(pt); return PT_ENDED; }
+
+/** @} */
+
+/**
+ * \name Blocked wait
+ * @{
+ */
+
+/**
+ * Block and wait until condition is true.
+ *
+ * This macro blocks the protothread until the specified condition is
+ * true.
+ *
+ * \param pt A pointer to the protothread control structure.
+ * \param condition The condition.
+ *
+ * \hideinitializer
+ */
+#define PT_WAIT_UNTIL(pt, condition)          \
+  do {            \
+    LC_SET((pt)->lc);       \
+    if(!(condition)) {        \
+      return PT_WAITING;      \
+    }           \
+  } while(0)
+
+/**
+ * Block and wait while condition is true.
+ *
+ * This function blocks and waits while condition is true. See
+ * PT_WAIT_UNTIL().
+ *
+ * \param pt A pointer to the protothread control structure.
+ * \param cond The condition.
+ *
+ * \hideinitializer
+ */
+#define PT_WAIT_WHILE(pt, cond)  PT_WAIT_UNTIL((pt), !(cond))
+
+/** @} */
+
+/**
+ * \name Hierarchical protothreads
+ * @{
+ */
+
+/**
+ * Block and wait until a child protothread completes.
+ *
+ * This macro schedules a child protothread. The current protothread
+ * will block until the child protothread completes.
+ *
+ * \note The child protothread must be manually initialized with the
+ * PT_INIT() function before this function is used.
+ *
+ * \param pt A pointer to the protothread control structure.
+ * \param thread The child protothread with arguments
+ *
+ * \sa PT_SPAWN()
+ *
+ * \hideinitializer
+ */
+#define PT_WAIT_THREAD(pt, thread) PT_WAIT_WHILE((pt), PT_SCHEDULE(thread))
+
+/**
+ * Spawn a child protothread and wait until it exits.
+ *
+ * This macro spawns a child protothread and waits until it exits. The
+ * macro can only be used within a protothread.
+ *
+ * \param pt A pointer to the protothread control structure.
+ * \param child A pointer to the child protothread's control structure.
+ * \param thread The child protothread with arguments
+ *
+ * \hideinitializer
+ */
+#define PT_SPAWN(pt, child, thread)   \
+  do {            \
+    PT_INIT((child));       \
+    PT_WAIT_THREAD((pt), (thread));   \
+  } while(0)
+
+/** @} */
+
+/**
+ * \name Exiting and restarting
+ * @{
+ */
+
+/**
+ * Restart the protothread.
+ *
+ * This macro will block and cause the running protothread to restart
+ * its execution at the place of the PT_BEGIN() call.
+ *
+ * \param pt A pointer to the protothread control structure.
+ *
+ * \hideinitializer
+ */
+#define PT_RESTART(pt)        \
+  do {            \
+    PT_INIT(pt);        \
+    return PT_WAITING;      \
+  } while(0)
+
+/**
+ * Exit the protothread.
+ *
+ * This macro causes the protothread to exit. If the protothread was
+ * spawned by another protothread, the parent protothread will become
+ * unblocked and can continue to run.
+ *
+ * \param pt A pointer to the protothread control structure.
+ *
+ * \hideinitializer
+ */
+#define PT_EXIT(pt)       \
+  do {            \
+    PT_INIT(pt);        \
+    return PT_EXITED;     \
+  } while(0)
+
+/** @} */
+
+/**
+ * \name Calling a protothread
+ * @{
+ */
+
+/**
+ * Schedule a protothread.
+ *
+ * This function shedules a protothread. The return value of the
+ * function is non-zero if the protothread is running or zero if the
+ * protothread has exited.
+ *
+ * \param f The call to the C function implementing the protothread to
+ * be scheduled
+ *
+ * \hideinitializer
+ */
+#define PT_SCHEDULE(f) ((f) < PT_EXITED)
+//#define PT_SCHEDULE(f) ((f))
+
+/** @} */
+
+/**
+ * \name Yielding from a protothread
+ * @{
+ */
+
+/**
+ * Yield from the current protothread.
+ *
+ * This function will yield the protothread, thereby allowing other
+ * processing to take place in the system.
+ *
+ * \param pt A pointer to the protothread control structure.
+ *
+ * \hideinitializer
+ */
+#define PT_YIELD(pt)        \
+  do {            \
+    PT_YIELD_FLAG = 0;        \
+    LC_SET((pt)->lc);       \
+    if(PT_YIELD_FLAG == 0) {      \
+      return PT_YIELDED;      \
+    }           \
+  } while(0)
+
+/**
+ * \brief      Yield from the protothread until a condition occurs.
+ * \param pt   A pointer to the protothread control structure.
+ * \param cond The condition.
+ *
+ *             This function will yield the protothread, until the
+ *             specified condition evaluates to true.
+ *
+ *             It returns PT_YIELDED when it first yields, and
+ *             PT_WAITING each time after that the condition is
+ *             still false (so the profiler can tell them apart).
+ *
+ * \hideinitializer
+ */
+
+#define PT_YIELD_UNTIL(pt, cond)    \
+  do {            \
+    PT_YIELD_FLAG = 0;        \
+    LC_SET((pt)->lc);       \
+    if((PT_YIELD_FLAG == 0) || !(cond)) { \
+      return PT_YIELD_FLAG ? PT_WAITING : PT_YIELDED; \
+    }           \
+  } while(0)
+
+/** @} */
+
+#endif /* __PT_H__ */
+
+#ifndef __PT_SEM_H__
+#define __PT_SEM_H__
+
+//#include "pt.h"
+
+struct pt_sem {
+  unsigned int count;
+};
+
+/**
+ * Initialize a semaphore
+ *
+ * This macro initializes a semaphore with a value for the
+ * counter. Internally, the semaphores use an "unsigned int" to
+ * represent the counter, and therefore the "count" argument should be
+ * within range of an unsigned int.
+ *
+ * \param s (struct pt_sem *) A pointer to the pt_sem struct
+ * representing the semaphore
+ *
+ * \param c (unsigned int) The initial count of the semaphore.
+ * \hide initializer
+ */
+// NOTE that the default semaphore is not
+// multi-core safe, but is OK one one core
+
+#define PT_SEM_INIT(s, c) (s)->count = c
+
+/**
+ * Wait for a semaphore
+ *
+ * This macro carries out the "wait" operation on the semaphore. The
+ * wait operation causes the protothread to block while the counter is
+ * zero. When the counter reaches a value larger than zero, the
+ * protothread will continue.
+ *
+ * \param pt (struct pt *) A pointer to the protothread (struct pt) in
+ * which the operation is executed.
+ *
+ * \param s (struct pt_sem *) A pointer to the pt_sem struct
+ * representing the semaphore
+ *
+ * \hideinitializer
+ */
+#define PT_SEM_WAIT(pt, s)  \
+  do {            \
+    PT_YIELD_UNTIL(pt, (s)->count > 0);   \
+    --(s)->count;       \
+  } while(0)
+
+/**
+ * Signal a semaphore
+ *
+ * This macro carries out the "signal" operation on the semaphore. The
+ * signal operation increments the counter inside the semaphore, which
+ * eventually will cause waiting protothreads to continue executing.
+ *
+ * \param pt (struct pt *) A pointer to the protothread (struct pt) in
+ * which the operation is executed.
+ *
+ * \param s (struct pt_sem *) A pointer to the pt_sem struct
+ * representing the semaphore
+ *
+ * \hideinitializer
+ */
+#define PT_SEM_SIGNAL(pt, s) ++(s)->count
+
+#endif /* __PT_SEM_H__ */
+
+//=====================================================================
+//=== BRL4 additions for rp2040 =======================================
+//=====================================================================
+
+// tells the SCHED_RATE scheduler when the running thread next needs to
+// run (defined with the scheduler below). Always 0, so it can sit in a
+// yield condition after the test it stands for.
+static int pt_wake_at(unsigned int wake_time) ;
+
+// macro to make a thread execution pause in usec
+// max time of about one hour
+#define PT_YIELD_usec(delay_time)  \
+    do { static unsigned int time_thread ;\
+    time_thread = timer_hw->timerawl + (unsigned int)delay_time ; \
+    pt_wake_at(time_thread) ; \
+    PT_YIELD_UNTIL(pt, (timer_hw->timerawl >= time_thread) || pt_wake_at(time_thread)); \
+    } while(0);
+
+// macro to return system time
+#define PT_GET_TIME_usec() (timer_hw->timerawl)
+
+// macros for interval yield
+// attempts to make interval equal to specified value
+#define PT_INTERVAL_INIT() static unsigned int pt_interval_marker
+//
+#define PT_YIELD_INTERVAL(interval_time)  \
+    do { \
+    pt_wake_at(pt_interval_marker) ; \
+    PT_YIELD_UNTIL(pt, (timer_hw->timerawl >= pt_interval_marker) || pt_wake_at(pt_interval_marker)); \
+    pt_interval_marker = timer_hw->timerawl + (unsigned int)interval_time; \
+    } while(0);
+//
+// =================================================================
+// core-safe semaphore based on hardware/sync library
+// a hardware spinlock to force core-safe alternation
+// NOTE that the default semaphore is not
+// multi-core safe, but is OK one one core
+// The SAFE versions work across cores, but have more overhead
+
+spin_lock_t * sem_lock ;
+
+// Under SCHED_RATE a thread waiting in PT_SEM_SAFE_WAIT is parked: it
+// isn't called again until a PT_SEM_SAFE_SIGNAL (from either core, or
+// an interrupt) sets pt_sem_kick, and the scheduler then checks the
+// semaphores its parked threads are waiting on. So a waiting thread
+// costs nothing, and an idle core stays asleep until it's signalled.
+// (Under round robin the wait polls, as before.) Both are defined with
+// the scheduler below; pt_sem_park is always 0, like pt_wake_at.
+static volatile char pt_sem_kick[2] ;
+static int pt_sem_park(struct pt_sem *s) ;
+
+#define PT_SEM_SAFE_INIT(s,c) do{ \
+  sem_lock = spin_lock_init(25); \
+  spin_lock_unsafe_blocking (sem_lock); \
+  (s)->count = c ; \
+  spin_unlock_unsafe (sem_lock); \
+} while(0)
+
+#define PT_SEM_SAFE_WAIT(pt,s)  do {  \
+    spin_lock_unsafe_blocking (sem_lock);   \
+    PT_YIELD_FLAG = 0;      \
+    LC_SET((pt)->lc);       \
+    if((PT_YIELD_FLAG == 0) || !((s)->count > 0 || pt_sem_park(s))) { \
+      spin_unlock_unsafe (sem_lock);  \
+      return PT_YIELD_FLAG ? PT_WAITING : PT_YIELDED; \
+    }   \
+    --(s)->count; \
+    spin_unlock_unsafe (sem_lock);  \
+  } while(0)
+
+// (the kick unparks waiters and the __sev() wakes the other core if
+// it's idle, see pt_sched_tickless)
+#define PT_SEM_SAFE_SIGNAL(pt,s) do{ \
+    spin_lock_unsafe_blocking (sem_lock); \
+    ++(s)->count ; \
+    spin_unlock_unsafe (sem_lock) ; \
+    pt_sem_kick[0] = pt_sem_kick[1] = 1 ; \
+    __sev() ; \
+} while(0)
+
+// ==================================================================
+// lock based directly on spin-lock hardware
+// core-safe lock based on hardware/sync library
+// a non-counting hardware spinlock to force core-safe signalling
+#define UNLOCKED 0
+#define LOCKED 1
+spin_lock_t * lock_lock ;
+// general pattern will be to lock lock_lock
+// do specific lock operation (on another spin_lock)
+// unlock lock_lock
+// NOTE vaild lock_num are from 26-31 total of SIX hardware locks!
+
+#define PT_LOCK_INIT(s,lock_num,lock_state) do{ \
+  lock_lock = spin_lock_init(24); \
+  spin_lock_unsafe_blocking (lock_lock); \
+  s = spin_lock_init((uint)lock_num); \
+  if(lock_state) spin_lock_unsafe_blocking (s); \
+  spin_unlock_unsafe (lock_lock) ; \
+} while(0)
+
+#define PT_LOCK_WAIT(pt,s)  do {  \
+  spin_lock_unsafe_blocking (lock_lock); \
+  PT_YIELD_FLAG = 0;        \
+  LC_SET((pt)->lc);       \
+  if((PT_YIELD_FLAG == 0) || !(is_spin_locked(s)==false)) { \
+      spin_unlock_unsafe (lock_lock) ; \
+      return PT_YIELD_FLAG ? PT_WAITING : PT_YIELDED; \
+  }           \
+  spin_lock_unsafe_blocking (s); \
+  spin_unlock_unsafe (lock_lock) ; \
+} while(0)
+
+#define PT_LOCK_RELEASE(s) do{ \
+    spin_unlock_unsafe (s) ; \
+} while(0)
+
+//====================================================================
+// Multicore communication via FIFO
+#define PT_FIFO_WRITE(data) do{ \
+    PT_YIELD_UNTIL(pt, multicore_fifo_wready()==true); \
+    multicore_fifo_push_blocking(data) ; \
+} while(0)
+
+#define PT_FIFO_READ(fifo_out)  \
+do{ \
+    PT_YIELD_UNTIL(pt, multicore_fifo_rvalid()==true); \
+    fifo_out = multicore_fifo_pop_blocking() ; \
+} while(0) 
+
+
+// clears OUTGOING FIFO for urrent core
+#define PT_FIFO_FLUSH do{ \
+    multicore_fifo_drain() ; \
+} while(0)
+
+//====================================================================
+// Single-producer, single-consumer rings between the cores
+// For handing over more than a 32-bit word at a time (a spectrum, a
+// block of IMU samples, a CAN frame). One core only ever puts, the other
+// only ever gets, so no lock is needed: the producer alone writes head
+// and the consumer alone writes tail, and both count up freely (the
+// slot is the count modulo the size, which must be a power of two).
+// The __dmb()s keep the slot's contents and its index update in order.
+// The slots are used in place, so nothing is copied unless you want it:
+//   PT_RING_DEFINE(name, type, n)  a ring of n (power of 2) slots of type
+//   pt_ring_put_ptr(&r)   next free slot, or NULL if full
+//   pt_ring_put_done(&r)  hands it to the consumer (and wakes its core)
+//   pt_ring_get_ptr(&r)   oldest full slot, or NULL if empty
+//   pt_ring_get_done(&r)  hands it back to the producer
+//   pt_ring_put(&r, &x) / pt_ring_get(&r, &x)  copy in or out, false if
+//                         the ring is full or empty
+//   PT_RING_WAIT_NOT_FULL(pt, &r) / PT_RING_WAIT_NOT_EMPTY(pt, &r)
+#include <string.h>
+struct pt_ring {
+  unsigned char *slots ;
+  unsigned int size ;   // slots, a power of 2
+  unsigned int width ;  // bytes per slot
+  volatile unsigned int head ; // slots ever put
+  volatile unsigned int tail ; // slots ever got
+} ;
+
+#define PT_RING_DEFINE(name, type, n) \
+  _Static_assert(((n) & ((n) - 1)) == 0, "pt_ring size must be a power of 2") ; \
+  static type name##_slots[n] ; \
+  struct pt_ring name = {(unsigned char *)name##_slots, (n), sizeof(type), 0, 0}
+
+static inline unsigned int pt_ring_count(struct pt_ring *r) {
+  return r->head - r->tail ;
+}
+
+static inline void *pt_ring_put_ptr(struct pt_ring *r) {
+  unsigned int head = r->head ;
+  if (head - r->tail >= r->size) return NULL ;
+  // don't fill the slot until the consumer is done reading it
+  __dmb() ;
+  return r->slots + (head & (r->size - 1)) * r->width ;
+}
+
+static inline void pt_ring_put_done(struct pt_ring *r) {
+  // the slot is written before the consumer can see it
+  __dmb() ;
+  r->head = r->head + 1 ;
+  // the SIO FIFO push would raise this event anyway; ending an idle
+  // WFE on the other core is all that's needed (see pt_sched_tickless)
+  __sev() ;
+}
+
+static inline void *pt_ring_get_ptr(struct pt_ring *r) {
+  unsigned int tail = r->tail ;
+  if (r->head == tail) return NULL ;
+  // don't read the slot before seeing that it's full
+  __dmb() ;
+  return r->slots + (tail & (r->size - 1)) * r->width ;
+}
+
+static inline void pt_ring_get_done(struct pt_ring *r) {
+  // the slot is read before the producer can reuse it
+  __dmb() ;
+  r->tail = r->tail + 1 ;
+  __sev() ;
+}
+
+static inline bool pt_ring_put(struct pt_ring *r, const void *x) {
+  void *slot = pt_ring_put_ptr(r) ;
+  if (!slot) return false ;
+  memcpy(slot, x, r->width) ;
+  pt_ring_put_done(r) ;
+  return true ;
+}
+
+static inline bool pt_ring_get(struct pt_ring *r, void *x) {
+  void *slot = pt_ring_get_ptr(r) ;
+  if (!slot) return false ;
+  memcpy(x, slot, r->width) ;
+  pt_ring_get_done(r) ;
+  return true ;
+}
+
+#define PT_RING_WAIT_NOT_FULL(pt, r) \
+  PT_YIELD_UNTIL(pt, pt_ring_count(r) < (r)->size)
+
+#define PT_RING_WAIT_NOT_EMPTY(pt, r) \
+  PT_YIELD_UNTIL(pt, pt_ring_count(r) > 0)
+
+//====================================================================
+// IMPROVED SCHEDULER 
+// === thread structures ===
+// thread control structs
+
+// A modified scheduler
+static struct pt pt_sched ;
+// second core
+static struct pt pt_sched1 ;
+
+// count of defined tasks
+int pt_task_count = 0 ;
+int pt_task_count1 = 0 ;
+
+// Per-thread profiling: with PT_PROFILE defined to 1, each call of a
+// thread is timed, and add protothread_pt_stats to print them
+#ifndef PT_PROFILE
+#define PT_PROFILE 0
+#endif
+
+// The task structure
+struct ptx {
+  struct pt pt;              // thread context
+  int num;                    // thread number
+  char (*pf)(struct pt *pt); // pointer to thread function
+  // used by SCHED_RATE
+  int priority;              // lowest number runs first
+  unsigned int period;       // least time between runs (usec), 0 for none
+  unsigned int wake;         // timerawl when it can next run
+  char wake_set;             // it set wake itself (PT_YIELD_usec)
+  char queued;               // it's in the SCHED_RATE queue
+  struct pt_sem *parked_on;  // SCHED_RATE: waiting on this semaphore
+  volatile char active;      // the slot holds a thread
+  const char *name;          // the thread function's name
+#if PT_PROFILE
+  // since the last pt_stats report
+  unsigned int calls;        // times called
+  unsigned int yields;       // returns from PT_YIELD..., having run
+  unsigned int waits;        // returns still waiting on a condition
+  unsigned int max_us;       // longest call
+  uint64_t total_us;         // time in all the calls
+#endif
+};
+
+// thread priorities for SCHED_RATE (any int will do)
+#define PT_PRIORITY_HIGH   0
+#define PT_PRIORITY_NORMAL 1
+#define PT_PRIORITY_LOW    2
+
+// === extended structure for scheduler ===============
+// an array of task structures per core. Define MAX_THREADS (both
+// cores) or MAX_THREADS1 (core 1) before including this file for more.
+#ifndef MAX_THREADS
+#define MAX_THREADS 10
+#endif
+#ifndef MAX_THREADS1
+#define MAX_THREADS1 MAX_THREADS
+#endif
+#if (MAX_THREADS > 255) || (MAX_THREADS1 > 255)
+#error "MAX_THREADS is at most 255"
+#endif
+static struct ptx pt_thread_list[MAX_THREADS];
+// core 1
+static struct ptx pt_thread_list1[MAX_THREADS1];
+
+// the thread tables, their sizes and counts by core (the count is one
+// past the last slot in use, so there may be free slots below it)
+static struct ptx * const pt_lists[2] = {pt_thread_list, pt_thread_list1} ;
+static const int pt_sizes[2] = {MAX_THREADS, MAX_THREADS1} ;
+static int * const pt_counts[2] = {&pt_task_count, &pt_task_count1} ;
+// set when a thread is added, for SCHED_RATE to queue it
+static volatile char pt_added[2] ;
+
+// returned by the pt_add functions when the table is full
+#define PT_NO_SLOT (-1)
+
+// see https://github.com/edartuz/c-ptx/tree/master/src
+// and the license above
+// add an entry to a core's thread list (name may be NULL), in the
+// first free slot. Returns the thread number, or PT_NO_SLOT.
+int pt_add_core(int core, char (*pf)(struct pt *pt), int priority, unsigned int period, const char *name) {
+  int *count = pt_counts[core] ;
+  int slot = 0 ;
+  while (slot < pt_sizes[core] && pt_lists[core][slot].active) slot++ ;
+  if (slot < pt_sizes[core]) {
+        // get the current thread table entry 
+    struct ptx *ptx = &pt_lists[core][slot];
+        // enter the tak data into the thread table
+    ptx->num   = slot;
+        // function pointer
+    ptx->pf    = pf;
+        // scheduling (ready at once)
+    ptx->priority = priority;
+    ptx->period = period;
+    ptx->wake = timer_hw->timerawl;
+    ptx->wake_set = 0;
+    ptx->name = name;
+#if PT_PROFILE
+    ptx->calls = ptx->yields = ptx->waits = ptx->max_us = 0;
+    ptx->total_us = 0;
+#endif
+    ptx->queued = 0;
+    ptx->parked_on = NULL;
+    //
+    PT_INIT( &ptx->pt );
+        // filled in before the scheduler can see it
+    __dmb();
+    ptx->active = 1;
+    if (slot >= *count) *count = slot + 1;
+    pt_added[core] = 1;
+        // return current entry
+        return slot;
+  }
+  return PT_NO_SLOT;
+}
+
+// add an entry to the thread list
+int pt_add( char (*pf)(struct pt *pt)) {
+  return pt_add_core(0, pf, PT_PRIORITY_NORMAL, 0, NULL) ;
+}
+
+// core 1 -- add an entry to the thread list
+int pt_add1( char (*pf)(struct pt *pt)) {
+  return pt_add_core(1, pf, PT_PRIORITY_NORMAL, 0, NULL) ;
+}
+
+/* Scheduler
+Copyright (c) 2014 edartuz
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+// === Scheduler Thread =================================================
+// update a 1 second tick counter
+// schedulser code was almost copied from
+// https://github.com/edartuz/c-ptx
+// see license above
+
+// choose schedule method
+#define SCHED_ROUND_ROBIN 0
+#define SCHED_RATE 1
+int pt_sched_method = SCHED_ROUND_ROBIN ;
+
+// === profiling ==========================================
+#if PT_PROFILE
+// set by protothread_pt_stats, for each scheduler to clear its own
+// threads' counts between calls
+static volatile char pt_profile_reset[2] ;
+
+static void pt_profile_check(int core) {
+  if (!pt_profile_reset[core]) return ;
+  struct ptx *ptx = pt_lists[core] ;
+  for (int i=0; i<*pt_counts[core]; i++, ptx++) {
+    if (!ptx->active) continue ;
+    ptx->calls = ptx->yields = ptx->waits = ptx->max_us = 0 ;
+    ptx->total_us = 0 ;
+  }
+  pt_profile_reset[core] = 0 ;
+}
+#else
+#define pt_profile_check(core)
+#endif
+
+// call a thread once, timing it if profiling
+static inline void pt_call(struct ptx *ptx) {
+#if PT_PROFILE
+  unsigned int start = timer_hw->timerawl ;
+  char r = (ptx->pf)(&ptx->pt) ;
+  unsigned int us = timer_hw->timerawl - start ;
+  ptx->calls++ ;
+  ptx->total_us += us ;
+  if (us > ptx->max_us) ptx->max_us = us ;
+  if (r == PT_WAITING) ptx->waits++ ;
+  else if (r == PT_YIELDED) ptx->yields++ ;
+#else
+  (ptx->pf)(&ptx->pt) ;
+#endif
+}
+
+// === SCHED_RATE =========================================
+// Each core keeps its threads in a queue sorted by wake time. The
+// threads that are due are at the front; of those, the one with the
+// lowest priority number runs (the longest-due on a tie, so threads of
+// one priority take turns). Threads that are asleep (PT_YIELD_usec,
+// PT_YIELD_INTERVAL) or waiting out their period aren't called at all.
+// A high priority thread that is always due (one polling with
+// PT_YIELD_UNTIL and no period) keeps lower ones from running, so give
+// those a period.
+// To use it, set pt_sched_method = SCHED_RATE before pt_schedule_start,
+// and add threads with pt_add_thread_rate(thread, priority, period)
+// (pt_add_thread gives PT_PRIORITY_NORMAL and no period).
+//
+// Tickless idle: with pt_sched_tickless set too, a core with no thread
+// due arms a timer alarm for the earliest wake time and sleeps in WFE
+// until it fires or something else wakes the core (any interrupt on
+// it, the other core's SIO FIFO write or __sev(), a PT_SEM_SAFE_SIGNAL).
+// Threads polling a condition set from another core need a period, or
+// the signal to __sev(). pt_idle_us[core] adds up the time asleep.
+int pt_sched_tickless = 0 ;
+volatile unsigned int pt_idle_us[2] ;
+
+// thread numbers in wake order, per core
+static unsigned char pt_queue0[MAX_THREADS], pt_queue1[MAX_THREADS1] ;
+static unsigned char * const pt_queue[2] = {pt_queue0, pt_queue1} ;
+static int pt_queue_count[2] ;
+// the thread each core is running
+static struct ptx * volatile pt_running[2] ;
+
+static int pt_wake_at(unsigned int wake_time) {
+  struct ptx *ptx = pt_running[get_core_num()] ;
+  if (ptx) {
+    ptx->wake = wake_time ;
+    ptx->wake_set = 1 ;
+  }
+  return 0 ;
+}
+
+// park the running thread until s is signalled. It's due again in
+// 2^30 usec (18 minutes) anyway, to look at s again in case.
+#define PT_PARK_USEC (1u << 30)
+static int pt_sem_park(struct pt_sem *s) {
+  struct ptx *ptx = pt_running[get_core_num()] ;
+  if (ptx && pt_sched_method == SCHED_RATE) {
+    ptx->parked_on = s ;
+    ptx->wake = timer_hw->timerawl + PT_PARK_USEC ;
+    ptx->wake_set = 1 ;
+  }
+  return 0 ;
+}
+
+// put thread i into a core's queue after every thread due no later
+static void pt_queue_insert(int core, int i) {
+  struct ptx *list = pt_lists[core] ;
+  unsigned char *q = pt_queue[core] ;
+  int k = pt_queue_count[core]++ ;
+  while (k > 0 && (int)(list[q[k-1]].wake - list[i].wake) > 0) {
+    q[k] = q[k-1] ;
+    k-- ;
+  }
+  q[k] = i ;
+  list[i].queued = 1 ;
+}
+
+// take the thread at position k out of a core's queue
+static void pt_queue_remove(int core, int k) {
+  unsigned char *q = pt_queue[core] ;
+  pt_lists[core][q[k]].queued = 0 ;
+  pt_queue_count[core]-- ;
+  for (; k<pt_queue_count[core]; k++) q[k] = q[k+1] ;
+}
+
+// === removing threads ===================================
+// pt_remove_thread(n) frees slot n of this core's table, so a thread
+// that's done (a short-lived worker) can make room for another. It is
+// never called again, and the slot is reused by the next pt_add on this
+// core. A thread can remove itself, with pt_remove_thread(pt_thread_id())
+// just before PT_EXIT. Only remove threads of the core you're on.
+// the number of the thread running on this core, or PT_NO_SLOT
+int pt_thread_id(void) {
+  struct ptx *ptx = pt_running[get_core_num()] ;
+  return ptx ? ptx->num : PT_NO_SLOT ;
+}
+
+// false if there's no thread n on this core
+bool pt_remove_thread(int n) {
+  int core = get_core_num() ;
+  int *count = pt_counts[core] ;
+  if (n < 0 || n >= *count || !pt_lists[core][n].active) return false ;
+  struct ptx *ptx = &pt_lists[core][n] ;
+  if (ptx->queued) {
+    int k = 0 ;
+    while (pt_queue[core][k] != n) k++ ;
+    pt_queue_remove(core, k) ;
+  }
+  ptx->active = 0 ;
+  while (*count > 0 && !pt_lists[core][*count - 1].active) (*count)-- ;
+  return true ;
+}
+
+// === jobs =================================================
+// A job is a function and an argument that runs to completion, for
+// splitting work (rows of a render, blocks of a filter) between cores
+// without deciding which core does what. pt_job_submit() puts a job at
+// the back of this core's queue. Each scheduler pass (round robin), or
+// each pass with no thread due (SCHED_RATE), runs one job: the newest
+// of its own, or failing that the oldest of the other core's. So a
+// core that has run out of work takes it from the one that hasn't.
+// Keep jobs short, since no thread on that core runs until one ends.
+// Each queue is guarded by a hardware spinlock, taken with interrupts
+// off, so jobs can also be submitted from an interrupt. The locks are
+// set up by the first pt_job_submit() (or pt_jobs_init()), so make that
+// on one core before the other starts submitting too.
+//   pt_job_submit(fn, arg)   false if this core's queue is full
+//   pt_jobs_pending()        jobs queued or running, on either core
+//   PT_YIELD_JOBS_DONE       yield until pt_jobs_pending() is 0
+#ifndef PT_JOB_QUEUE
+#define PT_JOB_QUEUE 32
+#endif
+typedef void (*pt_job_fn)(void *arg) ;
+struct pt_job_queue {
+  pt_job_fn fn[PT_JOB_QUEUE] ;
+  void *arg[PT_JOB_QUEUE] ;
+  int first ;                 // oldest job (others take from here)
+  volatile int count ;
+  spin_lock_t *lock ;
+} ;
+static struct pt_job_queue pt_jobs[2] ;
+// jobs submitted and not yet finished, under its own lock
+static volatile int pt_jobs_outstanding ;
+static spin_lock_t *pt_jobs_lock ;
+
+static void pt_jobs_init(void) {
+  if (pt_jobs_lock) return ;
+  pt_jobs[0].lock = spin_lock_init(next_striped_spin_lock_num()) ;
+  pt_jobs[1].lock = spin_lock_init(next_striped_spin_lock_num()) ;
+  pt_jobs_lock = spin_lock_init(next_striped_spin_lock_num()) ;
+}
+
+static void pt_jobs_count(int n) {
+  uint32_t save = spin_lock_blocking(pt_jobs_lock) ;
+  pt_jobs_outstanding += n ;
+  spin_unlock(pt_jobs_lock, save) ;
+}
+
+bool pt_job_submit(pt_job_fn fn, void *arg) {
+  pt_jobs_init() ;
+  struct pt_job_queue *q = &pt_jobs[get_core_num()] ;
+  // counted before anyone can take it
+  pt_jobs_count(1) ;
+  uint32_t save = spin_lock_blocking(q->lock) ;
+  bool ok = q->count < PT_JOB_QUEUE ;
+  if (ok) {
+    int k = (q->first + q->count) % PT_JOB_QUEUE ;
+    q->fn[k] = fn ;
+    q->arg[k] = arg ;
+    q->count++ ;
+  }
+  spin_unlock(q->lock, save) ;
+  if (!ok) pt_jobs_count(-1) ;
+  // wake the other core if it's idle, so it can take some
+  __sev() ;
+  return ok ;
+}
+
+int pt_jobs_pending(void) {
+  return pt_jobs_outstanding ;
+}
+
+#define PT_YIELD_JOBS_DONE PT_YIELD_UNTIL(pt, pt_jobs_pending() == 0)
+
+// run one job on this core, if there is one
+static bool pt_run_job(int core) {
+  pt_job_fn fn = NULL ;
+  void *arg = NULL ;
+  if (!pt_jobs_lock) return false ;
+  // own newest, else the other core's oldest
+  struct pt_job_queue *q = &pt_jobs[core] ;
+  uint32_t save ;
+  if (q->count) {
+    save = spin_lock_blocking(q->lock) ;
+    if (q->count) {
+      int k = (q->first + q->count - 1) % PT_JOB_QUEUE ;
+      fn = q->fn[k] ;
+      arg = q->arg[k] ;
+      q->count-- ;
+    }
+    spin_unlock(q->lock, save) ;
+  }
+  q = &pt_jobs[!core] ;
+  if (!fn && q->count) {
+    save = spin_lock_blocking(q->lock) ;
+    if (q->count) {
+      fn = q->fn[q->first] ;
+      arg = q->arg[q->first] ;
+      q->first = (q->first + 1) % PT_JOB_QUEUE ;
+      q->count-- ;
+    }
+    spin_unlock(q->lock, save) ;
+  }
+  if (!fn) return false ;
+  fn(arg) ;
+  pt_jobs_count(-1) ;
+  return true ;
+}
+
+// the alarm that ends each core's idle WFE
+static int pt_idle_alarm[2] = {-1, -1} ;
+
+// nothing to do but take the interrupt, which ends the WFE
+static void pt_idle_wake(uint alarm_num) {
+}
+
+// sleep until the first thread in the queue is due, or an event
+static void pt_sched_idle(int core) {
+  if (pt_idle_alarm[core] < 0) {
+    // claimed (and its interrupt enabled) on this core
+    pt_idle_alarm[core] = hardware_alarm_claim_unused(true) ;
+    hardware_alarm_set_callback(pt_idle_alarm[core], pt_idle_wake) ;
+  }
+  unsigned int now = timer_hw->timerawl ;
+  if (pt_queue_count[core] > 0) {
+    int wait = (int)(pt_lists[core][pt_queue[core][0]].wake - now) ;
+    if (wait <= 0) return ;
+    // true if that time has already passed
+    if (hardware_alarm_set_target(pt_idle_alarm[core], delayed_by_us(get_absolute_time(), wait))) return ;
+  }
+  __wfe() ;
+  pt_idle_us[core] += timer_hw->timerawl - now ;
+}
+
+// run (at most) one thread on this core
+static void pt_sched_rate_pass(int core) {
+  struct ptx *list = pt_lists[core] ;
+  unsigned char *q = pt_queue[core] ;
+  int k, best = -1 ;
+  pt_profile_check(core) ;
+  // threads added since the last pass join the queue
+  if (pt_added[core]) {
+    pt_added[core] = 0 ;
+    for (k=0; k<*pt_counts[core]; k++) {
+      if (list[k].active && !list[k].queued) pt_queue_insert(core, k) ;
+    }
+  }
+  // parked threads whose semaphore has been signalled are due now
+  unsigned int now = timer_hw->timerawl ;
+  if (pt_sem_kick[core]) {
+    pt_sem_kick[core] = 0 ;
+    for (k=0; k<pt_queue_count[core]; k++) {
+      struct ptx *p = &list[q[k]] ;
+      if (p->parked_on && p->parked_on->count > 0) {
+        // moving it reorders the queue, so start again
+        int i = q[k] ;
+        pt_queue_remove(core, k) ;
+        p->parked_on = NULL ;
+        p->wake = now ;
+        pt_queue_insert(core, i) ;
+        k = -1 ;
+      }
+    }
+  }
+  // the highest priority thread that's due
+  for (k=0; k<pt_queue_count[core] && (int)(list[q[k]].wake - now) <= 0; k++) {
+    if (best < 0 || list[q[k]].priority < list[q[best]].priority) best = k ;
+  }
+  if (best < 0) {
+    if (!pt_run_job(core) && pt_sched_tickless) pt_sched_idle(core) ;
+    return ;
+  }
+  struct ptx *ptx = &list[q[best]] ;
+  // take it out of the queue and run it
+  pt_queue_remove(core, best) ;
+  ptx->wake_set = 0 ;
+  ptx->parked_on = NULL ;
+  pt_running[core] = ptx ;
+  pt_call(ptx) ;
+  pt_running[core] = NULL ;
+  // unless it removed itself
+  if (!ptx->active || ptx->queued) return ;
+  // due again when it asked to be, but not within its period
+  if (!ptx->wake_set || (int)(ptx->wake - (now + ptx->period)) < 0) {
+    ptx->wake = now + ptx->period ;
+  }
+  pt_queue_insert(core, ptx->num) ;
+}
+
+static PT_THREAD (protothread_sched(struct pt *pt))
+{   
+    PT_BEGIN(pt);
+    static int i, rate;
+    
+    if (pt_sched_method==SCHED_ROUND_ROBIN){
+        while(1) {
+          // test stupid round-robin 
+          // on all defined threads
+          struct ptx *ptx = &pt_thread_list[0];
+          pt_profile_check(0) ;
+          // step thru all defined threads
+          // -- loop can have more than one initialization or increment/decrement, 
+          // -- separated using comma operator. But it can have only one condition.
+          for (i=0; i<pt_task_count; i++, ptx++ ){
+              // call thread function (if the slot's in use)
+              if (!ptx->active) continue ;
+              pt_running[0] = ptx ;
+              pt_call(ptx) ;
+          }
+          pt_running[0] = NULL ;
+          // and a job, if there is one
+          pt_run_job(0) ;
+          // Never yields! 
+          // NEVER exit while!
+        } // END WHILE(1)
+    } //end if (pt_sched_method==RR)       
+    else {
+        while(1) {
+          pt_sched_rate_pass(0) ;
+        }
+    }
+     
+    PT_END(pt);
+} // scheduler thread
+
+// ================================================
+// === second core scheduler
+static PT_THREAD (protothread_sched1(struct pt *pt))
+{   
+    PT_BEGIN(pt);
+    
+    static int i, rate;
+    
+    if (pt_sched_method==SCHED_ROUND_ROBIN){
+        while(1) {
+          // test stupid round-robin 
+          // on all defined threads
+          struct ptx *ptx = &pt_thread_list1[0];
+          pt_profile_check(1) ;
+          // step thru all defined threads
+          // -- loop can have more than one initialization or increment/decrement, 
+          // -- separated using comma operator. But it can have only one condition.
+          for (i=0; i<pt_task_count1; i++, ptx++ ){
+              // call thread function (if the slot's in use)
+              if (!ptx->active) continue ;
+              pt_running[1] = ptx ;
+              pt_call(ptx) ;
+          }
+          pt_running[1] = NULL ;
+          // and a job, if there is one
+          pt_run_job(1) ;
+          // Never yields! 
+          // NEVER exit while!
+        } // END WHILE(1)
+    } // end if(pt_sched_method==SCHED_ROUND_ROBIN)      
+    else {
+        while(1) {
+          pt_sched_rate_pass(1) ;
+        }
+    }
+     
+    PT_END(pt);
+} // scheduler1 thread
+
+// ========================================================
+// === package the schedulers =============================
+#define pt_schedule_start do{\
+  if(get_core_num()==1){ \
+    PT_INIT(&pt_sched1) ; \
+    PT_SCHEDULE(protothread_sched1(&pt_sched1));\
+  }  else {\
+    PT_INIT(&pt_sched) ;\
+    PT_SCHEDULE(protothread_sched(&pt_sched));\
+  }\
+} while(0) 
+
+// === package the add thread ==========================
+#define pt_add_thread(thread_name) \
+  pt_add_core(get_core_num(), thread_name, PT_PRIORITY_NORMAL, 0, #thread_name)
+
+// with a priority and a period (usec, or 0), for SCHED_RATE
+// (both give the thread number, or PT_NO_SLOT if the table is full)
+#define pt_add_thread_rate(thread_name, priority, period) \
+  pt_add_core(get_core_num(), thread_name, priority, period, #thread_name)
+
+// === profile report ==================================
+#if PT_PROFILE
+// Every PT_STATS_INTERVAL usec, prints each thread on both cores: calls,
+// how many of those ended in a yield after running and how many found
+// their wait condition still false, the mean and longest call, and the
+// share of the interval spent in it. Then the counts start again, so
+// "max" is the longest call in the last interval.
+//   pt_add_thread(protothread_pt_stats) ;
+#ifndef PT_STATS_INTERVAL
+#define PT_STATS_INTERVAL 2000000
+#endif
+static PT_THREAD (protothread_pt_stats(struct pt *pt))
+{
+    PT_BEGIN(pt);
+    static unsigned int last ;
+    static int core, i ;
+    last = timer_hw->timerawl ;
+    while(1) {
+      PT_YIELD_usec(PT_STATS_INTERVAL) ;
+      unsigned int now = timer_hw->timerawl ;
+      unsigned int span = now - last ;
+      last = now ;
+      printf("pt_stats over %u ms\ncore thread                     calls  yield   wait  avg_us  max_us  busy%%\n", span / 1000) ;
+      for (core=0; core<2; core++) {
+        struct ptx *ptx = pt_lists[core] ;
+        for (i=0; i<*pt_counts[core]; i++, ptx++) {
+          if (!ptx->active) continue ;
+          printf("%4d %-24.24s %7u %6u %6u %7u %7u %5u\n", core,
+                 ptx->name ? ptx->name : "?", ptx->calls, ptx->yields, ptx->waits,
+                 ptx->calls ? (unsigned int)(ptx->total_us / ptx->calls) : 0,
+                 ptx->max_us, (unsigned int)(ptx->total_us * 100 / span)) ;
+        }
+        pt_profile_reset[core] = 1 ;
+      }
+    }
+    PT_END(pt);
+}
+#endif
+
+// === serial input thread ================================
+// serial buffers
+#ifndef pt_buffer_size
+#define pt_buffer_size 100
+#endif
+char pt_serial_in_buffer[pt_buffer_size];
+char pt_serial_out_buffer[pt_buffer_size];
+// thread pointers
+static struct pt pt_serialin, pt_serialout ;
+// uart
+#define UART_ID uart0
+//
+#define pt_backspace 0x7f // make sure your backspace matches this!
+//
+static PT_THREAD (pt_serialin_polled(struct pt *pt)){
+    PT_BEGIN(pt);
+      static uint8_t ch ;
+      static int pt_current_char_count ;
+      // clear the string
+      memset(pt_serial_in_buffer, 0, pt_buffer_size);
+      pt_current_char_count = 0 ;
+      // clear uart fifo
+      while(uart_is_readable(UART_ID)){uart_getc(UART_ID);}
+      // build the output string
+      while(pt_current_char_count < pt_buffer_size) {   
+        PT_YIELD_UNTIL(pt, (int)uart_is_readable(UART_ID)) ;
+        //get the character and echo it back to terminal
+        // NOTE this assumes a human is typing!!
+        ch = uart_getc(UART_ID);
+        PT_YIELD_UNTIL(pt, (int)uart_is_writable(UART_ID)) ;
+        uart_putc(UART_ID, ch);
+        // check for <enter> or <backspace>
+        if (ch == '\r' ){
+          // <enter>> character terminates string,
+          // advances the cursor to the next line, then exits
+          pt_serial_in_buffer[pt_current_char_count] = 0 ;
+          PT_YIELD_UNTIL(pt, (int)uart_is_writable(UART_ID)) ;
+          uart_putc(UART_ID, '\n') ;
+          break ; 
+        }
+        // check fo ,backspace>
+        else if (ch == pt_backspace){
+          PT_YIELD_UNTIL(pt, (int)uart_is_writable(UART_ID)) ;
+          uart_putc(UART_ID, ' ') ;
+          PT_YIELD_UNTIL(pt, (int)uart_is_writable(UART_ID)) ;
+          uart_putc(UART_ID, pt_backspace) ;
+          //uart_putc(UART_ID, ' ') ;
+          // wipe a character from the output
+          pt_current_char_count-- ;
+          if (pt_current_char_count<0) {pt_current_char_count = 0 ;}
+        }
+        // must be a real character
+        else {
+          // build the output string
+          pt_serial_in_buffer[pt_current_char_count++] = ch ;
+        }
+      } // END WHILe
+      // kill this input thread, to allow spawning thread to execute
+    PT_EXIT(pt);
+  PT_END(pt);
+} // serial input thread
+
+// ================================================================
+// === serial output thread
+//
+int pt_serialout_polled(struct pt *pt)
+{
+    static int num_send_chars ;
+    PT_BEGIN(pt);
+    num_send_chars = 0;
+    while (pt_serial_out_buffer[num_send_chars] != 0){
+        PT_YIELD_UNTIL(pt, (int)uart_is_writable(UART_ID)) ;
+        uart_putc(UART_ID, pt_serial_out_buffer[num_send_chars]) ;
+        num_send_chars++;
+    }
+    // kill this output thread, to allow spawning thread to execute
+    PT_EXIT(pt);
+    // and indicate the end of the thread
+    PT_END(pt);
+}
+// ================================================================
+// === DMA serial
+// With PT_SERIAL_DMA defined to 1 (before this file is included, or as
+// a compile definition) serial_write and serial_read go through DMA
+// instead of polling UART_ID a character per scheduler pass.
+//  - Output is copied into a ring (2^PT_SERIAL_TX_BITS bytes) that a DMA
+//    channel sends to the UART, so serial_write only waits when the ring
+//    is full. pt_serial_dma_init() also points stdio at the ring, so
+//    printf costs a copy, not the time to send it.
+//  - Input is written by another DMA channel round a ring of
+//    2^PT_SERIAL_RX_BITS bytes, from which serial_read takes whatever
+//    has arrived each time it's called. Characters are never lost to the
+//    8-deep UART FIFO, only if more than the ring arrive unread.
+// DMA drains the UART's receive FIFO as soon as a character lands in it,
+// so the UART's receive timeout (its idle-line interrupt) never fires;
+// pt_serial_rx_count() and pt_serial_rx_idle_us() give the equivalent.
+// Call pt_serial_dma_init() after stdio_init_all(). It claims two DMA
+// channels (from lib/hw_claim) and shares DMA_IRQ_1 (with the VGA driver) on that core.
+// Write from one thread at a time (as with pt_serial_out_buffer), and
+// don't printf with interrupts off on that core once the ring is full.
+#ifndef PT_SERIAL_DMA
+#define PT_SERIAL_DMA 0
+#endif
+#if PT_SERIAL_DMA
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hw_claim.h"
+#include "pico/stdio/driver.h"
+#if LIB_PICO_STDIO_UART
+#include "pico/stdio_uart.h"
+#endif
+
+#ifndef PT_SERIAL_TX_BITS
+#define PT_SERIAL_TX_BITS 10
+#endif
+#ifndef PT_SERIAL_RX_BITS
+#define PT_SERIAL_RX_BITS 8
+#endif
+#define PT_SERIAL_TX_SIZE (1u << PT_SERIAL_TX_BITS)
+#define PT_SERIAL_RX_SIZE (1u << PT_SERIAL_RX_BITS)
+
+// the receive ring is aligned to its size for the DMA write ring
+static char pt_serial_tx[PT_SERIAL_TX_SIZE] ;
+static char pt_serial_rx[PT_SERIAL_RX_SIZE] __attribute__((aligned(PT_SERIAL_RX_SIZE))) ;
+// chars ever queued and ever sent, and the number being sent now
+static volatile unsigned int pt_serial_tx_head, pt_serial_tx_tail ;
+static unsigned int pt_serial_tx_sending ;
+// where the reader is in the receive ring, and when it last saw a char
+static unsigned int pt_serial_rx_tail, pt_serial_rx_seen ;
+static uint32_t pt_serial_rx_time ;
+static int pt_serial_tx_chan = -1, pt_serial_rx_chan = -1 ;
+// guards the transmit ring and starting its DMA
+static spin_lock_t *pt_serial_lock ;
+
+// send the oldest run of queued chars (up to the end of the ring), if
+// nothing is being sent. Called with pt_serial_lock held.
+static void pt_serial_tx_start(void) {
+  unsigned int first = pt_serial_tx_tail & (PT_SERIAL_TX_SIZE - 1) ;
+  unsigned int n = pt_serial_tx_head - pt_serial_tx_tail ;
+  if (pt_serial_tx_sending || n == 0) return ;
+  if (n > PT_SERIAL_TX_SIZE - first) n = PT_SERIAL_TX_SIZE - first ;
+  pt_serial_tx_sending = n ;
+  dma_channel_transfer_from_buffer_now(pt_serial_tx_chan, pt_serial_tx + first, n) ;
+}
+
+// DMA_IRQ_1 may be shared, so only our channels' bits are cleared
+static void pt_serial_dma_handler(void) {
+  uint32_t ints = dma_hw->ints1 & ((1u << pt_serial_tx_chan) | (1u << pt_serial_rx_chan)) ;
+  if (!ints) return ;
+  dma_hw->ints1 = ints ;
+  // the receive channel counts down from 2^32 - 1 chars, so roughly
+  // every four days at 115200 baud it's set going round again
+  if (ints & (1u << pt_serial_rx_chan)) {
+    dma_channel_set_trans_count(pt_serial_rx_chan, 0xFFFFFFFF, true) ;
+  }
+  if (ints & (1u << pt_serial_tx_chan)) {
+    uint32_t save = spin_lock_blocking(pt_serial_lock) ;
+    pt_serial_tx_tail += pt_serial_tx_sending ;
+    pt_serial_tx_sending = 0 ;
+    pt_serial_tx_start() ;
+    spin_unlock(pt_serial_lock, save) ;
+  }
+}
+
+// queue up to n chars to send, returning how many fitted
+static int pt_serial_put(const char *s, int n) {
+  uint32_t save = spin_lock_blocking(pt_serial_lock) ;
+  unsigned int room = PT_SERIAL_TX_SIZE - (pt_serial_tx_head - pt_serial_tx_tail) ;
+  if ((unsigned int)n > room) n = room ;
+  for (int i=0; i<n; i++) {
+    pt_serial_tx[(pt_serial_tx_head + i) & (PT_SERIAL_TX_SIZE - 1)] = s[i] ;
+  }
+  pt_serial_tx_head += n ;
+  pt_serial_tx_start() ;
+  spin_unlock(pt_serial_lock, save) ;
+  return n ;
+}
+
+// chars received and not yet read
+static unsigned int pt_serial_rx_count(void) {
+  unsigned int head = dma_hw->ch[pt_serial_rx_chan].write_addr - (uint32_t)pt_serial_rx ;
+  unsigned int n = (head - pt_serial_rx_tail) & (PT_SERIAL_RX_SIZE - 1) ;
+  if (head != pt_serial_rx_seen) {
+    pt_serial_rx_seen = head ;
+    pt_serial_rx_time = time_us_32() ;
+  }
+  return n ;
+}
+
+// time since a char last arrived (as of the last pt_serial_rx_count())
+static uint32_t pt_serial_rx_idle_us(void) {
+  pt_serial_rx_count() ;
+  return time_us_32() - pt_serial_rx_time ;
+}
+
+// next received char, or -1 if there isn't one
+static int pt_serial_getc(void) {
+  if (pt_serial_rx_count() == 0) return -1 ;
+  char ch = pt_serial_rx[pt_serial_rx_tail & (PT_SERIAL_RX_SIZE - 1)] ;
+  pt_serial_rx_tail++ ;
+  return (unsigned char)ch ;
+}
+
+// stdio (printf, getchar) through the same rings
+static void pt_serial_out_chars(const char *buf, int len) {
+  while (len > 0) {
+    int n = pt_serial_put(buf, len) ;
+    buf += n ;
+    len -= n ;
+  }
+}
+
+static int pt_serial_in_chars(char *buf, int len) {
+  int n = 0 ;
+  int ch ;
+  while ((n < len) && ((ch = pt_serial_getc()) >= 0)) buf[n++] = ch ;
+  return n ? n : PICO_ERROR_NO_DATA ;
+}
+
+static stdio_driver_t pt_serial_stdio = {
+  .out_chars = pt_serial_out_chars,
+  .in_chars = pt_serial_in_chars,
+#if PICO_STDIO_ENABLE_CRLF_SUPPORT
+  .crlf_enabled = PICO_STDIO_DEFAULT_CRLF
+#endif
+} ;
+
+void pt_serial_dma_init(void) {
+  if (pt_serial_lock) return ;
+  pt_serial_lock = spin_lock_init(next_striped_spin_lock_num()) ;
+  pt_serial_tx_chan = hw_claim_dma("pt_serial") ;
+  pt_serial_rx_chan = hw_claim_dma("pt_serial") ;
+
+  // transmit: bytes from the ring to the UART, paced by its TX DREQ
+  dma_channel_config c = dma_channel_get_default_config(pt_serial_tx_chan) ;
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8) ;
+  channel_config_set_read_increment(&c, true) ;
+  channel_config_set_write_increment(&c, false) ;
+  channel_config_set_dreq(&c, uart_get_dreq(UART_ID, true)) ;
+  dma_channel_configure(pt_serial_tx_chan, &c, &uart_get_hw(UART_ID)->dr, pt_serial_tx, 0, false) ;
+
+  // receive: bytes from the UART round the ring, paced by its RX DREQ
+  c = dma_channel_get_default_config(pt_serial_rx_chan) ;
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_8) ;
+  channel_config_set_read_increment(&c, false) ;
+  channel_config_set_write_increment(&c, true) ;
+  channel_config_set_ring(&c, true, PT_SERIAL_RX_BITS) ;
+  channel_config_set_dreq(&c, uart_get_dreq(UART_ID, false)) ;
+  // whatever is already in the UART FIFO is dropped
+  while (uart_is_readable(UART_ID)) uart_getc(UART_ID) ;
+  dma_channel_configure(pt_serial_rx_chan, &c, pt_serial_rx, &uart_get_hw(UART_ID)->dr, 0xFFFFFFFF, true) ;
+  pt_serial_rx_time = time_us_32() ;
+
+  // the UART raises its DREQs only with DMA enabled
+  hw_set_bits(&uart_get_hw(UART_ID)->dmacr, UART_UARTDMACR_TXDMAE_BITS | UART_UARTDMACR_RXDMAE_BITS) ;
+
+  dma_channel_set_irq1_enabled(pt_serial_tx_chan, true) ;
+  dma_channel_set_irq1_enabled(pt_serial_rx_chan, true) ;
+  irq_add_shared_handler(DMA_IRQ_1, pt_serial_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY) ;
+  irq_set_enabled(DMA_IRQ_1, true) ;
+
+  // printf now queues as well, rather than waiting on the UART
+#if LIB_PICO_STDIO_UART
+  stdio_set_driver_enabled(&stdio_uart, false) ;
+#endif
+  stdio_set_driver_enabled(&pt_serial_stdio, true) ;
+}
+
+// wait (without yielding if there's no need) until ch is queued
+#define PT_SERIAL_PUTC(pt, ch) PT_WAIT_UNTIL(pt, pt_serial_put(&(ch), 1) == 1)
+
+static PT_THREAD (pt_serialin_dma(struct pt *pt)){
+    PT_BEGIN(pt);
+      static char ch ;
+      static char echo ;
+      static int pt_current_char_count ;
+      pt_serial_dma_init() ;
+      // clear the string
+      memset(pt_serial_in_buffer, 0, pt_buffer_size);
+      pt_current_char_count = 0 ;
+      // drop anything typed before now
+      pt_serial_rx_tail += pt_serial_rx_count() ;
+      // build the output string from whatever has arrived, yielding
+      // only when there's nothing more to read (or the echo is held up)
+      while(pt_current_char_count < pt_buffer_size) {
+        PT_WAIT_UNTIL(pt, pt_serial_rx_count() > 0) ;
+        // NOTE this assumes a human is typing!! (it echoes)
+        ch = pt_serial_getc() ;
+        PT_SERIAL_PUTC(pt, ch) ;
+        if (ch == '\r' ){
+          // <enter> terminates the string, on a new line
+          pt_serial_in_buffer[pt_current_char_count] = 0 ;
+          echo = '\n' ;
+          PT_SERIAL_PUTC(pt, echo) ;
+          break ;
+        }
+        else if (ch == pt_backspace){
+          echo = ' ' ;
+          PT_SERIAL_PUTC(pt, echo) ;
+          echo = pt_backspace ;
+          PT_SERIAL_PUTC(pt, echo) ;
+          pt_current_char_count-- ;
+          if (pt_current_char_count<0) {pt_current_char_count = 0 ;}
+        }
+        else {
+          pt_serial_in_buffer[pt_current_char_count++] = ch ;
+        }
+      }
+    PT_EXIT(pt);
+  PT_END(pt);
+}
+
+int pt_serialout_dma(struct pt *pt)
+{
+    static int num_send_chars, len ;
+    PT_BEGIN(pt);
+    pt_serial_dma_init() ;
+    len = strlen(pt_serial_out_buffer) ;
+    num_send_chars = pt_serial_put(pt_serial_out_buffer, len) ;
+    // only waits if the ring is full
+    while (num_send_chars < len) {
+        PT_YIELD(pt) ;
+        num_send_chars += pt_serial_put(pt_serial_out_buffer + num_send_chars, len - num_send_chars) ;
+    }
+    PT_EXIT(pt);
+    PT_END(pt);
+}
+#endif // PT_SERIAL_DMA
+
+// ================================================================
+// package the spawn read/write macros to make them look better
+#if PT_SERIAL_DMA
+#define serial_write do{PT_SPAWN(pt,&pt_serialout,pt_serialout_dma(&pt_serialout));}while(0)
+#define serial_read  do{PT_SPAWN(pt,&pt_serialin,pt_serialin_dma(&pt_serialin));}while(0)
+#else
+#define serial_write do{PT_SPAWN(pt,&pt_serialout,pt_serialout_polled(&pt_serialout));}while(0)
+#define serial_read  do{PT_SPAWN(pt,&pt_serialin,pt_serialin_polled(&pt_serialin));}while(0)
+#endif
+//
+// ======
+// END
+// ======
\ No newline at end of file
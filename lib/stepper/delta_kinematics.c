@@ -0,0 +1,96 @@
+/*
+* Delta inverse kinematics. Each arm is solved in its own y-z plane (the
+* target rotated round to motor 0's): the elbow is on the circle the
+* upper arm sweeps about the motor shaft, and on the sphere of the lower
+* arm's length about the effector's corner. Where they meet is a
+* quadratic in y, and the outer root is the elbow.
+*/
+
+#include <math.h>
+#include "pico/stdlib.h"
+#include "stepper_motion.h"
+#include "delta_kinematics.h"
+
+#define TAN30 0.57735027f
+#define COS120 -0.5f
+#define SIN120 0.86602540f
+
+// One arm, in its own plane. Returns -1 if the arms can't meet.
+static int armAngle(const delta_geometry * g, float x0, float y0, float z0, float * theta) {
+    float y1 = -0.5f * TAN30 * g->base ;        // the motor shaft
+    y0 -= 0.5f * TAN30 * g->effector ;          // the effector's corner
+    if (z0 == 0.0f) return -1 ;
+
+    // The elbow is on the line z = a + b y
+    float a = (x0 * x0 + y0 * y0 + z0 * z0 + g->upper * g->upper - g->lower * g->lower - y1 * y1) / (2.0f * z0) ;
+    float b = (y1 - y0) / z0 ;
+    float d = -(a + b * y1) * (a + b * y1) + g->upper * (b * b * g->upper + g->upper) ;
+    if (d < 0.0f) return -1 ;
+
+    float yj = (y1 - a * b - sqrtf(d)) / (b * b + 1.0f) ;
+    float zj = a + b * yj ;
+    *theta = atan2f(-zj, y1 - yj) ;
+    return 0 ;
+}
+
+int delta_inverse(const delta_geometry * g, float x, float y, float z, float * theta) {
+    if (armAngle(g, x, y, z, &theta[0])) return -1 ;
+    if (armAngle(g, x * COS120 + y * SIN120, y * COS120 - x * SIN120, z, &theta[1])) return -1 ;
+    if (armAngle(g, x * COS120 - y * SIN120, y * COS120 + x * SIN120, z, &theta[2])) return -1 ;
+    return 0 ;
+}
+
+int delta_init(delta_robot * r, const delta_geometry * g, float x, float y, float z) {
+    r->geometry = g ;
+    r->x = x ;
+    r->y = y ;
+    r->z = z ;
+    if (r->max_rate <= 0.0f) r->max_rate = 900.0f ;
+    return delta_inverse(g, x, y, z, r->zero) ;
+}
+
+// Motor steps for the effector at x, y, z
+static int toSteps(const delta_robot * r, float x, float y, float z, int * steps) {
+    float theta[3] ;
+    if (delta_inverse(r->geometry, x, y, z, theta)) return -1 ;
+    for (int a=0; a<3; a++) {
+        steps[a] = (int)lroundf((theta[a] - r->zero[a]) * r->geometry->steps_per_radian) ;
+    }
+    return 0 ;
+}
+
+int delta_move_to(delta_robot * r, float x, float y, float z, float speed) {
+    float dx = x - r->x, dy = y - r->y, dz = z - r->z ;
+    float length = sqrtf(dx * dx + dy * dy + dz * dz) ;
+    int pieces = (int)ceilf(length / DELTA_SEGMENT_MM) ;
+    if ((pieces < 1) || (speed <= 0.0f)) return 0 ;
+
+    // Axes past the three arms (MOTION_AXES raised for others) stay put
+    int target[MOTION_AXES] ;
+    for (int a=3; a<MOTION_AXES; a++) target[a] = motion_planned(a) ;
+
+    // Check the whole line first
+    for (int i=1; i<=pieces; i++) {
+        float u = (float)i / (float)pieces ;
+        if (toSteps(r, r->x + u * dx, r->y + u * dy, r->z + u * dz, target)) return -1 ;
+    }
+
+    float seconds = length / (speed * (float)pieces) ;
+    for (int i=1; i<=pieces; i++) {
+        float u = (float)i / (float)pieces ;
+        toSteps(r, r->x + u * dx, r->y + u * dy, r->z + u * dz, target) ;
+
+        // No faster than max_rate on any axis
+        float t = seconds ;
+        for (int a=0; a<3; a++) {
+            int d = target[a] - motion_planned(a) ;
+            float need = (float)((d < 0) ? -d : d) / r->max_rate ;
+            if (need > t) t = need ;
+        }
+        motion_queue_timed(target, t) ;
+    }
+    r->x = x ;
+    r->y = y ;
+    r->z = z ;
+    return 0 ;
+}
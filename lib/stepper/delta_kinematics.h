@@ -0,0 +1,58 @@
+/**
+ * Delta robot inverse kinematics, and straight-line moves on the motion
+ * queue
+ *
+ * The robot is three motors at the corners of the base triangle, each
+ * turning an upper arm, with parallelogram lower arms down to the
+ * effector triangle. Coordinates are in mm, with the origin at the middle
+ * of the base and z negative below it. Motor 0's arm swings in the y-z
+ * plane on the -y side, and motors 1 and 2 are 120 and 240 degrees round
+ * from it. Arm angles are in radians, 0 horizontal and positive down.
+ *
+ * A straight line in space isn't one in joint space, so delta_move_to()
+ * splits each line into short pieces (DELTA_SEGMENT_MM) and queues each
+ * as a motion segment (stepper_motion.h), whose axes are all paced to
+ * finish it together. The queue's lookahead runs the pieces of a line
+ * into each other at full speed, and slows only for the corners.
+ *
+ * USE
+ *  - Fill in a delta_geometry for the robot
+ *  - delta_init(&robot, &geometry, x, y, z), with the effector at x, y,
+ *    z and every motor at step 0
+ *  - delta_move_to(&robot, x, y, z, speed) queues a line there at
+ *    'speed' mm/s, slower where an axis would go over robot.max_rate
+ *    steps/s. It returns -1, and queues nothing, if any of the line is
+ *    out of reach.
+ *
+ */
+
+#ifndef DELTA_KINEMATICS_H
+#define DELTA_KINEMATICS_H
+
+// Longest piece of a line (mm, build-time)
+#ifndef DELTA_SEGMENT_MM
+#define DELTA_SEGMENT_MM 2.0f
+#endif
+
+typedef struct {
+    float base ;                    // side of the base triangle (mm)
+    float effector ;                // side of the effector triangle
+    float upper ;                   // upper arm, motor shaft to elbow
+    float lower ;                   // lower arm, elbow to effector
+    float steps_per_radian ;        // negative if a positive step raises the arm
+} delta_geometry ;
+
+typedef struct {
+    const delta_geometry * geometry ;
+    float zero[3] ;                 // arm angles at step 0
+    float x, y, z ;                 // where the queue ends
+    float max_rate ;                // fastest an axis may step (steps/s)
+} delta_robot ;
+
+// Arm angles for the effector at x, y, z. Returns -1 if it can't get there.
+int delta_inverse(const delta_geometry * g, float x, float y, float z, float * theta) ;
+
+int delta_init(delta_robot * r, const delta_geometry * g, float x, float y, float z) ;
+int delta_move_to(delta_robot * r, float x, float y, float z, float speed) ;
+
+#endif
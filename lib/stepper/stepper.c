@@ -0,0 +1,368 @@
+/*
+* Stepper motors. Each step is one word to the motor's state machine, its
+* pause and its coil pattern together. For a move at one speed the CPU
+* fills an 8-word ring for the motor, the half-step table (forward,
+* backward or all off) with the pause in each word, and the motor's DMA
+* channel starts at the word after the motor's position and wraps round
+* it; the motion queue sends a word per step from a table instead. A
+* move's count goes in only once the last move's words have all been
+* sent, so the two never interleave in the FIFO. The motor raises its IRQ
+* flag at the end of each move, and the ISR records where it is and calls
+* its callback.
+* At each step the state machine pushes its count down, and a second
+* channel copies it to the motor's countdown, so the position can be read
+* mid-move without an interrupt per step.
+* Microstepping motors' coils are PWM outputs instead. The count-down
+* channel chains on to one channel per slice, which writes the slice's
+* two duties (one compare word) from a table of the electrical cycle,
+* then chains back to wait for the next push.
+*/
+
+#include <math.h>
+#include "pico/stdlib.h"
+#include "pico/sync.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/pwm.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hotpath.h"
+#include "hw_claim.h"
+#include "stepper.h"
+#include "stepper.pio.h"
+
+// Half-step coil patterns, forward and backward (each the other reversed),
+// and all off
+const unsigned char stepper_forward[8] = {0x9, 0x8, 0xc, 0x4, 0x6, 0x2, 0x3, 0x1} ;
+static const unsigned char stepper_backward[8] = {0x1, 0x3, 0x2, 0x6, 0x4, 0xc, 0x8, 0x9} ;
+static const unsigned char stepper_off[8] = {0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x0} ;
+
+// Each motor's ring of step words, by PIO and state machine, aligned for
+// the DMA read ring
+static uint32_t stepper_words[2][4][8] __attribute__((aligned(32))) ;
+
+// Microsteps an electrical cycle (four full steps), and the size of a
+// table of them in bytes, as a read ring
+#define MICRO_PERIOD (4 * STEPPER_MICROSTEPS)
+#define MICRO_MASK (MICRO_PERIOD - 1)
+#define MICRO_RING_BITS ((STEPPER_MICROSTEPS == 16) ? 8 : (STEPPER_MICROSTEPS == 32) ? 9 : 10)
+
+// Compare words for the first slice (IN2 and IN1) and the second (IN4 and
+// IN3) at each microstep, forward and backward, and all off. Microstep
+// q * STEPPER_MICROSTEPS / 2 is half step q.
+static uint32_t micro_a[2][MICRO_PERIOD] __attribute__((aligned(MICRO_PERIOD * 4))) ;
+static uint32_t micro_b[2][MICRO_PERIOD] __attribute__((aligned(MICRO_PERIOD * 4))) ;
+static uint32_t micro_off[MICRO_PERIOD] __attribute__((aligned(MICRO_PERIOD * 4))) ;
+static unsigned int micro_top = 0 ;
+
+// Motors by PIO and state machine
+static stepper_t * stepper_motors[2][4] ;
+
+// Where each PIO's copies of the programs are, once loaded
+static int table_offset[2] = {-1, -1} ;
+static int micro_offset[2] = {-1, -1} ;
+
+// Load a program on a PIO, once. False if there isn't room for it.
+static bool loadProgram(PIO pio, const pio_program_t * program, int * offset) {
+    int index = pio_get_index(pio) ;
+    if (offset[index] < 0) offset[index] = hw_add_program_try(pio, program, "stepper") ;
+    return offset[index] >= 0 ;
+}
+
+// A motor has finished a move. Both PIOs' IRQs come here, and each
+// checks every motor (motors in the motion queue are its ISR's). The
+// next move's count down starts before the state machine can take it.
+static void HOT_ISR(stepper_irq)() {
+    for (int p=0; p<2; p++) {
+        for (int sm=0; sm<4; sm++) {
+            stepper_t * m = stepper_motors[p][sm] ;
+            if (!m || m->motion || !pio_interrupt_get(m->pio, sm)) continue ;
+            m->position = m->ends[m->finished % STEPPER_MOVES] ;
+            m->finished++ ;
+            if (m->queued != m->finished) m->countdown = m->counts[m->finished % STEPPER_MOVES] + 1 ;
+            pio_interrupt_clear(m->pio, sm) ;
+            if (m->done) m->done(m) ;
+        }
+    }
+}
+
+bool stepper_init(stepper_t * motor, unsigned int pin) {
+    // A state machine, on pio1 first since the VGA driver uses pio0
+    PIO pios[2] = {pio1, pio0} ;
+    int sm = -1 ;
+    PIO pio = NULL ;
+    for (int i=0; (i<2) && (sm < 0); i++) {
+        if (!loadProgram(pios[i], &stepper_table_program, table_offset)) continue ;
+        sm = hw_claim_sm_try(pios[i], "stepper") ;
+        pio = pios[i] ;
+        // The program's "irq wait 0 rel" is flag sm
+        if ((sm >= 0) && !hw_claim_pio_irq_try(pio, sm, "stepper")) {
+            hw_unclaim_sm(pio, sm) ;
+            sm = -1 ;
+        }
+    }
+    if (sm < 0) return false ;
+    int chan = hw_claim_dma_try("stepper") ;
+    int count_chan = (chan < 0) ? -1 : hw_claim_dma_try("stepper") ;
+    if (count_chan < 0) {
+        hw_unclaim_dma(chan) ;
+        hw_unclaim_pio_irq(pio, sm) ;
+        hw_unclaim_sm(pio, sm) ;
+        return false ;
+    }
+    int index = pio_get_index(pio) ;
+
+    motor->pio = pio ;
+    motor->sm = sm ;
+    motor->pin = pin ;
+    motor->chan = chan ;
+    motor->count_chan = count_chan ;
+    motor->micro = 0 ;
+    motor->countdown = 1 ;
+    motor->position = 0 ;
+    motor->planned = 0 ;
+    motor->queued = 0 ;
+    motor->finished = 0 ;
+    motor->done = NULL ;
+    motor->motion = 0 ;
+    stepper_set_speed(motor, 500.0f) ;
+
+    stepper_table_program_init(pio, sm, table_offset[index], pin) ;
+    pio_interrupt_clear(pio, sm) ;
+    pio_set_irq0_source_enabled(pio, pis_interrupt0 + sm, true) ;
+    pio_sm_set_enabled(pio, sm, true) ;
+
+    // Step words (wrapping round the motor's 32-byte ring)
+    dma_channel_config c0 = dma_channel_get_default_config(chan);   // default configs
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_32);        // 32-bit txfers
+    channel_config_set_read_increment(&c0, true);                   // yes read incrementing
+    channel_config_set_write_increment(&c0, false);                 // no write incrementing
+    channel_config_set_ring(&c0, false, 5);                         // wrap the read address (8 words)
+    channel_config_set_dreq(&c0, pio_get_dreq(pio, sm, true));      // TX FIFO pacing
+    dma_channel_configure(chan, &c0, &pio->txf[sm], stepper_words[index][sm], 0, false) ;
+
+    // Count down, from the RX FIFO to RAM, for as long as it runs
+    dma_channel_config c1 = dma_channel_get_default_config(count_chan);    // default configs
+    channel_config_set_transfer_data_size(&c1, DMA_SIZE_32);               // 32-bit txfers
+    channel_config_set_read_increment(&c1, false);                         // no read incrementing
+    channel_config_set_write_increment(&c1, false);                        // no write incrementing
+    channel_config_set_dreq(&c1, pio_get_dreq(pio, sm, false));            // RX FIFO pacing
+    dma_channel_configure(count_chan, &c1, &motor->countdown, &pio->rxf[sm], 0xFFFFFFFF, true) ;
+
+    // First motor on this PIO: take its IRQ
+    bool first = true ;
+    for (int i=0; i<4; i++) {
+        if (stepper_motors[index][i]) first = false ;
+    }
+    stepper_motors[index][sm] = motor ;
+    if (first) {
+        irq_add_shared_handler(index ? PIO1_IRQ_0 : PIO0_IRQ_0, stepper_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY) ;
+        irq_set_enabled(index ? PIO1_IRQ_0 : PIO0_IRQ_0, true) ;
+    }
+    return true ;
+}
+
+// The pause has 28 bits in a step word
+void stepper_set_speed(stepper_t * motor, float steps_per_second) {
+    float cycles = (steps_per_second > 0.0f) ? (float)clock_get_hz(clk_sys) / steps_per_second : (float)STEPPER_MAX_PAUSE ;
+    if (cycles > (float)STEPPER_MAX_PAUSE) cycles = (float)STEPPER_MAX_PAUSE ;
+    motor->pause = (cycles > STEPPER_STEP_OVERHEAD) ? (unsigned int)cycles - STEPPER_STEP_OVERHEAD : 0 ;
+}
+
+void stepper_on_done(stepper_t * motor, stepper_callback_t callback) {
+    motor->done = callback ;
+}
+
+bool stepper_busy(const stepper_t * motor) {
+    return motor->queued != motor->finished ;
+}
+
+// Steps taken of the move under way (0 if there isn't one), from its
+// count down. Called with interrupts off.
+static unsigned int stepsTaken(const stepper_t * motor) {
+    if (motor->queued == motor->finished) return 0 ;
+    int n = motor->counts[motor->finished % STEPPER_MOVES] ;
+    int taken = n + 1 - (int)motor->countdown ;
+    return (taken < 0) ? 0 : (taken > n) ? n : taken ;
+}
+
+int stepper_get_position(const stepper_t * motor) {
+    uint32_t save = save_and_disable_interrupts() ;
+    int from = motor->position ;
+    int to = (motor->queued != motor->finished) ? motor->ends[motor->finished % STEPPER_MOVES] : from ;
+    int taken = stepsTaken(motor) ;
+    restore_interrupts(save) ;
+    return (to > from) ? from + taken : (to < from) ? from - taken : from ;
+}
+
+unsigned int stepper_steps_left(const stepper_t * motor) {
+    uint32_t save = save_and_disable_interrupts() ;
+    unsigned int left = 0 ;
+    if (motor->queued != motor->finished) left = motor->counts[motor->finished % STEPPER_MOVES] - stepsTaken(motor) ;
+    restore_interrupts(save) ;
+    return left ;
+}
+
+// Count a move of n steps in, ending at 'end', and send the state machine
+// its count (and, microstepping, its pause)
+static void sendMove(stepper_t * motor, unsigned int n, int end) {
+    uint32_t save = save_and_disable_interrupts() ;
+    if (motor->queued == motor->finished) motor->countdown = n + 1 ;
+    motor->ends[motor->queued % STEPPER_MOVES] = end ;
+    motor->counts[motor->queued % STEPPER_MOVES] = n ;
+    motor->planned = end ;
+    motor->queued++ ;
+    restore_interrupts(save) ;
+    pio_sm_put_blocking(motor->pio, motor->sm, n) ;
+    if (motor->micro) pio_sm_put_blocking(motor->pio, motor->sm, motor->pause) ;
+}
+
+// Queue n steps of the patterns in 'table' from entry 'first' on
+static void queueMove(stepper_t * motor, const unsigned char * table, int first, unsigned int n, int end) {
+    while (dma_channel_is_busy(motor->chan) || (motor->queued - motor->finished >= STEPPER_MOVES)) {
+        tight_loop_contents() ;
+    }
+    uint32_t * words = stepper_words[pio_get_index(motor->pio)][motor->sm] ;
+    for (int i=0; i<8; i++) {
+        words[i] = ((uint32_t)table[i] << 28) | motor->pause ;
+    }
+    sendMove(motor, n, end) ;
+    dma_channel_transfer_from_buffer_now(motor->chan, &words[first & 7], n) ;
+}
+
+// Queue n microsteps of duties from the slices' tables at a and b, once
+// the chain is done with the last move
+static void queueMicro(stepper_t * motor, const uint32_t * a, const uint32_t * b, unsigned int n, int end) {
+    while (stepper_busy(motor) || dma_channel_is_busy(motor->chan) || dma_channel_is_busy(motor->chan_b)) {
+        tight_loop_contents() ;
+    }
+    dma_channel_set_read_addr(motor->chan, a, false) ;
+    dma_channel_set_read_addr(motor->chan_b, b, false) ;
+    sendMove(motor, n, end) ;
+}
+
+void stepper_move(stepper_t * motor, int steps) {
+    int q = motor->planned ;
+    if (motor->micro) {
+        int dir = (steps < 0) ;
+        int k = dir ? (MICRO_PERIOD - q) & MICRO_MASK : (q + 1) & MICRO_MASK ;
+        queueMicro(motor, &micro_a[dir][k], &micro_b[dir][k], dir ? -steps : steps, q + steps) ;
+    }
+    else if (steps >= 0) queueMove(motor, stepper_forward, q + 1, steps, q + steps) ;
+    else queueMove(motor, stepper_backward, 8 - q, -steps, q + steps) ;
+}
+
+void stepper_move_to(stepper_t * motor, int position) {
+    stepper_move(motor, position - motor->planned) ;
+}
+
+void stepper_idle(stepper_t * motor, int steps) {
+    if (motor->micro) queueMicro(motor, micro_off, micro_off, (steps > 0) ? steps : 0, motor->planned) ;
+    else queueMove(motor, stepper_off, 0, (steps > 0) ? steps : 0, motor->planned) ;
+}
+
+// The duty tables. Electrical angle 0 is half step 1 (IN4 alone), and
+// each coil's duty is the positive part of a cosine a quarter cycle on
+// from the last: IN4, IN3, IN2, IN1.
+static void buildMicro() {
+    micro_top = clock_get_hz(clk_sys) / STEPPER_PWM_HZ - 1 ;
+    if (micro_top > 0xFFFF) micro_top = 0xFFFF ;
+    for (int q=0; q<MICRO_PERIOD; q++) {
+        float angle = 6.2831853f * (float)q / (float)MICRO_PERIOD - 0.7853982f ;
+        float c = cosf(angle), s = sinf(angle) ;
+        uint32_t in1 = (s < 0.0f) ? (uint32_t)lroundf(-s * micro_top) : 0 ;
+        uint32_t in2 = (c < 0.0f) ? (uint32_t)lroundf(-c * micro_top) : 0 ;
+        uint32_t in3 = (s > 0.0f) ? (uint32_t)lroundf(s * micro_top) : 0 ;
+        uint32_t in4 = (c > 0.0f) ? (uint32_t)lroundf(c * micro_top) : 0 ;
+        micro_a[0][q] = (in2 << 16) | in1 ;
+        micro_b[0][q] = (in4 << 16) | in3 ;
+    }
+    for (int q=0; q<MICRO_PERIOD; q++) {
+        micro_a[1][q] = micro_a[0][MICRO_MASK - q] ;
+        micro_b[1][q] = micro_b[0][MICRO_MASK - q] ;
+        micro_off[q] = 0 ;
+    }
+}
+
+bool stepper_microstep(stepper_t * motor) {
+    if (motor->micro) return true ;
+    if (motor->motion || (motor->pin & 1)) return false ;
+    PIO pio = motor->pio ;
+    int index = pio_get_index(pio) ;
+    if (!loadProgram(pio, &stepper_micro_program, micro_offset)) return false ;
+    int b = hw_claim_dma_try("stepper") ;
+    if (b < 0) return false ;
+    if (!micro_top) buildMicro() ;
+
+    // Once it's still, its position in microsteps
+    while (stepper_busy(motor)) tight_loop_contents() ;
+    motor->chan_b = b ;
+    motor->slice = pwm_gpio_to_slice_num(motor->pin) ;
+    motor->position *= STEPPER_MICROSTEPS / 2 ;
+    motor->planned *= STEPPER_MICROSTEPS / 2 ;
+    int q = motor->planned & MICRO_MASK ;
+
+    // The slices, starting at the duties for where it is
+    for (int i=0; i<2; i++) {
+        pwm_config c = pwm_get_default_config() ;
+        pwm_config_set_wrap(&c, micro_top) ;
+        pwm_init(motor->slice + i, &c, false) ;
+    }
+    pwm_hw->slice[motor->slice].cc = micro_a[0][q] ;
+    pwm_hw->slice[motor->slice + 1].cc = micro_b[0][q] ;
+    for (int i=0; i<4; i++) gpio_set_function(motor->pin + i, GPIO_FUNC_PWM) ;
+    pwm_set_mask_enabled(pwm_hw->en | (3u << motor->slice)) ;
+
+    // The state machine just pushes
+    pio_sm_set_enabled(pio, motor->sm, false) ;
+    pio_sm_clear_fifos(pio, motor->sm) ;
+    stepper_micro_program_init(pio, motor->sm, micro_offset[index]) ;
+    pio_interrupt_clear(pio, motor->sm) ;
+    pio_sm_set_enabled(pio, motor->sm, true) ;
+
+    // Each push, to the count down, then on to the slices
+    dma_channel_abort(motor->count_chan) ;
+    dma_channel_abort(motor->chan) ;
+    dma_channel_config c0 = dma_channel_get_default_config(motor->count_chan);   // default configs
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_32);                     // 32-bit txfers
+    channel_config_set_read_increment(&c0, false);                               // no read incrementing
+    channel_config_set_write_increment(&c0, false);                              // no write incrementing
+    channel_config_set_dreq(&c0, pio_get_dreq(pio, motor->sm, false));           // RX FIFO pacing
+    channel_config_set_chain_to(&c0, motor->chan);                               // chain to the first slice's channel
+    dma_channel_configure(motor->count_chan, &c0, &motor->countdown, &pio->rxf[motor->sm], 1, false) ;
+
+    // One compare word to each slice, from round its table
+    dma_channel_config c1 = dma_channel_get_default_config(motor->chan);   // default configs
+    channel_config_set_transfer_data_size(&c1, DMA_SIZE_32);               // 32-bit txfers
+    channel_config_set_read_increment(&c1, true);                          // yes read incrementing
+    channel_config_set_write_increment(&c1, false);                        // no write incrementing
+    channel_config_set_ring(&c1, false, MICRO_RING_BITS);                  // wrap the read address (one cycle)
+    channel_config_set_chain_to(&c1, b);                                   // chain to the second slice's channel
+    dma_channel_configure(motor->chan, &c1, &pwm_hw->slice[motor->slice].cc, &micro_a[0][(q + 1) & MICRO_MASK], 1, false) ;
+
+    dma_channel_config c2 = dma_channel_get_default_config(b);             // default configs
+    channel_config_set_transfer_data_size(&c2, DMA_SIZE_32);               // 32-bit txfers
+    channel_config_set_read_increment(&c2, true);                          // yes read incrementing
+    channel_config_set_write_increment(&c2, false);                        // no write incrementing
+    channel_config_set_ring(&c2, false, MICRO_RING_BITS);                  // wrap the read address (one cycle)
+    channel_config_set_chain_to(&c2, motor->count_chan);                   // chain back to wait for the next step
+    dma_channel_configure(b, &c2, &pwm_hw->slice[motor->slice + 1].cc, &micro_b[0][(q + 1) & MICRO_MASK], 1, false) ;
+
+    motor->micro = 1 ;
+    dma_channel_start(motor->count_chan) ;
+    return true ;
+}
+
+void stepper_use_table(stepper_t * motor) {
+    if (motor->micro) panic("stepper: a microstepping motor can't join the motion queue") ;
+    while (stepper_busy(motor)) tight_loop_contents() ;
+    motor->motion = 1 ;
+
+    // A word per step, read straight through a table
+    dma_channel_config c0 = dma_channel_get_default_config(motor->chan);   // default configs
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_32);               // 32-bit txfers
+    channel_config_set_read_increment(&c0, true);                          // yes read incrementing
+    channel_config_set_write_increment(&c0, false);                        // no write incrementing
+    channel_config_set_dreq(&c0, pio_get_dreq(motor->pio, motor->sm, true));   // TX FIFO pacing
+    dma_channel_configure(motor->chan, &c0, &motor->pio->txf[motor->sm], NULL, 0, false) ;
+}
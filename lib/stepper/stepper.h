@@ -0,0 +1,138 @@
+/**
+ * PIO stepper motors, any number of them
+ *
+ * A stepper_t is one ULN2003-driven motor on four consecutive pins. Each
+ * takes one state machine (stepper.pio), claimed on pio1 if there's one
+ * free and then on pio0, that PIO's IRQ flag of the same number, and two
+ * DMA channels, all from lib/hw_claim.
+ * The programs are loaded once per PIO and shared. So four motors can
+ * share pio1 and take eight channels, leaving pio0 and two channels for
+ * a VGA display, and a fifth motor takes the state machine VGA leaves.
+ *
+ * A move is a signed number of half steps at the motor's speed. The CPU
+ * writes the step count to the state machine, and a DMA channel sends it
+ * one word per step, its pause and coil pattern, starting where the motor
+ * is in the 8-step half-step cycle and wrapping round it (a 32-byte read
+ * ring), so a motor never loses its place between moves.
+ *
+ * POSITION
+ *  - At each step the state machine pushes its count down, and the
+ *    motor's other channel copies it to RAM, so stepper_get_position()
+ *    is where the motor is now, mid-move, and stepper_steps_left() how
+ *    far it has to go in the move under way. Neither needs an interrupt
+ *    per step, so they're cheap to poll.
+ *  - motor.position is where it was at the end of the last finished
+ *    move, and motor.planned where its moves end
+ *
+ * MICROSTEPPING
+ *  - stepper_microstep(&motor) switches a motor to STEPPER_MICROSTEPS
+ *    microsteps a full step (16, 32 or 64, build-time), driving its coils
+ *    from two PWM slices instead, with sine and cosine duty tables. Its
+ *    pin has to be even, so that the four pins are two whole slices.
+ *  - Each microstep the state machine pushes to its RX FIFO, and a chain
+ *    of three DMA channels waiting on it (the count-down channel, then
+ *    one per slice) writes the next duties to both slices, reading round
+ *    the tables with a read ring as the half steps do. One more channel
+ *    is claimed for it.
+ *  - From then on the motor's positions, moves and speeds are in
+ *    microsteps (its position is scaled up to match). The chain has to be
+ *    pointed at each move's tables while it's still, so a move waits for
+ *    the last one to finish: queue the next from the callback.
+ *  - The PWM runs at STEPPER_PWM_HZ (build-time, default 20 kHz)
+ *
+ * USE
+ *  - stepper_init(&motor, pin) claims everything, or returns false if
+ *    there isn't a state machine (with its IRQ flag), a channel or
+ *    program space left
+ *  - stepper_set_speed(&motor, steps_per_second) for the moves after it
+ *    (no slower than about half a step a second)
+ *  - stepper_move(&motor, steps) (signed, positive is the old
+ *    COUNTERCLOCKWISE) or stepper_move_to(&motor, position). If the motor
+ *    is still moving it waits until the last move's patterns have all
+ *    gone to the state machine (a few steps from its end), then queues
+ *    this one to follow it. stepper_idle(&motor, steps) spends that many
+ *    step times with the coils off, as the old STOPPED direction did.
+ *  - stepper_on_done(&motor, callback) calls callback(&motor) from the
+ *    PIO ISR at the end of each move: it can start the next one
+ *  - stepper_motion.h drives several motors together from a motion queue
+ *
+ */
+
+#ifndef STEPPER_H
+#define STEPPER_H
+
+#include <stdbool.h>
+#include "hardware/pio.h"
+
+// Cycles the state machine spends on each step beyond its pause, and the
+// longest pause (28 bits, about 2 s at 125 MHz)
+#define STEPPER_STEP_OVERHEAD 8
+#define STEPPER_MAX_PAUSE 0x0FFFFFFF
+
+// Most moves a motor can have under way at once
+#define STEPPER_MOVES 4
+
+// Microsteps a full step, for motors that microstep (build-time)
+#ifndef STEPPER_MICROSTEPS
+#define STEPPER_MICROSTEPS 16
+#endif
+#if (STEPPER_MICROSTEPS != 16) && (STEPPER_MICROSTEPS != 32) && (STEPPER_MICROSTEPS != 64)
+#error "STEPPER_MICROSTEPS must be 16, 32 or 64"
+#endif
+
+// Microstepping PWM frequency (build-time)
+#ifndef STEPPER_PWM_HZ
+#define STEPPER_PWM_HZ 20000
+#endif
+
+typedef struct stepper stepper_t ;
+typedef void (*stepper_callback_t)(stepper_t * motor) ;
+
+struct stepper {
+    PIO pio ;
+    unsigned int sm ;
+    unsigned int pin ;                  // first of the four coil pins
+    int chan ;                          // step words, to the state machine
+    int count_chan ;                    // count down, from the state machine
+    int chan_b ;                        // microstepping: duties to the second slice
+    unsigned int slice ;                // microstepping: the first slice
+    int micro ;                         // microstepping
+    volatile unsigned int countdown ;   // n for a move's first step, down to 1 for its last
+    unsigned int pause ;                // cycles before each step
+    volatile int position ;             // at the end of the last finished move
+    int planned ;                       // at the end of the last queued move
+    int ends[STEPPER_MOVES] ;           // ends of the moves under way, in order
+    unsigned int counts[STEPPER_MOVES] ; // and their steps
+    volatile unsigned int queued ;      // moves queued so far
+    volatile unsigned int finished ;    // and finished
+    stepper_callback_t done ;
+    int motion ;                        // driven by the motion queue instead
+} ;
+
+bool stepper_init(stepper_t * motor, unsigned int pin) ;
+
+void stepper_set_speed(stepper_t * motor, float steps_per_second) ;
+void stepper_move(stepper_t * motor, int steps) ;
+void stepper_move_to(stepper_t * motor, int position) ;
+void stepper_idle(stepper_t * motor, int steps) ;
+void stepper_on_done(stepper_t * motor, stepper_callback_t callback) ;
+
+// False if its pin is odd, there isn't a channel left, or it's in the
+// motion queue
+bool stepper_microstep(stepper_t * motor) ;
+
+// Whether it has moves still to finish
+bool stepper_busy(const stepper_t * motor) ;
+
+// Where it is now, and the steps left in the move under way
+int stepper_get_position(const stepper_t * motor) ;
+unsigned int stepper_steps_left(const stepper_t * motor) ;
+
+// Half-step coil patterns: position q has stepper_forward[q & 7] on the coils
+extern const unsigned char stepper_forward[8] ;
+
+// For stepper_motion.c: hand the motor to the motion queue, which sends
+// it a table of step words per segment (and keeps its ends and counts)
+void stepper_use_table(stepper_t * motor) ;
+
+#endif
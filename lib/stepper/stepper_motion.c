@@ -0,0 +1,365 @@
+/*
+* Motion queue. Each step of a segment is one word to the axis's state
+* machine, its pause and its coil pattern together, so an axis runs a
+* whole segment from one table on its one DMA channel, and direction
+* changes fall exactly on segment boundaries. The state machines raise
+* their IRQ at the end of each segment and wait; when the last axis has,
+* the ISR starts all of them on the next segment at once.
+*/
+
+#include <math.h>
+#include "pico/stdlib.h"
+#include "pico/sync.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/clocks.h"
+#include "hotpath.h"
+#include "stepper_motion.h"
+
+static stepper_t * motion_motors[MOTION_AXES] ;
+static unsigned int motion_active = 0 ;          // axes added (bits)
+static int motion_irq_on[2] ;                    // whether each PIO's IRQ comes here
+
+// A queued segment. Speeds are along the path, in steps/s, where the
+// path's length is the Euclidean length of the segment's steps.
+typedef struct {
+    int steps[MOTION_AXES] ;                // signed
+    int end[MOTION_AXES] ;                  // positions at the end
+    float unit[MOTION_AXES] ;               // direction (steps / length)
+    float length ;                          // 0 for a dwell
+    float nominal ;                         // cruise speed
+    float seconds ;                         // for a dwell
+    float stop ;                            // fastest it can start or stop from rest
+    float junction ;                        // fastest its corner with the last one allows
+    float entry, exit ;                     // planned speeds
+} motion_segment ;
+
+// The queue. The segment at the tail is the one moving, and stays in the
+// queue until every axis has finished it. Segments before motion_prep also
+// have their tables built, and their speeds can no longer change.
+static motion_segment motion_queue[MOTION_QUEUE] ;
+static volatile unsigned int motion_head = 0 ;
+static volatile unsigned int motion_tail = 0 ;
+static volatile unsigned int motion_prep = 0 ;
+static volatile int motion_running = 0 ;
+static volatile unsigned int motion_done = 0 ;   // axes done with the tail segment (bits)
+
+// Step tables (a count, then each step's pause and coil pattern) for the
+// moving segment and the next, by the parity of their place in the queue
+static unsigned int motion_tables[2][MOTION_AXES][MOTION_SEGMENT_STEPS + 1] ;
+
+// Positions at the end of the last finished segment, and of the queue
+static volatile int motion_pos[MOTION_AXES] ;
+static int motion_plan[MOTION_AXES] ;
+
+float motion_accel = 2000.0f ;
+float motion_jerk = 150.0f ;
+
+#define SEGMENT(i) (&motion_queue[(i) & (MOTION_QUEUE - 1)])
+
+static float accel() {
+    return (motion_accel > 0.0f) ? motion_accel : 1e9f ;
+}
+
+// Build the step tables for segment i. Its speed goes from its entry speed
+// up to its nominal speed and then down to its exit speed (peaking lower
+// if it's too short), and each axis steps each time the distance along the
+// path passes another of its share of the length. Step times are rounded
+// to cycles from the start of the segment, so every axis ends on the same
+// cycle and rounding doesn't add up. An axis that stays put holds its
+// pattern, in as many steps as it takes to keep each pause in 28 bits.
+static void buildTables(unsigned int i) {
+    motion_segment * s = SEGMENT(i) ;
+    unsigned int (*tables)[MOTION_SEGMENT_STEPS + 1] = motion_tables[i & 1] ;
+    float hz = (float)clock_get_hz(clk_sys) ;
+    float a = accel(), length = s->length ;
+    float v0 = s->entry, v1 = s->exit, vp = s->nominal ;
+    float up = 0.0f, down = 0.0f, t_up = 0.0f, t_cruise = 0.0f, total = s->seconds ;
+
+    if (length > 0.0f) {
+        up = (vp * vp - v0 * v0) / (2.0f * a) ;
+        down = (vp * vp - v1 * v1) / (2.0f * a) ;
+        if (up + down > length) {
+            vp = sqrtf(a * length + 0.5f * (v0 * v0 + v1 * v1)) ;
+            up = (vp * vp - v0 * v0) / (2.0f * a) ;
+            down = length - up ;
+        }
+        t_up = (vp - v0) / a ;
+        t_cruise = (length - up - down) / vp ;
+        total = t_up + t_cruise + (vp - v1) / a ;
+    }
+    float cycles = total * hz ;
+    if (cycles > 4294967040.0f) cycles = 4294967040.0f ;
+
+    for (int k=0; k<MOTION_AXES; k++) {
+        if (!(motion_active & (1u << k))) continue ;
+        unsigned int * t = tables[k] ;
+        int n = (s->steps[k] < 0) ? -s->steps[k] : s->steps[k] ;
+        int dir = (s->steps[k] < 0) ? -1 : (s->steps[k] > 0) ? 1 : 0 ;
+        int q = s->end[k] - s->steps[k] ;
+        int count = n ;
+        if (!n) {
+            count = (int)(cycles / (float)STEPPER_MAX_PAUSE) + 1 ;
+            if (count > MOTION_SEGMENT_STEPS) count = MOTION_SEGMENT_STEPS ;
+        }
+        t[0] = count ;
+        unsigned int last = 0 ;
+        for (int j=1; j<=count; j++) {
+            float d = length * (float)j / (float)count ;
+            float when ;
+            if (j == count) when = total ;
+            else if (!n) when = total * (float)j / (float)count ;
+            else if (d < up) when = (sqrtf(v0 * v0 + 2.0f * a * d) - v0) / a ;
+            else if (d <= length - down) when = t_up + (d - up) / vp ;
+            else {
+                float r = vp * vp - 2.0f * a * (d - (length - down)) ;
+                when = t_up + t_cruise + (vp - sqrtf((r > 0.0f) ? r : 0.0f)) / a ;
+            }
+            float c = when * hz ;
+            unsigned int now = (c > cycles) ? (unsigned int)cycles : (unsigned int)(c + 0.5f) ;
+            unsigned int pause = (now - last > STEPPER_STEP_OVERHEAD) ? now - last - STEPPER_STEP_OVERHEAD : 0 ;
+            if (pause > STEPPER_MAX_PAUSE) pause = STEPPER_MAX_PAUSE ;
+            t[j] = ((unsigned int)stepper_forward[(q + dir * j) & 7] << 28) | pause ;
+            last = now ;
+        }
+    }
+}
+
+// Build the tables for the next segment without any, if there is one and
+// a buffer is free (only the moving segment's may be in use)
+static void prepareNext() {
+    if ((motion_prep != motion_head) && (motion_prep - motion_tail < 2)) {
+        buildTables(motion_prep) ;
+        motion_prep++ ;
+    }
+}
+
+// Start every axis on the segment at the tail, if there is one, then
+// build the next one's tables while it runs. Each motor counts it in as a
+// move, so stepper_get_position() works mid-segment. Called from the ISR,
+// or with interrupts off. The ISR and this run from RAM; the tables are
+// built in flash, since it's long and its float math is in the bootrom.
+static void HOT_ISR(startSegment)() {
+    if (motion_tail == motion_head) {
+        motion_running = 0 ;
+        return ;
+    }
+    if (motion_prep == motion_tail) prepareNext() ;
+    motion_segment * s = SEGMENT(motion_tail) ;
+    unsigned int (*tables)[MOTION_SEGMENT_STEPS + 1] = motion_tables[motion_tail & 1] ;
+    uint32_t mask = 0 ;
+    for (int a=0; a<MOTION_AXES; a++) {
+        if (!(motion_active & (1u << a))) continue ;
+        stepper_t * m = motion_motors[a] ;
+        m->ends[m->queued % STEPPER_MOVES] = s->end[a] ;
+        m->counts[m->queued % STEPPER_MOVES] = tables[a][0] ;
+        m->countdown = tables[a][0] + 1 ;
+        m->planned = s->end[a] ;
+        m->queued++ ;
+        dma_channel_set_read_addr(m->chan, tables[a], false) ;
+        dma_channel_set_trans_count(m->chan, tables[a][0] + 1, false) ;
+        mask |= (1u << m->chan) ;
+    }
+    motion_running = 1 ;
+    dma_start_channel_mask(mask) ;
+    prepareNext() ;
+}
+
+// An axis has finished its segment. Both PIOs' IRQs come here, and each
+// checks every axis.
+static void HOT_ISR(motion_irq)() {
+    for (int a=0; a<MOTION_AXES; a++) {
+        if (!(motion_active & (1u << a))) continue ;
+        stepper_t * m = motion_motors[a] ;
+        if (pio_interrupt_get(m->pio, m->sm)) {
+            pio_interrupt_clear(m->pio, m->sm) ;
+            m->position = m->ends[m->finished % STEPPER_MOVES] ;
+            m->finished++ ;
+            motion_done |= (1u << a) ;
+        }
+    }
+    if (motion_running && (motion_done == motion_active)) {
+        motion_segment * s = SEGMENT(motion_tail) ;
+        for (int a=0; a<MOTION_AXES; a++) {
+            motion_pos[a] = s->end[a] ;
+        }
+        motion_done = 0 ;
+        motion_tail++ ;
+        startSegment() ;
+    }
+}
+
+void motion_add_axis(int axis, stepper_t * motor) {
+    if ((axis < 0) || (axis >= MOTION_AXES)) return ;
+    stepper_use_table(motor) ;
+
+    // First axis on this PIO: take its IRQ
+    int index = pio_get_index(motor->pio) ;
+    if (!motion_irq_on[index]) {
+        motion_irq_on[index] = 1 ;
+        irq_add_shared_handler(index ? PIO1_IRQ_0 : PIO0_IRQ_0, motion_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY) ;
+        irq_set_enabled(index ? PIO1_IRQ_0 : PIO0_IRQ_0, true) ;
+    }
+
+    motion_motors[axis] = motor ;
+    motion_pos[axis] = motor->planned ;
+    motion_plan[axis] = motor->planned ;
+    motion_active |= (1u << axis) ;
+}
+
+int motion_space() {
+    return MOTION_QUEUE - (int)(motion_head - motion_tail) ;
+}
+
+int motion_busy() {
+    return motion_running ;
+}
+
+int motion_position(int axis) {
+    return motion_pos[axis] ;
+}
+
+int motion_planned(int axis) {
+    return motion_plan[axis] ;
+}
+
+// Fastest a segment in direction u can start or stop from rest, and
+// fastest it can take the corner from direction w, with no axis's speed
+// changing by more than motion_jerk at once
+static float restSpeed(const float * u) {
+    float v = 1e9f ;
+    for (int a=0; a<MOTION_AXES; a++) {
+        float du = fabsf(u[a]) ;
+        if ((du > 0.0f) && (motion_jerk < v * du)) v = motion_jerk / du ;
+    }
+    return v ;
+}
+
+static float cornerSpeed(const float * w, const float * u) {
+    float v = 1e9f ;
+    for (int a=0; a<MOTION_AXES; a++) {
+        float du = fabsf(u[a] - w[a]) ;
+        if ((du > 0.0f) && (motion_jerk < v * du)) v = motion_jerk / du ;
+    }
+    return v ;
+}
+
+// Plan the speeds of the segments that don't have tables yet. Backwards
+// from the end of the queue (which has to stop), each enters no faster
+// than it can slow down from to its exit, or than its corner allows; then
+// forwards from the last one with tables, each speeds up no faster than
+// it can from its entry. Called with interrupts off.
+static void plan() {
+    unsigned int first = motion_prep ;
+    if (first == motion_head) return ;
+    float a = accel() ;
+
+    float next = -1.0f ;                    // entry of the one after, or -1 for rest
+    for (unsigned int i = motion_head; i-- != first; ) {
+        motion_segment * s = SEGMENT(i) ;
+        if (s->length == 0.0f) {
+            s->entry = s->exit = 0.0f ;
+            next = -1.0f ;
+            continue ;
+        }
+        s->exit = (next < 0.0f) ? s->stop : next ;
+        float entry = sqrtf(s->exit * s->exit + 2.0f * a * s->length) ;
+        s->entry = (entry < s->junction) ? entry : s->junction ;
+        next = s->entry ;
+    }
+
+    float last = -1.0f ;                    // exit of the one before, or -1 for rest
+    if (first != motion_tail) last = (SEGMENT(first - 1)->length > 0.0f) ? SEGMENT(first - 1)->exit : -1.0f ;
+    for (unsigned int i = first; i != motion_head; i++) {
+        motion_segment * s = SEGMENT(i) ;
+        if (s->length == 0.0f) {
+            last = -1.0f ;
+            continue ;
+        }
+        float start = (last < 0.0f) ? s->stop : last ;
+        if (start < s->entry) s->entry = start ;
+        float exit = sqrtf(s->entry * s->entry + 2.0f * a * s->length) ;
+        if (exit < s->exit) s->exit = exit ;
+        last = s->exit ;
+    }
+}
+
+// Queue one segment (at most MOTION_SEGMENT_STEPS on any axis), planned
+// with the ones before it
+static void queueSegment(const int * target, float seconds) {
+    while (motion_space() == 0) tight_loop_contents() ;
+    unsigned int h = motion_head ;
+    motion_segment * s = SEGMENT(h) ;
+
+    float sum = 0.0f ;
+    for (int a=0; a<MOTION_AXES; a++) {
+        int q = motion_plan[a] ;
+        int d = (motion_active & (1u << a)) ? target[a] - q : 0 ;
+        s->steps[a] = d ;
+        s->end[a] = q + d ;
+        motion_plan[a] = q + d ;
+        sum += (float)d * (float)d ;
+    }
+    if (seconds < 1e-6f) seconds = 1e-6f ;
+    s->length = sqrtf(sum) ;
+    s->seconds = seconds ;
+    s->nominal = s->length / seconds ;
+    for (int a=0; a<MOTION_AXES; a++) {
+        s->unit[a] = (s->length > 0.0f) ? (float)s->steps[a] / s->length : 0.0f ;
+    }
+    float stop = restSpeed(s->unit) ;
+    s->stop = (stop < s->nominal) ? stop : s->nominal ;
+
+    // The ISR only sees it once it's all there, and planned
+    uint32_t save = save_and_disable_interrupts() ;
+    s->junction = s->stop ;
+    if (h != motion_tail) {
+        motion_segment * p = SEGMENT(h - 1) ;
+        if ((p->length > 0.0f) && (s->length > 0.0f)) {
+            float v = cornerSpeed(p->unit, s->unit) ;
+            if (v > p->nominal) v = p->nominal ;
+            if (v > s->nominal) v = s->nominal ;
+            s->junction = v ;
+        }
+    }
+    motion_head = h + 1 ;
+    plan() ;
+    if (!motion_running) startSegment() ;
+    restore_interrupts(save) ;
+}
+
+// Long moves go in as several segments, in a line
+void motion_queue_timed(const int * target, float seconds) {
+    int start[MOTION_AXES], piece[MOTION_AXES] ;
+    int most = 0 ;
+    for (int a=0; a<MOTION_AXES; a++) {
+        start[a] = motion_plan[a] ;
+        int d = target[a] - start[a] ;
+        if (d < 0) d = -d ;
+        if ((motion_active & (1u << a)) && (d > most)) most = d ;
+    }
+    int pieces = (most + MOTION_SEGMENT_STEPS - 1) / MOTION_SEGMENT_STEPS ;
+    if (pieces < 1) pieces = 1 ;
+    for (int p=1; p<=pieces; p++) {
+        for (int a=0; a<MOTION_AXES; a++) {
+            piece[a] = start[a] + (int)(((long long)(target[a] - start[a]) * p) / pieces) ;
+        }
+        queueSegment(piece, seconds / (float)pieces) ;
+    }
+}
+void motion_queue_joint(const int * target, float rate) {
+    int most = 0 ;
+    for (int a=0; a<MOTION_AXES; a++) {
+        if (!(motion_active & (1u << a))) continue ;
+        int d = target[a] - motion_plan[a] ;
+        if (d < 0) d = -d ;
+        if (d > most) most = d ;
+    }
+    if (!most || (rate <= 0.0f)) return ;
+    motion_queue_timed(target, (float)most / rate) ;
+}
+
+void motion_queue_dwell(float seconds) {
+    motion_queue_timed(motion_plan, seconds) ;
+}
@@ -0,0 +1,88 @@
+/**
+ * Coordinated multi-axis motion queue for the PIO stepper driver
+ *
+ * Moves are queued as segments, each a number of steps for every axis
+ * and a speed. Each axis is a motor (stepper.h), and takes its
+ * steps in step with the others, at its share of the segment's length,
+ * so all of the axes start and finish it together and the move is a
+ * straight line in joint space. Ending a segment is a matter of the PIO
+ * ISR waiting for the last axis and then pointing each axis's DMA
+ * channel at the next segment's table.
+ *
+ * LOOKAHEAD
+ *  - Segments don't stop between them. Each corner is taken as fast as
+ *    it can be without any axis's speed jumping by more than motion_jerk
+ *    (steps/s), and the speeds are planned back from the end of the
+ *    queue, which always comes to a stop, so that every segment can slow
+ *    down in time at motion_accel (steps/s^2, along the path).
+ *  - Each segment speeds up from its entry speed to its own speed, and
+ *    slows down to its exit speed, with a step table per axis (the
+ *    cycles before each step). The ISR builds the next segment's tables
+ *    as it starts each one, so the tables for only two segments are kept,
+ *    and a segment's speeds are fixed once it has them.
+ *  - Queueing a segment replans the ones after that, so the more there
+ *    are queued the faster the corners can be.
+ *
+ * An axis needs nothing beyond its motor's state machine and channels:
+ * the motor's step-word channel is pointed straight at each segment's
+ * table, a word per step holding both its pause and its coil pattern.
+ *
+ * USE
+ *  - stepper_init(&motor, pin) and then motion_add_axis(axis, &motor)
+ *    for each axis. The motor's position carries over, and from then on
+ *    it's the queue's (don't stepper_move() it).
+ *  - motion_queue_timed(target, seconds) moves every axis to its target
+ *    (absolute, in half steps), taking that long at full speed (ramps
+ *    add to it), and motion_queue_joint(target, rate) moves them at
+ *    'rate' steps/s on the axis that moves farthest. Longer moves are
+ *    split into segments of MOTION_SEGMENT_STEPS. motion_queue_dwell(
+ *    seconds) stops and holds still.
+ *  - Motion starts as soon as there's a segment queued. Queueing waits
+ *    while the queue is full, so it mustn't be done from an ISR.
+ *  - motion_position() is where an axis was at the end of the last
+ *    segment it finished, and motion_planned() where the queue ends.
+ *    stepper_get_position() on its motor is where it is now.
+ *  - delta_kinematics.h plans straight Cartesian lines for a delta robot
+ *
+ */
+
+#ifndef STEPPER_MOTION_H
+#define STEPPER_MOTION_H
+
+#include "stepper.h"
+
+// Axes (build-time)
+#ifndef MOTION_AXES
+#define MOTION_AXES 3
+#endif
+
+// The queue holds 2^MOTION_QUEUE_BITS segments (build-time)
+#ifndef MOTION_QUEUE_BITS
+#define MOTION_QUEUE_BITS 5
+#endif
+#define MOTION_QUEUE (1 << MOTION_QUEUE_BITS)
+
+// Most steps any axis takes in one segment (build-time)
+#ifndef MOTION_SEGMENT_STEPS
+#define MOTION_SEGMENT_STEPS 256
+#endif
+
+// Acceleration along the path (steps/s^2), and the most any axis's speed
+// may change at once (steps/s), at run time
+extern float motion_accel ;
+extern float motion_jerk ;
+
+void motion_add_axis(int axis, stepper_t * motor) ;
+
+void motion_queue_timed(const int * target, float seconds) ;
+void motion_queue_joint(const int * target, float rate) ;
+void motion_queue_dwell(float seconds) ;
+
+// Free slots in the queue, and whether anything's still moving
+int motion_space(void) ;
+int motion_busy(void) ;
+
+int motion_position(int axis) ;
+int motion_planned(int axis) ;
+
+#endif
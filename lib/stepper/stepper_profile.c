@@ -0,0 +1,98 @@
+/*
+* Acceleration profiles. Step k is taken at distance k + 1/2 into the
+* move (the middle of its interval), and its speed is the lesser of what
+* the ramp up allows there and what the ramp down allows from there to
+* the end, capped at the top speed. The pacer count for step k is then
+* pacer_hz / speed, less the cycles the pacer spends between counts.
+*/
+
+#include <math.h>
+#include "stepper_profile.h"
+
+void stepper_profile_init(stepper_profile * p, unsigned int * delays, int size, float pacer_hz) {
+    p->delays = delays ;
+    p->size = size ;
+    p->steps = 0 ;
+    p->pacer_hz = pacer_hz ;
+}
+
+unsigned int stepper_rate_to_delay(const stepper_profile * p, float rate) {
+    if (rate <= 0.0f) return 0xFFFFFFFF ;
+    float cycles = p->pacer_hz / rate - STEPPER_PACER_OVERHEAD ;
+    if (cycles < 1.0f) return 1 ;
+    if (cycles > 4294967040.0f) return 0xFFFFFFFF ;
+    return (unsigned int)cycles ;
+}
+
+float stepper_delay_to_rate(const stepper_profile * p, unsigned int delay) {
+    return p->pacer_hz / ((float)delay + STEPPER_PACER_OVERHEAD) ;
+}
+
+// Checks common to both shapes. Returns 0 if the move can't be profiled.
+static int profileStart(stepper_profile * p, int steps, float * v_start, float * v_max, float accel) {
+    p->steps = 0 ;
+    if ((steps <= 0) || (steps > p->size) || (*v_max <= 0.0f)) return 0 ;
+    if (*v_start < 0.0f) *v_start = 0.0f ;
+    if (*v_start > *v_max) *v_start = *v_max ;
+    // No acceleration means no ramps
+    if (accel <= 0.0f) *v_start = *v_max ;
+    return 1 ;
+}
+
+// Constant acceleration: v^2 = v_start^2 + 2 a s on each ramp
+int stepper_profile_trapezoid(stepper_profile * p, int steps, float v_start, float v_max, float accel) {
+    if (!profileStart(p, steps, &v_start, &v_max, accel)) return -1 ;
+    float v0 = v_start * v_start ;
+    float vm = v_max * v_max ;
+    float a2 = 2.0f * accel ;
+    for (int k=0; k<steps; k++) {
+        float s = (float)k + 0.5f ;
+        float up = v0 + a2 * s ;
+        float down = v0 + a2 * ((float)steps - s) ;
+        float v = (up < down) ? up : down ;
+        if (v > vm) v = vm ;
+        p->delays[k] = stepper_rate_to_delay(p, sqrtf(v)) ;
+    }
+    p->steps = steps ;
+    return steps ;
+}
+
+// Each ramp is a smoothstep in time, v = v_start + dv (3u^2 - 2u^3) for
+// u = t/T, whose peak acceleration 1.5 dv/T is accel. Its distance is
+// v_start T + dv T (u^3 - u^4/2), solved for u at each step by bisection
+// (the speed is zero at the start of a ramp from rest, so Newton's method
+// can't be used). Moves too short for two ramps lower the peak until the
+// ramps meet in the middle.
+static float rampDistance(float u, float v_start, float dv, float t) {
+    return t * (v_start * u + dv * (u * u * u - 0.5f * u * u * u * u)) ;
+}
+
+int stepper_profile_scurve(stepper_profile * p, int steps, float v_start, float v_max, float accel) {
+    if (!profileStart(p, steps, &v_start, &v_max, accel)) return -1 ;
+    float dv = v_max - v_start ;
+    float t = (accel > 0.0f) ? 1.5f * dv / accel : 0.0f ;
+    if (rampDistance(1.0f, v_start, dv, t) > 0.5f * (float)steps) {
+        // 0.75 dv^2 + 1.5 v_start dv = accel steps / 2
+        dv = (sqrtf(2.25f * v_start * v_start + 1.5f * accel * (float)steps) - 1.5f * v_start) / 1.5f ;
+        t = 1.5f * dv / accel ;
+    }
+    float ramp = rampDistance(1.0f, v_start, dv, t) ;
+    float u = 0.0f ;
+    for (int k=0; k<steps; k++) {
+        float s = (float)k + 0.5f ;
+        float d = (s < (float)steps - s) ? s : (float)steps - s ;
+        float v = v_start + dv ;
+        if (d < ramp) {
+            float lo = 0.0f, hi = 1.0f ;
+            for (int i=0; i<20; i++) {
+                u = 0.5f * (lo + hi) ;
+                if (rampDistance(u, v_start, dv, t) < d) lo = u ;
+                else hi = u ;
+            }
+            v = v_start + dv * u * u * (3.0f - 2.0f * u) ;
+        }
+        p->delays[k] = stepper_rate_to_delay(p, v) ;
+    }
+    p->steps = steps ;
+    return steps ;
+}
@@ -0,0 +1,52 @@
+/**
+ * Acceleration profiles for the PIO stepper driver
+ *
+ * The pacer state machine counts down one word from its TX FIFO before
+ * each step, so a move's speed profile is just a table of those counts,
+ * one per step. A profile is computed once, before the move, and DMA
+ * streams it to the pacer while the move runs: speed ramps in hardware,
+ * with no CPU time per step.
+ *
+ *  - Trapezoid: constant acceleration from the start speed up to the top
+ *    speed, cruise, and the same deceleration down to the start speed.
+ *  - S-curve: the speed follows a smoothstep in time over each ramp, so
+ *    the acceleration itself rises and falls (no jerk at the ends of the
+ *    ramps). 'accel' is the peak acceleration, so the ramps take 1.5
+ *    times as long as the trapezoid's.
+ *  Moves too short to reach the top speed peak in the middle instead.
+ *
+ * USE
+ *  - stepper_profile_init(&p, table, size, pacer_hz) with a table of
+ *    'size' words and the pacer's clock (clock_get_hz(clk_sys) with its
+ *    default divider)
+ *  - stepper_profile_trapezoid(&p, steps, v_start, v_max, accel) or
+ *    stepper_profile_scurve(...), speeds in steps/s and acceleration in
+ *    steps/s^2. Each returns the number of steps, or -1 if the table is
+ *    too small.
+ *  - Give the profile to the motor library's MOVE_PROFILE_MOTOR_n()
+ *
+ */
+
+#ifndef STEPPER_PROFILE_H
+#define STEPPER_PROFILE_H
+
+// Cycles the pacer spends on each step beyond its countdown (pull,
+// waiting for the counter, and the step IRQ)
+#define STEPPER_PACER_OVERHEAD 4
+
+typedef struct {
+    unsigned int * delays ;     // pacer counts; delays[k] comes before step k
+    int steps ;                 // steps in the move
+    int size ;                  // room in delays
+    float pacer_hz ;            // pacer clock
+} stepper_profile ;
+
+void stepper_profile_init(stepper_profile * p, unsigned int * delays, int size, float pacer_hz) ;
+int stepper_profile_trapezoid(stepper_profile * p, int steps, float v_start, float v_max, float accel) ;
+int stepper_profile_scurve(stepper_profile * p, int steps, float v_start, float v_max, float accel) ;
+
+// Pacer count for a speed in steps/s, and back
+unsigned int stepper_rate_to_delay(const stepper_profile * p, float rate) ;
+float stepper_delay_to_rate(const stepper_profile * p, unsigned int delay) ;
+
+#endif
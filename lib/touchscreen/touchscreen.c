@@ -0,0 +1,394 @@
+/*
+* Resistive touchscreen. To measure x, Y+ and Y- are driven (so there's
+* a voltage gradient across the panel) and X+ is read on the ADC with X-
+* and X+ left floating; y is the same the other way round. For the
+* pressure, X- is driven low and Y- high, and X+ and Y+ are both read.
+* Each burst makes one of the measurements, and its DMA interrupt sets
+* the panel up for the next and starts it, so they go round x, y, z.
+*/
+
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/adc.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/flash.h"
+#include "hotpath.h"
+#include "hw_claim.h"
+#include "touchscreen.h"
+
+// The measurement being made now
+enum {MEASURE_X, MEASURE_Y, MEASURE_Z} ;
+static volatile int chooser ;
+
+// One burst of readings, as the DMA channel copies them from the FIFO
+#define BURST_LENGTH (TOUCH_SETTLE + TOUCH_BURST)
+static uint16_t burst_buf[BURST_LENGTH] ;
+static int burst_chan = -1 ;
+
+// This scan's x and y burst sums, kept until its z says whether they
+// were pressed
+static uint32_t xburst, yburst ;
+
+// X/Y burst sums for filtering, their next entries, running sums, and
+// how many pressed scans they hold
+static uint32_t xarray[TOUCH_FILTER] ;
+static uint32_t yarray[TOUCH_FILTER] ;
+static unsigned char xypointer = 0 ;
+static unsigned char filled = 0 ;
+static uint32_t xsum = 0 ;
+static uint32_t ysum = 0 ;
+
+// Output of filter, and the latest pressure
+static volatile int xret ;
+static volatile int yret ;
+static volatile int zret ;
+
+// Raw readings to the screen
+static touch_calibration touch_cal ;
+
+// Events, a ring filled by the DMA interrupt and emptied by
+// touch_get_event()
+static touch_event queue[TOUCH_QUEUE] ;
+static volatile uint32_t queue_head = 0 ;  // written by the DMA interrupt
+static volatile uint32_t queue_tail = 0 ;  // written by touch_get_event
+volatile unsigned int touch_dropped = 0 ;
+
+// The touch in progress (its latest position, and when it last moved),
+// scans without pressure since it was last pressed, and scans so far
+static volatile char down = 0 ;
+static touch_event last_event ;
+static uint32_t last_move_us ;
+static unsigned char released = 0 ;
+static volatile unsigned int scans = 0 ;
+
+// The calibration in flash, checked by a magic number and a sum
+#define CAL_MAGIC 0x54434131        // "TCA1"
+typedef struct {
+    uint32_t magic ;
+    touch_calibration cal ;
+    uint32_t check ;
+} cal_record ;
+
+// Setup for reading the y coordinate
+// Y+ and Y- set to input (high impedance)
+// X+ and X- set to output
+static void HOT_ISR(setupY)(void) {
+    gpio_set_dir(TOUCH_XMINUS, GPIO_OUT) ;
+    gpio_set_dir(TOUCH_XPLUS, GPIO_OUT) ;
+    gpio_set_dir(TOUCH_YPLUS, GPIO_IN) ;
+    gpio_set_dir(TOUCH_YMINUS, GPIO_IN) ;
+    gpio_put(TOUCH_XMINUS, 0) ;
+    gpio_put(TOUCH_XPLUS, 1) ;
+}
+
+// Setup for reading the x coordinate
+// X+ and X- set to input (high impedance)
+// Y+ and Y- set to output
+static void HOT_ISR(setupX)(void) {
+    gpio_set_dir(TOUCH_XMINUS, GPIO_IN) ;
+    gpio_set_dir(TOUCH_XPLUS, GPIO_IN) ;
+    gpio_set_dir(TOUCH_YPLUS, GPIO_OUT) ;
+    gpio_set_dir(TOUCH_YMINUS, GPIO_OUT) ;
+    gpio_put(TOUCH_YMINUS, 0) ;
+    gpio_put(TOUCH_YPLUS, 1) ;
+}
+
+// Setup for reading the pressure
+// X+ and Y+ set to input (high impedance)
+// X- and Y- set to output, low and high
+static void HOT_ISR(setupZ)(void) {
+    gpio_set_dir(TOUCH_XPLUS, GPIO_IN) ;
+    gpio_set_dir(TOUCH_YPLUS, GPIO_IN) ;
+    gpio_set_dir(TOUCH_XMINUS, GPIO_OUT) ;
+    gpio_set_dir(TOUCH_YMINUS, GPIO_OUT) ;
+    gpio_put(TOUCH_XMINUS, 0) ;
+    gpio_put(TOUCH_YMINUS, 1) ;
+}
+
+// Start a burst on ADC input 0 (x) or 1 (y), or both in turn from input
+// 0 (z), the panel already set up
+static void HOT_ISR(startBurst)(int input, int round_robin) {
+    adc_select_input(input) ;
+    adc_set_round_robin(round_robin ? 0x3 : 0) ;
+    dma_channel_set_write_addr(burst_chan, burst_buf, true) ;
+    adc_run(true) ;
+}
+
+// Queue e if there's room, or count it dropped
+static void HOT_ISR(pushEvent)(const touch_event * e) {
+    uint32_t head = queue_head ;
+    if ((head - queue_tail) < TOUCH_QUEUE) {
+        queue[head & (TOUCH_QUEUE - 1)] = *e ;
+        __dmb() ;
+        queue_head = head + 1 ;
+    }
+    else {
+        touch_dropped++ ;
+    }
+}
+
+// Filtered readings to VGA coordinates (clamped to the screen)
+static void HOT_ISR(touchMap)(int xr, int yr, short * x, short * y) {
+    int32_t sx = (int32_t)(((int64_t)touch_cal.a * xr + (int64_t)touch_cal.b * yr + touch_cal.c) >> 16) ;
+    int32_t sy = (int32_t)(((int64_t)touch_cal.d * xr + (int64_t)touch_cal.e * yr + touch_cal.f) >> 16) ;
+    *x = (sx < 0) ? 0 : (sx > 639) ? 639 : sx ;
+    *y = (sy < 0) ? 0 : (sy > 479) ? 479 : sy ;
+}
+
+// Start the moving average afresh
+static void HOT_ISR(resetFilter)(void) {
+    memset(xarray, 0, sizeof(xarray)) ;
+    memset(yarray, 0, sizeof(yarray)) ;
+    xsum = ysum = 0 ;
+    xypointer = 0 ;
+    filled = 0 ;
+}
+
+// A scan is done: average x and y if it was pressed, and queue the start,
+// movement or end of a touch
+static void HOT_ISR(scanDone)(int pressure) {
+    scans++ ;
+    if (pressure < TOUCH_Z_MIN) {
+        // Readings without pressure are the panel floating, so they're
+        // left out. A touch ends after a few of them in a row.
+        if (!down) {
+            if (filled) resetFilter() ;
+            return ;
+        }
+        if (++released < TOUCH_RELEASE) return ;
+        last_event.type = TOUCH_UP ;
+        pushEvent(&last_event) ;
+        down = 0 ;
+        resetFilter() ;
+        return ;
+    }
+
+    released = 0 ;
+    xsum += xburst - xarray[xypointer] ;
+    ysum += yburst - yarray[xypointer] ;
+    xarray[xypointer] = xburst ;
+    yarray[xypointer] = yburst ;
+    xypointer = (xypointer + 1 == TOUCH_FILTER) ? 0 : xypointer + 1 ;
+    if (filled < TOUCH_FILTER) {
+        // Not a touch until it's lasted long enough to fill the average
+        if (++filled < TOUCH_FILTER) return ;
+    }
+    xret = xsum / (TOUCH_FILTER * TOUCH_BURST) ;
+    yret = ysum / (TOUCH_FILTER * TOUCH_BURST) ;
+
+    touch_event e ;
+    touchMap(xret, yret, &e.x, &e.y) ;
+    e.raw_x = xret ;
+    e.raw_y = yret ;
+    e.pressure = pressure ;
+    uint32_t now = time_us_32() ;
+    if (!down) {
+        e.type = TOUCH_DOWN ;
+        down = 1 ;
+    }
+    else if (((e.x != last_event.x) || (e.y != last_event.y)) &&
+             ((now - last_move_us) >= TOUCH_MOVE_US)) {
+        e.type = TOUCH_MOVE ;
+    }
+    else return ;
+    pushEvent(&e) ;
+    last_event = e ;
+    last_move_us = now ;
+}
+
+// A burst has been copied out: sum it, then set up and start the next
+// measurement. It, and everything it calls, runs from RAM.
+static void HOT_ISR(touch_dma_handler)() {
+    // DMA_IRQ_0 may be shared, so check that it's ours
+    if (!(dma_hw->ints0 & (1u << burst_chan))) return ;
+    dma_hw->ints0 = (1u << burst_chan) ;
+
+    // Stop the ADC, and throw away whatever it's started since
+    adc_run(false) ;
+    adc_fifo_drain() ;
+
+    int i ;
+    if (chooser == MEASURE_X) {
+        xburst = 0 ;
+        for (i = TOUCH_SETTLE; i < BURST_LENGTH; i++) xburst += burst_buf[i] ;
+        setupY() ;
+        chooser = MEASURE_Y ;
+        startBurst(1, 0) ;
+    }
+    else if (chooser == MEASURE_Y) {
+        yburst = 0 ;
+        for (i = TOUCH_SETTLE; i < BURST_LENGTH; i++) yburst += burst_buf[i] ;
+        setupZ() ;
+        chooser = MEASURE_Z ;
+        startBurst(0, 1) ;
+    }
+    else {
+        // Readings alternate X+ (even) and Y+ (odd)
+        int z1 = 0, z2 = 0 ;
+        for (i = TOUCH_SETTLE; i < BURST_LENGTH; i += 2) {
+            z1 += burst_buf[i] ;
+            z2 += burst_buf[i+1] ;
+        }
+        int pressure = 4095 - ((z2 - z1) / (TOUCH_BURST / 2)) ;
+        if (pressure < 0) pressure = 0 ;
+        if (pressure > 4095) pressure = 4095 ;
+        zret = pressure ;
+        setupX() ;
+        chooser = MEASURE_X ;
+        startBurst(0, 0) ;
+        scanDone(pressure) ;
+    }
+}
+
+void touch_init(void) {
+    // Make sure the ADC GPIO is high-impedance, no pullups etc
+    adc_init() ;
+    adc_gpio_init(26) ;
+    adc_gpio_init(27) ;
+
+    gpio_init(TOUCH_XMINUS) ;
+    gpio_init(TOUCH_YPLUS) ;
+    gpio_init(TOUCH_XPLUS) ;
+    gpio_init(TOUCH_YMINUS) ;
+
+    // The calibration from flash, if it's been saved, or the default
+    touch_cal_default(&touch_cal) ;
+    touch_cal_load() ;
+
+    // Free-running conversions into the FIFO, 12 bits, each one raising
+    // the DMA request, at one per TOUCH_SAMPLE_US (the ADC clock is 48 MHz)
+    adc_fifo_setup(true, true, 1, false, false) ;
+    adc_set_clkdiv(48 * TOUCH_SAMPLE_US - 1) ;
+
+    // A burst is a fixed number of readings from the FIFO, each restart
+    // (with a new write address) taking another
+    if (burst_chan < 0) burst_chan = hw_claim_dma("touchscreen") ;
+    dma_channel_config c = dma_channel_get_default_config(burst_chan) ;
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_16) ;
+    channel_config_set_read_increment(&c, false) ;
+    channel_config_set_write_increment(&c, true) ;
+    channel_config_set_dreq(&c, DREQ_ADC) ;
+    dma_channel_configure(burst_chan, &c, burst_buf, &adc_hw->fifo, BURST_LENGTH, false) ;
+
+    // Each finished burst raises DMA_IRQ_0 on this core
+    dma_channel_set_irq0_enabled(burst_chan, true) ;
+    irq_add_shared_handler(DMA_IRQ_0, touch_dma_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY) ;
+    irq_set_enabled(DMA_IRQ_0, true) ;
+
+    setupX() ;
+    chooser = MEASURE_X ;
+    startBurst(0, 0) ;
+}
+
+int touch_get_event(touch_event * e) {
+    uint32_t tail = queue_tail ;
+    if (tail == queue_head) return 0 ;
+    __dmb() ;
+    *e = queue[tail & (TOUCH_QUEUE - 1)] ;
+    __dmb() ;
+    queue_tail = tail + 1 ;
+    return 1 ;
+}
+
+void touch_read_raw(int * x, int * y) {
+    *x = xret ;
+    *y = yret ;
+}
+
+int touch_read(short * x, short * y) {
+    if (!down) return 0 ;
+    touchMap(xret, yret, x, y) ;
+    return 1 ;
+}
+
+int touch_pressure(void) {
+    return zret ;
+}
+
+unsigned int touch_scans(void) {
+    return scans ;
+}
+
+////////////////////////////////////////////////////////////////////////
+// Calibration
+
+int touch_cal_compute(touch_calibration * cal, const int raw_x[3], const int raw_y[3],
+                      const short x[3], const short y[3]) {
+    // With point 2 as the origin, x - x2 = a (rx - rx2) + b (ry - ry2) at
+    // points 0 and 1 (and the same for y), two equations in two unknowns
+    int64_t dx0 = raw_x[0] - raw_x[2], dy0 = raw_y[0] - raw_y[2] ;
+    int64_t dx1 = raw_x[1] - raw_x[2], dy1 = raw_y[1] - raw_y[2] ;
+    int64_t sx0 = x[0] - x[2], sy0 = y[0] - y[2] ;
+    int64_t sx1 = x[1] - x[2], sy1 = y[1] - y[2] ;
+    int64_t det = dx0 * dy1 - dx1 * dy0 ;
+
+    // Twice the area of the triangle of readings: the points should be
+    // a good way apart, or a little noise swings the map a long way
+    if ((det < 10000) && (det > -10000)) return 0 ;
+
+    touch_calibration c ;
+    c.a = (int32_t)(((sx0 * dy1 - sx1 * dy0) * 65536) / det) ;
+    c.b = (int32_t)(((dx0 * sx1 - dx1 * sx0) * 65536) / det) ;
+    c.d = (int32_t)(((sy0 * dy1 - sy1 * dy0) * 65536) / det) ;
+    c.e = (int32_t)(((dx0 * sy1 - dx1 * sy0) * 65536) / det) ;
+    // Offsets, with a half for rounding in the map's shift
+    c.c = (int32_t)(((int64_t)x[2] << 16) - (int64_t)c.a * raw_x[2] - (int64_t)c.b * raw_y[2] + 0x8000) ;
+    c.f = (int32_t)(((int64_t)y[2] << 16) - (int64_t)c.d * raw_x[2] - (int64_t)c.e * raw_y[2] + 0x8000) ;
+    *cal = c ;
+    return 1 ;
+}
+
+void touch_cal_default(touch_calibration * cal) {
+    static const int raw_x[3] = {TOUCH_X_MIN, TOUCH_X_MAX, TOUCH_X_MIN} ;
+    static const int raw_y[3] = {TOUCH_Y_MIN, TOUCH_Y_MIN, TOUCH_Y_MAX} ;
+    static const short x[3] = {640, 0, 640} ;
+    static const short y[3] = {0, 0, 480} ;
+    touch_cal_compute(cal, raw_x, raw_y, x, y) ;
+}
+
+void touch_cal_set(const touch_calibration * cal) {
+    // The DMA interrupt maps with it
+    uint32_t irq_status = save_and_disable_interrupts() ;
+    touch_cal = *cal ;
+    restore_interrupts(irq_status) ;
+}
+
+void touch_cal_get(touch_calibration * cal) {
+    uint32_t irq_status = save_and_disable_interrupts() ;
+    *cal = touch_cal ;
+    restore_interrupts(irq_status) ;
+}
+
+// The check word of a record
+static uint32_t calCheck(const cal_record * r) {
+    const int32_t * w = &r->cal.a ;
+    uint32_t check = r->magic ;
+    for (int i = 0; i < 6; i++) check = (check << 5) + (check >> 27) + (uint32_t)w[i] ;
+    return ~check ;
+}
+
+int touch_cal_load(void) {
+    const cal_record * r = (const cal_record *)(XIP_BASE + TOUCH_CAL_FLASH_OFFSET) ;
+    if ((r->magic != CAL_MAGIC) || (r->check != calCheck(r))) return 0 ;
+    touch_cal_set(&r->cal) ;
+    return 1 ;
+}
+
+void touch_cal_save(void) {
+    // Flash is programmed a page at a time, from RAM
+    static uint8_t page[FLASH_PAGE_SIZE] __attribute__((aligned(4))) ;
+    cal_record * r = (cal_record *)page ;
+    memset(page, 0xFF, sizeof(page)) ;
+    r->magic = CAL_MAGIC ;
+    touch_cal_get(&r->cal) ;
+    r->check = calCheck(r) ;
+
+    // Nothing may run from flash while it's erased and programmed (the
+    // sector erase takes tens of ms, so scans just stop for a while)
+    uint32_t irq_status = save_and_disable_interrupts() ;
+    flash_range_erase(TOUCH_CAL_FLASH_OFFSET, FLASH_SECTOR_SIZE) ;
+    flash_range_program(TOUCH_CAL_FLASH_OFFSET, page, FLASH_PAGE_SIZE) ;
+    restore_interrupts(irq_status) ;
+}
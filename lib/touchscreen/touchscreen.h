@@ -0,0 +1,192 @@
+/**
+ * Resistive touchscreen, read on the ADC
+ *
+ * The panel is scanned in bursts: x, then y, then the pressure (z). The
+ * pins are set to drive the panel for one measurement, and the ADC
+ * (free-running into its FIFO) takes a burst of readings, which a DMA
+ * channel copies out. At the end of each burst the DMA interrupt sums
+ * it, sets the panel up for the next measurement and starts the next
+ * burst, so the CPU does no waiting and no converting. The first
+ * TOUCH_SETTLE readings of a burst are dropped while the panel settles
+ * after the pins change.
+ *
+ * PRESSURE
+ *  - For z, X- is pulled low and Y- high, and the ADC takes X+ and Y+
+ *    in turn (round-robin). With nothing touching, the plates sit at the
+ *    two rails; pressed together, the difference between them is the
+ *    drop across the contact, which shrinks the harder the press.
+ *    Pressure is 4095 less that difference, and the panel counts as
+ *    pressed at TOUCH_Z_MIN or more, so a light brush or a floating
+ *    input doesn't make a touch.
+ *  - x and y are only averaged while pressed: TOUCH_FILTER pressed scans
+ *    in a row make a touch (the debounce), and the moving average (an
+ *    integer running sum) starts afresh with each touch, so the first
+ *    readings aren't pulled toward wherever the last one ended
+ *
+ * CALIBRATION
+ *  - Filtered readings are mapped to 640x480 VGA coordinates by an
+ *    affine map in 16.16 fixed point, which takes care of a panel that's
+ *    flipped, skewed or rotated: x = (a rx + b ry + c) >> 16, and
+ *    y = (d rx + e ry + f) >> 16
+ *  - touch_cal_compute() works the map out from three points, touched
+ *    (raw) and where they are on the screen (one integer division per
+ *    coefficient, no floats). touch_cal_save() keeps it in the last
+ *    sector of flash, and touch_init() loads it from there, or failing
+ *    that, uses the default map from TOUCH_X_MIN etc.
+ *  - The flash sector outlasts reprogramming (unless an image grows into
+ *    it), so one app's calibration is there for the others on the board
+ *
+ * EVENTS
+ *  - TOUCH_DOWN when a touch starts, TOUCH_MOVE as it moves (at most one
+ *    per TOUCH_MOVE_US), and TOUCH_UP after TOUCH_RELEASE scans without
+ *    pressure, so a moment's lighter press doesn't cut a stroke in two
+ *  - Events are queued by the DMA interrupt for the app to take at its
+ *    own pace (from a protothread, say), rather than handled there
+ *
+ * USE
+ *  - touch_init() sets up the ADC, pins and DMA, loads the calibration
+ *    and starts scanning
+ *  - touch_get_event(&e) returns 1 and the next event, or 0 if there is
+ *    none
+ *  - touch_read(&x, &y) returns 1, and the position, while touched (for
+ *    polling apps)
+ *  - A scan takes 3 bursts of 200 us, so a touch is reported 2.4 ms
+ *    after it's first pressed
+ *  - touch_cal_save() erases and programs flash with interrupts off on
+ *    this core. The other core (if running) must be kept out of flash,
+ *    e.g. with multicore_lockout_start_blocking().
+ *
+ * HARDWARE CONNECTIONS (default pins)
+ *  - GPIO 6 ---> X-
+ *  - GPIO 7 ---> Y+
+ *  - GPIO 8 ---> X+
+ *  - GPIO 9 ---> Y-
+ *  - GPIO 26 (ADC 0) ---> X+ (reads x)
+ *  - GPIO 27 (ADC 1) ---> Y+ (reads y)
+ *
+ * RESOURCES USED
+ *  - The ADC (inputs 0 and 1, and its FIFO), all the time
+ *  - One DMA channel (claimed from lib/hw_claim) and DMA_IRQ_0 (shared)
+ *  - The last 4 kB sector of flash (TOUCH_CAL_FLASH_OFFSET)
+ *
+ */
+#ifndef TOUCHSCREEN_H
+#define TOUCHSCREEN_H
+
+#include <stdint.h>
+#include "hardware/flash.h"
+
+// Panel pins (build-time)
+#ifndef TOUCH_XMINUS
+#define TOUCH_XMINUS 6
+#endif
+#ifndef TOUCH_YPLUS
+#define TOUCH_YPLUS 7
+#endif
+#ifndef TOUCH_XPLUS
+#define TOUCH_XPLUS 8
+#endif
+#ifndef TOUCH_YMINUS
+#define TOUCH_YMINUS 9
+#endif
+
+// Time between ADC readings within a burst (us, at least 2)
+#ifndef TOUCH_SAMPLE_US
+#define TOUCH_SAMPLE_US 10
+#endif
+
+// Readings dropped at the start of each burst while the panel settles,
+// and readings kept, per burst (even, so z gets as many of each input)
+#ifndef TOUCH_SETTLE
+#define TOUCH_SETTLE 4
+#endif
+#ifndef TOUCH_BURST
+#define TOUCH_BURST 16
+#endif
+
+// Pressed scans in each axis's moving average, and to make a touch
+#ifndef TOUCH_FILTER
+#define TOUCH_FILTER 4
+#endif
+
+// Least pressure (0 to 4095) that counts as a touch. Panels differ, and
+// the same press reads a little higher toward X+ and Y+ (more of the
+// plates in series with the contact); touch_pressure() shows what a
+// panel gives.
+#ifndef TOUCH_Z_MIN
+#define TOUCH_Z_MIN 1000
+#endif
+
+// Scans without pressure that end a touch
+#ifndef TOUCH_RELEASE
+#define TOUCH_RELEASE 3
+#endif
+
+// Least time between TOUCH_MOVE events (us)
+#ifndef TOUCH_MOVE_US
+#define TOUCH_MOVE_US 10000
+#endif
+
+// Events waiting for the app, a power of 2. Beyond this, new ones are
+// dropped.
+#ifndef TOUCH_QUEUE
+#define TOUCH_QUEUE 32
+#endif
+
+// Where the calibration lives, from the start of flash
+#ifndef TOUCH_CAL_FLASH_OFFSET
+#define TOUCH_CAL_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE)
+#endif
+
+// Raw ADC readings at the panel's edges, for the default calibration:
+// x runs from 640 at TOUCH_X_MIN to 0 at TOUCH_X_MAX, and y from 0 at
+// TOUCH_Y_MIN to 480 at TOUCH_Y_MAX
+#define TOUCH_X_MIN 1500
+#define TOUCH_X_MAX 3500
+#define TOUCH_Y_MIN 1700
+#define TOUCH_Y_MAX 2600
+
+enum touch_event_type {TOUCH_DOWN, TOUCH_MOVE, TOUCH_UP} ;
+
+typedef struct {
+    short x, y ;            // VGA coordinates (for TOUCH_UP, the last)
+    short raw_x, raw_y ;    // the filtered readings they came from
+    short pressure ;
+    char type ;             // enum touch_event_type
+} touch_event ;
+
+// Screen x = (a rx + b ry + c) >> 16, y = (d rx + e ry + f) >> 16
+typedef struct {
+    int32_t a, b, c ;
+    int32_t d, e, f ;
+} touch_calibration ;
+
+void touch_init(void) ;
+// Take the next event, if there is one (1 if there was)
+int touch_get_event(touch_event * e) ;
+// 1 if the panel is being touched, and where (VGA coordinates)
+int touch_read(short * x, short * y) ;
+// The filtered ADC readings, from the latest touch
+void touch_read_raw(int * x, int * y) ;
+// Pressure at the latest scan (0 to 4095), touched or not
+int touch_pressure(void) ;
+// Scans so far, and events dropped with the queue full
+unsigned int touch_scans(void) ;
+extern volatile unsigned int touch_dropped ;
+
+// The map that sends raw readings (raw_x[i], raw_y[i]) to screen points
+// (x[i], y[i]). Returns 0 (and leaves cal alone) if the three points
+// are too close to a line to fix one.
+int touch_cal_compute(touch_calibration * cal, const int raw_x[3], const int raw_y[3],
+                      const short x[3], const short y[3]) ;
+// The map from TOUCH_X_MIN etc.
+void touch_cal_default(touch_calibration * cal) ;
+void touch_cal_set(const touch_calibration * cal) ;
+void touch_cal_get(touch_calibration * cal) ;
+// Use the calibration in flash (1), or if there's none there, leave the
+// one in use (0)
+int touch_cal_load(void) ;
+// Keep the calibration in use in flash
+void touch_cal_save(void) ;
+
+#endif
@@ -0,0 +1,80 @@
+/*
+* Density rendering. Level l (1 to LEVELS - 1) starts at the count
+* (1 + max)^(l / (LEVELS - 1)) - 1, so the levels are evenly spaced in
+* log(1 + count) and the busiest counter is the top level. The counts
+* are mapped to levels by binary search over those thresholds, and each
+* row of counters is drawn as runs of one level.
+*/
+
+#include <math.h>
+#include <string.h>
+#include "vga_graphics.h"
+#include "vga_density.h"
+
+vga_density_t vga_density[VGA_DENSITY_H][VGA_DENSITY_W] ;
+
+// Dimmest to brightest of the 8 output colors
+static const unsigned char default_ramp[] = {BLUE, RED, MAGENTA, GREEN, CYAN, YELLOW, WHITE} ;
+
+void vga_density_clear() {
+    memset(vga_density, 0, sizeof(vga_density)) ;
+}
+
+void vga_density_palette(const unsigned char * ramp, int n) {
+    unsigned char colors[VGA_DENSITY_LEVELS] ;
+    if (!ramp || (n < 1)) {
+        ramp = default_ramp ;
+        n = sizeof(default_ramp) ;
+    }
+    colors[0] = BLACK ;
+    for (int l=1; l<VGA_DENSITY_LEVELS; l++) {
+        colors[l] = ramp[((l - 1) * n) / (VGA_DENSITY_LEVELS - 1)] ;
+    }
+    vga_load_palette(0, VGA_DENSITY_LEVELS, colors) ;
+}
+
+// Level of a count: the last level whose threshold it has reached
+static inline int levelOf(const uint32_t * thresholds, uint32_t count) {
+    int lo = 0, hi = VGA_DENSITY_LEVELS - 1 ;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) >> 1 ;
+        if (count >= thresholds[mid]) lo = mid ;
+        else hi = mid - 1 ;
+    }
+    return lo ;
+}
+
+int vga_density_render() {
+    uint32_t thresholds[VGA_DENSITY_LEVELS] ;
+    int max = 0 ;
+    int x, y, l ;
+
+    for (y=0; y<VGA_DENSITY_H; y++) {
+        for (x=0; x<VGA_DENSITY_W; x++) {
+            if (vga_density[y][x] > max) max = vga_density[y][x] ;
+        }
+    }
+
+    // Any hit at all is level 1 at least
+    thresholds[0] = 0 ;
+    float log_max = logf(1.0f + (float)max) ;
+    for (l=1; l<VGA_DENSITY_LEVELS; l++) {
+        uint32_t t = (uint32_t)ceilf(expf(log_max * l / (VGA_DENSITY_LEVELS - 1)) - 1.0f) ;
+        thresholds[l] = (t < 1) ? 1 : t ;
+    }
+
+    for (y=0; y<VGA_DENSITY_H; y++) {
+        int run_start = 0 ;
+        int run_level = levelOf(thresholds, vga_density[y][0]) ;
+        for (x=1; x<=VGA_DENSITY_W; x++) {
+            int level = (x < VGA_DENSITY_W) ? levelOf(thresholds, vga_density[y][x]) : -1 ;
+            if (level != run_level) {
+                fillRect(run_start << VGA_DENSITY_SHIFT, y << VGA_DENSITY_SHIFT,
+                         (x - run_start) << VGA_DENSITY_SHIFT, 1 << VGA_DENSITY_SHIFT, run_level) ;
+                run_start = x ;
+                run_level = level ;
+            }
+        }
+    }
+    return max ;
+}
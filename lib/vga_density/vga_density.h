@@ -0,0 +1,81 @@
+/**
+ * Density (histogram) rendering for the VGA palette modes
+ *
+ * Rather than draw each point of a fractal (an IFS attractor, the orbits
+ * of Mandelbrot points...) straight to the screen, where every hit after
+ * the first on a pixel is wasted, count the hits. vga_density_render()
+ * then tone-maps the counts onto VGA_DENSITY_LEVELS palette entries on a
+ * log scale, so the picture shows where the points are dense as well as
+ * where they are.
+ *
+ * USE
+ *  - Build with VGA_BPP 4 or 8 (vga_graphics_config(app BPP 8)), and
+ *    call vga_density_palette() after initVGA() to load a color ramp
+ *  - vga_density_add(x, y) for each point (drawing coordinates,
+ *    VGA_WIDTH x VGA_HEIGHT); it's inline, and a saturating increment of
+ *    one counter
+ *  - vga_density_render() draws the counts, as often as you like (the
+ *    counts are kept), and returns the largest
+ *  - Two cores may add at once; the odd increment lost when both hit the
+ *    same counter together doesn't show
+ *
+ * SIZE (build-time)
+ *  - VGA_DENSITY_SHIFT (default 1): each counter covers 2^shift x 2^shift
+ *    pixels, so the default is 320x240 counters at 640x480 (the VGA_BPP
+ *    8 pixel)
+ *  - VGA_DENSITY_BITS, 8 (default) or 16: the counters saturate at 255
+ *    or 65535. 320x240 8-bit counters take 76.8 kBytes, as much as the
+ *    VGA_BPP 8 pixel array.
+ *  - VGA_DENSITY_LEVELS (default 16, at most the palette size): palette
+ *    entries 0 (no hits) to LEVELS - 1 (the busiest)
+ *
+ */
+#ifndef VGA_DENSITY_LIB_H
+#define VGA_DENSITY_LIB_H
+
+#include <stdint.h>
+
+#if (VGA_BPP != 4) && (VGA_BPP != 8)
+#error "vga_density needs a palette mode (VGA_BPP 4 or 8)"
+#endif
+
+#ifndef VGA_DENSITY_SHIFT
+#define VGA_DENSITY_SHIFT 1
+#endif
+#ifndef VGA_DENSITY_BITS
+#define VGA_DENSITY_BITS 8
+#endif
+#ifndef VGA_DENSITY_LEVELS
+#define VGA_DENSITY_LEVELS 16
+#endif
+#if (VGA_DENSITY_LEVELS > (1 << VGA_BPP))
+#error "VGA_DENSITY_LEVELS is more than the palette holds"
+#endif
+
+#define VGA_DENSITY_W (VGA_WIDTH >> VGA_DENSITY_SHIFT)
+#define VGA_DENSITY_H (VGA_HEIGHT >> VGA_DENSITY_SHIFT)
+
+#if (VGA_DENSITY_BITS == 16)
+typedef uint16_t vga_density_t ;
+#define VGA_DENSITY_MAX 0xFFFF
+#else
+typedef uint8_t vga_density_t ;
+#define VGA_DENSITY_MAX 0xFF
+#endif
+
+extern vga_density_t vga_density[VGA_DENSITY_H][VGA_DENSITY_W] ;
+
+// Count a hit at (x, y). Points off the screen are dropped.
+static inline void vga_density_add(short x, short y) {
+    if ((x < 0) || (x >= VGA_WIDTH) || (y < 0) || (y >= VGA_HEIGHT)) return ;
+    vga_density_t * count = &vga_density[y >> VGA_DENSITY_SHIFT][x >> VGA_DENSITY_SHIFT] ;
+    if (*count != VGA_DENSITY_MAX) (*count)++ ;
+}
+
+void vga_density_clear(void) ;
+// Palette entry 0 to BLACK, and 1 to LEVELS - 1 spread over the n colors
+// of ramp, dimmest first (NULL for the default ramp, BLUE to WHITE)
+void vga_density_palette(const unsigned char * ramp, int n) ;
+int vga_density_render(void) ;
+
+#endif
@@ -0,0 +1,2307 @@
+/*
+* https://vanhunteradams.com/Pico/VGA/VGA.html
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hw_claim.h"
+#include "hotpath.h"
+// Our assembled programs:
+// Each gets the name <pio_filename.pio.h>
+#include "hsync.pio.h"
+#include "vsync.pio.h"
+#include "rgb.pio.h"
+// Header file
+#include "vga_graphics.h"
+// Font file
+#include "glcdfont.c"
+
+// VGA timing constants
+#define H_ACTIVE   655    // (active + frontporch - 1) - one cycle delay for mov
+#define V_ACTIVE   479    // (active - 1)
+#ifndef VGA_LOW_RES
+#define RGB_ACTIVE 319    // (horizontal active)/2 - 1
+#else
+#define RGB_ACTIVE 159    // (horizontal active)/4 - 1, each pixel sent once for two
+#endif
+// #define RGB_ACTIVE 639 // change to this if 1 pixel/byte
+
+// Bytes per scanline sent to the PIO (always 3 bits/pixel, 2 pixels per
+// byte). At low resolution the PIO shows each pixel twice as wide.
+#ifndef VGA_LOW_RES
+#define SCAN_BYTES 320
+#else
+#define SCAN_BYTES 160
+#endif
+
+#if defined(VGA_SCANLINE_MODE) && (defined(VGA_DOUBLE_BUFFER) || defined(VGA_DAMAGE_TRACKING))
+#error "VGA_SCANLINE_MODE has no framebuffer to double-buffer or track damage in"
+#endif
+
+#if (VGA_BPP != 3) && (defined(VGA_SCANLINE_MODE) || defined(VGA_DOUBLE_BUFFER))
+#error "VGA_SCANLINE_MODE and VGA_DOUBLE_BUFFER need VGA_BPP 3"
+#endif
+
+#if defined(VGA_SCROLL) && (defined(VGA_SCANLINE_MODE) || defined(VGA_DOUBLE_BUFFER))
+#error "VGA_SCROLL needs the single pixel array (no VGA_SCANLINE_MODE or VGA_DOUBLE_BUFFER)"
+#endif
+
+#if defined(VGA_LOW_RES) && ((VGA_BPP != 3) || defined(VGA_SCANLINE_MODE))
+#error "VGA_LOW_RES needs VGA_BPP 3 and a pixel array (no VGA_SCANLINE_MODE)"
+#endif
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Pixel format =====================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Drawing coordinates are 640x480 (320x240 with VGA_LOW_RES, where each
+// drawing pixel is 2x2 screen pixels). Each format says how many drawing
+// pixels share a byte of the pixel array, where in its byte a pixel's
+// bits live, and how many drawing lines share a row.
+//
+//   PIXELS_PER_BYTE   screen pixels per byte (PPB_SHIFT is its log2)
+//   PIXEL_SHIFT(x)    position of screen pixel x's bits in its byte
+//   PIXEL_MASK        those bits, before the shift
+//   PIXEL_VALUE(c)    the bits for color c
+//   FILL_BYTE(c)      a whole byte of color c
+//   ROW_SHIFT         log2 of the screen lines per row
+#if VGA_BPP == 1
+// 640x480 monochrome: 8 pixels per byte, pixel x in bit (x & 7).
+// Any nonzero color is 'on' (palette entry 1).
+#define PIXELS_PER_BYTE 8
+#define PPB_SHIFT       3
+#define PIXEL_SHIFT(x)  ((x) & 7)
+#define PIXEL_MASK      0x1
+#define PIXEL_VALUE(c)  ((c) ? 1 : 0)
+#define FILL_BYTE(c)    ((c) ? 0xFF : 0x00)
+#define ROW_SHIFT       0
+#elif VGA_BPP == 3
+// 640x480, 8 colors: even pixel in bits 0-2, odd pixel in bits 3-5.
+// This is also the format of every scanline sent to the PIO.
+#define PIXELS_PER_BYTE 2
+#define PPB_SHIFT       1
+#define PIXEL_SHIFT(x)  (((x) & 1) * 3)
+#define PIXEL_MASK      0x7
+#define PIXEL_VALUE(c)  (c)
+#define FILL_BYTE(c)    ((c) | ((c) << 3))
+#define PIXEL_PAIR(a,b) ((a) | ((b) << 3))
+#if !defined(VGA_DOUBLE_BUFFER) || defined(VGA_LOW_RES)
+#define ROW_SHIFT       0
+#else
+#define ROW_SHIFT       1
+#endif
+#elif VGA_BPP == 4
+// 640x480, 16 palette entries: even pixel in the low nibble, odd in the high
+#define PIXELS_PER_BYTE 2
+#define PPB_SHIFT       1
+#define PIXEL_SHIFT(x)  (((x) & 1) << 2)
+#define PIXEL_MASK      0xF
+#define PIXEL_VALUE(c)  ((c) & 0xF)
+#define FILL_BYTE(c)    (((c) & 0xF) * 0x11)
+#define PIXEL_PAIR(a,b) (((a) & 0xF) | (((b) & 0xF) << 4))
+#define ROW_SHIFT       0
+#elif VGA_BPP == 8
+// 320x240, 256 palette entries: one byte per pixel. (640x480 at a byte
+// per pixel would be 300 kBytes.) Each pixel covers 2x2 screen pixels.
+#define PIXELS_PER_BYTE 2
+#define PPB_SHIFT       1
+#define PIXEL_SHIFT(x)  0
+#define PIXEL_MASK      0xFF
+#define PIXEL_VALUE(c)  ((unsigned char)(c))
+#define FILL_BYTE(c)    ((unsigned char)(c))
+#define PIXEL_PAIR(a,b) ((unsigned char)(b))
+#define ROW_SHIFT       1
+#else
+#error "VGA_BPP must be 1, 3, 4 or 8"
+#endif
+
+// Bytes per row of the pixel array, rows in the array, and its size
+#define LINE_BYTES (VGA_WIDTH / PIXELS_PER_BYTE)
+#define FB_ROWS    (VGA_HEIGHT >> ROW_SHIFT)
+#define FB_BYTES   (LINE_BYTES * FB_ROWS)
+
+// Row of the pixel array that screen line 'line' (of 480) shows, for the
+// modes that scan out through a list of line addresses
+#ifndef VGA_LOW_RES
+#define SCAN_ROW(line) ((line) >> ROW_SHIFT)
+#else
+#define SCAN_ROW(line) ((line) >> 1)
+#endif
+
+// Byte of a row holding screen pixel x, and the row holding screen line y
+#define PIXEL_BYTE(x) ((x) >> PPB_SHIFT)
+#define ROW_INDEX(y)  ((y) >> ROW_SHIFT)
+
+// Formats other than 3 bits/pixel are expanded a scanline at a time
+// into a small ring of buffers that the DMA channels stream to the PIO,
+// the same way scanline mode works.
+#if defined(VGA_SCANLINE_MODE) || (VGA_BPP != 3)
+#define VGA_LINE_RING
+#endif
+
+#ifdef VGA_LINE_RING
+
+// Each buffer in the ring is refilled (by a callback, from the display
+// list, or from the pixel array) as soon as its line has been sent.
+#ifndef VGA_SCANLINE_BUFFERS
+#define VGA_SCANLINE_BUFFERS 8      // must be a power of two
+#endif
+#define NUM_LINES  480              // scanlines per frame
+
+#if (VGA_SCANLINE_BUFFERS & (VGA_SCANLINE_BUFFERS - 1)) || (VGA_SCANLINE_BUFFERS < 2)
+#error "VGA_SCANLINE_BUFFERS must be a power of two"
+#endif
+
+unsigned char vga_line_buffers[VGA_SCANLINE_BUFFERS][SCAN_BYTES] __attribute__((aligned(4))) ;
+
+// Addresses of the line buffers. The control channel reads these in a
+// ring (so the list must be aligned to its size) and never needs a restart.
+unsigned char * vga_line_ring[VGA_SCANLINE_BUFFERS]
+    __attribute__((aligned(VGA_SCANLINE_BUFFERS * 4))) ;
+
+// Screen line that was last sent to the PIO, and the ring slot it used.
+// (480 need not be a multiple of the ring size, so these are kept apart.)
+volatile int vga_scan_line = 0 ;
+volatile int vga_scan_slot = 0 ;
+
+// DMA channels (assigned in initVGA)
+int rgb_chan_0, rgb_chan_1 ;
+
+#endif
+
+#if defined(VGA_SCANLINE_MODE)
+
+// Scanline mode. There is no pixel array at all: lines are drawn
+// straight into the ring.
+
+#elif (VGA_BPP != 3)
+
+// Pixel array in the selected format. Scanlines are expanded from it.
+unsigned char vga_data_array[FB_BYTES] __attribute__((aligned(4))) ;
+
+#elif !defined(VGA_DOUBLE_BUFFER)
+
+// Pixel color array that is DMA's to the PIO machines and
+// a pointer to the ADDRESS of this color array.
+// Note that this array is automatically initialized to all 0's (black)
+unsigned char vga_data_array[FB_BYTES] __attribute__((aligned(4)));
+char * address_pointer = &vga_data_array[0] ;
+
+#if defined(VGA_SCROLL) || defined(VGA_LOW_RES)
+// Scrolling, or low resolution. The array is sent a line at a time, from
+// the read address of every scanline in this list (NULL-terminated, as
+// in double-buffered mode, with just the one list). Scrolling rewrites
+// the list, never the pixels. At low resolution each row of the array
+// is in the list twice, so it's scanned out on two lines.
+#define NUM_LINES  480              // scanlines per frame
+unsigned char * vga_line_list[1][NUM_LINES + 1] ;
+
+// DMA channels (assigned in initVGA)
+int rgb_chan_0, rgb_chan_1 ;
+#endif
+
+#else
+
+// Double-buffered mode. Two 640x240 buffers fit in the space of
+// the single 640x480 one. Each buffer row is sent to the PIO
+// machines twice, so the screen is still 480 lines tall. (At low
+// resolution, the buffers are 320x240 and the rows are still sent
+// twice, so each buffer is the whole picture, in 38.4 kBytes.)
+#define NUM_LINES  480              // scanlines per frame
+
+unsigned char vga_buffers[2][FB_BYTES] __attribute__((aligned(4))) ;
+
+// For each buffer, the read address of every scanline, followed by
+// a NULL. The control channel walks one of these lists, writing
+// each address to the color channel's read-address trigger. The
+// NULL ends the chain and raises an IRQ at the end of each frame.
+unsigned char * vga_line_list[2][NUM_LINES + 1] ;
+
+// Index of the buffer being scanned out, and of the buffer that
+// should be shown at the next frame boundary (-1 if none)
+volatile int vga_front = 0 ;
+volatile int vga_pending = -1 ;
+
+// The primitives all draw into the back buffer
+unsigned char * volatile vga_data_array = &vga_buffers[1][0] ;
+
+// DMA channels (assigned in initVGA)
+int rgb_chan_0, rgb_chan_1 ;
+
+#endif
+
+// For drawLine
+#define swap(a, b) { short t = a; a = b; b = t; }
+
+// For writing text
+#define tabspace 4 // number of spaces for a tab
+
+// For accessing the font library
+#define pgm_read_byte(addr) (*(const unsigned char *)(addr))
+
+// For drawing characters
+unsigned short cursor_y, cursor_x, textsize ;
+char textcolor, textbgcolor, wrap;
+
+// Screen width/height, in drawing coordinates
+#define _width VGA_WIDTH
+#define _height VGA_HEIGHT
+
+#if defined(VGA_DOUBLE_BUFFER) || (defined(VGA_SCROLL) && !defined(VGA_LINE_RING)) || defined(VGA_LOW_RES)
+static void vga_frame_handler(void) ;
+#endif
+
+#if defined(VGA_SCROLL) && !defined(VGA_LINE_RING)
+static void buildScrollList(void) ;
+#endif
+
+#ifdef VGA_SCROLL
+
+// The scroll region is screen lines top <= y < bottom. Screen line
+// top + i shows pixel array line top + ((i + offset) % (bottom - top)).
+// An empty region (top == bottom) is no scrolling at all.
+static short scroll_top = 0, scroll_bottom = 0, scroll_offset = 0 ;
+
+// Changes are made here and latched at the next frame boundary, so a
+// frame is never scanned out from two different offsets
+static short next_scroll_top = 0, next_scroll_bottom = 0, next_scroll_offset = 0 ;
+static volatile char scroll_dirty = 0 ;
+
+// Pixel array line shown at screen line y, for the given region and offset
+static HOT_INLINE short scrollMap(short y, short top, short bottom, short offset) {
+    if ((y < top) || (y >= bottom)) return y ;
+    int i = y - top + offset ;
+    if (i >= (bottom - top)) i -= (bottom - top) ;
+    return top + i ;
+}
+
+// Take any scroll change. Called from the frame boundary interrupt.
+static HOT_INLINE char latchScroll() {
+    if (!scroll_dirty) return 0 ;
+    scroll_dirty = 0 ;
+    scroll_top = next_scroll_top ;
+    scroll_bottom = next_scroll_bottom ;
+    scroll_offset = next_scroll_offset ;
+    return 1 ;
+}
+
+#endif
+
+static void vga_vblank_handler(void) ;
+
+#ifdef VGA_LINE_RING
+static void vga_line_handler(void) ;
+static void renderLine(short line, unsigned char * buf) ;
+#endif
+
+#if defined(VGA_LINE_RING) && !defined(VGA_SCANLINE_MODE)
+static void initExpand(void) ;
+#endif
+
+#ifdef VGA_TEXT_MODE
+static void initText(void) ;
+#endif
+
+// Set screen pixel x of one row of packed pixels
+static HOT_INLINE void setPixel(unsigned char * line, int x, char color) {
+    unsigned char * p = &line[PIXEL_BYTE(x)] ;
+    *p = (*p & ~(PIXEL_MASK << PIXEL_SHIFT(x))) | (PIXEL_VALUE(color) << PIXEL_SHIFT(x)) ;
+}
+
+// Fill pixels x0 through x1-1 of one line of packed pixels. Pixels at
+// either end that share a byte with pixels outside the span get a
+// read-modify-write. Everything between is whole bytes of the same
+// color, which memset fills a word at a time.
+static HOT_INLINE void fillBytes(unsigned char * line, int x0, int x1, char color) {
+    while ((x0 & (PIXELS_PER_BYTE - 1)) && (x0 < x1)) {
+        setPixel(line, x0++, color) ;
+    }
+    while ((x1 & (PIXELS_PER_BYTE - 1)) && (x1 > x0)) {
+        setPixel(line, --x1, color) ;
+    }
+    if (x1 > x0) {
+        memset(&line[PIXEL_BYTE(x0)], FILL_BYTE(color), PIXEL_BYTE(x1 - x0)) ;
+    }
+}
+
+#ifdef VGA_DAMAGE_TRACKING
+
+// Number of rows in the pixel array
+#define PIXEL_ROWS FB_ROWS
+
+// Damaged pixels x0 <= x < x1 of each row of the pixel array. A row is
+// clean when x1 <= x0 (so the all-zero initial state is clean).
+short damage_x0[PIXEL_ROWS] ;
+short damage_x1[PIXEL_ROWS] ;
+
+// Range of rows that might be damaged (first, last+1)
+int damage_row0 = PIXEL_ROWS ;
+int damage_row1 = 0 ;
+
+// Record that pixels x0 <= x < x1 of rows row0 through row1 changed
+static void HOT_KERNEL(markDamage)(int row0, int row1, int x0, int x1) {
+    for (int row=row0; row<=row1; row++) {
+        if (damage_x1[row] <= damage_x0[row]) {
+            damage_x0[row] = x0 ;
+            damage_x1[row] = x1 ;
+        }
+        else {
+            if (x0 < damage_x0[row]) damage_x0[row] = x0 ;
+            if (x1 > damage_x1[row]) damage_x1[row] = x1 ;
+        }
+    }
+    if (row0 < damage_row0) damage_row0 = row0 ;
+    if (row1 >= damage_row1) damage_row1 = row1 + 1 ;
+}
+#define DAMAGE(row0, row1, x0, x1) markDamage(row0, row1, x0, x1)
+
+#else
+#define DAMAGE(row0, row1, x0, x1)
+#endif
+
+void initVGA() {
+        // Choose which PIO instance to use (there are two instances, each with 4 state machines)
+    PIO pio = pio0;
+
+    // Our assembled programs need to be loaded into this PIO's instruction
+    // memory, and each needs a state machine. hw_claim finds a location
+    // (offset) in the instruction memory where there is enough space for
+    // each program, and a free state machine, and stops with a message
+    // saying who has them if there isn't one. We need to remember these!
+    //
+    // The programs signal each other with PIO 0's IRQ flags 4 and 5 (which
+    // only state machines see), and the CPU with flag 2, so they all run on
+    // pio0.
+    //
+    // The program name comes from the .program part of the pio file
+    // and is of the form <program name_program>
+    uint hsync_offset = hw_add_program(pio, &hsync_program, "vga");
+    uint vsync_offset = hw_add_program(pio, &vsync_program, "vga");
+#ifndef VGA_LOW_RES
+    uint rgb_offset = hw_add_program(pio, &rgb_program, "vga");
+#else
+    uint rgb_offset = hw_add_program(pio, &rgb_double_program, "vga");
+#endif
+
+    uint hsync_sm = hw_claim_sm(pio, "vga");
+    uint vsync_sm = hw_claim_sm(pio, "vga");
+    uint rgb_sm = hw_claim_sm(pio, "vga");
+    hw_claim_pio_irq(pio, 2, "vga");
+    hw_claim_pio_irq(pio, 4, "vga");
+    hw_claim_pio_irq(pio, 5, "vga");
+
+    // Call the initialization functions that are defined within each PIO file.
+    // Why not create these programs here? By putting the initialization function in
+    // the pio file, then all information about how to use/setup that state machine
+    // is consolidated in one place. Here in the C, we then just import and use it.
+    hsync_program_init(pio, hsync_sm, hsync_offset, HSYNC);
+    vsync_program_init(pio, vsync_sm, vsync_offset, VSYNC);
+#ifndef VGA_LOW_RES
+    rgb_program_init(pio, rgb_sm, rgb_offset, RED_PIN);
+#else
+    rgb_double_program_init(pio, rgb_sm, rgb_offset, RED_PIN);
+#endif
+
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    // ============================== PIO DMA Channels =================================================
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifdef VGA_LINE_RING
+
+    // DMA channels - 0 sends one scanline buffer, 1 writes the address of
+    // the next buffer in the ring to 0's read-address trigger
+    rgb_chan_0 = hw_claim_dma("vga");
+    rgb_chan_1 = hw_claim_dma("vga");
+
+#ifdef VGA_TEXT_MODE
+    initText() ;
+#endif
+#ifndef VGA_SCANLINE_MODE
+    initExpand() ;
+#endif
+
+    // Fill the ring with the first lines of the frame
+    for (int i=0; i<VGA_SCANLINE_BUFFERS; i++) {
+        vga_line_ring[i] = &vga_line_buffers[i][0] ;
+        renderLine(i, vga_line_ring[i]) ;
+    }
+
+    // Channel Zero (sends one line of color data to PIO VGA machine)
+    dma_channel_config c0 = dma_channel_get_default_config(rgb_chan_0);  // default configs
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_8);              // 8-bit txfers
+    channel_config_set_read_increment(&c0, true);                        // yes read incrementing
+    channel_config_set_write_increment(&c0, false);                      // no write incrementing
+    channel_config_set_dreq(&c0, pio_get_dreq(pio, rgb_sm, true));       // RGB TX FIFO pacing
+    channel_config_set_chain_to(&c0, rgb_chan_1);                        // chain to other channel
+
+    dma_channel_configure(
+        rgb_chan_0,                 // Channel to be configured
+        &c0,                        // The configuration we just created
+        &pio->txf[rgb_sm],          // write address (RGB PIO TX FIFO)
+        vga_line_ring[0],           // The initial read address (first line)
+        SCAN_BYTES,                 // Number of transfers; one scanline of bytes.
+        false                       // Don't start immediately.
+    );
+
+    // Channel One (walks the ring of buffer addresses, triggering the first channel)
+    dma_channel_config c1 = dma_channel_get_default_config(rgb_chan_1);   // default configs
+    channel_config_set_transfer_data_size(&c1, DMA_SIZE_32);              // 32-bit txfers
+    channel_config_set_read_increment(&c1, true);                         // yes read incrementing
+    channel_config_set_write_increment(&c1, false);                       // no write incrementing
+    channel_config_set_ring(&c1, false, __builtin_ctz(sizeof(vga_line_ring))); // wrap the read address
+
+    dma_channel_configure(
+        rgb_chan_1,                             // Channel to be configured
+        &c1,                                    // The configuration we just created
+        &dma_hw->ch[rgb_chan_0].al3_read_addr_trig, // Write address (channel 0 read address trigger)
+        &vga_line_ring[0],                      // Read address (ring of line buffer addresses)
+        1,                                      // Number of transfers, in this case each is 4 byte
+        false                                   // Don't start immediately.
+    );
+
+    // Each finished line raises DMA_IRQ_1, where the freed buffer is refilled.
+    // The IRQ is handled by the core that calls initVGA.
+    dma_channel_set_irq1_enabled(rgb_chan_0, true);
+    irq_add_shared_handler(DMA_IRQ_1, vga_line_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+#elif !defined(VGA_DOUBLE_BUFFER) && !defined(VGA_SCROLL) && !defined(VGA_LOW_RES)
+
+    // DMA channels - 0 sends color data, 1 reconfigures and restarts 0
+    int rgb_chan_0 = hw_claim_dma("vga");
+    int rgb_chan_1 = hw_claim_dma("vga");
+
+    // Channel Zero (sends color data to PIO VGA machine)
+    dma_channel_config c0 = dma_channel_get_default_config(rgb_chan_0);  // default configs
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_8);              // 8-bit txfers
+    channel_config_set_read_increment(&c0, true);                        // yes read incrementing
+    channel_config_set_write_increment(&c0, false);                      // no write incrementing
+    channel_config_set_dreq(&c0, pio_get_dreq(pio, rgb_sm, true));       // RGB TX FIFO pacing
+    channel_config_set_chain_to(&c0, rgb_chan_1);                        // chain to other channel
+
+    dma_channel_configure(
+        rgb_chan_0,                 // Channel to be configured
+        &c0,                        // The configuration we just created
+        &pio->txf[rgb_sm],          // write address (RGB PIO TX FIFO)
+        &vga_data_array,            // The initial read address (pixel color array)
+        FB_BYTES,                   // Number of transfers; in this case each is 1 byte.
+        false                       // Don't start immediately.
+    );
+
+    // Channel One (reconfigures the first channel)
+    dma_channel_config c1 = dma_channel_get_default_config(rgb_chan_1);   // default configs
+    channel_config_set_transfer_data_size(&c1, DMA_SIZE_32);              // 32-bit txfers
+    channel_config_set_read_increment(&c1, false);                        // no read incrementing
+    channel_config_set_write_increment(&c1, false);                       // no write incrementing
+    channel_config_set_chain_to(&c1, rgb_chan_0);                         // chain to other channel
+
+    dma_channel_configure(
+        rgb_chan_1,                         // Channel to be configured
+        &c1,                                // The configuration we just created
+        &dma_hw->ch[rgb_chan_0].read_addr,  // Write address (channel 0 read address)
+        &address_pointer,                   // Read address (POINTER TO AN ADDRESS)
+        1,                                  // Number of transfers, in this case each is 4 byte
+        false                               // Don't start immediately.
+    );
+
+#else
+
+    // DMA channels - 0 sends one scanline of color data, 1 writes the
+    // address of the next scanline to 0's read-address trigger
+    rgb_chan_0 = hw_claim_dma("vga");
+    rgb_chan_1 = hw_claim_dma("vga");
+
+#ifdef VGA_DOUBLE_BUFFER
+    // Build the scanline lists. Row r of each buffer feeds lines 2r and 2r+1.
+    for (int b=0; b<2; b++) {
+        for (int line=0; line<NUM_LINES; line++) {
+            vga_line_list[b][line] = &vga_buffers[b][SCAN_ROW(line)*LINE_BYTES] ;
+        }
+        vga_line_list[b][NUM_LINES] = NULL ;
+    }
+#elif defined(VGA_SCROLL)
+    // One list, unscrolled to start with
+    buildScrollList() ;
+    vga_line_list[0][NUM_LINES] = NULL ;
+#else
+    // One list, which never changes. Row r feeds lines 2r and 2r+1.
+    for (int line=0; line<NUM_LINES; line++) {
+        vga_line_list[0][line] = &vga_data_array[SCAN_ROW(line)*LINE_BYTES] ;
+    }
+    vga_line_list[0][NUM_LINES] = NULL ;
+#endif
+
+    // Channel Zero (sends one line of color data to PIO VGA machine)
+    dma_channel_config c0 = dma_channel_get_default_config(rgb_chan_0);  // default configs
+    channel_config_set_transfer_data_size(&c0, DMA_SIZE_8);              // 8-bit txfers
+    channel_config_set_read_increment(&c0, true);                        // yes read incrementing
+    channel_config_set_write_increment(&c0, false);                      // no write incrementing
+    channel_config_set_dreq(&c0, pio_get_dreq(pio, rgb_sm, true));       // RGB TX FIFO pacing
+    channel_config_set_chain_to(&c0, rgb_chan_1);                        // chain to other channel
+    channel_config_set_irq_quiet(&c0, true);                             // IRQ only on NULL trigger
+
+    dma_channel_configure(
+        rgb_chan_0,                 // Channel to be configured
+        &c0,                        // The configuration we just created
+        &pio->txf[rgb_sm],          // write address (RGB PIO TX FIFO)
+        vga_line_list[0][0],        // The initial read address (first line)
+        SCAN_BYTES,                 // Number of transfers; one scanline of bytes.
+        false                       // Don't start immediately.
+    );
+
+    // Channel One (walks the scanline list, triggering the first channel)
+    dma_channel_config c1 = dma_channel_get_default_config(rgb_chan_1);   // default configs
+    channel_config_set_transfer_data_size(&c1, DMA_SIZE_32);              // 32-bit txfers
+    channel_config_set_read_increment(&c1, true);                         // yes read incrementing
+    channel_config_set_write_increment(&c1, false);                       // no write incrementing
+
+    dma_channel_configure(
+        rgb_chan_1,                             // Channel to be configured
+        &c1,                                    // The configuration we just created
+        &dma_hw->ch[rgb_chan_0].al3_read_addr_trig, // Write address (channel 0 read address trigger)
+        &vga_line_list[0][0],                   // Read address (list of line addresses)
+        1,                                      // Number of transfers, in this case each is 4 byte
+        false                                   // Don't start immediately.
+    );
+
+    // The NULL at the end of each list raises DMA_IRQ_1, where we latch
+    // any pending swap (or scroll) and restart the list for the next frame
+    dma_channel_set_irq1_enabled(rgb_chan_0, true);
+    irq_add_shared_handler(DMA_IRQ_1, vga_frame_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+    irq_set_enabled(DMA_IRQ_1, true);
+
+#endif
+
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+    /////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    // Initialize PIO state machine counters. This passes the information to the state machines
+    // that they retrieve in the first 'pull' instructions, before the .wrap_target directive
+    // in the assembly. Each uses these values to initialize some counting registers.
+    pio_sm_put_blocking(pio, hsync_sm, H_ACTIVE);
+    pio_sm_put_blocking(pio, vsync_sm, V_ACTIVE);
+    pio_sm_put_blocking(pio, rgb_sm, RGB_ACTIVE);
+
+    // The vsync machine sets IRQ 2 at the start of vertical blanking, which
+    // counts frames (vga_frame()) from PIO0_IRQ_1, on the core that calls
+    // initVGA
+    pio_set_irq1_source_enabled(pio, pis_interrupt2, true) ;
+    irq_add_shared_handler(PIO0_IRQ_1, vga_vblank_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY) ;
+    irq_set_enabled(PIO0_IRQ_1, true) ;
+
+
+    // Start the two pio machine IN SYNC
+    // Note that the RGB state machine is running at full speed,
+    // so synchronization doesn't matter for that one. But, we'll
+    // start them all simultaneously anyway.
+    pio_enable_sm_mask_in_sync(pio, ((1u << hsync_sm) | (1u << vsync_sm) | (1u << rgb_sm)));
+
+    // Start DMA channel 0. Once started, the contents of the pixel color array
+    // will be continously DMA's to the PIO machines that are driving the screen.
+    // To change the contents of the screen, we need only change the contents
+    // of that array.
+#if !defined(VGA_DOUBLE_BUFFER) && !defined(VGA_SCROLL) && !defined(VGA_LINE_RING) && !defined(VGA_LOW_RES)
+    dma_start_channel_mask((1u << rgb_chan_0)) ;
+#else
+    // (With a line list or ring, the control channel starts first so
+    // that it can hand the color channel the first line address.)
+    dma_start_channel_mask((1u << rgb_chan_1)) ;
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Frame pacing =====================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Frames begun since initVGA, counted as each one's active lines end
+static volatile unsigned int vga_frames = 0 ;
+
+static void HOT_ISR(vga_vblank_handler)() {
+    // PIO0_IRQ_1 may be shared, so check that it's ours
+    if (!pio_interrupt_get(pio0, 2)) return ;
+    pio_interrupt_clear(pio0, 2) ;
+    vga_frames++ ;
+}
+
+// Number of the frame being shown: it goes up by one at the start of each
+// vertical blanking interval (60 times a second), when the last line of
+// the frame before has been scanned out
+unsigned int vga_frame() {
+    return vga_frames ;
+}
+
+// Returns 1 if refresh 'frame' + n has already begun ('frame' being a
+// vga_frame() from earlier), i.e. drawing that started at 'frame' missed
+// the vertical blanking n refreshes on that it was meant to be done by
+char vga_frame_overrun(unsigned int frame, unsigned int n) {
+    return (vga_frames - frame) >= n ;
+}
+
+// Block until the next vertical blanking interval begins
+void vga_wait_vblank() {
+    unsigned int frame = vga_frames ;
+    while (vga_frames == frame) {
+        tight_loop_contents() ;
+    }
+}
+
+#ifdef VGA_DOUBLE_BUFFER
+
+// End-of-frame interrupt. Runs at the start of vertical blanking, when the
+// control channel writes the NULL at the end of a scanline list.
+static void HOT_ISR(vga_frame_handler)() {
+    // DMA_IRQ_1 is shared with the blitter, so check that it's ours
+    if (!(dma_hw->ints1 & (1u << rgb_chan_0))) return ;
+
+    // Clear the interrupt
+    dma_hw->ints1 = (1u << rgb_chan_0) ;
+
+    // Latch a requested swap. The old front buffer becomes the back buffer.
+    if (vga_pending >= 0) {
+        vga_front = vga_pending ;
+        vga_data_array = &vga_buffers[vga_front ^ 1][0] ;
+        vga_pending = -1 ;
+    }
+
+    // Restart the control channel at the top of the front buffer's list
+    dma_channel_set_read_addr(rgb_chan_1, &vga_line_list[vga_front][0], true) ;
+}
+
+// Ask for the back buffer to be shown at the next frame boundary. Don't
+// draw again until vga_swap_pending() returns 0, since until then the
+// primitives still point at the buffer that is about to be displayed.
+void vga_request_swap() {
+    if (vga_pending < 0) vga_pending = vga_front ^ 1 ;
+}
+
+// Returns 1 while a requested swap has not yet been latched. In a
+// protothread, use PT_YIELD_UNTIL(pt, !vga_swap_pending()) ;
+char vga_swap_pending() {
+    return (vga_pending >= 0) ;
+}
+
+// Show the back buffer, blocking until the swap is latched at the
+// next frame boundary. Note that the new back buffer holds the frame
+// from before last, so it should be redrawn completely.
+void vga_swap_buffers() {
+    vga_request_swap() ;
+    while (vga_swap_pending()) {
+        tight_loop_contents() ;
+    }
+}
+
+#endif
+
+#if defined(VGA_LOW_RES) && !defined(VGA_DOUBLE_BUFFER) && !defined(VGA_SCROLL)
+
+// End-of-frame interrupt, as in double-buffered mode, with only the one
+// list to restart
+static void HOT_ISR(vga_frame_handler)() {
+    // DMA_IRQ_1 is shared with the blitter, so check that it's ours
+    if (!(dma_hw->ints1 & (1u << rgb_chan_0))) return ;
+    dma_hw->ints1 = (1u << rgb_chan_0) ;
+    dma_channel_set_read_addr(rgb_chan_1, &vga_line_list[0][0], true) ;
+}
+
+#endif
+
+#ifdef VGA_SCROLL
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Scrolling ========================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#ifndef VGA_LINE_RING
+
+// Point every scanline of the list at the array line it should show
+static void HOT_ISR(buildScrollList)() {
+    for (int line=0; line<NUM_LINES; line++) {
+        short y = scrollMap(SCAN_ROW(line), scroll_top, scroll_bottom, scroll_offset) ;
+        vga_line_list[0][line] = &vga_data_array[y * LINE_BYTES] ;
+    }
+}
+
+// End-of-frame interrupt, as in double-buffered mode. A scroll change
+// rewrites the list here, during vertical blanking, before it restarts.
+static void HOT_ISR(vga_frame_handler)() {
+    // DMA_IRQ_1 is shared with the blitter, so check that it's ours
+    if (!(dma_hw->ints1 & (1u << rgb_chan_0))) return ;
+    dma_hw->ints1 = (1u << rgb_chan_0) ;
+
+    if (latchScroll()) buildScrollList() ;
+
+    // Restart the control channel at the top of the list
+    dma_channel_set_read_addr(rgb_chan_1, &vga_line_list[0][0], true) ;
+}
+
+#endif
+
+// Scroll screen lines top <= y < bottom as a circular region (the rest of
+// the screen stays put), starting unscrolled. top == bottom turns
+// scrolling off. Like all the scroll functions, this takes effect at the
+// start of the next frame.
+void vga_set_scroll_region(short top, short bottom) {
+    if (top < 0) top = 0 ;
+    if (bottom > _height) bottom = _height ;
+    if (bottom < top) bottom = top ;
+    next_scroll_top = top ;
+    next_scroll_bottom = bottom ;
+    next_scroll_offset = 0 ;
+    scroll_dirty = 1 ;
+}
+
+// Move the contents of the region up by 'lines' (down if negative). The
+// lines that leave the top come back in at the bottom, so after
+// vga_scroll(1) the bottom line of the region, vga_scroll_line(bottom-1),
+// is the one to redraw.
+void vga_scroll(short lines) {
+    int h = next_scroll_bottom - next_scroll_top ;
+    if (h <= 0) return ;
+    int offset = (next_scroll_offset + lines) % h ;
+    if (offset < 0) offset += h ;
+    next_scroll_offset = offset ;
+    scroll_dirty = 1 ;
+}
+
+// Drawing line (for the primitives) that screen line y shows once the
+// latest scroll has taken effect
+short vga_scroll_line(short y) {
+    return scrollMap(y, next_scroll_top, next_scroll_bottom, next_scroll_offset) ;
+}
+
+// Returns 1 while a scroll change has not yet been latched. Until then,
+// the line that vga_scroll_line() names for the bottom of the region may
+// still be on screen at the top of it.
+char vga_scroll_pending() {
+    return scroll_dirty ;
+}
+
+#endif
+
+
+#ifndef VGA_SCANLINE_MODE
+
+// A function for drawing a pixel with a specified color.
+// Note that because information is passed to the PIO state machines through
+// a DMA channel, we only need to modify the contents of the array and the
+// pixels will be automatically updated on the screen.
+void HOT_KERNEL(drawPixel)(short x, short y, char color) {
+    // Range checks (640x480 display, or 320x240 at low resolution)
+    if (x > _width - 1) x = _width - 1 ;
+    if (x < 0) x = 0 ;
+    if (y < 0) y = 0 ;
+    if (y > _height - 1) y = _height - 1 ;
+
+    // Which row of the pixel array is it? (In double-buffered mode and
+    // at 8 bits/pixel, each row is shown on two scanlines.)
+    y = ROW_INDEX(y) ;
+
+    DAMAGE(y, y, x, x+1) ;
+
+    // Mask this pixel's bits into its byte
+    setPixel(&vga_data_array[y * LINE_BYTES], x, color) ;
+}
+
+// Fill pixels x0 through x1-1 of one row of the pixel array
+static inline void fillSpan(int row, int x0, int x1, char color) {
+    DAMAGE(row, row, x0, x1) ;
+    fillBytes(&vga_data_array[row * LINE_BYTES], x0, x1, color) ;
+}
+
+void drawVLine(short x, short y, short h, char color) {
+    // Clip once, rather than per pixel
+    int y0 = y ;
+    int y1 = y + h ;
+    if ((x < 0) || (x >= _width)) return ;
+    if (y0 < 0) y0 = 0 ;
+    if (y1 > _height) y1 = _height ;
+    if (y1 <= y0) return ;
+
+    // Every pixel in the line lives in the same bits of its byte
+    unsigned char mask = (unsigned char)~(PIXEL_MASK << PIXEL_SHIFT(x)) ;
+    unsigned char bits = PIXEL_VALUE(color) << PIXEL_SHIFT(x) ;
+    DAMAGE(ROW_INDEX(y0), ROW_INDEX(y1 - 1), x, x+1) ;
+
+    // Step down the column one row of the pixel array at a time
+    unsigned char * p = &vga_data_array[(ROW_INDEX(y0) * LINE_BYTES) + PIXEL_BYTE(x)] ;
+    for (int row = ROW_INDEX(y0); row <= ROW_INDEX(y1 - 1); row++) {
+        *p = (*p & mask) | bits ;
+        p += LINE_BYTES ;
+    }
+}
+
+void drawHLine(short x, short y, short w, char color) {
+    // Clip once, rather than per pixel
+    int x0 = x ;
+    int x1 = x + w ;
+    if ((y < 0) || (y >= _height)) return ;
+    if (x0 < 0) x0 = 0 ;
+    if (x1 > _width) x1 = _width ;
+    if (x1 <= x0) return ;
+
+    fillSpan(ROW_INDEX(y), x0, x1, color) ;
+}
+
+// Bresenham's algorithm - thx wikipedia and thx Bruce!
+void drawLine(short x0, short y0, short x1, short y1, char color) {
+/* Draw a straight line from (x0,y0) to (x1,y1) with given color
+ * Parameters:
+ *      x0: x-coordinate of starting point of line. The x-coordinate of
+ *          the top-left of the screen is 0. It increases to the right.
+ *      y0: y-coordinate of starting point of line. The y-coordinate of
+ *          the top-left of the screen is 0. It increases to the bottom.
+ *      x1: x-coordinate of ending point of line. The x-coordinate of
+ *          the top-left of the screen is 0. It increases to the right.
+ *      y1: y-coordinate of ending point of line. The y-coordinate of
+ *          the top-left of the screen is 0. It increases to the bottom.
+ *      color: 3-bit color value for line
+ */
+      short steep = abs(y1 - y0) > abs(x1 - x0);
+      if (steep) {
+        swap(x0, y0);
+        swap(x1, y1);
+      }
+
+      if (x0 > x1) {
+        swap(x0, x1);
+        swap(y0, y1);
+      }
+
+      short dx, dy;
+      dx = x1 - x0;
+      dy = abs(y1 - y0);
+
+      short err = dx / 2;
+      short ystep;
+
+      if (y0 < y1) {
+        ystep = 1;
+      } else {
+        ystep = -1;
+      }
+
+      for (; x0<=x1; x0++) {
+        if (steep) {
+          drawPixel(y0, x0, color);
+        } else {
+          drawPixel(x0, y0, color);
+        }
+        err -= dy;
+        if (err < 0) {
+          y0 += ystep;
+          err += dx;
+        }
+      }
+}
+
+// Draw a rectangle
+void drawRect(short x, short y, short w, short h, char color) {
+/* Draw a rectangle outline with top left vertex (x,y), width w
+ * and height h at given color
+ * Parameters:
+ *      x:  x-coordinate of top-left vertex. The x-coordinate of
+ *          the top-left of the screen is 0. It increases to the right.
+ *      y:  y-coordinate of top-left vertex. The y-coordinate of
+ *          the top-left of the screen is 0. It increases to the bottom.
+ *      w:  width of the rectangle
+ *      h:  height of the rectangle
+ *      color:  16-bit color of the rectangle outline
+ * Returns: Nothing
+ */
+  drawHLine(x, y, w, color);
+  drawHLine(x, y+h-1, w, color);
+  drawVLine(x, y, h, color);
+  drawVLine(x+w-1, y, h, color);
+}
+
+void drawCircle(short x0, short y0, short r, char color) {
+/* Draw a circle outline with center (x0,y0) and radius r, with given color
+ * Parameters:
+ *      x0: x-coordinate of center of circle. The top-left of the screen
+ *          has x-coordinate 0 and increases to the right
+ *      y0: y-coordinate of center of circle. The top-left of the screen
+ *          has y-coordinate 0 and increases to the bottom
+ *      r:  radius of circle
+ *      color: 16-bit color value for the circle. Note that the circle
+ *          isn't filled. So, this is the color of the outline of the circle
+ * Returns: Nothing
+ */
+  short f = 1 - r;
+  short ddF_x = 1;
+  short ddF_y = -2 * r;
+  short x = 0;
+  short y = r;
+
+  drawPixel(x0  , y0+r, color);
+  drawPixel(x0  , y0-r, color);
+  drawPixel(x0+r, y0  , color);
+  drawPixel(x0-r, y0  , color);
+
+  while (x<y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f += ddF_x;
+
+    drawPixel(x0 + x, y0 + y, color);
+    drawPixel(x0 - x, y0 + y, color);
+    drawPixel(x0 + x, y0 - y, color);
+    drawPixel(x0 - x, y0 - y, color);
+    drawPixel(x0 + y, y0 + x, color);
+    drawPixel(x0 - y, y0 + x, color);
+    drawPixel(x0 + y, y0 - x, color);
+    drawPixel(x0 - y, y0 - x, color);
+  }
+}
+
+void drawCircleHelper( short x0, short y0, short r, unsigned char cornername, char color) {
+// Helper function for drawing circles and circular objects
+  short f     = 1 - r;
+  short ddF_x = 1;
+  short ddF_y = -2 * r;
+  short x     = 0;
+  short y     = r;
+
+  while (x<y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f     += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f     += ddF_x;
+    if (cornername & 0x4) {
+      drawPixel(x0 + x, y0 + y, color);
+      drawPixel(x0 + y, y0 + x, color);
+    }
+    if (cornername & 0x2) {
+      drawPixel(x0 + x, y0 - y, color);
+      drawPixel(x0 + y, y0 - x, color);
+    }
+    if (cornername & 0x8) {
+      drawPixel(x0 - y, y0 + x, color);
+      drawPixel(x0 - x, y0 + y, color);
+    }
+    if (cornername & 0x1) {
+      drawPixel(x0 - y, y0 - x, color);
+      drawPixel(x0 - x, y0 - y, color);
+    }
+  }
+}
+
+void fillCircle(short x0, short y0, short r, char color) {
+/* Draw a filled circle with center (x0,y0) and radius r, with given color
+ * Parameters:
+ *      x0: x-coordinate of center of circle. The top-left of the screen
+ *          has x-coordinate 0 and increases to the right
+ *      y0: y-coordinate of center of circle. The top-left of the screen
+ *          has y-coordinate 0 and increases to the bottom
+ *      r:  radius of circle
+ *      color: 16-bit color value for the circle
+ * Returns: Nothing
+ */
+  drawVLine(x0, y0-r, 2*r+1, color);
+  fillCircleHelper(x0, y0, r, 3, 0, color);
+}
+
+void fillCircleHelper(short x0, short y0, short r, unsigned char cornername, short delta, char color) {
+// Helper function for drawing filled circles
+  short f     = 1 - r;
+  short ddF_x = 1;
+  short ddF_y = -2 * r;
+  short x     = 0;
+  short y     = r;
+
+  while (x<y) {
+    if (f >= 0) {
+      y--;
+      ddF_y += 2;
+      f     += ddF_y;
+    }
+    x++;
+    ddF_x += 2;
+    f     += ddF_x;
+
+    if (cornername & 0x1) {
+      drawVLine(x0+x, y0-y, 2*y+1+delta, color);
+      drawVLine(x0+y, y0-x, 2*x+1+delta, color);
+    }
+    if (cornername & 0x2) {
+      drawVLine(x0-x, y0-y, 2*y+1+delta, color);
+      drawVLine(x0-y, y0-x, 2*x+1+delta, color);
+    }
+  }
+}
+
+// Draw a rounded rectangle
+void drawRoundRect(short x, short y, short w, short h, short r, char color) {
+/* Draw a rounded rectangle outline with top left vertex (x,y), width w,
+ * height h and radius of curvature r at given color
+ * Parameters:
+ *      x:  x-coordinate of top-left vertex. The x-coordinate of
+ *          the top-left of the screen is 0. It increases to the right.
+ *      y:  y-coordinate of top-left vertex. The y-coordinate of
+ *          the top-left of the screen is 0. It increases to the bottom.
+ *      w:  width of the rectangle
+ *      h:  height of the rectangle
+ *      color:  16-bit color of the rectangle outline
+ * Returns: Nothing
+ */
+  // smarter version
+  drawHLine(x+r  , y    , w-2*r, color); // Top
+  drawHLine(x+r  , y+h-1, w-2*r, color); // Bottom
+  drawVLine(x    , y+r  , h-2*r, color); // Left
+  drawVLine(x+w-1, y+r  , h-2*r, color); // Right
+  // draw four corners
+  drawCircleHelper(x+r    , y+r    , r, 1, color);
+  drawCircleHelper(x+w-r-1, y+r    , r, 2, color);
+  drawCircleHelper(x+w-r-1, y+h-r-1, r, 4, color);
+  drawCircleHelper(x+r    , y+h-r-1, r, 8, color);
+}
+
+// Fill a rounded rectangle
+void fillRoundRect(short x, short y, short w, short h, short r, char color) {
+  // smarter version
+  fillRect(x+r, y, w-2*r, h, color);
+
+  // draw four corners
+  fillCircleHelper(x+w-r-1, y+r, r, 1, h-2*r-1, color);
+  fillCircleHelper(x+r    , y+r, r, 2, h-2*r-1, color);
+}
+
+
+// fill a rectangle
+void fillRect(short x, short y, short w, short h, char color) {
+/* Draw a filled rectangle with starting top-left vertex (x,y),
+ *  width w and height h with given color
+ * Parameters:
+ *      x:  x-coordinate of top-left vertex; top left of screen is x=0
+ *              and x increases to the right
+ *      y:  y-coordinate of top-left vertex; top left of screen is y=0
+ *              and y increases to the bottom
+ *      w:  width of rectangle
+ *      h:  height of rectangle
+ *      color:  3-bit color value
+ * Returns:     Nothing
+ */
+
+  // Clip to the screen (drawChar w/big text requires this)
+  int x0 = x ;
+  int x1 = x + w ;
+  int y0 = y ;
+  int y1 = y + h ;
+  if (x0 < 0) x0 = 0 ;
+  if (y0 < 0) y0 = 0 ;
+  if (x1 > _width) x1 = _width ;
+  if (y1 > _height) y1 = _height ;
+  if ((x1 <= x0) || (y1 <= y0)) return ;
+
+  // One span fill per row of the pixel array
+  for (int row = ROW_INDEX(y0); row <= ROW_INDEX(y1 - 1); row++) {
+    fillSpan(row, x0, x1, color) ;
+  }
+}
+
+#if PIXELS_PER_BYTE == 2
+
+// Glyph cache. A 6x8 character cell at an even x is 3 bytes per row of
+// the pixel array, so opaque text can be copied a row at a time once
+// its glyph has been expanded for a particular pair of colors. The cache
+// is direct-mapped, indexed mostly by character, and filled on a miss.
+// (At 1 bit/pixel, cells don't line up with bytes, so there's no cache.)
+#ifndef GLYPH_CACHE_SIZE
+#define GLYPH_CACHE_SIZE 128        // entries, must be a power of two
+#endif
+#define GLYPH_BYTES 24              // 8 rows of 3 bytes
+
+static unsigned int glyph_tags[GLYPH_CACHE_SIZE] ;      // 0 for empty
+static unsigned char glyph_cache[GLYPH_CACHE_SIZE][GLYPH_BYTES] ;
+
+// Returns the packed rows of character c in the given colors
+static const unsigned char * cachedGlyph(unsigned char c, char color, char bg) {
+    unsigned int fg_bits = PIXEL_VALUE(color) ;
+    unsigned int bg_bits = PIXEL_VALUE(bg) ;
+    unsigned int tag = 0x1000000 | c | (fg_bits << 8) | (bg_bits << 16) ;
+    int index = (c ^ (fg_bits << 4) ^ (bg_bits << 1)) & (GLYPH_CACHE_SIZE - 1) ;
+    unsigned char * glyph = glyph_cache[index] ;
+    if (glyph_tags[index] == tag) return glyph ;
+
+    for (int j=0; j<8; j++) {
+        for (int k=0; k<3; k++) {
+            // Column 5 is the blank space between characters
+            unsigned char even = pgm_read_byte(font+(c*5)+(2*k)) ;
+            unsigned char odd  = (k < 2) ? pgm_read_byte(font+(c*5)+(2*k)+1) : 0 ;
+            char p0 = ((even >> j) & 1) ? color : bg ;
+            char p1 = ((odd >> j) & 1) ? color : bg ;
+            glyph[(j*3)+k] = PIXEL_PAIR(p0, p1) ;
+        }
+    }
+    glyph_tags[index] = tag ;
+    return glyph ;
+}
+
+#endif
+
+// Draw a character
+void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned char size) {
+    char i, j;
+  if((x >= _width)            || // Clip right
+     (y >= _height)           || // Clip bottom
+     ((x + 6 * size - 1) < 0) || // Clip left
+     ((y + 8 * size - 1) < 0))   // Clip top
+    return;
+
+#if PIXELS_PER_BYTE == 2
+  // Opaque, size-1 text at an even x (what writeString usually draws)
+  // comes from the glyph cache, whole bytes at a time
+  if ((size == 1) && (bg != color) && !(x & 1) && (x >= 0) && ((x + 6) <= _width)) {
+    const unsigned char * glyph = cachedGlyph(c, color, bg) ;
+    for (int row=0; row<8; row++, glyph+=3) {
+      int py = y + row ;
+      if ((py < 0) || (py >= _height)) continue ;
+      DAMAGE(ROW_INDEX(py), ROW_INDEX(py), x, x + 6) ;
+      unsigned char * dst = &vga_data_array[(ROW_INDEX(py) * LINE_BYTES) + PIXEL_BYTE(x)] ;
+      dst[0] = glyph[0] ;
+      dst[1] = glyph[1] ;
+      dst[2] = glyph[2] ;
+    }
+    return;
+  }
+#endif
+
+  for (i=0; i<6; i++ ) {
+    unsigned char line;
+    if (i == 5)
+      line = 0x0;
+    else
+      line = pgm_read_byte(font+(c*5)+i);
+    for ( j = 0; j<8; j++) {
+      if (line & 0x1) {
+        if (size == 1) // default size
+          drawPixel(x+i, y+j, color);
+        else {  // big size
+          fillRect(x+(i*size), y+(j*size), size, size, color);
+        }
+      } else if (bg != color) {
+        if (size == 1) // default size
+          drawPixel(x+i, y+j, bg);
+        else {  // big size
+          fillRect(x+i*size, y+j*size, size, size, bg);
+        }
+      }
+      line >>= 1;
+    }
+  }
+}
+
+
+inline void setCursor(short x, short y) {
+/* Set cursor for text to be printed
+ * Parameters:
+ *      x = x-coordinate of top-left of text starting
+ *      y = y-coordinate of top-left of text starting
+ * Returns: Nothing
+ */
+  cursor_x = x;
+  cursor_y = y;
+}
+
+inline void setTextSize(unsigned char s) {
+/*Set size of text to be displayed
+ * Parameters:
+ *      s = text size (1 being smallest)
+ * Returns: nothing
+ */
+  textsize = (s > 0) ? s : 1;
+}
+
+inline void setTextColor(char c) {
+  // For 'transparent' background, we'll set the bg
+  // to the same as fg instead of using a flag
+  textcolor = textbgcolor = c;
+}
+
+inline void setTextColor2(char c, char b) {
+/* Set color of text to be displayed
+ * Parameters:
+ *      c = 16-bit color of text
+ *      b = 16-bit color of text background
+ */
+  textcolor   = c;
+  textbgcolor = b;
+}
+
+inline void setTextWrap(char w) {
+  wrap = w;
+}
+
+
+void tft_write(unsigned char c){
+  if (c == '\n') {
+    cursor_y += textsize*8;
+    cursor_x  = 0;
+  } else if (c == '\r') {
+    // skip em
+  } else if (c == '\t'){
+      int new_x = cursor_x + tabspace;
+      if (new_x < _width){
+          cursor_x = new_x;
+      }
+  } else {
+    drawChar(cursor_x, cursor_y, c, textcolor, textbgcolor, textsize);
+    cursor_x += textsize*6;
+    if (wrap && (cursor_x > (_width - textsize*6))) {
+      cursor_y += textsize*8;
+      cursor_x = 0;
+    }
+  }
+}
+
+inline void writeString(char* str){
+/* Print text onto screen
+ * Call tft_setCursor(), tft_setTextColor(), tft_setTextSize()
+ *  as necessary before printing
+ */
+    while (*str){
+        tft_write(*str++);
+    }
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== DMA blitter ======================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// One spare DMA channel does solid fills and rectangular copies, one row
+// per transfer. Its completion interrupt (DMA_IRQ_1) starts the next row,
+// so the core that started a blit is free until the whole thing is done.
+//
+// Sprites are packed exactly like the pixel array: w/PIXELS_PER_BYTE bytes
+// per sprite row (w/2 at 3 bits/pixel, even pixel in the low 3 bits).
+// Copies therefore start, and end, on a byte boundary.
+
+int blit_chan = -1 ;                        // claimed on first use
+
+// Replicated color word, the (non-incrementing) source for solid fills
+static unsigned int blit_fill_word ;
+
+// State of the blit in progress
+static volatile char blit_busy = 0 ;        // set until the last row is done
+static unsigned char * blit_dst ;           // pixel array address of current row
+static const unsigned char * blit_src ;     // source address of current row
+static int blit_src_step ;                  // source bytes between rows (0 for fills)
+static int blit_dst_step ;                  // pixel array bytes between rows
+static int blit_rows_left ;                 // rows left after the current one
+static void (*blit_callback)(void) = NULL ; // called from the IRQ when done
+
+static void HOT_ISR(blit_handler)() {
+    // DMA_IRQ_1 is shared (double-buffered mode uses it too)
+    if (!(dma_hw->ints1 & (1u << blit_chan))) return ;
+    dma_hw->ints1 = (1u << blit_chan) ;
+
+    if (blit_rows_left > 0) {
+        // Start the next row. The transfer count and config are reloaded.
+        blit_rows_left-- ;
+        blit_dst += blit_dst_step ;
+        blit_src += blit_src_step ;
+        dma_channel_set_write_addr(blit_chan, blit_dst, false) ;
+        dma_channel_set_read_addr(blit_chan, blit_src, true) ;
+    }
+    else {
+        blit_busy = 0 ;
+        if (blit_callback) blit_callback() ;
+    }
+}
+
+// Claim a DMA channel for the blitter
+static void initBlit() {
+    blit_chan = hw_claim_dma("vga blit") ;
+    dma_channel_set_irq1_enabled(blit_chan, true) ;
+    irq_add_shared_handler(DMA_IRQ_1, blit_handler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY) ;
+    irq_set_enabled(DMA_IRQ_1, true) ;
+}
+
+// Start a blit of 'rows' rows of 'bytes' bytes each. The first row is
+// read from src and written to dst. Transfers are word-wide when every
+// row start and the row length allow it.
+static void startBlit(unsigned char * dst, int dst_step,
+                      const unsigned char * src, int src_step,
+                      int bytes, int rows, char fill) {
+    // Only one blit at a time
+    blitWait() ;
+    if (blit_chan < 0) initBlit() ;
+
+    // 32-bit transfers if the rows are word-aligned, otherwise bytes.
+    // (A fill's source is a replicated word, so it's always aligned.)
+    char words = ((((uintptr_t)dst | dst_step | bytes) & 3) == 0) &&
+                 (fill || ((((uintptr_t)src | src_step) & 3) == 0)) ;
+
+    dma_channel_config c = dma_channel_get_default_config(blit_chan) ;
+    channel_config_set_transfer_data_size(&c, words ? DMA_SIZE_32 : DMA_SIZE_8) ;
+    channel_config_set_read_increment(&c, !fill) ;
+    channel_config_set_write_increment(&c, true) ;
+
+    blit_dst = dst ;
+    blit_dst_step = dst_step ;
+    blit_src = src ;
+    blit_src_step = src_step ;
+    blit_rows_left = rows - 1 ;
+    blit_busy = 1 ;
+
+    dma_channel_configure(
+        blit_chan,                  // Channel to be configured
+        &c,                         // The configuration we just created
+        dst,                        // Write address (first row)
+        src,                        // Read address (first row)
+        words ? (bytes>>2) : bytes, // Number of transfers per row
+        true                        // Start immediately.
+    );
+}
+
+// Returns 1 while a blit is in progress. Don't draw to the area
+// being blitted until it returns 0. In a protothread, use
+// PT_YIELD_UNTIL(pt, !blitBusy()) ;
+char blitBusy() {
+    return blit_busy ;
+}
+
+// Block until the blit in progress (if any) is done
+void blitWait() {
+    while (blit_busy) {
+        tight_loop_contents() ;
+    }
+}
+
+// Set a function to be called (from the DMA interrupt) when each blit
+// finishes. Pass NULL for none.
+void setBlitCallback(void (*callback)(void)) {
+    blit_callback = callback ;
+}
+
+// Fill a rectangle using the DMA channel. Pixel columns at the edges of
+// the rectangle that don't fill a byte are drawn by the CPU before the
+// DMA starts.
+void dmaFillRect(short x, short y, short w, short h, char color) {
+    // Clip to the screen
+    int x0 = x ;
+    int x1 = x + w ;
+    int y0 = y ;
+    int y1 = y + h ;
+    if (x0 < 0) x0 = 0 ;
+    if (y0 < 0) y0 = 0 ;
+    if (x1 > _width) x1 = _width ;
+    if (y1 > _height) y1 = _height ;
+    if ((x1 <= x0) || (y1 <= y0)) return ;
+
+    // Don't let the CPU edges race a blit that's still running
+    blitWait() ;
+    while ((x0 & (PIXELS_PER_BYTE - 1)) && (x0 < x1)) drawVLine(x0++, y0, y1 - y0, color) ;
+    while ((x1 & (PIXELS_PER_BYTE - 1)) && (x1 > x0)) drawVLine(--x1, y0, y1 - y0, color) ;
+    if (x1 <= x0) return ;
+
+    unsigned char fill = FILL_BYTE(color) ;
+    blit_fill_word = fill * 0x01010101u ;
+
+    int first_row = ROW_INDEX(y0) ;
+    int rows = ROW_INDEX(y1 - 1) - first_row + 1 ;
+    unsigned char * dst = &vga_data_array[(first_row * LINE_BYTES) + PIXEL_BYTE(x0)] ;
+    DAMAGE(first_row, first_row + rows - 1, x0, x1) ;
+
+    if ((x0 == 0) && (x1 == _width)) {
+        // Full-width rows are contiguous, so it's one transfer
+        startBlit(dst, 0, (const unsigned char *)&blit_fill_word, 0,
+                  rows * LINE_BYTES, 1, 1) ;
+    }
+    else {
+        startBlit(dst, LINE_BYTES, (const unsigned char *)&blit_fill_word, 0,
+                  PIXEL_BYTE(x1 - x0), rows, 1) ;
+    }
+}
+
+// Clear the whole screen to a color using the DMA channel
+void clearScreen(char color) {
+    dmaFillRect(0, 0, _width, _height, color) ;
+}
+
+// Copy a sprite into the pixel array with its top-left corner at (x, y).
+// x is rounded down to a byte boundary. The sprite is w x h pixels,
+// w/PIXELS_PER_BYTE bytes per row. The sprite must not change until the
+// blit is done.
+void blitRect(short x, short y, short w, short h, const unsigned char * sprite) {
+    int stride = PIXEL_BYTE(w) ;
+    x &= ~(PIXELS_PER_BYTE - 1) ;
+
+    // Clip to the screen, moving the sprite start to match
+    int x0 = x ;
+    int x1 = x + (stride << PPB_SHIFT) ;
+    int y0 = y ;
+    int y1 = y + h ;
+    if (x0 < 0) x0 = 0 ;
+    if (y0 < 0) y0 = 0 ;
+    if (x1 > _width) x1 = _width ;
+    if (y1 > _height) y1 = _height ;
+    if ((x1 <= x0) || (y1 <= y0)) return ;
+
+    const unsigned char * src = sprite + ((y0 - y) * stride) + PIXEL_BYTE(x0 - x) ;
+    unsigned char * dst = &vga_data_array[(ROW_INDEX(y0) * LINE_BYTES) + PIXEL_BYTE(x0)] ;
+
+    DAMAGE(ROW_INDEX(y0), ROW_INDEX(y1 - 1), x0, x1) ;
+
+#if ROW_SHIFT == 0
+    startBlit(dst, LINE_BYTES, src, stride, PIXEL_BYTE(x1 - x0), y1 - y0, 0) ;
+#else
+    // Each pixel array row holds two screen lines, so copy every second
+    // sprite row, starting with the one that lands on an even line.
+    if (y0 & 1) {
+        src += stride ;
+        dst += LINE_BYTES ;
+        y0++ ;
+        if (y1 <= y0) return ;
+    }
+    startBlit(dst, LINE_BYTES, src, stride<<1, PIXEL_BYTE(x1 - x0), (y1 - y0 + 1)>>1, 0) ;
+#endif
+}
+
+// Copy a w x h pixel rectangle of the screen, top-left corner at (x, y),
+// into a sprite buffer (w/PIXELS_PER_BYTE bytes per row). x is rounded
+// down to a byte boundary. The rectangle must be on the screen.
+void grabRect(short x, short y, short w, short h, unsigned char * sprite) {
+    int stride = PIXEL_BYTE(w) ;
+    x &= ~(PIXELS_PER_BYTE - 1) ;
+    if ((x < 0) || (y < 0) || ((x + (stride << PPB_SHIFT)) > _width) || ((y + h) > _height)) return ;
+    if ((stride <= 0) || (h <= 0)) return ;
+
+    unsigned char * src = &vga_data_array[(ROW_INDEX(y) * LINE_BYTES) + PIXEL_BYTE(x)] ;
+
+#if ROW_SHIFT == 0
+    startBlit(sprite, stride, src, LINE_BYTES, stride, h, 0) ;
+#else
+    // Pixel array rows are shown twice, so sprite rows come in equal
+    // pairs. Grab the first line of each pair, and an odd y's first line.
+    // (Use blitRect with the same y to put the sprite back.)
+    if (y & 1) {
+        startBlit(sprite, stride, src, LINE_BYTES, stride, 1, 0) ;
+        sprite += stride ;
+        src += LINE_BYTES ;
+        y++ ;
+        h-- ;
+    }
+    if (h > 0) startBlit(sprite, stride<<1, src, LINE_BYTES, stride, (h + 1)>>1, 0) ;
+#endif
+}
+
+// Move the whole picture dx pixels right and dy lines down (negative for
+// left and up). dx is rounded toward zero to whole bytes of the pixel
+// array, and dy to whole rows. The strips that are uncovered keep what
+// was there before, for the caller to redraw. This is a CPU copy (rows
+// overlap), done after any blit in progress.
+void shiftScreen(short dx, short dy) {
+    int bx = dx / PIXELS_PER_BYTE ;
+    int ry = dy / (1 << ROW_SHIFT) ;
+    if ((abs(bx) >= LINE_BYTES) || (abs(ry) >= FB_ROWS)) return ;
+    if ((bx == 0) && (ry == 0)) return ;
+
+    int width = LINE_BYTES - abs(bx) ;
+    int src_x = (bx < 0) ? -bx : 0 ;
+    int dst_x = (bx > 0) ? bx : 0 ;
+
+    blitWait() ;
+    DAMAGE(0, FB_ROWS - 1, 0, _width) ;
+
+    // Work away from the rows being uncovered, so no row is overwritten
+    // before it has been moved
+    if (ry > 0) {
+        for (int row = FB_ROWS - 1; row >= ry; row--) {
+            memmove(&vga_data_array[(row * LINE_BYTES) + dst_x],
+                    &vga_data_array[((row - ry) * LINE_BYTES) + src_x], width) ;
+        }
+    }
+    else {
+        for (int row = 0; row < FB_ROWS + ry; row++) {
+            memmove(&vga_data_array[(row * LINE_BYTES) + dst_x],
+                    &vga_data_array[((row - ry) * LINE_BYTES) + src_x], width) ;
+        }
+    }
+}
+
+#ifndef VGA_DOUBLE_BUFFER
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Sprites ==========================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Each sprite saves the pixels it covers as it is drawn, and puts them
+// back before it is drawn anywhere else, so the picture underneath never
+// needs redrawing. vga_sprites_update() takes every sprite off the
+// screen, newest first, then draws them all where they now are, oldest
+// first. Pixels are taken off in exactly the reverse order they were
+// drawn, which keeps overlapping sprites (and, at 8 bits/pixel, the two
+// screen lines that share a row of the pixel array) straight. Which
+// pixels were saved is kept with them, a bit each, so an image changed
+// in place while it's shown still comes off cleanly.
+
+typedef struct {
+    short x, y, w, h ;                  // where it's wanted, and its size
+    const unsigned char * image ;       // w x h colors, one byte each
+    int transparent ;                   // color not drawn (-1 for none)
+    char visible ;
+    // As it is on the screen
+    char drawn ;
+    short drawn_x, drawn_y ;
+    unsigned char * under ;             // w x h saved pixels
+    int saved ;                         // bit of sprite_saved for under[0]
+} vga_sprite ;
+
+static vga_sprite sprites[VGA_SPRITE_MAX] ;
+static int sprite_count = 0 ;
+static unsigned char sprite_under[VGA_SPRITE_UNDER_BYTES] ;
+static unsigned char sprite_saved[(VGA_SPRITE_UNDER_BYTES + 7) / 8] ;   // 1 per pixel saved
+static int sprite_under_used = 0 ;
+static char sprites_dirty = 0 ;
+
+static inline char getPixel(const unsigned char * line, int x) {
+    return (line[PIXEL_BYTE(x)] >> PIXEL_SHIFT(x)) & PIXEL_MASK ;
+}
+
+static inline void setSaved(int bit, char saved) {
+    if (saved) sprite_saved[bit >> 3] |= 1u << (bit & 7) ;
+    else sprite_saved[bit >> 3] &= ~(1u << (bit & 7)) ;
+}
+
+static inline char isSaved(int bit) {
+    return (sprite_saved[bit >> 3] >> (bit & 7)) & 1 ;
+}
+
+// Save what's under each opaque pixel of a sprite, then draw it
+static void spriteDraw(vga_sprite * s) {
+    const unsigned char * image = s->image ;
+    unsigned char * under = s->under ;
+    for (int j=0; j<s->h; j++) {
+        int y = s->y + j ;
+        if ((y < 0) || (y >= _height)) continue ;
+        int row = ROW_INDEX(y) ;
+        unsigned char * line = &vga_data_array[row * LINE_BYTES] ;
+        for (int i=0; i<s->w; i++) {
+            int x = s->x + i ;
+            int k = (j * s->w) + i ;
+            char opaque = (x >= 0) && (x < _width) && (image[k] != s->transparent) ;
+            setSaved(s->saved + k, opaque) ;
+            if (!opaque) continue ;
+            under[k] = getPixel(line, x) ;
+            setPixel(line, x, image[k]) ;
+        }
+        DAMAGE(row, row, (s->x < 0) ? 0 : s->x, (s->x + s->w > _width) ? _width : s->x + s->w) ;
+    }
+    s->drawn = 1 ;
+    s->drawn_x = s->x ;
+    s->drawn_y = s->y ;
+}
+
+// Put back what was under a sprite, last pixel drawn first
+static void spriteErase(vga_sprite * s) {
+    for (int j=s->h-1; j>=0; j--) {
+        int y = s->drawn_y + j ;
+        if ((y < 0) || (y >= _height)) continue ;
+        int row = ROW_INDEX(y) ;
+        unsigned char * line = &vga_data_array[row * LINE_BYTES] ;
+        for (int i=s->w-1; i>=0; i--) {
+            int x = s->drawn_x + i ;
+            int k = (j * s->w) + i ;
+            if (!isSaved(s->saved + k)) continue ;
+            setPixel(line, x, s->under[k]) ;
+        }
+        DAMAGE(row, row, (s->drawn_x < 0) ? 0 : s->drawn_x,
+               (s->drawn_x + s->w > _width) ? _width : s->drawn_x + s->w) ;
+    }
+    s->drawn = 0 ;
+}
+
+// Add a w x h sprite (hidden, at 0,0) showing image, one color per byte,
+// row by row. Pixels of color 'transparent' (-1 for none) aren't drawn.
+// Returns a handle, or -1 if there's no room (VGA_SPRITE_MAX sprites of
+// VGA_SPRITE_UNDER_BYTES pixels all told).
+int vga_sprite_add(short w, short h, const unsigned char * image, int transparent) {
+    if ((w <= 0) || (h <= 0) || (sprite_count >= VGA_SPRITE_MAX)) return -1 ;
+    if (sprite_under_used + (w * h) > VGA_SPRITE_UNDER_BYTES) return -1 ;
+    vga_sprite * s = &sprites[sprite_count] ;
+    s->x = s->y = 0 ;
+    s->w = w ;
+    s->h = h ;
+    s->image = image ;
+    s->transparent = transparent ;
+    s->visible = 0 ;
+    s->drawn = 0 ;
+    s->under = &sprite_under[sprite_under_used] ;
+    s->saved = sprite_under_used ;
+    sprite_under_used += w * h ;
+    return sprite_count++ ;
+}
+
+// Move a sprite's top-left corner to (x, y), at the next update
+void vga_sprite_move(int handle, short x, short y) {
+    if ((handle < 0) || (handle >= sprite_count)) return ;
+    vga_sprite * s = &sprites[handle] ;
+    if ((s->x == x) && (s->y == y)) return ;
+    s->x = x ;
+    s->y = y ;
+    sprites_dirty = 1 ;
+}
+
+// Show or hide a sprite, at the next update
+void vga_sprite_show(int handle, char visible) {
+    if ((handle < 0) || (handle >= sprite_count)) return ;
+    sprites[handle].visible = visible ;
+    sprites_dirty = 1 ;
+}
+
+// Change a sprite's image (the same size), at the next update. Call this
+// after changing the colors in its image, too.
+void vga_sprite_set_image(int handle, const unsigned char * image) {
+    if ((handle < 0) || (handle >= sprite_count)) return ;
+    sprites[handle].image = image ;
+    sprites_dirty = 1 ;
+}
+
+// Put every sprite where it now is, once per frame. Costs the area of the
+// sprites (twice), however much of the screen they cross; does nothing if
+// no sprite changed.
+void vga_sprites_update() {
+    if (!sprites_dirty) return ;
+    sprites_dirty = 0 ;
+    blitWait() ;
+    for (int i=sprite_count-1; i>=0; i--) {
+        if (sprites[i].drawn) spriteErase(&sprites[i]) ;
+    }
+    for (int i=0; i<sprite_count; i++) {
+        if (sprites[i].visible) spriteDraw(&sprites[i]) ;
+    }
+}
+
+// Take all the sprites off the screen and forget them
+void vga_sprites_clear() {
+    blitWait() ;
+    for (int i=sprite_count-1; i>=0; i--) {
+        if (sprites[i].drawn) spriteErase(&sprites[i]) ;
+    }
+    sprite_count = 0 ;
+    sprite_under_used = 0 ;
+    sprites_dirty = 0 ;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Strip charts =====================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Set up a chart over the w x h rectangle at (x, y), mapping values lo to
+// hi (in the caller's units, e.g. fix15) bottom to top, and clear it
+void vga_chart_init(vga_chart * chart, short x, short y, short w, short h, int lo, int hi, char background) {
+    if (w > VGA_CHART_MAX_W) w = VGA_CHART_MAX_W ;
+    if (h < 2) h = 2 ;
+    if (hi <= lo) hi = lo + 1 ;
+    chart->x = x ;
+    chart->y = y ;
+    chart->w = w ;
+    chart->h = h ;
+    chart->lo = lo ;
+    chart->scale = (int)((((int64_t)(h - 1)) << 16) / ((int64_t)hi - lo)) ;
+    chart->background = background ;
+    chart->traces = 0 ;
+    chart->decimation = 1 ;
+    chart->n = 0 ;
+    chart->head = chart->tail = 0 ;
+    chart->dropped = 0 ;
+    chart->column = 0 ;
+    chart->started = 0 ;
+    for (int i=0; i<w; i++) {
+        chart->span_top[i] = 1 ;
+        chart->span_bottom[i] = 0 ;
+    }
+    fillRect(x, y, w, h, background) ;
+}
+
+// Add a trace, returning its index (the position of its values in each
+// sample), or -1 if the chart is full
+int vga_chart_add_trace(vga_chart * chart, char color) {
+    if (chart->traces >= VGA_CHART_TRACES) return -1 ;
+    chart->color[chart->traces] = color ;
+    return chart->traces++ ;
+}
+
+// Plot one column for every samples_per_column samples
+void vga_chart_set_decimation(vga_chart * chart, int samples_per_column) {
+    chart->decimation = (samples_per_column > 0) ? samples_per_column : 1 ;
+}
+
+// One sample: a value for each trace
+void vga_chart_add(vga_chart * chart, const int * values) {
+    vga_chart_column * c = &chart->gather ;
+    int t ;
+    if (chart->n == 0) {
+        for (t=0; t<chart->traces; t++) c->min[t] = c->max[t] = values[t] ;
+    }
+    else {
+        for (t=0; t<chart->traces; t++) {
+            if (values[t] < c->min[t]) c->min[t] = values[t] ;
+            if (values[t] > c->max[t]) c->max[t] = values[t] ;
+        }
+    }
+    if (++chart->n < chart->decimation) return ;
+
+    // The column's done: queue it for drawing
+    chart->n = 0 ;
+    for (t=0; t<chart->traces; t++) c->last[t] = values[t] ;
+    unsigned int head = chart->head ;
+    if ((head - chart->tail) >= VGA_CHART_PENDING) {
+        chart->dropped++ ;
+        return ;
+    }
+    chart->pending[head & (VGA_CHART_PENDING - 1)] = *c ;
+    __dmb() ;
+    chart->head = head + 1 ;
+}
+
+// Screen line of a value, within the chart
+static inline short chartLine(const vga_chart * chart, int value) {
+    int offset = (int)((((int64_t)value - chart->lo) * chart->scale) >> 16) ;
+    if (offset < 0) offset = 0 ;
+    if (offset > chart->h - 1) offset = chart->h - 1 ;
+    return chart->y + chart->h - 1 - offset ;
+}
+
+// Draw the columns gathered since last time, returning how many
+int vga_chart_draw(vga_chart * chart) {
+    int drawn = 0 ;
+    while (chart->tail != chart->head) {
+        __dmb() ;
+        const vga_chart_column * c = &chart->pending[chart->tail & (VGA_CHART_PENDING - 1)] ;
+        int col = chart->column ;
+        short x = chart->x + col ;
+        int t ;
+
+        // Clear what this column held last time round
+        if (chart->span_bottom[col] >= chart->span_top[col]) {
+            drawVLine(x, chart->span_top[col], chart->span_bottom[col] - chart->span_top[col] + 1, chart->background) ;
+        }
+
+        // Each trace spans its samples' range, and reaches back to the
+        // last sample of the column before
+        short top = chart->y + chart->h ;
+        short bottom = chart->y - 1 ;
+        for (t=0; t<chart->traces; t++) {
+            int lo = c->min[t] ;
+            int hi = c->max[t] ;
+            if (chart->started) {
+                if (chart->prev[t] < lo) lo = chart->prev[t] ;
+                if (chart->prev[t] > hi) hi = chart->prev[t] ;
+            }
+            short y0 = chartLine(chart, hi) ;
+            short y1 = chartLine(chart, lo) ;
+            drawVLine(x, y0, y1 - y0 + 1, chart->color[t]) ;
+            if (y0 < top) top = y0 ;
+            if (y1 > bottom) bottom = y1 ;
+            chart->prev[t] = c->last[t] ;
+        }
+        chart->span_top[col] = top ;
+        chart->span_bottom[col] = bottom ;
+        chart->started = 1 ;
+
+        chart->column = (col + 1 < chart->w) ? col + 1 : 0 ;
+        __dmb() ;
+        chart->tail++ ;
+        drawn++ ;
+    }
+    return drawn ;
+}
+
+#endif // !VGA_DOUBLE_BUFFER
+
+#endif // !VGA_SCANLINE_MODE
+
+#ifdef VGA_DAMAGE_TRACKING
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Damage tracking ==================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Every primitive records the pixels it touches (per row of the pixel
+// array, as a span from leftmost to rightmost). Anything that mirrors the
+// framebuffer elsewhere can then copy only what changed since the last reset.
+
+// Forget all recorded damage
+void vga_damage_reset() {
+    for (int row=damage_row0; row<damage_row1; row++) {
+        damage_x0[row] = 0 ;
+        damage_x1[row] = 0 ;
+    }
+    damage_row0 = PIXEL_ROWS ;
+    damage_row1 = 0 ;
+}
+
+// Damaged pixels x0 <= x < x1 of screen line y. Returns 0 if the line
+// is clean (and leaves x0 and x1 alone).
+char vga_damage_line(short y, short * x0, short * x1) {
+    if ((y < 0) || (y >= _height)) return 0 ;
+    int row = ROW_INDEX(y) ;
+    if (damage_x1[row] <= damage_x0[row]) return 0 ;
+    *x0 = damage_x0[row] ;
+    *x1 = damage_x1[row] ;
+    return 1 ;
+}
+
+// Bounding rectangle of all the damage, x0 <= x < x1 and y0 <= y < y1 in
+// screen coordinates. Returns 0 if nothing has been drawn since the reset.
+char vga_damage_bounds(short * x0, short * y0, short * x1, short * y1) {
+    short left = _width ;
+    short right = 0 ;
+    for (int row=damage_row0; row<damage_row1; row++) {
+        if (damage_x1[row] <= damage_x0[row]) continue ;
+        if (damage_x0[row] < left) left = damage_x0[row] ;
+        if (damage_x1[row] > right) right = damage_x1[row] ;
+    }
+    if (right <= left) return 0 ;
+    *x0 = left ;
+    *x1 = right ;
+    *y0 = damage_row0 << ROW_SHIFT ;
+    *y1 = damage_row1 << ROW_SHIFT ;
+    return 1 ;
+}
+
+#ifdef VGA_DOUBLE_BUFFER
+// After a swap, copy the regions damaged while drawing the frame that
+// is now displayed into the new back buffer, then reset the damage.
+// Called after every swap, this keeps the back buffer identical to the
+// front one, so apps can keep erasing and redrawing just what moved.
+void vga_sync_back_buffer() {
+    unsigned char * front = &vga_buffers[vga_front][0] ;
+    for (int row=damage_row0; row<damage_row1; row++) {
+        if (damage_x1[row] <= damage_x0[row]) continue ;
+        int first = (row * LINE_BYTES) + (damage_x0[row]>>1) ;
+        int last = (row * LINE_BYTES) + ((damage_x1[row] + 1)>>1) ;
+        memcpy(&vga_data_array[first], &front[first], last - first) ;
+    }
+    vga_damage_reset() ;
+}
+#endif
+
+#endif
+
+#ifdef VGA_TEXT_MODE
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Text mode ========================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// An 80x60 map of 8x8 character cells, composited into each scanline on
+// its way out. Printing a character writes two bytes (glyph and color
+// attribute); the pixels only exist in the line buffers. Glyphs are the
+// 5x7 glcdfont characters in the top-left of their cell.
+unsigned char vga_text_chars[TEXT_ROWS][TEXT_COLS] ;
+unsigned char vga_text_attrs[TEXT_ROWS][TEXT_COLS] ;   // fg | (bg << 4)
+
+static volatile char text_enabled = 1 ;
+
+// glcdfont stores each glyph as 5 column bytes. Scanout wants rows, so
+// the font is transposed once at startup: bit i of text_glyph_rows[c][r]
+// is pixel i of row r of character c.
+static unsigned char text_glyph_rows[256][8] ;
+
+static void initText() {
+    for (int c=0; c<256; c++) {
+        for (int r=0; r<8; r++) {
+            unsigned char bits = 0 ;
+            for (int i=0; i<5; i++) {
+                if (pgm_read_byte(font+(c*5)+i) & (1 << r)) bits |= (1 << i) ;
+            }
+            text_glyph_rows[c][r] = bits ;
+        }
+    }
+    vga_text_clear(WHITE, BLACK) ;
+}
+
+// Draw screen line 'line' of the text layer into a 320-byte line buffer.
+// Called by the scanline renderer; a line callback can use it too.
+void HOT_ISR(vga_text_render_line)(short line, unsigned char * buf) {
+    const unsigned char * chars = vga_text_chars[line >> 3] ;
+    const unsigned char * attrs = vga_text_attrs[line >> 3] ;
+    int r = line & 7 ;
+
+    // Bytes for each pair of pixels (bg/bg, fg/bg, bg/fg, fg/fg). Runs of
+    // cells with the same colors share one table.
+    unsigned char pairs[4] ;
+    int last_attr = -1 ;
+
+    for (int col=0; col<TEXT_COLS; col++) {
+        if (attrs[col] != last_attr) {
+            last_attr = attrs[col] ;
+            unsigned char fg = last_attr & 0x7 ;
+            unsigned char bg = (last_attr >> 4) & 0x7 ;
+            pairs[0] = bg | (bg << 3) ;
+            pairs[1] = fg | (bg << 3) ;
+            pairs[2] = bg | (fg << 3) ;
+            pairs[3] = fg | (fg << 3) ;
+        }
+        unsigned char bits = text_glyph_rows[chars[col]][r] ;
+        *buf++ = pairs[bits & 3] ;
+        *buf++ = pairs[(bits >> 2) & 3] ;
+        *buf++ = pairs[(bits >> 4) & 3] ;
+        *buf++ = pairs[(bits >> 6) & 3] ;
+    }
+}
+
+// Show or hide the text layer (hidden, the display list background shows)
+void vga_text_enable(char on) {
+    text_enabled = on ;
+}
+
+// Put a character in a cell
+void vga_text_putc(short col, short row, unsigned char c, char color, char bg) {
+    if ((col < 0) || (col >= TEXT_COLS) || (row < 0) || (row >= TEXT_ROWS)) return ;
+    vga_text_chars[row][col] = c ;
+    vga_text_attrs[row][col] = (color & 0x7) | ((bg & 0x7) << 4) ;
+}
+
+// Put a string in consecutive cells of one row. Returns the column after
+// the last character written.
+short vga_text_write(short col, short row, const char * str, char color, char bg) {
+    while (*str && (col < TEXT_COLS)) {
+        vga_text_putc(col++, row, *str++, color, bg) ;
+    }
+    return col ;
+}
+
+// Blank every cell
+void vga_text_clear(char color, char bg) {
+    memset(vga_text_chars, ' ', sizeof(vga_text_chars)) ;
+    memset(vga_text_attrs, (color & 0x7) | ((bg & 0x7) << 4), sizeof(vga_text_attrs)) ;
+}
+
+// The usual text API, on the cell map. The cursor is still in pixels,
+// and is rounded down to a cell. Text size is ignored (cells are 8x8),
+// and setTextColor's transparent background is drawn as black.
+
+inline void setCursor(short x, short y) {
+  cursor_x = x;
+  cursor_y = y;
+}
+
+inline void setTextSize(unsigned char s) {
+  textsize = 1;
+}
+
+inline void setTextColor(char c) {
+  textcolor = c;
+  textbgcolor = BLACK;
+}
+
+inline void setTextColor2(char c, char b) {
+  textcolor   = c;
+  textbgcolor = b;
+}
+
+inline void setTextWrap(char w) {
+  wrap = w;
+}
+
+void tft_write(unsigned char c){
+  if (c == '\n') {
+    cursor_y += 8;
+    cursor_x  = 0;
+  } else if (c == '\r') {
+    // skip em
+  } else if (c == '\t'){
+      int new_x = cursor_x + tabspace*8;
+      if (new_x < _width){
+          cursor_x = new_x;
+      }
+  } else {
+    vga_text_putc(cursor_x >> 3, cursor_y >> 3, c, textcolor, textbgcolor);
+    cursor_x += 8;
+    if (wrap && (cursor_x > (_width - 8))) {
+      cursor_y += 8;
+      cursor_x = 0;
+    }
+  }
+}
+
+inline void writeString(char* str){
+    while (*str){
+        tft_write(*str++);
+    }
+}
+
+#endif
+
+#ifdef VGA_SCANLINE_MODE
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Scanline renderer ================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Racing the beam: each line is rendered into its ring buffer a few
+// lines before it is sent out. A line takes 32us at 25MHz, so a line
+// callback has VGA_SCANLINE_BUFFERS-1 of those to finish, and must be
+// quick. It writes 320 bytes of packed pixels (same format as the
+// framebuffer: 2 pixels per byte, even pixel in the low 3 bits).
+static vga_line_callback_t line_callback = NULL ;
+
+// The built-in renderer draws a display list of rectangles and
+// sprites over a background color, in the order they were added.
+static vga_dl_item display_list[VGA_DL_MAX] ;
+static volatile int dl_count = 0 ;
+static char dl_background = BLACK ;
+
+// Render screen line 'line' into a line buffer
+static void HOT_ISR(renderLine)(short line, unsigned char * buf) {
+    if (line_callback) {
+        line_callback(line, buf) ;
+        return ;
+    }
+
+#ifdef VGA_TEXT_MODE
+    // The text layer covers the whole screen, so it replaces the background
+    if (text_enabled) vga_text_render_line(line, buf) ;
+    else
+#endif
+    memset(buf, dl_background | (dl_background << 3), SCAN_BYTES) ;
+
+    for (int i=0; i<dl_count; i++) {
+        vga_dl_item * item = &display_list[i] ;
+        if (!item->visible || (line < item->y) || (line >= (item->y + item->h))) continue ;
+
+        // Clip horizontally
+        int x0 = item->x ;
+        int x1 = item->x + item->w ;
+        if (x0 < 0) x0 = 0 ;
+        if (x1 > _width) x1 = _width ;
+        if (x1 <= x0) continue ;
+
+        if (item->sprite == NULL) {
+            fillBytes(buf, x0, x1, item->color) ;
+        }
+        else {
+            // Sprites are packed, w/2 bytes per row, drawn at an even x
+            const unsigned char * src = item->sprite + ((line - item->y) * (item->w>>1)) + ((x0 - item->x)>>1) ;
+            memcpy(&buf[x0>>1], src, (x1 - x0)>>1) ;
+        }
+    }
+}
+
+// Render lines with a function instead of the display list (NULL to
+// go back to the display list)
+void vga_set_line_callback(vga_line_callback_t callback) {
+    line_callback = callback ;
+}
+
+// Set the color drawn behind the display list
+void vga_dl_set_background(char color) {
+    dl_background = color ;
+}
+
+// Add a filled rectangle to the display list. Returns a handle, or -1
+// if the list is full.
+int vga_dl_add_rect(short x, short y, short w, short h, char color) {
+    if (dl_count >= VGA_DL_MAX) return -1 ;
+    vga_dl_item * item = &display_list[dl_count] ;
+    item->x = x ;
+    item->y = y ;
+    item->w = w ;
+    item->h = h ;
+    item->color = color ;
+    item->sprite = NULL ;
+    item->visible = 1 ;
+    return dl_count++ ;
+}
+
+// Add a packed w x h sprite (w/2 bytes per row) to the display list.
+// x is rounded down to even. Returns a handle, or -1 if the list is full.
+int vga_dl_add_sprite(short x, short y, short w, short h, const unsigned char * sprite) {
+    int handle = vga_dl_add_rect(x & ~1, y, w & ~1, h, BLACK) ;
+    if (handle >= 0) display_list[handle].sprite = sprite ;
+    return handle ;
+}
+
+// Direct access to a display list item, for moving it, recoloring it or
+// hiding it. Changes show up on the next line that is rendered.
+vga_dl_item * vga_dl_item_at(int handle) {
+    if ((handle < 0) || (handle >= dl_count)) return NULL ;
+    return &display_list[handle] ;
+}
+
+// Move a display list item (sprites stay on an even x)
+void vga_dl_move(int handle, short x, short y) {
+    vga_dl_item * item = vga_dl_item_at(handle) ;
+    if (item == NULL) return ;
+    item->x = (item->sprite == NULL) ? x : (x & ~1) ;
+    item->y = y ;
+}
+
+// Empty the display list
+void vga_dl_clear() {
+    dl_count = 0 ;
+}
+
+#endif
+
+#ifdef VGA_LINE_RING
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Line ring ========================================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// A line has been sent to the PIO. Its buffer now gets the line that
+// will be sent VGA_SCANLINE_BUFFERS lines from now.
+static void HOT_ISR(vga_line_handler)() {
+    // DMA_IRQ_1 may be shared, so check that it's ours
+    if (!(dma_hw->ints1 & (1u << rgb_chan_0))) return ;
+    dma_hw->ints1 = (1u << rgb_chan_0) ;
+
+    int done = vga_scan_line ;
+    int next = (done + VGA_SCANLINE_BUFFERS) % NUM_LINES ;
+    renderLine(next, vga_line_buffers[vga_scan_slot]) ;
+
+    vga_scan_line = (done == (NUM_LINES - 1)) ? 0 : (done + 1) ;
+    vga_scan_slot = (vga_scan_slot + 1) & (VGA_SCANLINE_BUFFERS - 1) ;
+}
+
+#endif
+
+#if defined(VGA_LINE_RING) && !defined(VGA_SCANLINE_MODE)
+
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+// ============================== Pixel format expansion ===========================================
+/////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Rows of a 1, 4 or 8 bit/pixel array are converted to 3 bit/pixel
+// scanlines by table lookup, a byte (or a word) of the array at a time.
+// Each color value goes through a palette to one of the 8 output colors.
+// The default palette repeats the 8 colors of enum colors (at 1 bit/pixel,
+// off is BLACK and on is WHITE).
+#define PALETTE_SIZE (1 << VGA_BPP)
+static unsigned char vga_palette[PALETTE_SIZE] ;
+
+// Palette changes are made here, and copied into vga_palette (and the
+// expansion table rebuilt) just before line 0 is rendered, so a frame
+// never shows two palettes
+static unsigned char next_palette[PALETTE_SIZE] ;
+static volatile char palette_dirty = 0 ;
+
+#if VGA_BPP == 1
+// One byte of the array (8 pixels) becomes four bytes of scanline
+static uint32_t expand_table[256] ;
+#else
+// One byte of the array (a pixel pair, or one doubled pixel) becomes
+// one byte of scanline
+static unsigned char expand_table[256] ;
+#endif
+
+static void HOT_ISR(buildExpandTable)() {
+    for (int b=0; b<256; b++) {
+#if VGA_BPP == 1
+        uint32_t out = 0 ;
+        for (int k=0; k<4; k++) {
+            unsigned char p0 = vga_palette[(b >> (2*k)) & 1] ;
+            unsigned char p1 = vga_palette[(b >> (2*k + 1)) & 1] ;
+            out |= (uint32_t)(p0 | (p1 << 3)) << (8*k) ;
+        }
+        expand_table[b] = out ;
+#elif VGA_BPP == 4
+        expand_table[b] = vga_palette[b & 0xF] | (vga_palette[b >> 4] << 3) ;
+#else
+        expand_table[b] = vga_palette[b] | (vga_palette[b] << 3) ;
+#endif
+    }
+}
+
+static void initExpand() {
+    for (int i=0; i<PALETTE_SIZE; i++) {
+#if VGA_BPP == 1
+        vga_palette[i] = i ? WHITE : BLACK ;
+#else
+        vga_palette[i] = i & 0x7 ;
+#endif
+        next_palette[i] = vga_palette[i] ;
+    }
+    buildExpandTable() ;
+}
+
+// Expand the pixel array row holding screen line 'line' into a scanline
+static void HOT_ISR(renderLine)(short line, unsigned char * buf) {
+    // Top of a new frame, take any palette changes
+    if ((line == 0) && palette_dirty) {
+        palette_dirty = 0 ;
+        memcpy(vga_palette, next_palette, PALETTE_SIZE) ;
+        buildExpandTable() ;
+    }
+#ifdef VGA_SCROLL
+    // and any scroll change, then find the line scrolled into this one
+    if (line == 0) latchScroll() ;
+    line = scrollMap(line, scroll_top, scroll_bottom, scroll_offset) ;
+#endif
+
+    const unsigned char * row = &vga_data_array[ROW_INDEX(line) * LINE_BYTES] ;
+#if VGA_BPP == 1
+    uint32_t * out = (uint32_t *)buf ;
+    for (int i=0; i<LINE_BYTES; i++) {
+        out[i] = expand_table[row[i]] ;
+    }
+#else
+    // A word of the array at a time, a word of scanline out
+    const uint32_t * in = (const uint32_t *)row ;
+    uint32_t * out = (uint32_t *)buf ;
+    for (int i=0; i<(LINE_BYTES/4); i++) {
+        uint32_t w = in[i] ;
+        out[i] = expand_table[w & 0xFF] |
+                 (expand_table[(w >> 8) & 0xFF] << 8) |
+                 (expand_table[(w >> 16) & 0xFF] << 16) |
+                 ((uint32_t)expand_table[w >> 24] << 24) ;
+    }
+#endif
+}
+
+// Set palette entry 'index' to one of the 8 output colors. Like all the
+// palette functions, this takes effect at the start of the next frame.
+void vga_set_palette(int index, char color) {
+    if ((index < 0) || (index >= PALETTE_SIZE)) return ;
+    next_palette[index] = color & 0x7 ;
+    palette_dirty = 1 ;
+}
+
+// Set 'count' palette entries, starting at 'first', from an array of colors
+void vga_load_palette(int first, int count, const unsigned char * colors) {
+    for (int i=0; i<count; i++) {
+        if ((first + i) >= PALETTE_SIZE) break ;
+        next_palette[first + i] = colors[i] & 0x7 ;
+    }
+    palette_dirty = 1 ;
+}
+
+// Output color of palette entry 'index' (as of the next frame)
+char vga_get_palette(int index) {
+    if ((index < 0) || (index >= PALETTE_SIZE)) return BLACK ;
+    return next_palette[index] ;
+}
+
+// Rotate entries first through last by one place: each entry takes the
+// color of the one before it, and 'first' takes the color of 'last'.
+// Called once a frame, this cycles color bands without touching a pixel.
+void vga_cycle_palette(int first, int last) {
+    if ((first < 0) || (last >= PALETTE_SIZE) || (last <= first)) return ;
+    unsigned char wrapped = next_palette[last] ;
+    memmove(&next_palette[first + 1], &next_palette[first], last - first) ;
+    next_palette[first] = wrapped ;
+    palette_dirty = 1 ;
+}
+
+#endif
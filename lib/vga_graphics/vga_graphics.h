@@ -0,0 +1,355 @@
+/**
+ * Hunter Adams (vha3@cornell.edu)
+ * 
+ *
+ * HARDWARE CONNECTIONS (defaults, see VGA_HSYNC_PIN etc. below)
+ *  - GPIO 16 ---> VGA Hsync
+ *  - GPIO 17 ---> VGA Vsync
+ *  - GPIO 18 ---> 330 ohm resistor ---> VGA Red
+ *  - GPIO 19 ---> 330 ohm resistor ---> VGA Green
+ *  - GPIO 20 ---> 330 ohm resistor ---> VGA Blue
+ *  - RP2040 GND ---> VGA GND
+ *
+ * RESOURCES USED
+ *  - 3 PIO state machines on PIO instance 0, and 2 DMA channels, claimed
+ *    from lib/hw_claim in initVGA()
+ *  - 153.6 kBytes of RAM (for pixel color data; 38.4 kBytes with
+ *    VGA_LOW_RES)
+ *  - DMA_IRQ_1 (double-buffered, scrolling and low resolution modes, and
+ *    blitter)
+ *  - PIO0_IRQ_1 and PIO 0 IRQ flag 2 (frame counter)
+ *  - One more DMA channel, claimed on first use of the blitter
+ *  - PIO 0 IRQ flags 4 and 5 (between the state machines). These and
+ *    flag 2 are claimed from lib/hw_claim, so a driver using them on PIO 0
+ *    stops at startup saying so.
+ *  - SRAM for the interrupt handlers, line renderers and drawPixel, which
+ *    run from RAM rather than flash (see lib/hotpath)
+ *
+ * PIXEL FORMATS
+ *  - Set VGA_BPP (e.g. target_compile_definitions(app PRIVATE VGA_BPP=1))
+ *    to pick the pixel array format. Drawing coordinates stay 640x480
+ *    (see LOW RESOLUTION for 320x240 ones).
+ *      1: 640x480, on/off (any nonzero color is on), 38.4 kBytes
+ *      3: 640x480, the 8 colors of enum colors, 153.6 kBytes (default)
+ *      4: 640x480, 16 palette entries, 153.6 kBytes
+ *      8: 320x240 (2x2 screen pixels each), 256 palette entries, 76.8 kBytes
+ *  - Formats other than 3 are expanded to scanlines for the PIO through a
+ *    palette from DMA_IRQ_1 (like scanline mode), which takes a share of
+ *    the core that calls initVGA. The default palette repeats enum colors.
+ *  - Sprites for blitRect/grabRect are in the same format as the array.
+ *  - vga_set_palette()/vga_cycle_palette() remap colors for the next frame
+ *    without touching the pixel array (palette animation is free).
+ *
+ * SPRITES
+ *  - vga_sprite_add() makes a small bitmap (one color per byte, with a
+ *    transparent color) that can be moved about over the picture. Each
+ *    sprite saves the pixels it covers and puts them back when it moves,
+ *    so nothing underneath has to be redrawn.
+ *  - vga_sprite_move()/vga_sprite_show() only record the change; call
+ *    vga_sprites_update() once per frame to put them all on the screen.
+ *  - Drawing under a sprite that's shown is undone when it moves, so draw
+ *    the background first (or with the sprites hidden and updated).
+ *  - Not available with VGA_DOUBLE_BUFFER (or VGA_SCANLINE_MODE, which
+ *    has display-list sprites)
+ *
+ * STRIP CHARTS
+ *  - A vga_chart scrolls traces across a rectangle, a column at a time,
+ *    plotting each column as vertical spans from the smallest to the
+ *    largest of its samples (joined to the column before), so no peak
+ *    between columns is lost whatever the decimation.
+ *  - vga_chart_add() takes one sample for every trace, and is cheap
+ *    enough for an interrupt; vga_chart_draw() (in a thread, on either
+ *    core) draws the columns finished since, clearing only the pixels
+ *    each column held before. Sample and display rates are independent.
+ *  - Not available with VGA_DOUBLE_BUFFER (or VGA_SCANLINE_MODE)
+ *
+ * SCANLINE MODE
+ *  - Build with VGA_SCANLINE_MODE defined to drop the framebuffer. The DMA
+ *    channels stream a ring of VGA_SCANLINE_BUFFERS line buffers (default 8,
+ *    2.5 kBytes), refilled from DMA_IRQ_1 on the core that calls initVGA.
+ *  - Lines are rendered from a display list of rectangles and sprites, or by
+ *    a callback set with vga_set_line_callback(). The framebuffer drawing
+ *    primitives are not available in this mode.
+ *  - A line callback runs in the interrupt, so put it in RAM with
+ *    HOT_ISR() (hotpath.h) as well
+ *
+ * TEXT MODE
+ *  - Build with VGA_TEXT_MODE defined (implies VGA_SCANLINE_MODE) for an
+ *    80x60 map of 8x8 character cells, drawn into each scanline during
+ *    scanout. setCursor()/setTextColor2()/writeString() print into cells.
+ *  - The display list is drawn over the text.
+ *
+ * DAMAGE TRACKING
+ *  - Build with VGA_DAMAGE_TRACKING defined to have every primitive
+ *    record which pixels it changed, per row. Query and reset with the
+ *    vga_damage_* functions.
+ *
+ * DOUBLE-BUFFERED MODE
+ *  - Build with VGA_DOUBLE_BUFFER defined (e.g. target_compile_definitions)
+ *  - Two 640x240 buffers share the 153.6 kBytes. Each buffer row is
+ *    scanned out twice, so the drawing API keeps 640x480 coordinates
+ *  - Primitives draw to the back buffer, vga_swap_buffers() shows it
+ *
+ * LOW RESOLUTION
+ *  - Build with VGA_LOW_RES defined for a 320x240 picture of 8 colors,
+ *    each pixel shown as 2x2 on the 640x480 screen: the rgb_double PIO
+ *    program holds each pixel for two pixel times, and the line list the
+ *    DMA walks has each row twice. The array is 38.4 kBytes.
+ *  - Drawing coordinates are 320x240 (VGA_WIDTH x VGA_HEIGHT), so every
+ *    primitive writes a quarter of the bytes it would at 640x480. An app
+ *    that draws in 640x480 coordinates (the Mandelbrot demos) needs
+ *    porting first; Game_of_Life and Barnsley_Fern size their drawing
+ *    from VGA_WIDTH and VGA_HEIGHT.
+ *  - Works with VGA_DOUBLE_BUFFER (two whole 320x240 buffers, 76.8
+ *    kBytes), VGA_SCROLL and VGA_DAMAGE_TRACKING, not with VGA_BPP other
+ *    than 3 or VGA_SCANLINE_MODE
+ *  - Uses DMA_IRQ_1 at the end of each frame, to restart the list
+ *
+ * SCROLLING
+ *  - Build with VGA_SCROLL defined to scroll a band of screen lines in
+ *    place: vga_set_scroll_region(top, bottom), then vga_scroll(n) moves
+ *    its contents up n lines at the next frame, wrapping around. Only the
+ *    line addresses the DMA reads change; no pixels are copied.
+ *  - At 3 bits/pixel the array is scanned out through a list of line
+ *    addresses (1.9 kBytes), rewritten from DMA_IRQ_1 in vertical blanking
+ *  - Primitives keep drawing in unscrolled coordinates. vga_scroll_line(y)
+ *    gives the drawing line that screen line y shows.
+ *  - Not available with VGA_SCANLINE_MODE or VGA_DOUBLE_BUFFER
+ *
+ * FRAME PACING
+ *  - The vsync PIO program raises an interrupt (PIO0_IRQ_1, on the core
+ *    that calls initVGA) at the start of each vertical blanking interval,
+ *    which counts frames: vga_frame(). A protothread paces itself to the
+ *    display with PT_YIELD_UNTIL_VBLANK(frame, n), drawing every n-th
+ *    refresh, and vga_frame_overrun() says if a frame took too long.
+ *  - Blanking lasts 45 lines (1.4 ms), so work done straight after the
+ *    yield (e.g. vga_sprites_update()) is off the screen while it happens
+ *
+ * NOTE
+ *  - This is a translation of the display primitives
+ *    for the PIC32 written by Bruce Land and students
+ *
+ */
+
+
+// The pins can be moved per app (vga_graphics_config in CMake, or
+// target_compile_definitions). The color pins must be consecutive.
+#ifndef VGA_HSYNC_PIN
+#define VGA_HSYNC_PIN 16
+#endif
+#ifndef VGA_VSYNC_PIN
+#define VGA_VSYNC_PIN 17
+#endif
+#ifndef VGA_RGB_PIN
+#define VGA_RGB_PIN 18      // red, then green and blue on the next two
+#endif
+
+// Give the I/O pins that we're using some names that make sense - usable in main()
+enum vga_pins {HSYNC=VGA_HSYNC_PIN, VSYNC=VGA_VSYNC_PIN, RED_PIN=VGA_RGB_PIN, GREEN_PIN, BLUE_PIN} ;
+
+// We can only produce 8 (3-bit) colors, so let's give them readable names - usable in main()
+enum colors {BLACK, RED, GREEN, YELLOW, BLUE, MAGENTA, CYAN, WHITE} ;
+
+// Bits per pixel of the pixel array (see PIXEL FORMATS above)
+#ifndef VGA_BPP
+#define VGA_BPP 3
+#endif
+
+// Size of the picture, in drawing coordinates (see LOW RESOLUTION above)
+#ifndef VGA_LOW_RES
+#define VGA_WIDTH  640
+#define VGA_HEIGHT 480
+#else
+#define VGA_WIDTH  320
+#define VGA_HEIGHT 240
+#endif
+
+// Text mode is built on scanline mode
+#if defined(VGA_TEXT_MODE) && !defined(VGA_SCANLINE_MODE)
+#define VGA_SCANLINE_MODE
+#endif
+
+// VGA primitives - usable in main
+void initVGA(void) ;
+#if !defined(VGA_SCANLINE_MODE) || defined(VGA_TEXT_MODE)
+void setCursor(short x, short y);
+void setTextColor(char c);
+void setTextColor2(char c, char bg);
+void setTextSize(unsigned char s);
+void setTextWrap(char w);
+void tft_write(unsigned char c) ;
+void writeString(char* str) ;
+#endif
+#ifndef VGA_SCANLINE_MODE
+void drawPixel(short x, short y, char color) ;
+void drawVLine(short x, short y, short h, char color) ;
+void drawHLine(short x, short y, short w, char color) ;
+void drawLine(short x0, short y0, short x1, short y1, char color) ;
+void drawRect(short x, short y, short w, short h, char color);
+void drawCircle(short x0, short y0, short r, char color) ;
+void drawCircleHelper( short x0, short y0, short r, unsigned char cornername, char color) ;
+void fillCircle(short x0, short y0, short r, char color) ;
+void fillCircleHelper(short x0, short y0, short r, unsigned char cornername, short delta, char color) ;
+void drawRoundRect(short x, short y, short w, short h, short r, char color) ;
+void fillRoundRect(short x, short y, short w, short h, short r, char color) ;
+void fillRect(short x, short y, short w, short h, char color) ;
+void drawChar(short x, short y, unsigned char c, char color, char bg, unsigned char size) ;
+
+// DMA blitter - usable in main. These return before the blit is done;
+// use blitBusy()/blitWait() (or a callback) before touching the area.
+void clearScreen(char color) ;
+void dmaFillRect(short x, short y, short w, short h, char color) ;
+void blitRect(short x, short y, short w, short h, const unsigned char * sprite) ;
+void grabRect(short x, short y, short w, short h, unsigned char * sprite) ;
+char blitBusy(void) ;
+void blitWait(void) ;
+void setBlitCallback(void (*callback)(void)) ;
+// Move the picture by (dx, dy), e.g. to pan. Unlike the blits, this
+// returns when it is done (see vga_graphics.c).
+void shiftScreen(short dx, short dy) ;
+#endif
+
+// Sprites with save-under (framebuffer modes other than VGA_DOUBLE_BUFFER)
+// - usable in main
+#if !defined(VGA_SCANLINE_MODE) && !defined(VGA_DOUBLE_BUFFER)
+#ifndef VGA_SPRITE_MAX
+#define VGA_SPRITE_MAX 32           // sprites
+#endif
+#ifndef VGA_SPRITE_UNDER_BYTES
+#define VGA_SPRITE_UNDER_BYTES 4096 // pixels of all the sprites together
+#endif
+int vga_sprite_add(short w, short h, const unsigned char * image, int transparent) ;
+void vga_sprite_move(int handle, short x, short y) ;
+void vga_sprite_show(int handle, char visible) ;
+void vga_sprite_set_image(int handle, const unsigned char * image) ;
+void vga_sprites_update(void) ;
+void vga_sprites_clear(void) ;
+
+// Strip charts (the same modes) - usable in main
+#ifndef VGA_CHART_TRACES
+#define VGA_CHART_TRACES 4          // traces per chart
+#endif
+#ifndef VGA_CHART_PENDING
+#define VGA_CHART_PENDING 32        // columns waiting to be drawn (a power of two)
+#endif
+#ifndef VGA_CHART_MAX_W
+#define VGA_CHART_MAX_W 640         // widest chart (pixels)
+#endif
+// The samples of one column of a chart: their range, and the last one
+typedef struct {
+    int min[VGA_CHART_TRACES] ;
+    int max[VGA_CHART_TRACES] ;
+    int last[VGA_CHART_TRACES] ;
+} vga_chart_column ;
+typedef struct {
+    short x, y, w, h ;                  // plot area
+    int lo ;                            // value at the bottom edge
+    int scale ;                         // pixels per unit of value, 16.16
+    char background ;
+    int traces ;
+    char color[VGA_CHART_TRACES] ;
+    int decimation ;                    // samples per column
+    // The column being gathered (vga_chart_add)
+    int n ;
+    vga_chart_column gather ;
+    // Columns gathered, waiting for vga_chart_draw
+    vga_chart_column pending[VGA_CHART_PENDING] ;
+    volatile unsigned int head, tail ;
+    unsigned int dropped ;              // columns lost with pending full
+    // What's on the screen
+    short column ;                      // next column to draw
+    char started ;
+    int prev[VGA_CHART_TRACES] ;        // last sample of the column before
+    short span_top[VGA_CHART_MAX_W] ;   // pixels drawn in each column
+    short span_bottom[VGA_CHART_MAX_W] ;
+} vga_chart ;
+void vga_chart_init(vga_chart * chart, short x, short y, short w, short h, int lo, int hi, char background) ;
+int vga_chart_add_trace(vga_chart * chart, char color) ;
+void vga_chart_set_decimation(vga_chart * chart, int samples_per_column) ;
+void vga_chart_add(vga_chart * chart, const int * values) ;
+int vga_chart_draw(vga_chart * chart) ;
+#endif
+
+// Scanline mode (VGA_SCANLINE_MODE) - usable in main
+#ifdef VGA_SCANLINE_MODE
+#ifndef VGA_DL_MAX
+#define VGA_DL_MAX 64   // display list length
+#endif
+// Called with a screen line number and a 320-byte buffer of packed pixels to fill
+typedef void (*vga_line_callback_t)(short line, unsigned char * buf) ;
+// A display list entry: a filled rectangle, or a sprite if sprite != NULL
+typedef struct {
+    short x, y, w, h ;
+    char color ;
+    char visible ;
+    const unsigned char * sprite ;
+} vga_dl_item ;
+void vga_set_line_callback(vga_line_callback_t callback) ;
+void vga_dl_set_background(char color) ;
+int vga_dl_add_rect(short x, short y, short w, short h, char color) ;
+int vga_dl_add_sprite(short x, short y, short w, short h, const unsigned char * sprite) ;
+vga_dl_item * vga_dl_item_at(int handle) ;
+void vga_dl_move(int handle, short x, short y) ;
+void vga_dl_clear(void) ;
+#endif
+
+// Frame pacing - usable in main. vga_frame() counts refreshes (60 Hz),
+// going up at the start of each vertical blanking interval.
+unsigned int vga_frame(void) ;
+char vga_frame_overrun(unsigned int frame, unsigned int n) ;
+void vga_wait_vblank(void) ;
+// In a protothread, yield until vertical blanking n refreshes after
+// 'frame' (an unsigned int the thread keeps from one frame to the next,
+// first set from vga_frame()), then set 'frame' to the refresh starting,
+// so that the thread draws once every n refreshes. If that one has already
+// started (vga_frame_overrun(frame, n) - the frame took too long), it
+// carries on drawing from the current refresh rather than catching up.
+#define PT_YIELD_UNTIL_VBLANK(frame, n) \
+    do { \
+        (frame) = vga_frame_overrun((frame), (n)) ? vga_frame() : (frame) + (n) ; \
+        PT_YIELD_UNTIL(pt, (int)(vga_frame() - (frame)) >= 0) ; \
+    } while (0)
+
+// Palette (VGA_BPP 1, 4 or 8) - usable in main
+#if (VGA_BPP != 3)
+void vga_set_palette(int index, char color) ;
+void vga_load_palette(int first, int count, const unsigned char * colors) ;
+char vga_get_palette(int index) ;
+void vga_cycle_palette(int first, int last) ;
+#endif
+
+// Text mode (VGA_TEXT_MODE) - usable in main
+#ifdef VGA_TEXT_MODE
+#define TEXT_COLS 80
+#define TEXT_ROWS 60
+void vga_text_enable(char on) ;
+void vga_text_putc(short col, short row, unsigned char c, char color, char bg) ;
+short vga_text_write(short col, short row, const char * str, char color, char bg) ;
+void vga_text_clear(char color, char bg) ;
+void vga_text_render_line(short line, unsigned char * buf) ;
+#endif
+
+// Double-buffered mode (VGA_DOUBLE_BUFFER) - usable in main
+#ifdef VGA_DOUBLE_BUFFER
+void vga_swap_buffers(void) ;
+void vga_request_swap(void) ;
+char vga_swap_pending(void) ;
+#endif
+
+// Scrolling (VGA_SCROLL) - usable in main
+#ifdef VGA_SCROLL
+void vga_set_scroll_region(short top, short bottom) ;
+void vga_scroll(short lines) ;
+short vga_scroll_line(short y) ;
+char vga_scroll_pending(void) ;
+#endif
+
+// Damage tracking (VGA_DAMAGE_TRACKING) - usable in main
+#ifdef VGA_DAMAGE_TRACKING
+void vga_damage_reset(void) ;
+char vga_damage_line(short y, short * x0, short * x1) ;
+char vga_damage_bounds(short * x0, short * y0, short * x1, short * y1) ;
+#ifdef VGA_DOUBLE_BUFFER
+void vga_sync_back_buffer(void) ;
+#endif
+#endif
\ No newline at end of file